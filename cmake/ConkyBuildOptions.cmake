@@ -85,6 +85,10 @@ mark_as_advanced(RELEASE)
 
 option(MAINTAINER_MODE "Enable maintainer mode" false)
 
+option(BUILD_PERF_TESTS
+       "Check the frame budgets of tests/perf with ctest (needs BUILD_TESTS)"
+       false)
+
 option(BUILD_DOCS "Build documentation" false)
 option(BUILD_EXTRAS "Build extras (includes syntax files for editors)" false)
 
@@ -132,11 +136,13 @@ if(OS_LINUX)
     # nvidia may also work on FreeBSD, not sure
     option(BUILD_NVIDIA "Enable nvidia support" false)
   endif(BUILD_X11)
+  option(BUILD_NVML "Enable the NVML backend for the nvidia objects" false)
 else(OS_LINUX)
   set(BUILD_PORT_MONITORS false)
   set(BUILD_IBM false)
   set(BUILD_HDDTEMP false)
   set(BUILD_NVIDIA false)
+  set(BUILD_NVML false)
   set(BUILD_IPV6 false)
 endif(OS_LINUX)
 
@@ -189,7 +195,9 @@ if(BUILD_X11)
   endif(OS_DARWIN)
 
   option(BUILD_XINERAMA "Build Xinerama support" true)
+  option(BUILD_XRANDR "Build XRandR (screen change) support" true)
   option(BUILD_XDBE "Build Xdbe (double-buffer) support" true)
+  option(BUILD_XDPMS "Build DPMS (monitor power) support" true)
   option(BUILD_XFT "Build Xft (freetype fonts) support" true)
   option(BUILD_IMLIB2 "Enable Imlib2 support" true)
   option(BUILD_XSHAPE "Enable Xshape support" true)
@@ -197,7 +205,10 @@ else(BUILD_X11)
   set(OWN_WINDOW false CACHE BOOL "Enable own_window support" FORCE)
   set(BUILD_XDAMAGE false CACHE BOOL "Build Xdamage support" FORCE)
   set(BUILD_XINERAMA false CACHE BOOL "Build Xinerama support" FORCE)
+  set(BUILD_XRANDR false CACHE BOOL "Build XRandR (screen change) support"
+      FORCE)
   set(BUILD_XDBE false CACHE BOOL "Build Xdbe (double-buffer) support" FORCE)
+  set(BUILD_XDPMS false CACHE BOOL "Build DPMS (monitor power) support" FORCE)
   set(BUILD_XFT false CACHE BOOL "Build Xft (freetype fonts) support" FORCE)
   set(BUILD_IMLIB2 false CACHE BOOL "Enable Imlib2 support" FORCE)
   set(BUILD_XSHAPE false CACHE BOOL "Enable Xshape support" FORCE)
@@ -34,6 +34,8 @@ check_function_exists(strndup HAVE_STRNDUP)
 
 check_symbol_exists(pipe2 "unistd.h" HAVE_PIPE2)
 check_symbol_exists(O_CLOEXEC "fcntl.h" HAVE_O_CLOEXEC)
+check_symbol_exists(malloc_usable_size "malloc.h" HAVE_MALLOC_USABLE_SIZE)
+check_symbol_exists(mallinfo2 "malloc.h" HAVE_MALLINFO2)
 
 if(CMAKE_SYSTEM_NAME MATCHES "Darwin")
   check_symbol_exists(statfs64 "sys/mount.h" HAVE_STATFS64)
@@ -319,6 +321,13 @@ if(BUILD_X11)
       set(conky_libs ${conky_libs} ${X11_Xdamage_LIB} ${X11_Xfixes_LIB})
     endif(BUILD_XDAMAGE)
 
+    if(BUILD_XRANDR)
+      if(NOT X11_Xrandr_FOUND)
+        message(FATAL_ERROR "Unable to find Xrandr library")
+      endif(NOT X11_Xrandr_FOUND)
+      set(conky_libs ${conky_libs} ${X11_Xrandr_LIB})
+    endif(BUILD_XRANDR)
+
     if(BUILD_XSHAPE)
       if(NOT X11_Xshape_FOUND)
         message(FATAL_ERROR "Unable to find Xshape library")
@@ -347,6 +356,14 @@ if(BUILD_X11)
       endif(NOT X11_Xext_FOUND)
       set(conky_libs ${conky_libs} ${X11_Xext_LIB})
     endif(BUILD_XDBE)
+
+    # check for DPMS, which is part of Xext as well
+    if(BUILD_XDPMS)
+      if(NOT X11_dpms_FOUND)
+        message(FATAL_ERROR "Unable to find Xext library (needed for DPMS)")
+      endif(NOT X11_dpms_FOUND)
+      set(conky_libs ${conky_libs} ${X11_Xext_LIB})
+    endif(BUILD_XDPMS)
   else(X11_FOUND)
     message(FATAL_ERROR "Unable to find X11 library")
   endif(X11_FOUND)
@@ -436,6 +453,19 @@ if(BUILD_NVIDIA)
   endif(XNVCtrl_INCLUDE_PATH AND XNVCtrl_LIB)
 endif(BUILD_NVIDIA)
 
+if(BUILD_NVML)
+  find_path(NVML_INCLUDE_PATH nvml.h ${INCLUDE_SEARCH_PATH}
+            PATH_SUFFIXES cuda)
+  find_library(NVML_LIB NAMES nvidia-ml)
+  if(NVML_INCLUDE_PATH AND NVML_LIB)
+    set(NVML_FOUND true)
+    set(conky_libs ${conky_libs} ${NVML_LIB})
+    set(conky_includes ${conky_includes} ${NVML_INCLUDE_PATH})
+  else(NVML_INCLUDE_PATH AND NVML_LIB)
+    message(FATAL_ERROR "Unable to find NVML library")
+  endif(NVML_INCLUDE_PATH AND NVML_LIB)
+endif(BUILD_NVML)
+
 if(BUILD_IMLIB2)
   pkg_search_module(IMLIB2 REQUIRED imlib2 Imlib2)
   set(conky_libs ${conky_libs} ${IMLIB2_LIBS} ${IMLIB2_LDFLAGS})
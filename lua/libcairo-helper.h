@@ -25,7 +25,9 @@
 #ifndef _LIBCAIRO_HELPER_H_
 #define _LIBCAIRO_HELPER_H_
 
+#include <cairo-xlib.h>
 #include <cairo.h>
+#include <string.h>
 
 cairo_text_extents_t *create_cairo_text_extents_t(void) {
   return calloc(1, sizeof(cairo_text_extents_t));
@@ -49,4 +51,163 @@ void destroy_cairo_font_extents_t(cairo_font_extents_t *pointer) {
 
 void destroy_cairo_matrix_t(cairo_matrix_t *pointer) { free(pointer); }
 
+/* The conky window surface: scripts draw into an image surface kept across
+ * frames, which cairo_conky_surface_end() sends to the window in one go
+ * (through XShm where the X server supports it) instead of one X request per
+ * primitive. */
+static cairo_surface_t *conky_image_surface = NULL;
+static cairo_surface_t *conky_window_surface = NULL;
+
+static void destroy_conky_surfaces(void) {
+  if (conky_image_surface != NULL) {
+    cairo_surface_destroy(conky_image_surface);
+    conky_image_surface = NULL;
+  }
+  if (conky_window_surface != NULL) {
+    cairo_surface_destroy(conky_window_surface);
+    conky_window_surface = NULL;
+  }
+}
+
+cairo_surface_t *cairo_conky_surface_begin(Display *dpy, Drawable drawable,
+                                           Visual *visual, int width,
+                                           int height) {
+  cairo_t *cr;
+
+  if (conky_window_surface != NULL &&
+      (cairo_xlib_surface_get_display(conky_window_surface) != dpy ||
+       cairo_xlib_surface_get_visual(conky_window_surface) != visual ||
+       cairo_image_surface_get_width(conky_image_surface) != width ||
+       cairo_image_surface_get_height(conky_image_surface) != height)) {
+    destroy_conky_surfaces();
+  }
+
+  if (conky_window_surface == NULL) {
+    conky_window_surface =
+        cairo_xlib_surface_create(dpy, drawable, visual, width, height);
+    conky_image_surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  } else if (cairo_xlib_surface_get_drawable(conky_window_surface) !=
+             drawable) {
+    cairo_xlib_surface_set_drawable(conky_window_surface, drawable, width,
+                                    height);
+  }
+
+  /* start every frame from a transparent surface */
+  cr = cairo_create(conky_image_surface);
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+
+  /* the caller's cairo_surface_destroy() only drops this reference */
+  return cairo_surface_reference(conky_image_surface);
+}
+
+void cairo_conky_surface_end(void) {
+  cairo_t *cr;
+
+  if (conky_window_surface == NULL) { return; }
+
+  cairo_surface_flush(conky_image_surface);
+  cr = cairo_create(conky_window_surface);
+  cairo_set_source_surface(cr, conky_image_surface, 0, 0);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(conky_window_surface);
+}
+
+/*
+ * Bulk drawing: widgets hand over a whole path in one call from Lua instead
+ * of making one call per point, arc or rectangle. The arrays are flat tables
+ * of numbers and n is their length; a trailing incomplete record is
+ * ignored.
+ */
+
+/* Adds a path through the points x1, y1, x2, y2, ... and closes it if close
+ * is non-zero. */
+void cairo_polyline(cairo_t *cr, int n, const double *points, int close) {
+  int i;
+
+  if (n < 2) { return; }
+  cairo_move_to(cr, points[0], points[1]);
+  for (i = 2; i + 1 < n; i += 2) {
+    cairo_line_to(cr, points[i], points[i + 1]);
+  }
+  if (close) { cairo_close_path(cr); }
+}
+
+/* Adds the path of a graph whose i-th value is drawn values[i] * scale
+ * above the baseline y, at x + i * dx. With fill non-zero the path runs
+ * down to the baseline at both ends and is closed, ready for cairo_fill(). */
+void cairo_graph_path(cairo_t *cr, double x, double y, double dx,
+                      double scale, int n, const double *values, int fill) {
+  int i;
+
+  if (n < 1) { return; }
+  if (fill) {
+    cairo_move_to(cr, x, y);
+    cairo_line_to(cr, x, y - values[0] * scale);
+  } else {
+    cairo_move_to(cr, x, y - values[0] * scale);
+  }
+  for (i = 1; i < n; ++i) {
+    cairo_line_to(cr, x + i * dx, y - values[i] * scale);
+  }
+  if (fill) {
+    cairo_line_to(cr, x + (n - 1) * dx, y);
+    cairo_close_path(cr);
+  }
+}
+
+/* Adds one sub-path per arc, of 5 numbers each: xc, yc, radius, angle1 and
+ * angle2 as for cairo_arc(). */
+void cairo_arcs(cairo_t *cr, int n, const double *arcs) {
+  int i;
+
+  for (i = 0; i + 4 < n; i += 5) {
+    cairo_new_sub_path(cr);
+    cairo_arc(cr, arcs[i], arcs[i + 1], arcs[i + 2], arcs[i + 3], arcs[i + 4]);
+  }
+}
+
+/* Strokes arcs in order, of 10 numbers each: xc, yc, radius, angle1, angle2,
+ * the line width and the red, green, blue and alpha of the colour, e.g. the
+ * background and the indicator of a ring. Arcs in a row with the same width
+ * and colour are stroked together. The line width and the source are left
+ * at those of the last arc. */
+void cairo_stroke_arcs(cairo_t *cr, int n, const double *arcs) {
+  int i;
+
+  cairo_new_path(cr);
+  for (i = 0; i + 9 < n; i += 10) {
+    const double *a = arcs + i;
+    cairo_new_sub_path(cr);
+    cairo_arc(cr, a[0], a[1], a[2], a[3], a[4]);
+    if (i + 19 < n && memcmp(a + 5, a + 15, 5 * sizeof(double)) == 0) {
+      continue;
+    }
+    cairo_set_line_width(cr, a[5]);
+    cairo_set_source_rgba(cr, a[6], a[7], a[8], a[9]);
+    cairo_stroke(cr);
+  }
+}
+
+/* Fills rectangles, of 8 numbers each: x, y, width, height and the red,
+ * green, blue and alpha of the colour. Rectangles in a row with the same
+ * colour are filled together. The source is left at the last colour. */
+void cairo_fill_rectangles(cairo_t *cr, int n, const double *rects) {
+  int i;
+
+  cairo_new_path(cr);
+  for (i = 0; i + 7 < n; i += 8) {
+    const double *r = rects + i;
+    cairo_rectangle(cr, r[0], r[1], r[2], r[3]);
+    if (i + 15 < n && memcmp(r + 4, r + 12, 4 * sizeof(double)) == 0) {
+      continue;
+    }
+    cairo_set_source_rgba(cr, r[4], r[5], r[6], r[7]);
+    cairo_fill(cr);
+  }
+}
+
 #endif /* _LIBCAIRO_HELPER_H_ */
@@ -27,28 +27,41 @@
 
 #include <Imlib2.h>
 #include <cairo.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
-void cairo_draw_image(const char *file, cairo_surface_t *cs, int x, int y,
-                      double scale_x, double scale_y, double *return_scale_w,
-                      double *return_scale_h) {
-  int w, h;
-  double scaled_w, scaled_h;
+/* Loads file scaled by scale_x and scale_y into a new image surface with
+ * premultiplied alpha, as cairo wants it. Sets *w and *h to the scaled size.
+ * Returns NULL if the file can't be loaded. */
+static cairo_surface_t *load_premultiplied_surface(const char *file,
+                                                   double scale_x,
+                                                   double scale_y, double *w,
+                                                   double *h) {
+  int image_w, image_h, scaled_w, scaled_h, row;
   Imlib_Image premul;
   cairo_surface_t *result;
-  cairo_t *cr;
+  const unsigned char *src;
+  unsigned char *dst;
+  int dst_stride;
   Imlib_Image *image = imlib_load_image(file);
-  if (!image) { return; }
+  if (!image) { return NULL; }
 
   imlib_context_set_image(image);
-  w = imlib_image_get_width();
-  h = imlib_image_get_height();
+  image_w = imlib_image_get_width();
+  image_h = imlib_image_get_height();
 
-  scaled_w = *return_scale_w = scale_x * (double)w;
-  scaled_h = *return_scale_h = scale_y * (double)h;
+  *w = scale_x * (double)image_w;
+  *h = scale_y * (double)image_h;
+  scaled_w = *w;
+  scaled_h = *h;
 
   /* create temporary image */
   premul = imlib_create_image(scaled_w, scaled_h);
-  /* FIXME: add error handling */
+  if (!premul) {
+    imlib_free_image();
+    return NULL;
+  }
 
   /* fill with opaque black */
   imlib_context_set_image(premul);
@@ -57,27 +70,147 @@ void cairo_draw_image(const char *file, cairo_surface_t *cs, int x, int y,
 
   /* blend source image on top -
    * in effect this multiplies the rgb values by alpha */
-  imlib_blend_image_onto_image(image, 0, 0, 0, w, h, 0, 0, scaled_w, scaled_h);
+  imlib_blend_image_onto_image(image, 0, 0, 0, image_w, image_h, 0, 0,
+                               scaled_w, scaled_h);
 
   /* and use the alpha channel of the source image */
   imlib_image_copy_alpha_to_image(image, 0, 0);
 
-  /* now pass the result to cairo */
-  result = cairo_image_surface_create_for_data(
-      (void *)imlib_image_get_data_for_reading_only(), CAIRO_FORMAT_ARGB32,
-      scaled_w, scaled_h, sizeof(DATA32) * scaled_w);
-
-  cr = cairo_create(cs);
-  cairo_set_source_surface(cr, result, x, y);
-  cairo_paint(cr);
+  /* now copy the result into a surface of cairo's own, so it outlives the
+   * imlib2 images */
+  result = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, scaled_w, scaled_h);
+  cairo_surface_flush(result);
+  src = (const unsigned char *)imlib_image_get_data_for_reading_only();
+  dst = cairo_image_surface_get_data(result);
+  dst_stride = cairo_image_surface_get_stride(result);
+  if (dst != NULL) {
+    for (row = 0; row < scaled_h; ++row) {
+      memcpy(dst + row * dst_stride, src + row * scaled_w * sizeof(DATA32),
+             scaled_w * sizeof(DATA32));
+    }
+  }
+  cairo_surface_mark_dirty(result);
 
-  imlib_context_set_image(image);
   imlib_free_image();
-  imlib_context_set_image(premul);
+  imlib_context_set_image(image);
   imlib_free_image();
 
+  return result;
+}
+
+static void paint_surface(cairo_surface_t *cs, cairo_surface_t *image, int x,
+                          int y) {
+  cairo_t *cr = cairo_create(cs);
+  cairo_set_source_surface(cr, image, x, y);
+  cairo_paint(cr);
   cairo_destroy(cr);
+}
+
+void cairo_draw_image(const char *file, cairo_surface_t *cs, int x, int y,
+                      double scale_x, double scale_y, double *return_scale_w,
+                      double *return_scale_h) {
+  cairo_surface_t *result = load_premultiplied_surface(
+      file, scale_x, scale_y, return_scale_w, return_scale_h);
+  if (!result) { return; }
+
+  paint_surface(cs, result, x, y);
   cairo_surface_destroy(result);
 }
 
+/*
+ * The surfaces cairo_draw_image_cached() made, keyed on the path, the
+ * file's mtime and the scale. A script drawing the same icons every frame
+ * then pays for one stat() and one cairo_paint() per icon. The least
+ * recently drawn entry makes room once the cache is full.
+ */
+#define IMAGE_CACHE_SIZE 64
+
+struct cached_image {
+  char *path;
+  time_t mtime;
+  double scale_x, scale_y;
+  double w, h;
+  cairo_surface_t *surface;
+  unsigned long last_used;
+};
+
+static struct cached_image image_cache[IMAGE_CACHE_SIZE];
+static unsigned long image_cache_clock = 0;
+
+static void free_cached_image(struct cached_image *entry) {
+  free(entry->path);
+  cairo_surface_destroy(entry->surface);
+  memset(entry, 0, sizeof(*entry));
+}
+
+/* Drops the cached surfaces of file at any scale, or of every file if file
+ * is NULL. */
+void cairo_image_cache_evict(const char *file) {
+  int i;
+
+  for (i = 0; i < IMAGE_CACHE_SIZE; ++i) {
+    struct cached_image *e = &image_cache[i];
+    if (e->path != NULL && (file == NULL || strcmp(e->path, file) == 0)) {
+      free_cached_image(e);
+    }
+  }
+}
+
+void cairo_draw_image_cached(const char *file, cairo_surface_t *cs, int x,
+                             int y, double scale_x, double scale_y,
+                             double *return_scale_w, double *return_scale_h) {
+  struct stat st;
+  struct cached_image *entry = NULL;
+  struct cached_image *oldest = &image_cache[0];
+  int i;
+
+  if (stat(file, &st) != 0) {
+    cairo_image_cache_evict(file);
+    return;
+  }
+
+  for (i = 0; i < IMAGE_CACHE_SIZE; ++i) {
+    struct cached_image *e = &image_cache[i];
+    if (e->path == NULL) {
+      if (oldest->path != NULL) { oldest = e; }
+      continue;
+    }
+    if (strcmp(e->path, file) == 0 && e->scale_x == scale_x &&
+        e->scale_y == scale_y) {
+      entry = e;
+      break;
+    }
+    if (oldest->path != NULL && e->last_used < oldest->last_used) {
+      oldest = e;
+    }
+  }
+
+  if (entry != NULL && entry->mtime != st.st_mtime) {
+    /* the file changed, load it again in the same place */
+    free_cached_image(entry);
+    oldest = entry;
+    entry = NULL;
+  }
+  if (entry == NULL) {
+    double w, h;
+    cairo_surface_t *surface =
+        load_premultiplied_surface(file, scale_x, scale_y, &w, &h);
+    if (!surface) { return; }
+    if (oldest->path != NULL) { free_cached_image(oldest); }
+    entry = oldest;
+    entry->path = strdup(file);
+    entry->mtime = st.st_mtime;
+    entry->scale_x = scale_x;
+    entry->scale_y = scale_y;
+    entry->w = w;
+    entry->h = h;
+    entry->surface = surface;
+  }
+
+  entry->last_used = ++image_cache_clock;
+  *return_scale_w = entry->w;
+  *return_scale_h = entry->h;
+  paint_surface(cs, entry->surface, x, y);
+}
+
 #endif /* _LIBCAIRO_IMAGE_HELPER_H_ */
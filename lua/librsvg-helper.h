@@ -28,6 +28,8 @@
 #include <glib.h>
 #include <librsvg/rsvg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 
 RsvgDimensionData *rsvg_dimension_data_create(void) {
   return (RsvgDimensionData *)calloc(1, sizeof(RsvgDimensionData));
@@ -118,4 +120,141 @@ void rsvg_rectangle_get(RsvgRectangle *rect, double *x, double *y,
   }
 }
 
+/*
+ * Rendered SVGs, keyed on the path, the id of the element drawn (empty for
+ * the whole document), the size and the file's mtime. Scripts drawing the
+ * same icons or gauge faces every frame only render them again when the
+ * file or the size changes. The least recently drawn entry makes room once
+ * the cache is full.
+ */
+#define RSVG_CACHE_SIZE 32
+
+struct rsvg_cached {
+  char *path;
+  char *id;
+  time_t mtime;
+  int width, height;
+  cairo_surface_t *surface;
+  unsigned long last_used;
+};
+
+static struct rsvg_cached rsvg_cache[RSVG_CACHE_SIZE];
+static unsigned long rsvg_cache_clock = 0;
+
+static void rsvg_free_cached(struct rsvg_cached *entry) {
+  free(entry->path);
+  free(entry->id);
+  cairo_surface_destroy(entry->surface);
+  memset(entry, 0, sizeof(*entry));
+}
+
+/* renders id of file, or all of it for NULL, into a new width x height
+ * image surface; NULL if the file can't be read or rendered */
+static cairo_surface_t *rsvg_rasterize(const char *file, const char *id,
+                                       int width, int height) {
+  RsvgHandle *handle = rsvg_create_handle_from_file(file);
+  RsvgRectangle viewport = {0, 0, (double)width, (double)height};
+  cairo_surface_t *surface;
+  cairo_t *cr;
+  gboolean ok;
+
+  if (!handle) { return NULL; }
+  surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+  cr = cairo_create(surface);
+  if (id != NULL) {
+    ok = rsvg_handle_render_layer(handle, cr, id, &viewport, NULL);
+  } else {
+    ok = rsvg_handle_render_document(handle, cr, &viewport, NULL);
+  }
+  cairo_destroy(cr);
+  g_object_unref(handle);
+
+  if (!ok) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  return surface;
+}
+
+/* Drops the rendered surfaces of file at any size, or of every file if file
+ * is NULL. */
+void rsvg_cache_evict(const char *file) {
+  int i;
+
+  for (i = 0; i < RSVG_CACHE_SIZE; ++i) {
+    struct rsvg_cached *e = &rsvg_cache[i];
+    if (e->path != NULL && (file == NULL || strcmp(e->path, file) == 0)) {
+      rsvg_free_cached(e);
+    }
+  }
+}
+
+/*
+ * Paints the element id of file (all of it if id is NULL or empty) scaled to
+ * width x height pixels, with its top left corner at x, y of cr. It is
+ * rendered once for each size and kept until the file changes. Returns 0 if
+ * the file can't be rendered.
+ */
+int rsvg_draw_cached(const char *file, const char *id, cairo_t *cr, double x,
+                     double y, double width, double height) {
+  struct stat st;
+  struct rsvg_cached *entry = NULL;
+  struct rsvg_cached *oldest = &rsvg_cache[0];
+  int w = (int)width;
+  int h = (int)height;
+  int i;
+
+  /* round up, so the whole image fits */
+  if (w < width) { ++w; }
+  if (h < height) { ++h; }
+  if (id != NULL && *id == '\0') { id = NULL; }
+  if (w <= 0 || h <= 0) { return 0; }
+  if (stat(file, &st) != 0) {
+    rsvg_cache_evict(file);
+    return 0;
+  }
+
+  for (i = 0; i < RSVG_CACHE_SIZE; ++i) {
+    struct rsvg_cached *e = &rsvg_cache[i];
+    if (e->path == NULL) {
+      if (oldest->path != NULL) { oldest = e; }
+      continue;
+    }
+    if (e->width == w && e->height == h && strcmp(e->path, file) == 0 &&
+        (e->id == NULL ? id == NULL : id != NULL && strcmp(e->id, id) == 0)) {
+      entry = e;
+      break;
+    }
+    if (oldest->path != NULL && e->last_used < oldest->last_used) {
+      oldest = e;
+    }
+  }
+
+  if (entry != NULL && entry->mtime != st.st_mtime) {
+    /* the file changed, render it again in the same place */
+    rsvg_free_cached(entry);
+    oldest = entry;
+    entry = NULL;
+  }
+  if (entry == NULL) {
+    cairo_surface_t *surface = rsvg_rasterize(file, id, w, h);
+    if (!surface) { return 0; }
+    if (oldest->path != NULL) { rsvg_free_cached(oldest); }
+    entry = oldest;
+    entry->path = strdup(file);
+    entry->id = id != NULL ? strdup(id) : NULL;
+    entry->mtime = st.st_mtime;
+    entry->width = w;
+    entry->height = h;
+    entry->surface = surface;
+  }
+
+  entry->last_used = ++rsvg_cache_clock;
+  cairo_save(cr);
+  cairo_set_source_surface(cr, entry->surface, x, y);
+  cairo_paint(cr);
+  cairo_restore(cr);
+  return 1;
+}
+
 #endif /* _LIBRSVG_HELPER_H_ */
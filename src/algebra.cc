@@ -32,9 +32,13 @@
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <vector>
 #include "config.h"
 #include "conky.h"
+#include "core.h"
 #include "logging.h"
+#include "text_object.h"
 
 /* find the operand in the given expression
  * returns the index of the first op character or -1 on error
@@ -116,6 +120,7 @@ int scompare(const char *a, enum match_type mtype, const char *b) {
 enum arg_type get_arg_type(const char *arg) {
   const char *p, *e;
 
+  if (*arg == '\0') { return ARG_BAD; }
   p = arg;
   e = arg + strlen(arg) - 1;
 
@@ -232,13 +237,241 @@ int compare(const char *expr) {
   return -2;
 }
 
+namespace {
+/* A value taken from a side of a comparison, ready to be compared. */
+struct match_value {
+  enum arg_type type;
+  long lng;
+  double dbl;
+  const char *str;
+};
+
+/* One side of a comparison. Operands without variables are converted when
+ * the config is parsed, the others are printed and converted every time. */
+struct match_operand {
+  struct text_object *text = nullptr;
+  std::vector<char> buffer; /* what text printed last */
+  std::string str;
+  match_value value{ARG_BAD, 0, 0.0, nullptr};
+};
+
+struct match_comparison {
+  match_operand a, b;
+  enum match_type op;
+};
+
+/* The comparisons of an if_match expression. || has lower precedence than
+ * &&, so the inner vectors are joined by && and the outer one by ||. */
+struct match_expression {
+  std::string source;
+  std::vector<std::vector<match_comparison>> alternatives;
+
+  ~match_expression() {
+    for (auto &comparisons : alternatives) {
+      for (auto &comparison : comparisons) {
+        for (match_operand *operand : {&comparison.a, &comparison.b}) {
+          if (operand->text == nullptr) { continue; }
+          free_text_objects(operand->text);
+          free(operand->text);
+        }
+      }
+    }
+  }
+};
+
+/* Converts text like compare() converts its arguments. Strings are cut out
+ * of text in place. */
+bool to_match_value(char *text, match_value &value) {
+  value.type = get_arg_type(text);
+  switch (value.type) {
+    case ARG_STRING: {
+      char *start = strchr(text, '"') + 1;
+      char *end = strchr(start, '"');
+      if (end != nullptr) { *end = '\0'; }
+      value.str = start;
+      return true;
+    }
+    case ARG_LONG:
+      value.lng = strtol(text, nullptr, 10);
+      return true;
+    case ARG_DOUBLE:
+      value.dbl = strtod(text, nullptr);
+      return true;
+    case ARG_BAD:
+      break;
+  }
+  return false;
+}
+
+bool get_match_value(match_operand &operand, match_value &value) {
+  if (operand.text == nullptr) {
+    value = operand.value;
+    return true;
+  }
+  size_t size = max_user_text.get(*state);
+  if (operand.buffer.size() != size) { operand.buffer.resize(size); }
+  generate_text_internal(operand.buffer.data(), size, *operand.text);
+  return to_match_value(operand.buffer.data(), value);
+}
+
+/* Returns like compare(): 1 or 0 if the comparison holds or not, and -2 if
+ * the operands can't be compared */
+int evaluate(match_comparison &comparison) {
+  match_value a, b;
+
+  if (!get_match_value(comparison.a, a) || !get_match_value(comparison.b, b)) {
+    return -2;
+  }
+  if (a.type == ARG_LONG && b.type == ARG_DOUBLE) {
+    a.type = ARG_DOUBLE;
+    a.dbl = a.lng;
+  }
+  if (a.type == ARG_DOUBLE && b.type == ARG_LONG) {
+    b.type = ARG_DOUBLE;
+    b.dbl = b.lng;
+  }
+  if (a.type != b.type) { return -2; }
+  switch (a.type) {
+    case ARG_STRING:
+      return scompare(a.str, comparison.op, b.str);
+    case ARG_LONG:
+      return lcompare(a.lng, comparison.op, b.lng);
+    case ARG_DOUBLE:
+      return dcompare(a.dbl, comparison.op, b.dbl);
+    case ARG_BAD:
+      break;
+  }
+  return -2;
+}
+
+bool compile_operand(const char *begin, const char *end,
+                     match_operand &operand) {
+  std::string text(begin, end);
+
+  if (text.find_first_not_of(' ') == std::string::npos) { return false; }
+  if (text.find('$') != std::string::npos) {
+    operand.text =
+        static_cast<struct text_object *>(malloc(sizeof(struct text_object)));
+    memset(operand.text, 0, sizeof(struct text_object));
+    extract_variable_text_internal(operand.text, text.c_str());
+    return true;
+  }
+  operand.str = text;
+  if (!to_match_value(&operand.str[0], operand.value)) { return false; }
+  if (operand.value.type == ARG_STRING) {
+    /* the string was cut out of str in place */
+    operand.str = std::string(operand.value.str);
+    operand.value.str = operand.str.c_str();
+  }
+  return true;
+}
+
+/* Returns the length of the operator at p and sets op, or 0 if there is no
+ * valid one. */
+size_t match_op_at(const char *p, enum match_type &op) {
+  switch (*p) {
+    case '=':
+      op = OP_EQ;
+      return p[1] == '=' ? 2 : 0;
+    case '!':
+      op = OP_NEQ;
+      return p[1] == '=' ? 2 : 0;
+    case '<':
+      op = p[1] == '=' ? OP_LEQ : OP_LT;
+      return p[1] == '=' ? 2 : 1;
+    case '>':
+      op = p[1] == '=' ? OP_GEQ : OP_GT;
+      return p[1] == '=' ? 2 : 1;
+  }
+  return 0;
+}
+
+/* Splits arg into comparisons joined by && and ||, each having exactly one
+ * operator outside of variables and quotes. Returns nullptr for anything
+ * else, e.g. when the operator only shows up once the variables printed. */
+match_expression *compile_if_match(const char *arg) {
+  std::unique_ptr<match_expression> expr(new match_expression);
+  const char *start = arg, *op_begin = nullptr, *op_end = nullptr;
+  enum match_type op = OP_EQ;
+  int depth = 0;
+  bool quoted = false;
+
+  expr->source = arg;
+  expr->alternatives.emplace_back();
+  for (const char *p = arg;; ++p) {
+    if (*p == '\0' || (depth == 0 && !quoted &&
+                       ((p[0] == '&' && p[1] == '&') ||
+                        (p[0] == '|' && p[1] == '|')))) {
+      if (op_begin == nullptr) { return nullptr; }
+      expr->alternatives.back().emplace_back();
+      match_comparison &comparison = expr->alternatives.back().back();
+      comparison.op = op;
+      if (!compile_operand(start, op_begin, comparison.a) ||
+          !compile_operand(op_end, p, comparison.b)) {
+        return nullptr;
+      }
+      if (*p == '\0') { break; }
+      if (*p == '|') { expr->alternatives.emplace_back(); }
+      start = ++p + 1;
+      op_begin = nullptr;
+      continue;
+    }
+    if (*p == '$') {
+      if (p[1] == '{') {
+        depth++;
+        p++;
+      } else if (p[1] == '$') {
+        p++;
+      }
+    } else if (depth > 0) {
+      if (*p == '{') { depth++; }
+      if (*p == '}') { depth--; }
+    } else if (*p == '"') {
+      quoted = !quoted;
+    } else if (!quoted && strchr("=!<>", *p) != nullptr) {
+      size_t len = match_op_at(p, op);
+      if (len == 0 || op_begin != nullptr) { return nullptr; }
+      op_begin = p;
+      op_end = p + len;
+      p = op_end - 1;
+    }
+  }
+  return expr.release();
+}
+}  // namespace
+
+void parse_if_match(struct text_object *obj, const char *arg) {
+  obj->data.opaque = compile_if_match(arg);
+  if (obj->data.opaque == nullptr) {
+    /* the old way: print everything, then look for the operator */
+    extract_object_args_to_sub(obj, arg);
+  }
+}
+
 int check_if_match(struct text_object *obj) {
-  std::unique_ptr<char[]> expression(new char[max_user_text.get(*state)]);
+  if (obj->data.opaque != nullptr) {
+    auto *expr = static_cast<match_expression *>(obj->data.opaque);
+    for (auto &comparisons : expr->alternatives) {
+      int result = 1;
+      for (auto &comparison : comparisons) {
+        int val = evaluate(comparison);
+        if (val == -2) {
+          NORM_ERR("compare failed for expression '%s'", expr->source.c_str());
+        } else if (val == 0) {
+          result = 0;
+          break;
+        }
+      }
+      if (result != 0) { return 1; }
+    }
+    return 0;
+  }
+
+  conky::scratch_text expression(max_user_text.get(*state));
   int val;
   int result = 1;
 
-  generate_text_internal(expression.get(), max_user_text.get(*state),
-                         *obj->sub);
+  generate_text_internal(expression.get(), expression.size(), *obj->sub);
   DBGP("parsed arg into '%s'", expression.get());
 
   val = compare(expression.get());
@@ -249,3 +482,8 @@ int check_if_match(struct text_object *obj) {
   }
   return result;
 }
+
+void free_if_match(struct text_object *obj) {
+  delete static_cast<match_expression *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
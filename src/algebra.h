@@ -46,6 +46,8 @@ enum arg_type {
 };
 
 int compare(const char *);
+void parse_if_match(struct text_object *, const char *);
 int check_if_match(struct text_object *);
+void free_if_match(struct text_object *);
 
 #endif /* _ALGEBRA_H */
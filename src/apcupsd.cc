@@ -24,13 +24,22 @@
 #include "apcupsd.h"
 #include "conky.h"
 #include "logging.h"
+#include "net-endpoint.hh"
 #include "text_object.h"
+#include "update-cb.hh"
 
-#include <netdb.h>
 #include <netinet/in.h>
-#include <sys/time.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 enum _apcupsd_items {
   APCUPSD_NAME,
@@ -47,203 +56,185 @@ enum _apcupsd_items {
   _APCUPSD_COUNT
 };
 
-/* type for data exchange with main thread */
+/* how long connecting to and talking to apcupsd may take, in seconds */
+#define APCUPSD_TIMEOUT 2
+/* how long a frame waits for the daemon, in seconds */
+#define APCUPSD_DEADLINE 0.25
+
+namespace {
+/* the status keys the objects show; first_word keeps only the number of
+ * values like "230.0 Volts" */
+struct apcupsd_key {
+  const char *key;
+  enum _apcupsd_items item;
+  bool first_word;
+};
+
+const apcupsd_key apcupsd_keys[] = {
+    {"UPSNAME", APCUPSD_NAME, false},     {"MODEL", APCUPSD_MODEL, false},
+    {"UPSMODE", APCUPSD_UPSMODE, false},  {"CABLE", APCUPSD_CABLE, false},
+    {"STATUS", APCUPSD_STATUS, true},     {"LINEV", APCUPSD_LINEV, true},
+    {"LOADPCT", APCUPSD_LOAD, true},      {"BCHARGE", APCUPSD_CHARGE, true},
+    {"TIMELEFT", APCUPSD_TIMELEFT, true}, {"ITEMP", APCUPSD_TEMP, true},
+    {"LASTXFER", APCUPSD_LASTXFER, false}};
+
 #define APCUPSD_MAXSTR 32
-typedef struct apcupsd_s {
-  char items[_APCUPSD_COUNT]
-            [APCUPSD_MAXSTR + 1]; /* e.g. items[APCUPSD_STATUS] */
-  char host[64];
-  int port;
-} APCUPSD_S, *PAPCUPSD_S;
-
-static APCUPSD_S apcupsd;
-
-//
-// encapsulated recv()
-//
-static int net_recv_ex(int sock, void *buf, int size, struct timeval *tv) {
-  fd_set fds;
-  int res;
-
-  // wait for some data to be read
-  do {
-    errno = 0;
-    FD_ZERO(&fds);
-    FD_SET(sock, &fds);
-    res = select(sock + 1, &fds, nullptr, nullptr, tv);
-  } while (res < 0 && errno == EINTR);
-  if (res < 0) { return 0; }
-  if (res == 0) {
-    // timeout
-    errno = ETIMEDOUT;  // select was successful, errno is now 0
-    return 0;
+struct apcupsd_result {
+  /* e.g. items[APCUPSD_STATUS] */
+  char items[_APCUPSD_COUNT][APCUPSD_MAXSTR + 1];
+
+  apcupsd_result() {
+    for (auto &item : items) { memcpy(item, "N/A", 4); } /* including \0 */
   }
+};
 
-  // socket ready, read the data
-  do {
-    errno = 0;
-    res = recv(sock, static_cast<char *>(buf), size, 0);
-  } while (res < 0 && errno == EINTR);
-  if (res < 0) { return 0; }
-  if (res == 0) {
-    // orderly shutdown
-    errno = ENOTCONN;
-    return 0;
+/*
+ * Asks apcupsd's network information server for the status of the UPS. The
+ * connection is kept open from one update to the next, the server answers
+ * any number of requests on it. Every answer is a series of lines, each sent
+ * as a two byte length followed by the line, and ends with an empty one.
+ */
+class apcupsd_cb
+    : public conky::callback<apcupsd_result, std::string, std::string> {
+  typedef conky::callback<apcupsd_result, std::string, std::string> Base;
+
+  std::shared_ptr<conky::net_endpoint> endpoint;
+  int sock; /* -1 while there is no connection */
+  std::string buf; /* received and not parsed yet */
+
+  bool request();
+  bool read_status(apcupsd_result &out);
+  void disconnect();
+
+ protected:
+  void work() override;
+
+ public:
+  apcupsd_cb(double period, const std::string &host, const std::string &port)
+      : Base(period, true, Base::Tuple(host, port)),
+        endpoint(conky::net_endpoint::get(host, port)),
+        sock(-1) {
+    set_deadline(APCUPSD_DEADLINE);
   }
 
-  return res;
-}
+  ~apcupsd_cb() { disconnect(); }
+};
+
+std::string apcupsd_host;
+std::string apcupsd_port;
 
-//
-// read whole buffer or fail
-//
-static int net_recv(int sock, void *buf, int size) {
-  int todo = size;
-  int off = 0;
-  int len;
-  struct timeval tv = {0, 250000};
-
-  while (todo != 0) {
-    len = net_recv_ex(sock, static_cast<char *>(buf) + off, todo, &tv);
-    if (len == 0) { return 0; }
-    todo -= len;
-    off += len;
+void parse_status_line(const char *line, size_t len, apcupsd_result &out) {
+  /* "KEY      : value\n" */
+  const char *colon = static_cast<const char *>(memchr(line, ':', len));
+  if (colon == nullptr) { return; }
+  size_t key_len = colon - line;
+  while (key_len > 0 && line[key_len - 1] == ' ') { --key_len; }
+
+  for (const auto &k : apcupsd_keys) {
+    if (strlen(k.key) != key_len || strncmp(k.key, line, key_len) != 0) {
+      continue;
+    }
+    const char *value = colon + 1;
+    const char *end = line + len;
+    while (value < end && *value == ' ') { ++value; }
+    while (end > value && (end[-1] == '\n' || end[-1] == ' ')) { --end; }
+    if (k.first_word) {
+      /* the first space after the first couple of characters */
+      for (const char *c = value + 2; c < end; ++c) {
+        if (*c == ' ') {
+          end = c;
+          break;
+        }
+      }
+    }
+    size_t n = std::min<size_t>(end - value, APCUPSD_MAXSTR);
+    memcpy(out.items[k.item], value, n);
+    out.items[k.item][n] = '\0';
+    return;
   }
-  return 1;
 }
+}  // namespace
 
-//
-// get one response line
-//
-static int get_line(int sock, char line[], short linesize) {
-  // get the line length
-  short sz;
-  if (net_recv(sock, &sz, sizeof(sz)) == 0) { return -1; }
-  sz = ntohs(sz);
-  if (sz == 0) { return 0; }
-
-  // get the line
-  while (sz >= linesize) {
-    // this is just a hack (being lazy), this should not happen anyway
-    net_recv(sock, line, linesize);
-    sz -= linesize;
+void apcupsd_cb::disconnect() {
+  if (sock != -1) {
+    close(sock);
+    sock = -1;
   }
-  if (net_recv(sock, line, sz) == 0) { return 0; }
-  line[sz] = 0;
-  return sz;
+  buf.clear();
 }
 
-#define FILL(NAME, FIELD, FIRST)                                               \
-  if (!strncmp(NAME, line, sizeof(NAME) - 1)) {                                \
-    strncpy(apc->items[FIELD], line + 11, APCUPSD_MAXSTR);                     \
-    /* remove trailing newline and assure termination */                       \
-    apc->items[FIELD][len - 11 > APCUPSD_MAXSTR ? APCUPSD_MAXSTR : len - 12] = \
-        0;                                                                     \
-    if (FIRST) {                                                               \
-      char *c;                                                                 \
-      for (c = apc->items[FIELD]; *c; ++c)                                     \
-        if (*c == ' ' && c > apc->items[FIELD] + 2) {                          \
-          *c = 0;                                                              \
-          break;                                                               \
-        }                                                                      \
-    }                                                                          \
-  }
+/* sends "status", connecting first if need be */
+bool apcupsd_cb::request() {
+  static const char status[] = {0, 6, 's', 't', 'a', 't', 'u', 's'};
 
-//
-// fills in the data received from a socket
-//
-static int fill_items(int sock, PAPCUPSD_S apc) {
-  char line[512];
-  int len;
-  while ((len = get_line(sock, line, sizeof(line))) != 0) {
-    // fill the right types in
-    FILL("UPSNAME", APCUPSD_NAME, FALSE);
-    FILL("MODEL", APCUPSD_MODEL, FALSE);
-    FILL("UPSMODE", APCUPSD_UPSMODE, FALSE);
-    FILL("CABLE", APCUPSD_CABLE, FALSE);
-    FILL("STATUS", APCUPSD_STATUS, TRUE);
-    FILL("LINEV", APCUPSD_LINEV, TRUE);
-    FILL("LOADPCT", APCUPSD_LOAD, TRUE);
-    FILL("BCHARGE", APCUPSD_CHARGE, TRUE);
-    FILL("TIMELEFT", APCUPSD_TIMELEFT, TRUE);
-    FILL("ITEMP", APCUPSD_TEMP, TRUE);
-    FILL("LASTXFER", APCUPSD_LASTXFER, FALSE);
+  if (sock == -1) {
+    /* no error reporting, the daemon is probably not running */
+    if ((sock = endpoint->connect(APCUPSD_TIMEOUT)) == -1) { return false; }
   }
-
-  return static_cast<int>(len == 0);
+  return send(sock, status, sizeof(status), MSG_NOSIGNAL) ==
+         static_cast<ssize_t>(sizeof(status));
 }
 
-//
-// Conky update function for apcupsd data
-//
-int update_apcupsd() {
-  int i;
-  APCUPSD_S apc;
-  int sock = -1;
+/* parses the lines as they arrive, until the empty one */
+bool apcupsd_cb::read_status(apcupsd_result &out) {
+  char chunk[1024];
+  size_t pos = 0;
+
+  for (;;) {
+    while (buf.size() - pos >= 2) {
+      size_t len = (static_cast<unsigned char>(buf[pos]) << 8) |
+                   static_cast<unsigned char>(buf[pos + 1]);
+      if (len == 0) {
+        buf.erase(0, pos + 2);
+        return true;
+      }
+      if (buf.size() - pos - 2 < len) { break; }
+      parse_status_line(&buf[pos + 2], len, out);
+      pos += 2 + len;
+    }
+    buf.erase(0, pos);
+    pos = 0;
 
-  for (i = 0; i < _APCUPSD_COUNT; ++i) {
-    memcpy(apc.items[i], "N/A", 4);  // including \0
+    ssize_t n;
+    do {
+      n = recv(sock, chunk, sizeof(chunk), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) { return false; }
+    buf.append(chunk, n);
   }
+}
 
-  do {
-    struct addrinfo hints {};
-    struct addrinfo *ai, *rp;
-    int res;
-    short sz = 0;
-    char portbuf[8];
-    //
-    // connect to apcupsd daemon
-    //
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_flags = 0;
-    hints.ai_protocol = 0;
-    snprintf(portbuf, 8, "%d", apcupsd.port);
-    res = getaddrinfo(apcupsd.host, portbuf, &hints, &ai);
-    if (res != 0) {
-      NORM_ERR("APCUPSD getaddrinfo: %s", gai_strerror(res));
-      break;
-    }
-    for (rp = ai; rp != nullptr; rp = rp->ai_next) {
-      sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-      if (sock == -1) { continue; }
-      if (connect(sock, rp->ai_addr, rp->ai_addrlen) != -1) { break; }
-      close(sock);
-      sock = -1;
-    }
-    freeaddrinfo(ai);
-    if (rp == nullptr) {
-      // no error reporting, the daemon is probably not running
-      if (sock >= 0) { close(sock); }
-      break;
-    }
+void apcupsd_cb::work() {
+  apcupsd_result status;
 
-    //
-    // send status request - "status" - 6B
-    //
-    sz = htons(6);
-    // no waiting to become writeable is really needed
-    if (send(sock, &sz, sizeof(sz), 0) != sizeof(sz) ||
-        send(sock, "status", 6, 0) != 6) {
-      perror("send");
-      close(sock);
-      break;
+  if (endpoint->ready()) {
+    bool reused = sock != -1;
+    bool ok = request() && read_status(status);
+    if (!ok && reused) {
+      /* the daemon may have closed a connection that sat idle, so try a
+       * new one before counting it as a failure */
+      disconnect();
+      status = apcupsd_result();
+      ok = request() && read_status(status);
+    }
+    if (ok) {
+      endpoint->succeeded();
+    } else {
+      if (sock != -1) { endpoint->failed(); }
+      disconnect();
     }
+  }
 
-    //
-    // read the lines of output and put them into the info structure
-    //
-    fill_items(sock, &apc);
-    close(sock);
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = status;
+}
 
-  } while (0);
+static const apcupsd_result &get_apcupsd() {
+  static const apcupsd_result none;
 
-  //
-  // "atomically" copy the data into working set
-  //
-  memcpy(apcupsd.items, apc.items, sizeof(apcupsd.items));
-  return 0;
+  if (apcupsd_host.empty()) { return none; }
+  return conky::register_cb<apcupsd_cb>(0, apcupsd_host, apcupsd_port)
+      ->read_result();
 }
 
 int apcupsd_scan_arg(const char *arg) {
@@ -251,22 +242,22 @@ int apcupsd_scan_arg(const char *arg) {
   int port;
   if (sscanf(arg, "%63s %d", host, &port) != 2) { return 1; }
 
-  apcupsd.port = port;
-  strncpy(apcupsd.host, host, sizeof(apcupsd.host));
+  apcupsd_host = host;
+  apcupsd_port = std::to_string(port);
   return 0;
 }
 
 double apcupsd_loadbarval(struct text_object *obj) {
   (void)obj;
 
-  return atof(apcupsd.items[APCUPSD_LOAD]);
+  return atof(get_apcupsd().items[APCUPSD_LOAD]);
 }
 
-#define APCUPSD_PRINT_GENERATOR(name, idx)                       \
-  void print_apcupsd_##name(struct text_object *obj, char *p,    \
-                            unsigned int p_max_size) {           \
-    (void)obj;                                                   \
-    snprintf(p, p_max_size, "%s", apcupsd.items[APCUPSD_##idx]); \
+#define APCUPSD_PRINT_GENERATOR(name, idx)                             \
+  void print_apcupsd_##name(struct text_object *obj, char *p,          \
+                            unsigned int p_max_size) {                 \
+    (void)obj;                                                         \
+    snprintf(p, p_max_size, "%s", get_apcupsd().items[APCUPSD_##idx]); \
   }
 
 APCUPSD_PRINT_GENERATOR(name, NAME)
@@ -26,9 +26,6 @@
 
 int apcupsd_scan_arg(const char *);
 
-/* Service routine for the conky main thread */
-int update_apcupsd(void);
-
 double apcupsd_loadbarval(struct text_object *);
 
 void print_apcupsd_name(struct text_object *, char *, unsigned int);
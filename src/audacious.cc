@@ -23,10 +23,13 @@
 
 #include <config.h>
 
+#include <atomic>
 #include <cmath>
+#include <cstring>
 
 #include <mutex>
 #include "audacious.h"
+#include "common.h"
 #include "conky.h"
 #include "logging.h"
 #include "update-cb.hh"
@@ -35,6 +38,7 @@
 #ifdef NEW_AUDACIOUS_FOUND
 #include <audacious/audctrl.h>
 #include <audacious/dbus.h>
+#include <dbus/dbus-glib.h>
 #include <glib-object.h>
 #else /* NEW_AUDACIOUS_FOUND */
 #include <audacious/beepctrl.h>
@@ -72,6 +76,7 @@ struct aud_result {
   int playlist_position;
   int main_volume;
   aud_status status;
+  double sampled;  // get_time() when position was read
 
   aud_result()
       : length(0),
@@ -82,14 +87,52 @@ struct aud_result {
         playlist_length(0),
         playlist_position(0),
         main_volume(0),
-        status(AS_NOT_RUNNING) {}
+        status(AS_NOT_RUNNING),
+        sampled(0) {}
 };
 
+#ifdef NEW_AUDACIOUS_FOUND
+/* Audacious announces changes through its MPRIS plugin. Without the plugin
+ * only starting and quitting is announced. */
+const char MPRIS_NAME[] = "org.mpris.MediaPlayer2.audacious";
+const char MPRIS_PATH[] = "/org/mpris/MediaPlayer2";
+/* what was read is refreshed this often anyway, e.g. for the playlist
+ * length which MPRIS doesn't signal */
+const double RESYNC_INTERVAL = 30;
+#endif /* NEW_AUDACIOUS_FOUND */
+
 class audacious_cb : public conky::callback<aud_result> {
   typedef conky::callback<aud_result> Base;
 
 #ifdef NEW_AUDACIOUS_FOUND
   DBusGProxy *session;
+  DBusGProxy *bus;
+  DBusGProxy *properties;
+  DBusGProxy *player;
+  /* set by the signal handlers: what was read is out of date */
+  std::atomic<bool> changed;
+  /* whether a change would be signalled, so that nothing needs to be read
+   * until then */
+  bool watched;
+  double last_read;
+
+  static void name_owner_changed(DBusGProxy *, const char *name,
+                                 const char *, const char *, gpointer self) {
+    if (strcmp(name, AUDACIOUS_DBUS_SERVICE) == 0 ||
+        strcmp(name, MPRIS_NAME) == 0) {
+      static_cast<audacious_cb *>(self)->changed = true;
+    }
+  }
+  static void properties_changed(DBusGProxy *, const char *, GHashTable *,
+                                 char **, gpointer self) {
+    static_cast<audacious_cb *>(self)->changed = true;
+  }
+  static void seeked(DBusGProxy *, gint64, gpointer self) {
+    static_cast<audacious_cb *>(self)->changed = true;
+  }
+
+  void watch_signals(DBusGConnection *connection);
+  bool mpris_running();
 #else
   gint session;
 #endif
@@ -98,7 +141,7 @@ class audacious_cb : public conky::callback<aud_result> {
   virtual void work();
 
  public:
-  audacious_cb(uint32_t period) : Base(period, false, Tuple()) {
+  audacious_cb(double period) : Base(period, false, Tuple()) {
 #ifdef NEW_AUDACIOUS_FOUND
     DBusGConnection *connection = dbus_g_bus_get(DBUS_BUS_SESSION, nullptr);
     if (!connection)
@@ -108,6 +151,10 @@ class audacious_cb : public conky::callback<aud_result> {
                                         AUDACIOUS_DBUS_PATH,
                                         AUDACIOUS_DBUS_INTERFACE);
     if (!session) throw std::runtime_error("unable to create dbus proxy");
+    changed = true;
+    watched = false;
+    last_read = 0;
+    watch_signals(connection);
 #else
     session = 0;
 #endif /* NEW_AUDACIOUS_FOUND */
@@ -115,12 +162,62 @@ class audacious_cb : public conky::callback<aud_result> {
 
 #ifdef NEW_AUDACIOUS_FOUND
   ~audacious_cb() {
-    /* release reference to dbus proxy */
+    /* release references to the dbus proxies, which disconnects the signal
+     * handlers */
+    g_object_unref(player);
+    g_object_unref(properties);
+    g_object_unref(bus);
     g_object_unref(session);
   }
 #endif
 };
 
+#ifdef NEW_AUDACIOUS_FOUND
+void audacious_cb::watch_signals(DBusGConnection *connection) {
+  GType changed_type =
+      dbus_g_type_get_map("GHashTable", G_TYPE_STRING, G_TYPE_VALUE);
+
+  bus = dbus_g_proxy_new_for_name(connection, DBUS_SERVICE_DBUS,
+                                  DBUS_PATH_DBUS, DBUS_INTERFACE_DBUS);
+  dbus_g_object_register_marshaller(g_cclosure_marshal_generic, G_TYPE_NONE,
+                                    G_TYPE_STRING, G_TYPE_STRING,
+                                    G_TYPE_STRING, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal(bus, "NameOwnerChanged", G_TYPE_STRING,
+                          G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal(bus, "NameOwnerChanged",
+                              G_CALLBACK(&name_owner_changed), this, nullptr);
+
+  properties = dbus_g_proxy_new_for_name(connection, MPRIS_NAME, MPRIS_PATH,
+                                         "org.freedesktop.DBus.Properties");
+  dbus_g_object_register_marshaller(g_cclosure_marshal_generic, G_TYPE_NONE,
+                                    G_TYPE_STRING, changed_type, G_TYPE_STRV,
+                                    G_TYPE_INVALID);
+  dbus_g_proxy_add_signal(properties, "PropertiesChanged", G_TYPE_STRING,
+                          changed_type, G_TYPE_STRV, G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal(properties, "PropertiesChanged",
+                              G_CALLBACK(&properties_changed), this, nullptr);
+
+  /* seeking changes no property */
+  player = dbus_g_proxy_new_for_name(connection, MPRIS_NAME, MPRIS_PATH,
+                                     "org.mpris.MediaPlayer2.Player");
+  dbus_g_object_register_marshaller(g_cclosure_marshal_generic, G_TYPE_NONE,
+                                    G_TYPE_INT64, G_TYPE_INVALID);
+  dbus_g_proxy_add_signal(player, "Seeked", G_TYPE_INT64, G_TYPE_INVALID);
+  dbus_g_proxy_connect_signal(player, "Seeked", G_CALLBACK(&seeked), this,
+                              nullptr);
+}
+
+bool audacious_cb::mpris_running() {
+  gboolean has_owner = FALSE;
+  if (!dbus_g_proxy_call(bus, "NameHasOwner", nullptr, G_TYPE_STRING,
+                         MPRIS_NAME, G_TYPE_INVALID, G_TYPE_BOOLEAN,
+                         &has_owner, G_TYPE_INVALID)) {
+    return false;
+  }
+  return has_owner != FALSE;
+}
+#endif /* NEW_AUDACIOUS_FOUND */
+
 /* ---------------------------------------------------
  * Worker thread function for audacious data sampling.
  * --------------------------------------------------- */
@@ -130,6 +227,19 @@ void audacious_cb::work() {
   psong = nullptr;
   pfilename = nullptr;
 
+#ifdef NEW_AUDACIOUS_FOUND
+  /* dbus-glib delivers signals from the default main context, which only
+   * this thread runs */
+  while (g_main_context_iteration(nullptr, FALSE)) {}
+  bool pending = changed.exchange(false);
+  double now = get_time();
+  if (watched && !pending && now - last_read < RESYNC_INTERVAL) {
+    /* the position printed moves on by itself */
+    return;
+  }
+  last_read = now;
+#endif /* NEW_AUDACIOUS_FOUND */
+
   do {
     if (!audacious_remote_is_running(session)) {
       tmp.status = AS_NOT_RUNNING;
@@ -178,6 +288,11 @@ void audacious_cb::work() {
     /* Main volume */
     tmp.main_volume = audacious_remote_get_main_volume(session);
   } while (0);
+  tmp.sampled = get_time();
+#ifdef NEW_AUDACIOUS_FOUND
+  /* once running, changes are only signalled through MPRIS */
+  watched = tmp.status == AS_NOT_RUNNING || mpris_running();
+#endif /* NEW_AUDACIOUS_FOUND */
   {
     /* Deliver the refreshed items array to audacious_items. */
     std::lock_guard<std::mutex> lock(result_mutex);
@@ -185,10 +300,17 @@ void audacious_cb::work() {
   }
 }
 
-aud_result get_res() {
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
-  return conky::register_cb<audacious_cb>(period)->get_result_copy();
+const aud_result &get_res() {
+  double period = music_player_interval.get(*state);
+  return conky::register_cb<audacious_cb>(period)->read_result();
+}
+
+/* the position in ms, moved on by the time passed since it was read */
+int position(const aud_result &res) {
+  if (res.status != AS_PLAYING) { return res.position; }
+  double pos = res.position + (get_time() - res.sampled) * 1000;
+  if (res.length > 0 && pos > res.length) { return res.length; }
+  return static_cast<int>(pos);
 }
 }  // namespace
 
@@ -212,7 +334,7 @@ void print_audacious_filename(struct text_object *obj, char *p,
 
 double audacious_barval(struct text_object *) {
   const aud_result &res = get_res();
-  return (double)res.position / res.length;
+  return (double)position(res) / res.length;
 }
 
 void print_audacious_length(struct text_object *, char *p,
@@ -229,14 +351,13 @@ void print_audacious_length_seconds(struct text_object *, char *p,
 
 void print_audacious_position(struct text_object *, char *p,
                               unsigned int p_max_size) {
-  const aud_result &res = get_res();
-  int sec = res.position / 1000;
+  int sec = position(get_res()) / 1000;
   snprintf(p, p_max_size, "%d:%.2d", sec / 60, sec % 60);
 }
 
 void print_audacious_position_seconds(struct text_object *, char *p,
                                       unsigned int p_max_size) {
-  snprintf(p, p_max_size, "%d", get_res().position);
+  snprintf(p, p_max_size, "%d", position(get_res()));
 }
 
 void print_audacious_bitrate(struct text_object *, char *p,
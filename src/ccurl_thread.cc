@@ -23,8 +23,15 @@
  */
 
 #include "ccurl_thread.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cinttypes>
 #include <cmath>
+#include <cstdio>
 #include <mutex>
+#include "common.h"
 #include "conky.h"
 #include "logging.h"
 #include "text_object.h"
@@ -42,6 +49,140 @@
  * example.
  */
 
+void curl_global_setup() {
+  struct curl_global_initializer {
+    curl_global_initializer() {
+      if (curl_global_init(CURL_GLOBAL_ALL)) {
+        NORM_ERR(
+            "curl_global_init() failed, you may not be able to use curl "
+            "variables");
+      }
+    }
+    ~curl_global_initializer() { curl_global_cleanup(); }
+  };
+  static curl_global_initializer curl_global;
+}
+
+namespace {
+conky::simple_config_setting<bool> http_cache("http_cache", true, false);
+
+/* $XDG_CACHE_HOME/conky/http, created if need be; empty if there is no
+ * place for it */
+std::string http_cache_dir() {
+  std::string dir;
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  if (xdg != nullptr && *xdg == '/') {
+    dir = xdg;
+  } else {
+    const char *home = getenv("HOME");
+    if (home == nullptr || *home == 0) { return std::string(); }
+    dir = std::string(home) + "/.cache";
+  }
+  for (const char *sub : {"", "/conky", "/http"}) {
+    dir += sub;
+    if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+      LIMITED_ERR("curl: can't create the cache directory %s: %s",
+                  dir.c_str(), strerror(errno));
+      return std::string();
+    }
+  }
+  return dir;
+}
+
+/* FNV-1a, which stays the same from one build to the next */
+uint64_t hash_text(const std::string &text, uint64_t hash) {
+  for (unsigned char c : text) { hash = (hash ^ c) * 0x100000001b3ULL; }
+  return hash;
+}
+
+bool read_file(const std::string &path, std::string &contents) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) { return false; }
+
+  contents.clear();
+  char buf[0x4000];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof buf)) > 0 || (n == -1 && errno == EINTR)) {
+    if (n > 0) { contents.append(buf, n); }
+  }
+  close(fd);
+  return n == 0;
+}
+
+/* replaces path, so that a reader only ever sees the old or the new file;
+ * the responses may hold private data, so only we may read them */
+void write_file(const std::string &path, const std::string &contents) {
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd == -1) { return; }
+
+  const char *p = contents.data();
+  size_t left = contents.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n == -1 && errno == EINTR) { continue; }
+    if (n <= 0) { break; }
+    p += n;
+    left -= n;
+  }
+  if (close(fd) != 0 || left > 0 || rename(tmp.c_str(), path.c_str()) != 0) {
+    LIMITED_ERR("curl: can't write the cache file %s", path.c_str());
+    unlink(tmp.c_str());
+  }
+}
+
+/* Handles are used from the callback threads, so every kind of data in the
+ * share gets a mutex of its own. */
+class curl_share {
+  CURLSH *share;
+  std::mutex locks[CURL_LOCK_DATA_LAST];
+
+  static void lock(CURL *, curl_lock_data data, curl_lock_access,
+                   void *userptr) {
+    static_cast<curl_share *>(userptr)->locks[data].lock();
+  }
+  static void unlock(CURL *, curl_lock_data data, void *userptr) {
+    static_cast<curl_share *>(userptr)->locks[data].unlock();
+  }
+
+ public:
+  curl_share() : share(curl_share_init()) {
+    if (share == nullptr) {
+      NORM_ERR("curl_share_init() failed, curl handles won't share anything");
+      return;
+    }
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+  }
+  ~curl_share() {
+    if (share != nullptr) { curl_share_cleanup(share); }
+  }
+
+  CURLSH *get() const { return share; }
+};
+}  // namespace
+
+void curl_share_handle(CURL *curl) {
+  /* constructed after, and so destroyed before, the global initialisation */
+  curl_global_setup();
+  static curl_share share;
+
+  if (share.get() != nullptr) {
+    curl_easy_setopt(curl, CURLOPT_SHARE, share.get());
+  }
+#if LIBCURL_VERSION_NUM >= 0x072f00
+  /* lets requests to the same host multiplex over one connection */
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+#endif
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+}
+
 namespace priv {
 /* callback used by curl for parsing the header data */
 size_t curl_internal::parse_header_cb(void *ptr, size_t size, size_t nmemb,
@@ -55,10 +196,15 @@ size_t curl_internal::parse_header_cb(void *ptr, size_t size, size_t nmemb,
     --realsize;
   }
 
-  if (strncmp(value, "Last-Modified: ", 15) == EQUAL) {
+  /* HTTP/2 sends the names in lower case */
+  if (strncasecmp(value, "Last-Modified: ", 15) == EQUAL) {
     obj->last_modified = std::string(value + 15, realsize - 15);
-  } else if (strncmp(value, "ETag: ", 6) == EQUAL) {
+  } else if (strncasecmp(value, "ETag: ", 6) == EQUAL) {
     obj->etag = std::string(value + 6, realsize - 6);
+  } else if (strncasecmp(value, "Cache-Control: ", 15) == EQUAL) {
+    obj->cache_control(std::string(value + 15, realsize - 15));
+  } else {
+    obj->receive_header(value, realsize);
   }
 
   return size * nmemb;
@@ -71,14 +217,31 @@ size_t curl_internal::write_cb(void *ptr, size_t size, size_t nmemb,
   const char *value = static_cast<const char *>(ptr);
   size_t realsize = size * nmemb;
 
-  obj->data += std::string(value, realsize);
+  if (obj->cache_enabled) { obj->cache_body.append(value, realsize); }
+  if (!obj->receive_data(value, realsize)) {
+    /* makes curl give up with CURLE_WRITE_ERROR */
+    obj->stopped_early = true;
+    return 0;
+  }
 
   return realsize;
 }
 
-curl_internal::curl_internal(const std::string &url) : curl(curl_easy_init()) {
+curl_internal::curl_internal(const std::string &url_)
+    : data_size(0),
+      curl(nullptr),
+      stopped_early(false),
+      url(url_),
+      cache_enabled(http_cache.get(*state)),
+      cache_opened(false),
+      cache_complete(false),
+      no_store(false),
+      fresh_until(0) {
+  curl_global_setup();
+  curl = curl_easy_init();
   if (!curl) throw std::runtime_error("curl_easy_init() failed");
 
+  curl_share_handle(curl);
   curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1);
   curl_easy_setopt(curl, CURLOPT_HEADERDATA, this);
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, parse_header_cb);
@@ -95,6 +258,107 @@ curl_internal::curl_internal(const std::string &url) : curl(curl_easy_init()) {
   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1);
 }
 
+void curl_internal::cache_control(const std::string &value) {
+  std::string directives(value);
+  for (char &c : directives) {
+    c = static_cast<char>(tolower(static_cast<unsigned char>(c)));
+  }
+  if (directives.find("no-store") != std::string::npos) { no_store = true; }
+  /* what may be stored is still to be revalidated every time */
+  if (directives.find("no-cache") != std::string::npos) { return; }
+
+  std::string::size_type pos = directives.find("max-age=");
+  if (pos != std::string::npos) {
+    long seconds = strtol(directives.c_str() + pos + 8, nullptr, 10);
+    if (seconds > 0) { fresh_until = time(nullptr) + seconds; }
+  }
+}
+
+bool curl_internal::replay_cache() {
+  if (cache_opened || !cache_enabled) { return false; }
+  cache_opened = true;
+
+  std::string dir = http_cache_dir();
+  if (dir.empty()) {
+    cache_enabled = false;
+    return false;
+  }
+  /* the request headers tell apart e.g. the users of different tokens */
+  uint64_t hash = hash_text(url, 0xcbf29ce484222325ULL);
+  for (const auto &h : request_headers) { hash = hash_text(h, hash); }
+  char name[17];
+  snprintf(name, sizeof name, "%016" PRIx64, hash);
+  cache_file = dir + "/" + name;
+
+  std::string meta;
+  std::string body;
+  if (!read_file(cache_file + ".meta", meta) ||
+      !read_file(cache_file + ".body", body)) {
+    return false;
+  }
+
+  std::string cached_url;
+  std::string cached_etag;
+  std::string cached_last_modified;
+  time_t cached_fresh_until = 0;
+  bool complete = false;
+  std::string::size_type begin = 0;
+  while (begin < meta.size()) {
+    std::string::size_type end = meta.find('\n', begin);
+    if (end == std::string::npos) { end = meta.size(); }
+    std::string line = meta.substr(begin, end - begin);
+    if (line.compare(0, 5, "url: ") == 0) {
+      cached_url = line.substr(5);
+    } else if (line.compare(0, 6, "etag: ") == 0) {
+      cached_etag = line.substr(6);
+    } else if (line.compare(0, 15, "last-modified: ") == 0) {
+      cached_last_modified = line.substr(15);
+    } else if (line.compare(0, 13, "fresh-until: ") == 0) {
+      cached_fresh_until = strtoll(line.c_str() + 13, nullptr, 10);
+    } else if (line == "complete: 1") {
+      complete = true;
+    }
+    begin = end + 1;
+  }
+  if (cached_url != url) { return false; }
+
+  DBGP("curl: using the response to '%s' cached in %s", url.c_str(),
+       cache_file.c_str());
+  stopped_early = false;
+  begin_data();
+  receive_data(body.data(), body.size());
+  process_data();
+  data_size = conky::priv::heap_size(data);
+
+  /* revalidated when do_work() asks the server, unless it is still fresh;
+   * a body cut short where the objects had all they wanted then is only
+   * good to show until it is downloaded again */
+  cache_complete = complete;
+  if (!complete) { return true; }
+  etag = cached_etag;
+  last_modified = cached_last_modified;
+  fresh_until = cached_fresh_until;
+  return true;
+}
+
+void curl_internal::save_cache(bool with_body) {
+  if (cache_file.empty()) { return; }
+  /* a 304 leaves the body on disk as it was */
+  if (with_body) { cache_complete = !stopped_early; }
+
+  if (no_store) {
+    unlink((cache_file + ".meta").c_str());
+    unlink((cache_file + ".body").c_str());
+  } else {
+    if (with_body) { write_file(cache_file + ".body", cache_body); }
+    write_file(cache_file + ".meta",
+               "url: " + url + "\netag: " + etag +
+                   "\nlast-modified: " + last_modified +
+                   "\nfresh-until: " + std::to_string(fresh_until) +
+                   "\ncomplete: " + (cache_complete ? "1" : "0") + "\n");
+  }
+}
+
 /* fetch our datums */
 void curl_internal::do_work() {
   CURLcode res;
@@ -105,22 +369,35 @@ void curl_internal::do_work() {
     ~headers_() { curl_slist_free_all(h); }
   } headers;
 
-  data.clear();
+  /* the server said what we have is good until then */
+  if (fresh_until > time(nullptr)) { return; }
+
+  stopped_early = false;
+  no_store = false;
+  fresh_until = 0;
+  cache_body.clear();
+  begin_data();
 
+  /* a 304 need not repeat them */
+  std::string old_last_modified;
+  std::string old_etag;
   if (!last_modified.empty()) {
     headers.h = curl_slist_append(
         headers.h, ("If-Modified-Since: " + last_modified).c_str());
-    last_modified.clear();
+    old_last_modified.swap(last_modified);
   }
   if (!etag.empty()) {
     headers.h =
         curl_slist_append(headers.h, ("If-None-Match: " + etag).c_str());
-    etag.clear();
+    old_etag.swap(etag);
+  }
+  for (const auto &h : request_headers) {
+    headers.h = curl_slist_append(headers.h, h.c_str());
   }
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers.h);
 
   res = curl_easy_perform(curl);
-  if (res == CURLE_OK) {
+  if (res == CURLE_OK || (res == CURLE_WRITE_ERROR && stopped_early)) {
     long http_status_code;
 
     if (curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status_code) ==
@@ -128,20 +405,31 @@ void curl_internal::do_work() {
       switch (http_status_code) {
         case 200:
           process_data();
+          save_cache(true);
           break;
         case 304:
+          if (last_modified.empty()) { last_modified.swap(old_last_modified); }
+          if (etag.empty()) { etag.swap(old_etag); }
+          save_cache(false);
           break;
         default:
-          NORM_ERR("curl: no data from server, got HTTP status %ld",
-                   http_status_code);
+          process_failure(http_status_code);
           break;
       }
     } else {
-      NORM_ERR("curl: no HTTP status from server");
+      LIMITED_ERR("curl: no HTTP status from server");
     }
   } else {
-    NORM_ERR("curl: could not retrieve data from server");
+    LIMITED_ERR("curl: could not retrieve data from server");
   }
+  /* only needed until it is written */
+  cache_body.clear();
+  cache_body.shrink_to_fit();
+  data_size = conky::priv::heap_size(data);
+}
+
+void curl_internal::process_failure(long http_status) {
+  LIMITED_ERR("curl: no data from server, got HTTP status %ld", http_status);
 }
 }  // namespace priv
 
@@ -156,7 +444,7 @@ class simple_curl_cb : public curl_callback<std::string> {
   }
 
  public:
-  simple_curl_cb(uint32_t period, const std::string &uri)
+  simple_curl_cb(double period, const std::string &uri)
       : Base(period, Tuple(uri)) {}
 };
 }  // namespace
@@ -173,10 +461,10 @@ struct curl_data {
 /* prints result data to text buffer, used by $curl */
 void ccurl_process_info(char *p, int p_max_size, const std::string &uri,
                         int interval) {
-  uint32_t period = std::max(lround(interval / active_update_interval()), 1l);
+  double period = interval;
   auto cb = conky::register_cb<simple_curl_cb>(period, uri);
 
-  strncpy(p, cb->get_result_copy().c_str(), p_max_size);
+  strncpy(p, cb->read_result().c_str(), p_max_size);
 }
 
 void curl_parse_arg(struct text_object *obj, const char *arg) {
@@ -223,3 +511,99 @@ void curl_obj_free(struct text_object *obj) {
   free_and_zero(cd->uri);
   free_and_zero(obj->data.opaque);
 }
+
+/*
+ * This is where the $github_notifications section begins.
+ */
+
+#define NEW_TOKEN                       \
+  "https://github.com/settings/tokens/" \
+  "new?scopes=notifications&description=conky-query-github\n"
+
+namespace {
+/* the number of unread notifications, or what went wrong */
+class github_cb : public curl_callback<std::string, std::string> {
+  typedef curl_callback<std::string, std::string> Base;
+
+  /* the seconds GitHub asks to leave between two polls */
+  int poll_interval;
+  double next_poll;
+
+ protected:
+  virtual void work() {
+    /* registered with a period of 0, the callback runs every update but
+     * only asks GitHub once the poll interval is over */
+    double now = get_time();
+    if (now < next_poll) { return; }
+    Base::work();
+    next_poll = now + poll_interval;
+  }
+
+  virtual void receive_header(const char *line, size_t len) {
+    if (len > 17 && strncasecmp(line, "X-Poll-Interval: ", 17) == EQUAL) {
+      int seconds = atoi(std::string(line + 17, len - 17).c_str());
+      if (seconds > 0) { poll_interval = seconds; }
+    }
+  }
+
+  virtual void process_data() {
+    /* every notification has an unread field, and only unread ones are
+     * listed */
+    size_t count = 0;
+    for (size_t pos = data.find("\"unread\""); pos != std::string::npos;
+         pos = data.find("\"unread\"", pos + 8)) {
+      ++count;
+    }
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    result = std::to_string(count);
+  }
+
+  virtual void process_failure(long http_status) {
+    std::string message;
+    if (data.find("Bad credentials") != std::string::npos) {
+      LIMITED_ERR("Bad credentials: generate a new token:\n" NEW_TOKEN);
+      message = "GitHub: Bad credentials, generate a new token.";
+    } else if (data.find("notifications") != std::string::npos &&
+               data.find("scope") != std::string::npos) {
+      LIMITED_ERR("Missing 'notifications' scope. Generate a new token\n"
+                  NEW_TOKEN);
+      message =
+          "GitHub: Missing the notifications scope. Generate a new token.";
+    } else {
+      /* keep showing the last count */
+      Base::process_failure(http_status);
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(result_mutex);
+    result = message;
+  }
+
+ public:
+  github_cb(double period, const std::string &uri, const std::string &token)
+      : Base(period, Tuple(uri, token)), poll_interval(60), next_poll(0) {
+    request_headers.push_back("Authorization: token " + token);
+    request_headers.push_back("Accept: application/vnd.github+json");
+  }
+};
+}  // namespace
+
+void print_github(struct text_object *obj, char *p, unsigned int p_max_size) {
+  (void)obj;
+  const std::string &token = github_token.get(*state);
+
+  if (token.empty()) {
+    LIMITED_ERR(
+        "${github_notifications} requires token. "
+        "Go ahead and generate one " NEW_TOKEN
+        "Insert it in conky.config = { github_token='TOKEN_SHA' }");
+    snprintf(p, p_max_size, "%s",
+             "GitHub notifications requires token, generate a new one.");
+    return;
+  }
+
+  auto cb = conky::register_cb<github_cb>(
+      0, "https://api.github.com/notifications", token);
+  snprintf(p, p_max_size, "%s", cb->read_result().c_str());
+}
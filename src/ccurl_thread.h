@@ -27,9 +27,25 @@
 
 #include <curl/curl.h>
 
+#include <atomic>
+#include <ctime>
+#include <string>
+#include <vector>
+
 #include "logging.h"
 #include "update-cb.hh"
 
+/* Initialises libcurl the first time it is called. That has to happen on the
+ * main thread before any handle is created, and pulls in the TLS libraries,
+ * so it is left until the text actually uses curl. */
+void curl_global_setup();
+
+/* Makes the handle share its connection cache, DNS lookups and TLS sessions
+ * with every other handle set up this way, so that objects fetching from
+ * the same hosts don't each open connections and do handshakes of their
+ * own. */
+void curl_share_handle(CURL *curl);
+
 namespace priv {
 // factored out stuff that does not depend on the template parameters
 class curl_internal {
@@ -37,7 +53,24 @@ class curl_internal {
   std::string last_modified;
   std::string etag;
   std::string data;
+  /* sent with every request, e.g. "Authorization: ..." */
+  std::vector<std::string> request_headers;
+  /* what data kept allocated after the last download, for ${conky_mem} */
+  std::atomic<size_t> data_size;
   CURL *curl;
+  bool stopped_early;
+
+  /* The last response is kept on disk, see http_cache, so that after a
+   * restart it is shown right away and only revalidated. cache_file is the
+   * path of its files without .meta or .body, empty if there are none. */
+  const std::string url;
+  std::string cache_file;
+  std::string cache_body; /* the body as it arrives, to write it there */
+  bool cache_enabled;
+  bool cache_opened;
+  bool cache_complete; /* the body there wasn't cut short */
+  bool no_store;       /* the server said Cache-Control: no-store */
+  time_t fresh_until;  /* the server's max-age, no request until then */
 
   static size_t parse_header_cb(void *ptr, size_t size, size_t nmemb,
                                 void *data);
@@ -45,10 +78,33 @@ class curl_internal {
 
   void do_work();
 
+  // feeds the response cached on disk to process_data() the first time it is
+  // called, before do_work() revalidates it; returns whether there was one
+  bool replay_cache();
+  void save_cache(bool with_body);
+  void cache_control(const std::string &value);
+
+  // called by do_work() before a download, and with every piece of the body
+  // as it arrives. By default the body is collected in data; returning false
+  // ends the download early, with the data so far treated as complete
+  virtual void begin_data() { data.clear(); }
+  virtual bool receive_data(const char *ptr, size_t size) {
+    data.append(ptr, size);
+    return true;
+  }
+
   // called by do_work() after downloading data from the uri
   // it should populate the result variable
   virtual void process_data() = 0;
 
+  // called by do_work() for every response header other than the ones
+  // for conditional requests, without the line end
+  virtual void receive_header(const char * /*line*/, size_t /*len*/) {}
+
+  // called by do_work() when the server answered with a status other than
+  // 200 or 304, with whatever body it sent in data
+  virtual void process_failure(long http_status);
+
   explicit curl_internal(const std::string &url);
   virtual ~curl_internal() {
     if (curl) curl_easy_cleanup(curl);
@@ -69,12 +125,18 @@ class curl_callback : public conky::callback<Result, std::string, Keys...>,
  protected:
   virtual void work() {
     DBGP("reading curl data from '%s'", std::get<0>(Base1::tuple).c_str());
+    /* readers get what was cached without waiting for the server */
+    if (replay_cache()) { Base1::publish_now(); }
     do_work();
   }
 
+  virtual size_t memory() { return Base1::memory() + Base2::data_size; }
+
  public:
-  curl_callback(uint32_t period, const typename Base1::Tuple &tuple)
-      : Base1(period, false, tuple), Base2(std::get<0>(tuple)) {}
+  curl_callback(double period, const typename Base1::Tuple &tuple)
+      : Base1(period, false, tuple), Base2(std::get<0>(tuple)) {
+    Base1::set_power_source("curl");
+  }
 };
 
 /* $curl exports begin */
@@ -89,4 +151,6 @@ void curl_obj_free(struct text_object *);
 
 /* $curl exports end */
 
+void print_github(struct text_object *, char *, unsigned int);
+
 #endif /* _CURL_THREAD_H_ */
@@ -0,0 +1,234 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "cgroup.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <mutex>
+
+#include "common.h"
+#include "conky.h"
+#include "key-table.hh"
+#include "linux.h"
+#include "logging.h"
+#include "psi.h"
+#include "text_object.h"
+
+/* Where the cgroup v2 hierarchy is mounted, found on first use. */
+static const std::string &cgroup_root() {
+  static const std::string root = [] {
+    std::string found = "/sys/fs/cgroup";
+    int reported = 0;
+    FILE *fp = open_file("/proc/self/mountinfo", &reported);
+    if (fp == nullptr) { return found; }
+
+    /* 30 23 0:26 / /sys/fs/cgroup rw,nosuid - cgroup2 cgroup2 rw */
+    char line[1024], mount_point[512];
+    while (fgets(line, sizeof line, fp) != nullptr) {
+      const char *fs = strstr(line, " - ");
+      if (fs != nullptr && strncmp(fs + 3, "cgroup2 ", 8) == 0 &&
+          sscanf(line, "%*s %*s %*s %*s %511s", mount_point) == 1) {
+        found = mount_point;
+        break;
+      }
+    }
+    fclose(fp);
+    return found;
+  }();
+  return root;
+}
+
+/* The group conky itself runs in, e.g. the container's. */
+static std::string own_cgroup() {
+  int reported = 0;
+  FILE *fp = open_file("/proc/self/cgroup", &reported);
+  std::string group;
+  if (fp == nullptr) { return group; }
+
+  /* the v2 hierarchy is the one with id 0: "0::/user.slice/..." */
+  char line[1024];
+  while (fgets(line, sizeof line, fp) != nullptr) {
+    if (strncmp(line, "0::", 3) == 0) {
+      group = line + 3;
+      while (!group.empty() && group.back() == '\n') { group.pop_back(); }
+      break;
+    }
+  }
+  fclose(fp);
+  return group;
+}
+
+static const char *cgroup_file(int metric) {
+  switch (metric) {
+    case CGROUP_CPU:
+      return "cpu.stat";
+    case CGROUP_MEM:
+      return "memory.current";
+    case CGROUP_IO:
+      return "io.stat";
+    case CGROUP_PRESSURE_CPU:
+      return "cpu.pressure";
+    case CGROUP_PRESSURE_MEM:
+      return "memory.pressure";
+    default:
+      return "io.pressure";
+  }
+}
+
+cgroup_cb::cgroup_cb(double period, const std::string &group, int metric)
+    : Base(period, true, Base::Tuple(group, metric)),
+      file((group + "/" + cgroup_file(metric)).c_str()),
+      reported(0),
+      last_value(0),
+      last_time(0) {}
+
+/* rbytes= plus wbytes= of every device in io.stat */
+static unsigned long long io_stat_bytes(const char *p, const char *end) {
+  static const char rbytes[] = "rbytes=", wbytes[] = "wbytes=";
+  unsigned long long total = 0, value;
+
+  while (p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) { eol = end; }
+    for (const char *key : {rbytes, wbytes}) {
+      const char *at =
+          static_cast<const char *>(memmem(p, eol - p, key, strlen(key)));
+      if (at != nullptr) {
+        scan_decimal(at + strlen(key), eol, &value);
+        total += value;
+      }
+    }
+    p = eol + 1;
+  }
+  return total;
+}
+
+void cgroup_cb::work() {
+  static constexpr auto cpu_stat_keys = conky::make_key_table("usage_usec");
+  static const long cpus = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+  double value = 0;
+
+  const char *buf = file.read(&reported);
+  if (buf != nullptr) {
+    const char *end = buf + file.size();
+    unsigned long long counter = 0;
+    double now = get_time();
+
+    switch (get<1>()) {
+      case CGROUP_CPU:
+      case CGROUP_IO:
+        if (get<1>() == CGROUP_CPU) {
+          conky::for_each_key_value(
+              buf, end, cpu_stat_keys,
+              [&](size_t, const char *v, const char *eol) {
+                scan_decimal(v, eol, &counter);
+              });
+        } else {
+          counter = io_stat_bytes(buf, end);
+        }
+        if (last_time > 0 && now > last_time && counter >= last_value) {
+          value = (counter - last_value) / (now - last_time);
+          /* usage_usec is in microseconds of cpu time */
+          if (get<1>() == CGROUP_CPU) { value *= 100 / (1e6 * cpus); }
+        }
+        last_value = counter;
+        last_time = now;
+        break;
+      case CGROUP_MEM:
+        scan_decimal(buf, end, &counter);
+        value = counter;
+        break;
+      default:
+        value = psi_avg10(buf, end, false);
+        break;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = value;
+}
+
+static std::string cgroup_path(const char *group) {
+  while (group != nullptr && *group == ' ') { ++group; }
+  std::string path =
+      group != nullptr && *group != 0 ? std::string(group) : own_cgroup();
+  while (!path.empty() && path.back() == ' ') { path.pop_back(); }
+  if (!path.empty() && path[0] == '/') { path.erase(0, 1); }
+  return path.empty() ? cgroup_root() : cgroup_root() + "/" + path;
+}
+
+void parse_cgroup_arg(struct text_object *obj, const char *arg,
+                      enum cgroup_metric metric) {
+  obj->data.opaque = new conky::callback_handle<cgroup_cb>(
+      conky::register_cb<cgroup_cb>(0, cgroup_path(arg), metric));
+}
+
+void parse_cgroup_pressure_arg(struct text_object *obj, const char *arg) {
+  char resource[8] = "";
+  int n = 0;
+  enum cgroup_metric metric;
+
+  if (arg == nullptr || sscanf(arg, "%7s %n", resource, &n) < 1) {
+    NORM_ERR("cgroup_pressure needs a resource: cpu, memory or io");
+    return;
+  }
+  if (strcmp(resource, "cpu") == 0) {
+    metric = CGROUP_PRESSURE_CPU;
+  } else if (strcmp(resource, "memory") == 0) {
+    metric = CGROUP_PRESSURE_MEM;
+  } else if (strcmp(resource, "io") == 0) {
+    metric = CGROUP_PRESSURE_IO;
+  } else {
+    NORM_ERR("cgroup_pressure: unknown resource '%s', use cpu, memory or io",
+             resource);
+    return;
+  }
+  parse_cgroup_arg(obj, arg + n, metric);
+}
+
+static double cgroup_value(struct text_object *obj) {
+  auto *cb = static_cast<conky::callback_handle<cgroup_cb> *>(obj->data.opaque);
+
+  return cb != nullptr ? (*cb)->read_result() : 0;
+}
+
+uint8_t cgroup_percentage(struct text_object *obj) {
+  return round_to_positive_int(cgroup_value(obj));
+}
+
+void print_cgroup_bytes(struct text_object *obj, char *p,
+                        unsigned int p_max_size) {
+  human_readable(static_cast<long long>(cgroup_value(obj)), p, p_max_size);
+}
+
+void free_cgroup(struct text_object *obj) {
+  delete static_cast<conky::callback_handle<cgroup_cb> *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
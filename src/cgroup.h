@@ -0,0 +1,74 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _CGROUP_H
+#define _CGROUP_H
+
+#include <string>
+
+#include "proc-file.hh"
+#include "update-cb.hh"
+
+/* what a cgroup_cb reads about its group */
+enum cgroup_metric {
+  CGROUP_CPU,          /* cpu.stat usage_usec, percent of all cpus */
+  CGROUP_MEM,          /* memory.current, in bytes */
+  CGROUP_IO,           /* io.stat rbytes + wbytes, in bytes per second */
+  CGROUP_PRESSURE_CPU, /* avg10 of "some" in cpu.pressure, a percentage */
+  CGROUP_PRESSURE_MEM,
+  CGROUP_PRESSURE_IO,
+};
+
+/**
+ * Reads one metric of one cgroup v2 group every update. Only groups that
+ * an object refers to get one, and the file it reads stays open between
+ * updates. Objects for the same group and metric share it.
+ */
+class cgroup_cb : public conky::callback<double, std::string, int> {
+  typedef conky::callback<double, std::string, int> Base;
+
+  conky::proc_file file;
+  int reported;
+  /* the last reading of the counter behind a rate, and when it was taken */
+  unsigned long long last_value;
+  double last_time;
+
+ protected:
+  virtual void work();
+
+ public:
+  cgroup_cb(double period, const std::string &group, int metric);
+};
+
+void parse_cgroup_arg(struct text_object *, const char *, enum cgroup_metric);
+void parse_cgroup_pressure_arg(struct text_object *, const char *);
+uint8_t cgroup_percentage(struct text_object *);
+void print_cgroup_bytes(struct text_object *, char *, unsigned int);
+void free_cgroup(struct text_object *);
+
+#endif /* _CGROUP_H */
@@ -25,9 +25,14 @@
 #include "text_object.h"
 
 #include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include <cmath>
 #include <mutex>
 
@@ -48,91 +53,164 @@ struct cmus_result {
   std::string track;
   std::string genre;
   std::string date;
-  float progress;
-  float timeleft;
+  float progress{};
+  float timeleft{};
 };
 
 class cmus_cb : public conky::callback<cmus_result> {
   typedef conky::callback<cmus_result> Base;
 
+  /* connection to the cmus socket, kept open between updates */
+  int fd;
+  /* the last reply, reused so reading it doesn't allocate once it is big
+   * enough */
+  std::string reply;
+
+  bool query();
+
  protected:
   virtual void work();
 
  public:
-  explicit cmus_cb(uint32_t period) : Base(period, false, Tuple()) {}
+  explicit cmus_cb(double period)
+      : Base(period, false, Tuple()), fd(-1) {}
+
+  ~cmus_cb() {
+    if (fd != -1) close(fd);
+  }
 };
 
+/* where cmus-remote would connect to */
+std::string cmus_socket_path() {
+  const char *env = getenv("CMUS_SOCKET");
+  if (env && *env) return env;
+
+  env = getenv("XDG_RUNTIME_DIR");
+  if (env && *env) return std::string(env) + "/cmus-socket";
+
+  std::string dir;
+  const char *home = getenv("HOME");
+  struct stat st;
+  if ((env = getenv("CMUS_HOME")) && *env) {
+    dir = env;
+  } else if (home &&
+             stat((std::string(home) + "/.cmus").c_str(), &st) == 0) {
+    dir = std::string(home) + "/.cmus";
+  } else if ((env = getenv("XDG_CONFIG_HOME")) && *env) {
+    dir = std::string(env) + "/cmus";
+  } else {
+    dir = std::string(home ? home : "") + "/.config/cmus";
+  }
+  return dir + "/socket";
+}
+
+/* Asks cmus for its status, leaving the reply in reply. The reply ends with
+ * an empty line. Returns false if cmus isn't running or stopped answering. */
+bool cmus_cb::query() {
+  if (fd == -1) {
+    std::string path = cmus_socket_path();
+    struct sockaddr_un addr;
+
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) return false;
+    if (connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                sizeof(addr)) == -1) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+  }
+
+  if (send(fd, "status\n", 7, MSG_NOSIGNAL) != 7) return false;
+
+  reply.clear();
+  while (reply.size() < 2 || reply.compare(reply.size() - 2, 2, "\n\n") != 0) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char buf[1024];
+
+    /* cmus answers right away, don't hang the update if it is stuck */
+    if (poll(&pfd, 1, 1000) <= 0) return false;
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) return false;
+    reply.append(buf, n);
+  }
+  return true;
+}
+
 void cmus_cb::work() {
   cmus_result cmus;
-  FILE *fp;
 
-  fp = popen("cmus-remote -Q 2>/dev/null", "r");
-  if (!fp) {
-    cmus.state = "Can't run 'cmus-remote -Q'";
-  } else {
-    while (1) {
-      char line[255];
-      char *p;
-
-      /* Read a line from the pipe and strip the possible '\n'. */
-      if (!fgets(line, 255, fp)) break;
-      if ((p = strrchr(line, '\n'))) *p = '\0';
-
-      /* Parse infos. */
-      if (strncmp(line, "status ", 7) == 0) {
-        cmus.state = line + 7;
-
-      } else if (strncmp(line, "file ", 5) == 0) {
-        cmus.file = line + 5;
-
-      } else if (strncmp(line, "tag artist ", 11) == 0) {
-        cmus.artist = line + 11;
-
-      } else if (strncmp(line, "tag title ", 10) == 0) {
-        cmus.title = line + 10;
-
-      } else if (strncmp(line, "tag album ", 10) == 0) {
-        cmus.album = line + 10;
-
-      } else if (strncmp(line, "duration ", 9) == 0) {
-        cmus.totaltime = line + 9;
-
-      } else if (strncmp(line, "position ", 9) == 0) {
-        cmus.curtime = line + 9;
-        cmus.timeleft = strtol(cmus.totaltime.c_str(), nullptr, 10) -
-                        strtol(cmus.curtime.c_str(), nullptr, 10);
-        if (cmus.curtime.size() > 0) {
-          cmus.progress =
-              static_cast<float>(strtol(cmus.curtime.c_str(), nullptr, 10)) /
-              strtol(cmus.totaltime.c_str(), nullptr, 10);
-        } else {
-          cmus.progress = 0;
-        }
-      }
+  if (!query()) {
+    if (fd != -1) {
+      close(fd);
+      fd = -1;
+    }
+    reply.clear();
+  }
+
+  for (size_t start = 0, end; start < reply.size(); start = end + 1) {
+    end = reply.find('\n', start);
+    if (end == std::string::npos) end = reply.size();
+    reply[end] = '\0';
+    const char *line = &reply[start];
+
+    /* Parse infos. */
+    if (strncmp(line, "status ", 7) == 0) {
+      cmus.state = line + 7;
 
-      else if (strncmp(line, "set shuffle ", 12) == 0) {
-        cmus.random = (strncmp(line + 12, "true", 4) == 0 ? "on" : "off");
+    } else if (strncmp(line, "file ", 5) == 0) {
+      cmus.file = line + 5;
 
-      } else if (strncmp(line, "set repeat ", 11) == 0) {
-        cmus.repeat = (strncmp((line + 11), "true", 4) == 0 ? "all" : "off");
+    } else if (strncmp(line, "tag artist ", 11) == 0) {
+      cmus.artist = line + 11;
 
-      } else if (strncmp(line, "set repeat_current ", 19) == 0) {
-        cmus.repeat =
-            (strncmp((line + 19), "true", 4) == 0 ? "song" : cmus.repeat);
-      } else if (strncmp(line, "set aaa_mode ", 13) == 0) {
-        cmus.aaa = line + 13;
+    } else if (strncmp(line, "tag title ", 10) == 0) {
+      cmus.title = line + 10;
 
-      } else if (strncmp(line, "tag tracknumber ", 16) == 0) {
-        cmus.track = line + 16;
-      } else if (strncmp(line, "tag genre ", 10) == 0) {
-        cmus.genre = line + 10;
-      } else if (strncmp(line, "tag date ", 9) == 0) {
-        cmus.date = line + 9;
+    } else if (strncmp(line, "tag album ", 10) == 0) {
+      cmus.album = line + 10;
+
+    } else if (strncmp(line, "duration ", 9) == 0) {
+      cmus.totaltime = line + 9;
+
+    } else if (strncmp(line, "position ", 9) == 0) {
+      cmus.curtime = line + 9;
+      cmus.timeleft = strtol(cmus.totaltime.c_str(), nullptr, 10) -
+                      strtol(cmus.curtime.c_str(), nullptr, 10);
+      if (cmus.curtime.size() > 0) {
+        cmus.progress =
+            static_cast<float>(strtol(cmus.curtime.c_str(), nullptr, 10)) /
+            strtol(cmus.totaltime.c_str(), nullptr, 10);
+      } else {
+        cmus.progress = 0;
       }
     }
-  }
 
-  pclose(fp);
+    else if (strncmp(line, "set shuffle ", 12) == 0) {
+      cmus.random = (strncmp(line + 12, "true", 4) == 0 ? "on" : "off");
+
+    } else if (strncmp(line, "set repeat ", 11) == 0) {
+      cmus.repeat = (strncmp((line + 11), "true", 4) == 0 ? "all" : "off");
+
+    } else if (strncmp(line, "set repeat_current ", 19) == 0) {
+      cmus.repeat =
+          (strncmp((line + 19), "true", 4) == 0 ? "song" : cmus.repeat);
+    } else if (strncmp(line, "set aaa_mode ", 13) == 0) {
+      cmus.aaa = line + 13;
+
+    } else if (strncmp(line, "tag tracknumber ", 16) == 0) {
+      cmus.track = line + 16;
+    } else if (strncmp(line, "tag genre ", 10) == 0) {
+      cmus.genre = line + 10;
+    } else if (strncmp(line, "tag date ", 9) == 0) {
+      cmus.date = line + 9;
+    }
+  }
 
   std::lock_guard<std::mutex> l(result_mutex);
   result = cmus;
@@ -143,11 +221,9 @@ void cmus_cb::work() {
   void print_cmus_##type(struct text_object *obj, char *p,                    \
                          unsigned int p_max_size) {                           \
     (void)obj;                                                                \
-    uint32_t period = std::max(                                               \
-        lround(music_player_interval.get(*state) / active_update_interval()), \
-        1l);                                                                  \
+    double period = music_player_interval.get(*state);                        \
     const cmus_result &cmus =                                                 \
-        conky::register_cb<cmus_cb>(period)->get_result_copy();               \
+        conky::register_cb<cmus_cb>(period)->read_result();                   \
     snprintf(p, p_max_size, "%s",                                             \
              (cmus.type.length() ? cmus.type.c_str() : alt));                 \
   }
@@ -166,29 +242,26 @@ CMUS_PRINT_GENERATOR(date, "")
 
 uint8_t cmus_percent(struct text_object *obj) {
   (void)obj;
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
+  double period = music_player_interval.get(*state);
   const cmus_result &cmus =
-      conky::register_cb<cmus_cb>(period)->get_result_copy();
+      conky::register_cb<cmus_cb>(period)->read_result();
   return static_cast<uint8_t>(round(cmus.progress * 100.0f));
 }
 
 double cmus_progress(struct text_object *obj) {
   (void)obj;
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
+  double period = music_player_interval.get(*state);
   const cmus_result &cmus =
-      conky::register_cb<cmus_cb>(period)->get_result_copy();
+      conky::register_cb<cmus_cb>(period)->read_result();
   return static_cast<double>(cmus.progress);
 }
 
 void print_cmus_totaltime(struct text_object *obj, char *p,
                           unsigned int p_max_size) {
   (void)obj;
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
+  double period = music_player_interval.get(*state);
   const cmus_result &cmus =
-      conky::register_cb<cmus_cb>(period)->get_result_copy();
+      conky::register_cb<cmus_cb>(period)->read_result();
   format_seconds_short(p, p_max_size,
                        strtol(cmus.totaltime.c_str(), nullptr, 10));
 }
@@ -196,20 +269,18 @@ void print_cmus_totaltime(struct text_object *obj, char *p,
 void print_cmus_timeleft(struct text_object *obj, char *p,
                          unsigned int p_max_size) {
   (void)obj;
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
+  double period = music_player_interval.get(*state);
   const cmus_result &cmus =
-      conky::register_cb<cmus_cb>(period)->get_result_copy();
+      conky::register_cb<cmus_cb>(period)->read_result();
   format_seconds_short(p, p_max_size, static_cast<long>(cmus.timeleft));
 }
 
 void print_cmus_curtime(struct text_object *obj, char *p,
                         unsigned int p_max_size) {
   (void)obj;
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
+  double period = music_player_interval.get(*state);
   const cmus_result &cmus =
-      conky::register_cb<cmus_cb>(period)->get_result_copy();
+      conky::register_cb<cmus_cb>(period)->read_result();
   format_seconds_short(p, p_max_size,
                        strtol(cmus.curtime.c_str(), nullptr, 10));
 }
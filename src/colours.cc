@@ -29,6 +29,8 @@
 #include "conky.h"
 #include "logging.h"
 #ifdef BUILD_X11
+#include <string>
+#include <unordered_map>
 #include "x11.h"
 #endif
 
@@ -84,7 +86,20 @@ unsigned int adjust_colours(unsigned int colour) {
 }
 
 #ifdef BUILD_X11
-long get_x11_color(const char *name) {
+namespace {
+/* The pixels of the colours allocated so far by name, so that colour settings
+ * and objects don't ask the X server again each time they are read. They are
+ * only good for the colormap and depth they were allocated for. Names that
+ * can't be parsed are kept too, to complain only once. */
+struct x11_colour_cache {
+  Display *display = nullptr;
+  Colormap colormap = 0;
+  int depth = 0;
+  std::unordered_map<std::string, long> pixels;
+} colour_cache;
+}  // namespace
+
+static long alloc_x11_color(const char *name) {
   XColor color;
 
   color.pixel = 0;
@@ -110,6 +125,31 @@ long get_x11_color(const char *name) {
   return static_cast<long>(color.pixel);
 }
 
+long get_x11_color(const char *name) {
+  Colormap colormap = DefaultColormap(display, screen);
+  int depth = DisplayPlanes(display, screen);
+
+  if (colour_cache.display != display || colour_cache.colormap != colormap ||
+      colour_cache.depth != depth) {
+    clear_x11_color_cache();
+    colour_cache.display = display;
+    colour_cache.colormap = colormap;
+    colour_cache.depth = depth;
+  }
+
+  auto it = colour_cache.pixels.find(name);
+  if (it != colour_cache.pixels.end()) { return it->second; }
+
+  long pixel = alloc_x11_color(name);
+  colour_cache.pixels.emplace(name, pixel);
+  return pixel;
+}
+
+void clear_x11_color_cache() {
+  colour_cache.display = nullptr;
+  colour_cache.pixels.clear();
+}
+
 long get_x11_color(const std::string &colour) {
   return get_x11_color(colour.c_str());
 }
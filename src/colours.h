@@ -37,5 +37,8 @@ unsigned int adjust_colours(unsigned int);
 long get_x11_color(const std::string &colour);
 // XXX: when everyone uses C++ strings, remove this C version
 long get_x11_color(const char *);
+/* forgets the colours get_x11_color() allocated, e.g. before closing the
+ * display */
+void clear_x11_color_cache();
 
 #endif /* _COLOURS_H */
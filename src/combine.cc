@@ -27,16 +27,29 @@
  *
  */
 
+#include <algorithm>
+#include <cstring>
+#include <string>
 #include <vector>
 
 #include "core.h"
 #include "logging.h"
 #include "text_object.h"
 
+/* a row of one side, as an offset and length into that side's scratch
+ * buffer */
+struct combine_row {
+  size_t start;
+  size_t len;
+};
+
 struct combine_data {
-  char *left;
-  char *seperation;
-  char *right;
+  std::string left;
+  std::string seperation;
+  std::string right;
+  /* scratch space reused on every print, so that a frame doesn't allocate */
+  std::vector<char> buf[2];
+  std::vector<combine_row> rows[2];
 };
 
 void parse_combine_arg(struct text_object *obj, const char *arg) {
@@ -66,140 +79,103 @@ void parse_combine_arg(struct text_object *obj, const char *arg) {
   }
   if (startvar[0] >= 0 && endvar[0] >= 0 && startvar[1] >= 0 &&
       endvar[1] >= 0) {
-    cd =
-        static_cast<struct combine_data *>(malloc(sizeof(struct combine_data)));
-    memset(cd, 0, sizeof(struct combine_data));
-
-    cd->left = static_cast<char *>(malloc(endvar[0] - startvar[0] + 1));
-    cd->seperation = static_cast<char *>(malloc(startvar[1] - endvar[0] + 1));
-    cd->right = static_cast<char *>(malloc(endvar[1] - startvar[1] + 1));
-
-    strncpy(cd->left, arg + startvar[0], endvar[0] - startvar[0]);
-    cd->left[endvar[0] - startvar[0]] = 0;
-
-    strncpy(cd->seperation, arg + endvar[0], startvar[1] - endvar[0]);
-    cd->seperation[startvar[1] - endvar[0]] = 0;
-
-    strncpy(cd->right, arg + startvar[1], endvar[1] - startvar[1]);
-    cd->right[endvar[1] - startvar[1]] = 0;
+    cd = new combine_data;
+    cd->left.assign(arg + startvar[0], endvar[0] - startvar[0]);
+    cd->seperation.assign(arg + endvar[0], startvar[1] - endvar[0]);
+    cd->right.assign(arg + startvar[1], endvar[1] - startvar[1]);
 
     obj->sub =
         static_cast<struct text_object *>(malloc(sizeof(struct text_object)));
-    extract_variable_text_internal(obj->sub, cd->left);
+    extract_variable_text_internal(obj->sub, cd->left.c_str());
     obj->sub->sub =
         static_cast<struct text_object *>(malloc(sizeof(struct text_object)));
-    extract_variable_text_internal(obj->sub->sub, cd->right);
+    extract_variable_text_internal(obj->sub->sub, cd->right.c_str());
     obj->data.opaque = cd;
   } else {
     throw combine_needs_2_args_error();
   }
 }
 
+/* Generate one side into its scratch buffer and split it into rows in place.
+ * Tabs become spaces, \002 separates rows and a \n ends the text, since the
+ * vars inside combine may not have a \n at the end.  Returns the length of
+ * the longest row. */
+static size_t combine_split(std::vector<char> &buf,
+                            std::vector<combine_row> &rows,
+                            text_object &objsub) {
+  size_t longest = 0;
+  size_t start = 0;
+  size_t j;
+
+  buf.resize(max_user_text.get(*state));
+  generate_text_internal(buf.data(), buf.size(), objsub);
+  rows.clear();
+  for (j = 0; buf[j] != 0 && buf[j] != '\n'; j++) {
+    if (buf[j] == '\t') {
+      buf[j] = ' ';
+    } else if (buf[j] == 2) {
+      rows.push_back({start, j - start});
+      if (j - start > longest) { longest = j - start; }
+      start = j + 1;
+    }
+  }
+  rows.push_back({start, j - start});
+  if (j - start > longest) { longest = j - start; }
+  return longest;
+}
+
+static inline void combine_append(char *p, size_t &len, size_t max_len,
+                                  const char *s, size_t n) {
+  if (n > max_len - len) { n = max_len - len; }
+  memcpy(p + len, s, n);
+  len += n;
+}
+
 void print_combine(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *cd = static_cast<struct combine_data *>(obj->data.opaque);
-  std::vector<std::vector<char>> buf;
-  buf.resize(2);
-  buf[0].resize(max_user_text.get(*state));
-  buf[1].resize(max_user_text.get(*state));
-  int i, j;
-  int p_len_remaining = p_max_size - 1;
-  long longest = 0;
-  int nextstart;
-  int nr_rows[2];
-  struct llrows {
-    char *row;
-    struct llrows *next;
-  };
-  struct llrows *ll_rows[2], *current[2];
-  struct text_object *objsub = obj->sub;
 
   if ((cd == nullptr) || (p_max_size == 0)) { return; }
 
-  p[0] = 0;
-  for (i = 0; i < 2; i++) {
-    nr_rows[i] = 1;
-    nextstart = 0;
-    ll_rows[i] = static_cast<struct llrows *>(malloc(sizeof(struct llrows)));
-    current[i] = ll_rows[i];
-    for (j = 0; j < i; j++) { objsub = objsub->sub; }
-    generate_text_internal(&(buf[i][0]), max_user_text.get(*state), *objsub);
-    for (j = 0; buf[i][j] != 0; j++) {
-      if (buf[i][j] == '\t') { buf[i][j] = ' '; }
-      if (buf[i][j] == '\n') {
-        buf[i][j] = 0;  // the vars inside combine may not have a \n at the end
-      }
-      if (buf[i][j] ==
-          2) {  // \002 is used instead of \n to separate lines inside a var
-        buf[i][j] = 0;
-        current[i]->row = strdup(&(buf[i][0]) + nextstart);
-        if (i == 0 && static_cast<long>(strlen(current[i]->row)) > longest) {
-          longest = static_cast<long>(strlen(current[i]->row));
-        }
-        current[i]->next =
-            static_cast<struct llrows *>(malloc(sizeof(struct llrows)));
-        current[i] = current[i]->next;
-        nextstart = j + 1;
-        nr_rows[i]++;
-      }
-    }
-    current[i]->row = strdup(&(buf[i][0]) + nextstart);
-    if (i == 0 && static_cast<long>(strlen(current[i]->row)) > longest) {
-      longest = static_cast<long>(strlen(current[i]->row));
-    }
-    current[i]->next = nullptr;
-    current[i] = ll_rows[i];
-  }
-  for (j = 0; j < (nr_rows[0] > nr_rows[1] ? nr_rows[0] : nr_rows[1]); j++) {
-    if (current[0] != nullptr) {
-      strncat(p, current[0]->row, p_len_remaining);
-      p_len_remaining -= strlen(current[0]->row);
-      i = strlen(current[0]->row);
-    } else {
-      i = 0;
-    }
-    while (i < longest) {
-      strncat(p, " ", p_len_remaining);
-      p_len_remaining -= 2;
-      i++;
-    }
-    if (current[1] != nullptr) {
-      p_len_remaining -= strlen(cd->seperation);
-      strncat(p, cd->seperation, p_len_remaining);
-      p_len_remaining -= strlen(current[1]->row);
-      strncat(p, current[1]->row, p_len_remaining);
+  size_t longest = combine_split(cd->buf[0], cd->rows[0], *obj->sub);
+  combine_split(cd->buf[1], cd->rows[1], *obj->sub->sub);
+
+  const std::vector<combine_row> &left = cd->rows[0];
+  const std::vector<combine_row> &right = cd->rows[1];
+  size_t nr_rows = std::max(left.size(), right.size());
+  size_t max_len = p_max_size - 1;
+  size_t len = 0;
+
+  for (size_t j = 0; j < nr_rows && len < max_len; j++) {
+    size_t width = 0;
+    if (j < left.size()) {
+      width = left[j].len;
+      combine_append(p, len, max_len, cd->buf[0].data() + left[j].start,
+                     width);
     }
-    strncat(p, "\n", p_len_remaining);
-    p_len_remaining -= 2;
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-    for (i = 0; i < 2; i++) {
-      if (current[i] != nullptr) { current[i] = current[i]->next; }
+    if (longest > width) {
+      size_t pad = std::min(longest - width, max_len - len);
+      memset(p + len, ' ', pad);
+      len += pad;
     }
-  }
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-  for (i = 0; i < 2; i++) {
-    while (ll_rows[i] != nullptr) {
-      current[i] = ll_rows[i];
-      free(current[i]->row);
-      ll_rows[i] = current[i]->next;
-      free(current[i]);
+    if (j < right.size()) {
+      combine_append(p, len, max_len, cd->seperation.data(),
+                     cd->seperation.size());
+      combine_append(p, len, max_len, cd->buf[1].data() + right[j].start,
+                     right[j].len);
     }
+    combine_append(p, len, max_len, "\n", 1);
   }
+  p[len] = 0;
 }
 
 void free_combine(struct text_object *obj) {
   auto *cd = static_cast<struct combine_data *>(obj->data.opaque);
 
   if (cd == nullptr) { return; }
-  free(cd->left);
-  free(cd->seperation);
-  free(cd->right);
   free_text_objects(obj->sub->sub);
   free_and_zero(obj->sub->sub);
   free_text_objects(obj->sub);
   free_and_zero(obj->sub);
-  free_and_zero(obj->data.opaque);
+  delete cd;
+  obj->data.opaque = nullptr;
 }
@@ -41,10 +41,13 @@
 #include "config.h"
 #include "conky.h"
 #include "core.h"
+#include "file-watch.hh"
 #include "fs.h"
 #include "logging.h"
 #include "misc.h"
 #include "net_stat.h"
+#include "number-format.hh"
+#include "session-capture.hh"
 #include "specials.h"
 #include "temphelper.h"
 #include "timeinfo.h"
@@ -95,6 +98,8 @@ char *strndup(const char *s, size_t n) {
 }
 #endif /* HAVE_STRNDUP */
 
+std::atomic<uint64_t> uname_generation(0);
+
 int update_uname() {
   uname(&info.uname_s);
 
@@ -116,6 +121,7 @@ int update_uname() {
   }
 #endif
 
+  ++uname_generation;
   return 0;
 }
 
@@ -155,10 +161,21 @@ int open_fifo(const char *file, int *reported) {
   return fd;
 }
 
-FILE *open_file(const char *file, int *reported) {
-  FILE *fp = nullptr;
+static std::string open_file_root;
+
+void set_open_file_root(const std::string &root) { open_file_root = root; }
+
+std::string open_file_path(const char *file) {
+  std::string recorded;
+  if (conky::record_session_file(file, recorded)) { return recorded; }
+  if (!open_file_root.empty() && file[0] == '/') {
+    return open_file_root + file;
+  }
+  return file;
+}
 
-  fp = fopen(file, "re");
+FILE *open_file(const char *file, int *reported) {
+  FILE *fp = fopen(open_file_path(file).c_str(), "re");
 
   if (fp == nullptr) {
     if ((reported == nullptr) || *reported == 0) {
@@ -214,11 +231,12 @@ std::string variable_substitute(std::string s) {
 }
 
 void format_seconds(char *buf, unsigned int n, long seconds) {
+  conky::text_writer out(buf, n);
   long days;
   int hours, minutes;
 
   if (times_in_seconds.get(*state)) {
-    snprintf(buf, n, "%ld", seconds);
+    out.append(seconds).finish();
     return;
   }
 
@@ -230,18 +248,22 @@ void format_seconds(char *buf, unsigned int n, long seconds) {
   seconds %= 60;
 
   if (days > 0) {
-    snprintf(buf, n, "%ldd %dh %dm", days, hours, minutes);
+    out.append(days).append("d ").append(hours).append("h ");
+    out.append(minutes).append("m");
   } else {
-    snprintf(buf, n, "%dh %dm %lds", hours, minutes, seconds);
+    out.append(hours).append("h ").append(minutes).append("m ");
+    out.append(seconds).append("s");
   }
+  out.finish();
 }
 
 void format_seconds_short(char *buf, unsigned int n, long seconds) {
+  conky::text_writer out(buf, n);
   long days;
   int hours, minutes;
 
   if (times_in_seconds.get(*state)) {
-    snprintf(buf, n, "%ld", seconds);
+    out.append(seconds).finish();
     return;
   }
 
@@ -253,12 +275,13 @@ void format_seconds_short(char *buf, unsigned int n, long seconds) {
   seconds %= 60;
 
   if (days > 0) {
-    snprintf(buf, n, "%ldd %dh", days, hours);
+    out.append(days).append("d ").append(hours).append("h");
   } else if (hours > 0) {
-    snprintf(buf, n, "%dh %dm", hours, minutes);
+    out.append(hours).append("h ").append(minutes).append("m");
   } else {
-    snprintf(buf, n, "%dm %lds", minutes, seconds);
+    out.append(minutes).append("m ").append(seconds).append("s");
   }
+  out.finish();
 }
 
 conky::simple_config_setting<bool> no_buffers("no_buffers", true, true);
@@ -272,21 +295,18 @@ conky::simple_config_setting<std::string> github_token("github_token", "",
 void update_stuff() {
   /* clear speeds, addresses and up status in case device was removed and
    *  doesn't get updated */
-
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-  for (int i = 0; i < MAX_NET_INTERFACES; ++i) {
-    if (netstats[i].dev != nullptr) {
-      netstats[i].up = 0;
-      netstats[i].recv_speed = 0.0;
-      netstats[i].trans_speed = 0.0;
-      netstats[i].addr.sa_data[2] = 0;
-      netstats[i].addr.sa_data[3] = 0;
-      netstats[i].addr.sa_data[4] = 0;
-      netstats[i].addr.sa_data[5] = 0;
-    }
-  }
+  for_each_net_stat([](struct net_stat *ns) {
+    ns->up = 0;
+    ns->recv_speed = 0.0;
+    ns->trans_speed = 0.0;
+    ns->addr.sa_data[2] = 0;
+    ns->addr.sa_data[3] = 0;
+    ns->addr.sa_data[4] = 0;
+    ns->addr.sa_data[5] = 0;
+  });
+
+  /* recorded sessions move on to the next frame's files */
+  conky::next_session_frame();
 
   /* this is a stub on all platforms except solaris */
   prepare_update();
@@ -366,7 +386,8 @@ double loadgraphval(struct text_object *obj) {
 #endif /* BUILD_GUI */
 
 uint8_t cpu_percentage(struct text_object *obj) {
-  if (static_cast<unsigned int>(obj->data.i) > info.cpu_count) {
+  if (static_cast<unsigned int>(obj->data.i) >
+      info.cpu_count + info.cpu_groups) {
     NORM_ERR("obj->data.i %i info.cpu_count %i", obj->data.i, info.cpu_count);
     CRIT_ERR(nullptr, nullptr, "attempting to use more CPUs than you have!");
   }
@@ -377,7 +398,8 @@ uint8_t cpu_percentage(struct text_object *obj) {
 }
 
 double cpu_barval(struct text_object *obj) {
-  if (static_cast<unsigned int>(obj->data.i) > info.cpu_count) {
+  if (static_cast<unsigned int>(obj->data.i) >
+      info.cpu_count + info.cpu_groups) {
     NORM_ERR("obj->data.i %i info.cpu_count %i", obj->data.i, info.cpu_count);
     CRIT_ERR(nullptr, nullptr, "attempting to use more CPUs than you have!");
   }
@@ -385,11 +407,21 @@ double cpu_barval(struct text_object *obj) {
   return 0.;
 }
 
-#define PRINT_HR_GENERATOR(name)                                     \
-  void print_##name(struct text_object *obj, char *p,                \
-                    unsigned int p_max_size) {                       \
-    human_readable(apply_base_multiplier(obj->data.s, info.name), p, \
-                   p_max_size);                                      \
+#ifdef BUILD_GUI
+void print_cpuheatmap(struct text_object *obj, char *p,
+                      unsigned int p_max_size) {
+  /* cpu_usage[0] is all of them together */
+  new_heatmap(obj, p, p_max_size,
+              info.cpu_usage != nullptr ? info.cpu_usage + 1 : nullptr,
+              info.cpu_usage != nullptr ? info.cpu_count : 0);
+}
+#endif /* BUILD_GUI */
+
+#define PRINT_HR_GENERATOR(name)                                            \
+  int print_##name(struct text_object *obj, char *p,                        \
+                   unsigned int p_max_size) {                               \
+    return human_readable(apply_base_multiplier(obj->data.s, info.name), p, \
+                          p_max_size);                                      \
   }
 
 PRINT_HR_GENERATOR(mem)
@@ -492,105 +524,106 @@ void print_uptime_short(struct text_object *obj, char *p,
   format_seconds_short(p, p_max_size, static_cast<int>(info.uptime));
 }
 
-void print_processes(struct text_object *obj, char *p,
-                     unsigned int p_max_size) {
+int print_processes(struct text_object *obj, char *p,
+                    unsigned int p_max_size) {
   (void)obj;
-  spaced_print(p, p_max_size, "%hu", 4, info.procs);
+  return spaced_print(p, p_max_size, "%hu", 4, info.procs);
 }
 
-void print_running_processes(struct text_object *obj, char *p,
-                             unsigned int p_max_size) {
+int print_running_processes(struct text_object *obj, char *p,
+                            unsigned int p_max_size) {
   (void)obj;
-  spaced_print(p, p_max_size, "%hu", 4, info.run_procs);
+  return spaced_print(p, p_max_size, "%hu", 4, info.run_procs);
 }
 
-void print_running_threads(struct text_object *obj, char *p,
-                           unsigned int p_max_size) {
+int print_running_threads(struct text_object *obj, char *p,
+                          unsigned int p_max_size) {
   (void)obj;
-  spaced_print(p, p_max_size, "%hu", 4, info.run_threads);
+  return spaced_print(p, p_max_size, "%hu", 4, info.run_threads);
 }
 
-void print_threads(struct text_object *obj, char *p, unsigned int p_max_size) {
+int print_threads(struct text_object *obj, char *p, unsigned int p_max_size) {
   (void)obj;
-  spaced_print(p, p_max_size, "%hu", 4, info.threads);
+  return spaced_print(p, p_max_size, "%hu", 4, info.threads);
 }
 
-void print_buffers(struct text_object *obj, char *p, unsigned int p_max_size) {
-  human_readable(apply_base_multiplier(obj->data.s, info.buffers), p,
-                 p_max_size);
+int print_buffers(struct text_object *obj, char *p, unsigned int p_max_size) {
+  return human_readable(apply_base_multiplier(obj->data.s, info.buffers), p,
+                        p_max_size);
 }
 
-void print_cached(struct text_object *obj, char *p, unsigned int p_max_size) {
-  human_readable(apply_base_multiplier(obj->data.s, info.cached), p,
-                 p_max_size);
+int print_cached(struct text_object *obj, char *p, unsigned int p_max_size) {
+  return human_readable(apply_base_multiplier(obj->data.s, info.cached), p,
+                        p_max_size);
 }
 
-void print_free_bufcache(struct text_object *obj, char *p,
-                         unsigned int p_max_size) {
-  human_readable(apply_base_multiplier(obj->data.s, info.free_bufcache), p,
-                 p_max_size);
+int print_free_bufcache(struct text_object *obj, char *p,
+                        unsigned int p_max_size) {
+  return human_readable(
+      apply_base_multiplier(obj->data.s, info.free_bufcache), p, p_max_size);
 }
 
 void print_evaluate(struct text_object *obj, char *p, unsigned int p_max_size) {
-  std::vector<char> buf(text_buffer_size.get(*state));
-  evaluate(obj->data.s, &buf[0], buf.size());
-  evaluate(&buf[0], p, p_max_size);
+  conky::scratch_text buf(text_buffer_size.get(*state));
+  evaluate(obj->data.s, buf.get(), buf.size());
+  evaluate(buf.get(), p, p_max_size);
 }
 
 int if_empty_iftest(struct text_object *obj) {
-  std::vector<char> buf(max_user_text.get(*state));
+  conky::scratch_text buf(max_user_text.get(*state));
   int result = 1;
 
-  generate_text_internal(&(buf[0]), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(buf.get(), buf.size(), *obj->sub);
 
-  if (strlen(&(buf[0])) != 0) { result = 0; }
+  if (buf.get()[0] != 0) { result = 0; }
   return result;
 }
 
-static int check_contains(char *f, char *s) {
-  int ret = 0;
-  FILE *where = open_file(f, nullptr);
+struct if_existing_data {
+  std::shared_ptr<conky::watched_file> file;
+  bool has_pattern{false};
+  std::string pattern;
+  int reported{0};
+};
 
-  if (where != nullptr) {
-    char buf1[256];
+void scan_if_existing(struct text_object *obj, const char *arg) {
+  auto *ed = new if_existing_data;
+  const char *spc = strchr(arg, ' ');
 
-    while (fgets(buf1, 256, where) != nullptr) {
-      if (strstr(buf1, s) != nullptr) {
-        ret = 1;
-        break;
-      }
-    }
-    fclose(where);
-  } else {
-    NORM_ERR("Could not open the file");
+  if (spc != nullptr) {
+    ed->has_pattern = true;
+    ed->pattern = spc + 1;
   }
-  return ret;
+  ed->file = conky::watched_file::get(
+      spc != nullptr ? std::string(arg, spc - arg) : std::string(arg));
+  obj->data.opaque = ed;
 }
 
 int if_existing_iftest(struct text_object *obj) {
-  char *spc;
-  int result = 0;
-
-  spc = strchr(obj->data.s, ' ');
-  if (spc != nullptr) { *spc = 0; }
-  if (access(obj->data.s, F_OK) == 0) {
-    if (spc == nullptr || (check_contains(obj->data.s, spc + 1) != 0)) {
-      result = 1;
+  auto *ed = static_cast<struct if_existing_data *>(obj->data.opaque);
+
+  if (ed == nullptr) { return 0; }
+  ed->file->refresh();
+  if (!ed->file->exists()) { return 0; }
+  if (!ed->has_pattern) { return 1; }
+  if (!ed->file->readable()) {
+    if (ed->reported == 0) {
+      NORM_ERR("Could not open the file");
+      ed->reported = 1;
     }
+    return 0;
   }
-  if (spc != nullptr) { *spc = ' '; }
-  return result;
+  ed->reported = 0;
+  return ed->file->contains(ed->pattern) ? 1 : 0;
+}
+
+void free_if_existing(struct text_object *obj) {
+  delete static_cast<struct if_existing_data *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
 }
 
 int if_running_iftest(struct text_object *obj) {
-#ifdef __linux__
-  if (!get_process_by_name(obj->data.s)) {
-#else
-  if (((obj->data.s) != nullptr) && (system(obj->data.s) != 0)) {
-#endif
-    return 0;
-  }
-  return 1;
+  return get_process_by_name(obj->data.s) != nullptr ? 1 : 0;
 }
 
 #ifndef __OpenBSD__
@@ -677,136 +710,33 @@ void print_battery_status(struct text_object *obj, char *p,
 void print_blink(struct text_object *obj, char *p, unsigned int p_max_size) {
   // blinking like this can look a bit ugly if the chars in the font don't have
   // the same width
-  std::vector<char> buf(max_user_text.get(*state));
   static int visible = 1;
   static int last_len = 0;
-  int i;
 
+  if (p_max_size == 0) { return; }
   if (visible != 0) {
-    generate_text_internal(&(buf[0]), max_user_text.get(*state), *obj->sub);
-    last_len = strlen(&(buf[0]));
+    auto size = std::min<unsigned int>(p_max_size, max_user_text.get(*state));
+    generate_text_internal(p, size, *obj->sub);
+    last_len = strlen(p);
   } else {
-    for (i = 0; i < last_len; i++) { buf[i] = ' '; }
+    int n = std::min(last_len, static_cast<int>(p_max_size) - 1);
+    memset(p, ' ', n);
+    p[n] = 0;
   }
 
-  snprintf(p, p_max_size, "%s", &(buf[0]));
   visible = static_cast<int>(static_cast<int>(visible) == 0);
 }
 
 void print_include(struct text_object *obj, char *p, unsigned int p_max_size) {
-  std::vector<char> buf(max_user_text.get(*state));
-
   if (obj->sub == nullptr) { return; }
 
-  generate_text_internal(&(buf[0]), max_user_text.get(*state), *obj->sub);
-  snprintf(p, p_max_size, "%s", &(buf[0]));
+  /* straight into the output, as much as a copy of max_user_text would have
+   * let through */
+  auto size = std::min<unsigned int>(p_max_size, max_user_text.get(*state));
+  generate_text_internal(p, size, *obj->sub);
 }
 
 #ifdef BUILD_CURL
-#define NEW_TOKEN                       \
-  "https://github.com/settings/tokens/" \
-  "new?scopes=notifications&description=conky-query-github\n"
-static size_t read_github_data_cb(char *, size_t, size_t, char *);
-static size_t read_github_data_cb(char *data, size_t size, size_t nmemb,
-                                  char *p) {
-  char *ptr = data;
-  size_t sz = nmemb * size;
-  size_t z = 0;
-  static size_t x = 0;
-  static unsigned int skip = 0U;
-
-  for (; *ptr; ptr++, z++) {
-    if (z + 4 < sz) { /* Verifying up to *(ptr+4) */
-      if ('u' == *ptr && 'n' == *(ptr + 1) && 'r' == *(ptr + 2) &&
-          'e' == *(ptr + 3)) { /* "unread" */
-        ++x;
-        skip = 0U;
-      }
-      if ('m' == *ptr && 'e' == *(ptr + 1) && 's' == *(ptr + 2) &&
-          's' == *(ptr + 3) && z + 13 < sz) { /* "message": */
-        if ('B' == *(ptr + 10) && 'a' == *(ptr + 11) &&
-            'd' == *(ptr + 12)) { /* "Bad credentials" */
-          NORM_ERR("Bad credentials: generate a new token:\n" NEW_TOKEN);
-          snprintf(p, 80, "%s",
-                   "GitHub: Bad credentials, generate a new token.");
-          skip = 1U;
-          break;
-        }
-        if ('M' == *(ptr + 10) && 'i' == *(ptr + 11) &&
-            's' == *(ptr + 12)) { /* Missing the 'notifications' scope. */
-          NORM_ERR(
-              "Missing 'notifications' scope. Generate a new "
-              "token\n" NEW_TOKEN);
-          snprintf(
-              p, 80, "%s",
-              "GitHub: Missing the notifications scope. Generate a new token.");
-          skip = 1U;
-          break;
-        }
-      }
-    }
-  }
-  if (0U == skip) { snprintf(p, 49, "%zu", x); }
-  return sz;
-}
-
-void print_github(struct text_object *obj, char *p, unsigned int p_max_size) {
-  (void)obj;
-  char github_url[256] = {""};
-  char user_agent[30] = {""};
-  static char cached_result[256] = {""};
-  static unsigned int last_update = 1U;
-  CURL *curl = nullptr;
-  CURLcode res;
-
-  if (0 == strcmp(github_token.get(*state).c_str(), "")) {
-    NORM_ERR(
-        "${github_notifications} requires token. "
-        "Go ahead and generate one " NEW_TOKEN
-        "Insert it in conky.config = { github_token='TOKEN_SHA' }\n");
-    snprintf(p, p_max_size, "%s",
-             "GitHub notifications requires token, generate a new one.");
-    return;
-  }
-
-  if (1U != last_update) {
-    --last_update;
-    snprintf(p, p_max_size, "%s", cached_result);
-    return;
-  }
-
-  snprintf(github_url, 255, "%s%s",
-           "https://api.github.com/notifications?access_token=",
-           github_token.get(*state).c_str());
-  /* unique string for each conky user, so we dont hit any query limits */
-  snprintf(user_agent, 29, "conky/%s", github_token.get(*state).c_str());
-
-  curl_global_init(CURL_GLOBAL_ALL);
-  if (nullptr == (curl = curl_easy_init())) { goto error; }
-  curl_easy_setopt(curl, CURLOPT_URL, github_url);
-#if defined(CURLOPT_ACCEPT_ENCODING)
-  curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip");
-#else  /* defined(CURLOPT_ACCEPT_ENCODING) */
-  curl_easy_setopt(curl, CURLOPT_ENCODING, "gzip");
-#endif /* defined(CURLOPT_ACCEPT_ENCODING) */
-  curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent);
-  curl_easy_setopt(curl, CURLOPT_USE_SSL, (long)CURLUSESSL_ALL);
-  curl_easy_setopt(curl, CURLOPT_TIMEOUT, 20L);
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, read_github_data_cb);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, p);
-
-  res = curl_easy_perform(curl);
-  if (CURLE_OK != res) { goto error; }
-  snprintf(cached_result, 255, "%s", p);
-  last_update = 60U;
-
-error:
-  if (nullptr != curl) { curl_easy_cleanup(curl); }
-  curl_global_cleanup();
-
-  if (!isdigit(static_cast<unsigned char>(*p))) { last_update = 1U; }
-}
-
 void print_stock(struct text_object *obj, char *p, unsigned int p_max_size) {
   if (!obj->data.s) {
     p[0] = 0;
@@ -819,28 +749,28 @@ void free_stock(struct text_object *obj) { free(obj->data.s); }
 #endif /* BUILD_CURL */
 
 void print_to_bytes(struct text_object *obj, char *p, unsigned int p_max_size) {
-  std::vector<char> buf(max_user_text.get(*state));
+  conky::scratch_text buf(max_user_text.get(*state));
   long double bytes;
   char unit[16];  // 16 because we can also have long names (like mega-bytes)
 
-  generate_text_internal(&(buf[0]), max_user_text.get(*state), *obj->sub);
-  if (sscanf(&(buf[0]), "%Lf%s", &bytes, unit) == 2 && strlen(unit) < 16) {
+  generate_text_internal(buf.get(), buf.size(), *obj->sub);
+  if (sscanf(buf.get(), "%Lf%s", &bytes, unit) == 2 && strlen(unit) < 16) {
     if (strncasecmp("b", unit, 1) == 0) {
-      snprintf(&(buf[0]), max_user_text.get(*state), "%Lf", bytes);
+      snprintf(buf.get(), buf.size(), "%Lf", bytes);
     } else if (strncasecmp("k", unit, 1) == 0) {
-      snprintf(&(buf[0]), max_user_text.get(*state), "%Lf", bytes * 1024);
+      snprintf(buf.get(), buf.size(), "%Lf", bytes * 1024);
     } else if (strncasecmp("m", unit, 1) == 0) {
-      snprintf(&(buf[0]), max_user_text.get(*state), "%Lf",
+      snprintf(buf.get(), buf.size(), "%Lf",
                bytes * 1024 * 1024);
     } else if (strncasecmp("g", unit, 1) == 0) {
-      snprintf(&(buf[0]), max_user_text.get(*state), "%Lf",
+      snprintf(buf.get(), buf.size(), "%Lf",
                bytes * 1024 * 1024 * 1024);
     } else if (strncasecmp("t", unit, 1) == 0) {
-      snprintf(&(buf[0]), max_user_text.get(*state), "%Lf",
+      snprintf(buf.get(), buf.size(), "%Lf",
                bytes * 1024 * 1024 * 1024 * 1024);
     }
   }
-  snprintf(p, p_max_size, "%s", &(buf[0]));
+  snprintf(p, p_max_size, "%s", buf.get());
 }
 
 void print_updates(struct text_object *obj, char *p, unsigned int p_max_size) {
@@ -46,6 +46,8 @@ int update_net_stats(void);
 int update_cpu_usage(void);
 int update_total_processes(void);
 int update_uname(void);
+/* incremented whenever update_uname() refreshes info.uname_s */
+extern std::atomic<uint64_t> uname_generation;
 int update_threads(void);
 int update_running_processes(void);
 void update_stuff(void);
@@ -63,6 +65,12 @@ double get_time(void);
  * path */
 std::string to_real_path(const std::string &source);
 FILE *open_file(const char *file, int *reported);
+/* Prefix prepended to absolute paths passed to open_file(), so parsers can be
+ * run against recorded /proc and /sys trees. Empty (the default) disables it.
+ */
+void set_open_file_root(const std::string &root);
+/* file with the open_file() root prepended, if it needs one */
+std::string open_file_path(const char *file);
 int open_fifo(const char *file, int *reported);
 std::string variable_substitute(std::string s);
 
@@ -102,19 +110,22 @@ double loadgraphval(struct text_object *);
 
 uint8_t cpu_percentage(struct text_object *);
 double cpu_barval(struct text_object *);
+#ifdef BUILD_GUI
+void print_cpuheatmap(struct text_object *, char *, unsigned int);
+#endif /* BUILD_GUI */
 
-void print_mem(struct text_object *, char *, unsigned int);
-void print_memwithbuffers(struct text_object *, char *, unsigned int);
-void print_memeasyfree(struct text_object *, char *, unsigned int);
-void print_legacymem(struct text_object *, char *, unsigned int);
-void print_memfree(struct text_object *, char *, unsigned int);
-void print_memmax(struct text_object *, char *, unsigned int);
-void print_memdirty(struct text_object *, char *, unsigned int);
-void print_shmem(struct text_object *, char *, unsigned int);
-void print_memavail(struct text_object *, char *, unsigned int);
-void print_swap(struct text_object *, char *, unsigned int);
-void print_swapfree(struct text_object *, char *, unsigned int);
-void print_swapmax(struct text_object *, char *, unsigned int);
+int print_mem(struct text_object *, char *, unsigned int);
+int print_memwithbuffers(struct text_object *, char *, unsigned int);
+int print_memeasyfree(struct text_object *, char *, unsigned int);
+int print_legacymem(struct text_object *, char *, unsigned int);
+int print_memfree(struct text_object *, char *, unsigned int);
+int print_memmax(struct text_object *, char *, unsigned int);
+int print_memdirty(struct text_object *, char *, unsigned int);
+int print_shmem(struct text_object *, char *, unsigned int);
+int print_memavail(struct text_object *, char *, unsigned int);
+int print_swap(struct text_object *, char *, unsigned int);
+int print_swapfree(struct text_object *, char *, unsigned int);
+int print_swapmax(struct text_object *, char *, unsigned int);
 uint8_t mem_percentage(struct text_object *);
 double mem_barval(struct text_object *);
 double mem_with_buffers_barval(struct text_object *);
@@ -134,19 +145,21 @@ void print_version(struct text_object *obj, char *p, unsigned int p_max_size);
 void print_uptime(struct text_object *, char *, unsigned int);
 void print_uptime_short(struct text_object *, char *, unsigned int);
 
-void print_processes(struct text_object *, char *, unsigned int);
-void print_running_processes(struct text_object *, char *, unsigned int);
-void print_running_threads(struct text_object *, char *, unsigned int);
-void print_threads(struct text_object *, char *, unsigned int);
+int print_processes(struct text_object *, char *, unsigned int);
+int print_running_processes(struct text_object *, char *, unsigned int);
+int print_running_threads(struct text_object *, char *, unsigned int);
+int print_threads(struct text_object *, char *, unsigned int);
 
-void print_buffers(struct text_object *, char *, unsigned int);
-void print_cached(struct text_object *, char *, unsigned int);
-void print_free_bufcache(struct text_object *, char *, unsigned int);
+int print_buffers(struct text_object *, char *, unsigned int);
+int print_cached(struct text_object *, char *, unsigned int);
+int print_free_bufcache(struct text_object *, char *, unsigned int);
 
 void print_evaluate(struct text_object *, char *, unsigned int);
 
 int if_empty_iftest(struct text_object *);
+void scan_if_existing(struct text_object *, const char *);
 int if_existing_iftest(struct text_object *);
+void free_if_existing(struct text_object *);
 int if_running_iftest(struct text_object *);
 
 #ifndef __OpenBSD__
@@ -177,7 +190,6 @@ void print_updates(struct text_object *, char *, unsigned int);
 int updatenr_iftest(struct text_object *);
 
 #ifdef BUILD_CURL
-void print_github(struct text_object *, char *, unsigned int);
 void print_stock(struct text_object *, char *, unsigned int);
 void free_stock(struct text_object *);
 #endif /* BUILD_CURL */
@@ -36,9 +36,13 @@
 #include <cstdarg>
 #include <ctime>
 #include <iostream>
+#include <list>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 #include "common.h"
 #include "config.h"
@@ -100,15 +104,21 @@
 #include "mail.h"
 #include "nc.h"
 #include "net_stat.h"
+#include "memory-usage.hh"
+#include "number-format.hh"
+#include "profiling.hh"
+#include "reactor.hh"
+#include "session-capture.hh"
 #include "specials.h"
 #include "temphelper.h"
 #include "template.h"
+#include "thread-qos.hh"
 #include "timeinfo.h"
 #include "top.h"
 #ifdef BUILD_MYSQL
 #include "mysql.h"
 #endif /* BUILD_MYSQL */
-#ifdef BUILD_NVIDIA
+#if defined(BUILD_NVIDIA) || defined(BUILD_NVML)
 #include "nvidia.h"
 #endif
 #ifdef BUILD_CURL
@@ -116,6 +126,7 @@
 #endif /* BUILD_CURL */
 
 #include "display-output.hh"
+#include "display-socket.hh"
 #include "lua-config.hh"
 #include "setting.hh"
 
@@ -160,8 +171,8 @@ int global_debug_level = 0;
 static conky::simple_config_setting<bool> disable_auto_reload(
     "disable_auto_reload", false, false);
 
-/* two strings for internal use */
-static char *tmpstring1, *tmpstring2;
+/* draw_string() expands tabs into this */
+static char *tmpstring2;
 
 enum spacer_state { NO_SPACER = 0, LEFT_SPACER, RIGHT_SPACER };
 template <>
@@ -191,8 +202,10 @@ conky::simple_config_setting<bool> out_to_stderr("out_to_stderr", false, false);
 int top_cpu, top_mem, top_time;
 #ifdef BUILD_IOSTATS
 int top_io;
+int top_io_fields;
 #endif
 int top_running;
+int top_depth;
 
 /* Update interval */
 conky::range_config_setting<double> update_interval(
@@ -205,11 +218,60 @@ conky::simple_config_setting<std::string> detect_battery("detect_battery",
                                                          false);
 static bool on_battery = false;
 
+/* the power profile, see power_period_factor() */
+static conky::simple_config_setting<std::string> battery_sources(
+    "battery_sources", std::string("top,curl,nvidia,journal"), true);
+static conky::range_config_setting<double> battery_period_factor(
+    "battery_period_factor", 1.0, std::numeric_limits<double>::infinity(),
+    1.0, true);
+static conky::range_config_setting<unsigned int> low_battery_percent(
+    "low_battery_percent", 0, 100, 0, true);
+static conky::range_config_setting<double> low_battery_period_factor(
+    "low_battery_period_factor", 1.0, std::numeric_limits<double>::infinity(),
+    1.0, true);
+static double power_factor = 1.0;
+/* 0 keeps update_interval, see display_output_base::hidden() */
+static conky::range_config_setting<double> update_interval_hidden(
+    "update_interval_hidden", 0.0, std::numeric_limits<double>::infinity(), 0.0,
+    true);
+
+/* whether none of the outputs can be seen, so there is no hurry */
+static bool display_outputs_hidden() {
+  for (auto output : conky::active_display_outputs) {
+    if (!output->hidden()) { return false; }
+  }
+  return !conky::active_display_outputs.empty();
+}
+
 double active_update_interval() {
-  return (on_battery ? update_interval_on_battery : update_interval)
-      .get(*state);
+  double interval =
+      (on_battery ? update_interval_on_battery : update_interval).get(*state);
+  if (update_interval_hidden.get(*state) > interval &&
+      display_outputs_hidden()) {
+    interval = update_interval_hidden.get(*state);
+  }
+  return interval;
 }
 
+#ifdef BUILD_GUI
+conky::range_config_setting<double> animation_interval(
+    "animation_interval", 0.0, std::numeric_limits<double>::infinity(), 0.0,
+    true);
+
+/* how far into the update interval the movement of bars and gauges is */
+static double animation_progress() {
+  double interval = active_update_interval();
+  if (animation_interval.get(*state) <= 0 || interval <= 0) { return 1; }
+  return (get_time() - current_update_time) / interval;
+}
+
+bool animating_specials() {
+  if (animation_interval.get(*state) <= 0) { return false; }
+  set_tween_progress(animation_progress());
+  return specials_tweening();
+}
+#endif /* BUILD_GUI */
+
 void music_player_interval_setting::lua_setter(lua::state &l, bool init) {
   lua::stack_sentry s(l, -2);
 
@@ -237,6 +299,7 @@ extern kvm_t *kd;
 /* prototypes for internally used functions */
 static void signal_handler(int /*sig*/);
 static void reload_config();
+static bool reload_text();
 
 static const char *suffixes[] = {_nop("B"),   _nop("KiB"), _nop("MiB"),
                                  _nop("GiB"), _nop("TiB"), _nop("PiB"),
@@ -281,12 +344,13 @@ int first_pass = 1;
 int argc_copy;
 char **argv_copy;
 
-conky::range_config_setting<int> cpu_avg_samples("cpu_avg_samples", 1, 14, 2,
+/* kept in sample rings, so long windows cost memory but no time */
+conky::range_config_setting<int> cpu_avg_samples("cpu_avg_samples", 1, 1000, 2,
                                                  true);
-conky::range_config_setting<int> net_avg_samples("net_avg_samples", 1, 14, 2,
+conky::range_config_setting<int> net_avg_samples("net_avg_samples", 1, 1000, 2,
                                                  true);
-conky::range_config_setting<int> diskio_avg_samples("diskio_avg_samples", 1, 14,
-                                                    2, true);
+conky::range_config_setting<int> diskio_avg_samples("diskio_avg_samples", 1,
+                                                    1000, 2, true);
 
 #ifdef BUILD_GUI
 /* graph */
@@ -417,30 +481,101 @@ conky::gradient_factory *create_gradient_factory(int width,
   }
   return nullptr;
 }
+
+/* graphs are redrawn far more often than their colours or width change */
+static const unsigned long *graph_gradient(int width,
+                                           unsigned long first_colour,
+                                           unsigned long last_colour) {
+  static conky::gradient_cache gradients;
+
+  return gradients.get(
+      graph_gradient_mode.get(*state), width, first_colour, last_colour, [&] {
+        std::unique_ptr<conky::gradient_factory> factory(
+            create_gradient_factory(width, first_colour, last_colour));
+        return factory->create_gradient();
+      });
+}
 #endif /* BUILD_GUI */
 
 /* formatted text to render on screen, generated in generate_text(),
  * drawn in draw_stuff() */
 
 static char *text_buffer;
+static size_t text_buffer_capacity; /* allocated size of text_buffer */
+
+/* text_buffer starts out max_user_text bytes large and is grown when the text
+ * doesn't fit, up to this size */
+static const size_t text_buffer_limit = 16 * 1024 * 1024;
+
+/* where generate_text() wraps text_buffer into, the two are swapped after */
+static char *wrap_buffer;
+static size_t wrap_buffer_capacity;
+
+static void free_text_buffer() {
+  delete_block_and_zero(text_buffer);
+  text_buffer_capacity = 0;
+  delete_block_and_zero(wrap_buffer);
+  wrap_buffer_capacity = 0;
+}
+
+/* resizes text_buffer to size bytes, keeping what fits of its contents */
+static void resize_text_buffer(size_t size) {
+  char *buffer = new char[size];
+
+  memset(buffer, 0, size);
+  if (text_buffer != nullptr) {
+    memcpy(buffer, text_buffer, std::min(size, text_buffer_capacity) - 1);
+  }
+  delete[] text_buffer;
+  text_buffer = buffer;
+  text_buffer_capacity = size;
+}
 
 /* quite boring functions */
 
-static inline void for_each_line(char *b, int f(char *, int)) {
-  char *ps, *pe;
-  int special_index = 0; /* specials index */
-
-  if (b == nullptr) { return; }
-  for (ps = b, pe = b; *pe != 0; pe++) {
-    if (*pe == '\n') {
-      *pe = '\0';
-      special_index = f(ps, special_index);
-      *pe = '\n';
-      ps = pe + 1;
+/* text_buffer split into lines once per generate_text(), so that the layout
+ * pass and every draw pass (shades and outlines draw the text several times)
+ * don't search it for newlines and walk the specials list all over again */
+struct buffer_line {
+  size_t start;
+  size_t length;
+  int special_index; /* of the first special in the line */
+};
+
+static std::vector<buffer_line> buffer_lines;
+
+static void index_text_buffer() {
+  buffer_lines.clear();
+  if (text_buffer == nullptr) { return; }
+
+  buffer_line line{0, 0, 0};
+  int special_index = 0;
+  size_t i;
+  for (i = 0; text_buffer[i] != 0; i++) {
+    if (text_buffer[i] == '\n') {
+      line.length = i - line.start;
+      buffer_lines.push_back(line);
+      line = buffer_line{i + 1, 0, special_index};
+    } else if (text_buffer[i] == SPECIAL_CHAR) {
+      special_index++;
     }
   }
+  if (line.start < i) {
+    line.length = i - line.start;
+    buffer_lines.push_back(line);
+  }
+}
 
-  if (ps < pe) { f(ps, special_index); }
+static inline void for_each_line(int f(char *, int)) {
+  if (text_buffer == nullptr) { return; }
+  for (const buffer_line &line : buffer_lines) {
+    char *s = text_buffer + line.start;
+    char end = s[line.length];
+
+    s[line.length] = '\0';
+    f(s, line.special_index);
+    s[line.length] = end;
+  }
 }
 
 static void convert_escapes(char *buf) {
@@ -462,35 +597,51 @@ static void convert_escapes(char *buf) {
   *p = '\0';
 }
 
+/* Pads len bytes of text to width according to the current value of
+ * use_spacer, like spaced_print() does. text must not point into buf. */
+static int spaced_text(char *buf, int size, const char *text, size_t len,
+                       int width) {
+  if (size < 1) { return 0; }
+
+  conky::text_writer out(buf, size);
+  size_t fill = width > 0 && len < static_cast<size_t>(width) ? width - len : 0;
+  switch (use_spacer.get(*state)) {
+    case NO_SPACER:
+      out.append(text, len);
+      break;
+    case LEFT_SPACER:
+      out.fill(' ', fill).append(text, len);
+      break;
+    case RIGHT_SPACER:
+      out.append(text, len).fill(' ', fill);
+      break;
+  }
+  return out.finish();
+}
+
 /* Prints anything normally printed with snprintf according to the current value
  * of use_spacer.  Actually slightly more flexible than snprintf, as you can
  * safely specify the destination buffer as one of your inputs.  */
 int spaced_print(char *buf, int size, const char *format, int width, ...) {
-  int len = 0;
+  char stackbuf[128];
+  std::vector<char> heapbuf;
+  char *tempbuf = stackbuf;
   va_list argp;
-  char *tempbuf;
+  int len;
 
   if (size < 1) { return 0; }
-  tempbuf = new char[size];
+  if (static_cast<size_t>(size) > sizeof(stackbuf)) {
+    heapbuf.resize(size);
+    tempbuf = heapbuf.data();
+  }
 
   // Passes the varargs along to vsnprintf
   va_start(argp, width);
-  vsnprintf(tempbuf, size, format, argp);
+  len = vsnprintf(tempbuf, size, format, argp);
   va_end(argp);
+  if (len < 0) { return 0; }
 
-  switch (use_spacer.get(*state)) {
-    case NO_SPACER:
-      len = snprintf(buf, size, "%s", tempbuf);
-      break;
-    case LEFT_SPACER:
-      len = snprintf(buf, size, "%*s", width, tempbuf);
-      break;
-    case RIGHT_SPACER:
-      len = snprintf(buf, size, "%-*s", width, tempbuf);
-      break;
-  }
-  delete[] tempbuf;
-  return len;
+  return spaced_text(buf, size, tempbuf, std::min(len, size - 1), width);
 }
 
 /* print percentage values
@@ -498,72 +649,82 @@ int spaced_print(char *buf, int size, const char *format, int width, ...) {
  * - i.e., unsigned values between 0 and 100
  * - respect the value of pad_percents */
 int percent_print(char *buf, int size, unsigned value) {
-  return spaced_print(buf, size, "%u", pad_percents.get(*state), value);
+  char digits[16];
+  conky::text_writer out(digits, sizeof(digits));
+  size_t len = out.append(value).finish();
+  return spaced_text(buf, size, digits, len, pad_percents.get(*state));
 }
 
 /* converts from bytes to human readable format (K, M, G, T)
  *
  * The algorithm always divides by 1024, as unit-conversion of byte
  * counts suggests. But for output length determination we need to
- * compare with 1000 here, as we print in decimal form. */
-void human_readable(long long num, char *buf, int size) {
+ * compare with 1000 here, as we print in decimal form. Returns the length
+ * of the output like snprintf() does. */
+int human_readable(long long num, char *buf, int size) {
   const char **suffix = suffixes;
+  char text[128];
+  conky::text_writer out(text, sizeof(text));
   float fnum;
   int precision;
   int width;
-  const char *format;
+  size_t suffix_len;
 
   /* Possibly just output as usual, for example for stdout usage */
   if (!format_human_readable.get(*state)) {
-    spaced_print(buf, size, "%lld", 6, num);
-    return;
+    size_t len = out.append(num).finish();
+    return spaced_text(buf, size, text, std::min(len, sizeof(text) - 1), 6);
   }
+  const std::string spacer = units_spacer.get(*state);
   if (short_units.get(*state)) {
     width = 5;
-    format = "%.*f%s%.1s";
+    suffix_len = 1;
   } else {
     width = 7;
-    format = "%.*f%s%-.3s";
+    suffix_len = 3;
   }
-  width += strlen(units_spacer.get(*state).c_str());
+  width += spacer.size();
 
   if (llabs(num) < 1000LL) {
-    spaced_print(buf, size, format, width, 0, static_cast<float>(num),
-                 units_spacer.get(*state).c_str(), _(*suffix));
-    return;
-  }
+    fnum = static_cast<float>(num);
+    precision = 0;
+  } else {
+    while (llabs(num / 1024) >= 1000LL && (**(suffix + 2) != 0)) {
+      num /= 1024;
+      suffix++;
+    }
 
-  while (llabs(num / 1024) >= 1000LL && (**(suffix + 2) != 0)) {
-    num /= 1024;
     suffix++;
+    fnum = num / 1024.0;
+
+    /* fnum should now be < 1000, so looks like 'AAA.BBBBB'
+     *
+     * The goal is to always have a significance of 3, by
+     * adjusting the decimal part of the number. Sample output:
+     *  123MiB
+     * 23.4GiB
+     * 5.12B
+     * so the point of alignment resides between number and unit. The
+     * upside of this is that there is minimal padding necessary, though
+     * there should be a way to make alignment take place at the decimal
+     * dot (then with fixed width decimal part).
+     *
+     * Note the repdigits below: when given a precision value, printf()
+     * rounds the float to it, not just cuts off the remaining digits. So
+     * e.g. 99.95 with a precision of 1 gets 100.0, which again should be
+     * printed with a precision of 0. Yay. */
+
+    precision = 0;                        /* print 100-999 without decimals */
+    if (fnum < 99.95) { precision = 1; }  /* print 10-99 with one decimal */
+    if (fnum < 9.995) { precision = 2; }  /* print 0-9 with two decimals */
   }
 
-  suffix++;
-  fnum = num / 1024.0;
-
-  /* fnum should now be < 1000, so looks like 'AAA.BBBBB'
-   *
-   * The goal is to always have a significance of 3, by
-   * adjusting the decimal part of the number. Sample output:
-   *  123MiB
-   * 23.4GiB
-   * 5.12B
-   * so the point of alignment resides between number and unit. The
-   * upside of this is that there is minimal padding necessary, though
-   * there should be a way to make alignment take place at the decimal
-   * dot (then with fixed width decimal part).
-   *
-   * Note the repdigits below: when given a precision value, printf()
-   * rounds the float to it, not just cuts off the remaining digits. So
-   * e.g. 99.95 with a precision of 1 gets 100.0, which again should be
-   * printed with a precision of 0. Yay. */
-
-  precision = 0; /* print 100-999 without decimal part */
-  if (fnum < 99.95) { precision = 1; /* print 10-99 with one decimal place */ }
-  if (fnum < 9.995) { precision = 2; /* print 0-9 with two decimal places */ }
-
-  spaced_print(buf, size, format, width, precision, fnum,
-               units_spacer.get(*state).c_str(), _(*suffix));
+  /* what "%.*f%s%.1s" (or "%.3s" without short_units) used to print */
+  const char *unit = _(*suffix);
+  out.append_fixed(fnum, precision).append(spacer.data(), spacer.size());
+  out.append(unit, strnlen(unit, suffix_len));
+  size_t len = out.finish();
+  return spaced_text(buf, size, text, std::min(len, sizeof(text) - 1), width);
 }
 
 /* global object list root element */
@@ -575,21 +736,137 @@ void set_current_text_color(long colour) { current_text_color = colour; }
 
 long get_current_text_color() { return current_text_color; }
 
+namespace {
+/* A text parsed by evaluate(). Entries are shared so that a nested
+ * evaluate() evicting the text currently being generated can't free it
+ * from under us. */
+struct parsed_text {
+  struct text_object root {};
+  ~parsed_text() { free_text_objects(&root); }
+};
+
+struct evaluated_text {
+  std::string text;
+  std::shared_ptr<parsed_text> parsed;
+  unsigned long looped; /* info.looped when last evaluated */
+};
+
+/* most recently used first, indexed by text */
+std::list<evaluated_text> evaluate_cache;
+std::unordered_map<std::string, std::list<evaluated_text>::iterator>
+    evaluate_index;
+unsigned long evaluate_pruned; /* info.looped when last pruned */
+/* Lua dashboards may conky_parse() or conky_values() a few hundred
+ * different texts every update */
+const size_t EVALUATE_CACHE_SIZE = 512;
+
+void clear_evaluate_cache() {
+  evaluate_index.clear();
+  evaluate_cache.clear();
+}
+
+void evict_evaluated_text(std::list<evaluated_text>::iterator it) {
+  evaluate_index.erase(it->text);
+  evaluate_cache.erase(it);
+}
+
+/* Texts which haven't been evaluated in the last update hold on to their
+ * callbacks (and so keep their data being fetched) for nothing; drop them
+ * just like the old parse-every-time evaluate() would have. */
+void prune_evaluate_cache() {
+  if (evaluate_pruned == info.looped) { return; }
+  evaluate_pruned = info.looped;
+
+  /* least recently used entries are at the back */
+  while (!evaluate_cache.empty() &&
+         evaluate_cache.back().looped + 1 < info.looped) {
+    evict_evaluated_text(std::prev(evaluate_cache.end()));
+  }
+}
+
+std::shared_ptr<parsed_text> parse_evaluated_text(const char *text) {
+  prune_evaluate_cache();
+
+  std::string key(text);
+  auto found = evaluate_index.find(key);
+  if (found != evaluate_index.end()) {
+    auto it = found->second;
+    evaluate_cache.splice(evaluate_cache.begin(), evaluate_cache, it);
+    it->looped = info.looped;
+    return it->parsed;
+  }
+
+  auto parsed = std::make_shared<parsed_text>();
+  /* a text evaluated while parsing is cached beyond it */
+  extract_variable_text_internal(&parsed->root, text, true);
+  evaluate_cache.push_front(evaluated_text{key, parsed, info.looped});
+  evaluate_index.emplace(std::move(key), evaluate_cache.begin());
+  if (evaluate_cache.size() > EVALUATE_CACHE_SIZE) {
+    evict_evaluated_text(std::prev(evaluate_cache.end()));
+  }
+  return parsed;
+}
+}  // namespace
+
 static void extract_variable_text(const char *p) {
+  clear_evaluate_cache();
+  free_shared_updaters();
   free_text_objects(&global_root_object);
-  delete_block_and_zero(tmpstring1);
   delete_block_and_zero(tmpstring2);
-  delete_block_and_zero(text_buffer);
+  free_text_buffer();
 
   extract_variable_text_internal(&global_root_object, p);
 }
 
+size_t text_memory(size_t *count) {
+  *count = 0;
+  return text_objects_memory(&global_root_object, count);
+}
+
 void parse_conky_vars(struct text_object *root, const char *txt, char *p,
                       int p_max_size) {
   extract_variable_text_internal(root, txt);
   generate_text_internal(p, p_max_size, *root);
 }
 
+/* Copies the cached output of a print op to p if its object's generation
+ * counter hasn't moved since the output was made. Returns false if the op has
+ * to be run again. */
+static bool print_text_segment(const struct text_op &op, char *p,
+                               int p_max_size, size_t *len) {
+  struct text_segment *seg = op.segment;
+  uint64_t generation = op.obj->generation->load();
+
+  if (!seg->valid || seg->len >= static_cast<uint32_t>(p_max_size) ||
+      seg->generation != generation) {
+    // remember the generation the output is going to be made from
+    seg->generation = generation;
+    seg->valid = false;
+    return false;
+  }
+  memcpy(p, seg->text, seg->len + 1);
+  *len = seg->len;
+  return true;
+}
+
+/* Stores the len bytes just printed at p as the op's cached output, unless
+ * they may have been truncated by p_max_size. */
+static void save_text_segment(const struct text_op &op, const char *p,
+                              int p_max_size, size_t len) {
+  struct text_segment *seg = op.segment;
+
+  seg->valid = false;
+  if (len + 1 >= static_cast<size_t>(p_max_size)) { return; }
+  if (seg->size < len + 1) {
+    seg->size = len + 1;
+    seg->text = static_cast<char *>(realloc(seg->text, seg->size));
+  }
+  memcpy(seg->text, p, len);
+  seg->text[len] = '\0';
+  seg->len = len;
+  seg->valid = true;
+}
+
 /* IFBLOCK jumping algorithm
  *
  * This is easier as it looks like:
@@ -600,146 +877,294 @@ void parse_conky_vars(struct text_object *root, const char *txt, char *p,
  * - each ENDIF is silently being ignored
  *
  * Why this works (or: how jumping works):
- * Jumping means to overwrite the "obj" variable of the loop and set it to the
- * target (i.e. the corresponding ELSE or ENDIF). After that, the for-loop does
- * the rest: as regularly, "obj" is being updated to point to obj->next, so
- * object parsing continues right after the corresponding ELSE or ENDIF. This
- * means that if we find an ELSE, it's corresponding IF must not have jumped,
- * so we need to jump always. If we encounter an ENDIF, it's corresponding IF
- * or ELSE has not jumped, and there is nothing to do.
+ * The object list is compiled into root.ops by compile_text_objects(), which
+ * stores in each IF and ELSE op the index of the op right after the
+ * corresponding ELSE or ENDIF. Jumping means to continue the loop at that
+ * index, so object parsing continues right after the corresponding ELSE or
+ * ENDIF. This means that if we find an ELSE, it's corresponding IF must not
+ * have jumped, so we need to jump always. ENDIFs print nothing and are left
+ * out of the ops entirely.
+ *
+ * The ops run one after the other on the main thread. Print callbacks read
+ * settings and call Lua through the one lua::state, and specials are
+ * numbered by the order they are made in, so none of them may run
+ * concurrently; the costly part of most objects is in their update
+ * callbacks, which already run on the callback pool.
  */
-void generate_text_internal(char *p, int p_max_size, struct text_object root) {
-  struct text_object *obj;
+void generate_text_internal(char *p, int p_max_size,
+                            const struct text_object &root) {
   size_t a;
 
   if (p == nullptr) { return; }
-
-#ifdef BUILD_ICONV
-  char *buff_in;
-
-  buff_in = new char[p_max_size];
-  memset(buff_in, 0, p_max_size);
-#endif /* BUILD_ICONV */
+  conky::profile::span trace("generate_text_internal");
 
   p[0] = 0;
-  obj = root.next;
-  while ((obj != nullptr) && p_max_size > 0) {
-    /* check callbacks for existence and act accordingly */
-    if (obj->callbacks.print != nullptr) {
-      (*obj->callbacks.print)(obj, p, p_max_size);
-    } else if (obj->callbacks.iftest != nullptr) {
-      if ((*obj->callbacks.iftest)(obj) == 0) {
-        DBGP2("jumping");
-        if (obj->ifblock_next != nullptr) { obj = obj->ifblock_next; }
+  uint32_t i = 0;
+  while (i < root.op_count && p_max_size > 0) {
+    const struct text_op &op = root.ops[i];
+    struct text_object *obj = op.obj;
+    bool metered = false;
+    double value = 0;
+    int len = -1; /* as returned by snprintf(), if the op knows it */
+
+    ++i;
+    /* keep the updater of obj running, see set_on_demand() */
+    if (obj->cb_handle != nullptr) { (*obj->cb_handle)->wanted(); }
+    if (op.segment != nullptr) {
+      if (print_text_segment(op, p, p_max_size, &a)) {
+        p += a;
+        p_max_size -= a;
+        continue;
       }
-    } else if (obj->callbacks.barval != nullptr) {
-      new_bar(obj, p, p_max_size, (*obj->callbacks.barval)(obj));
-    } else if (obj->callbacks.gaugeval != nullptr) {
-      new_gauge(obj, p, p_max_size, (*obj->callbacks.gaugeval)(obj));
+    }
+    switch (op.type) {
+      case TEXT_OP_PRINT:
+        (*op.cb.print)(obj, p, p_max_size);
+        break;
+      case TEXT_OP_PRINT_LEN:
+        len = (*op.cb.print_len)(obj, p, p_max_size);
+        break;
+      case TEXT_OP_IFTEST:
+        if ((*op.cb.iftest)(obj) == 0) {
+          DBGP2("jumping");
+          i = op.jump;
+        }
+        break;
+      case TEXT_OP_BAR:
+        value = (*op.cb.meter)(obj);
+        metered = true;
+        new_bar(obj, p, p_max_size, value);
+        break;
+      case TEXT_OP_GAUGE:
+        value = (*op.cb.meter)(obj);
+        metered = true;
+        new_gauge(obj, p, p_max_size, value);
+        break;
 #ifdef BUILD_GUI
-    } else if (obj->callbacks.graphval != nullptr) {
-      new_graph(obj, p, p_max_size, (*obj->callbacks.graphval)(obj));
+      case TEXT_OP_GRAPH:
+        value = (*op.cb.meter)(obj);
+        metered = true;
+        new_graph(obj, p, p_max_size, value);
+        break;
 #endif /* BUILD_GUI */
-    } else if (obj->callbacks.percentage != nullptr) {
-      percent_print(p, p_max_size, (*obj->callbacks.percentage)(obj));
+      case TEXT_OP_PERCENTAGE:
+        value = (*op.cb.percentage)(obj);
+        metered = true;
+        len = percent_print(p, p_max_size, value);
+        break;
+      default:
+        break;
+    }
+    if (metered && &root == &global_root_object) {
+      conky::record_meter_value(root, i - 1, value);
     }
 
-    a = strlen(p);
+    if (len < 0) {
+      a = strlen(p);
+    } else {
+      /* like snprintf(), the length counts what didn't fit */
+      a = std::min(static_cast<size_t>(len),
+                   static_cast<size_t>(p_max_size - 1));
+    }
 #ifdef BUILD_ICONV
-    iconv_convert(&a, buff_in, p, p_max_size);
+    iconv_convert(&a, p, p_max_size);
 #endif /* BUILD_ICONV */
+    if (op.segment != nullptr) { save_text_segment(op, p, p_max_size, a); }
     p += a;
     p_max_size -= a;
     (*p) = 0;
-
-    obj = obj->next;
   }
 #ifdef BUILD_GUI
   /* load any new fonts we may have had */
   load_fonts(utf8_mode.get(*state));
 #endif /* BUILD_GUI */
-#ifdef BUILD_ICONV
-  delete[] buff_in;
-#endif /* BUILD_ICONV */
 }
 
 void evaluate(const char *text, char *p, int p_max_size) {
-  struct text_object subroot {};
-
   /**
    * Consider expressions like: ${execp echo '${execp echo hi}'}
    * These would require run extract_variable_text_internal() before
    * callbacks and generate_text_internal() after callbacks.
+   *
+   * The same text tends to be evaluated every update (execp output, lua
+   * parse results, ...), so the parsed objects are kept around and reused
+   * instead of being rebuilt (and their callbacks re-registered) each time.
    */
-  extract_variable_text_internal(&subroot, text);
-  generate_text_internal(p, p_max_size, subroot);
+  std::shared_ptr<parsed_text> parsed = parse_evaluated_text(text);
+  generate_text_internal(p, p_max_size, parsed->root);
   DBGP2("evaluated '%s' to '%s'", text, p);
+}
 
-  free_text_objects(&subroot);
+bool evaluate_value(const char *text, double *value) {
+  std::shared_ptr<parsed_text> parsed = parse_evaluated_text(text);
+  const struct text_object &root = parsed->root;
+
+  if (root.op_count != 1) { return false; }
+  const struct text_op &op = root.ops[0];
+  switch (op.type) {
+    case TEXT_OP_BAR:
+    case TEXT_OP_GAUGE:
+    case TEXT_OP_GRAPH:
+      *value = (*op.cb.meter)(op.obj);
+      return true;
+    case TEXT_OP_PERCENTAGE:
+      *value = (*op.cb.percentage)(op.obj);
+      return true;
+    default:
+      return false;
+  }
 }
 
 double current_update_time, next_update_time, last_update_time;
 
+namespace {
+/* the case folding table for fold, built with toupper()/tolower() so that
+ * it follows the locale */
+const unsigned char *case_table(enum text_case fold) {
+  static unsigned char upper[256], lower[256];
+  static bool built = false;
+
+  if (!built) {
+    for (int c = 0; c < 256; ++c) {
+      upper[c] = static_cast<unsigned char>(toupper(c));
+      lower[c] = static_cast<unsigned char>(tolower(c));
+    }
+    built = true;
+  }
+  return fold == TEXT_CASE_UPPER ? upper : lower;
+}
+
+/* folds the case of 8 ASCII bytes at once: the bytes between first and last
+ * get their 0x20 bit flipped. None of the additions carries into the next
+ * byte, since all of them are below 0x80. */
+inline uint64_t fold_ascii_word(uint64_t w, unsigned char first,
+                                unsigned char last) {
+  const uint64_t ones = 0x0101010101010101ULL;
+  const uint64_t high = 0x8080808080808080ULL;
+  uint64_t from_first = (w + (0x80 - first) * ones) & high;
+  uint64_t past_last = (w + (0x80 - last - 1) * ones) & high;
+
+  return w ^ ((from_first & ~past_last) >> 2);
+}
+}  // namespace
+
+void fold_text_case(char *s, enum text_case fold) {
+  if (fold == TEXT_CASE_KEEP) { return; }
+  const unsigned char *table = case_table(fold);
+  unsigned char first = fold == TEXT_CASE_UPPER ? 'a' : 'A';
+  unsigned char last = fold == TEXT_CASE_UPPER ? 'z' : 'Z';
+  size_t n = strlen(s);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    if ((w & 0x8080808080808080ULL) != 0) {
+      for (size_t j = i; j < i + 8; ++j) {
+        s[j] = table[static_cast<unsigned char>(s[j])];
+      }
+      continue;
+    }
+    w = fold_ascii_word(w, first, last);
+    memcpy(s + i, &w, 8);
+  }
+  for (; i < n; ++i) { s[i] = table[static_cast<unsigned char>(s[i])]; }
+}
+
+bool wrap_text(const char *src, char *dst, size_t size, unsigned int width,
+               enum text_case fold) {
+  const unsigned char *table =
+      fold == TEXT_CASE_KEEP ? nullptr : case_table(fold);
+  size_t o = 0;
+  unsigned int column = 0;
+
+  if (size == 0) { return false; }
+  for (; *src != 0; ++src) {
+    auto c = static_cast<unsigned char>(*src);
+
+    if (c == '\n') {
+      column = 0;
+    } else if ((c & 0xc0) != 0x80) {
+      /* c starts a character, continuation bytes stay with it */
+      if (column == width) {
+        if (o + 1 >= size) { break; }
+        dst[o++] = '\n';
+        column = 0;
+      }
+      column++;
+    }
+    if (o + 1 >= size) { break; }
+    dst[o++] = table != nullptr ? table[c] : c;
+  }
+  dst[o] = '\0';
+  return *src == 0;
+}
+
 static void generate_text() {
   char *p;
-  unsigned int i, j, k;
-  special_count = 0;
+  begin_frame_specials();
 
   current_update_time = get_time();
 
   /* clears netstats info, calls conky::run_all_callbacks(), and changes
    * some info.mem entries */
-  update_stuff();
+  {
+    conky::profile::scope s(
+        conky::profile::stage_record(conky::profile::UPDATE_STUFF));
+    update_stuff();
+  }
 
   /* populate the text buffer; generate_text_internal() iterates through
    * global_root_object (an instance of the text_object struct) and calls
    * any callbacks that were set on startup by construct_text_object(). */
   p = text_buffer;
 
-  generate_text_internal(p, max_user_text.get(*state), global_root_object);
-  unsigned int mw = max_text_width.get(*state);
-  unsigned int tbs = text_buffer_size.get(*state);
-  if (mw > 0) {
-    for (i = 0, j = 0; p[i] != 0; i++) {
-      if (p[i] == '\n') {
-        j = 0;
-      } else if (j == mw) {
-        k = i + strlen(p + i) + 1;
-        if (k < tbs) {
-          while (k != i) {
-            p[k] = p[k - 1];
-            k--;
-          }
-          p[k] = '\n';
-          j = 0;
-        } else {
-          NORM_ERR(
-              "The end of the text_buffer is reached, increase "
-              "\"text_buffer_size\"");
-        }
-      } else {
-        j++;
-      }
-    }
+  {
+    conky::profile::scope s(
+        conky::profile::stage_record(conky::profile::GENERATE_TEXT));
+    generate_text_internal(p, text_buffer_capacity, global_root_object);
   }
-
+  /* a full buffer most likely cut the text short */
+  bool full = strlen(p) + 1 >= text_buffer_capacity;
+  unsigned int mw = max_text_width.get(*state);
+  enum text_case fold = TEXT_CASE_KEEP;
   if (stuff_in_uppercase.get(*state)) {
-    char *tmp_p;
+    fold = TEXT_CASE_UPPER;
+  } else if (stuff_in_lowercase.get(*state)) {
+    fold = TEXT_CASE_LOWER;
+  }
 
-    tmp_p = text_buffer;
-    while (*tmp_p != 0) {
-      *tmp_p = toupper(static_cast<unsigned char>(*tmp_p));
-      tmp_p++;
+  if (mw > 0) {
+    if (wrap_buffer_capacity != text_buffer_capacity) {
+      delete[] wrap_buffer;
+      wrap_buffer = new char[text_buffer_capacity];
+      wrap_buffer_capacity = text_buffer_capacity;
     }
-  } else if (stuff_in_lowercase.get(*state)) {
-    char *tmp_p;
+    if (wrap_text(text_buffer, wrap_buffer, wrap_buffer_capacity, mw, fold)) {
+      std::swap(text_buffer, wrap_buffer);
+    } else {
+      /* show the text unwrapped until the buffer has grown */
+      full = true;
+      fold_text_case(text_buffer, fold);
+    }
+  } else {
+    fold_text_case(text_buffer, fold);
+  }
 
-    tmp_p = text_buffer;
-    while (*tmp_p != 0) {
-      *tmp_p = tolower(static_cast<unsigned char>(*tmp_p));
-      tmp_p++;
+  /* give the next frame twice the room; the text of this one is kept */
+  if (full) {
+    static bool warned = false;
+
+    if (text_buffer_capacity < text_buffer_limit) {
+      resize_text_buffer(std::min(2 * text_buffer_capacity, text_buffer_limit));
+      DBGP("text buffer grown to %zu bytes", text_buffer_capacity);
+    } else if (!warned) {
+      NORM_ERR("the text is longer than %zu bytes, the rest is cut off",
+               text_buffer_limit);
+      warned = true;
     }
   }
+  index_text_buffer();
 
   double ui = active_update_interval();
   double time = get_time();
@@ -762,7 +1187,7 @@ int get_border_total() {
 
 static int get_string_width_special(char *s, int special_index) {
   char *p, *final;
-  special_t *current = specials;
+  special_t *current;
   int idx = 1;
   int width = 0;
   long i;
@@ -777,8 +1202,7 @@ static int get_string_width_special(char *s, int special_index) {
   p = strndup(s, text_buffer_size.get(*state));
   final = p;
 
-  for (i = 0; i < special_index; i++) { current = current->next; }
-  for (i = 0; i < idx; i++) { current = current->next; }
+  current = special_at(special_index + idx);
 
   while (*p != 0) {
     if (*p == SPECIAL_CHAR) {
@@ -789,17 +1213,17 @@ static int get_string_width_special(char *s, int special_index) {
       }
       if (current->type == GRAPH || current->type == GAUGE ||
           current->type == BAR) {
-        width += current->width;
+        width += meter_of(current)->width;
       }
       if (current->type == FONT) {
         // put all following text until the next fontchange/stringend in
         // influenced_by_font but do not include specials
         char *influenced_by_font = strdup(p);
-        special_t *current_after_font = current;
+        int after_font = special_index + idx;
         for (i = 0; influenced_by_font[i] != 0; i++) {
           if (influenced_by_font[i] == SPECIAL_CHAR) {
             // remove specials and stop at fontchange
-            current_after_font = current_after_font->next;
+            special_t *current_after_font = special_at(++after_font);
             if (current_after_font->type == FONT) {
               influenced_by_font[i] = 0;
               break;
@@ -812,7 +1236,7 @@ static int get_string_width_special(char *s, int special_index) {
         }
         // add the length of influenced_by_font in the new font to width
         int orig_font = selected_font;
-        selected_font = current->font_added;
+        selected_font = current->arg;
         width += calc_text_width(influenced_by_font);
         selected_font = orig_font;
         free(influenced_by_font);
@@ -830,7 +1254,7 @@ static int get_string_width_special(char *s, int special_index) {
         }
       }
       idx++;
-      current = current->next;
+      current = special_at(special_index + idx);
     } else {
       p++;
     }
@@ -844,6 +1268,8 @@ static int text_size_updater(char *s, int special_index);
 
 int last_font_height;
 void update_text_area() {
+  conky::profile::scope s(
+      conky::profile::stage_record(conky::profile::UPDATE_TEXT_AREA));
   int x = 0, y = 0;
 
   if (!out_to_x.get(*state)) { return; }
@@ -855,7 +1281,7 @@ void update_text_area() {
     text_width = dpi_scale(minimum_width.get(*state));
     text_height = 0;
     last_font_height = font_height();
-    for_each_line(text_buffer, text_size_updater);
+    for_each_line(text_size_updater);
     text_width += 1;
     if (text_height < dpi_scale(minimum_height.get(*state))) {
       text_height = dpi_scale(minimum_height.get(*state));
@@ -953,9 +1379,7 @@ int get_saved_coordinates_y(int i) { return saved_coordinates_y[i]; }
 static int text_size_updater(char *s, int special_index) {
   int w = 0;
   char *p;
-  special_t *current = specials;
-
-  for (int i = 0; i < special_index; i++) { current = current->next; }
+  special_t *current = special_at(special_index);
 
   if (!out_to_x.get(*state)) { return 0; }
   if (display_output() == nullptr || !display_output()->graphical()) {
@@ -971,9 +1395,10 @@ static int text_size_updater(char *s, int special_index) {
 
       if (current->type == BAR || current->type == GAUGE ||
           current->type == GRAPH) {
-        w += current->width;
-        if (current->height > last_font_height) {
-          last_font_height = current->height;
+        const special_meter *m = meter_of(current);
+        w += m->width;
+        if (m->height > last_font_height) {
+          last_font_height = m->height;
           last_font_height += font_height();
         }
       } else if (current->type == OFFSET) {
@@ -984,19 +1409,18 @@ static int text_size_updater(char *s, int special_index) {
         if (current->arg > cur_x) { w = static_cast<int>(current->arg); }
       } else if (current->type == TAB) {
         int start = current->arg;
-        int step = current->width;
+        int step = current->size;
 
         if ((step == 0) || step < 0) { step = 10; }
         w += step - (cur_x - text_start_x - start) % step;
       } else if (current->type == FONT) {
-        selected_font = current->font_added;
+        selected_font = current->arg;
         if (font_height() > last_font_height) {
           last_font_height = font_height();
         }
       }
 
-      special_index++;
-      current = current->next;
+      current = special_at(++special_index);
       s = p + 1;
     }
     p++;
@@ -1018,15 +1442,44 @@ static inline void set_foreground_color(long c) {
   for (auto output : display_outputs()) output->set_foreground_color(c);
 }
 
+#ifdef BUILD_GUI
+/* The length of the longest prefix of s (len bytes) that is at most width
+ * pixels wide. Prefix widths grow with their length, so they are bisected;
+ * the cuts fall on character boundaries to keep UTF-8 intact. */
+static size_t fit_string_width(char *s, size_t len, int width) {
+  if (get_string_width(s) <= width) { return len; }
+  /* the prefix of lo bytes fits, the one of hi bytes does not */
+  size_t lo = 0;
+  size_t hi = len;
+
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    while (mid > lo && (s[mid] & 0xc0) == 0x80) { mid--; }
+    if (mid == lo) {
+      mid = lo + 1;
+      while (mid < hi && (s[mid] & 0xc0) == 0x80) { mid++; }
+      if (mid == hi) { break; }
+    }
+    char c = s[mid];
+    s[mid] = '\0';
+    int w = get_string_width(s);
+    s[mid] = c;
+    if (w <= width) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+#endif /* BUILD_GUI */
+
 static void draw_string(const char *s) {
-  int i;
-  int i2;
-  int pos;
 #ifdef BUILD_GUI
   int width_of_s;
 #endif /* BUILD_GUI */
   int max = 0;
-  int added;
+  int added = 0;
 
   if (s[0] == '\0') { return; }
 
@@ -1037,12 +1490,7 @@ static void draw_string(const char *s) {
     for (auto output : display_outputs())
       if (!output->graphical()) output->draw_string(s, 0);
   }
-  int tbs = text_buffer_size.get(*state);
-  memset(tmpstring1, 0, tbs);
-  memset(tmpstring2, 0, tbs);
-  strncpy(tmpstring1, s, tbs - 1);
-  pos = 0;
-  added = 0;
+  size_t limit = text_buffer_size.get(*state) - 1;
 
 #ifdef BUILD_GUI
   if (display_output() && display_output()->graphical()) {
@@ -1052,44 +1500,34 @@ static void draw_string(const char *s) {
   /* This code looks for tabs in the text and coverts them to spaces.
    * The trick is getting the correct number of spaces, and not going
    * over the window's size without forcing the window larger. */
-  for (i = 0; i < tbs; i++) {
-    if (tmpstring1[i] == '\t') {
-      i2 = 0;
-      for (i2 = 0; i2 < (8 - (1 + pos) % 8) && added <= max; i2++) {
-        /* guard against overrun */
-        tmpstring2[std::min(pos + i2, tbs - 1)] = ' ';
+  size_t pos = 0;
+  for (; *s != 0 && pos < limit; ++s) {
+    if (*s == '\t') {
+      int spaces = 8 - (1 + pos) % 8;
+      for (int i = 0; i < spaces && added <= max && pos < limit; i++) {
+        tmpstring2[pos++] = ' ';
         added++;
       }
-      pos += i2;
     } else {
-      /* guard against overrun */
-      tmpstring2[std::min(pos, tbs - 1)] = tmpstring1[i];
-      pos++;
+      tmpstring2[pos++] = *s;
     }
   }
+  tmpstring2[pos] = '\0';
 #ifdef BUILD_GUI
   if (display_output() && display_output()->graphical()) {
     int mw = display_output()->dpi_scale(maximum_width.get(*state));
     if (text_width == mw) {
       /* this means the text is probably pushing the limit,
        * so we'll chop it */
-      while (cur_x + get_string_width(tmpstring2) - text_start_x > mw &&
-             strlen(tmpstring2) > 0) {
-        tmpstring2[strlen(tmpstring2) - 1] = '\0';
-      }
+      pos = fit_string_width(tmpstring2, pos, mw - (cur_x - text_start_x));
+      tmpstring2[pos] = '\0';
     }
-  }
-#endif /* BUILD_GUI */
-  s = tmpstring2;
-#ifdef BUILD_GUI
-  if (display_output() && display_output()->graphical()) {
     display_output()->draw_string_at(text_offset_x + cur_x,
-                                     text_offset_y + cur_y, s, strlen(s));
+                                     text_offset_y + cur_y, tmpstring2, pos);
 
     cur_x += width_of_s;
   }
 #endif /* BUILD_GUI */
-  memcpy(tmpstring1, s, tbs);
 }
 
 #if defined(BUILD_MATH) && defined(BUILD_GUI)
@@ -1125,6 +1563,7 @@ static std::string formatSizeWithUnits(double size, int prec = 1) {
 #endif /* BUILD_MATH && BUILD_GUI */
 
 int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
+  conky::profile::span trace("draw_each_line_inner");
 #ifndef BUILD_GUI
   static int cur_x, cur_y; /* current x and y for drawing */
   (void)cur_y;
@@ -1163,13 +1602,12 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
         s = p + 1;
       }
       /* draw special */
-      special_t *current = specials;
-      for (int i = 0; i < special_index; i++) { current = current->next; }
+      special_t *current = special_at(special_index);
       switch (current->type) {
 #ifdef BUILD_GUI
         case HORIZONTAL_LINE:
           if (out_to_x.get(*state)) {
-            int h = current->height;
+            int h = current->size;
             int mid = font_ascent() / 2;
 
             w = text_start_x + text_width - cur_x;
@@ -1185,7 +1623,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
         case STIPPLED_HR:
           if (out_to_x.get(*state)) {
-            int h = current->height;
+            int h = current->size;
             char tmp_s = current->arg;
             int mid = font_ascent() / 2;
             char ss[2] = {tmp_s, tmp_s};
@@ -1203,16 +1641,17 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
         case BAR:
           if (out_to_x.get(*state)) {
+            special_meter *m = meter_of(current);
             int h, by;
             double bar_usage, scale;
             if (cur_x - text_start_x > mw && mw > 0) { break; }
-            h = current->height;
-            bar_usage = current->arg;
-            scale = current->scale;
+            h = m->height;
+            bar_usage = shown_arg(m);
+            scale = m->scale;
             by = cur_y - (font_ascent() / 2) - 1;
 
             if (h < font_h) { by -= h / 2 - 1; }
-            w = current->width;
+            w = m->width;
             if (w == 0) { w = text_start_x + text_width - cur_x - 1; }
             if (w < 0) { w = 0; }
 
@@ -1231,6 +1670,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
         case GAUGE: /* new GAUGE  */
           if (out_to_x.get(*state)) {
+            special_meter *m = meter_of(current);
             int h, by = 0;
             unsigned long last_colour = current_color;
 #ifdef BUILD_MATH
@@ -1240,11 +1680,11 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
             if (cur_x - text_start_x > mw && mw > 0) { break; }
 
-            h = current->height;
+            h = m->height;
             by = cur_y - (font_ascent() / 2) - 1;
 
             if (h < font_h) { by -= h / 2 - 1; }
-            w = current->width;
+            w = m->width;
             if (w == 0) { w = text_start_x + text_width - cur_x - 1; }
             if (w < 0) { w = 0; }
 
@@ -1256,8 +1696,8 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
             }
 
 #ifdef BUILD_MATH
-            usage = current->arg;
-            scale = current->scale;
+            usage = shown_arg(m);
+            scale = m->scale;
             angle = M_PI * usage / scale;
             px = static_cast<float>(cur_x + (w / 2.)) -
                  static_cast<float>(w / 2.) * cos(angle);
@@ -1281,20 +1721,20 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
         case GRAPH:
           if (out_to_x.get(*state)) {
+            special_meter *m = meter_of(current);
             int h, by, i = 0, j = 0;
-            int colour_idx = 0;
             unsigned long last_colour = current_color;
             if (cur_x - text_start_x > mw && mw > 0) { break; }
-            h = current->height;
+            h = m->height;
             by = cur_y - (font_ascent() / 2) - 1;
 
             if (h < font_h) { by -= h / 2 - 1; }
-            w = current->width;
+            w = m->width;
             if (w == 0) {
               w = text_start_x + text_width - cur_x - 1;
-              current->graph_width = std::max(w - 1, 0);
-              if (current->graph_width != current->graph_allocated) {
-                w = current->graph_allocated + 1;
+              m->graph_width = std::max(w - 1, 0);
+              if (m->graph_width != m->graph_allocated) {
+                w = m->graph_allocated + 1;
               }
             }
             if (w < 0) { w = 0; }
@@ -1308,46 +1748,55 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
             if (display_output()) display_output()->set_line_style(1, true);
 
             /* in case we don't have a graph yet */
-            if (current->graph != nullptr) {
-              std::unique_ptr<unsigned long[]> tmpcolour;
-
-              if (current->last_colour != 0 || current->first_colour != 0) {
-                auto factory = create_gradient_factory(w, current->last_colour,
-                                                       current->first_colour);
-                tmpcolour = factory->create_gradient();
-                delete factory;
+            if (m->graph != nullptr) {
+              const unsigned long *tmpcolour = nullptr;
+
+              if (m->last_colour != 0 || m->first_colour != 0) {
+                tmpcolour = graph_gradient(w, m->last_colour,
+                                           m->first_colour);
               }
-              colour_idx = 0;
-              for (i = w - 2; i > -1; i--) {
-                if (current->last_colour != 0 || current->first_colour != 0) {
-                  if (current->tempgrad != 0) {
-                    set_foreground_color(tmpcolour[static_cast<int>(
-                        static_cast<float>(w - 2) -
-                        current->graph[j] * (w - 2) /
-                            std::max(static_cast<float>(current->scale),
-                                     1.0F))]);
-                  } else {
-                    set_foreground_color(tmpcolour[colour_idx++]);
-                  }
+              static std::vector<int> tops;
+              static std::vector<unsigned long> colours;
+              int n = std::max(w - 1, 0);
+
+              tops.resize(n);
+              colours.resize(n);
+              /* graph[0] is the newest sample, drawn in the rightmost column */
+              for (i = n - 1; i >= 0; i--, j++) {
+                if (tmpcolour != nullptr) {
+                  colours[i] =
+                      m->tempgrad != 0
+                          ? tmpcolour[static_cast<int>(
+                                static_cast<float>(w - 2) -
+                                (*m->graph)[j] * (w - 2) /
+                                    std::max(static_cast<float>(m->scale),
+                                             1.0F))]
+                          : tmpcolour[n - 1 - i];
                 }
-                /* this is mugfugly, but it works */
-                if (display_output()) {
-                  display_output()->draw_line(
-                      text_offset_x + cur_x + i + 1, text_offset_y + by + h,
-                      text_offset_x + cur_x + i + 1,
-                      text_offset_y +
+                tops[i] = text_offset_y +
                           round_to_positive_int(static_cast<double>(by) + h -
-                                                current->graph[j] * (h - 1) /
-                                                    current->scale));
-                }
-                ++j;
+                                                (*m->graph)[j] * (h - 1) /
+                                                    m->scale);
+              }
+              if (display_output()) {
+                display_output()->draw_graph(
+                    text_offset_x + cur_x + 1, text_offset_y + by + h, n,
+                    tops.data(),
+                    tmpcolour != nullptr ? colours.data() : nullptr);
+              }
+              /* the colour drawing column by column used to leave behind */
+              if (tmpcolour != nullptr && n > 0) {
+                set_foreground_color(colours[0]);
               }
             }
             if (h > cur_y_add && h > font_h) { cur_y_add = h; }
             if (show_graph_range.get(*state)) {
               int tmp_x = cur_x;
               int tmp_y = cur_y;
-              unsigned short int seconds = active_update_interval() * w;
+              /* a day of seconds does not fit in an unsigned short */
+              auto seconds = static_cast<unsigned int>(
+                  m->span != 0 ? m->span
+                                     : active_update_interval() * w);
               char *tmp_day_str;
               char *tmp_hour_str;
               char *tmp_min_str;
@@ -1398,14 +1847,14 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
               cur_y = tmp_y;
             }
 #ifdef BUILD_MATH
-            if (show_graph_scale.get(*state) && (current->show_scale == 1)) {
+            if (show_graph_scale.get(*state) && (m->show_scale == 1)) {
               int tmp_x = cur_x;
               int tmp_y = cur_y;
               cur_x += font_ascent() / 2;
               cur_y += font_h / 2;
               std::string tmp_str = formatSizeWithUnits(
-                  current->scale_log != 0 ? std::pow(10.0, current->scale)
-                                          : current->scale);
+                  m->scale_log != 0 ? std::pow(10.0, m->scale)
+                                          : m->scale);
               draw_string(tmp_str.c_str());
               cur_x = tmp_x;
               cur_y = tmp_y;
@@ -1415,12 +1864,57 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
           }
           break;
 
+        case HEATMAP:
+          if (out_to_x.get(*state)) {
+            special_meter *m = meter_of(current);
+            int h, by;
+            unsigned long last_colour = current_color;
+            if (cur_x - text_start_x > mw && mw > 0) { break; }
+            h = m->height;
+            by = cur_y - (font_ascent() / 2) - 1;
+
+            if (h < font_h) { by -= h / 2 - 1; }
+            w = m->width;
+            if (w == 0) { w = text_start_x + text_width - cur_x - 1; }
+            if (w < 0) { w = 0; }
+
+            /* without colours the cells go from the shade to the text colour,
+             * in as many steps as they can tell apart */
+            unsigned long first_colour = m->first_colour;
+            unsigned long last = m->last_colour;
+            if (first_colour == 0 && last == 0) {
+              first_colour = default_shade_color.get(*state);
+              last = default_color.get(*state);
+            }
+            const int levels = 256;
+            const unsigned long *gradient =
+                graph_gradient(levels, last, first_colour);
+            static std::vector<unsigned long> colours;
+
+            colours.resize(m->cells.size());
+            for (size_t i = 0; i < colours.size(); i++) {
+              float v = std::min(std::max(m->cells[i], 0.0F), 1.0F);
+              colours[i] =
+                  gradient[levels - 1 - static_cast<int>(v * (levels - 1))];
+            }
+            if (display_output()) {
+              display_output()->draw_cells(text_offset_x + cur_x,
+                                           text_offset_y + by, w, h,
+                                           m->cols, m->rows,
+                                           static_cast<int>(colours.size()),
+                                           colours.data());
+            }
+            if (h > cur_y_add && h > font_h) { cur_y_add = h; }
+            set_foreground_color(last_colour);
+          }
+          break;
+
         case FONT:
           if (out_to_x.get(*state)) {
             int old = font_ascent();
 
             cur_y -= font_ascent();
-            selected_font = current->font_added;
+            selected_font = current->arg;
             set_font();
             if (cur_y + font_ascent() < cur_y + old) {
               cur_y += old;
@@ -1432,16 +1926,22 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
           break;
 #endif /* BUILD_GUI */
         case FG:
-          if (draw_mode == FG) { set_foreground_color(current->arg); }
+          if (draw_mode == FG) {
+            set_foreground_color(special_colour(current));
+          }
           break;
 
 #ifdef BUILD_GUI
         case BG:
-          if (draw_mode == BG) { set_foreground_color(current->arg); }
+          if (draw_mode == BG) {
+            set_foreground_color(special_colour(current));
+          }
           break;
 
         case OUTLINE:
-          if (draw_mode == OUTLINE) { set_foreground_color(current->arg); }
+          if (draw_mode == OUTLINE) {
+            set_foreground_color(special_colour(current));
+          }
           break;
 
         case OFFSET:
@@ -1461,7 +1961,7 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
 
         case TAB: {
           int start = current->arg;
-          int step = current->width;
+          int step = current->size;
 
           if ((step == 0) || step < 0) { step = 10; }
           w = step - (cur_x - text_start_x - start) % step;
@@ -1543,8 +2043,235 @@ int draw_each_line_inner(char *s, int special_index, int last_special_applied) {
   return special_index;
 }
 
+#ifdef BUILD_GUI
+/* Damage tracking
+ *
+ * After every generate_text(), hash_text_lines() gives each line of
+ * text_buffer a key made from its text, the specials it uses and the drawing
+ * state (colours, fonts) it starts with. draw_text() records where each line
+ * was drawn. get_text_damage() compares the two, so a display only needs to
+ * clear and redraw the lines whose key changed since they were last drawn.
+ */
+namespace {
+struct text_line {
+  size_t key;    /* what the line looks like */
+  size_t layout; /* what its height depends on */
+  int y;         /* window coordinates the last time it was drawn */
+  int height;
+};
+
+/* what draw_each_line_inner() leaves for the next line */
+struct line_state {
+  unsigned int font;
+  long color;
+};
+
+std::vector<text_line> generated_lines; /* the lines in text_buffer */
+std::vector<text_line> drawn_lines;     /* the lines on screen */
+std::vector<line_state> drawn_states;   /* after each of drawn_lines */
+std::vector<std::pair<int, int>> drawing_lines; /* drawn so far this frame */
+std::vector<line_state> drawing_states;
+int drawn_x, drawn_y, drawn_width, drawn_height;
+bool drawn_valid = false;
+
+inline void hash_mix(size_t &h, size_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+size_t hash_special(const special_t *s) {
+  size_t h = 0;
+  hash_mix(h, s->type);
+  hash_mix(h, s->size);
+  if (s->type != BAR && s->type != GAUGE && s->type != GRAPH &&
+      s->type != HEATMAP) {
+    hash_mix(h, s->arg);
+    return h;
+  }
+
+  const special_meter *m = meter_of(s);
+  hash_mix(h, m->height);
+  hash_mix(h, m->width);
+  hash_mix(h, std::hash<double>()(m->arg));
+  hash_mix(h, std::hash<double>()(m->scale));
+  hash_mix(h, m->show_scale);
+  hash_mix(h, m->scaled);
+  hash_mix(h, m->scale_log);
+  hash_mix(h, m->first_colour);
+  hash_mix(h, m->last_colour);
+  hash_mix(h, m->tempgrad);
+  /* a meter that showed a graph in an earlier frame still points to it */
+  if (s->type == GRAPH && m->graph != nullptr) {
+    for (int i = 0; i < m->graph_width && i < m->graph_allocated; ++i) {
+      hash_mix(h, std::hash<double>()((*m->graph)[i]));
+    }
+  }
+  if (s->type == HEATMAP) {
+    hash_mix(h, m->cols);
+    hash_mix(h, m->rows);
+    for (float v : m->cells) { hash_mix(h, std::hash<float>()(v)); }
+  }
+  return h;
+}
+
+void hash_text_lines() {
+  generated_lines.clear();
+  if (text_buffer == nullptr) { return; }
+
+  size_t drawing_state = 0;
+  for (const buffer_line &l : buffer_lines) {
+    const char *p = text_buffer + l.start;
+    int special_index = l.special_index;
+    const special_t *current = special_at(special_index);
+    text_line line{};
+
+    line.key = std::hash<std::string_view>()(std::string_view(p, l.length));
+    hash_mix(line.key, drawing_state);
+    for (size_t i = 0; i < l.length && current != nullptr; ++i) {
+      if (p[i] != SPECIAL_CHAR) { continue; }
+      size_t h = hash_special(current);
+      hash_mix(line.key, h);
+      switch (current->type) {
+        case FG:
+        case BG:
+        case OUTLINE:
+          hash_mix(drawing_state, h);
+          break;
+        case FONT:
+          hash_mix(drawing_state, h);
+          hash_mix(line.layout, h);
+          break;
+        case VOFFSET:
+        case BAR:
+        case GAUGE:
+        case GRAPH:
+        case HEATMAP:
+        case HORIZONTAL_LINE:
+        case STIPPLED_HR:
+          hash_mix(line.layout, h);
+          break;
+        default:
+          break;
+      }
+      current = special_at(++special_index);
+    }
+    generated_lines.push_back(line);
+  }
+}
+
+void begin_drawing_lines() {
+  drawing_lines.clear();
+  drawing_states.clear();
+}
+
+void end_drawing_lines() {
+  drawn_valid = drawing_lines.size() == generated_lines.size();
+  if (!drawn_valid) { return; }
+  drawn_lines = generated_lines;
+  drawn_states = drawing_states;
+  for (size_t i = 0; i < drawn_lines.size(); ++i) {
+    drawn_lines[i].y = drawing_lines[i].first;
+    drawn_lines[i].height = drawing_lines[i].second - drawing_lines[i].first;
+  }
+  drawn_x = text_start_x;
+  drawn_y = text_start_y;
+  drawn_width = text_width;
+  drawn_height = text_height;
+}
+
+/* Whether line i is unchanged since it was drawn last and lies outside the
+ * area being redrawn, where the display keeps what is there already. Then
+ * there is no need to send it again only for it to be clipped. */
+bool line_clipped_out(size_t i) {
+  if (!drawn_valid || i >= drawn_lines.size() || i >= generated_lines.size() ||
+      drawn_x != text_start_x || drawn_width != text_width) {
+    return false;
+  }
+  const text_line &old = drawn_lines[i];
+  if (old.key != generated_lines[i].key ||
+      old.layout != generated_lines[i].layout || old.y != cur_y) {
+    return false;
+  }
+  // shades and outlines are offset by a pixel, see get_text_damage()
+  int border_total = get_border_total();
+  return display_output()->clipped_out(text_start_x - border_total, old.y - 1,
+                                       text_width + 2 * border_total,
+                                       old.height + 2);
+}
+}  // namespace
+
+bool get_text_damage(std::vector<std::pair<int, int>> &bands) {
+  bands.clear();
+  if (!drawn_valid || drawn_lines.size() != generated_lines.size() ||
+      drawn_x != text_start_x || drawn_y != text_start_y ||
+      drawn_width != text_width || drawn_height != text_height) {
+    return false;
+  }
+  // whatever these draw isn't part of text_buffer, so they are repainted
+  // with everything else, unless nothing at all changed
+  bool hooks = llua_has_draw_hooks();
+  if (hooks && llua_draw_hooks_dirty()) { return false; }
+#ifdef BUILD_IMLIB2
+  // only the rectangle of the images that changed is redrawn
+  XRectangle images{};
+  if (cimlib_images_changed() && !cimlib_damage(images)) { return false; }
+#endif /* BUILD_IMLIB2 */
+
+  for (size_t i = 0; i < drawn_lines.size(); ++i) {
+    const text_line &old = drawn_lines[i];
+    if (old.layout != generated_lines[i].layout) { return false; }
+    if (old.key == generated_lines[i].key) { continue; }
+    // leave room for shades and outlines, which are offset by a pixel
+    int top = old.y - 1;
+    int bottom = old.y + old.height + 1;
+    if (!bands.empty() && bands.back().second >= top) {
+      bands.back().second = bottom;
+    } else {
+      bands.emplace_back(top, bottom);
+    }
+  }
+#ifdef BUILD_IMLIB2
+  if (images.width != 0 && images.height != 0) {
+    bands.emplace_back(images.y, images.y + images.height);
+    std::sort(bands.begin(), bands.end());
+    size_t merged = 0;
+    for (size_t i = 1; i < bands.size(); ++i) {
+      if (bands[i].first <= bands[merged].second) {
+        bands[merged].second = std::max(bands[merged].second, bands[i].second);
+      } else {
+        bands[++merged] = bands[i];
+      }
+    }
+    bands.resize(merged + 1);
+  }
+#endif /* BUILD_IMLIB2 */
+  if (hooks && !bands.empty()) { return false; }
+  return true;
+}
+#endif /* BUILD_GUI */
+
 static int draw_line(char *s, int special_index) {
   if (display_output() && display_output()->draw_line_inner_required()) {
+#ifdef BUILD_GUI
+    if (draw_mode == FG && display_output()->graphical()) {
+      size_t i = drawing_lines.size();
+      if (line_clipped_out(i)) {
+        /* carry on as if it had been drawn */
+        const line_state &after = drawn_states[i];
+        cur_y = drawn_lines[i].y + drawn_lines[i].height;
+        drawing_lines.emplace_back(drawn_lines[i].y, cur_y);
+        drawing_states.push_back(after);
+        selected_font = after.font;
+        set_font();
+        set_foreground_color(after.color);
+        return special_index;
+      }
+      int y = cur_y;
+      special_index = draw_each_line_inner(s, special_index, -1);
+      drawing_lines.emplace_back(y, cur_y);
+      drawing_states.push_back(line_state{selected_font, current_color});
+      return special_index;
+    }
+#endif /* BUILD_GUI */
     return draw_each_line_inner(s, special_index, -1);
   }
   draw_string(s);
@@ -1581,12 +2308,18 @@ static void draw_text() {
     /* draw text */
   }
   setup_fonts();
+  begin_drawing_lines();
+#endif /* BUILD_GUI */
+  for_each_line(draw_line);
+#ifdef BUILD_GUI
+  if (draw_mode == FG && !drawing_lines.empty()) { end_drawing_lines(); }
 #endif /* BUILD_GUI */
-  for_each_line(text_buffer, draw_line);
   for (auto output : display_outputs()) output->end_draw_text();
 }
 
 void draw_stuff() {
+  conky::profile::scope s(
+      conky::profile::stage_record(conky::profile::DRAW_STUFF));
 #ifdef BUILD_GUI
   text_offset_x = text_offset_y = 0;
 #ifdef BUILD_IMLIB2
@@ -1595,6 +2328,7 @@ void draw_stuff() {
 #endif /* BUILD_GUI */
   for (auto output : display_outputs()) output->begin_draw_stuff();
 #ifdef BUILD_GUI
+  set_tween_progress(animation_progress());
   llua_draw_pre_hook();
   //  if (out_to_x.get(*state)) {
   for (auto output : display_outputs()) {
@@ -1614,15 +2348,22 @@ void draw_stuff() {
     if (draw_outline.get(*state)) {
       selected_font = 0;
 
-      for (text_offset_x = -1; text_offset_x < 2; text_offset_x++) {
-        for (text_offset_y = -1; text_offset_y < 2; text_offset_y++) {
-          if (text_offset_x == 0 && text_offset_y == 0) { continue; }
-          set_foreground_color(default_outline_color.get(*state));
-          draw_mode = OUTLINE;
-          draw_text();
+      if (output->begin_outline()) {
+        set_foreground_color(default_outline_color.get(*state));
+        draw_mode = OUTLINE;
+        draw_text();
+        output->end_outline();
+      } else {
+        for (text_offset_x = -1; text_offset_x < 2; text_offset_x++) {
+          for (text_offset_y = -1; text_offset_y < 2; text_offset_y++) {
+            if (text_offset_x == 0 && text_offset_y == 0) { continue; }
+            set_foreground_color(default_outline_color.get(*state));
+            draw_mode = OUTLINE;
+            draw_text();
+          }
         }
+        text_offset_x = text_offset_y = 0;
       }
-      text_offset_x = text_offset_y = 0;
     }
 
     selected_font = 0;
@@ -1636,19 +2377,30 @@ void draw_stuff() {
   llua_draw_post_hook();
 #endif /* BUILD_GUI */
   for (auto output : display_outputs()) output->end_draw_stuff();
+  /* windows are drawn once while being set up, before the first update */
+  if (info.looped > 0) { conky::profile::startup_done(); }
 }
 
 int need_to_update;
 
+static void flush_display_outputs() {
+  for (auto output : display_outputs()) {
+    conky::profile::scope s(conky::profile::flush_record(output->name));
+    output->flush();
+  }
+}
+
 /* update_text() generates new text and clears old text area */
 void update_text() {
 #ifdef BUILD_IMLIB2
   cimlib_cleanup();
 #endif /* BUILD_IMLIB2 */
   generate_text();
+  llua_run_subscriptions();
 #ifdef BUILD_GUI
+  hash_text_lines();
   for (auto output : display_outputs()) {
-    if (output->graphical()) output->clear_text(1);
+    if (output->graphical()) output->clear_damaged_text();
   }
 #endif /* BUILD_GUI */
   need_to_update = 1;
@@ -1683,6 +2435,49 @@ bool is_on_battery() {  // checks if at least one battery specified in
   return false;
 }
 
+/* of the batteries in detect_battery, leaving out those that are missing */
+static int lowest_battery_perct() {
+  int lowest = 100;
+  for (auto const &value : split(detect_battery.get(*state), ',')) {
+    int perct = get_battery_perct(value.c_str());
+    if (perct > 0) { lowest = std::min(lowest, perct); }
+  }
+  return lowest;
+}
+
+static bool power_profile_enabled() {
+  return battery_period_factor.get(*state) > 1 ||
+         (low_battery_percent.get(*state) > 0 &&
+          low_battery_period_factor.get(*state) > 1);
+}
+
+static void update_power_factor(bool discharging) {
+  power_factor = 1;
+  if (!discharging) { return; }
+  power_factor = battery_period_factor.get(*state);
+  if (low_battery_period_factor.get(*state) > power_factor &&
+      lowest_battery_perct() <
+          static_cast<int>(low_battery_percent.get(*state))) {
+    power_factor = low_battery_period_factor.get(*state);
+  }
+}
+
+double power_period_factor(const char *source) {
+  if (power_factor <= 1) { return 1; }
+
+  static std::string list;
+  static std::vector<std::string> sources;
+  std::string current = battery_sources.get(*state);
+  if (current != list) {
+    list = current;
+    sources = split(list, ',');
+  }
+  for (const auto &s : sources) {
+    if (s == source) { return power_factor; }
+  }
+  return 1;
+}
+
 volatile sig_atomic_t g_sigterm_pending, g_sighup_pending, g_sigusr2_pending;
 
 void main_loop() {
@@ -1693,6 +2488,7 @@ void main_loop() {
 #ifdef BUILD_GUI
   double t;
 #endif /* BUILD_GUI */
+  bool inotify_ready = false;
 #ifdef HAVE_SYS_INOTIFY_H
   int inotify_config_wd = -1;
 #define INOTIFY_EVENT_SIZE (sizeof(struct inotify_event))
@@ -1710,10 +2506,24 @@ void main_loop() {
   last_update_time = 0.0;
   next_update_time = get_time() - fmod(get_time(), active_update_interval());
   info.looped = 0;
+  conky::thread_qos render_qos;
   while (terminate == 0 && (total_run_times.get(*state) == 0 ||
                             info.looped < total_run_times.get(*state))) {
-    if ((update_interval_on_battery.get(*state) != NOBATTERY)) {
-      on_battery = is_on_battery();
+    const bool profile = power_profile_enabled();
+    if ((update_interval_on_battery.get(*state) != NOBATTERY) || profile) {
+      bool discharging = is_on_battery();
+      if (update_interval_on_battery.get(*state) != NOBATTERY) {
+        on_battery = discharging;
+      }
+      update_power_factor(profile && discharging);
+    } else {
+      power_factor = 1;
+    }
+    /* render_cpus may change with the config */
+    conky::thread_qos qos = conky::render_thread_qos();
+    if (qos != render_qos) {
+      qos.apply();
+      render_qos = qos;
     }
     info.looped++;
 
@@ -1730,16 +2540,15 @@ void main_loop() {
       display_output()->main_loop_wait(t);
     } else {
 #endif /* BUILD_GUI */
-      struct timespec req, rem;
-      auto time_to_sleep = next_update_time - get_time();
-      auto seconds = static_cast<time_t>(std::floor(time_to_sleep));
-      auto nanos = (time_to_sleep - seconds) * 1000000000L;
-      req.tv_sec = seconds;
-      req.tv_nsec = nanos;
-      nanosleep(&req, &rem);
+      /* only a signal or a config change cuts the interval short, and
+       * benchmarks don't wait at all */
+      while (!conky::benchmarking() &&
+             !conky::main_reactor().wait(next_update_time) &&
+             g_sighup_pending == 0 && g_sigusr2_pending == 0 &&
+             g_sigterm_pending == 0 && !inotify_ready) {}
       update_text();
       draw_stuff();
-      for (auto output : display_outputs()) output->flush();
+      flush_display_outputs();
 #ifdef BUILD_GUI
     }
 #endif /* BUILD_GUI */
@@ -1762,9 +2571,12 @@ void main_loop() {
       g_sigusr2_pending = 0;
       // refresh view;
       NORM_ERR("received SIGUSR2. refreshing.");
+      conky::profile::dump(stderr);
+      conky::profile::write_trace();
+      conky::memory::dump(stderr);
       update_text();
       draw_stuff();
-      for (auto output : display_outputs()) output->flush();
+      flush_display_outputs();
     }
 
     if (g_sigterm_pending != 0) {
@@ -1778,22 +2590,18 @@ void main_loop() {
         inotify_config_wd == -1 && !current_config.empty()) {
       inotify_config_wd =
           inotify_add_watch(inotify_fd, current_config.c_str(), IN_MODIFY);
+      conky::main_reactor().add(inotify_fd,
+                                [&inotify_ready] { inotify_ready = true; });
     }
     if (!disable_auto_reload.get(*state) && inotify_fd != -1 &&
         inotify_config_wd != -1 && !current_config.empty()) {
       int len = 0, idx = 0;
-      fd_set descriptors;
-      struct timeval time_to_wait;
 
-      FD_ZERO(&descriptors);
-      FD_SET(inotify_fd, &descriptors);
-
-      time_to_wait.tv_sec = time_to_wait.tv_usec = 0;
-
-      select(inotify_fd + 1, &descriptors, nullptr, NULL, &time_to_wait);
-      if (FD_ISSET(inotify_fd, &descriptors)) {
+      if (inotify_ready) {
+        inotify_ready = false;
         /* process inotify events */
         len = read(inotify_fd, inotify_buff, INOTIFY_BUF_LEN - 1);
+        if (len < 0) { len = 0; }
         inotify_buff[len] = 0;
         while (len > 0 && idx < len) {
           struct inotify_event *ev = (struct inotify_event *)&inotify_buff[idx];
@@ -1816,6 +2624,7 @@ void main_loop() {
         }
       }
     } else if (disable_auto_reload.get(*state) && inotify_fd != -1) {
+      conky::main_reactor().remove(inotify_fd);
       inotify_rm_watch(inotify_fd, inotify_config_wd);
       close(inotify_fd);
       inotify_fd = inotify_config_wd = -1;
@@ -1823,11 +2632,14 @@ void main_loop() {
 #endif /* HAVE_SYS_INOTIFY_H */
 
     llua_update_info(&info, active_update_interval());
+    llua_collect_garbage(next_update_time - get_time());
   }
+  if (conky::benchmarking()) { conky::profile::print_percentiles(stdout); }
   clean_up(nullptr, nullptr);
 
 #ifdef HAVE_SYS_INOTIFY_H
   if (inotify_fd != -1) {
+    conky::main_reactor().remove(inotify_fd);
     inotify_rm_watch(inotify_fd, inotify_config_wd);
     close(inotify_fd);
     inotify_fd = inotify_config_wd = -1;
@@ -1846,6 +2658,7 @@ static void reload_config() {
              current_config.c_str(), getpid());
     return;
   }
+  if (reload_text()) { return; }
   clean_up(nullptr, nullptr);
   state = std::make_unique<lua::state>();
   conky::export_symbols(*state);
@@ -1853,17 +2666,6 @@ static void reload_config() {
   initialisation(argc_copy, argv_copy);
 }
 
-void free_specials(special_t *&current) {
-  if (current != nullptr) {
-    free_specials(current->next);
-    if (current->type == GRAPH) { free(current->graph); }
-    delete current;
-    current = nullptr;
-  }
-
-  clear_stored_graphs();
-}
-
 void clean_up_without_threads(void *memtofree1, void *memtofree2) {
   free_and_zero(memtofree1);
   free_and_zero(memtofree2);
@@ -1882,10 +2684,10 @@ void clean_up_without_threads(void *memtofree1, void *memtofree2) {
     info.first_process = nullptr;
   }
 
+  clear_evaluate_cache();
   free_text_objects(&global_root_object);
-  delete_block_and_zero(tmpstring1);
   delete_block_and_zero(tmpstring2);
-  delete_block_and_zero(text_buffer);
+  free_text_buffer();
   free_and_zero(global_text);
 
 #ifdef BUILD_PORT_MONITORS
@@ -1896,7 +2698,8 @@ void clean_up_without_threads(void *memtofree1, void *memtofree2) {
   xmlCleanupParser();
 #endif
 
-  free_specials(specials);
+  free_specials();
+  buffer_lines.clear();
 
   clear_net_stats();
   clear_fs_stats();
@@ -1920,8 +2723,10 @@ static void set_default_configurations() {
   top_time = 0;
 #ifdef BUILD_IOSTATS
   top_io = 0;
+  top_io_fields = 0;
 #endif
   top_running = 0;
+  top_depth = 0;
 #ifdef BUILD_XMMS2
   info.xmms2.artist = nullptr;
   info.xmms2.album = nullptr;
@@ -1942,10 +2747,48 @@ static void set_default_configurations() {
   info.users.number = 1;
 }
 
-void load_config_file() {
-  DBGP(_("reading contents from config file '%s'"), current_config.c_str());
+/* conky.config as the config file left it, before the command line was
+ * applied, see config_signature() */
+static std::string loaded_config_signature;
 
-  lua::state &l = *state;
+/* -t replaced the text of the config file */
+static bool text_from_command_line = false;
+
+/* Describes the conky.config table at index by its keys and values, so that
+ * the settings of two runs of the config file can be compared. Empty if it
+ * holds something that can't be compared, e.g. a function. */
+static std::string config_signature(lua::state &l, int index) {
+  lua::stack_sentry s(l);
+  l.checkstack(3);
+
+  if (l.type(index) != lua::TTABLE) { return std::string(); }
+  l.pushvalue(index);
+
+  std::map<std::string, std::string> values;
+  l.pushnil();
+  while (l.next(-2)) {
+    lua::Type type = l.type(-1);
+    if (l.type(-2) != lua::TSTRING ||
+        (type != lua::TSTRING && type != lua::TNUMBER &&
+         type != lua::TBOOLEAN)) {
+      return std::string();
+    }
+    std::string value = type == lua::TBOOLEAN
+                            ? std::string(l.toboolean(-1) ? "true" : "false")
+                            : l.tostring(-1);
+    values[l.tostring(-2)] = static_cast<char>(type) + value;
+    l.pop();
+  }
+
+  std::string signature("{");
+  for (const auto &v : values) {
+    signature.append(v.first).append(1, '\0').append(v.second).append(1, '\0');
+  }
+  return signature;
+}
+
+/* Runs the config file in l. */
+static void run_config_file(lua::state &l) {
   lua::stack_sentry s(l);
   l.checkstack(2);
 
@@ -1978,6 +2821,12 @@ void load_config_file() {
 #endif
   }
   l.call(0, 0);
+}
+
+/* Returns conky.text as set by the config file, to be freed by the caller. */
+static char *config_text(lua::state &l) {
+  lua::stack_sentry s(l);
+  l.checkstack(2);
 
   l.getglobal("conky");
   l.getfield(-1, "text");
@@ -1989,8 +2838,80 @@ void load_config_file() {
   /* Remove \\-\n. */
   l.gsub(l.tocstring(-1), "\\\n", "");
   l.replace(-2);
-  global_text = strdup(l.tocstring(-1));
-  l.pop();
+  return strdup(l.tocstring(-1));
+}
+
+void load_config_file() {
+  DBGP(_("reading contents from config file '%s'"), current_config.c_str());
+
+  lua::state &l = *state;
+  lua::stack_sentry s(l);
+  l.checkstack(2);
+
+  run_config_file(l);
+  conky::invalidate_config_settings();
+
+  l.getglobal("conky");
+  l.rawgetfield(-1, "config");
+  loaded_config_signature = config_signature(l, -1);
+  l.pop(2);
+
+  global_text = config_text(l);
+}
+
+/* Runs the config file again, and if only conky.text changed, replaces the
+ * text objects and keeps everything else: the windows, fonts, Lua scripts,
+ * stats and stored graphs. The new text is parsed while the old objects
+ * still hold their callbacks, so those of equivalent objects keep running
+ * with their results. Returns false if the config has to be reloaded in
+ * full. */
+static bool reload_text() {
+  if (loaded_config_signature.empty()) { return false; }
+
+  lua::state &l = *state;
+  lua::stack_sentry s(l);
+  l.checkstack(4);
+
+  /* the config file sets conky.config to a plain table, the settings live in
+   * what set_config_settings() made of the old one */
+  l.getglobal("conky");
+  if (l.type(-1) != lua::TTABLE) { return false; }
+  l.rawgetfield(-1, "config");
+  const int config = l.gettop();
+
+  char *text = nullptr;
+  bool same = false;
+  try {
+    run_config_file(l);
+    l.getglobal("conky");
+    if (l.type(-1) == lua::TTABLE) {
+      l.rawgetfield(-1, "config");
+      same = config_signature(l, -1) == loaded_config_signature;
+      l.pop();
+      if (same && !text_from_command_line) { text = config_text(l); }
+    }
+  } catch (std::exception &) {
+    /* the full reload reports it */
+    same = false;
+  }
+  l.settop(config);
+  l.pushvalue(config);
+  l.rawsetfield(config - 1, "config");
+  l.pushvalue(config - 1);
+  l.setglobal("conky");
+  if (!same) { return false; }
+
+  if (text != nullptr) {
+    struct text_object root {};
+
+    renumber_graphs();
+    extract_variable_text_internal(&root, text);
+    free(text);
+    free_text_objects(&global_root_object);
+    global_root_object = root;
+  }
+  NORM_ERR("only the text changed, keeping the rest of the config");
+  return true;
 }
 
 inline void reset_optind() {
@@ -2070,7 +2991,15 @@ const struct option longopts[] = {
     {"double-buffer", 0, nullptr, 'b'}, {"window-id", 1, nullptr, 'w'},
 #endif /* BUILD_X11 */
     {"text", 1, nullptr, 't'},          {"interval", 1, nullptr, 'u'},
-    {"pause", 1, nullptr, 'p'},         {nullptr, 0, nullptr, 0}};
+    {"pause", 1, nullptr, 'p'},
+    {"startup-profile", 0, nullptr, OPT_STARTUP_PROFILE},
+    {"collector", 2, nullptr, OPT_COLLECTOR},
+    {"client", 2, nullptr, OPT_CLIENT},
+    {"record", 1, nullptr, OPT_RECORD},
+    {"replay", 1, nullptr, OPT_REPLAY},
+    {"bench", 1, nullptr, OPT_BENCH},
+    {"trace", 2, nullptr, OPT_TRACE},
+    {nullptr, 0, nullptr, 0}};
 
 void setup_inotify() {
 #ifdef HAVE_SYS_INOTIFY_H
@@ -2092,6 +3021,7 @@ void initialisation(int argc, char **argv) {
 
   set_current_config();
   load_config_file();
+  conky::profile::startup_mark("config file");
 
   /* handle other command line arguments */
 
@@ -2157,6 +3087,7 @@ void initialisation(int argc, char **argv) {
 #endif
 #endif /* BUILD_X11 */
       case 't':
+        text_from_command_line = true;
         free_and_zero(global_text);
         global_text = strndup(optarg, max_user_text.get(*state));
         convert_escapes(global_text);
@@ -2178,6 +3109,22 @@ void initialisation(int argc, char **argv) {
         }
         total_run_times.lua_set(*state);
         break;
+
+      case OPT_BENCH:
+        state->pushinteger(strtol(optarg, &conv_end, 10));
+        if (*conv_end != 0 || state->tointeger(-1) <= 0) {
+          CRIT_ERR(nullptr, nullptr, "'%s' is a wrong number of frames",
+                   optarg);
+        }
+        conky::set_bench_frames(state->tointeger(-1));
+        total_run_times.lua_set(*state);
+        conky::profile::keep_all_samples();
+#ifdef BUILD_X11
+        /* there is no window, so nothing may be laid out for one */
+        state->pushboolean(false);
+        out_to_x.lua_set(*state);
+#endif /* BUILD_X11 */
+        break;
 #ifdef BUILD_X11
       case 'x':
         state->pushinteger(strtol(optarg, &conv_end, 10));
@@ -2210,6 +3157,7 @@ void initialisation(int argc, char **argv) {
   }
 
   conky::set_config_settings(*state);
+  conky::profile::startup_mark("settings");
 
 #ifdef BUILD_GUI
   if (out_to_x.get(*state)) { current_text_color = default_color.get(*state); }
@@ -2218,6 +3166,8 @@ void initialisation(int argc, char **argv) {
   /* generate text and get initial size */
   extract_variable_text(global_text);
   free_and_zero(global_text);
+  register_shared_updaters();
+  conky::profile::startup_mark("text objects");
   /* fork */
   if (fork_to_background.get(*state) && (first_pass != 0)) {
     int pid = fork();
@@ -2244,16 +3194,14 @@ void initialisation(int argc, char **argv) {
     }
   }
 
-  text_buffer = new char[max_user_text.get(*state)];
-  memset(text_buffer, 0, max_user_text.get(*state));
-  tmpstring1 = new char[text_buffer_size.get(*state)];
-  memset(tmpstring1, 0, text_buffer_size.get(*state));
+  resize_text_buffer(max_user_text.get(*state));
   tmpstring2 = new char[text_buffer_size.get(*state)];
   memset(tmpstring2, 0, text_buffer_size.get(*state));
 
   if (!conky::initialize_display_outputs()) {
     CRIT_ERR(nullptr, nullptr, "initialize_display_outputs() failed.");
   }
+  conky::profile::startup_mark("display outputs");
 #ifdef BUILD_GUI
   /* setup lua window globals */
   llua_setup_window_table(text_start_x, text_start_y, text_width, text_height);
@@ -2261,6 +3209,9 @@ void initialisation(int argc, char **argv) {
 
   llua_setup_info(&info, active_update_interval());
 
+  /* the handler wakes the reactor, so it must exist before any signal */
+  conky::main_reactor();
+
   /* Set signal handlers */
   act.sa_handler = signal_handler;
   sigemptyset(&act.sa_mask);
@@ -2279,6 +3230,7 @@ void initialisation(int argc, char **argv) {
   }
 
   llua_startup_hook();
+  conky::profile::startup_mark("startup hook");
 }
 
 static void signal_handler(int sig) {
@@ -2307,4 +3259,6 @@ static void signal_handler(int sig) {
        */
       break;
   }
+
+  conky::main_reactor().wake();
 }
@@ -37,6 +37,8 @@
 #include <sys/utsname.h> /* struct uname_s */
 #include <csignal>
 #include <memory>
+#include <utility>
+#include <vector>
 #include "common.h" /* at least for struct dns_data */
 #include "luamm.hh"
 
@@ -146,12 +148,30 @@ char *get_global_text(void);
 extern long global_text_lines;
 
 #define MAX_TEMPLATES 10
+
+/* upper bound of the num argument of ${top*}. Only as many processes as the
+ * configs ask for are selected, so raising it costs little. */
+#ifndef MAX_SP
+#define MAX_SP 100
+#endif
 char **get_templates(void);
 
 /* get_battery_stuff() item selector
  * needed by conky.c, linux.c and freebsd.c */
 enum { BATTERY_STATUS, BATTERY_TIME };
 
+/* the size of a cache line, to keep apart data written by different threads */
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+/*
+ * The sections below marked with a legacy_state flag (see text_object.h) are
+ * each written by the updaters of that flag, under its lock, and those of
+ * different flags run at the same time in the callback pool. Every section
+ * starts a cache line of its own so that they don't keep taking the lines
+ * away from each other. run_all_callbacks() waits for all of the updaters
+ * before the text is generated, so a frame reads each section as one
+ * consistent snapshot.
+ */
 struct information {
   unsigned int mask;
 
@@ -162,37 +182,51 @@ struct information {
 
   char freq[10];
 
-  double uptime;
+  /* LEGACY_UPTIME */
+  alignas(CACHE_LINE_SIZE) double uptime;
 
-  /* memory information in kilobytes */
-  unsigned long long mem, memwithbuffers, memavail, memeasyfree, memfree,
-      memmax, memdirty, shmem, legacymem;
+  /* LEGACY_MEMORY, in kilobytes */
+  alignas(CACHE_LINE_SIZE) unsigned long long mem;
+  unsigned long long memwithbuffers, memavail, memeasyfree, memfree, memmax,
+      memdirty, shmem, legacymem;
   unsigned long long swap, swapfree, swapmax;
   unsigned long long bufmem, buffers, cached, free_bufcache;
 
-  unsigned short procs;
+  /* LEGACY_PROCESSES, the running ones are LEGACY_CPU on Linux */
+  alignas(CACHE_LINE_SIZE) unsigned short procs;
   unsigned short run_procs;
   unsigned short threads;
   unsigned short run_threads;
 
-  float *cpu_usage;
+  /* LEGACY_CPU */
+  alignas(CACHE_LINE_SIZE) float *cpu_usage;
   /* struct cpu_stat cpu_summed; what the hell is this? */
   unsigned int cpu_count;
+  /* aggregates of cpus in cpu_usage after the cpus, see cpu_group_slot() */
+  unsigned int cpu_groups;
 
-  float loadavg[3];
+  /* LEGACY_LOADAVG */
+  alignas(CACHE_LINE_SIZE) float loadavg[3];
 
-#ifdef BUILD_XMMS2
-  struct xmms2_s xmms2;
-#endif /* BUILD_XMMS2 */
-  struct usr_info users;
-  struct process *cpu[10];
-  struct process *memu[10];
-  struct process *time[10];
+  /* LEGACY_USERS */
+  alignas(CACHE_LINE_SIZE) struct usr_info users;
+
+  /* LEGACY_TOP */
+  alignas(CACHE_LINE_SIZE) struct process *cpu[MAX_SP];
+  struct process *memu[MAX_SP];
+  struct process *time[MAX_SP];
 #ifdef BUILD_IOSTATS
-  struct process *io[10];
+  struct process *io[MAX_SP];
 #endif /* BUILD_IOSTATS */
   struct process *first_process;
-  unsigned long looped;
+
+#ifdef BUILD_XMMS2
+  /* written by update_xmms2() */
+  alignas(CACHE_LINE_SIZE) struct xmms2_s xmms2;
+#endif /* BUILD_XMMS2 */
+
+  /* the rest is written by the main thread */
+  alignas(CACHE_LINE_SIZE) unsigned long looped;
 
 #ifdef BUILD_X11
   struct x11_info x11;
@@ -278,8 +312,13 @@ enum {
 extern int top_cpu, top_mem, top_time;
 #ifdef BUILD_IOSTATS
 extern int top_io;
+/* whether any ${top*} object shows I/O, which /proc/<pid>/io is only read
+ * for then */
+extern int top_io_fields;
 #endif /* BUILD_IOSTATS */
 extern int top_running;
+/* the largest num argument of any ${top*} object */
+extern int top_depth;
 
 /* struct that has all info to be shared between
  * instances of the same text object */
@@ -292,6 +331,18 @@ extern conky::range_config_setting<double> update_interval;
 extern conky::range_config_setting<double> update_interval_on_battery;
 double active_update_interval();
 
+#ifdef BUILD_GUI
+/* seconds between the frames moving bars and gauges towards their new value
+ * in between updates, 0 to draw once per update */
+extern conky::range_config_setting<double> animation_interval;
+/* whether bars or gauges are still moving, so the graphical outputs should
+ * redraw every animation_interval until the next update */
+bool animating_specials();
+#endif /* BUILD_GUI */
+/* how many times longer the period of callbacks reading the given kind of
+ * source is right now, see callback_base::set_power_source() */
+double power_period_factor(const char *source);
+
 extern conky::simple_config_setting<bool> show_graph_scale;
 extern conky::simple_config_setting<bool> show_graph_range;
 extern conky::simple_config_setting<int> gap_x;
@@ -323,18 +374,44 @@ extern int inotify_fd;
  * evaluates 'text' and places the result in 'p' of max length 'p_max_size'
  */
 void evaluate(const char *text, char *p, int p_max_size);
+/* If text is a single meter or percentage object, store its value without
+ * printing it and return true. */
+bool evaluate_value(const char *text, double *value);
 
 void parse_conky_vars(struct text_object *, const char *, char *, int);
 
 void extract_object_args_to_sub(struct text_object *, const char *);
 
-void generate_text_internal(char *, int, struct text_object);
+void generate_text_internal(char *, int, const struct text_object &);
+
+enum text_case { TEXT_CASE_KEEP, TEXT_CASE_UPPER, TEXT_CASE_LOWER };
+
+/* Folds the case of the zero-terminated s in place, like toupper() or
+ * tolower() on every byte would. */
+void fold_text_case(char *s, enum text_case fold);
+
+/* Copies src to dst of size bytes, breaking lines after width characters
+ * (a UTF-8 sequence counts as one) and folding the case on the way. Returns
+ * false if it didn't fit; dst holds as much as did then. */
+bool wrap_text(const char *src, char *dst, size_t size, unsigned int width,
+               enum text_case fold);
 
 void update_text_area();
 void draw_stuff();
 
+/* the memory held by the text objects of conky.text, for ${conky_mem};
+ * count is set to their number */
+size_t text_memory(size_t *count);
+
+#ifdef BUILD_GUI
+/* Fills bands with the [top, bottom) window rows of the lines that changed
+ * since the text was last drawn. Returns false if everything has to be
+ * redrawn (first frame, different layout or size, lua draw hooks, images). */
+bool get_text_damage(std::vector<std::pair<int, int>> &bands);
+#endif /* BUILD_GUI */
+
 int percent_print(char *, int, unsigned);
-void human_readable(long long, char *, int);
+int human_readable(long long, char *, int);
 
 #ifdef BUILD_X11
 
@@ -390,6 +467,16 @@ extern char **argv_copy;
 
 extern const char *getopt_string;
 extern const struct option longopts[];
+/* long options without a short form */
+enum {
+  OPT_STARTUP_PROFILE = 256,
+  OPT_COLLECTOR,
+  OPT_CLIENT,
+  OPT_RECORD,
+  OPT_REPLAY,
+  OPT_BENCH,
+  OPT_TRACE
+};
 
 extern conky::simple_config_setting<bool> out_to_stdout;
 extern conky::simple_config_setting<bool> out_to_stderr;
@@ -37,6 +37,7 @@
 #include "diskio.h"
 #include "entropy.h"
 #include "exec.h"
+#include "file-watch.hh"
 #include "i8k.h"
 #include "misc.h"
 #include "text_object.h"
@@ -71,13 +72,17 @@
 #include "mixer.h"
 #include "nc.h"
 #include "net_stat.h"
-#ifdef BUILD_NVIDIA
+#if defined(BUILD_NVIDIA) || defined(BUILD_NVML)
 #include "nvidia.h"
-#endif /* BUILD_NVIDIA */
+#endif /* BUILD_NVIDIA || BUILD_NVML */
 #include <inttypes.h>
 #include "cpu.h"
+#include "memory-usage.hh"
+#include "profiling.hh"
 #include "read_tcpip.h"
+#include "remote.h"
 #include "scroll.h"
+#include "shared-info.hh"
 #include "specials.h"
 #include "tailhead.h"
 #include "temphelper.h"
@@ -110,7 +115,9 @@
 
 /* check for OS and include appropriate headers */
 #if defined(__linux__)
+#include "cgroup.h"
 #include "linux.h"
+#include "psi.h"
 #elif defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
 #include "freebsd.h"
 #elif defined(__DragonFly__)
@@ -123,8 +130,11 @@
 
 #define STRNDUP_ARG strndup(arg ? arg : "", text_buffer_size.get(*state))
 
+#include <algorithm>
 #include <cctype>
+#include <cmath>
 #include <cstring>
+#include <type_traits>
 
 /* strip a leading /dev/ if any, following symlinks first
  *
@@ -145,12 +155,31 @@ const char *dev_name(const char *path) {
 #undef DEV_NAME
 }
 
+/* only called while parsing, the object goes with the arena of the text */
 static struct text_object *new_text_object_internal() {
-  auto *obj = static_cast<text_object *>(malloc(sizeof(struct text_object)));
-  memset(obj, 0, sizeof(struct text_object));
-  return obj;
+  return static_cast<text_object *>(
+      conky::text_arena::current->allocate(sizeof(struct text_object)));
 }
 
+namespace {
+/* Sets up the arena for the objects of the text parsed into root while it
+ * exists: a new one if root is parsed on its own, otherwise the one of the
+ * text being parsed. */
+class text_arena_scope {
+  conky::text_arena *outer;
+
+ public:
+  text_arena_scope(struct text_object *root, bool own_arena)
+      : outer(conky::text_arena::current) {
+    if (own_arena || outer == nullptr) {
+      root->arena = new conky::text_arena;
+      conky::text_arena::current = root->arena;
+    }
+  }
+  ~text_arena_scope() { conky::text_arena::current = outer; }
+};
+}  // namespace
+
 static struct text_object *create_plain_text(const char *s) {
   struct text_object *obj;
 
@@ -359,11 +388,168 @@ void stock_parse_arg(struct text_object *obj, const char *arg) {
 }
 #endif /* BUILD_CURL */
 
-legacy_cb_handle *create_cb_handle(int (*fn)()) {
-  if (fn != nullptr) {
-    return new legacy_cb_handle(conky::register_cb<legacy_cb>(1, fn));
+/*
+ * What the legacy update functions read and write. Functions not listed here
+ * only write their own private state, so they can run concurrently with
+ * anything. A function reading the same source as another one, only to
+ * publish part of the same result, is registered as an alias of it so it
+ * doesn't run twice per update.
+ */
+struct legacy_updater {
+  int (*fn)();
+  int (*alias)();     /* run this one instead, if set */
+  const char *name;   /* of the function to run, for ${conky_profile} */
+  const char *source; /* where the function reads from */
+  uint32_t writes;    /* legacy_state flags */
+  const char *power;  /* see callback_base::set_power_source() */
+};
+
+#define LEGACY_UPDATER(fn, source, writes) \
+  { &fn, nullptr, #fn, source, writes, nullptr }
+#define LEGACY_ALIAS(fn, alias, source, writes) \
+  { &fn, &alias, #alias, source, writes, nullptr }
+#define LEGACY_COSTLY(fn, source, writes, power) \
+  { &fn, nullptr, #fn, source, writes, power }
+
+static const legacy_updater legacy_updaters[] = {
+#ifdef __linux__
+    LEGACY_UPDATER(update_stat, "/proc/stat", LEGACY_CPU),
+    LEGACY_ALIAS(update_cpu_usage, update_stat, "/proc/stat", LEGACY_CPU),
+    LEGACY_ALIAS(update_running_processes, update_stat, "/proc/stat",
+                 LEGACY_CPU),
+#else
+    LEGACY_UPDATER(update_cpu_usage, "cpu times", LEGACY_CPU),
+    LEGACY_UPDATER(update_running_processes, "process list",
+                   LEGACY_PROCESSES),
+#endif /* __linux__ */
+    LEGACY_UPDATER(update_total_processes, "process list", LEGACY_PROCESSES),
+    LEGACY_UPDATER(update_threads, "/proc/loadavg", LEGACY_PROCESSES),
+    LEGACY_COSTLY(update_top, "/proc/<pid>", LEGACY_TOP | LEGACY_PROCESSES,
+                  "top"),
+    LEGACY_UPDATER(update_meminfo, "/proc/meminfo", LEGACY_MEMORY),
+    LEGACY_UPDATER(update_net_stats, "/proc/net/dev", LEGACY_NET),
+    LEGACY_UPDATER(update_diskio, "/proc/diskstats", LEGACY_DISKIO),
+    LEGACY_UPDATER(update_load_average, "/proc/loadavg", LEGACY_LOADAVG),
+    LEGACY_UPDATER(update_uptime, "/proc/uptime", LEGACY_UPTIME),
+#if defined(__linux__)
+    LEGACY_UPDATER(update_users, "utmp", LEGACY_USERS),
+#endif /* __linux__ */
+};
+
+#undef LEGACY_UPDATER
+#undef LEGACY_ALIAS
+#undef LEGACY_COSTLY
+
+/* The slot in info.cpu_usage named at the start of arg, which is moved past
+ * it: "cpuN", or on Linux an aggregate like "socketN", see cpu_group_slot().
+ * 0, all cpus, if there is none. */
+static int scan_cpu_arg(const char *&arg) {
+  int n = 0;
+  int offset = 0;
+
+  if (arg == nullptr) { return 0; }
+  if (sscanf(arg, " cpu%d %n", &n, &offset) > 0) {
+    arg += offset;
+    return n;
+  }
+#ifdef __linux__
+  char kind[8];
+  if (sscanf(arg, " %7[a-z]%d %n", kind, &n, &offset) == 2 && offset > 0) {
+    int slot = cpu_group_slot(kind, n);
+    if (slot >= 0) {
+      arg += offset;
+      return slot;
+    }
+  }
+#endif /* __linux__ */
+  return 0;
+}
+
+legacy_cb_handle *create_cb_handle(int (*fn)(), double interval,
+                                   bool on_demand) {
+  if (fn == nullptr) { return nullptr; }
+
+  uint32_t writes = 0;
+  const char *name = "legacy_cb";
+  const char *power = nullptr;
+  for (const auto &u : legacy_updaters) {
+    if (u.fn == fn) {
+      if (u.alias != nullptr) { fn = u.alias; }
+      name = u.name;
+      writes = u.writes;
+      power = u.power;
+      break;
+    }
+  }
+  if (interval < 0) { interval = 0; }
+
+  /* all objects sharing an update function get the shortest of their
+   * periods, see callback_base::merge() */
+  return new legacy_cb_handle(
+      conky::register_cb<legacy_cb>(interval, fn, writes, name, on_demand,
+                                    power));
+}
+
+/* the updaters a collector runs for its clients, see shared-info.hh */
+static std::vector<std::unique_ptr<legacy_cb_handle>> shared_updaters;
+
+void register_shared_updaters() {
+  shared_updaters.clear();
+  if (conky::get_shared_info_mode() != conky::shared_info_mode::collector) {
+    return;
+  }
+  for (const auto &u : legacy_updaters) {
+    if (u.alias != nullptr || (u.writes & ~conky::shared_info_groups) != 0) {
+      continue;
+    }
+    /* the clients need them whatever the collector shows */
+    shared_updaters.emplace_back(create_cb_handle(u.fn, -1, false));
+  }
+}
+
+void free_shared_updaters() { shared_updaters.clear(); }
+
+const char *take_interval_arg(const char *arg, std::string &rest,
+                              double &interval) {
+  interval = -1;
+  if (arg == nullptr) { return arg; }
+
+  const char *word = strrchr(arg, ' ');
+  word = word != nullptr ? word + 1 : arg;
+  if (strncmp(word, "interval=", 9) != 0) { return arg; }
+
+  char *end;
+  double value = strtod(word + 9, &end);
+  if (end == word + 9 || *end != '\0' || value < 0) {
+    NORM_ERR("invalid interval '%s', using the default", word + 9);
+    value = -1;
+  }
+  interval = value;
+
+  rest.assign(arg, word - arg);
+  while (!rest.empty() && rest.back() == ' ') { rest.pop_back(); }
+  return rest.empty() ? nullptr : rest.c_str();
+}
+
+/* only objects with an update function take an interval argument */
+static const char *updater_arg(int (*fn)(), const char *arg, std::string &rest,
+                               double &interval) {
+  if (fn == nullptr) {
+    interval = -1;
+    return arg;
+  }
+  return take_interval_arg(arg, rest, interval);
+}
+
+/* FNV-1a. The object names below are hashed at compile time, so finding
+ * the constructor of a variable compares one number per candidate and runs
+ * strcmp() only on the one whose hash matches. */
+static constexpr uint32_t obj_name_hash(const char *s) {
+  uint32_t h = 2166136261u;
+  for (; *s != '\0'; ++s) {
+    h = (h ^ static_cast<unsigned char>(*s)) * 16777619u;
   }
-  { return nullptr; }
+  return h;
 }
 
 /* construct_text_object() creates a new text_object */
@@ -372,18 +558,24 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
                                           void *free_at_crash) {
   // struct text_object *obj = new_text_object();
   struct text_object *obj = new_text_object_internal();
+  std::string interval_rest;
+  double interval = -1;
+  const uint32_t s_hash = obj_name_hash(s);
 
   obj->line = line;
 
 /* helper defines for internal use only */
-#define __OBJ_HEAD(a, n) \
-  if (!strcmp(s, #a)) {  \
-    obj->cb_handle = create_cb_handle(n);
+#define __OBJ_HEAD(a, n)                                                  \
+  if (s_hash ==                                                           \
+          std::integral_constant<uint32_t, obj_name_hash(#a)>::value &&   \
+      !strcmp(s, #a)) {                                                   \
+    arg = updater_arg(n, arg, interval_rest, interval);                   \
+    obj->cb_handle = create_cb_handle(n, interval);
 #define __OBJ_IF obj_be_ifblock_if(ifblock_opaque, obj)
-#define __OBJ_ARG(...)                         \
-  if (!arg) {                                  \
-    free(s);                                   \
-    CRIT_ERR(obj, free_at_crash, __VA_ARGS__); \
+#define __OBJ_ARG(...)                             \
+  if (!arg) {                                      \
+    free(s);                                       \
+    CRIT_ERR(nullptr, free_at_crash, __VA_ARGS__); \
   }
 
 /* defines to be used below */
@@ -428,7 +620,11 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.print = &print_acpiacadapter;
   obj->callbacks.free = &gen_free_opaque;
 #endif /* !__OpenBSD__ */
+#ifdef __linux__
+  END OBJ(freq, &update_cpu_freq) get_cpu_count();
+#else
   END OBJ(freq, nullptr) get_cpu_count();
+#endif /* __linux__ */
   if ((arg == nullptr) || strlen(arg) >= 3 ||
       strtol(&arg[0], nullptr, 10) == 0 ||
       static_cast<unsigned int>(strtol(&arg[0], nullptr, 10)) >
@@ -440,7 +636,11 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
     obj->data.i = strtol(&arg[0], nullptr, 10);
   }
   obj->callbacks.print = &print_freq;
+#ifdef __linux__
+  END OBJ(freq_g, &update_cpu_freq) get_cpu_count();
+#else
   END OBJ(freq_g, nullptr) get_cpu_count();
+#endif /* __linux__ */
   if ((arg == nullptr) || strlen(arg) >= 3 ||
       strtol(&arg[0], nullptr, 10) == 0 ||
       static_cast<unsigned int>(strtol(&arg[0], nullptr, 10)) >
@@ -453,6 +653,10 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   }
   obj->callbacks.print = &print_freq_g;
 #if defined(__linux__)
+  END OBJ(cpu_cycles, &update_cpu_perf) parse_cpu_perf_arg(obj, arg);
+  obj->callbacks.print = &print_cpu_cycles;
+  END OBJ(cpu_ipc, &update_cpu_perf) parse_cpu_perf_arg(obj, arg);
+  obj->callbacks.print = &print_cpu_ipc;
   END OBJ(cpugovernor, nullptr) get_cpu_count();
   if ((arg == nullptr) || strlen(arg) >= 3 ||
       strtol(&arg[0], nullptr, 10) == 0 ||
@@ -468,14 +672,19 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #endif /* __linux__ */
   END OBJ_ARG(read_tcp, nullptr,
               "read_tcp: Needs \"(host) port\" as argument(s)")
-      parse_read_tcpip_arg(obj, arg, free_at_crash);
+      parse_read_tcpip_arg(obj, arg, free_at_crash, IPPROTO_TCP);
   obj->callbacks.print = &print_read_tcp;
   obj->callbacks.free = &free_read_tcpip;
   END OBJ_ARG(read_udp, nullptr,
               "read_udp: Needs \"(host) port\" as argument(s)")
-      parse_read_tcpip_arg(obj, arg, free_at_crash);
+      parse_read_tcpip_arg(obj, arg, free_at_crash, IPPROTO_UDP);
   obj->callbacks.print = &print_read_udp;
   obj->callbacks.free = &free_read_tcpip;
+  END OBJ_ARG(remote, nullptr,
+              "remote needs arguments: <host:port|socket path> <n>")
+      parse_remote_arg(obj, arg, free_at_crash);
+  obj->callbacks.print = &print_remote;
+  obj->callbacks.free = &free_remote;
   END OBJ_ARG(tcp_ping, nullptr,
               "tcp_ping: Needs \"host (port)\" as argument(s)")
       parse_tcp_ping_arg(obj, arg, free_at_crash);
@@ -508,34 +717,34 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #ifdef BUILD_WLAN
   END OBJ(wireless_essid, &update_net_stats) obj->data.opaque =
       get_net_stat(arg, obj, free_at_crash);
-  parse_net_stat_arg(obj, arg, free_at_crash);
+  parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_essid;
   END OBJ(wireless_channel, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_channel;
   END OBJ(wireless_freq, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_frequency;
   END OBJ(wireless_mode, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_mode;
   END OBJ(wireless_bitrate, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_bitrate;
   END OBJ(wireless_ap, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_ap;
   END OBJ(wireless_link_qual, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_link_qual;
   END OBJ(wireless_link_qual_max, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_link_qual_max;
   END OBJ(wireless_link_qual_perc, &update_net_stats)
-      parse_net_stat_arg(obj, arg, free_at_crash);
+      parse_wireless_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_wireless_link_qual_perc;
   END OBJ(wireless_link_bar, &update_net_stats)
-      parse_net_stat_bar_arg(obj, arg, free_at_crash);
+      parse_wireless_bar_arg(obj, arg, free_at_crash);
   obj->callbacks.barval = &wireless_link_barval;
 #endif /* BUILD_WLAN */
 
@@ -632,17 +841,22 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(i8k_buttons_status, &update_i8k) obj->callbacks.print =
       &print_i8k_buttons_status;
 #if defined(BUILD_IBM)
-  END OBJ(ibm_fan, 0) obj->callbacks.print = &get_ibm_acpi_fan;
+  END OBJ(ibm_fan, &update_ibm_acpi_fan) obj->callbacks.print =
+      &get_ibm_acpi_fan;
   END OBJ_ARG(ibm_temps, &get_ibm_acpi_temps, "ibm_temps: needs an argument")
       parse_ibm_temps_arg(obj, arg);
   obj->callbacks.print = &print_ibm_temps;
-  END OBJ(ibm_volume, 0) obj->callbacks.print = &get_ibm_acpi_volume;
-  END OBJ(ibm_brightness, 0) obj->callbacks.print = &get_ibm_acpi_brightness;
-  END OBJ(ibm_thinklight, 0) obj->callbacks.print = &get_ibm_acpi_thinklight;
+  END OBJ(ibm_volume, &update_ibm_acpi_volume) obj->callbacks.print =
+      &get_ibm_acpi_volume;
+  END OBJ(ibm_brightness, &update_ibm_acpi_brightness) obj->callbacks.print =
+      &get_ibm_acpi_brightness;
+  END OBJ(ibm_thinklight, &update_ibm_acpi_thinklight) obj->callbacks.print =
+      &get_ibm_acpi_thinklight;
 #endif
   /* information from sony_laptop kernel module
    * /sys/devices/platform/sony-laptop */
-  END OBJ(sony_fanspeed, 0) obj->callbacks.print = &get_sony_fanspeed;
+  END OBJ(sony_fanspeed, &update_sony_fanspeed) obj->callbacks.print =
+      &get_sony_fanspeed;
   END OBJ_ARG(ioscheduler, 0, "get_ioscheduler needs an argument (e.g. hda)")
       obj->data.s = strndup(dev_name(arg), text_buffer_size.get(*state));
   obj->callbacks.print = &print_ioscheduler;
@@ -689,34 +903,26 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(obsd_product, 0) obj->callbacks.print = &get_obsd_product;
 #endif /* __OpenBSD__ */
   END OBJ(buffers, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_buffers;
+  obj->callbacks.print_len = &print_buffers;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(cached, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_cached;
+  obj->callbacks.print_len = &print_cached;
   obj->callbacks.free = &gen_free_opaque;
-#define SCAN_CPU(__arg, __var)                                          \
-  {                                                                     \
-    int __offset = 0;                                                   \
-    if ((__arg) && sscanf(__arg, " cpu%d %n", &(__var), &__offset) > 0) \
-      (__arg) += __offset;                                              \
-    else                                                                \
-      (__var) = 0;                                                      \
-  }
   END OBJ(cpu, &update_cpu_usage) get_cpu_count();
-  SCAN_CPU(arg, obj->data.i);
+  obj->data.i = scan_cpu_arg(arg);
   obj->callbacks.percentage = &cpu_percentage;
   obj->callbacks.free = &free_cpu;
   DBGP2("Adding $cpu for CPU %d", obj->data.i);
 #ifdef BUILD_GUI
   END OBJ(cpugauge, &update_cpu_usage) get_cpu_count();
-  SCAN_CPU(arg, obj->data.i);
+  obj->data.i = scan_cpu_arg(arg);
   scan_gauge(obj, arg, 1);
   obj->callbacks.gaugeval = &cpu_barval;
   obj->callbacks.free = &free_cpu;
   DBGP2("Adding $cpugauge for CPU %d", obj->data.i);
 #endif
   END OBJ(cpubar, &update_cpu_usage) get_cpu_count();
-  SCAN_CPU(arg, obj->data.i);
+  obj->data.i = scan_cpu_arg(arg);
   scan_bar(obj, arg, 1);
   obj->callbacks.barval = &cpu_barval;
   obj->callbacks.free = &free_cpu;
@@ -724,21 +930,24 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #ifdef BUILD_GUI
   END OBJ(cpugraph, &update_cpu_usage) get_cpu_count();
   char *buf = nullptr;
-  SCAN_CPU(arg, obj->data.i);
+  obj->data.i = scan_cpu_arg(arg);
   buf = scan_graph(obj, arg, 1);
   DBGP2("Adding $cpugraph for CPU %d", obj->data.i);
   free_and_zero(buf);
   obj->callbacks.graphval = &cpu_barval;
   obj->callbacks.free = &free_cpu;
+  END OBJ(cpuheatmap, &update_cpu_usage) get_cpu_count();
+  scan_heatmap(obj, arg);
+  obj->callbacks.print = &print_cpuheatmap;
   END OBJ(loadgraph, &update_load_average) scan_loadgraph_arg(obj, arg);
   obj->callbacks.graphval = &loadgraphval;
 #endif /* BUILD_GUI */
   END OBJ(diskio, &update_diskio) parse_diskio_arg(obj, arg);
-  obj->callbacks.print = &print_diskio;
+  obj->callbacks.print_len = &print_diskio;
   END OBJ(diskio_read, &update_diskio) parse_diskio_arg(obj, arg);
-  obj->callbacks.print = &print_diskio_read;
+  obj->callbacks.print_len = &print_diskio_read;
   END OBJ(diskio_write, &update_diskio) parse_diskio_arg(obj, arg);
-  obj->callbacks.print = &print_diskio_write;
+  obj->callbacks.print_len = &print_diskio_write;
 #ifdef BUILD_GUI
   END OBJ(diskiograph, &update_diskio) parse_diskiograph_arg(obj, arg);
   obj->callbacks.graphval = &diskiographval;
@@ -848,12 +1057,16 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(conky_version, nullptr) obj_be_plain_text(obj, VERSION);
   END OBJ(conky_build_date, nullptr) obj_be_plain_text(obj, BUILD_DATE);
   END OBJ(conky_build_arch, nullptr) obj_be_plain_text(obj, BUILD_ARCH);
+  END OBJ(conky_profile, nullptr) parse_conky_profile_arg(obj, arg);
+  obj->callbacks.print = &print_conky_profile;
+  END OBJ(conky_mem, nullptr) parse_conky_mem_arg(obj, arg);
+  obj->callbacks.print = &print_conky_mem;
   END OBJ(downspeed, &update_net_stats)
       parse_net_stat_arg(obj, arg, free_at_crash);
-  obj->callbacks.print = &print_downspeed;
+  obj->callbacks.print_len = &print_downspeed;
   END OBJ(downspeedf, &update_net_stats)
       parse_net_stat_arg(obj, arg, free_at_crash);
-  obj->callbacks.print = &print_downspeedf;
+  obj->callbacks.print_len = &print_downspeedf;
 #ifdef BUILD_GUI
   END OBJ(downspeedgraph, &update_net_stats)
       parse_net_stat_graph_arg(obj, arg, free_at_crash);
@@ -879,9 +1092,9 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
       scan_no_update(obj, arg);
   obj->callbacks.print = &print_no_update;
   obj->callbacks.free = &free_no_update;
-  END OBJ(cat, 0) obj->data.s = STRNDUP_ARG;
+  END OBJ(cat, 0) scan_watched_file(obj, arg);
   obj->callbacks.print = &print_cat;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &free_watched_file;
 
 #ifdef BUILD_GUI
   END OBJ(key_num_lock, 0) obj->callbacks.print = &print_key_num_lock;
@@ -921,9 +1134,9 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(rstrip, 0) obj->data.s = STRNDUP_ARG;
   obj->callbacks.print = &strip_trailing_whitespace;
   obj->callbacks.free = &gen_free_opaque;
-  END OBJ(catp, 0) obj->data.s = STRNDUP_ARG;
+  END OBJ(catp, 0) scan_watched_file(obj, arg);
   obj->callbacks.print = &print_catp;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &free_watched_file;
   END OBJ_ARG(exec, nullptr, "exec needs arguments: <command>")
       scan_exec_arg(obj, arg, EF_EXEC);
   obj->parse = false;
@@ -952,6 +1165,23 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   register_execi(obj);
   obj->callbacks.print = &print_exec;
   obj->callbacks.free = &free_execi;
+  END OBJ_ARG(execstream, nullptr, "execstream needs arguments: <command>")
+      scan_execstream(obj, arg);
+  obj->callbacks.print = &print_execstream;
+  obj->callbacks.free = &free_execstream;
+  END OBJ_ARG(execmulti, nullptr,
+              "execmulti needs arguments: <interval> <name> <command>")
+      scan_execmulti(obj, arg);
+  obj->callbacks.free = &free_execmulti;
+  END OBJ_ARG(execval, nullptr, "execval needs arguments: <name> <key>")
+      scan_execval(obj, arg, 0);
+  obj->callbacks.print = &print_execval;
+  obj->callbacks.free = &free_execval;
+  END OBJ_ARG(execvalbar, nullptr,
+              "execvalbar needs arguments: [height],[width] <name> <key>")
+      scan_execval(obj, arg, EF_BAR);
+  obj->callbacks.barval = &execvalbarval;
+  obj->callbacks.free = &free_execval;
   END OBJ_ARG(execbar, nullptr,
               "execbar needs arguments: [height],[width] <command>")
       scan_exec_arg(obj, arg, EF_EXEC | EF_BAR);
@@ -992,6 +1222,12 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   register_execi(obj);
   obj->callbacks.graphval = &execbarval;
   obj->callbacks.free = &free_execi;
+  END OBJ_ARG(execvalgraph, nullptr,
+              "execvalgraph needs arguments: <name> <key> [height],[width] "
+              "[color1] [color2] [scale] [-t|-l]")
+      scan_execval(obj, arg, EF_GRAPH);
+  obj->callbacks.graphval = &execvalbarval;
+  obj->callbacks.free = &free_execval;
 #endif /* BUILD_GUI */
   END OBJ_ARG(texeci, nullptr, "texeci needs arguments: <interval> <command>")
       scan_exec_arg(obj, arg, EF_EXECI);
@@ -1007,21 +1243,21 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   register_execi(obj);
   obj->callbacks.print = &print_exec;
   obj->callbacks.free = &free_execi;
-  END OBJ(fs_bar, &update_fs_stats) init_fs_bar(obj, arg);
+  END OBJ(fs_bar, nullptr) init_fs_bar(obj, arg);
   obj->callbacks.barval = &fs_barval;
-  END OBJ(fs_bar_free, &update_fs_stats) init_fs_bar(obj, arg);
+  END OBJ(fs_bar_free, nullptr) init_fs_bar(obj, arg);
   obj->callbacks.barval = &fs_free_barval;
-  END OBJ(fs_free, &update_fs_stats) init_fs(obj, arg);
+  END OBJ(fs_free, nullptr) init_fs(obj, arg);
   obj->callbacks.print = &print_fs_free;
-  END OBJ(fs_used_perc, &update_fs_stats) init_fs(obj, arg);
+  END OBJ(fs_used_perc, nullptr) init_fs(obj, arg);
   obj->callbacks.percentage = &fs_used_percentage;
-  END OBJ(fs_free_perc, &update_fs_stats) init_fs(obj, arg);
+  END OBJ(fs_free_perc, nullptr) init_fs(obj, arg);
   obj->callbacks.percentage = &fs_free_percentage;
-  END OBJ(fs_size, &update_fs_stats) init_fs(obj, arg);
+  END OBJ(fs_size, nullptr) init_fs(obj, arg);
   obj->callbacks.print = &print_fs_size;
-  END OBJ(fs_type, &update_fs_stats) init_fs(obj, arg);
+  END OBJ(fs_type, nullptr) init_fs(obj, arg);
   obj->callbacks.print = &print_fs_type;
-  END OBJ(fs_used, &update_fs_stats) init_fs(obj, arg);
+  END OBJ(fs_used, nullptr) init_fs(obj, arg);
   obj->callbacks.print = &print_fs_used;
 #ifdef BUILD_GUI
   END OBJ(hr, nullptr) obj->data.l =
@@ -1058,6 +1294,23 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ_ARG(hwmon, 0, "hwmon needs argumanets") parse_hwmon_sensor(obj, arg);
   obj->callbacks.print = &print_sysfs_sensor;
   obj->callbacks.free = &free_sysfs_sensor;
+  END OBJ(cgroup_cpu, nullptr) parse_cgroup_arg(obj, arg, CGROUP_CPU);
+  obj->callbacks.percentage = &cgroup_percentage;
+  obj->callbacks.free = &free_cgroup;
+  END OBJ(cgroup_mem, nullptr) parse_cgroup_arg(obj, arg, CGROUP_MEM);
+  obj->callbacks.print = &print_cgroup_bytes;
+  obj->callbacks.free = &free_cgroup;
+  END OBJ(cgroup_io, nullptr) parse_cgroup_arg(obj, arg, CGROUP_IO);
+  obj->callbacks.print = &print_cgroup_bytes;
+  obj->callbacks.free = &free_cgroup;
+  END OBJ_ARG(cgroup_pressure, 0, "cgroup_pressure needs a resource")
+      parse_cgroup_pressure_arg(obj, arg);
+  obj->callbacks.percentage = &cgroup_percentage;
+  obj->callbacks.free = &free_cgroup;
+  END OBJ_ARG(pressure, 0, "pressure needs a resource")
+      parse_psi_arg(obj, arg);
+  obj->callbacks.percentage = &psi_percentage;
+  obj->callbacks.free = &free_psi;
 #endif /* __linux__ */
   END
       /* we have four different types of top (top, top_mem, top_time and
@@ -1066,13 +1319,14 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
       /* XXX: maybe fiddle them apart later, as print_top() does
        * nothing else than just that, using an ugly switch(). */
       if (strncmp(s, "top", 3) == EQUAL) {
+    arg = take_interval_arg(arg, interval_rest, interval);
     if (parse_top_args(s, arg, obj) != 0) {
 #ifdef __linux__
       determine_longstat_file();
 #endif
-      obj->cb_handle = create_cb_handle(update_top);
+      obj->cb_handle = create_cb_handle(update_top, interval);
     } else {
-      free(obj);
+      /* the object stays in the arena until the text is freed */
       return nullptr;
     }
   }
@@ -1097,38 +1351,33 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
       init_tailhead("head", arg, obj, free_at_crash);
   obj->callbacks.print = &print_head;
   obj->callbacks.free = &free_tailhead;
-  END OBJ_ARG(lines, nullptr, "lines needs an argument") obj->data.s =
-      STRNDUP_ARG;
+  END OBJ_ARG(lines, nullptr, "lines needs an argument")
+      scan_watched_file(obj, arg);
   obj->callbacks.print = &print_lines;
-  obj->callbacks.free = &gen_free_opaque;
-  END OBJ_ARG(words, nullptr, "words needs a argument") obj->data.s =
-      STRNDUP_ARG;
+  obj->callbacks.free = &free_watched_file;
+  END OBJ_ARG(words, nullptr, "words needs a argument")
+      scan_watched_file(obj, arg);
   obj->callbacks.print = &print_words;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &free_watched_file;
   END OBJ(loadavg, &update_load_average) scan_loadavg_arg(obj, arg);
   obj->callbacks.print = &print_loadavg;
   END OBJ_IF_ARG(if_empty, nullptr, "if_empty needs an argument") obj->sub =
       static_cast<text_object *>(malloc(sizeof(struct text_object)));
   extract_variable_text_internal(obj->sub, arg);
   obj->callbacks.iftest = &if_empty_iftest;
-  END OBJ_IF_ARG(if_match, nullptr, "if_match needs arguments") obj->sub =
-      static_cast<text_object *>(malloc(sizeof(struct text_object)));
-  extract_variable_text_internal(obj->sub, arg);
+  END OBJ_IF_ARG(if_match, nullptr, "if_match needs arguments")
+      parse_if_match(obj, arg);
   obj->callbacks.iftest = &check_if_match;
+  obj->callbacks.free = &free_if_match;
   END OBJ_IF_ARG(if_existing, nullptr, "if_existing needs an argument or two")
-      obj->data.s = STRNDUP_ARG;
+      scan_if_existing(obj, arg);
   obj->callbacks.iftest = &if_existing_iftest;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &free_if_existing;
 #if defined(__linux__) || defined(__FreeBSD__)
   END OBJ_IF_ARG(if_mounted, 0, "if_mounted needs an argument") obj->data.s =
       STRNDUP_ARG;
   obj->callbacks.iftest = &check_mount;
   obj->callbacks.free = &gen_free_opaque;
-  END OBJ_IF_ARG(if_running, &update_top, "if_running needs an argument")
-      top_running = 1;
-  obj->data.s = STRNDUP_ARG;
-  obj->callbacks.iftest = &if_running_iftest;
-  obj->callbacks.free = &gen_free_opaque;
 #elif defined(__APPLE__) && defined(__MACH__)
   END OBJ_IF_ARG(if_mounted, nullptr, "if_mounted needs an argument")
       obj->data.s = STRNDUP_ARG;
@@ -1139,18 +1388,18 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(sip_status, &get_sip_status) obj->data.s = STRNDUP_ARG;
   obj->callbacks.print = &print_sip_status;
   obj->callbacks.free = &gen_free_opaque;
-#else
-  END OBJ_IF_ARG(if_running, 0, "if_running needs an argument")
-
-      char buf[DEFAULT_TEXT_BUFFER_SIZE];
-
-  snprintf(buf, DEFAULT_TEXT_BUFFER_SIZE, "pidof %s >/dev/null", arg);
+#endif
+#if !defined(__APPLE__) || !defined(__MACH__)
+  END OBJ_IF_ARG(if_running, &update_top, "if_running needs an argument")
+      top_running = 1;
   obj->data.s = STRNDUP_ARG;
-  /* XXX: maybe use a different callback here */
   obj->callbacks.iftest = &if_running_iftest;
-#endif
+  obj->callbacks.free = &gen_free_opaque;
+#endif /* !__APPLE__ || !__MACH__ */
   END OBJ(kernel, nullptr) obj->callbacks.print = &print_kernel;
+  obj->generation = &uname_generation;
   END OBJ(machine, nullptr) obj->callbacks.print = &print_machine;
+  obj->generation = &uname_generation;
 #if defined(__DragonFly__)
   END OBJ(version, 0) obj->callbacks.print = &print_version;
 #endif
@@ -1194,36 +1443,36 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.print = &print_mboxscan;
   obj->callbacks.free = &free_mboxscan;
   END OBJ(mem, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_mem;
+  obj->callbacks.print_len = &print_mem;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(legacymem, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_legacymem;
+  obj->callbacks.print_len = &print_legacymem;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(memwithbuffers, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_memwithbuffers;
+  obj->callbacks.print_len = &print_memwithbuffers;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(memeasyfree, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_memeasyfree;
+  obj->callbacks.print_len = &print_memeasyfree;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(memfree, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_memfree;
+  obj->callbacks.print_len = &print_memfree;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(memmax, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_memmax;
+  obj->callbacks.print_len = &print_memmax;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(memperc, &update_meminfo) obj->callbacks.percentage = &mem_percentage;
 #ifdef __linux__
   END OBJ(memdirty, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_memdirty;
+  obj->callbacks.print_len = &print_memdirty;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(memavail, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_memavail;
+  obj->callbacks.print_len = &print_memavail;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(shmem, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_shmem;
+  obj->callbacks.print_len = &print_shmem;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(free_bufcache, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_free_bufcache;
+  obj->callbacks.print_len = &print_free_bufcache;
   obj->callbacks.free = &gen_free_opaque;
 #endif /* __linux__ */
 #ifdef BUILD_GUI
@@ -1272,12 +1521,14 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   extract_variable_text_internal(obj->sub, arg);
   obj->callbacks.print = &print_format_time;
   END OBJ(nodename, nullptr) obj->callbacks.print = &print_nodename;
+  obj->generation = &uname_generation;
   END OBJ(nodename_short, nullptr) obj->callbacks.print = &print_nodename_short;
+  obj->generation = &uname_generation;
   END OBJ_ARG(cmdline_to_pid, nullptr,
               "cmdline_to_pid needs a command line as argument")
       scan_cmdline_to_pid_arg(obj, arg, free_at_crash);
   obj->callbacks.print = &print_cmdline_to_pid;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &free_cmdline_to_pid;
   END OBJ_ARG(pid_chroot, nullptr, "pid_chroot needs a pid as argument")
       extract_object_args_to_sub(obj, arg);
   obj->callbacks.print = &print_pid_chroot;
@@ -1414,27 +1665,28 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #else
   END OBJ(processes, &update_total_processes)
 #endif
-      obj->callbacks.print = &print_processes;
+      obj->callbacks.print_len = &print_processes;
 #ifdef __linux__
   END OBJ(distribution, 0) obj->callbacks.print = &print_distribution;
+  obj->generation = &constant_generation;
   END OBJ(running_processes, &update_top) top_running = 1;
-  obj->callbacks.print = &print_running_processes;
-  END OBJ(threads, &update_threads) obj->callbacks.print = &print_threads;
-  END OBJ(running_threads, &update_stat) obj->callbacks.print =
+  obj->callbacks.print_len = &print_running_processes;
+  END OBJ(threads, &update_threads) obj->callbacks.print_len = &print_threads;
+  END OBJ(running_threads, &update_stat) obj->callbacks.print_len =
       &print_running_threads;
 #else
 #if defined(__DragonFly__)
-  END OBJ(running_processes, &update_top) obj->callbacks.print =
+  END OBJ(running_processes, &update_top) obj->callbacks.print_len =
       &print_running_processes;
 #elif (defined(__APPLE__) && defined(__MACH__))
-  END OBJ(running_processes, &update_running_processes) obj->callbacks.print =
-      &print_running_processes;
-  END OBJ(threads, &update_threads) obj->callbacks.print = &print_threads;
-  END OBJ(running_threads, &update_running_threads) obj->callbacks.print =
+  END OBJ(running_processes, &update_running_processes)
+      obj->callbacks.print_len = &print_running_processes;
+  END OBJ(threads, &update_threads) obj->callbacks.print_len = &print_threads;
+  END OBJ(running_threads, &update_running_threads) obj->callbacks.print_len =
       &print_running_threads;
 #else
-  END OBJ(running_processes, &update_running_processes) obj->callbacks.print =
-      &print_running_processes;
+  END OBJ(running_processes, &update_running_processes)
+      obj->callbacks.print_len = &print_running_processes;
 #endif
 #endif /* __linux__ */
   END OBJ(shadecolor, nullptr)
@@ -1455,13 +1707,13 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.print = &new_stippled_hr;
 #endif /* BUILD_GUI */
   END OBJ(swap, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_swap;
+  obj->callbacks.print_len = &print_swap;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(swapfree, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_swapfree;
+  obj->callbacks.print_len = &print_swapfree;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(swapmax, &update_meminfo) obj->data.s = STRNDUP_ARG;
-  obj->callbacks.print = &print_swapmax;
+  obj->callbacks.print_len = &print_swapmax;
   obj->callbacks.free = &gen_free_opaque;
   END OBJ(swapperc, &update_meminfo) obj->callbacks.percentage =
       &swap_percentage;
@@ -1469,6 +1721,7 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.barval = &swap_barval;
   /* XXX: swapgraph, swapgauge? */
   END OBJ(sysname, nullptr) obj->callbacks.print = &print_sysname;
+  obj->generation = &uname_generation;
   END OBJ(time, nullptr) scan_time(obj, arg);
   obj->callbacks.print = &print_time;
   obj->callbacks.free = &free_time;
@@ -1499,15 +1752,15 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #endif
   END OBJ(totaldown, &update_net_stats)
       parse_net_stat_arg(obj, arg, free_at_crash);
-  obj->callbacks.print = &print_totaldown;
+  obj->callbacks.print_len = &print_totaldown;
   END OBJ(totalup, &update_net_stats)
       parse_net_stat_arg(obj, arg, free_at_crash);
-  obj->callbacks.print = &print_totalup;
+  obj->callbacks.print_len = &print_totalup;
   END OBJ(updates, nullptr) obj->callbacks.print = &print_updates;
   END OBJ_IF(if_updatenr, nullptr) obj->data.i =
       arg != nullptr ? strtol(arg, nullptr, 10) : 0;
   if (obj->data.i == 0) {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "if_updatenr needs a number above 0 as argument");
   }
   set_updatereset(obj->data.i > get_updatereset() ? obj->data.i
@@ -1521,10 +1774,10 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.print = &new_alignc;
   END OBJ(upspeed, &update_net_stats)
       parse_net_stat_arg(obj, arg, free_at_crash);
-  obj->callbacks.print = &print_upspeed;
+  obj->callbacks.print_len = &print_upspeed;
   END OBJ(upspeedf, &update_net_stats)
       parse_net_stat_arg(obj, arg, free_at_crash);
-  obj->callbacks.print = &print_upspeedf;
+  obj->callbacks.print_len = &print_upspeedf;
 #ifdef BUILD_GUI
   END OBJ(upspeedgraph, &update_net_stats)
       parse_net_stat_graph_arg(obj, arg, free_at_crash);
@@ -1538,7 +1791,8 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   obj->callbacks.free = &free_user_names;
   END OBJ(user_times, &update_users) obj->callbacks.print = &print_user_times;
   obj->callbacks.free = &free_user_times;
-  END OBJ_ARG(user_time, 0, "user time needs a console name as argument")
+  END OBJ_ARG(user_time, &update_users,
+              "user time needs a console name as argument")
       obj->data.s = STRNDUP_ARG;
   obj->callbacks.print = &print_user_time;
   obj->callbacks.free = &free_user_time;
@@ -1751,7 +2005,8 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   if (obj->data.i > 0) {
     ++obj->data.i;
   } else {
-    CRIT_ERR(obj, free_at_crash, "audacious_title: invalid length argument");
+    CRIT_ERR(nullptr, free_at_crash,
+             "audacious_title: invalid length argument");
   }
   obj->callbacks.print = &print_audacious_title;
   END OBJ(audacious_length, 0) obj->callbacks.print = &print_audacious_length;
@@ -1793,27 +2048,32 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
 #endif /* BUILD_RSS */
   END OBJ_ARG(lua, nullptr,
               "lua needs arguments: <function name> [function parameters]")
-      obj->data.s = STRNDUP_ARG;
+      llua_parse_call(obj, arg);
   obj->callbacks.print = &print_lua;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
+  END OBJ_ARG(lua_async, nullptr,
+              "lua_async needs arguments: <interval> <function name> "
+              "[function parameters]") scan_lua_async(obj, arg);
+  obj->callbacks.print = &print_lua_async;
+  obj->callbacks.free = &free_lua_async;
   END OBJ_ARG(
       lua_parse, nullptr,
       "lua_parse needs arguments: <function name> [function parameters]")
-      obj->data.s = STRNDUP_ARG;
+      llua_parse_call(obj, arg);
   obj->callbacks.print = &print_lua_parse;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
   END OBJ_ARG(lua_bar, nullptr,
               "lua_bar needs arguments: <height>,<width> <function name> "
               "[function parameters]") arg = scan_bar(obj, arg, 100);
   if (arg != nullptr) {
-    obj->data.s = STRNDUP_ARG;
+    llua_parse_call(obj, arg);
   } else {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "lua_bar needs arguments: <height>,<width> <function name> "
              "[function parameters]");
   }
   obj->callbacks.barval = &lua_barval;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
 #ifdef BUILD_GUI
   END OBJ_ARG(
       lua_graph, nullptr,
@@ -1821,29 +2081,30 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
       "colour 1] [gradient colour 2] [scale] [-t] [-l]") char *buf = nullptr;
   buf = scan_graph(obj, arg, 100);
   if (buf != nullptr) {
-    obj->data.s = buf;
+    llua_parse_call(obj, buf);
+    free(buf);
   } else {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "lua_graph needs arguments: <function name> [height],[width] "
              "[gradient colour 1] [gradient colour 2] [scale] [-t] [-l]");
   }
   obj->callbacks.graphval = &lua_barval;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
   END OBJ_ARG(lua_gauge, nullptr,
               "lua_gauge needs arguments: <height>,<width> <function name> "
               "[function parameters]") arg = scan_gauge(obj, arg, 100);
   if (arg != nullptr) {
-    obj->data.s = STRNDUP_ARG;
+    llua_parse_call(obj, arg);
   } else {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "lua_gauge needs arguments: <height>,<width> <function name> "
              "[function parameters]");
   }
   obj->callbacks.gaugeval = &lua_barval;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->callbacks.free = &llua_free_call;
 #endif /* BUILD_GUI */
 #ifdef BUILD_HDDTEMP
-  END OBJ(hddtemp, &update_hddtemp) if (arg) obj->data.s = STRNDUP_ARG;
+  END OBJ(hddtemp, nullptr) parse_hddtemp_arg(obj, arg);
   obj->callbacks.print = &print_hddtemp;
   obj->callbacks.free = &free_hddtemp;
 #endif /* BUILD_HDDTEMP */
@@ -1884,16 +2145,15 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ(combine, nullptr) try {
     parse_combine_arg(obj, arg);
   } catch (combine_needs_2_args_error &e) {
-    free(obj);
     throw obj_create_error(e.what());
   }
   obj->callbacks.print = &print_combine;
   obj->callbacks.free = &free_combine;
-#ifdef BUILD_NVIDIA
+#if defined(BUILD_NVIDIA) || defined(BUILD_NVML)
   END OBJ_ARG(
       nvidia, 0,
       "nvidia needs an argument") if (set_nvidia_query(obj, arg, NONSPECIAL)) {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "nvidia: invalid argument"
              " specified: '%s'",
              arg);
@@ -1903,17 +2163,18 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ_ARG(
       nvidiabar, 0,
       "nvidiabar needs an argument") if (set_nvidia_query(obj, arg, BAR)) {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "nvidiabar: invalid argument"
              " specified: '%s'",
              arg);
   }
   obj->callbacks.barval = &get_nvidia_barval;
   obj->callbacks.free = &free_nvidia;
+#ifdef BUILD_GUI
   END OBJ_ARG(
       nvidiagraph, 0,
       "nvidiagraph needs an argument") if (set_nvidia_query(obj, arg, GRAPH)) {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "nvidiagraph: invalid argument"
              " specified: '%s'",
              arg);
@@ -1923,53 +2184,44 @@ struct text_object *construct_text_object(char *s, const char *arg, long line,
   END OBJ_ARG(
       nvidiagauge, 0,
       "nvidiagauge needs an argument") if (set_nvidia_query(obj, arg, GAUGE)) {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "nvidiagauge: invalid argument"
              " specified: '%s'",
              arg);
   }
   obj->callbacks.gaugeval = &get_nvidia_barval;
   obj->callbacks.free = &free_nvidia;
-#endif /* BUILD_NVIDIA */
+#endif /* BUILD_GUI */
+#endif /* BUILD_NVIDIA || BUILD_NVML */
 #ifdef BUILD_APCUPSD
-  END OBJ_ARG(
-      apcupsd, &update_apcupsd,
-      "apcupsd needs arguments: <host> <port>") if (apcupsd_scan_arg(arg) !=
-                                                    0) {
-    CRIT_ERR(obj, free_at_crash, "apcupsd needs arguments: <host> <port>");
+  END OBJ_ARG(apcupsd, nullptr, "apcupsd needs arguments: <host> <port>")
+  if (apcupsd_scan_arg(arg) != 0) {
+    CRIT_ERR(nullptr, free_at_crash, "apcupsd needs arguments: <host> <port>");
   }
   obj->callbacks.print = &gen_print_nothing;
-  END OBJ(apcupsd_name, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_name;
-  END OBJ(apcupsd_model, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_model;
-  END OBJ(apcupsd_upsmode, &update_apcupsd) obj->callbacks.print =
+  END OBJ(apcupsd_name, nullptr) obj->callbacks.print = &print_apcupsd_name;
+  END OBJ(apcupsd_model, nullptr) obj->callbacks.print = &print_apcupsd_model;
+  END OBJ(apcupsd_upsmode, nullptr) obj->callbacks.print =
       &print_apcupsd_upsmode;
-  END OBJ(apcupsd_cable, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_cable;
-  END OBJ(apcupsd_status, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_status;
-  END OBJ(apcupsd_linev, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_linev;
-  END OBJ(apcupsd_load, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_load;
-  END OBJ(apcupsd_loadbar, &update_apcupsd) scan_bar(obj, arg, 100);
+  END OBJ(apcupsd_cable, nullptr) obj->callbacks.print = &print_apcupsd_cable;
+  END OBJ(apcupsd_status, nullptr) obj->callbacks.print = &print_apcupsd_status;
+  END OBJ(apcupsd_linev, nullptr) obj->callbacks.print = &print_apcupsd_linev;
+  END OBJ(apcupsd_load, nullptr) obj->callbacks.print = &print_apcupsd_load;
+  END OBJ(apcupsd_loadbar, nullptr) scan_bar(obj, arg, 100);
   obj->callbacks.barval = &apcupsd_loadbarval;
 #ifdef BUILD_GUI
-  END OBJ(apcupsd_loadgraph, &update_apcupsd) char *buf = nullptr;
+  END OBJ(apcupsd_loadgraph, nullptr) char *buf = nullptr;
   buf = scan_graph(obj, arg, 100);
   free_and_zero(buf);
   obj->callbacks.graphval = &apcupsd_loadbarval;
-  END OBJ(apcupsd_loadgauge, &update_apcupsd) scan_gauge(obj, arg, 100);
+  END OBJ(apcupsd_loadgauge, nullptr) scan_gauge(obj, arg, 100);
   obj->callbacks.gaugeval = &apcupsd_loadbarval;
 #endif /* BUILD_GUI */
-  END OBJ(apcupsd_charge, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_charge;
-  END OBJ(apcupsd_timeleft, &update_apcupsd) obj->callbacks.print =
+  END OBJ(apcupsd_charge, nullptr) obj->callbacks.print = &print_apcupsd_charge;
+  END OBJ(apcupsd_timeleft, nullptr) obj->callbacks.print =
       &print_apcupsd_timeleft;
-  END OBJ(apcupsd_temp, &update_apcupsd) obj->callbacks.print =
-      &print_apcupsd_temp;
-  END OBJ(apcupsd_lastxfer, &update_apcupsd) obj->callbacks.print =
+  END OBJ(apcupsd_temp, nullptr) obj->callbacks.print = &print_apcupsd_temp;
+  END OBJ(apcupsd_lastxfer, nullptr) obj->callbacks.print =
       &print_apcupsd_lastxfer;
 #endif /* BUILD_APCUPSD */
 #ifdef BUILD_JOURNAL
@@ -2066,7 +2318,7 @@ size_t remove_comments(char *string) {
 }
 
 int extract_variable_text_internal(struct text_object *retval,
-                                   const char *const_p) {
+                                   const char *const_p, bool own_arena) {
   struct text_object *obj;
   char *p, *s, *orig_p;
   long line;
@@ -2076,7 +2328,8 @@ int extract_variable_text_internal(struct text_object *retval,
   size_t len = 0;
 
   p = strndup(const_p, max_user_text.get(*state) - 1);
-  while (text_contains_templates(p) != 0) {
+  /* a single pass, which also expands the templates used by templates */
+  if (text_contains_templates(p) != 0) {
     char *tmp;
     tmp = find_and_replace_templates(p);
     free(p);
@@ -2092,6 +2345,7 @@ int extract_variable_text_internal(struct text_object *retval,
   }
 
   memset(retval, 0, sizeof(struct text_object));
+  text_arena_scope arena(retval, own_arena);
 
   line = global_text_lines;
 
@@ -2203,6 +2457,8 @@ int extract_variable_text_internal(struct text_object *retval,
     NORM_ERR("one or more $endif's are missing");
   }
 
+  compile_text_objects(retval);
+
   free(orig_p);
   return 0;
 }
@@ -2226,8 +2482,12 @@ void free_text_objects(struct text_object *root) {
       free_and_zero(obj->sub);
       free_and_zero(obj->special_data);
       delete obj->cb_handle;
-
-      free(obj);
     }
   }
+  if (root != nullptr) {
+    free_text_ops(root);
+    /* all the objects and their plain text at once */
+    delete root->arena;
+    root->arena = nullptr;
+  }
 }
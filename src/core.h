@@ -30,7 +30,9 @@
 #ifndef _CONKY_CORE_H_
 #define _CONKY_CORE_H_
 
+#include <string>
 #include "conky.h"
+#include "text_object.h"
 
 struct text_object *construct_text_object(const char *s, const char *arg,
                                           long line, void **ifblock_opaque,
@@ -38,8 +40,28 @@ struct text_object *construct_text_object(const char *s, const char *arg,
 
 size_t remove_comments(char *string);
 
+/* Strips a trailing "interval=<seconds>" word from arg, storing the rest in
+ * rest. Returns what is left of arg (nullptr if nothing) and sets interval to
+ * -1 if there was no valid interval. */
+const char *take_interval_arg(const char *arg, std::string &rest,
+                              double &interval);
+
+/* keeps the updaters of what a --collector shares running, whether or not
+ * any object uses them */
+void register_shared_updaters();
+void free_shared_updaters();
+
+/* interval < 0 runs fn every update; unless on_demand is false, fn only runs
+ * while the objects owning the handle are shown, see set_on_demand() */
+legacy_cb_handle *create_cb_handle(int (*fn)(), double interval,
+                                   bool on_demand = true);
+
+/* A text parsed while another one is (for one of its objects) shares its
+ * arena, so that freeing the outer text frees its objects too; own_arena
+ * is for those that may outlive it. */
 int extract_variable_text_internal(struct text_object *retval,
-                                   const char *const_p);
+                                   const char *const_p,
+                                   bool own_arena = false);
 
 void free_text_objects(struct text_object *root);
 
@@ -33,6 +33,7 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include "common.h"
 #include "config.h"
 #include "conky.h"
 #include "text_object.h"
@@ -49,12 +50,6 @@
 #define AmD 0x68747541
 #define InteL 0x756e6547
 
-#if defined(__FreeBSD__)
-#define TICKZ 100L
-#else
-#define TICKZ sysconf(_SC_CLK_TCK)
-#endif /* __FreeBSD__ */
-
 uint8_t has_tsc_reg(void) {
   uint_fast16_t vend = 0;
   uint_fast16_t leafs = 0;
@@ -111,18 +106,37 @@ seeya:
           static_cast<uintmax_t>(ticklo));
 }
 
-void get_cpu_clock_speed(char *str1, unsigned int p_max_size) {
-  uintmax_t x = 0;
-  uintmax_t z = 0;
-  struct timespec tc = {0L, 0L};
-
-  tc.tv_nsec = TICKZ * 1000000L;
+/* how long the first call samples the TSC for, to have something to show */
+#define WARMUP_NSEC 10000000L
 
-  x = rdtsc();
-  if (-1 == (nanosleep(&tc, NULL))) { return; }
-  z = rdtsc();
+/* The TSC rate since the last update, rather than over a sleep inside the
+ * frame. Only the first call blocks, for one short warm-up sample. */
+void get_cpu_clock_speed(char *str1, unsigned int p_max_size) {
+  static uintmax_t last_tsc = 0;
+  static double last_time = 0;
+  static double sampled_at = -1;
+  static uintmax_t mhz = 0;
+
+  if (sampled_at != current_update_time) {
+    sampled_at = current_update_time;
+    if (last_tsc == 0) {
+      struct timespec tc = {0L, WARMUP_NSEC};
+
+      last_tsc = rdtsc();
+      last_time = get_time();
+      if (-1 == (nanosleep(&tc, NULL))) { return; }
+    }
+    uintmax_t tsc = rdtsc();
+    double now = get_time();
+    if (now > last_time) {
+      double seconds = now - last_time;
+      mhz = static_cast<uintmax_t>((tsc - last_tsc) / (seconds * 1e6));
+    }
+    last_tsc = tsc;
+    last_time = now;
+  }
 
-  snprintf(str1, p_max_size, "%ju MHz", ((z - x) / 100000U));
+  snprintf(str1, p_max_size, "%ju MHz", mhz);
 }
 
 void print_freq2(struct text_object *obj, char *p, unsigned int p_max_size) {
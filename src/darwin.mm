@@ -59,7 +59,6 @@
 
 #include <mach/mach.h>  // update_total_processes
 
-#include <dispatch/dispatch.h>  // get_top_info
 #include <libproc.h>            // get_top_info
 #include "top.h"                // get_top_info
 
@@ -68,6 +67,7 @@
 
 #include "darwin_sip.h"  // sip status
 
+#include <mutex>
 #include <vector>
 
 #ifdef BUILD_IPGFREQ
@@ -259,6 +259,9 @@ static void get_cpu_sample(struct cpusample **sample) {
   /*
    * sum up all totals
    */
+  (*sample)[0].totalSystemTime = 0;
+  (*sample)[0].totalUserTime = 0;
+  (*sample)[0].totalIdleTime = 0;
   for (natural_t i = 1; i < processorCount + 1; i++) {
     (*sample)[0].totalSystemTime += (*sample)[i].totalSystemTime;
     (*sample)[0].totalUserTime += (*sample)[i].totalUserTime;
@@ -286,7 +289,34 @@ void allocate_cpu_sample(struct cpusample **sample) {
   sample_handle = *sample; /* use a public handle for deallocating */
 }
 
+/* bumped before each update, see get_frame_cpu_sample() and get_proc_list() */
+static unsigned long update_generation = 0;
+
+/*
+ * get_frame_cpu_sample()
+ *
+ * Returns the cpu sample of this update. host_processor_info() is called
+ * only once per update for update_cpu_usage() and get_top_info(), hold
+ * cpu_sample_mutex while using the sample.
+ */
+static std::mutex cpu_sample_mutex;
+
+static struct cpusample *get_frame_cpu_sample() {
+  static unsigned long generation = 0;
+
+  if (sample_handle == nullptr) {
+    allocate_cpu_sample(&sample_handle);
+    generation = 0;
+  }
+  if (generation != update_generation) {
+    get_cpu_sample(&sample_handle);
+    generation = update_generation;
+  }
+  return sample_handle;
+}
+
 void free_cpu(struct text_object *) {
+  std::lock_guard<std::mutex> guard(cpu_sample_mutex);
   if (sample_handle != nullptr) {
     free(sample_handle);
     sample_handle = nullptr;
@@ -294,46 +324,49 @@ void free_cpu(struct text_object *) {
 }
 
 /*
- * helper_get_proc_list()
- *
- * helper function that returns the count of processes
- * and provides a list of kinfo_proc structs representing each.
+ * get_proc_list()
  *
- * ERRORS: returns -1 if something failed
+ * Returns a list of kinfo_proc structs representing each process as of this
+ * update and stores their count in |proc_count|. The list is fetched once
+ * per update and shared, hold proc_list_mutex while using it.
  *
- * ATTENTION: Do not forget to free the array once you are done with it,
- *  it is not freed automatically.
+ * ERRORS: returns nullptr if something failed
  */
-static int helper_get_proc_list(struct kinfo_proc **p) {
-  int err = 0;
-  size_t length = 0;
+static std::mutex proc_list_mutex;
+
+static struct kinfo_proc *get_proc_list(int *proc_count) {
+  static std::vector<struct kinfo_proc> procs;
+  static unsigned long generation = 0;
+  static int count = -1;
   static const int name[] = {CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0};
+  size_t length = 0;
 
-  /* Call sysctl with a nullptr buffer to get proper length */
-  err = sysctl((int *)name, (sizeof(name) / sizeof(*name)) - 1, nullptr,
-               &length, nullptr, 0);
-  if (err != 0) {
-    perror(nullptr);
-    return (-1);
-  }
+  if (count < 0 || generation != update_generation) {
+    generation = update_generation;
+    count = -1;
 
-  /* Allocate buffer */
-  *p = static_cast<kinfo_proc *>(malloc(length));
-  if (p == nullptr) {
-    perror(nullptr);
-    return (-1);
-  }
+    /* Call sysctl with a nullptr buffer to get proper length */
+    if (sysctl((int *)name, (sizeof(name) / sizeof(*name)) - 1, nullptr,
+               &length, nullptr, 0) != 0) {
+      perror(nullptr);
+      return nullptr;
+    }
 
-  /* Get the actual process list */
-  err = sysctl((int *)name, (sizeof(name) / sizeof(*name)) - 1, *p, &length,
-               nullptr, 0);
-  if (err != 0) {
-    perror(nullptr);
-    return (-1);
+    /* with room for processes started in the meantime */
+    procs.resize(length / sizeof(struct kinfo_proc) + 16);
+    length = procs.size() * sizeof(struct kinfo_proc);
+
+    /* Get the actual process list */
+    if (sysctl((int *)name, (sizeof(name) / sizeof(*name)) - 1, procs.data(),
+               &length, nullptr, 0) != 0) {
+      perror(nullptr);
+      return nullptr;
+    }
+    count = length / sizeof(struct kinfo_proc);
   }
 
-  int proc_count = length / sizeof(struct kinfo_proc);
-  return proc_count;
+  *proc_count = count;
+  return procs.data();
 }
 
 /*-------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -378,9 +411,7 @@ static int swapmode(unsigned long *retavail, unsigned long *retfree) {
   return 1;
 }
 
-void prepare_update() {
-  // in freebsd.cc this is empty so leaving it here too!
-}
+void prepare_update() { ++update_generation; }
 
 int update_uptime() {
   int mib[2] = {CTL_KERN, KERN_BOOTTIME};
@@ -569,10 +600,12 @@ static int libtop_tsamp_update_vm_stats(libtop_tsamp_t *tsamp) {
 uint64_t get_physical_memory() {
   int mib[2] = {CTL_HW, HW_MEMSIZE};
 
-  int64_t physical_memory = 0;
+  /* doesn't change while we run, so only ask once */
+  static int64_t physical_memory = 0;
   size_t length = sizeof(int64_t);
 
-  if (sysctl(mib, 2, &physical_memory, &length, nullptr, 0) == -1) {
+  if (physical_memory == 0 &&
+      sysctl(mib, 2, &physical_memory, &length, nullptr, 0) == -1) {
     physical_memory = 0;
   }
 
@@ -807,9 +840,10 @@ int update_running_threads() {
   int proc_count = 0;
   int run_threads = 0;
 
-  proc_count = helper_get_proc_list(&p);
+  std::lock_guard<std::mutex> guard(proc_list_mutex);
+  p = get_proc_list(&proc_count);
 
-  if (proc_count == -1) { return 0; }
+  if (p == nullptr) { return 0; }
 
   for (int i = 0; i < proc_count; i++) {
     if ((p[i].kp_proc.p_stat & SRUN) != 0) {
@@ -840,7 +874,6 @@ int update_running_threads() {
     }
   }
 
-  free(p);
   info.run_threads = run_threads;
   return 0;
 }
@@ -891,9 +924,10 @@ int update_running_processes() {
   int proc_count = 0;
   int run_procs = 0;
 
-  proc_count = helper_get_proc_list(&p);
+  std::lock_guard<std::mutex> guard(proc_list_mutex);
+  p = get_proc_list(&proc_count);
 
-  if (proc_count == -1) { return 0; }
+  if (p == nullptr) { return 0; }
 
   for (int i = 0; i < proc_count; i++) {
     int state = p[i].kp_proc.p_stat;
@@ -903,7 +937,6 @@ int update_running_processes() {
     }
   }
 
-  free(p);
   info.run_procs = run_procs;
   return 0;
 }
@@ -950,8 +983,6 @@ int update_cpu_usage() {
   unsigned int malloc_cpu_size = 0;
   extern void *global_cpu;
 
-  static struct cpusample *sample = nullptr;
-
   static pthread_mutex_t last_stat_update_mutex = PTHREAD_MUTEX_INITIALIZER;
   static double last_stat_update = 0.0;
 
@@ -982,9 +1013,8 @@ int update_cpu_usage() {
     global_cpu = cpu;
   }
 
-  allocate_cpu_sample(&sample);
-
-  get_cpu_sample(&sample);
+  std::lock_guard<std::mutex> guard(cpu_sample_mutex);
+  struct cpusample *sample = get_frame_cpu_sample();
 
   /*
    * Setup conky's structs for-each core
@@ -1156,26 +1186,6 @@ static void calc_cpu_usage_for_proc(struct process *proc, uint64_t total) {
       mul * (proc->user_time + proc->kernel_time) / static_cast<float>(total);
 }
 
-/*
- * calculate total CPU usage based on total CPU usage
- * of previous iteration stored inside |process| struct
- */
-static void calc_cpu_total(struct process *proc, uint64_t *total) {
-  uint64_t current_total = 0; /* of current iteration */
-  struct cpusample *sample = nullptr;
-
-  allocate_cpu_sample(&sample);
-
-  get_cpu_sample(&sample);
-  current_total =
-      sample[0].totalUserTime + sample[0].totalIdleTime + sample[0].totalSystemTime;
-
-  *total = current_total - proc->previous_total_cpu_time;
-  proc->previous_total_cpu_time = current_total;
-
-  *total = ((*total / sysconf(_SC_CLK_TCK)) * 100) / info.cpu_count;
-}
-
 /*
  * calc_cpu_time_for_proc
  *
@@ -1216,94 +1226,86 @@ static void calc_cpu_time_for_proc(struct process *process,
   process->kernel_time = kernel_time;
 }
 
-/*
- * finds top-information only for one process which is represented by a
- * kinfo_proc struct this function is called multiple types ( one foreach
- * process ) to implement get_top_info()
- */
-static void get_top_info_for_kinfo_proc(struct kinfo_proc *p) {
-  struct process *proc = nullptr;
-  struct proc_taskinfo pti {};
-  pid_t pid;
-
-  pid = p->kp_proc.p_pid;
-  proc = get_process(pid);
-
-  free_and_zero(proc->name);
-  free_and_zero(proc->basename);
-
-  proc->name = strndup(p->kp_proc.p_comm, text_buffer_size.get(*state));
-  proc->basename = strndup(p->kp_proc.p_comm, text_buffer_size.get(*state));
-  proc->uid = p->kp_eproc.e_pcred.p_ruid;
-  proc->time_stamp = g_time;
-
-  if (sizeof(pti) ==
-      proc_pidinfo(pid, PROC_PIDTASKINFO, 0, &pti, sizeof(pti))) {
-    /* vsize, rss are in bytes thus we dont have to convert */
-    proc->vsize = pti.pti_virtual_size;
-    proc->rss = pti.pti_resident_size;
-
-    __block uint64_t t = 0;
-
-    __block bool calc_cpu_total_finished = false;
-    __block bool calc_proc_total_finished = false;
-
-    dispatch_async(
-        dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-          /* calc CPU time for process */
-          calc_cpu_time_for_proc(proc, &pti);
-
-          calc_proc_total_finished = true;
-        });
-
-    dispatch_async(
-        dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-          /* calc total CPU time (considering current process) */
-          calc_cpu_total(proc, &t);
-
-          calc_cpu_total_finished = true;
-        });
-
-    /*
-     * wait until done
-     */
-    while (!(calc_cpu_total_finished && calc_proc_total_finished)) { usleep(500); }
-
-    /* calc the amount(%) of CPU the process used  */
-    calc_cpu_usage_for_proc(proc, t);
-  }
-}
-
 /* While topless is obviously better, top is also not bad. */
 
 void get_top_info() {
-  int proc_count = 0;
-  struct kinfo_proc *p = nullptr;
+  static std::vector<pid_t> pids;
+  static uint64_t previous_total = 0;
+  uint64_t total = 0;
 
   /*
    * See #16
    */
   get_cpu_count();
 
+  /* the CPU time that passed since the last time, like calc_cpu_total() in
+   * linux.cc */
+  {
+    std::lock_guard<std::mutex> guard(cpu_sample_mutex);
+    const struct cpusample *sample = get_frame_cpu_sample();
+    uint64_t current_total = sample[0].totalUserTime +
+                             sample[0].totalIdleTime +
+                             sample[0].totalSystemTime;
+
+    total = current_total - previous_total;
+    previous_total = current_total;
+  }
+  total = ((total / sysconf(_SC_CLK_TCK)) * 100) / info.cpu_count;
+
   /*
-   *  get processes count
-   *  and create the processes list
+   *  list the pids, with room for processes started in the meantime
    */
-  proc_count = helper_get_proc_list(&p);
+  int size = proc_listpids(PROC_ALL_PIDS, 0, nullptr, 0);
+  if (size <= 0) { return; }
+  pids.resize(size / sizeof(pid_t) + 16);
+  size = proc_listpids(PROC_ALL_PIDS, 0, pids.data(),
+                       pids.size() * sizeof(pid_t));
+  if (size <= 0) { return; }
 
-  if (proc_count == -1) { return; }
+  const size_t name_len = text_buffer_size.get(*state);
+  const int pid_count = size / sizeof(pid_t);
 
   /*
-   *  get top info for-each process
+   *  one proc_pidinfo() for-each process gives everything top needs
    */
-  for (int i = 0; i < proc_count; i++) {
-    if ((((p[i].kp_proc.p_flag & P_SYSTEM)) == 0) &&
-        *p[i].kp_proc.p_comm != '\0') {
-      get_top_info_for_kinfo_proc(&p[i]);
+  for (int i = 0; i < pid_count; i++) {
+    struct proc_taskallinfo tai {};
+    pid_t pid = pids[i];
+
+    if (pid == 0 || sizeof(tai) != proc_pidinfo(pid, PROC_PIDTASKALLINFO, 0,
+                                                &tai, sizeof(tai))) {
+      continue;
+    }
+    if ((tai.pbsd.pbi_flags & PROC_FLAG_SYSTEM) != 0 ||
+        tai.pbsd.pbi_comm[0] == '\0') {
+      continue;
     }
-  }
 
-  free(p);
+    struct process *proc = get_process(pid);
+    unsigned long long starttime =
+        tai.pbsd.pbi_start_tvsec * 1000000ULL + tai.pbsd.pbi_start_tvusec;
+    if (proc->starttime != starttime) {
+      /* a new process, or the pid was reused */
+      proc->starttime = starttime;
+      proc->previous_user_time = ULONG_MAX;
+      proc->previous_kernel_time = ULONG_MAX;
+    }
+
+    process_set_name(proc, tai.pbsd.pbi_comm, tai.pbsd.pbi_comm, name_len);
+    proc->uid = tai.pbsd.pbi_ruid;
+    proc->time_stamp = g_time;
+
+    /* vsize, rss are in bytes thus we dont have to convert */
+    proc->vsize = tai.ptinfo.pti_virtual_size;
+    proc->rss = tai.ptinfo.pti_resident_size;
+
+    calc_cpu_time_for_proc(proc, &tai.ptinfo);
+    if (total != 0) {
+      calc_cpu_usage_for_proc(proc, total);
+    } else {
+      proc->amount = 0;
+    }
+  }
 }
 
 /*********************************************************************************************
@@ -42,6 +42,8 @@
 /* this is the root of all per disk stats,
  * also containing the totals. */
 struct diskio_stat stats;
+unsigned int diskio_stats_generation = 0;
+bool diskio_total_used = false;
 
 void clear_diskio_stats() {
   struct diskio_stat *cur;
@@ -49,8 +51,10 @@ void clear_diskio_stats() {
     cur = stats.next;
     stats.next = stats.next->next;
     free_and_zero(cur->dev);
-    free(cur);
+    delete cur;
   }
+  diskio_total_used = false;
+  ++diskio_stats_generation;
 }
 
 struct diskio_stat *prepare_diskio_stat(const char *s) {
@@ -62,7 +66,13 @@ struct diskio_stat *prepare_diskio_stat(const char *s) {
   char *rpbuf;
   char rpbuf2[256];
 
-  if (s == nullptr) { return &stats; }
+  if (s == nullptr) {
+    if (!diskio_total_used) {
+      diskio_total_used = true;
+      ++diskio_stats_generation;
+    }
+    return &stats;
+  }
 
   if (strncmp(s, "label:", 6) == 0) {
     snprintf(&(device_name[0]), text_buffer_size.get(*state),
@@ -123,6 +133,7 @@ struct diskio_stat *prepare_diskio_stat(const char *s) {
   cur->last = UINT_MAX;
   cur->last_read = UINT_MAX;
   cur->last_write = UINT_MAX;
+  ++diskio_stats_generation;
 
   return cur;
 }
@@ -136,12 +147,12 @@ void parse_diskio_arg(struct text_object *obj, const char *arg) {
  *  0: read + write
  *  1: write
  */
-static void print_diskio_dir(struct text_object *obj, int dir, char *p,
-                             unsigned int p_max_size) {
+static int print_diskio_dir(struct text_object *obj, int dir, char *p,
+                            unsigned int p_max_size) {
   auto *diskio = static_cast<struct diskio_stat *>(obj->data.opaque);
   double val;
 
-  if (diskio == nullptr) { return; }
+  if (diskio == nullptr) { return 0; }
 
   if (dir < 0) {
     val = diskio->current_read;
@@ -153,21 +164,21 @@ static void print_diskio_dir(struct text_object *obj, int dir, char *p,
 
   /* TODO: move this correction from kB to kB/s elsewhere
    * (or get rid of it??) */
-  human_readable(val / active_update_interval(), p, p_max_size);
+  return human_readable(val / active_update_interval(), p, p_max_size);
 }
 
-void print_diskio(struct text_object *obj, char *p, unsigned int p_max_size) {
-  print_diskio_dir(obj, 0, p, p_max_size);
+int print_diskio(struct text_object *obj, char *p, unsigned int p_max_size) {
+  return print_diskio_dir(obj, 0, p, p_max_size);
 }
 
-void print_diskio_read(struct text_object *obj, char *p,
-                       unsigned int p_max_size) {
-  print_diskio_dir(obj, -1, p, p_max_size);
+int print_diskio_read(struct text_object *obj, char *p,
+                      unsigned int p_max_size) {
+  return print_diskio_dir(obj, -1, p, p_max_size);
 }
 
-void print_diskio_write(struct text_object *obj, char *p,
-                        unsigned int p_max_size) {
-  print_diskio_dir(obj, 1, p, p_max_size);
+int print_diskio_write(struct text_object *obj, char *p,
+                       unsigned int p_max_size) {
+  return print_diskio_dir(obj, 1, p, p_max_size);
 }
 
 #ifdef BUILD_GUI
@@ -200,9 +211,6 @@ double diskiographval_write(struct text_object *obj) {
 
 void update_diskio_values(struct diskio_stat *ds, unsigned int reads,
                           unsigned int writes) {
-  int i;
-  double sum = 0, sum_r = 0, sum_w = 0;
-
   if (reads < ds->last_read || writes < ds->last_write) {
     /* counter overflow or reset - rebase to sane values */
     ds->last = reads + writes;
@@ -212,27 +220,16 @@ void update_diskio_values(struct diskio_stat *ds, unsigned int reads,
   /* since the values in /proc/diskstats are absolute, we have to subtract
    * our last reading. The numbers stand for "sectors read", and we therefore
    * have to divide by two to get KB */
-  ds->sample_read[0] = (reads - ds->last_read) / 2;
-  ds->sample_write[0] = (writes - ds->last_write) / 2;
-  ds->sample[0] = ds->sample_read[0] + ds->sample_write[0];
+  const int samples = diskio_avg_samples.get(*state);
+  ds->sample_read.set_window(samples);
+  ds->sample_write.set_window(samples);
+  ds->sample_read.push((reads - ds->last_read) / 2);
+  ds->sample_write.push((writes - ds->last_write) / 2);
 
   /* compute averages */
-  int samples = diskio_avg_samples.get(*state);
-  for (i = 0; i < samples; i++) {
-    sum += ds->sample[i] * 1024LL;
-    sum_r += ds->sample_read[i] * 1024LL;
-    sum_w += ds->sample_write[i] * 1024LL;
-  }
-  ds->current = sum / static_cast<double>(samples);
-  ds->current_read = sum_r / static_cast<double>(samples);
-  ds->current_write = sum_w / static_cast<double>(samples);
-
-  /* shift sample history */
-  for (i = samples - 1; i > 0; i--) {
-    ds->sample[i] = ds->sample[i - 1];
-    ds->sample_read[i] = ds->sample_read[i - 1];
-    ds->sample_write[i] = ds->sample_write[i - 1];
-  }
+  ds->current_read = ds->sample_read.average() * 1024LL;
+  ds->current_write = ds->sample_write.average() * 1024LL;
+  ds->current = ds->current_read + ds->current_write;
 
   /* save last */
   ds->last_read = reads;
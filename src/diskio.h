@@ -32,6 +32,7 @@
 
 #include <limits.h>
 #include <cstring>
+#include "sample-ring.hh"
 
 struct diskio_stat {
   diskio_stat()
@@ -41,16 +42,13 @@ struct diskio_stat {
         current_write(0),
         last(UINT_MAX),
         last_read(UINT_MAX),
-        last_write(UINT_MAX) {
-    std::memset(sample, 0, sizeof(sample));
-    std::memset(sample_read, 0, sizeof(sample_read));
-    std::memset(sample_write, 0, sizeof(sample_write));
-  }
+        last_write(UINT_MAX) {}
   struct diskio_stat *next;
   char *dev;
-  double sample[15];
-  double sample_read[15];
-  double sample_write[15];
+  /* KB read and written between updates, averaged into current_read and
+   * current_write */
+  conky::sample_ring<double> sample_read;
+  conky::sample_ring<double> sample_write;
   double current;
   double current_read;
   double current_write;
@@ -60,6 +58,11 @@ struct diskio_stat {
 };
 
 extern struct diskio_stat stats;
+/* changes whenever a diskio_stat is added or freed */
+extern unsigned int diskio_stats_generation;
+/* whether any object shows the totals in stats, rather than only some
+ * devices */
+extern bool diskio_total_used;
 
 struct diskio_stat *prepare_diskio_stat(const char *);
 int update_diskio(void);
@@ -67,9 +70,9 @@ void clear_diskio_stats(void);
 void update_diskio_values(struct diskio_stat *, unsigned int, unsigned int);
 
 void parse_diskio_arg(struct text_object *, const char *);
-void print_diskio(struct text_object *, char *, unsigned int);
-void print_diskio_read(struct text_object *, char *, unsigned int);
-void print_diskio_write(struct text_object *, char *, unsigned int);
+int print_diskio(struct text_object *, char *, unsigned int);
+int print_diskio_read(struct text_object *, char *, unsigned int);
+int print_diskio_write(struct text_object *, char *, unsigned int);
 #ifdef BUILD_GUI
 void parse_diskiograph_arg(struct text_object *, const char *);
 double diskiographval(struct text_object *);
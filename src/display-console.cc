@@ -30,12 +30,16 @@
 #include "display-console.hh"
 #include "nc.h"
 
+#include <unistd.h>
+#include <cerrno>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
 
 static conky::simple_config_setting<bool> extra_newline("extra_newline", false,
                                                         false);
+static conky::simple_config_setting<bool> console_skip_unchanged(
+    "console_skip_unchanged", false, false);
 
 namespace conky {
 namespace {
@@ -47,6 +51,29 @@ void init_console_output() {}
 
 namespace priv {}  // namespace priv
 
+namespace {
+
+/* Writes the whole frame with as few write() calls as the descriptor
+ * allows, so a reader on a pipe sees it arrive at once. */
+void write_frame(FILE *stream, const std::string &frame) {
+  /* anything printed through stdio must not end up after the frame */
+  fflush(stream);
+  int fd = fileno(stream);
+  const char *p = frame.data();
+  size_t left = frame.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      return;
+    }
+    p += n;
+    left -= n;
+  }
+}
+
+}  // namespace
+
 display_output_console::display_output_console(const std::string &name_)
     : display_output_base(name_) {
   // lowest priority, it's a fallback
@@ -69,16 +96,30 @@ bool display_output_console::initialize() { return true; }
 
 bool display_output_console::shutdown() { return true; }
 
+void display_output_console::begin_draw_stuff() {
+  stdout_frame.clear();
+  stderr_frame.clear();
+}
+
+void display_output_console::end_draw_stuff() {
+  bool skip = console_skip_unchanged.get(*state);
+  if (!stdout_frame.empty() && !(skip && stdout_frame == last_stdout_frame)) {
+    write_frame(stdout, stdout_frame);
+  }
+  if (!stderr_frame.empty() && !(skip && stderr_frame == last_stderr_frame)) {
+    write_frame(stderr, stderr_frame);
+  }
+  /* keep both buffers around so their capacity is reused next frame */
+  stdout_frame.swap(last_stdout_frame);
+  stderr_frame.swap(last_stderr_frame);
+}
+
 void display_output_console::draw_string(const char *s, int) {
   if (out_to_stdout.get(*state)) {
-    printf("%s\n", s);
-    if (extra_newline.get(*state)) { fputc('\n', stdout); }
-    fflush(stdout); /* output immediately, don't buffer */
-  }
-  if (out_to_stderr.get(*state)) {
-    fprintf(stderr, "%s\n", s);
-    fflush(stderr); /* output immediately, don't buffer */
+    stdout_frame.append(s).push_back('\n');
+    if (extra_newline.get(*state)) { stdout_frame.push_back('\n'); }
   }
+  if (out_to_stderr.get(*state)) { stderr_frame.append(s).push_back('\n'); }
 }
 
 }  // namespace conky
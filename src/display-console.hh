@@ -47,9 +47,15 @@ class display_output_console : public display_output_base {
   virtual bool initialize();
   virtual bool shutdown();
 
+  virtual void begin_draw_stuff();
+  virtual void end_draw_stuff();
   virtual void draw_string(const char *s, int w);
 
   // console-specific
+ private:
+  // lines are collected here and written once the frame is complete
+  std::string stdout_frame, stderr_frame;
+  std::string last_stdout_frame, last_stderr_frame;
 };
 
 }  // namespace conky
@@ -30,6 +30,10 @@
 #include "display-file.hh"
 #include "nc.h"
 
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
@@ -37,11 +41,92 @@
 /* filenames for output */
 static conky::simple_config_setting<std::string> overwrite_file(
     "overwrite_file", std::string(), true);
-static FILE *overwrite_fpointer = nullptr;
 static conky::simple_config_setting<std::string> append_file("append_file",
                                                              std::string(),
                                                              true);
-static FILE *append_fpointer = nullptr;
+
+/* Text for the overwrite file is collected for the whole frame and replaces
+ * the file in one rename, so that readers never see half of an update. Text
+ * for the append file is collected across frames and written out once
+ * enough of it has piled up or it has waited long enough. */
+static std::string overwrite_buffer;
+static std::string append_buffer;
+static int append_fd = -1;
+static std::string append_path; /* what append_fd was opened as */
+static double append_flushed;   /* when append_buffer was last written */
+
+static const size_t APPEND_FLUSH_SIZE = 64 * 1024;
+static const double APPEND_FLUSH_INTERVAL = 1.0;
+
+static bool write_all(int fd, const std::string &buf) {
+  const char *p = buf.data();
+  size_t left = buf.size();
+
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    p += n;
+    left -= n;
+  }
+  return true;
+}
+
+static void write_overwrite_file(const std::string &path) {
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+
+  if (fd < 0) {
+    NORM_ERR("Cannot overwrite '%s'", path.c_str());
+    return;
+  }
+  bool written = write_all(fd, overwrite_buffer);
+  if (close(fd) != 0) { written = false; }
+  if (!written || rename(tmp.c_str(), path.c_str()) != 0) {
+    NORM_ERR("Cannot overwrite '%s'", path.c_str());
+    unlink(tmp.c_str());
+  }
+}
+
+static void close_append_file() {
+  if (append_fd >= 0) {
+    close(append_fd);
+    append_fd = -1;
+  }
+  append_path.clear();
+}
+
+/* (re)opens the append file if it was renamed away, e.g. by logrotate */
+static bool open_append_file(const std::string &path) {
+  struct stat current, opened;
+
+  if (append_fd >= 0 && path == append_path &&
+      stat(path.c_str(), &current) == 0 && fstat(append_fd, &opened) == 0 &&
+      current.st_dev == opened.st_dev && current.st_ino == opened.st_ino) {
+    return true;
+  }
+  close_append_file();
+  append_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                   0666);
+  if (append_fd < 0) {
+    NORM_ERR("Cannot append to '%s'", path.c_str());
+    return false;
+  }
+  append_path = path;
+  return true;
+}
+
+static void flush_append_file(const std::string &path) {
+  append_flushed = get_time();
+  if (append_buffer.empty()) { return; }
+  if (open_append_file(path) && !write_all(append_fd, append_buffer)) {
+    NORM_ERR("Cannot append to '%s'", path.c_str());
+    close_append_file();
+  }
+  append_buffer.clear();
+}
 
 namespace conky {
 namespace {
@@ -73,34 +158,34 @@ bool display_output_file::initialize() { return true; }
 bool display_output_file::shutdown() { return true; }
 
 void display_output_file::draw_string(const char *s, int) {
-  if (overwrite_fpointer != nullptr) { fprintf(overwrite_fpointer, "%s\n", s); }
-  if (append_fpointer != nullptr) { fprintf(append_fpointer, "%s\n", s); }
-}
-
-void display_output_file::begin_draw_stuff() {
-  if (static_cast<unsigned int>(!overwrite_file.get(*state).empty()) != 0u) {
-    overwrite_fpointer = fopen(overwrite_file.get(*state).c_str(), "we");
-    if (overwrite_fpointer == nullptr) {
-      NORM_ERR("Cannot overwrite '%s'", overwrite_file.get(*state).c_str());
-    }
+  if (!overwrite_file.get(*state).empty()) {
+    overwrite_buffer.append(s).push_back('\n');
   }
-  if (static_cast<unsigned int>(!append_file.get(*state).empty()) != 0u) {
-    append_fpointer = fopen(append_file.get(*state).c_str(), "ae");
-    if (append_fpointer == nullptr) {
-      NORM_ERR("Cannot append to '%s'", append_file.get(*state).c_str());
-    }
+  if (!append_file.get(*state).empty()) {
+    append_buffer.append(s).push_back('\n');
   }
 }
 
+void display_output_file::begin_draw_stuff() { overwrite_buffer.clear(); }
+
 void display_output_file::end_draw_stuff() {
-  if (overwrite_fpointer != nullptr) {
-    fclose(overwrite_fpointer);
-    overwrite_fpointer = nullptr;
+  const std::string &overwrite = overwrite_file.get(*state);
+  if (!overwrite.empty()) { write_overwrite_file(overwrite); }
+
+  const std::string &append = append_file.get(*state);
+  if (append.empty()) {
+    close_append_file();
+  } else if (append_buffer.size() >= APPEND_FLUSH_SIZE ||
+             get_time() - append_flushed >= APPEND_FLUSH_INTERVAL) {
+    flush_append_file(append);
   }
-  if (append_fpointer != nullptr) {
-    fclose(append_fpointer);
-    append_fpointer = nullptr;
+}
+
+void display_output_file::cleanup() {
+  if (!append_file.get(*state).empty()) {
+    flush_append_file(append_file.get(*state));
   }
+  close_append_file();
 }
 
 }  // namespace conky
@@ -52,6 +52,8 @@ class display_output_file : public display_output_base {
   virtual void begin_draw_stuff();
   virtual void end_draw_stuff();
 
+  virtual void cleanup();
+
   // file-specific
 };
 
@@ -28,10 +28,19 @@
 
 #include "conky.h"
 #include "display-http.hh"
+#include "profiling.hh"
+#include "thread-qos.hh"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #ifdef BUILD_HTTP
 #include <microhttpd.h>
@@ -57,22 +66,397 @@ extern void init_http_output() {}
 /* older API */
 #define MHD_Result int
 #endif /* MHD_YES */
-std::string webpage;
+#ifndef MHD_ALLOW_SUSPEND_RESUME
+#define MHD_ALLOW_SUSPEND_RESUME MHD_USE_SUSPEND_RESUME
+#endif /* MHD_ALLOW_SUSPEND_RESUME */
+std::string webpage; /* the page being drawn */
+
+/* A page drawn completely. Responses hold a reference until libmicrohttpd is
+ * done sending them, so publishing the next frame never touches their data. */
+struct http_page {
+  std::string body;
+  std::string etag;
+  const char *content_type = nullptr;
+};
+
+/* what can be requested, besides the page everything else falls back to */
+enum http_resource {
+  HTTP_PAGE,
+  HTTP_METRICS,
+  HTTP_JSON,
+  HTTP_LIVE,
+  HTTP_RESOURCES
+};
+std::shared_ptr<const http_page> served_page[HTTP_RESOURCES];
+std::mutex served_page_mutex;
 struct MHD_Daemon *httpd;
 static conky::simple_config_setting<bool> http_refresh("http_refresh", false,
                                                        true);
 static conky::simple_config_setting<unsigned short> http_port("http_port",
                                                               HTTPPORT, true);
+static conky::range_config_setting<unsigned int> http_threads(
+    "http_threads", 1, 64, 1, false);
+
+/* The text as it is pushed to /events: one segment of HTML per string
+ * drawn. Every frame carries the event turning the previous frame into it,
+ * built once however many clients are listening. */
+struct http_frame {
+  uint64_t generation = 0;
+  std::vector<std::string> segments;
+  std::string delta;
+};
+std::vector<std::string> drawn_segments; /* the frame being drawn */
+std::shared_ptr<const http_frame> served_frame;
+/* /events streams that have sent the served frame, suspended until the next
+ * one; they are resumed (and dropped from here) when it is published */
+std::vector<struct MHD_Connection *> waiting_streams;
+bool streams_closing;
+std::mutex served_frame_mutex;
+
+/* Streams the text to an EventSource, see live_page. */
+struct http_stream {
+  explicit http_stream(struct MHD_Connection *c) : connection(c) {}
+
+  struct MHD_Connection *connection;
+  uint64_t generation = 0; /* of the last frame sent, 0 before the first */
+  std::string pending;
+  size_t sent = 0;
+};
+
+/* A page updating itself from /events, as the served page does with
+ * http_refresh but without reloading all of it every update. */
+const char live_page[] =
+    "<!DOCTYPE html>\n<html><head><meta charset=\"UTF-8\" />"
+    "<title>Conky</title></head><body style=\"font-family: monospace\">"
+    "<p id=\"text\"></p><script>\n"
+    "var segments = [];\n"
+    "new EventSource(\"/events\").addEventListener(\"frame\", function(e) {\n"
+    "  var data = e.data.split(\"\\n\");\n"
+    "  segments.length = parseInt(data[0], 10);\n"
+    "  for (var i = 1; i < data.length; i++) {\n"
+    "    var sp = data[i].indexOf(\" \");\n"
+    "    segments[parseInt(data[i], 10)] = data[i].substring(sp + 1);\n"
+    "  }\n"
+    "  document.getElementById(\"text\").innerHTML =\n"
+    "      segments.join(\"<br />\");\n"
+    "});\n"
+    "</script></body></html>\n";
+
+void publish_page(http_resource resource, std::string &&body,
+                  const char *content_type) {
+  auto next = std::make_shared<http_page>();
+  char etag[24];
+  snprintf(etag, sizeof etag, "\"%zx\"", std::hash<std::string>()(body));
+  next->etag = etag;
+  next->body = std::move(body);
+  next->content_type = content_type;
+
+  std::shared_ptr<const http_page> page = std::move(next);
+  std::lock_guard<std::mutex> lock(served_page_mutex);
+  served_page[resource].swap(page);
+}
+
+/* Appends a "frame" event whose data is the number of segments followed by
+ * "<index> <html>" for each segment differing from those in previous, or
+ * for every segment without previous. */
+void append_frame_event(std::string &out,
+                        const std::vector<std::string> &segments,
+                        const std::vector<std::string> *previous) {
+  out.append("event: frame\ndata: ").append(std::to_string(segments.size()));
+  out.append("\n");
+  for (size_t i = 0; i < segments.size(); i++) {
+    if (previous != nullptr && i < previous->size() &&
+        (*previous)[i] == segments[i]) {
+      continue;
+    }
+    out.append("data: ").append(std::to_string(i)).append(" ");
+    out.append(segments[i]).append("\n");
+  }
+  out.append("\n");
+}
+
+void resume_streams(std::vector<struct MHD_Connection *> &streams) {
+  for (auto *connection : streams) { MHD_resume_connection(connection); }
+  streams.clear();
+}
+
+/* Only the main thread publishes, so served_frame can be read unlocked. */
+void publish_frame(std::vector<std::string> &&segments) {
+  const http_frame *previous = served_frame.get();
+  if (previous != nullptr && previous->segments == segments) { return; }
+
+  auto next = std::make_shared<http_frame>();
+  next->generation = previous != nullptr ? previous->generation + 1 : 1;
+  append_frame_event(next->delta, segments,
+                     previous != nullptr ? &previous->segments : nullptr);
+  next->segments = std::move(segments);
+
+  std::vector<struct MHD_Connection *> wake;
+  {
+    std::lock_guard<std::mutex> lock(served_frame_mutex);
+    served_frame = std::move(next);
+    wake.swap(waiting_streams);
+  }
+  resume_streams(wake);
+}
+
+ssize_t read_events(void *cls, uint64_t, char *buf, size_t max) {
+  auto *stream = static_cast<http_stream *>(cls);
+  if (stream->sent == stream->pending.size()) {
+    std::lock_guard<std::mutex> lock(served_frame_mutex);
+    if (streams_closing) { return MHD_CONTENT_READER_END_OF_STREAM; }
+    const http_frame *frame = served_frame.get();
+    if (frame == nullptr || frame->generation == stream->generation) {
+      /* nothing new, sleep instead of being asked again right away */
+      waiting_streams.push_back(stream->connection);
+      MHD_suspend_connection(stream->connection);
+      return 0;
+    }
+    stream->pending.clear();
+    stream->sent = 0;
+    if (stream->generation != 0 &&
+        frame->generation == stream->generation + 1) {
+      stream->pending.append(frame->delta);
+    } else {
+      /* first event, or frames were missed: send all of the text */
+      append_frame_event(stream->pending, frame->segments, nullptr);
+    }
+    stream->generation = frame->generation;
+  }
+  size_t n = std::min(max, stream->pending.size() - stream->sent);
+  memcpy(buf, stream->pending.data() + stream->sent, n);
+  stream->sent += n;
+  return n;
+}
+
+void release_stream(void *cls) { delete static_cast<http_stream *>(cls); }
+
+/* /trace, the events traced so far when conky runs with --trace */
+MHD_Result send_trace(struct MHD_Connection *connection) {
+  if (!conky::profile::tracing()) {
+    static char msg[] = "conky isn't tracing, start it with --trace\n";
+    struct MHD_Response *response = MHD_create_response_from_buffer(
+        sizeof msg - 1, msg, MHD_RESPMEM_PERSISTENT);
+    MHD_Result ret =
+        MHD_queue_response(connection, MHD_HTTP_NOT_FOUND, response);
+    MHD_destroy_response(response);
+    return ret;
+  }
+  std::string json = conky::profile::trace_json();
+  struct MHD_Response *response = MHD_create_response_from_buffer(
+      json.size(), &json[0], MHD_RESPMEM_MUST_COPY);
+  if (response == nullptr) { return MHD_NO; }
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE,
+                          "application/json");
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL,
+                          "no-cache");
+  MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+  MHD_destroy_response(response);
+  return ret;
+}
+
+MHD_Result send_events(struct MHD_Connection *connection) {
+  auto *stream = new http_stream(connection);
+  struct MHD_Response *response = MHD_create_response_from_callback(
+      MHD_SIZE_UNKNOWN, 4 * 1024, &read_events, stream, &release_stream);
+  if (response == nullptr) {
+    delete stream;
+    return MHD_NO;
+  }
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE,
+                          "text/event-stream");
+  MHD_add_response_header(response, MHD_HTTP_HEADER_CACHE_CONTROL,
+                          "no-cache");
+  MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+  MHD_destroy_response(response);
+  return ret;
+}
+
+void append_number(std::string &out, double value) {
+  char buf[32];
+  if (std::isnan(value)) {
+    out.append("NaN");
+  } else {
+    snprintf(buf, sizeof buf, "%.15g", value);
+    out.append(buf);
+  }
+}
+
+void append_metric(std::string &out, const char *name, const char *help) {
+  out.append("# HELP ").append(name).append(" ").append(help);
+  out.append("\n# TYPE ").append(name).append(" gauge\n");
+}
+
+void append_sample(std::string &out, const char *name, const char *labels,
+                   double value) {
+  out.append(name);
+  if (labels != nullptr) { out.append("{").append(labels).append("}"); }
+  out.append(" ");
+  append_number(out, value);
+  out.append("\n");
+}
+
+const char *cpu_label(unsigned int i) {
+  static char buf[24];
+  snprintf(buf, sizeof buf, "cpu=\"cpu%u\"", i);
+  return buf;
+}
+
+/* The values are the ones conky collected for this update, so only those
+ * its text asks for are current; memory figures are reported in bytes. */
+void publish_metrics() {
+  static const char *const periods[] = {"period=\"1m\"", "period=\"5m\"",
+                                        "period=\"15m\""};
+  const double kib = 1024.0;
+  std::string out;
+
+  out.reserve(2048);
+  append_metric(out, "conky_uptime_seconds", "Time since boot.");
+  append_sample(out, "conky_uptime_seconds", nullptr, info.uptime);
+  append_metric(out, "conky_load_average", "System load average.");
+  for (int i = 0; i < 3; i++) {
+    append_sample(out, "conky_load_average", periods[i], info.loadavg[i]);
+  }
+  append_metric(out, "conky_cpu_usage_ratio",
+                "CPU usage between 0 and 1, cpu0 being all of them.");
+  if (info.cpu_usage != nullptr) {
+    for (unsigned int i = 0; i <= info.cpu_count; i++) {
+      append_sample(out, "conky_cpu_usage_ratio", cpu_label(i),
+                    info.cpu_usage[i]);
+    }
+  }
+  append_metric(out, "conky_memory_bytes", "Memory by state.");
+  append_sample(out, "conky_memory_bytes", "state=\"used\"", info.mem * kib);
+  append_sample(out, "conky_memory_bytes", "state=\"free\"",
+                info.memfree * kib);
+  append_sample(out, "conky_memory_bytes", "state=\"available\"",
+                info.memavail * kib);
+  append_sample(out, "conky_memory_bytes", "state=\"buffers\"",
+                info.buffers * kib);
+  append_sample(out, "conky_memory_bytes", "state=\"cached\"",
+                info.cached * kib);
+  append_sample(out, "conky_memory_bytes", "state=\"total\"",
+                info.memmax * kib);
+  append_metric(out, "conky_swap_bytes", "Swap space by state.");
+  append_sample(out, "conky_swap_bytes", "state=\"free\"",
+                info.swapfree * kib);
+  append_sample(out, "conky_swap_bytes", "state=\"total\"",
+                info.swapmax * kib);
+  append_metric(out, "conky_processes", "Processes by state.");
+  append_sample(out, "conky_processes", "state=\"all\"", info.procs);
+  append_sample(out, "conky_processes", "state=\"running\"", info.run_procs);
+  append_metric(out, "conky_threads", "Threads by state.");
+  append_sample(out, "conky_threads", "state=\"all\"", info.threads);
+  append_sample(out, "conky_threads", "state=\"running\"", info.run_threads);
+  publish_page(HTTP_METRICS, std::move(out), "text/plain; version=0.0.4");
+
+  out.clear();
+  out.reserve(512);
+  out.append("{\"uptime\":");
+  append_number(out, info.uptime);
+  out.append(",\"loadavg\":[");
+  for (int i = 0; i < 3; i++) {
+    if (i > 0) { out.append(","); }
+    append_number(out, info.loadavg[i]);
+  }
+  out.append("],\"cpu\":[");
+  if (info.cpu_usage != nullptr) {
+    for (unsigned int i = 0; i <= info.cpu_count; i++) {
+      if (i > 0) { out.append(","); }
+      append_number(out, info.cpu_usage[i]);
+    }
+  }
+  out.append("],\"memory\":{\"used\":");
+  append_number(out, info.mem * kib);
+  out.append(",\"free\":");
+  append_number(out, info.memfree * kib);
+  out.append(",\"available\":");
+  append_number(out, info.memavail * kib);
+  out.append(",\"buffers\":");
+  append_number(out, info.buffers * kib);
+  out.append(",\"cached\":");
+  append_number(out, info.cached * kib);
+  out.append(",\"total\":");
+  append_number(out, info.memmax * kib);
+  out.append("},\"swap\":{\"free\":");
+  append_number(out, info.swapfree * kib);
+  out.append(",\"total\":");
+  append_number(out, info.swapmax * kib);
+  out.append("},\"processes\":{\"all\":");
+  append_number(out, info.procs);
+  out.append(",\"running\":");
+  append_number(out, info.run_procs);
+  out.append("},\"threads\":{\"all\":");
+  append_number(out, info.threads);
+  out.append(",\"running\":");
+  append_number(out, info.run_threads);
+  out.append("}}\n");
+  publish_page(HTTP_JSON, std::move(out), "application/json");
+}
+
+ssize_t read_page(void *cls, uint64_t pos, char *buf, size_t max) {
+  const std::string &body =
+      (*static_cast<std::shared_ptr<const http_page> *>(cls))->body;
+  if (pos >= body.size()) { return MHD_CONTENT_READER_END_OF_STREAM; }
+  size_t n = std::min<uint64_t>(max, body.size() - pos);
+  memcpy(buf, body.data() + pos, n);
+  return n;
+}
+
+void release_page(void *cls) {
+  delete static_cast<std::shared_ptr<const http_page> *>(cls);
+}
 
 MHD_Result sendanswer(void *cls, struct MHD_Connection *connection,
                       const char *url, const char *method, const char *version,
                       const char *upload_data, size_t *upload_data_size,
                       void **con_cls) {
-  struct MHD_Response *response = MHD_create_response_from_buffer(
-      webpage.length(), (void *)webpage.c_str(), MHD_RESPMEM_PERSISTENT);
-  MHD_Result ret = MHD_queue_response(connection, MHD_HTTP_OK, response);
+  http_resource resource = HTTP_PAGE;
+  if (strcmp(url, "/metrics") == 0) {
+    resource = HTTP_METRICS;
+  } else if (strcmp(url, "/json") == 0) {
+    resource = HTTP_JSON;
+  } else if (strcmp(url, "/live") == 0) {
+    resource = HTTP_LIVE;
+  } else if (strcmp(url, "/events") == 0) {
+    return send_events(connection);
+  } else if (strcmp(url, "/trace") == 0) {
+    return send_trace(connection);
+  }
+
+  std::shared_ptr<const http_page> page;
+  {
+    std::lock_guard<std::mutex> lock(served_page_mutex);
+    page = served_page[resource];
+  }
+  if (!page) { page = std::make_shared<const http_page>(); }
+
+  struct MHD_Response *response;
+  unsigned int status;
+  const char *match = MHD_lookup_connection_value(
+      connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_NONE_MATCH);
+  if (match != nullptr && !page->etag.empty() && page->etag == match) {
+    response =
+        MHD_create_response_from_buffer(0, nullptr, MHD_RESPMEM_PERSISTENT);
+    status = MHD_HTTP_NOT_MODIFIED;
+  } else {
+    response = MHD_create_response_from_callback(
+        page->body.size(), 32 * 1024, &read_page,
+        new std::shared_ptr<const http_page>(page), &release_page);
+    status = MHD_HTTP_OK;
+  }
+  if (response == nullptr) { return MHD_NO; }
+  if (!page->etag.empty()) {
+    MHD_add_response_header(response, MHD_HTTP_HEADER_ETAG,
+                            page->etag.c_str());
+  }
+  if (page->content_type != nullptr) {
+    MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE,
+                            page->content_type);
+  }
+  MHD_Result ret = MHD_queue_response(connection, status, response);
   MHD_destroy_response(response);
-  if (cls || url || method || version || upload_data || upload_data_size ||
+  if (cls || method || version || upload_data || upload_data_size ||
       con_cls) {}  // make compiler happy
   return ret;
 }
@@ -93,9 +477,19 @@ class out_to_http_setting : public conky::simple_config_setting<bool> {
             "warning: port 10080 is blocked by browsers "
             "like Firefox and Chromium, you may want to change http_port.");
       }
-      httpd =
-          MHD_start_daemon(MHD_USE_SELECT_INTERNALLY, http_port.get(*state),
-                           nullptr, NULL, &sendanswer, nullptr, MHD_OPTION_END);
+      /* the threads of the daemon inherit how the thread starting it is
+       * scheduled, which the main thread itself shouldn't be */
+      publish_page(HTTP_LIVE, live_page, "text/html; charset=UTF-8");
+      auto port = static_cast<uint16_t>(http_port.get(*state));
+      auto threads = static_cast<unsigned int>(http_threads.get(*state));
+      conky::thread_qos qos = conky::collector_thread_qos();
+      std::thread([port, threads, qos] {
+        qos.apply();
+        httpd = MHD_start_daemon(
+            MHD_USE_SELECT_INTERNALLY | MHD_ALLOW_SUSPEND_RESUME, port,
+            nullptr, NULL, &sendanswer, nullptr, MHD_OPTION_THREAD_POOL_SIZE,
+            threads, MHD_OPTION_END);
+      }).join();
     }
 
     ++s;
@@ -105,8 +499,19 @@ class out_to_http_setting : public conky::simple_config_setting<bool> {
     lua::stack_sentry s(l, -1);
 
     if (do_convert(l, -1).first) {
+      /* the daemon can't be stopped with connections suspended */
+      std::vector<struct MHD_Connection *> wake;
+      {
+        std::lock_guard<std::mutex> lock(served_frame_mutex);
+        streams_closing = true;
+        wake.swap(waiting_streams);
+      }
+      resume_streams(wake);
       MHD_stop_daemon(httpd);
       httpd = nullptr;
+      std::lock_guard<std::mutex> lock(served_frame_mutex);
+      streams_closing = false;
+      served_frame.reset();
     }
 
     l.pop();
@@ -117,17 +522,18 @@ class out_to_http_setting : public conky::simple_config_setting<bool> {
 };
 static out_to_http_setting out_to_http;
 
-std::string string_replace_all(std::string original, const std::string &oldpart,
-                               const std::string &newpart,
-                               std::string::size_type start) {
-  std::string::size_type i = start;
-  int oldpartlen = oldpart.length();
-  while (1) {
-    i = original.find(oldpart, i);
-    if (i == std::string::npos) { break; }
-    original.replace(i, oldpartlen, newpart);
+/* Appends s to page with newlines as line breaks and runs of two or more
+ * spaces as non-breaking spaces, so that the layout of the text survives. */
+void append_html(std::string &page, const char *s) {
+  for (const char *p = s; *p != 0; p++) {
+    if (*p == '\n') {
+      page.append("<br />");
+    } else if (*p == ' ' && ((p > s && p[-1] == ' ') || p[1] == ' ')) {
+      page.append("&nbsp;");
+    } else {
+      page.push_back(*p);
+    }
   }
-  return original;
 }
 
 #endif /* BUILD_HTTP */
@@ -169,7 +575,13 @@ void display_output_http::begin_draw_text() {
   "<title>Conky</title></head><body style=\"font-family: monospace\"><p>"
 #define WEBPAGE_END "</p></body></html>"
   if (out_to_http.get(*state)) {
-    webpage = WEBPAGE_START1;
+    webpage.clear();
+    {
+      std::lock_guard<std::mutex> lock(served_page_mutex);
+      const auto &page = served_page[HTTP_PAGE];
+      if (page) { webpage.reserve(page->body.capacity()); }
+    }
+    webpage.append(WEBPAGE_START1);
     if (http_refresh.get(*state)) {
       webpage.append("<meta http-equiv=\"refresh\" content=\"");
       std::stringstream update_interval_str;
@@ -181,15 +593,29 @@ void display_output_http::begin_draw_text() {
   }
 }
 
-void display_output_http::end_draw_text() { webpage.append(WEBPAGE_END); }
+void display_output_http::begin_draw_stuff() { drawn_segments.clear(); }
+
+void display_output_http::end_draw_stuff() {
+  publish_frame(std::move(drawn_segments));
+  drawn_segments.clear();
+}
+
+void display_output_http::end_draw_text() {
+  webpage.append(WEBPAGE_END);
+
+  publish_page(HTTP_PAGE, std::move(webpage), nullptr);
+  publish_metrics();
+}
 
 void display_output_http::draw_string(const char *s, int) {
-  std::string::size_type origlen = webpage.length();
-  webpage.append(s);
-  webpage = string_replace_all(webpage, "\n", "<br />", origlen);
-  webpage = string_replace_all(webpage, "  ", "&nbsp;&nbsp;", origlen);
-  webpage = string_replace_all(webpage, "&nbsp; ", "&nbsp;&nbsp;", origlen);
+  append_html(webpage, s);
   webpage.append("<br />");
+  drawn_segments.emplace_back();
+  std::string &segment = drawn_segments.back();
+  append_html(segment, s);
+  /* a carriage return would end the data line of the event */
+  segment.erase(std::remove(segment.begin(), segment.end(), '\r'),
+                segment.end());
 }
 
 #endif /* BUILD_HTTP */
@@ -51,6 +51,8 @@ class display_output_http : public display_output_base {
   virtual void set_foreground_color(long) {}
   virtual void begin_draw_text();
   virtual void end_draw_text();
+  virtual void begin_draw_stuff();
+  virtual void end_draw_stuff();
   virtual void draw_string(const char *, int);
 
   // HTTP-specific
@@ -0,0 +1,229 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "conky.h"
+#include "display-i3bar.hh"
+#include "llua.h"
+#include "reactor.hh"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+static conky::simple_config_setting<bool> out_to_i3bar("out_to_i3bar", false,
+                                                       false);
+
+extern double next_update_time;
+
+namespace conky {
+namespace {
+
+conky::display_output_i3bar i3bar_output("i3bar");
+
+/* i3bar gives up on lines it cannot parse, so anything that could break
+ * out of the string is escaped */
+void append_json_string(std::string &out, const std::string &s) {
+  out.push_back('"');
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof buf, "\\u%04x", c);
+      out.append(buf);
+    } else {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+}
+
+/* Where the value of key starts in the JSON object on line, or nullptr.
+ * Good enough for the flat objects of click events. */
+const char *json_value(const std::string &line, const char *key) {
+  std::string quoted = std::string("\"") + key + "\"";
+  size_t pos = line.find(quoted);
+  if (pos == std::string::npos) { return nullptr; }
+  const char *p = line.c_str() + pos + quoted.size();
+  while (*p == ' ' || *p == '\t') { p++; }
+  if (*p != ':') { return nullptr; }
+  p++;
+  while (*p == ' ' || *p == '\t') { p++; }
+  return p;
+}
+
+int json_int(const std::string &line, const char *key) {
+  const char *p = json_value(line, key);
+  if (p == nullptr) { return 0; }
+  /* instance is one of our strings */
+  if (*p == '"') { p++; }
+  return static_cast<int>(strtol(p, nullptr, 10));
+}
+
+void write_all(int fd, const std::string &data) {
+  const char *p = data.data();
+  size_t left = data.size();
+  while (left > 0) {
+    ssize_t n = write(fd, p, left);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      return;
+    }
+    p += n;
+    left -= n;
+  }
+}
+
+}  // namespace
+extern void init_i3bar_output() {}
+
+display_output_i3bar::display_output_i3bar(const std::string &name_)
+    : display_output_base(name_), started(false), reading_clicks(false) {
+  priority = 0;
+}
+
+bool display_output_i3bar::detect() {
+  if (out_to_i3bar.get(*state)) {
+    DBGP2("Display output '%s' enabled in config.", name.c_str());
+    return true;
+  }
+  return false;
+}
+
+bool display_output_i3bar::initialize() {
+  fflush(stdout);
+  write_all(STDOUT_FILENO, "{\"version\":1,\"click_events\":true}\n[\n");
+  started = false;
+  shown.clear();
+  encoded.clear();
+  /* stdin is shared with whoever started us, so it stays blocking; a single
+   * read() once it polls readable doesn't block */
+  main_reactor().add(STDIN_FILENO, [this]() { read_clicks(); });
+  reading_clicks = true;
+  is_active = true;
+  return true;
+}
+
+bool display_output_i3bar::shutdown() {
+  if (reading_clicks) {
+    main_reactor().remove(STDIN_FILENO);
+    reading_clicks = false;
+  }
+  input.clear();
+  clicks.clear();
+  return true;
+}
+
+void display_output_i3bar::draw_string(const char *s, int) {
+  lines.emplace_back(s);
+}
+
+void display_output_i3bar::begin_draw_stuff() { lines.clear(); }
+
+void display_output_i3bar::end_draw_stuff() {
+  bool changed = lines.size() != shown.size();
+  encoded.resize(lines.size());
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (i < shown.size() && lines[i] == shown[i]) { continue; }
+    std::string &block = encoded[i];
+    block.assign("{\"name\":\"conky\",\"instance\":\"");
+    block.append(std::to_string(i + 1)).append("\",\"full_text\":");
+    append_json_string(block, lines[i]);
+    block.push_back('}');
+    changed = true;
+  }
+  shown.swap(lines);
+  if (!changed) { return; }
+
+  /* the status lines are elements of an endless array */
+  std::string out(started ? ",[" : "[");
+  for (size_t i = 0; i < encoded.size(); i++) {
+    if (i > 0) { out.push_back(','); }
+    out.append(encoded[i]);
+  }
+  out.append("]\n");
+  started = true;
+  fflush(stdout);
+  write_all(STDOUT_FILENO, out);
+}
+
+void display_output_i3bar::flush() {
+  if (clicks.empty()) { return; }
+  for (const click &c : clicks) {
+    llua_click_hook(c.block, c.button, c.x, c.y, c.relative_x, c.relative_y);
+  }
+  clicks.clear();
+  /* show what the hook changed right away */
+  next_update_time = get_time();
+}
+
+/* Runs from the reactor: only collects the clicks and asks for an update,
+ * at the end of which flush() passes them on. */
+void display_output_i3bar::read_clicks() {
+  char buf[4096];
+  ssize_t n = read(STDIN_FILENO, buf, sizeof buf);
+  if (n < 0 && errno == EINTR) { return; }
+  if (n <= 0) {
+    /* nobody sends clicks, e.g. stdin is /dev/null */
+    main_reactor().remove(STDIN_FILENO);
+    reading_clicks = false;
+    return;
+  }
+  input.append(buf, n);
+
+  size_t start = 0, end;
+  while ((end = input.find('\n', start)) != std::string::npos) {
+    parse_click(input.substr(start, end - start));
+    start = end + 1;
+  }
+  input.erase(0, start);
+  /* not a stream of click events after all */
+  if (input.size() > sizeof buf) { input.clear(); }
+  if (!clicks.empty()) { next_update_time = get_time(); }
+}
+
+/* Events come one object per line, the first one after a line with just
+ * "[" and the others preceded by a ",". */
+void display_output_i3bar::parse_click(const std::string &line) {
+  const char *name = json_value(line, "name");
+  if (name == nullptr || strncmp(name, "\"conky\"", 7) != 0) { return; }
+  click c;
+  c.block = json_int(line, "instance");
+  c.button = json_int(line, "button");
+  c.x = json_int(line, "x");
+  c.y = json_int(line, "y");
+  c.relative_x = json_int(line, "relative_x");
+  c.relative_y = json_int(line, "relative_y");
+  if (c.block > 0) { clicks.push_back(c); }
+}
+
+}  // namespace conky
@@ -0,0 +1,88 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DISPLAY_I3BAR_HH
+#define DISPLAY_I3BAR_HH
+
+#include <string>
+#include <vector>
+
+#include "display-output.hh"
+
+namespace conky {
+
+/*
+ * Writes the text to stdout in the i3bar protocol, also understood by
+ * swaybar: each line is a block, one status line per update. Status lines
+ * are only written when a block changed, and only changed blocks are
+ * encoded again. Clicks i3bar reports on stdin are passed to
+ * lua_click_hook.
+ */
+class display_output_i3bar : public display_output_base {
+  /* a click read from stdin, to be passed on once the main loop runs */
+  struct click {
+    int block;
+    int button;
+    int x, y;
+    int relative_x, relative_y;
+  };
+
+  std::vector<std::string> lines;   /* the text being drawn, by block */
+  std::vector<std::string> shown;   /* the text of the blocks written */
+  std::vector<std::string> encoded; /* and their JSON */
+  bool started;
+  bool reading_clicks;
+  std::string input;
+  std::vector<click> clicks;
+
+  void read_clicks();
+  void parse_click(const std::string &line);
+
+ public:
+  explicit display_output_i3bar(const std::string &name_);
+
+  virtual ~display_output_i3bar() {}
+
+  // check if available and enabled in settings
+  virtual bool detect();
+  // connect to DISPLAY and other stuff
+  virtual bool initialize();
+  virtual bool shutdown();
+
+  virtual void draw_string(const char *s, int w);
+
+  virtual void begin_draw_stuff();
+  virtual void end_draw_stuff();
+  virtual void flush();
+
+  // i3bar-specific
+};
+
+}  // namespace conky
+
+#endif /* DISPLAY_I3BAR_HH */
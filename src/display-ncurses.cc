@@ -92,10 +92,12 @@ void display_output_ncurses::begin_draw_text() {
 void display_output_ncurses::end_draw_text() {}
 
 void display_output_ncurses::draw_string(const char *s, int) {
-  printw("%s", s);
+  waddstr(ncurses_window, s);
 }
 
-void display_output_ncurses::line_inner_done() { printw("\n"); }
+void display_output_ncurses::line_inner_done() {
+  waddch(ncurses_window, '\n');
+}
 
 int display_output_ncurses::getx() {
   int x, y;
@@ -127,9 +129,14 @@ void display_output_ncurses::gotoy(int y) {
 
 void display_output_ncurses::gotoxy(int x, int y) { move(y, x); }
 
+/* The next frame is drawn over an erased window rather than a cleared one:
+ * clear() makes the following refresh repaint the whole terminal, while
+ * after erase() curses compares the frame with what is on screen and only
+ * sends the cells that changed. */
 void display_output_ncurses::flush() {
-  refresh();
-  clear();
+  wnoutrefresh(ncurses_window);
+  doupdate();
+  werase(ncurses_window);
 }
 
 #endif /* BUILD_NCURSES */
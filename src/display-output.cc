@@ -28,6 +28,7 @@
 
 #include "display-output.hh"
 #include "logging.h"
+#include "session-capture.hh"
 
 #include <algorithm>
 #include <iostream>
@@ -55,6 +56,8 @@ extern void init_console_output();
 extern void init_ncurses_output();
 extern void init_file_output();
 extern void init_http_output();
+extern void init_i3bar_output();
+extern void init_socket_output();
 extern void init_x11_output();
 
 /*
@@ -94,6 +97,25 @@ display_output_base::display_output_base(const std::string &name_)
   priv::do_register_display_output(name, this);
 }
 
+void display_output_base::draw_graph(int x, int bottom, int n, const int *tops,
+                                     const unsigned long *colours) {
+  for (int i = n - 1; i >= 0; i--) {
+    if (colours != nullptr) { set_foreground_color(colours[i]); }
+    draw_line(x + i, bottom, x + i, tops[i]);
+  }
+}
+
+void display_output_base::draw_cells(int x, int y, int w, int h, int cols,
+                                     int rows, int n,
+                                     const unsigned long *colours) {
+  for (int i = 0; i < n && i < cols * rows; i++) {
+    int c = i % cols, r = i / cols;
+    int x0 = x + c * w / cols, y0 = y + r * h / rows;
+    set_foreground_color(colours[i]);
+    fill_rect(x0, y0, x + (c + 1) * w / cols - x0, y + (r + 1) * h / rows - y0);
+  }
+}
+
 disabled_display_output::disabled_display_output(const std::string &name,
                                                  const std::string &define)
     : display_output_base(name) {
@@ -110,8 +132,13 @@ bool initialize_display_outputs() {
   init_ncurses_output();
   init_file_output();
   init_http_output();
+  init_i3bar_output();
+  init_socket_output();
   init_x11_output();
 
+  /* benchmarks generate and draw the text for no output at all */
+  if (benchmarking()) { return true; }
+
   std::vector<display_output_base *> outputs;
   outputs.reserve(display_outputs->size());
 
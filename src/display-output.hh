@@ -78,6 +78,10 @@ class display_output_base {
   virtual bool graphical() { return is_graphical; };
   virtual bool draw_line_inner_required() { return is_graphical; }
 
+  /* whether nothing drawn to the output can be seen right now, e.g. because
+   * the window is covered or the monitor is off */
+  virtual bool hidden() { return false; }
+
   virtual bool main_loop_wait(double /*t*/) { return false; }
 
   virtual void sigterm_cleanup() {}
@@ -96,6 +100,11 @@ class display_output_base {
   // GUI interface
   virtual void draw_string_at(int /*x*/, int /*y*/, const char * /*s*/,
                               int /*w*/) {}
+  /* Until end_outline(), draw everything at the eight pixels around where
+   * it is asked for, so that the outline takes one pass over the text.
+   * Outputs that can't return false, and are drawn at each offset in turn. */
+  virtual bool begin_outline() { return false; }
+  virtual void end_outline() {}
   // X11 lookalikes
   virtual void set_line_style(int /*w*/, bool /*solid*/) {}
   virtual void set_dashes(char * /*s*/) {}
@@ -104,12 +113,29 @@ class display_output_base {
   virtual void fill_rect(int /*x*/, int /*y*/, int /*w*/, int /*h*/) {}
   virtual void draw_arc(int /*x*/, int /*y*/, int /*w*/, int /*h*/, int /*a1*/,
                         int /*a2*/) {}
+  /* The columns of a graph: vertical lines from (x + i, bottom) up to
+   * (x + i, tops[i]) for i < n, each in colours[i], or all in the current
+   * colour if colours is null. The current colour is undefined afterwards. */
+  virtual void draw_graph(int x, int bottom, int n, const int *tops,
+                          const unsigned long *colours);
+  /* A grid of cols by rows cells covering the w by h rectangle at (x, y), of
+   * which the first n, row by row, are filled in colours[i]. The current
+   * colour is undefined afterwards. */
+  virtual void draw_cells(int x, int y, int w, int h, int cols, int rows,
+                          int n, const unsigned long *colours);
   virtual void move_win(int /*x*/, int /*y*/) {}
   virtual int dpi_scale(int value) { return value; }
+  /* whether nothing drawn inside the rectangle would change what is shown,
+   * because only other parts are being redrawn */
+  virtual bool clipped_out(int /*x*/, int /*y*/, int /*w*/, int /*h*/) {
+    return false;
+  }
 
   virtual void begin_draw_stuff() {}
   virtual void end_draw_stuff() {}
   virtual void clear_text(int /*exposures*/) {}
+  // clear the parts of the text area that changed since the last draw
+  virtual void clear_damaged_text() { clear_text(1); }
 
   // font stuff
   virtual int font_height(unsigned int) { return 0; }
@@ -119,6 +145,8 @@ class display_output_base {
   virtual void set_font(unsigned int) {}
   virtual void free_fonts(bool /*utf8*/) {}
   virtual void load_fonts(bool /*utf8*/) {}
+  /* what the loaded fonts take in this process, for ${conky_mem} */
+  virtual size_t fonts_memory() { return 0; }
 
   // tty interface
   virtual int getx() { return 0; }
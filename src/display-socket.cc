@@ -0,0 +1,308 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "conky.h"
+#include "display-socket.hh"
+#include "reactor.hh"
+#include "text_object.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static conky::simple_config_setting<std::string> out_to_socket(
+    "out_to_socket", std::string(), false);
+
+namespace conky {
+namespace {
+
+conky::display_output_socket socket_output("socket");
+
+bool streaming = false;
+
+/* where each meter op of the main text goes in a frame, -1 for other ops */
+const text_op *indexed_ops = nullptr;
+uint32_t indexed_count = 0;
+std::vector<int> meter_slots;
+std::vector<double> meter_values;
+bool meters_recorded = false;
+bool meters_reindexed = false;
+
+void index_meters(const struct text_object &root) {
+  indexed_ops = root.ops;
+  indexed_count = root.op_count;
+  meter_slots.assign(root.op_count, -1);
+  meter_values.clear();
+  meters_reindexed = true;
+  for (uint32_t i = 0; i < root.op_count; i++) {
+    switch (root.ops[i].type) {
+      case TEXT_OP_BAR:
+      case TEXT_OP_GAUGE:
+      case TEXT_OP_GRAPH:
+      case TEXT_OP_PERCENTAGE:
+        meter_slots[i] = meter_values.size();
+        meter_values.push_back(0);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void put_varint(std::string &out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+void put_zigzag(std::string &out, int64_t v) {
+  put_varint(out, (static_cast<uint64_t>(v) << 1) ^
+                      static_cast<uint64_t>(v >> 63));
+}
+
+void finish_frame(std::string &out) {
+  uint32_t size = out.size() - 4;
+  for (int i = 0; i < 4; i++) { out[i] = static_cast<char>(size >> (8 * i)); }
+}
+
+int64_t thousandths(double value) {
+  if (!std::isfinite(value)) { return 0; }
+  return std::llround(value * 1000);
+}
+
+/* a "host:port" or ":port" to listen on instead of a path, for ${remote} on
+ * other machines */
+bool is_tcp_address(const std::string &address) {
+  return address.find('/') == std::string::npos &&
+         address.find(':') != std::string::npos;
+}
+
+int listen_unix(const std::string &path) {
+  struct sockaddr_un addr {};
+
+  if (path.size() >= sizeof addr.sun_path) {
+    NORM_ERR("out_to_socket: path '%s' is too long", path.c_str());
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path.c_str(), sizeof addr.sun_path - 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    NORM_ERR("out_to_socket: socket(): %s", strerror(errno));
+    return -1;
+  }
+  /* a socket left behind by an earlier run would make bind() fail */
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) != 0) {
+    NORM_ERR("out_to_socket: cannot listen on '%s': %s", path.c_str(),
+             strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int listen_tcp(const std::string &address) {
+  size_t colon = address.rfind(':');
+  std::string host = address.substr(0, colon);
+  std::string port = address.substr(colon + 1);
+  struct addrinfo hints {}, *ai;
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  int err = getaddrinfo(host.empty() || host == "*" ? nullptr : host.c_str(),
+                        port.c_str(), &hints, &ai);
+  if (err != 0) {
+    NORM_ERR("out_to_socket: '%s': %s", address.c_str(), gai_strerror(err));
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *a = ai; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) { continue; }
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (bind(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(ai);
+  if (fd < 0) {
+    NORM_ERR("out_to_socket: cannot listen on '%s': %s", address.c_str(),
+             strerror(errno));
+  }
+  return fd;
+}
+
+}  // namespace
+extern void init_socket_output() {}
+
+void record_meter_value(const struct text_object &root, uint32_t op,
+                        double value) {
+  if (!streaming) { return; }
+  if (root.ops != indexed_ops || root.op_count != indexed_count) {
+    index_meters(root);
+  }
+  if (op < meter_slots.size() && meter_slots[op] >= 0) {
+    meter_values[meter_slots[op]] = value;
+    meters_recorded = true;
+  }
+}
+
+display_output_socket::display_output_socket(const std::string &name_)
+    : display_output_base(name_), listen_fd(-1), sent_time(0) {
+  priority = 0;
+}
+
+bool display_output_socket::detect() {
+  if (!out_to_socket.get(*state).empty()) {
+    DBGP2("Display output '%s' enabled in config.", name.c_str());
+    return true;
+  }
+  return false;
+}
+
+bool display_output_socket::initialize() {
+  path = out_to_socket.get(*state);
+  listen_fd = is_tcp_address(path) ? listen_tcp(path) : listen_unix(path);
+  if (listen_fd < 0) { return false; }
+  fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+  if (listen(listen_fd, 8) != 0) {
+    NORM_ERR("out_to_socket: cannot listen on '%s': %s", path.c_str(),
+             strerror(errno));
+    close(listen_fd);
+    listen_fd = -1;
+    return false;
+  }
+  main_reactor().add(listen_fd, [this]() { accept_clients(); });
+
+  streaming = true;
+  is_active = true;
+  return true;
+}
+
+bool display_output_socket::shutdown() {
+  for (const client &c : clients) { close(c.fd); }
+  clients.clear();
+  if (listen_fd >= 0) {
+    main_reactor().remove(listen_fd);
+    close(listen_fd);
+    listen_fd = -1;
+    if (!is_tcp_address(path)) { unlink(path.c_str()); }
+  }
+  streaming = false;
+  indexed_ops = nullptr;
+  indexed_count = 0;
+  return true;
+}
+
+void display_output_socket::accept_clients() {
+  int fd;
+
+  while ((fd = accept(listen_fd, nullptr, nullptr)) >= 0) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+    clients.push_back(client{fd, true});
+  }
+}
+
+/* A client that cannot take a whole frame right away is disconnected rather
+ * than buffered for; it can reconnect and starts over with a key frame. */
+void display_output_socket::send_frame(const std::vector<double> &values,
+                                       double time) {
+  int64_t now = std::llround(time * 1000);
+  bool resized = values.size() != sent.size() || meters_reindexed;
+  std::string delta, key;
+
+  meters_reindexed = false;
+  if (resized) { sent.assign(values.size(), 0); }
+  delta.assign(4, '\0');
+  delta.push_back('D');
+  put_varint(delta, values.size());
+  put_zigzag(delta, now - sent_time);
+  key.assign(4, '\0');
+  key.push_back('K');
+  put_varint(key, values.size());
+  put_zigzag(key, now);
+  for (size_t i = 0; i < values.size(); i++) {
+    int64_t v = thousandths(values[i]);
+    put_zigzag(delta, v - sent[i]);
+    put_zigzag(key, v);
+    sent[i] = v;
+  }
+  sent_time = now;
+  finish_frame(delta);
+  finish_frame(key);
+
+  for (auto it = clients.begin(); it != clients.end();) {
+    const std::string &frame = it->needs_key || resized ? key : delta;
+    ssize_t n = send(it->fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+    if (n != static_cast<ssize_t>(frame.size())) {
+      close(it->fd);
+      it = clients.erase(it);
+    } else {
+      it->needs_key = false;
+      ++it;
+    }
+  }
+}
+
+void display_output_socket::end_draw_stuff() {
+  /* redraws without an update in between have nothing new to send */
+  if (!meters_recorded) { return; }
+  meters_recorded = false;
+  if (clients.empty()) {
+    sent.clear();
+    return;
+  }
+  send_frame(meter_values, current_update_time);
+}
+
+}  // namespace conky
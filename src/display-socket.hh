@@ -0,0 +1,94 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DISPLAY_SOCKET_HH
+#define DISPLAY_SOCKET_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "display-output.hh"
+
+struct text_object;
+
+namespace conky {
+
+/*
+ * Streams the value of every bar, gauge, graph and percentage in the text to
+ * the clients of a Unix domain socket, or of a TCP port for an out_to_socket
+ * of "host:port", one frame per update. ${remote} reads such streams.
+ *
+ * A frame is a little-endian uint32 with the size of the rest, then
+ *   - a byte, 'K' for a key frame or 'D' for a delta frame,
+ *   - a varint with the number of values,
+ *   - a zigzag varint with the update time in milliseconds since the epoch,
+ *   - a zigzag varint for each value, in thousandths.
+ * Key frames carry absolute numbers, delta frames the difference to the
+ * previous frame. Every client gets a key frame first and whenever the text
+ * was reloaded. Values follow the order of the objects in the text; one that
+ * is skipped by an $if keeps its last value.
+ */
+class display_output_socket : public display_output_base {
+  struct client {
+    int fd;
+    bool needs_key;
+  };
+
+  int listen_fd;
+  std::string path;
+  std::vector<client> clients;
+  std::vector<int64_t> sent; /* values of the last frame, in thousandths */
+  int64_t sent_time;
+
+  void accept_clients();
+  void send_frame(const std::vector<double> &values, double time);
+
+ public:
+  explicit display_output_socket(const std::string &name_);
+
+  virtual ~display_output_socket() {}
+
+  // check if available and enabled in settings
+  virtual bool detect();
+  // connect to DISPLAY and other stuff
+  virtual bool initialize();
+  virtual bool shutdown();
+
+  virtual void end_draw_stuff();
+
+  // socket-specific
+};
+
+/* generate_text_internal() reports the value each meter of root showed */
+void record_meter_value(const struct text_object &root, uint32_t op,
+                        double value);
+
+}  // namespace conky
+
+#endif /* DISPLAY_SOCKET_HH */
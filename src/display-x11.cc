@@ -38,18 +38,24 @@
 #ifdef BUILD_XDAMAGE
 #include <X11/extensions/Xdamage.h>
 #endif
+#ifdef BUILD_XDPMS
+#include <X11/extensions/dpms.h>
+#endif /* BUILD_XDPMS */
 #ifdef BUILD_IMLIB2
 #include "imlib2.h"
 #endif /* BUILD_IMLIB2 */
 #endif /* BUILD_X11 */
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 #include "conky.h"
 #include "display-x11.hh"
 #include "llua.h"
+#include "reactor.hh"
 #include "x11.h"
 #ifdef BUILD_X11
 #include "fonts.h"
@@ -76,19 +82,54 @@ extern long current_color;
 static int xft_dpi = -1;
 #endif /* BUILD_XFT */
 
+/* nothing is drawn while the window can't be seen, see hidden() */
+static bool window_obscured = false; /* as of the last VisibilityNotify */
+static bool drawing_paused = false;
+
+/* set while draw_stuff() is clipped to x11_stuff.region, see clipped_out() */
+static bool drawing_clipped = false;
+
+#ifdef BUILD_XDPMS
+/* DPMS sends no events, so whether the monitor is off is polled */
+static int dpms_supported = -1; /* -1 until it was checked */
+static bool monitor_off = false;
+static double monitor_checked = 0;
+
+static void check_monitor() {
+  double now = get_time();
+  if (dpms_supported == 0 || now - monitor_checked < 1) { return; }
+  monitor_checked = now;
+
+  if (dpms_supported < 0) {
+    int event_base, error_base;
+    dpms_supported = DPMSQueryExtension(display, &event_base, &error_base) &&
+                     DPMSCapable(display);
+    if (dpms_supported == 0) { return; }
+  }
+  CARD16 level;
+  BOOL enabled;
+  monitor_off = DPMSInfo(display, &level, &enabled) && enabled &&
+                level != DPMSModeOn;
+}
+#endif /* BUILD_XDPMS */
+
 /* for x_fonts */
 struct x_font_list {
   XFontStruct *font;
   XFontSet fontset;
+  bool borrowed; /* the fonts belong to an earlier entry with the same name */
 
 #ifdef BUILD_XFT
   XftFont *xftfont;
   int font_alpha;
+  /* text extents are needed for the same strings every layout pass */
+  std::unordered_map<std::string, int> widths;
 #endif
 
   x_font_list()
       : font(nullptr),
-        fontset(nullptr)
+        fontset(nullptr),
+        borrowed(false)
 #ifdef BUILD_XFT
         ,
         xftfont(nullptr),
@@ -99,6 +140,9 @@ struct x_font_list {
 };
 
 static std::vector<x_font_list> x_fonts; /* indexed by selected_font */
+/* load_fonts() runs after every generate_text_internal(), but fonts only
+ * ever grows between two free_fonts(): entries before this are loaded */
+static unsigned int x_fonts_loaded = 0;
 
 #ifdef BUILD_XFT
 namespace {
@@ -161,6 +205,9 @@ static void X11_create_window() {
 
   create_gc();
 
+#ifdef BUILD_XDBE
+  xdbe_clear_back_buffer(nullptr);
+#endif
   draw_stuff();
 
   x11_stuff.region = XCreateRegion();
@@ -219,28 +266,48 @@ bool display_output_x11::initialize() {
 
 bool display_output_x11::shutdown() { return false; }
 
+bool display_output_x11::hidden() {
+#ifdef BUILD_XDPMS
+  check_monitor();
+  if (monitor_off) { return true; }
+#endif /* BUILD_XDPMS */
+  return window_obscured;
+}
+
 bool display_output_x11::main_loop_wait(double t) {
   /* wait for X event or timeout */
 
   if (XPending(display) == 0) {
-    fd_set fdsr;
-    struct timeval tv {};
-    int s;
     // t = next_update_time - get_time();
 
     t = std::min(std::max(t, 0.0), active_update_interval());
+    double deadline = get_time() + t;
+    double wake = deadline;
+#ifdef BUILD_XDPMS
+    /* notice the monitor coming back on without waiting out a long
+     * update_interval_hidden */
+    if (monitor_off) { wake = std::min(wake, get_time() + 1); }
+#endif /* BUILD_XDPMS */
+
+    /* frames in between updates only redraw what was already laid out */
+    bool animating = animating_specials() && !drawing_paused;
+    if (animating) {
+      wake = std::min(wake, get_time() + animation_interval.get(*state));
+    }
 
-    tv.tv_sec = static_cast<long>(t);
-    tv.tv_usec = static_cast<long>(t * 1000000) % 1000000;
-    FD_ZERO(&fdsr);
-    FD_SET(ConnectionNumber(display), &fdsr);
-
-    s = select(ConnectionNumber(display) + 1, &fdsr, nullptr, nullptr, &tv);
-    if (s == -1) {
-      if (errno != EINTR) { NORM_ERR("can't select(): %s", strerror(errno)); }
-    } else {
-      /* timeout */
-      if (s == 0) { update_text(); }
+    /* the X connection is registered with the reactor in init_X11() */
+    if (conky::main_reactor().wait(wake)) {
+      if (get_time() >= deadline) {
+        update_text();
+      } else if (animating) {
+        XRectangle r;
+        int border_total = get_border_total();
+        r.x = text_start_x - border_total;
+        r.y = text_start_y - border_total;
+        r.width = text_width + 2 * border_total;
+        r.height = text_height + 2 * border_total;
+        XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
+      }
     }
   }
 
@@ -264,6 +331,9 @@ bool display_output_x11::main_loop_wait(double t) {
            text_height + 2 * border_total != window.height)) {
         window.width = text_width + 2 * border_total;
         window.height = text_height + 2 * border_total;
+#ifdef BUILD_XDBE
+        xdbe_clear_back_buffer(nullptr);
+#endif
         draw_stuff(); /* redraw everything in our newly sized window */
         XResizeWindow(display, window.window, window.width,
                       window.height); /* resize window */
@@ -340,7 +410,7 @@ bool display_output_x11::main_loop_wait(double t) {
     }
 #endif
 
-    clear_text(1);
+    clear_damaged_text();
 
 #if defined(BUILD_XDBE)
     if (use_xdbe.get(*state)) {
@@ -351,18 +421,49 @@ bool display_output_x11::main_loop_wait(double t) {
       int border_total = get_border_total();
 
       r.x = text_start_x - border_total;
-      r.y = text_start_y - border_total;
       r.width = text_width + 2 * border_total;
-      r.height = text_height + 2 * border_total;
-      XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
+#ifdef BUILD_XDBE
+      unsigned long pixel;
+      std::vector<std::pair<int, int>> bands;
+      if (xdbe_copies_back_buffer(&pixel) && get_text_damage(bands)) {
+        /* the back buffer still holds the last frame, redraw what changed */
+        for (const auto &band : bands) {
+          r.y = band.first;
+          r.height = band.second - band.first;
+          XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
+        }
+      } else
+#endif /* BUILD_XDBE */
+      {
+        r.y = text_start_y - border_total;
+        r.height = text_height + 2 * border_total;
+        XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
+      }
     }
   }
 
-  /* handle X events */
-  while (XPending(display) != 0) {
+  /* handle X events: everything queued is drained in one go, exposed areas
+   * are collected in x11_stuff.region and only the last geometry change and
+   * root pixmap change count, so a burst of events (a window move, a
+   * compositor restart) costs one redraw instead of one per event */
+  bool root_pixmap_changed = false;
+  bool screen_changed = false;
+#ifdef OWN_WINDOW
+  bool configured = false;
+  int configured_width = 0, configured_height = 0;
+#endif
+
+  for (int pending = XPending(display); pending > 0;
+       pending = XEventsQueued(display, QueuedAfterReading)) {
     XEvent ev;
 
     XNextEvent(display, &ev);
+    /* docking a laptop sends a burst of these, the heads are asked for
+     * once after all of them */
+    if (x11_screen_changed(ev)) {
+      screen_changed = true;
+      continue;
+    }
     switch (ev.type) {
       case Expose: {
         XRectangle r;
@@ -371,24 +472,21 @@ bool display_output_x11::main_loop_wait(double t) {
         r.width = ev.xexpose.width;
         r.height = ev.xexpose.height;
         XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
-        XSync(display, False);
         break;
       }
 
       case PropertyNotify: {
-        if (ev.xproperty.state == PropertyNewValue) {
-          get_x11_desktop_info(ev.xproperty.display, ev.xproperty.atom);
+        if (ev.xproperty.state == PropertyNewValue &&
+            get_x11_desktop_info(ev.xproperty.display, ev.xproperty.atom)) {
+          next_update_time = get_time();
+          need_to_update = 1;
         }
 #ifdef USE_ARGB
         if (!have_argb_visual) {
 #endif
           if (ev.xproperty.atom == ATOM(_XROOTPMAP_ID) ||
               ev.xproperty.atom == ATOM(_XROOTMAP_ID)) {
-            if (forced_redraw.get(*state)) {
-              draw_stuff();
-              next_update_time = get_time();
-              need_to_update = 1;
-            }
+            root_pixmap_changed = true;
           }
 #ifdef USE_ARGB
         }
@@ -397,6 +495,10 @@ bool display_output_x11::main_loop_wait(double t) {
       }
 
 #ifdef OWN_WINDOW
+      case VisibilityNotify:
+        window_obscured = ev.xvisibility.state == VisibilityFullyObscured;
+        break;
+
       case ReparentNotify:
         /* make background transparent */
         if (own_window.get(*state)) {
@@ -405,43 +507,11 @@ bool display_output_x11::main_loop_wait(double t) {
         break;
 
       case ConfigureNotify:
+        /* only the final geometry matters, see below */
         if (own_window.get(*state)) {
-          /* if window size isn't what expected, set fixed size */
-          if (ev.xconfigure.width != window.width ||
-              ev.xconfigure.height != window.height) {
-            if (window.width != 0 && window.height != 0) { fixed_size = 1; }
-
-            /* clear old stuff before screwing up
-             * size and pos */
-            clear_text(1);
-
-            {
-              XWindowAttributes attrs;
-              if (XGetWindowAttributes(display, window.window, &attrs) != 0) {
-                window.width = attrs.width;
-                window.height = attrs.height;
-              }
-            }
-
-            int border_total = get_border_total();
-
-            text_width = window.width - 2 * border_total;
-            text_height = window.height - 2 * border_total;
-            int mw = this->dpi_scale(maximum_width.get(*state));
-            if (text_width > mw && mw > 0) { text_width = mw; }
-          }
-
-          /* if position isn't what expected, set fixed pos
-           * total_updates avoids setting fixed_pos when window
-           * is set to weird locations when started */
-          /* // this is broken
-          if (total_updates >= 2 && !fixed_pos
-              && (window.x != ev.xconfigure.x
-              || window.y != ev.xconfigure.y)
-              && (ev.xconfigure.x != 0
-              || ev.xconfigure.y != 0)) {
-            fixed_pos = 1;
-          } */
+          configured = true;
+          configured_width = ev.xconfigure.width;
+          configured_height = ev.xconfigure.height;
         }
         break;
 
@@ -497,6 +567,64 @@ bool display_output_x11::main_loop_wait(double t) {
     }
   }
 
+  if (screen_changed) {
+    x11_screen_update();
+    next_update_time = get_time();
+    need_to_update = 1;
+  }
+
+#ifdef OWN_WINDOW
+  /* if window size isn't what expected, set fixed size */
+  if (configured && (configured_width != window.width ||
+                     configured_height != window.height)) {
+    if (window.width != 0 && window.height != 0) { fixed_size = 1; }
+
+    /* clear old stuff before screwing up
+     * size and pos */
+    clear_text(1);
+
+    {
+      XWindowAttributes attrs;
+      if (XGetWindowAttributes(display, window.window, &attrs) != 0) {
+        window.width = attrs.width;
+        window.height = attrs.height;
+      }
+    }
+
+    int border_total = get_border_total();
+
+    text_width = window.width - 2 * border_total;
+    text_height = window.height - 2 * border_total;
+    int mw = this->dpi_scale(maximum_width.get(*state));
+    if (text_width > mw && mw > 0) { text_width = mw; }
+  }
+
+  /* if position isn't what expected, set fixed pos
+   * total_updates avoids setting fixed_pos when window
+   * is set to weird locations when started */
+  /* // this is broken
+  if (total_updates >= 2 && !fixed_pos
+      && (window.x != ev.xconfigure.x
+      || window.y != ev.xconfigure.y)
+      && (ev.xconfigure.x != 0
+      || ev.xconfigure.y != 0)) {
+    fixed_pos = 1;
+  } */
+#endif
+
+  /* the whole window is redrawn over the new background together with
+   * whatever else was exposed */
+  if (root_pixmap_changed && forced_redraw.get(*state)) {
+    XRectangle r;
+    r.x = 0;
+    r.y = 0;
+    r.width = window.width;
+    r.height = window.height;
+    XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
+    next_update_time = get_time();
+    need_to_update = 1;
+  }
+
 #ifdef BUILD_XDAMAGE
   if (x11_stuff.damage) {
     XDamageSubtract(display, x11_stuff.damage, x11_stuff.region2, None);
@@ -504,6 +632,27 @@ bool display_output_x11::main_loop_wait(double t) {
   }
 #endif /* BUILD_XDAMAGE */
 
+  /* the text is still generated while hidden, so graphs and the like keep
+   * their history, but nothing is drawn until the window can be seen again.
+   * Then it is redrawn as a whole right away and updated at the next loop */
+  if (hidden() != drawing_paused) {
+    drawing_paused = !drawing_paused;
+    if (!drawing_paused) {
+      XRectangle r;
+      r.x = 0;
+      r.y = 0;
+      r.width = window.width;
+      r.height = window.height;
+      XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
+      next_update_time = get_time();
+    }
+  }
+  if (drawing_paused) {
+    XDestroyRegion(x11_stuff.region);
+    x11_stuff.region = XCreateRegion();
+    return true;
+  }
+
   /* XDBE doesn't seem to provide a way to clear the back buffer
    * without interfering with the front buffer, other than passing
    * XdbeBackground to XdbeSwapBuffers. That means that if we're
@@ -513,7 +662,8 @@ bool display_output_x11::main_loop_wait(double t) {
 
   if (XEmptyRegion(x11_stuff.region) == 0) {
 #if defined(BUILD_XDBE)
-    if (use_xdbe.get(*state)) {
+    unsigned long pixel;
+    if (use_xdbe.get(*state) && !xdbe_copies_back_buffer(&pixel)) {
 #else
     if (use_xpmdb.get(*state)) {
 #endif
@@ -526,13 +676,23 @@ bool display_output_x11::main_loop_wait(double t) {
       r.height = text_height + 2 * border_total;
       XUnionRectWithRegion(&r, x11_stuff.region, x11_stuff.region);
     }
+#ifdef BUILD_IMLIB2
+    else {
+      cimlib_clip_damage(x11_stuff.region);
+    }
+#endif /* BUILD_IMLIB2 */
+#ifdef BUILD_XDBE
+    xdbe_clear_back_buffer(x11_stuff.region);
+#endif
     XSetRegion(display, window.gc, x11_stuff.region);
 #ifdef BUILD_XFT
     if (use_xft.get(*state)) {
       XftDrawSetClip(window.xftdraw, x11_stuff.region);
     }
 #endif
+    drawing_clipped = true;
     draw_stuff();
+    drawing_clipped = false;
     XDestroyRegion(x11_stuff.region);
     x11_stuff.region = XCreateRegion();
   }
@@ -569,16 +729,146 @@ void display_output_x11::cleanup() {
   }
 }
 
-void display_output_x11::set_foreground_color(long c) {
+static unsigned long window_pixel(long c) {
 #ifdef BUILD_ARGB
   if (have_argb_visual) {
-    current_color = c | (own_window_argb_value.get(*state) << 24);
-  } else {
-#endif /* BUILD_ARGB */
-    current_color = c;
-#ifdef BUILD_ARGB
+    return c | (own_window_argb_value.get(*state) << 24);
   }
 #endif /* BUILD_ARGB */
+  return c;
+}
+
+/*
+ * Lines, rectangles and filled rectangles drawn with the same GC state are
+ * queued and sent as one XDrawSegments/XDrawRectangles/XFillRectangles
+ * request each, rather than one request per primitive. A bar or a gauge is a
+ * handful of these, and a dashboard has hundreds of them. Anything changing
+ * the GC or drawing otherwise flushes the queue first: core X drawing just
+ * writes pixels, so only the order relative to these matters.
+ */
+static std::vector<XSegment> pending_lines;
+static std::vector<XRectangle> pending_rects;
+static std::vector<XRectangle> pending_fills;
+
+/*
+ * Between begin_outline() and end_outline() everything is drawn at the eight
+ * pixels around where it is asked for, which dilates it by one pixel. The
+ * outline takes one pass over the text instead of one per offset, and the
+ * copies of a line travel in the same requests.
+ */
+static bool outlining = false;
+static const XPoint outline_offsets[] = {{-1, -1}, {-1, 0}, {-1, 1}, {0, -1},
+                                         {0, 1},   {1, -1}, {1, 0},  {1, 1}};
+
+static void flush_primitives() {
+  if (!pending_lines.empty()) {
+    XDrawSegments(display, window.drawable, window.gc, pending_lines.data(),
+                  pending_lines.size());
+    pending_lines.clear();
+  }
+  if (!pending_rects.empty()) {
+    XDrawRectangles(display, window.drawable, window.gc, pending_rects.data(),
+                    pending_rects.size());
+    pending_rects.clear();
+  }
+  if (!pending_fills.empty()) {
+    XFillRectangles(display, window.drawable, window.gc, pending_fills.data(),
+                    pending_fills.size());
+    pending_fills.clear();
+  }
+}
+
+#ifdef BUILD_XFT
+/*
+ * Xft text is queued as well, as glyphs placed by their advances, and sent
+ * at the end of each line by one XftDrawGlyphFontSpec() per colour. Colour
+ * and font specials cut a line into many short strings, and each of them
+ * used to be a request of its own.
+ */
+struct text_run {
+  XftColor colour;
+  std::vector<XftGlyphFontSpec> glyphs;
+};
+/* the runs are kept with their buffers, only the first ones are in use */
+static std::vector<text_run> pending_text;
+static size_t pending_runs = 0;
+
+static std::vector<XftGlyphFontSpec> &text_run_for(const XftColor &c) {
+  for (size_t i = 0; i < pending_runs; i++) {
+    const XftColor &rc = pending_text[i].colour;
+    if (rc.pixel == c.pixel && rc.color.alpha == c.color.alpha) {
+      return pending_text[i].glyphs;
+    }
+  }
+  if (pending_runs == pending_text.size()) { pending_text.emplace_back(); }
+  text_run &run = pending_text[pending_runs++];
+  run.colour = c;
+  run.glyphs.clear();
+  return run.glyphs;
+}
+
+static void queue_text(std::vector<XftGlyphFontSpec> &glyphs, int x, int y,
+                       const char *s, int len, XftFont *font, bool utf8) {
+  const auto *p = reinterpret_cast<const FcChar8 *>(s);
+
+  while (len > 0) {
+    FcChar32 ucs4 = *p;
+    int n = 1;
+
+    /* like XftDrawStringUtf8(), stop at the first invalid character */
+    if (utf8 && (n = FcUtf8ToUcs4(p, &ucs4, len)) <= 0) { break; }
+    FT_UInt glyph = XftCharIndex(display, font, ucs4);
+    XGlyphInfo gi;
+    XftGlyphExtents(display, font, &glyph, 1, &gi);
+    glyphs.push_back(
+        {font, glyph, static_cast<short>(x), static_cast<short>(y)});
+    x += gi.xOff;
+    y += gi.yOff;
+    p += n;
+    len -= n;
+  }
+}
+
+/* replaces the glyphs from first on by their copies around them */
+static void outline_glyphs(std::vector<XftGlyphFontSpec> &glyphs,
+                           size_t first) {
+  size_t end = glyphs.size();
+
+  for (const XPoint &o : outline_offsets) {
+    for (size_t i = first; i < end; i++) {
+      XftGlyphFontSpec spec = glyphs[i];
+      spec.x += o.x;
+      spec.y += o.y;
+      glyphs.push_back(spec);
+    }
+  }
+  glyphs.erase(glyphs.begin() + first, glyphs.begin() + end);
+}
+
+static void flush_text() {
+  for (size_t i = 0; i < pending_runs; i++) {
+    text_run &run = pending_text[i];
+    if (run.glyphs.empty()) { continue; }
+    XftDrawGlyphFontSpec(window.xftdraw, &run.colour, run.glyphs.data(),
+                         run.glyphs.size());
+    run.glyphs.clear();
+  }
+  pending_runs = 0;
+}
+#else
+static void flush_text() {}
+#endif /* BUILD_XFT */
+
+static XRectangle x_rectangle(int x, int y, int w, int h) {
+  return {static_cast<short>(x), static_cast<short>(y),
+          static_cast<unsigned short>(std::max(w, 0)),
+          static_cast<unsigned short>(std::max(h, 0))};
+}
+
+void display_output_x11::set_foreground_color(long c) {
+  unsigned long pixel = window_pixel(c);
+  if (static_cast<long>(pixel) != current_color) { flush_primitives(); }
+  current_color = pixel;
   XSetForeground(display, window.gc, current_color);
 }
 
@@ -586,8 +876,15 @@ int display_output_x11::calc_text_width(const char *s) {
   size_t slen = strlen(s);
 #ifdef BUILD_XFT
   if (use_xft.get(*state)) {
-    XGlyphInfo gi;
+    /* reused so that looking up a cached width does not allocate */
+    static std::string key;
+    auto &widths = x_fonts[selected_font].widths;
 
+    key.assign(s, slen);
+    auto it = widths.find(key);
+    if (it != widths.end()) { return it->second; }
+
+    XGlyphInfo gi;
     if (utf8_mode.get(*state)) {
       XftTextExtentsUtf8(display, x_fonts[selected_font].xftfont,
                          reinterpret_cast<const FcChar8 *>(s), slen, &gi);
@@ -595,6 +892,9 @@ int display_output_x11::calc_text_width(const char *s) {
       XftTextExtents8(display, x_fonts[selected_font].xftfont,
                       reinterpret_cast<const FcChar8 *>(s), slen, &gi);
     }
+    /* changing values leave a trail of strings that never come back */
+    if (widths.size() >= 4096) { widths.clear(); }
+    widths.emplace(key, gi.xOff);
     return gi.xOff;
   }
 #endif /* BUILD_XFT */
@@ -603,31 +903,42 @@ int display_output_x11::calc_text_width(const char *s) {
 }
 
 void display_output_x11::draw_string_at(int x, int y, const char *s, int w) {
+  flush_primitives();
 #ifdef BUILD_XFT
   if (use_xft.get(*state)) {
-    XColor c;
+    /* XQueryColor() is a round trip, so the last answer is kept */
+    static XColor c;
+    static Colormap queried_colourmap = None;
     XftColor c2;
 
-    c.pixel = current_color;
-    // query color on custom colormap
-    XQueryColor(display, window.colourmap, &c);
+    if (queried_colourmap != window.colourmap ||
+        c.pixel != static_cast<unsigned long>(current_color)) {
+      c.pixel = current_color;
+      // query color on custom colormap
+      XQueryColor(display, window.colourmap, &c);
+      queried_colourmap = window.colourmap;
+    }
 
     c2.pixel = c.pixel;
     c2.color.red = c.red;
     c2.color.green = c.green;
     c2.color.blue = c.blue;
     c2.color.alpha = x_fonts[selected_font].font_alpha;
-    if (utf8_mode.get(*state)) {
-      XftDrawStringUtf8(window.xftdraw, &c2, x_fonts[selected_font].xftfont, x,
-                        y, reinterpret_cast<const XftChar8 *>(s), w);
-    } else {
-      XftDrawString8(window.xftdraw, &c2, x_fonts[selected_font].xftfont, x, y,
-                     reinterpret_cast<const XftChar8 *>(s), w);
-    }
+    auto &glyphs = text_run_for(c2);
+    size_t first = glyphs.size();
+    queue_text(glyphs, x, y, s, w, x_fonts[selected_font].xftfont,
+               utf8_mode.get(*state));
+    if (outlining) { outline_glyphs(glyphs, first); }
   } else
 #endif
   {
-    if (utf8_mode.get(*state)) {
+    if (outlining) {
+      outlining = false;
+      for (const XPoint &o : outline_offsets) {
+        draw_string_at(x + o.x, y + o.y, s, w);
+      }
+      outlining = true;
+    } else if (utf8_mode.get(*state)) {
       Xutf8DrawString(display, window.drawable, x_fonts[selected_font].fontset,
                       window.gc, x, y, s, w);
     } else {
@@ -636,37 +947,210 @@ void display_output_x11::draw_string_at(int x, int y, const char *s, int w) {
   }
 }
 
+bool display_output_x11::begin_outline() {
+  outlining = true;
+  return true;
+}
+
+void display_output_x11::end_outline() { outlining = false; }
+
 void display_output_x11::set_line_style(int w, bool solid) {
+  flush_primitives();
   XSetLineAttributes(display, window.gc, w, solid ? LineSolid : LineOnOffDash,
                      CapButt, JoinMiter);
 }
 
 void display_output_x11::set_dashes(char *s) {
+  flush_primitives();
   XSetDashes(display, window.gc, 0, s, 2);
 }
 
 void display_output_x11::draw_line(int x1, int y1, int x2, int y2) {
-  XDrawLine(display, window.drawable, window.gc, x1, y1, x2, y2);
+  if (outlining) {
+    for (const XPoint &o : outline_offsets) {
+      pending_lines.push_back(
+          {static_cast<short>(x1 + o.x), static_cast<short>(y1 + o.y),
+           static_cast<short>(x2 + o.x), static_cast<short>(y2 + o.y)});
+    }
+    return;
+  }
+  pending_lines.push_back({static_cast<short>(x1), static_cast<short>(y1),
+                           static_cast<short>(x2), static_cast<short>(y2)});
 }
 
 void display_output_x11::draw_rect(int x, int y, int w, int h) {
-  XDrawRectangle(display, window.drawable, window.gc, x, y, w, h);
+  if (outlining) {
+    for (const XPoint &o : outline_offsets) {
+      pending_rects.push_back(x_rectangle(x + o.x, y + o.y, w, h));
+    }
+    return;
+  }
+  pending_rects.push_back(x_rectangle(x, y, w, h));
 }
 
 void display_output_x11::fill_rect(int x, int y, int w, int h) {
-  XFillRectangle(display, window.drawable, window.gc, x, y, w, h);
+  /* the copies of a filled rectangle fill the one a pixel larger */
+  if (outlining) {
+    pending_fills.push_back(x_rectangle(x - 1, y - 1, w + 2, h + 2));
+    return;
+  }
+  pending_fills.push_back(x_rectangle(x, y, w, h));
 }
 
 void display_output_x11::draw_arc(int x, int y, int w, int h, int a1, int a2) {
+  flush_primitives();
+  if (outlining) {
+    XArc arcs[8];
+    int i = 0;
+    for (const XPoint &o : outline_offsets) {
+      arcs[i++] = {static_cast<short>(x + o.x),
+                   static_cast<short>(y + o.y),
+                   static_cast<unsigned short>(std::max(w, 0)),
+                   static_cast<unsigned short>(std::max(h, 0)),
+                   static_cast<short>(a1),
+                   static_cast<short>(a2)};
+    }
+    XDrawArcs(display, window.drawable, window.gc, arcs, 8);
+    return;
+  }
   XDrawArc(display, window.drawable, window.gc, x, y, w, h, a1, a2);
 }
 
+void display_output_x11::draw_graph(int x, int bottom, int n, const int *tops,
+                                    const unsigned long *colours) {
+  static std::vector<XSegment> columns;
+
+  if (n <= 0) { return; }
+  if (outlining) {
+    static std::vector<int> shifted;
+
+    outlining = false;
+    shifted.resize(n);
+    for (const XPoint &o : outline_offsets) {
+      for (int i = 0; i < n; i++) { shifted[i] = tops[i] + o.y; }
+      draw_graph(x + o.x, bottom + o.y, n, shifted.data(), colours);
+    }
+    outlining = true;
+    return;
+  }
+  flush_primitives();
+  columns.resize(n);
+  for (int i = 0; i < n; i++) {
+    columns[i] = {static_cast<short>(x + i), static_cast<short>(bottom),
+                  static_cast<short>(x + i), static_cast<short>(tops[i])};
+  }
+  if (colours == nullptr) {
+    XDrawSegments(display, window.drawable, window.gc, columns.data(), n);
+    return;
+  }
+
+  /*
+   * Rather than a colour change and a line per column, put the colours in a
+   * one pixel high pixmap and tile it over all columns at once. That is a
+   * handful of requests per graph however wide it is, which matters most on
+   * remote displays.
+   */
+  int depth = DefaultDepth(display, screen);
+#ifdef BUILD_ARGB
+  if (have_argb_visual) { depth = 32; }
+#endif /* BUILD_ARGB */
+  Visual *visual =
+      window.visual != nullptr ? window.visual : DefaultVisual(display, screen);
+  XImage *row =
+      XCreateImage(display, visual, depth, ZPixmap, 0, nullptr, n, 1, 32, 0);
+  if (row == nullptr) {
+    display_output_base::draw_graph(x, bottom, n, tops, colours);
+    return;
+  }
+  row->data = static_cast<char *>(malloc(row->bytes_per_line));
+  for (int i = 0; i < n; i++) {
+    XPutPixel(row, i, 0, window_pixel(colours[i]));
+  }
+
+  Pixmap tile = XCreatePixmap(display, window.drawable, n, 1, depth);
+  XPutImage(display, tile, window.gc, row, 0, 0, 0, 0, n, 1);
+  XDestroyImage(row);
+
+  XSetTile(display, window.gc, tile);
+  XSetTSOrigin(display, window.gc, x, 0);
+  XSetFillStyle(display, window.gc, FillTiled);
+  XDrawSegments(display, window.drawable, window.gc, columns.data(), n);
+  XSetFillStyle(display, window.gc, FillSolid);
+  XFreePixmap(display, tile);
+}
+
+void display_output_x11::draw_cells(int x, int y, int w, int h, int cols,
+                                    int rows, int n,
+                                    const unsigned long *colours) {
+  static std::vector<int> cell_cols, cell_rows;
+
+  if (w <= 0 || h <= 0 || cols <= 0 || rows <= 0) { return; }
+  if (outlining) {
+    outlining = false;
+    for (const XPoint &o : outline_offsets) {
+      draw_cells(x + o.x, y + o.y, w, h, cols, rows, n, colours);
+    }
+    outlining = true;
+    return;
+  }
+  flush_primitives();
+
+  /* Every cell goes into one image sent with a single request, rather than a
+   * colour change and a rectangle per cell. */
+  int depth = DefaultDepth(display, screen);
+#ifdef BUILD_ARGB
+  if (have_argb_visual) { depth = 32; }
+#endif /* BUILD_ARGB */
+  Visual *visual =
+      window.visual != nullptr ? window.visual : DefaultVisual(display, screen);
+  XImage *image =
+      XCreateImage(display, visual, depth, ZPixmap, 0, nullptr, w, h, 32, 0);
+  if (image == nullptr) {
+    display_output_base::draw_cells(x, y, w, h, cols, rows, n, colours);
+    return;
+  }
+  image->data = static_cast<char *>(calloc(h, image->bytes_per_line));
+
+  /* the pixels of the full rows, then those of the cells in the last one */
+  n = std::min(n, cols * rows);
+  int full_h = n / cols * h / rows;
+  int last_w = n % cols * w / cols;
+  int last_h = (n % cols != 0 ? (n / cols + 1) * h / rows : full_h) - full_h;
+
+  cell_cols.resize(w);
+  cell_rows.resize(h);
+  for (int i = 0; i < w; i++) { cell_cols[i] = i * cols / w; }
+  for (int i = 0; i < h; i++) { cell_rows[i] = i * rows / h; }
+  for (int py = 0; py < full_h + last_h; py++) {
+    int first = cell_rows[py] * cols;
+    for (int px = 0; px < w; px++) {
+      int cell = first + cell_cols[px];
+      if (cell < n) { XPutPixel(image, px, py, window_pixel(colours[cell])); }
+    }
+  }
+
+  if (full_h > 0) {
+    XPutImage(display, window.drawable, window.gc, image, 0, 0, x, y, w,
+              full_h);
+  }
+  if (last_w > 0 && last_h > 0) {
+    XPutImage(display, window.drawable, window.gc, image, 0, full_h, x,
+              y + full_h, last_w, last_h);
+  }
+  XDestroyImage(image);
+}
+
 void display_output_x11::move_win(int x, int y) {
   window.x = x;
   window.y = y;
   XMoveWindow(display, window.window, x, y);
 }
 
+bool display_output_x11::clipped_out(int x, int y, int w, int h) {
+  return drawing_clipped &&
+         XRectInRegion(x11_stuff.region, x, y, w, h) == RectangleOut;
+}
+
 int display_output_x11::dpi_scale(int value) {
 #if defined(BUILD_XFT)
   if (use_xft.get(*state) && xft_dpi > 0) {
@@ -679,14 +1163,56 @@ int display_output_x11::dpi_scale(int value) {
 #endif /* defined(BUILD_XFT) */
 }
 
+void display_output_x11::line_inner_done() { flush_text(); }
+
+void display_output_x11::end_draw_text() {
+  flush_text();
+  flush_primitives();
+}
+
 void display_output_x11::end_draw_stuff() {
+  flush_text();
+  flush_primitives();
 #if defined(BUILD_XDBE)
+  unsigned long pixel;
+  if (drawing_clipped && use_xdbe.get(*state) &&
+      xdbe_copies_back_buffer(&pixel)) {
+    /* the back buffer keeps its contents either way, so only copy what was
+     * redrawn: a swap damages the whole window, and a compositor (XWayland
+     * in particular) would composite all of it again on every update */
+    XRectangle box;
+    XClipBox(x11_stuff.region, &box);
+    XCopyArea(display, window.back_buffer, window.window, window.gc, box.x,
+              box.y, box.width, box.height, box.x, box.y);
+    return;
+  }
   xdbe_swap_buffers();
 #else
   xpmdb_swap_buffers();
 #endif
 }
 
+void display_output_x11::clear_damaged_text() {
+  std::vector<std::pair<int, int>> bands;
+
+  if (!get_text_damage(bands)) {
+    clear_text(1);
+    return;
+  }
+#ifdef BUILD_XDBE
+  if (use_xdbe.get(*state)) { return; }
+#else
+  if (use_xpmdb.get(*state)) { return; }
+#endif
+  if ((display == nullptr) || (window.window == 0u)) { return; }
+
+  int border_total = get_border_total();
+  for (const auto &band : bands) {
+    XClearArea(display, window.window, text_start_x - border_total, band.first,
+               text_width + 2 * border_total, band.second - band.first, True);
+  }
+}
+
 void display_output_x11::clear_text(int exposures) {
 #ifdef BUILD_XDBE
   if (use_xdbe.get(*state)) {
@@ -785,6 +1311,7 @@ void display_output_x11::set_font(unsigned int f) {
 
 void display_output_x11::free_fonts(bool utf8) {
   for (auto &font : x_fonts) {
+    if (font.borrowed) { continue; }
 #ifdef BUILD_XFT
     if (use_xft.get(*state)) {
       /*
@@ -804,6 +1331,7 @@ void display_output_x11::free_fonts(bool utf8) {
     }
   }
   x_fonts.clear();
+  x_fonts_loaded = 0;
 #ifdef BUILD_XFT
   if (window.xftdraw != nullptr) {
     XftDrawDestroy(window.xftdraw);
@@ -811,11 +1339,60 @@ void display_output_x11::free_fonts(bool utf8) {
   }
 #endif /* BUILD_XFT */
 }
+size_t display_output_x11::fonts_memory() {
+  size_t size = x_fonts.capacity() * sizeof(x_font_list);
+  for (const auto &font : x_fonts) {
+#ifdef BUILD_XFT
+    /* the map nodes: next pointer, cached hash, key and value */
+    for (const auto &w : font.widths) {
+      size += 2 * sizeof(void *) + sizeof(w) + w.first.capacity();
+    }
+    size += font.widths.bucket_count() * sizeof(void *);
+#endif /* BUILD_XFT */
+    /* Xft keeps its glyphs out of sight, only core fonts can be measured */
+    if (font.borrowed || font.font == nullptr) { continue; }
+    const XFontStruct *f = font.font;
+    size += sizeof(XFontStruct) + f->n_properties * sizeof(XFontProp);
+    if (f->per_char != nullptr) {
+      size += ((f->max_byte1 - f->min_byte1 + 1) *
+               (f->max_char_or_byte2 - f->min_char_or_byte2 + 1)) *
+              sizeof(XCharStruct);
+    }
+  }
+  return size;
+}
+
+/* Every ${font} in the text adds an entry to fonts, so the same name tends
+ * to be there many times. Only the first of them is opened, the others use
+ * its fonts. */
+static void borrow_font(unsigned int i) {
+  auto &xfont = x_fonts[i];
+
+  if (xfont.borrowed || xfont.font != nullptr || xfont.fontset != nullptr) {
+    return;
+  }
+#ifdef BUILD_XFT
+  if (xfont.xftfont != nullptr) { return; }
+#endif /* BUILD_XFT */
+  for (unsigned int j = 0; j < i; j++) {
+    if (fonts[j].name != fonts[i].name || x_fonts[j].borrowed) { continue; }
+    xfont.font = x_fonts[j].font;
+    xfont.fontset = x_fonts[j].fontset;
+#ifdef BUILD_XFT
+    xfont.xftfont = x_fonts[j].xftfont;
+#endif /* BUILD_XFT */
+    xfont.borrowed = true;
+    return;
+  }
+}
+
 void display_output_x11::load_fonts(bool utf8) {
   x_fonts.resize(fonts.size());
-  for (unsigned int i = 0; i < fonts.size(); i++) {
+  for (unsigned int i = x_fonts_loaded; i < fonts.size(); i++) {
     auto &font = fonts[i];
     auto &xfont = x_fonts[i];
+
+    borrow_font(i);
 #ifdef BUILD_XFT
     /* load Xft font */
     if (use_xft.get(*state)) {
@@ -861,6 +1438,7 @@ void display_output_x11::load_fonts(bool utf8) {
       }
     }
   }
+  x_fonts_loaded = fonts.size();
 }
 
 #endif /* BUILD_X11 */
@@ -47,6 +47,8 @@ class display_output_x11 : public display_output_base {
   virtual bool initialize();
   virtual bool shutdown();
 
+  virtual bool hidden();
+
   virtual bool main_loop_wait(double);
 
   virtual void sigterm_cleanup();
@@ -59,6 +61,8 @@ class display_output_x11 : public display_output_base {
 
   // GUI interface
   virtual void draw_string_at(int, int, const char *, int);
+  virtual bool begin_outline();
+  virtual void end_outline();
   // X11 lookalikes
   virtual void set_line_style(int, bool);
   virtual void set_dashes(char *);
@@ -66,11 +70,18 @@ class display_output_x11 : public display_output_base {
   virtual void draw_rect(int, int, int, int);
   virtual void fill_rect(int, int, int, int);
   virtual void draw_arc(int, int, int, int, int, int);
+  virtual void draw_graph(int, int, int, const int *, const unsigned long *);
+  virtual void draw_cells(int, int, int, int, int, int, int,
+                          const unsigned long *);
   virtual void move_win(int, int);
   virtual int dpi_scale(int);
+  virtual bool clipped_out(int, int, int, int);
 
+  virtual void line_inner_done();
+  virtual void end_draw_text();
   virtual void end_draw_stuff();
   virtual void clear_text(int);
+  virtual void clear_damaged_text();
 
   virtual int font_height(unsigned int);
   virtual int font_ascent(unsigned int);
@@ -79,6 +90,7 @@ class display_output_x11 : public display_output_base {
   virtual void set_font(unsigned int);
   virtual void free_fonts(bool);
   virtual void load_fonts(bool);
+  virtual size_t fonts_memory();
 
   // X11-specific
 };
@@ -51,6 +51,11 @@
 
 #include <dev/acpica/acpiio.h>
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "conky.h"
 #include "diskio.h"
 #include "dragonfly.h"
@@ -64,10 +69,35 @@
 
 static short cpu_setup = 0;
 
+/* MIBs of the sysctls read by name, so each name is only translated once */
+struct sysctl_mib {
+  int mib[CTL_MAXNAME];
+  size_t len;
+};
+static std::mutex sysctl_mibs_mutex;
+static std::unordered_map<std::string, sysctl_mib> sysctl_mibs;
+
+/* Looks the MIB of name up, returns false if there is no such sysctl. A
+ * missing one isn't remembered, its driver may be loaded later. */
+static bool get_sysctl_mib(const char *name, sysctl_mib *mib) {
+  std::lock_guard<std::mutex> guard(sysctl_mibs_mutex);
+  auto it = sysctl_mibs.find(name);
+  if (it != sysctl_mibs.end()) {
+    *mib = it->second;
+    return true;
+  }
+  mib->len = CTL_MAXNAME;
+  if (sysctlnametomib(name, mib->mib, &mib->len) == -1) { return false; }
+  sysctl_mibs.emplace(name, *mib);
+  return true;
+}
+
 static int getsysctl(const char *name, void *ptr, size_t len) {
   size_t nlen = len;
+  sysctl_mib mib;
 
-  if (sysctlbyname(name, ptr, &nlen, nullptr, 0) == -1) {
+  if (!get_sysctl_mib(name, &mib) ||
+      sysctl(mib.mib, mib.len, ptr, &nlen, nullptr, 0) == -1) {
     fprintf(stderr, "getsysctl(): %s failed '%s'\n", name, strerror(errno));
     return -1;
   }
@@ -233,50 +263,55 @@ int update_net_stats(void) {
   return 0;
 }
 
-static int kern_proc_all_n() {
-  size_t len = 0;
+/* Reads the process table, with an entry for each lwp, into a buffer which
+ * is kept from one update to the next. Returns nullptr on failure. */
+static struct kinfo_proc *kern_proc_all(size_t *proc_n) {
+  static std::vector<struct kinfo_proc> procs;
+  sysctl_mib mib;
 
-  if (sysctlbyname("kern.proc.all_lwp", nullptr, &len, NULL, 0) == -1) {
+  if (!get_sysctl_mib("kern.proc.all_lwp", &mib)) {
     perror("kern.proc.all_lwp");
-    return -1;
+    return nullptr;
   }
-
-  if (len % sizeof(struct kinfo_proc)) {
-    fprintf(stderr,
-            "kern_proc(): "
-            "len %% sizeof(struct kinfo_proc) != 0");
-    return -1;
-  }
-
-  return len / sizeof(struct kinfo_proc);
-}
-
-static struct kinfo_proc *kern_proc_all(size_t proc_n) {
-  if (proc_n > 0) {
-    size_t len = proc_n * sizeof(struct kinfo_proc);
-    struct kinfo_proc *kp = (struct kinfo_proc *)malloc(len);
-
-    if (kp) {
-      if (sysctlbyname("kern.proc.all_lwp", kp, &len, nullptr, 0) == -1)
+  for (;;) {
+    size_t len = procs.size() * sizeof(struct kinfo_proc);
+    if (procs.empty() ||
+        sysctl(mib.mib, mib.len, procs.data(), &len, nullptr, 0) == -1) {
+      if (!procs.empty() && errno != ENOMEM) {
         perror("kern_proc(): kern.proc.all_lwp");
-      else
-        return kp;
-      free(kp);
-    } else
-      perror("malloc");
+        return nullptr;
+      }
+      /* too small, make room for what there is now and some more */
+      len = 0;
+      if (sysctl(mib.mib, mib.len, nullptr, &len, nullptr, 0) == -1) {
+        perror("kern.proc.all_lwp");
+        return nullptr;
+      }
+      procs.resize(len / sizeof(struct kinfo_proc) * 5 / 4 + 16);
+      continue;
+    }
+    if (len % sizeof(struct kinfo_proc)) {
+      fprintf(stderr,
+              "kern_proc(): "
+              "len %% sizeof(struct kinfo_proc) != 0");
+      return nullptr;
+    }
+    *proc_n = len / sizeof(struct kinfo_proc);
+    return procs.data();
   }
-  return nullptr;
 }
 
 void get_cpu_count(void) {
-  int cpu_count = 0;
+  /* hw.ncpu doesn't change while we run */
+  static int cpu_count = -1;
 
-  if (GETSYSCTL("hw.ncpu", cpu_count) == 0) {
-    info.cpu_count = cpu_count;
-  } else {
+  if (info.cpu_usage) { return; }
+
+  if (cpu_count < 0 && GETSYSCTL("hw.ncpu", cpu_count) != 0) {
     fprintf(stderr, "Cannot get hw.ncpu\n");
-    info.cpu_count = 0;
+    cpu_count = 0;
   }
+  info.cpu_count = cpu_count;
 
   info.cpu_usage = (float *)malloc((info.cpu_count + 1) * sizeof(float));
   if (info.cpu_usage == nullptr) { CRIT_ERR(nullptr, NULL, "malloc"); }
@@ -688,13 +723,12 @@ static void proc_fill(struct kinfo_proc *kp, size_t proc_n) {
 }
 
 void get_top_info(void) {
-  size_t proc_n = kern_proc_all_n();
-  struct kinfo_proc *kp = kern_proc_all(proc_n);
+  size_t proc_n = 0;
+  struct kinfo_proc *kp = kern_proc_all(&proc_n);
 
   if (kp) {
     proc_count(kp, proc_n);
     proc_fill(kp, proc_n);
-    free(kp);
   }
 }
 
@@ -29,106 +29,137 @@
 
 #include "exec.h"
 #include <fcntl.h>
+#include <spawn.h>
+#include <csignal>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <cmath>
 #include <cstdio>
 #include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "conky.h"
 #include "core.h"
 #include "logging.h"
+#include "reactor.hh"
 #include "specials.h"
 #include "text_object.h"
 #include "update-cb.hh"
 
+extern char **environ;
+
 struct execi_data {
   float interval{0};
   char *cmd{nullptr};
   execi_data() = default;
 };
 
-static const int cmd_len = 256;
-static char cmd[cmd_len];
-
-static char *remove_excess_quotes(const char *);
-static char *remove_excess_quotes(const char *command) {
-  char *cmd_ptr = cmd;
-  const char *command_ptr = command;
-  int skip = 0;
+/* strip one pair of quotes surrounding the whole command */
+static std::string remove_excess_quotes(const std::string &command) {
+  std::string cmd(command);
 
-  if ((cmd_len - 1) < (strlen(command) - 1)) {
-    snprintf(cmd, cmd_len - 1, "%s", command);
-    return cmd;
-  }
-
-  if (*command_ptr == '"' || *command_ptr == '\'') {
-    skip = 1;
-    command_ptr++;
+  if (!cmd.empty() && (cmd[0] == '"' || cmd[0] == '\'')) {
+    cmd.erase(0, 1);
+    if (!cmd.empty() && (cmd.back() == '"' || cmd.back() == '\'')) {
+      cmd.pop_back();
+    }
   }
+  return cmd;
+}
 
-  for (; *command_ptr; command_ptr++) {
-    if ('\0' == *(command_ptr + 1) && 1 == skip &&
-        (*command_ptr == '"' || *command_ptr == '\'')) {
-      continue;
+/* Split command into words if the shell would do nothing but that with it,
+ * so we can run it directly; returns false if it needs a shell. */
+static bool split_simple_command(const std::string &command,
+                                 std::vector<std::string> &words) {
+  words.clear();
+  std::string word;
+  for (char c : command) {
+    if (c == ' ' || c == '\t') {
+      if (!word.empty()) { words.push_back(std::move(word)); }
+      word.clear();
+    } else if ((isalnum(static_cast<unsigned char>(c)) != 0) ||
+               strchr("_-./:,+@%", c) != nullptr) {
+      word += c;
+    } else {
+      return false;
     }
-    *cmd_ptr++ = *command_ptr;
   }
-  *cmd_ptr = '\0';
-  return cmd;
+  if (!word.empty()) { words.push_back(std::move(word)); }
+  return !words.empty();
 }
 
-// our own implementation of popen, the difference : the value of 'childpid'
-// will be filled with the pid of the running 'command'. This is useful if want
-// to kill it when it hangs while reading or writing to it. We have to kill it
-// because pclose will wait until the process dies by itself
-static FILE *pid_popen(const char *command, const char *mode, pid_t *child) {
+/* Start command with its stdout going to the returned pipe, without a shell
+ * whenever possible. posix_spawn() avoids copying our page tables the way
+ * fork() does, which matters with a large conky running many exec objects.
+ * Returns -1 on failure. */
+static int spawn_command(const std::string &command, pid_t *child) {
+  std::string cmd = remove_excess_quotes(command);
+  std::vector<std::string> words;
+  std::vector<char *> argv;
+
+  if (split_simple_command(cmd, words)) {
+    for (auto &word : words) { argv.push_back(&word[0]); }
+  } else {
+    argv = {const_cast<char *>("sh"), const_cast<char *>("-c"), &cmd[0]};
+  }
+  argv.push_back(nullptr);
+
   int ends[2];
-  int parentend, childend;
-
-  // by running pipe after the strcmp's we make sure that we don't have to
-  // create a pipe and close the ends if mode is something illegal
-  if (strcmp(mode, "r") == 0) {
-    if (pipe(ends) != 0) { return nullptr; }
-    parentend = ends[0];
-    childend = ends[1];
-  } else if (strcmp(mode, "w") == 0) {
-    if (pipe(ends) != 0) { return nullptr; }
-    parentend = ends[1];
-    childend = ends[0];
+  if (pipe2(ends, O_CLOEXEC) != 0) { return -1; }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  // the dup2()ed descriptor has close-on-exec turned off
+  posix_spawn_file_actions_adddup2(&actions, ends[1], 1);
+
+  int err;
+  if (words.empty()) {
+    err = posix_spawn(child, "/bin/sh", &actions, nullptr, argv.data(),
+                      environ);
   } else {
-    return nullptr;
+    err = posix_spawnp(child, argv[0], &actions, nullptr, argv.data(),
+                       environ);
   }
+  posix_spawn_file_actions_destroy(&actions);
+  close(ends[1]);
 
-  *child = fork();
-  if (*child == -1) {
-    close(parentend);
-    close(childend);
-    return nullptr;
+  if (err != 0) {
+    close(ends[0]);
+    return -1;
   }
-  if (*child > 0) {
-    close(childend);
-    waitpid(*child, nullptr, 0);
-  } else {
-    // don't read from both stdin and pipe or write to both stdout and pipe
-    if (childend == ends[0]) {
-      close(0);
-    } else {
-      close(1);
-    }
-    close(parentend);
+  return ends[0];
+}
 
-    // by dupping childend, the returned fd will have close-on-exec turned off
-    if (fcntl(childend, F_DUPFD, 0) == -1) { perror("fcntl()"); }
-    close(childend);
+/* Runs command and reads what it prints into buffer, which keeps its
+ * capacity from the last run, so commands printing about the same every time
+ * read straight into it. Returns the length of the output without its last
+ * newline, or -1 if the command can't be run. */
+static ssize_t read_command(const std::string &command, std::string &buffer) {
+  pid_t childpid;
+  int fd = spawn_command(command, &childpid);
+  if (fd == -1) { return -1; }
 
-    execl("/bin/sh", "sh", "-c", remove_excess_quotes(command),
-          (char *)nullptr);
-    _exit(EXIT_FAILURE);  // child should die here, (normally execl will take
-                          // care of this but it can fail)
+  size_t length = 0;
+  for (;;) {
+    if (buffer.size() - length < 0x1000) {
+      buffer.resize(std::max<size_t>(buffer.size() * 2, 0x1000));
+    }
+    ssize_t n = read(fd, &buffer[length], buffer.size() - length);
+    if (n > 0) {
+      length += n;
+    } else if (n == 0 || errno != EINTR) {
+      break;
+    }
   }
+  close(fd);
+  while (waitpid(childpid, nullptr, 0) == -1 && errno == EINTR) {}
 
-  return fdopen(parentend, mode);
+  if (length > 0 && buffer[length - 1] == '\n') { --length; }
+  return length;
 }
 
 /**
@@ -139,30 +170,223 @@ static FILE *pid_popen(const char *command, const char *mode, pid_t *child) {
  * conky::run_all_callbacks() handles this. In order for this magic to
  * happen, we must register a callback with conky::register_cb<exec_cb>()
  * and store it somewhere, such as obj->exec_handle. To retrieve the
- * results, use the stored callback to call get_result_copy(), which
+ * results, use the stored callback to call read_result(), which
  * returns a std::string.
  */
 void exec_cb::work() {
-  pid_t childpid;
-  std::string buf;
-  std::shared_ptr<FILE> fp;
-  char b[0x1000];
+  ssize_t length = read_command(std::get<0>(tuple), buffer);
+  if (length == -1) { return; }
 
-  if (FILE *t = pid_popen(std::get<0>(tuple).c_str(), "r", &childpid)) {
-    fp.reset(t, fclose);
-  } else {
-    return;
+  std::lock_guard<std::mutex> l(result_mutex);
+  result.assign(buffer, 0, length);
+}
+
+namespace {
+/* reads a JSON document into exec_values, see parse_exec_values() */
+class json_values {
+  const char *p;
+  const char *end;
+  exec_values &values;
+
+  void skip_space() {
+    while (p < end && (isspace(static_cast<unsigned char>(*p)) != 0)) { ++p; }
   }
 
-  while ((feof(fp.get()) == 0) && (ferror(fp.get()) == 0)) {
-    int length = fread(b, 1, sizeof b, fp.get());
-    buf.append(b, length);
+  bool take(char c) {
+    skip_space();
+    if (p == end || *p != c) { return false; }
+    ++p;
+    return true;
   }
 
-  if (*buf.rbegin() == '\n') { buf.resize(buf.size() - 1); }
+  static void append_utf8(std::string &s, unsigned long c) {
+    if (c < 0x80) {
+      s += static_cast<char>(c);
+    } else if (c < 0x800) {
+      s += static_cast<char>(0xc0 | (c >> 6));
+      s += static_cast<char>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      s += static_cast<char>(0xe0 | (c >> 12));
+      s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      s += static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+      s += static_cast<char>(0xf0 | (c >> 18));
+      s += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      s += static_cast<char>(0x80 | (c & 0x3f));
+    }
+  }
+
+  bool hex4(unsigned long &c) {
+    if (end - p < 4) { return false; }
+    char digits[5] = {p[0], p[1], p[2], p[3], 0};
+    char *stop;
+    c = strtoul(digits, &stop, 16);
+    p += 4;
+    return *stop == 0;
+  }
+
+  bool string(std::string &s) {
+    if (!take('"')) { return false; }
+    s.clear();
+    while (p < end && *p != '"') {
+      if (*p != '\\') {
+        s += *p++;
+        continue;
+      }
+      if (++p == end) { return false; }
+      char c = *p++;
+      switch (c) {
+        case 'b':
+          s += '\b';
+          break;
+        case 'f':
+          s += '\f';
+          break;
+        case 'n':
+          s += '\n';
+          break;
+        case 'r':
+          s += '\r';
+          break;
+        case 't':
+          s += '\t';
+          break;
+        case 'u': {
+          unsigned long code;
+          if (!hex4(code)) { return false; }
+          unsigned long low;
+          if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' &&
+              p[1] == 'u') {
+            p += 2;
+            if (!hex4(low)) { return false; }
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+          }
+          append_utf8(s, code);
+          break;
+        }
+        default:
+          s += c;
+          break;
+      }
+    }
+    if (p == end) { return false; }
+    ++p;
+    return true;
+  }
 
+  bool value(const std::string &key) {
+    skip_space();
+    if (p == end) { return false; }
+
+    if (*p == '{' || *p == '[') {
+      bool object = *p++ == '{';
+      char close = object ? '}' : ']';
+      if (take(close)) { return true; }
+      std::string name;
+      for (size_t i = 0;; ++i) {
+        if (object) {
+          if (!string(name) || !take(':')) { return false; }
+        } else {
+          name = std::to_string(i);
+        }
+        if (!value(key.empty() ? name : key + "." + name)) { return false; }
+        if (take(close)) { return true; }
+        if (!take(',')) { return false; }
+      }
+    }
+
+    std::string scalar;
+    if (*p == '"') {
+      if (!string(scalar)) { return false; }
+    } else {
+      const char *token = p;
+      while (p < end && strchr(",}] \t\r\n", *p) == nullptr) { ++p; }
+      if (p == token) { return false; }
+      if (p - token != 4 || strncmp(token, "null", 4) != 0) {
+        scalar.assign(token, p - token);
+      }
+    }
+    values.emplace_back(key, std::move(scalar));
+    return true;
+  }
+
+ public:
+  json_values(const char *output, size_t length, exec_values &values_)
+      : p(output), end(output + length), values(values_) {}
+
+  /* returns the offset of the first error, or -1 */
+  ssize_t parse(const char *output) {
+    if (!value(std::string())) { return p - output; }
+    skip_space();
+    return p == end ? -1 : p - output;
+  }
+};
+}  // namespace
+
+static std::string trimmed(const char *begin, const char *end) {
+  while (begin < end && (isspace(static_cast<unsigned char>(*begin)) != 0)) {
+    ++begin;
+  }
+  while (end > begin && (isspace(static_cast<unsigned char>(end[-1])) != 0)) {
+    --end;
+  }
+  return std::string(begin, end);
+}
+
+void parse_exec_values(const char *output, size_t length,
+                       exec_values &values) {
+  values.clear();
+
+  const char *p = output;
+  const char *end = output + length;
+  while (p < end && (isspace(static_cast<unsigned char>(*p)) != 0)) { ++p; }
+
+  if (p < end && (*p == '{' || *p == '[')) {
+    ssize_t error = json_values(output, length, values).parse(output);
+    if (error != -1) {
+      NORM_ERR("execmulti: invalid JSON at offset %zd of the output", error);
+    }
+  } else {
+    /* key=value lines */
+    while (p < end) {
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      if (eol == nullptr) { eol = end; }
+      const char *equals = static_cast<const char *>(memchr(p, '=', eol - p));
+      if (equals != nullptr && *p != '#') {
+        std::string key = trimmed(p, equals);
+        if (!key.empty()) {
+          values.emplace_back(std::move(key), trimmed(equals + 1, eol));
+        }
+      }
+      p = eol + 1;
+    }
+  }
+
+  /* sorted for lookups, keeping the last of the values with the same key */
+  auto by_key = [](const exec_values::value_type &a,
+                   const exec_values::value_type &b) {
+    return a.first < b.first;
+  };
+  std::stable_sort(values.begin(), values.end(), by_key);
+  auto last = std::unique(values.rbegin(), values.rend(),
+                          [](const exec_values::value_type &a,
+                             const exec_values::value_type &b) {
+                            return a.first == b.first;
+                          });
+  values.erase(values.begin(), last.base());
+}
+
+/**
+ * Executes an ${execmulti} command and stores the values it printed
+ */
+void execmulti_cb::work() {
+  ssize_t length = read_command(std::get<0>(tuple), buffer);
+  if (length == -1) { return; }
+
+  parse_exec_values(buffer.data(), length, values);
   std::lock_guard<std::mutex> l(result_mutex);
-  result = buf;
+  result.swap(values);
 }
 
 // remove backspaced chars, example: "dog^H^H^Hcat" becomes "cat"
@@ -301,7 +525,8 @@ void scan_exec_arg(struct text_object *obj, const char *arg,
 void register_exec(struct text_object *obj) {
   if ((obj->data.s != nullptr) && (obj->data.s[0] != 0)) {
     obj->exec_handle = new conky::callback_handle<exec_cb>(
-        conky::register_cb<exec_cb>(1, true, obj->data.s));
+        conky::register_cb<exec_cb>(0, true, obj->data.s));
+    if (!obj->parse) { obj->generation = &(*obj->exec_handle)->generation; }
   } else {
     DBGP("unable to register exec callback");
   }
@@ -319,10 +544,10 @@ void register_execi(struct text_object *obj) {
   auto *ed = static_cast<struct execi_data *>(obj->data.opaque);
 
   if ((ed != nullptr) && (ed->cmd != nullptr) && (ed->cmd[0] != 0)) {
-    uint32_t period =
-        std::max(lround(ed->interval / active_update_interval()), 1l);
+    double period = ed->interval;
     obj->exec_handle = new conky::callback_handle<exec_cb>(
         conky::register_cb<exec_cb>(period, !obj->thread, ed->cmd));
+    if (!obj->parse) { obj->generation = &(*obj->exec_handle)->generation; }
   } else {
     DBGP("unable to register execi callback");
   }
@@ -337,7 +562,7 @@ void register_execi(struct text_object *obj) {
  */
 void print_exec(struct text_object *obj, char *p, unsigned int p_max_size) {
   if (obj->exec_handle != nullptr) {
-    fill_p((*obj->exec_handle)->get_result_copy().c_str(), obj, p, p_max_size);
+    fill_p((*obj->exec_handle)->read_result().c_str(), obj, p, p_max_size);
   }
 }
 
@@ -349,7 +574,7 @@ void print_exec(struct text_object *obj, char *p, unsigned int p_max_size) {
  */
 double execbarval(struct text_object *obj) {
   if (obj->exec_handle != nullptr) {
-    return get_barnum((*obj->exec_handle)->get_result_copy().c_str());
+    return get_barnum((*obj->exec_handle)->read_result().c_str());
   }
   return 0.0;
 }
@@ -384,3 +609,254 @@ void free_execi(struct text_object *obj) {
   ed = nullptr;
   obj->data.opaque = nullptr;
 }
+
+/* How long to wait before starting an ${execstream} command again that
+ * exited; doubles for every run shorter than EXECSTREAM_STABLE seconds. */
+static const double EXECSTREAM_MIN_DELAY = 1;
+static const double EXECSTREAM_MAX_DELAY = 64;
+static const double EXECSTREAM_STABLE = 60;
+
+/**
+ * A command started once and kept running, whose stdout is read by the
+ * main loop as it arrives. Only the last complete line is kept.
+ */
+struct exec_stream {
+  std::string command;
+  std::string partial; /* the line being read */
+  std::string line;    /* the last complete line */
+  pid_t pid{-1};
+  int fd{-1};
+  double started{0};
+  double restart_at{0};
+  double delay{EXECSTREAM_MIN_DELAY};
+
+  explicit exec_stream(const char *cmd) : command(cmd) {}
+  ~exec_stream() { stop(); }
+
+  void start() {
+    fd = spawn_command(command, &pid);
+    if (fd == -1) {
+      NORM_ERR("execstream: can't run '%s'", command.c_str());
+      pid = -1;
+      schedule_restart();
+      return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    started = get_time();
+    conky::main_reactor().add(fd, [this]() { on_readable(); });
+  }
+
+  void stop() {
+    if (fd != -1) {
+      conky::main_reactor().remove(fd);
+      close(fd);
+      fd = -1;
+    }
+    if (pid != -1) {
+      kill(pid, SIGTERM);
+      if (waitpid(pid, nullptr, WNOHANG) == 0) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+      }
+      pid = -1;
+    }
+  }
+
+  void schedule_restart() {
+    if (started != 0 && get_time() - started >= EXECSTREAM_STABLE) {
+      delay = EXECSTREAM_MIN_DELAY;
+    }
+    restart_at = get_time() + delay;
+    delay = std::min(delay * 2, EXECSTREAM_MAX_DELAY);
+  }
+
+  void on_readable() {
+    char b[0x1000];
+    ssize_t n;
+
+    while ((n = read(fd, b, sizeof b)) > 0) { partial.append(b, n); }
+    std::string::size_type end = partial.rfind('\n');
+    if (end != std::string::npos) {
+      std::string::size_type begin = partial.rfind('\n', end - 1);
+      begin = (end == 0 || begin == std::string::npos) ? 0 : begin + 1;
+      line.assign(partial, begin, end - begin);
+      partial.erase(0, end + 1);
+    }
+    if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+      /* the command exited (or at least closed its stdout) */
+      conky::main_reactor().remove(fd);
+      close(fd);
+      fd = -1;
+      if (waitpid(pid, nullptr, WNOHANG) != 0) { pid = -1; }
+      partial.clear();
+      schedule_restart();
+    }
+  }
+
+  /* restart the command if it has exited and its delay has passed */
+  void check() {
+    if (fd != -1 || get_time() < restart_at) { return; }
+    if (pid != -1) {
+      /* closed its stdout without exiting; don't let it linger */
+      stop();
+    }
+    start();
+  }
+};
+
+/**
+ * Parse the argument of an ${execstream} object and start its command
+ *
+ * @param[out] obj stores the exec_stream
+ * @param[in] arg the command
+ */
+void scan_execstream(struct text_object *obj, const char *arg) {
+  if (arg == nullptr || *arg == 0) { return; }
+
+  auto *stream = new exec_stream(arg);
+  stream->start();
+  obj->data.opaque = stream;
+}
+
+/**
+ * Print the last line an ${execstream} command has output
+ *
+ * @param[in] obj holds the exec_stream
+ * @param[out] p the string in which we store the line
+ * @param[in] p_max_size the maximum size of p...
+ */
+void print_execstream(struct text_object *obj, char *p,
+                      unsigned int p_max_size) {
+  auto *stream = static_cast<exec_stream *>(obj->data.opaque);
+
+  if (stream == nullptr) { return; }
+  stream->check();
+  fill_p(stream->line.c_str(), obj, p, p_max_size);
+}
+
+/**
+ * Stop the command of an ${execstream} object
+ *
+ * @param[in] obj holds the exec_stream
+ */
+void free_execstream(struct text_object *obj) {
+  delete static_cast<exec_stream *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
+
+/* the ${execmulti} commands by name, for ${execval} to read from */
+static std::unordered_map<std::string, conky::callback_handle<execmulti_cb>>
+    exec_tables;
+
+struct execmulti_data {
+  std::string name;
+  execmulti_cb *cb;
+};
+
+struct execval_data {
+  std::string table;
+  std::string key;
+};
+
+/**
+ * Parse the arguments of an ${execmulti} object and register its command
+ * under its name
+ *
+ * @param[out] obj stores the name
+ * @param[in] arg interval, name and command
+ */
+void scan_execmulti(struct text_object *obj, const char *arg) {
+  float interval;
+  char name[128];
+  int n = -1;
+
+  if (sscanf(arg, "%f %127s %n", &interval, name, &n) != 2 || n == -1 ||
+      arg[n] == 0) {
+    NORM_ERR("execmulti needs arguments: <interval> <name> <command>");
+    return;
+  }
+
+  auto handle = conky::register_cb<execmulti_cb>(interval, true, arg + n);
+  auto inserted = exec_tables.emplace(name, handle);
+  if (!inserted.second) {
+    NORM_ERR("execmulti: there already is one named '%s'", name);
+    inserted.first->second = handle;
+  }
+  obj->data.opaque = new execmulti_data{name, &*handle};
+}
+
+void free_execmulti(struct text_object *obj) {
+  auto *em = static_cast<execmulti_data *>(obj->data.opaque);
+
+  if (em == nullptr) { return; }
+  auto it = exec_tables.find(em->name);
+  /* unless another one took over the name */
+  if (it != exec_tables.end() && &*it->second == em->cb) {
+    exec_tables.erase(it);
+  }
+  delete em;
+  obj->data.opaque = nullptr;
+}
+
+/**
+ * Parse the arguments of an ${execval*} object
+ *
+ * @param[out] obj stores the name of the execmulti and the key
+ * @param[in] arg the arguments, with those of a bar before or those of a
+ * graph after them
+ * @param[in] execflag EF_BAR or EF_GRAPH for those, otherwise 0
+ */
+void scan_execval(struct text_object *obj, const char *arg,
+                  unsigned int execflag) {
+  char table[128];
+  char key[128];
+  int n = 0;
+
+  if ((execflag & EF_BAR) != 0u) { arg = scan_bar(obj, arg, 100); }
+  if (arg == nullptr || sscanf(arg, "%127s %127s %n", table, key, &n) != 2) {
+    NORM_ERR("execval needs arguments: <execmulti name> <key>");
+    return;
+  }
+#ifdef BUILD_GUI
+  if ((execflag & EF_GRAPH) != 0u) {
+    free(scan_graph(obj, arg + n, 100));
+  }
+#endif /* BUILD_GUI */
+
+  obj->data.opaque = new execval_data{table, key};
+}
+
+/* the value of an ${execval*} object, nullptr if there is none (yet) */
+static const std::string *find_exec_value(struct text_object *obj) {
+  auto *ev = static_cast<execval_data *>(obj->data.opaque);
+  if (ev == nullptr) { return nullptr; }
+
+  auto table = exec_tables.find(ev->table);
+  if (table == exec_tables.end()) { return nullptr; }
+
+  const exec_values &values = table->second->read_result();
+  auto value = std::lower_bound(
+      values.begin(), values.end(), ev->key,
+      [](const exec_values::value_type &v, const std::string &key) {
+        return v.first < key;
+      });
+  if (value == values.end() || value->first != ev->key) { return nullptr; }
+  return &value->second;
+}
+
+void print_execval(struct text_object *obj, char *p, unsigned int p_max_size) {
+  const std::string *value = find_exec_value(obj);
+
+  if (value != nullptr) { snprintf(p, p_max_size, "%s", value->c_str()); }
+}
+
+double execvalbarval(struct text_object *obj) {
+  const std::string *value = find_exec_value(obj);
+
+  return value != nullptr ? get_barnum(value->c_str()) : 0.0;
+}
+
+void free_execval(struct text_object *obj) {
+  delete static_cast<execval_data *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
@@ -30,6 +30,9 @@
 #ifndef _EXEC_H
 #define _EXEC_H
 
+#include <string>
+#include <utility>
+#include <vector>
 #include "update-cb.hh"
 
 /**
@@ -50,12 +53,47 @@
 class exec_cb : public conky::callback<std::string, std::string> {
   typedef conky::callback<std::string, std::string> Base;
 
+  /* command output; reused from one run to the next */
+  std::string buffer;
+
+ protected:
+  virtual void work();
+
+ public:
+  exec_cb(double period, bool wait, const std::string &cmd)
+      : Base(period, wait, Base::Tuple(cmd)) {
+    set_power_source("exec");
+  }
+};
+
+/* the values an ${execmulti} command printed, sorted by key */
+typedef std::vector<std::pair<std::string, std::string>> exec_values;
+
+/*
+ * Parses command output into values: either a JSON document, whose nested
+ * keys are joined by dots ({"cpu": {"temp": 40}, "fan": [900]} gives cpu.temp
+ * and fan.0), or key=value lines. Of repeated keys the last one counts.
+ */
+void parse_exec_values(const char *output, size_t length, exec_values &values);
+
+/**
+ * A callback that executes a command once for any number of ${execval}
+ * objects, and keeps the values it printed.
+ */
+class execmulti_cb : public conky::callback<exec_values, std::string> {
+  typedef conky::callback<exec_values, std::string> Base;
+
+  std::string buffer;
+  exec_values values;
+
  protected:
   virtual void work();
 
  public:
-  exec_cb(uint32_t period, bool wait, const std::string &cmd)
-      : Base(period, wait, Base::Tuple(cmd)) {}
+  execmulti_cb(double period, bool wait, const std::string &cmd)
+      : Base(period, wait, Base::Tuple(cmd)) {
+    set_power_source("exec");
+  }
 };
 
 /**
@@ -79,5 +117,14 @@ void print_exec(struct text_object *, char *, unsigned int);
 double execbarval(struct text_object *);
 void free_exec(struct text_object *);
 void free_execi(struct text_object *);
+void scan_execstream(struct text_object *, const char *);
+void print_execstream(struct text_object *, char *, unsigned int);
+void free_execstream(struct text_object *);
+void scan_execmulti(struct text_object *, const char *);
+void free_execmulti(struct text_object *);
+void scan_execval(struct text_object *, const char *, unsigned int);
+void print_execval(struct text_object *, char *, unsigned int);
+double execvalbarval(struct text_object *);
+void free_execval(struct text_object *);
 
 #endif /* _EXEC_H */
@@ -0,0 +1,500 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "file-watch.hh"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "common.h"
+#include "config.h"
+#include "conky.h"
+#include "text_object.h"
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif /* __linux__ */
+
+#ifdef HAVE_SYS_INOTIFY_H
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc99-extensions"
+#include <sys/inotify.h>
+#pragma clang diagnostic pop
+#endif /* HAVE_SYS_INOTIFY_H */
+
+namespace conky {
+namespace {
+#ifdef __linux__
+/* statfs() f_type of filesystems which make up their contents when they are
+ * read, so neither inotify nor the mtime tell when they change */
+const uint32_t volatile_filesystems[] = {
+    0x9fa0,     /* proc */
+    0x62656572, /* sysfs */
+    0x64626720, /* debugfs */
+    0x74726163, /* tracefs */
+    0x27e0eb,   /* cgroup */
+    0x63677270, /* cgroup2 */
+    0x73636673, /* securityfs */
+    0xde5e81e4, /* efivarfs */
+};
+
+/* and of those where others can change files without inotify noticing */
+const uint32_t remote_filesystems[] = {
+    0x6969,     /* nfs */
+    0x517b,     /* smb */
+    0xff534d42, /* cifs */
+    0xfe534d42, /* smb2 */
+    0x73757245, /* coda */
+    0x5346414f, /* afs */
+    0x6b414653, /* kafs */
+    0x00c36400, /* ceph */
+    0x01021997, /* 9p */
+    0x65735546, /* fuse */
+};
+
+bool is_one_of(uint32_t type, const uint32_t *types, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (types[i] == type) { return true; }
+  }
+  return false;
+}
+#endif /* __linux__ */
+
+int64_t mtime_of(const struct stat &st) {
+#if defined(__APPLE__) && defined(__MACH__)
+  return st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+  return st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+}
+
+int64_t ctime_of(const struct stat &st) {
+#if defined(__APPLE__) && defined(__MACH__)
+  return st.st_ctimespec.tv_sec * 1000000000LL + st.st_ctimespec.tv_nsec;
+#else
+  return st.st_ctim.tv_sec * 1000000000LL + st.st_ctim.tv_nsec;
+#endif
+}
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+const uint64_t FNV_PRIME = 1099511628211ULL;
+}  // namespace
+
+/*
+ * One inotify instance for all watched files. It watches their directories
+ * rather than the files themselves, so files which don't exist yet and
+ * files that are replaced by rename() are noticed as well. Files which are
+ * symlinks are watched in the directory of the link and in that of its
+ * target.
+ */
+class watch_registry {
+#ifdef HAVE_SYS_INOTIFY_H
+  struct entry {
+    watched_file *file;
+    std::string name;
+  };
+
+  std::mutex mutex;
+  int fd{-1};
+  bool failed{false};
+  std::map<std::string, int> dirs;
+  std::multimap<int, entry> files;
+  double drained_at{-1};
+
+  void remove_locked(watched_file *f) {
+    for (auto it = files.begin(); it != files.end();) {
+      if (it->second.file != f) {
+        ++it;
+        continue;
+      }
+      int wd = it->first;
+      it = files.erase(it);
+      if (files.count(wd) == 0) {
+        inotify_rm_watch(fd, wd);
+        for (auto dir = dirs.begin(); dir != dirs.end(); ++dir) {
+          if (dir->second == wd) {
+            dirs.erase(dir);
+            break;
+          }
+        }
+      }
+    }
+    f->watched = false;
+  }
+
+  /* the directory is gone, so are the watches of its files, which are
+   * stat()ed from now on */
+  void forget(int wd) {
+    std::vector<watched_file *> gone;
+    auto range = files.equal_range(wd);
+    for (auto it = range.first; it != range.second; ++it) {
+      gone.push_back(it->second.file);
+    }
+    for (watched_file *f : gone) {
+      if (!f->watched) { continue; }
+      remove_locked(f);
+      f->mode_ = watched_file::STAT;
+      f->dirty = true;
+    }
+  }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+ public:
+  ~watch_registry() {
+#ifdef HAVE_SYS_INOTIFY_H
+    if (fd >= 0) { close(fd); }
+#endif /* HAVE_SYS_INOTIFY_H */
+  }
+
+  /* Watches for name in dir, a path as it is on disk. Returns false if it
+   * can't be watched. */
+  bool add(watched_file *f, const std::string &dir, const std::string &name) {
+#ifdef HAVE_SYS_INOTIFY_H
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0 && !failed) {
+      fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+      failed = fd < 0;
+    }
+    if (fd < 0) { return false; }
+
+    auto it = dirs.find(dir);
+    int wd = it != dirs.end() ? it->second : -1;
+    if (wd < 0) {
+      wd = inotify_add_watch(fd, dir.c_str(),
+                             IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                 IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                 IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                 IN_ONLYDIR);
+      if (wd < 0) { return false; }
+      dirs[dir] = wd;
+    }
+    files.emplace(wd, entry{f, name});
+    f->watched = true;
+    return true;
+#else
+    (void)f;
+    (void)dir;
+    (void)name;
+    return false;
+#endif /* HAVE_SYS_INOTIFY_H */
+  }
+
+  void remove(watched_file *f) {
+#ifdef HAVE_SYS_INOTIFY_H
+    std::lock_guard<std::mutex> lock(mutex);
+    remove_locked(f);
+#else
+    (void)f;
+#endif /* HAVE_SYS_INOTIFY_H */
+  }
+
+  /* marks the files inotify reported changes of, once per update */
+  void drain() {
+#ifdef HAVE_SYS_INOTIFY_H
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0 || drained_at == current_update_time) { return; }
+    drained_at = current_update_time;
+
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = ::read(fd, buf, sizeof(buf))) > 0) {
+      for (char *ptr = buf; ptr < buf + len;) {
+        auto *ev = reinterpret_cast<struct inotify_event *>(ptr);
+        ptr += sizeof(struct inotify_event) + ev->len;
+        if ((ev->mask & IN_Q_OVERFLOW) != 0) {
+          for (auto &file : files) { file.second.file->dirty = true; }
+        } else if ((ev->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) !=
+                   0) {
+          forget(ev->wd);
+        } else {
+          auto range = files.equal_range(ev->wd);
+          for (auto it = range.first; it != range.second; ++it) {
+            if (ev->len == 0 || it->second.name == ev->name) {
+              it->second.file->dirty = true;
+            }
+          }
+        }
+      }
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
+  }
+};
+
+static watch_registry &registry() {
+  static watch_registry r;
+  return r;
+}
+
+/* splits path into the directory and the name in it */
+static void split_path(const std::string &path, std::string &dir,
+                       std::string &name) {
+  size_t slash = path.find_last_of('/');
+  if (slash == std::string::npos) {
+    dir = ".";
+    name = path;
+  } else {
+    dir = slash == 0 ? "/" : path.substr(0, slash);
+    name = path.substr(slash + 1);
+  }
+}
+
+watched_file::watched_file(std::string path_) : path(std::move(path_)) {
+  split_path(open_file_path(path.c_str()), dir, name);
+  watch();
+}
+
+watched_file::~watched_file() {
+  if (watched) { registry().remove(this); }
+}
+
+std::shared_ptr<watched_file> watched_file::get(const std::string &path) {
+  static std::mutex mutex;
+  static std::map<std::string, std::weak_ptr<watched_file>> files;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  std::shared_ptr<watched_file> file = files[path].lock();
+  if (!file) {
+    file = std::make_shared<watched_file>(path);
+    files[path] = file;
+  }
+  return file;
+}
+
+/* how files in dir can be told to have changed */
+static watched_file::watch_mode mode_for(const std::string &dir) {
+#ifdef __linux__
+  struct statfs fs {};
+  if (statfs(dir.c_str(), &fs) == 0) {
+    auto type = static_cast<uint32_t>(fs.f_type);
+    if (is_one_of(type, volatile_filesystems,
+                  sizeof(volatile_filesystems) / sizeof(uint32_t))) {
+      return watched_file::VOLATILE;
+    }
+    if (is_one_of(type, remote_filesystems,
+                  sizeof(remote_filesystems) / sizeof(uint32_t))) {
+      return watched_file::STAT;
+    }
+  }
+#else
+  (void)dir;
+#endif /* __linux__ */
+  return watched_file::NOTIFY;
+}
+
+void watched_file::watch() {
+  mode_ = mode_for(dir);
+  if (mode_ != NOTIFY) { return; }
+  mode_ = STAT;
+
+  struct stat st {};
+  std::string on_disk = open_file_path(path.c_str());
+  if (lstat(on_disk.c_str(), &st) == 0 && S_ISLNK(st.st_mode)) {
+    /* the link's directory tells when it is pointed elsewhere, the
+     * target's when what it points to changes */
+    char *real = realpath(on_disk.c_str(), nullptr);
+    if (real == nullptr) { return; }
+    std::string target_dir, target_name;
+    split_path(real, target_dir, target_name);
+    free(real);
+    if (mode_for(target_dir) != NOTIFY ||
+        !registry().add(this, target_dir, target_name)) {
+      registry().remove(this);
+      mode_ = mode_for(target_dir) == VOLATILE ? VOLATILE : STAT;
+      return;
+    }
+    link = true;
+  } else {
+    link = false;
+  }
+  if (!registry().add(this, dir, name)) {
+    registry().remove(this);
+    return;
+  }
+  mode_ = NOTIFY;
+}
+
+/* stats the file, returns whether it looks any different */
+bool watched_file::changed() {
+  struct stat st {};
+
+  if (stat(open_file_path(path.c_str()).c_str(), &st) != 0) {
+    bool was = exists_;
+    exists_ = false;
+    size = -1;
+    return was;
+  }
+  bool same = exists_ && st.st_dev == dev && st.st_ino == ino &&
+              st.st_size == size && mtime_of(st) == mtime &&
+              ctime_of(st) == ctime;
+  exists_ = true;
+  dev = st.st_dev;
+  ino = st.st_ino;
+  size = st.st_size;
+  mtime = mtime_of(st);
+  ctime = ctime_of(st);
+  return !same;
+}
+
+void watched_file::refresh() {
+  if (refreshed_at == current_update_time) { return; }
+  refreshed_at = current_update_time;
+
+  if (mode_ == NOTIFY) {
+    registry().drain();
+    if (!dirty) { return; }
+    if (link) {
+      /* the link may point elsewhere now */
+      registry().remove(this);
+      watch();
+    }
+  }
+  dirty = false;
+  /* when inotify says it changed, it did, even if the mtime didn't */
+  if (changed() || mode_ != STAT) { stale = true; }
+}
+
+void watched_file::load() {
+  stale = false;
+  readable_ = false;
+  lines_ = words_ = 0;
+  head_.clear();
+  head_complete = true;
+
+  uint64_t h = FNV_OFFSET;
+  int fd = exists_ ? open(open_file_path(path.c_str()).c_str(),
+                          O_RDONLY | O_CLOEXEC)
+                   : -1;
+  if (fd >= 0) {
+    char buf[0x4000];
+    bool inword = false;
+    ssize_t len;
+
+    readable_ = true;
+    while ((len = ::read(fd, buf, sizeof(buf))) > 0) {
+      for (ssize_t i = 0; i < len; i++) {
+        h = (h ^ static_cast<unsigned char>(buf[i])) * FNV_PRIME;
+        if (buf[i] == '\n') { lines_++; }
+        if (isspace(static_cast<unsigned char>(buf[i])) == 0) {
+          if (!inword) { words_++; }
+          inword = true;
+        } else {
+          inword = false;
+        }
+      }
+      if (head_.size() < head_max) {
+        head_.append(buf, std::min<size_t>(len, head_max - head_.size()));
+      }
+      if (head_.size() >= head_max) { head_complete = false; }
+    }
+    close(fd);
+  }
+
+  if (h != hash_) { contained.clear(); }
+  hash_ = h;
+}
+
+uint64_t watched_file::hash() {
+  if (stale) { load(); }
+  return hash_;
+}
+
+bool watched_file::readable() {
+  if (stale) { load(); }
+  return readable_;
+}
+
+size_t watched_file::lines() {
+  if (stale) { load(); }
+  return lines_;
+}
+
+size_t watched_file::words() {
+  if (stale) { load(); }
+  return words_;
+}
+
+std::string watched_file::head(size_t max) {
+  if (max > head_max) {
+    head_max = max;
+    if (!head_complete) { stale = true; }
+  }
+  if (stale) { load(); }
+  return head_.substr(0, max);
+}
+
+bool watched_file::contains(const std::string &s) {
+  if (stale) { load(); }
+
+  auto it = contained.find(s);
+  if (it != contained.end()) { return it->second; }
+
+  bool found = false;
+  FILE *fp = readable_ ? fopen(open_file_path(path.c_str()).c_str(), "re")
+                       : nullptr;
+  if (fp != nullptr) {
+    char *line = nullptr;
+    size_t n = 0;
+    while (!found && getline(&line, &n, fp) >= 0) {
+      found = strstr(line, s.c_str()) != nullptr;
+    }
+    free(line);
+    fclose(fp);
+  }
+  contained[s] = found;
+  return found;
+}
+}  // namespace conky
+
+void scan_watched_file(struct text_object *obj, const char *path) {
+  if (path == nullptr) {
+    obj->data.opaque = nullptr;
+    return;
+  }
+  obj->data.opaque = new std::shared_ptr<conky::watched_file>(
+      conky::watched_file::get(path));
+}
+
+conky::watched_file *get_watched_file(struct text_object *obj) {
+  auto *file =
+      static_cast<std::shared_ptr<conky::watched_file> *>(obj->data.opaque);
+  if (file == nullptr) { return nullptr; }
+  (*file)->refresh();
+  return file->get();
+}
+
+void free_watched_file(struct text_object *obj) {
+  delete static_cast<std::shared_ptr<conky::watched_file> *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
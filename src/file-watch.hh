@@ -0,0 +1,121 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FILE_WATCH_HH
+#define FILE_WATCH_HH
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <sys/types.h>
+
+struct text_object;
+
+namespace conky {
+/*
+ * A file read by text objects, shared by all of them that read the same
+ * path, which keeps whether the file exists, a hash of its contents and the
+ * counts derived from them. Local files are watched with inotify where it
+ * is available, so an unchanged file costs nothing; files on network
+ * filesystems (and everywhere without inotify) get a stat() to see whether
+ * they changed, and files in /proc, /sys and the like, which don't tell
+ * either way, are read again every update. Links are followed, so it sees
+ * both what they point to changing and them being pointed elsewhere.
+ * Changes are looked for at most once per update. get() may be called from
+ * any thread, but an instance must not be used by two at once.
+ */
+class watched_file {
+ public:
+  enum watch_mode { NOTIFY, STAT, VOLATILE };
+
+  explicit watched_file(std::string path_);
+  ~watched_file();
+  watched_file(const watched_file &) = delete;
+  watched_file &operator=(const watched_file &) = delete;
+
+  static std::shared_ptr<watched_file> get(const std::string &path);
+
+  /* looks whether the file changed; what follows reads it again if so */
+  void refresh();
+
+  bool exists() const { return exists_; }
+  watch_mode mode() const { return mode_; }
+
+  /* the contents are only read when one of these asks for them */
+  bool readable();
+  uint64_t hash();
+  size_t lines();
+  size_t words();
+  /* the first max bytes of the file */
+  std::string head(size_t max);
+  /* whether a line of the file contains s, kept until the contents change */
+  bool contains(const std::string &s);
+
+ private:
+  std::string path;
+  std::string dir, name; /* where it is on disk */
+  std::atomic<watch_mode> mode_{STAT};
+  bool watched{false};
+  bool link{false};            /* the target's directory is watched too */
+  std::atomic<bool> dirty{true};
+  double refreshed_at{-1};
+
+  /* what the file looked like when it was read */
+  dev_t dev{0};
+  ino_t ino{0};
+  off_t size{-1};
+  int64_t mtime{0}, ctime{0};
+
+  bool exists_{false};
+  bool stale{true}; /* the contents need to be read again */
+  bool readable_{false};
+  uint64_t hash_{0};
+  size_t lines_{0}, words_{0};
+  std::string head_;
+  size_t head_max{0};
+  bool head_complete{false};
+  std::map<std::string, bool> contained;
+
+  void watch();
+  bool changed();
+  void load();
+
+  friend class watch_registry;
+};
+}  // namespace conky
+
+/* text objects reading a watched file have it as their opaque data */
+void scan_watched_file(struct text_object *obj, const char *path);
+conky::watched_file *get_watched_file(struct text_object *obj);
+void free_watched_file(struct text_object *obj);
+
+#endif /* FILE_WATCH_HH */
@@ -84,6 +84,14 @@ void load_fonts(bool utf8) {
   for (auto output : display_outputs()) output->load_fonts(utf8);
 }
 
+size_t fonts_memory(size_t *count) {
+  size_t size = fonts.capacity() * sizeof(font_list);
+  for (const auto &f : fonts) { size += f.name.capacity(); }
+  for (auto output : display_outputs()) { size += output->fonts_memory(); }
+  *count = fonts.size();
+  return size;
+}
+
 int font_height() {
   assert(selected_font < fonts.size());
   return display_output()->font_height(selected_font);
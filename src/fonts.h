@@ -53,6 +53,9 @@ void set_font(void);
 int add_font(const char *);
 void free_fonts(bool utf8);
 void load_fonts(bool utf8);
+/* the memory the fonts take, as far as the outputs can tell, for
+ * ${conky_mem}; count is set to the number of fonts */
+size_t fonts_memory(size_t *count);
 
 class font_setting : public conky::simple_config_setting<std::string> {
   typedef conky::simple_config_setting<std::string> Base;
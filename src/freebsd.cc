@@ -54,6 +54,8 @@
 #endif
 
 #include <mutex>
+#include <string>
+#include <unordered_map>
 
 #include "conky.h"
 #include "diskio.h"
@@ -80,10 +82,32 @@ __attribute__((gnu_inline)) inline void proc_find_top(struct process **cpu,
 
 static short conky_cpu_setup = 0;
 
+/* MIBs of the sysctls read by name, so each name is only translated once */
+struct sysctl_mib {
+  int mib[CTL_MAXNAME];
+  size_t len;
+};
+static std::mutex sysctl_mibs_mutex;
+static std::unordered_map<std::string, sysctl_mib> sysctl_mibs;
+
 static int getsysctl(const char *name, void *ptr, size_t len) {
   size_t nlen = len;
+  sysctl_mib mib;
+
+  {
+    std::lock_guard<std::mutex> guard(sysctl_mibs_mutex);
+    auto it = sysctl_mibs.find(name);
+    if (it != sysctl_mibs.end()) {
+      mib = it->second;
+    } else {
+      /* a missing one isn't remembered, its driver may be loaded later */
+      mib.len = CTL_MAXNAME;
+      if (sysctlnametomib(name, mib.mib, &mib.len) == -1) { return -1; }
+      sysctl_mibs.emplace(name, mib);
+    }
+  }
 
-  if (sysctlbyname(name, ptr, &nlen, nullptr, 0) == -1) { return -1; }
+  if (sysctl(mib.mib, mib.len, ptr, &nlen, nullptr, 0) == -1) { return -1; }
 
   if (nlen != len && errno == ENOMEM) { return -1; }
 
@@ -114,7 +138,28 @@ static int swapmode(unsigned long *retavail, unsigned long *retfree) {
   return n;
 }
 
-void prepare_update(void) {}
+/* bumped before each update, see get_procs() */
+static unsigned long update_generation = 0;
+
+void prepare_update(void) { ++update_generation; }
+
+/* Returns the process table, with an entry for each thread, as of this
+ * update. It is copied out of the kernel only once per update for all the
+ * process objects and top. The array belongs to kd, so only use it while
+ * holding kvm_proc_mutex. */
+static struct kinfo_proc *get_procs(int *n_processes) {
+  static unsigned long procs_generation = 0;
+  static struct kinfo_proc *procs = nullptr;
+  static int procs_n = 0;
+
+  if (procs == nullptr || procs_generation != update_generation) {
+    procs = kvm_getprocs(kd, KERN_PROC_ALL, 0, &procs_n);
+    if (procs == nullptr) { procs_n = 0; }
+    procs_generation = update_generation;
+  }
+  *n_processes = procs_n;
+  return procs;
+}
 
 int update_uptime(void) {
   int mib[2] = {CTL_KERN, KERN_BOOTTIME};
@@ -254,7 +299,7 @@ int update_total_processes(void) {
   int n_processes;
 
   std::lock_guard<std::mutex> guard(kvm_proc_mutex);
-  kvm_getprocs(kd, KERN_PROC_ALL, 0, &n_processes);
+  get_procs(&n_processes);
 
   info.procs = n_processes;
   return 0;
@@ -266,7 +311,7 @@ int update_running_processes(void) {
   int i, cnt = 0;
 
   std::lock_guard<std::mutex> guard(kvm_proc_mutex);
-  p = kvm_getprocs(kd, KERN_PROC_ALL, 0, &n_processes);
+  p = get_procs(&n_processes);
   for (i = 0; i < n_processes; i++) {
     if (p[i].ki_stat == SRUN) { cnt++; }
   }
@@ -276,14 +321,16 @@ int update_running_processes(void) {
 }
 
 void get_cpu_count(void) {
-  int cpu_count = 0;
+  /* hw.ncpu doesn't change while we run */
+  static int cpu_count = -1;
 
-  if (GETSYSCTL("hw.ncpu", cpu_count) == 0) {
-    info.cpu_count = cpu_count;
-  } else {
+  if (info.cpu_usage) { return; }
+
+  if (cpu_count < 0 && GETSYSCTL("hw.ncpu", cpu_count) != 0) {
     fprintf(stderr, "Cannot get hw.ncpu\n");
-    info.cpu_count = 0;
+    cpu_count = 0;
   }
+  info.cpu_count = cpu_count;
 
   info.cpu_usage = (float *)malloc((info.cpu_count + 1) * sizeof(float));
   if (info.cpu_usage == nullptr) { CRIT_ERR(nullptr, NULL, "malloc"); }
@@ -657,24 +704,32 @@ void get_top_info(void) {
   struct kinfo_proc *p;
   struct process *proc;
   int n_processes;
-  int i;
+  int i, j;
+  const size_t name_len = text_buffer_size.get(*state);
 
   std::lock_guard<std::mutex> guard(kvm_proc_mutex);
-  p = kvm_getprocs(kd, KERN_PROC_PROC, 0, &n_processes);
+  p = get_procs(&n_processes);
 
-  for (i = 0; i < n_processes; i++) {
+  /* the threads of a process are listed one after another, add them up */
+  for (i = 0; i < n_processes; i = j) {
+    fixpt_t pctcpu = 0;
+    uint64_t runtime = 0;
+
+    for (j = i; j < n_processes && p[j].ki_pid == p[i].ki_pid; j++) {
+      pctcpu += p[j].ki_pctcpu;
+      runtime += p[j].ki_runtime;
+    }
     if (!(p[i].ki_flag & P_SYSTEM)) {
       proc = get_process(p[i].ki_pid);
 
       proc->time_stamp = g_time;
-      proc->name = strndup(p[i].ki_comm, text_buffer_size.get(*state));
-      proc->basename = strndup(p[i].ki_comm, text_buffer_size.get(*state));
-      proc->amount = 100.0 * p[i].ki_pctcpu / FSCALE;
+      process_set_name(proc, p[i].ki_comm, p[i].ki_comm, name_len);
+      proc->amount = 100.0 * pctcpu / FSCALE;
       proc->vsize = p[i].ki_size;
       proc->rss = (p[i].ki_rssize * getpagesize());
       /* ki_runtime is in microseconds, total_cpu_time in centiseconds.
        * Therefore we divide by 10000. */
-      proc->total_cpu_time = p[i].ki_runtime / 10000;
+      proc->total_cpu_time = runtime / 10000;
     }
   }
 }
@@ -31,12 +31,21 @@
 #include <fcntl.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <atomic>
 #include <cctype>
 #include <cerrno>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
 #include "conky.h"
+#include "core.h"
 #include "logging.h"
+#include "reactor.hh"
 #include "specials.h"
 #include "text_object.h"
+#include "update-cb.hh"
 
 #ifdef HAVE_SYS_STATFS_H
 #include <sys/statfs.h>
@@ -63,58 +72,143 @@
 #include <mntent.h>
 #endif
 
-#define MAX_FS_STATS 64
+/* default refresh interval of fs stats, in seconds */
+#define DEFAULT_FS_INTERVAL 13
+/* how long a frame waits for statfs(), in seconds */
+#define FS_DEADLINE 0.25
 
-static struct fs_stat fs_stats_[MAX_FS_STATS];
-struct fs_stat *fs_stats = fs_stats_;
-
-static void update_fs_stat(struct fs_stat *fs);
+static void update_fs_stat(const char *path, struct fs_stat *fs,
+                           bool need_type);
 
 void get_fs_type(const char *path, char *result);
 
-int update_fs_stats() {
-  unsigned i;
-  static double last_fs_update = 0.0;
+namespace {
+/* bumped whenever something is mounted or unmounted */
+std::atomic<uint64_t> mount_generation{1};
+
+/*
+ * statfs()s one path on the callback pool. The frame waits for it only until
+ * FS_DEADLINE, so a hung network mount only ever blocks its own callback, and
+ * the objects showing it keep the last values until it returns.
+ */
+class fs_cb : public conky::callback<fs_stat, std::string> {
+  typedef conky::callback<fs_stat, std::string> Base;
+
+  uint64_t type_generation{0};
+
+ protected:
+  void work() override;
+
+ public:
+  fs_cb(double period, const std::string &path);
+  ~fs_cb() override;
+};
+
+/* the fs_cbs to expire when the mounts change */
+std::mutex fs_cbs_mutex;
+std::unordered_set<fs_cb *> fs_cbs;
+
+fs_cb::fs_cb(double period, const std::string &path)
+    : Base(period, true, Base::Tuple(path)) {
+  set_deadline(FS_DEADLINE);
+  strncpy(result.type, "unknown", DEFAULT_TEXT_BUFFER_SIZE);
+  std::lock_guard<std::mutex> lock(fs_cbs_mutex);
+  fs_cbs.insert(this);
+}
+
+fs_cb::~fs_cb() {
+  std::lock_guard<std::mutex> lock(fs_cbs_mutex);
+  fs_cbs.erase(this);
+}
+
+void fs_cb::work() {
+  fs_stat fs = get_result_copy();
+
+  /* finding the type means reading the mount table, so only do it again
+   * when that changed */
+  uint64_t generation = mount_generation;
+  update_fs_stat(get<0>().c_str(), &fs, type_generation != generation);
+  type_generation = generation;
 
-  if (current_update_time - last_fs_update < 13) { return 0; }
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = fs;
+}
+
+#ifdef __linux__
+int mountinfo_fd = -1;
+
+void mounts_changed() {
+  ++mount_generation;
+  std::lock_guard<std::mutex> lock(fs_cbs_mutex);
+  for (fs_cb *cb : fs_cbs) { cb->expire(); }
+}
 
-  for (i = 0; i < MAX_FS_STATS; ++i) {
-    if (fs_stats[i].set != 0) { update_fs_stat(&fs_stats[i]); }
+/* /proc/self/mountinfo polls with an exceptional condition after every
+ * change to the mount table */
+void watch_mounts() {
+  if (mountinfo_fd >= 0) { return; }
+  mountinfo_fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+  if (mountinfo_fd >= 0) {
+    conky::main_reactor().add(mountinfo_fd, mounts_changed, POLLPRI);
   }
-  last_fs_update = current_update_time;
-  return 0;
 }
+#endif /* __linux__ */
+}  // namespace
+
+struct fs_source {
+  conky::callback_handle<fs_cb> cb;
+
+  explicit fs_source(conky::callback_handle<fs_cb> &&cb_)
+      : cb(std::move(cb_)) {}
+};
+
+/* one fs_stat per path, shared by all the objects showing it */
+static std::map<std::string, fs_stat> fs_stats;
 
 void clear_fs_stats() {
-  unsigned i;
-  for (i = 0; i < MAX_FS_STATS; ++i) {
-    memset(&fs_stats[i], 0, sizeof(struct fs_stat));
+  for (auto &fs : fs_stats) { delete fs.second.source; }
+  fs_stats.clear();
+#ifdef __linux__
+  if (mountinfo_fd >= 0) {
+    conky::main_reactor().remove(mountinfo_fd);
+    close(mountinfo_fd);
+    mountinfo_fd = -1;
   }
+#endif /* __linux__ */
 }
 
-struct fs_stat *prepare_fs_stat(const char *s) {
-  struct fs_stat *next = nullptr;
-  unsigned i;
+struct fs_stat *prepare_fs_stat(const char *s, double interval) {
+  if (interval < 0) { interval = DEFAULT_FS_INTERVAL; }
+  double period = interval;
 
-  /* lookup existing or get new */
-  for (i = 0; i < MAX_FS_STATS; ++i) {
-    if (fs_stats[i].set != 0) {
-      if (strncmp(fs_stats[i].path, s, DEFAULT_TEXT_BUFFER_SIZE) == 0) {
-        return &fs_stats[i];
-      }
-    } else {
-      next = &fs_stats[i];
-    }
+#ifdef __linux__
+  watch_mounts();
+#endif /* __linux__ */
+
+  /* registering the path again keeps the shorter of the periods */
+  auto cb = conky::register_cb<fs_cb>(period, std::string(s));
+  fs_stat &fs = fs_stats[s];
+  if (fs.source == nullptr) {
+    strncpy(fs.type, "unknown", DEFAULT_TEXT_BUFFER_SIZE);
+    fs.source = new fs_source(std::move(cb));
   }
-  /* new path */
-  if (next == nullptr) {
-    NORM_ERR("too many fs stats");
-    return nullptr;
+  return &fs;
+}
+
+/* copies the latest values of the callback into fs for the print functions */
+static struct fs_stat *current_fs_stat(struct text_object *obj) {
+  auto *fs = static_cast<struct fs_stat *>(obj->data.opaque);
+
+  if (fs != nullptr && fs->source != nullptr) {
+    const fs_stat &latest = fs->source->cb->read_result();
+    fs->size = latest.size;
+    fs->avail = latest.avail;
+    fs->free = latest.free;
+    if (strcmp(fs->type, latest.type) != 0) {
+      strncpy(fs->type, latest.type, DEFAULT_TEXT_BUFFER_SIZE);
+    }
   }
-  strncpy(next->path, s, DEFAULT_TEXT_BUFFER_SIZE);
-  next->set = 1;
-  update_fs_stat(next);
-  return next;
+  return fs;
 }
 
 #if defined(__APPLE__)
@@ -125,11 +219,12 @@ struct fs_stat *prepare_fs_stat(const char *s) {
 #define statfs_struct statfs64
 #endif /* defined(__APPLE__) */
 
-static void update_fs_stat(struct fs_stat *fs) {
+static void update_fs_stat(const char *path, struct fs_stat *fs,
+                           bool need_type) {
 #if defined(__sun)
   struct statvfs s;
 
-  if (statvfs(fs->path, &s) == 0) {
+  if (statvfs(path, &s) == 0) {
     fs->size = (long long)s.f_blocks * s.f_frsize;
     fs->avail = (long long)s.f_bavail * s.f_frsize;
     fs->free = (long long)s.f_bfree * s.f_frsize;
@@ -137,15 +232,15 @@ static void update_fs_stat(struct fs_stat *fs) {
 #else
   struct statfs_struct s {};
 
-  if (statfs_func(fs->path, &s) == 0) {
+  if (statfs_func(path, &s) == 0) {
     fs->size = static_cast<long long>(s.f_blocks) * s.f_bsize;
     /* bfree (root) or bavail (non-roots) ? */
     fs->avail = static_cast<long long>(s.f_bavail) * s.f_bsize;
     fs->free = static_cast<long long>(s.f_bfree) * s.f_bsize;
-    get_fs_type(fs->path, fs->type);
+    if (need_type) { get_fs_type(path, fs->type); }
 #endif
   } else {
-    NORM_ERR("statfs '%s': %s", fs->path, strerror(errno));
+    NORM_ERR("statfs '%s': %s", path, strerror(errno));
     fs->size = 0;
     fs->avail = 0;
     fs->free = 0;
@@ -216,6 +311,10 @@ void get_fs_type(const char *path, char *result) {
 }
 
 void init_fs_bar(struct text_object *obj, const char *arg) {
+  std::string rest;
+  double interval;
+
+  arg = take_interval_arg(arg, rest, interval);
   arg = scan_bar(obj, arg, 1);
   if (arg != nullptr) {
     while (isspace(static_cast<unsigned char>(*arg)) != 0) { arg++; }
@@ -223,11 +322,11 @@ void init_fs_bar(struct text_object *obj, const char *arg) {
   } else {
     arg = "/";
   }
-  obj->data.opaque = prepare_fs_stat(arg);
+  obj->data.opaque = prepare_fs_stat(arg, interval);
 }
 
 static double get_fs_perc(struct text_object *obj, bool get_free) {
-  auto *fs = static_cast<struct fs_stat *>(obj->data.opaque);
+  struct fs_stat *fs = current_fs_stat(obj);
   double ret = 0.0;
 
   if ((fs != nullptr) && (fs->size != 0)) {
@@ -249,7 +348,11 @@ double fs_free_barval(struct text_object *obj) {
 }
 
 void init_fs(struct text_object *obj, const char *arg) {
-  obj->data.opaque = prepare_fs_stat(arg != nullptr ? arg : "/");
+  std::string rest;
+  double interval;
+
+  arg = take_interval_arg(arg, rest, interval);
+  obj->data.opaque = prepare_fs_stat(arg != nullptr ? arg : "/", interval);
 }
 
 uint8_t fs_free_percentage(struct text_object *obj) {
@@ -263,7 +366,7 @@ uint8_t fs_used_percentage(struct text_object *obj) {
 #define HUMAN_PRINT_FS_GENERATOR(name, expr)                 \
   void print_fs_##name(struct text_object *obj, char *p,     \
                        unsigned int p_max_size) {            \
-    struct fs_stat *fs = (struct fs_stat *)obj->data.opaque; \
+    struct fs_stat *fs = current_fs_stat(obj);               \
     if (fs) human_readable(expr, p, p_max_size);             \
   }
 
@@ -272,7 +375,7 @@ HUMAN_PRINT_FS_GENERATOR(size, fs->size)
 HUMAN_PRINT_FS_GENERATOR(used, fs->size - fs->free)
 
 void print_fs_type(struct text_object *obj, char *p, unsigned int p_max_size) {
-  auto *fs = static_cast<struct fs_stat *>(obj->data.opaque);
+  struct fs_stat *fs = current_fs_stat(obj);
 
   if (fs != nullptr) { snprintf(p, p_max_size, "%s", fs->type); }
 }
@@ -30,18 +30,28 @@
 #ifndef _FS_H
 #define _FS_H
 
+#include <cstring>
+
 #include "conky.h" /* DEFAULT_TEXT_BUFFER_SIZE */
 
+struct fs_source;
+
 /* needed here and by fs.c */
 struct fs_stat {
-  char path[DEFAULT_TEXT_BUFFER_SIZE];
   char type[DEFAULT_TEXT_BUFFER_SIZE];
   long long size;
   long long avail;
   long long free;
-  char set;
+  /* where the values above come from, unset when they are only a result */
+  struct fs_source *source{nullptr};
 };
 
+/* the same values, for callbacks backing off while they don't change */
+inline bool operator==(const fs_stat &a, const fs_stat &b) {
+  return a.size == b.size && a.avail == b.avail && a.free == b.free &&
+         strncmp(a.type, b.type, sizeof(a.type)) == 0;
+}
+
 /* forward declare to make gcc happy (fs.h <-> text_object.h include) */
 struct text_object;
 
@@ -57,8 +67,8 @@ void print_fs_size(struct text_object *, char *, unsigned int);
 void print_fs_used(struct text_object *, char *, unsigned int);
 void print_fs_type(struct text_object *, char *, unsigned int);
 
-int update_fs_stats(void);
-struct fs_stat *prepare_fs_stat(const char *s);
+/* interval < 0 picks the default of 13 seconds */
+struct fs_stat *prepare_fs_stat(const char *s, double interval = -1);
 void clear_fs_stats(void);
 
 #endif /* _FS_H */
@@ -30,6 +30,8 @@
 #include "conky.h"
 #include "logging.h"
 
+#include <algorithm>
+
 #ifdef BUILD_X11
 #include "x11.h"
 #endif /* BUILD_X11 */
@@ -143,6 +145,24 @@ gradient_factory::colour_array gradient_factory::create_gradient() {
   return colours;
 }
 
+const unsigned long *gradient_cache::get(
+    int mode, int width, unsigned long first_colour, unsigned long last_colour,
+    const std::function<gradient_factory::colour_array()> &make) {
+  auto it = std::find_if(entries.begin(), entries.end(), [&](const entry &e) {
+    return e.mode == mode && e.width == width &&
+           e.first_colour == first_colour && e.last_colour == last_colour;
+  });
+
+  if (it == entries.end()) {
+    if (entries.size() >= capacity) { entries.pop_back(); }
+    entries.push_back({mode, width, first_colour, last_colour, make()});
+    it = entries.end() - 1;
+  }
+  /* move it to the front; the arrays themselves stay where they are */
+  std::rotate(entries.begin(), it, it + 1);
+  return entries.front().colours.get();
+}
+
 long gradient_factory::get_hue(long *const rgb, long chroma, long value) {
   if (chroma == 0) { return 0; }
 
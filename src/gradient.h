@@ -30,7 +30,9 @@
 #ifndef _GRADIENT_H
 #define _GRADIENT_H
 
+#include <functional>
 #include <memory>
+#include <vector>
 
 namespace conky {
 class gradient_factory {
@@ -106,6 +108,36 @@ class hcl_gradient_factory : public gradient_factory {
   void convert_from_scaled_rgb(long *const scaled, long *target);
   void convert_to_scaled_rgb(long *const target, long *scaled);
 };
+
+/*
+ * The last few gradients handed out, so that a graph does not compute the
+ * same one again every time it is drawn. Gradients are looked up by the
+ * interpolation mode, width and end colours; the least recently used one is
+ * dropped when the cache is full.
+ */
+class gradient_cache {
+  struct entry {
+    int mode;
+    int width;
+    unsigned long first_colour, last_colour;
+    gradient_factory::colour_array colours;
+  };
+
+  std::vector<entry> entries;  // most recently used first
+  size_t capacity;
+
+ public:
+  explicit gradient_cache(size_t capacity_ = 16) : capacity(capacity_) {}
+
+  /* Returns the gradient, calling make to create it if it is not cached. The
+   * pointer is valid until the next get(). */
+  const unsigned long *get(
+      int mode, int width, unsigned long first_colour,
+      unsigned long last_colour,
+      const std::function<gradient_factory::colour_array()> &make);
+
+  void clear() { entries.clear(); }
+};
 }  // namespace conky
 
 #endif /* _GRADIENT_H */
@@ -0,0 +1,169 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "graph-history.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "logging.h"
+
+namespace conky {
+
+namespace {
+const uint32_t history_magic = 0x48474b43; /* "CKGH" */
+}  // namespace
+
+size_t graph_history::file_length(unsigned int width) {
+  return sizeof(header) + width * sizeof(float);
+}
+
+bool graph_history::open(const std::string &path, unsigned int width) {
+  close();
+  width = std::max(width, 1u);
+
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  struct stat st {};
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    NORM_ERR("can't open graph history %s: %s", path.c_str(),
+             strerror(errno));
+    close();
+    return false;
+  }
+
+  length = st.st_size;
+  if (length >= sizeof(header)) {
+    void *p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    map = p != MAP_FAILED ? static_cast<header *>(p) : nullptr;
+  }
+  if (map != nullptr &&
+      (map->magic != history_magic || map->width == 0 ||
+       length != file_length(map->width) || map->head >= map->width)) {
+    NORM_ERR("graph history %s is damaged, starting over", path.c_str());
+    munmap(map, length);
+    map = nullptr;
+  }
+
+  if (map == nullptr) {
+    /* a new file; ftruncate() fills it with zeros */
+    length = file_length(width);
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, 0) == 0 && ftruncate(fd, length) == 0) {
+      p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (p == MAP_FAILED) {
+      NORM_ERR("can't map graph history %s: %s", path.c_str(),
+               strerror(errno));
+      close();
+      return false;
+    }
+    map = static_cast<header *>(p);
+    map->magic = history_magic;
+    map->width = width;
+  }
+
+  return map->width == width || resize(width);
+}
+
+bool graph_history::resize(unsigned int width) {
+  /* the newest samples, in the order they were pushed */
+  unsigned int keep = std::min(width, map->width);
+  std::vector<double> newest(keep);
+  load(newest.data(), keep);
+  std::reverse(newest.begin(), newest.end());
+  double last_time = map->last_time;
+
+  munmap(map, length);
+  map = nullptr;
+  length = file_length(width);
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, 0) == 0 && ftruncate(fd, length) == 0) {
+    p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (p == MAP_FAILED) {
+    NORM_ERR("can't resize graph history: %s", strerror(errno));
+    close();
+    return false;
+  }
+
+  map = static_cast<header *>(p);
+  map->magic = history_magic;
+  map->width = width;
+  map->head = keep % width;
+  map->last_time = last_time;
+  std::copy(newest.begin(), newest.end(), samples());
+  return true;
+}
+
+void graph_history::close() {
+  /* no msync(): dirty pages of a shared mapping are written back anyway */
+  if (map != nullptr) { munmap(map, length); }
+  if (fd != -1) { ::close(fd); }
+  map = nullptr;
+  fd = -1;
+  length = 0;
+}
+
+void graph_history::catch_up(double now, double interval) {
+  if (map == nullptr || map->last_time <= 0 || interval <= 0) { return; }
+
+  /* the update happening now pushes a sample of its own */
+  double missed = std::floor((now - map->last_time) / interval) - 1;
+  unsigned int zeros =
+      missed > 0 ? static_cast<unsigned int>(std::min<double>(missed,
+                                                               map->width))
+                 : 0;
+  for (unsigned int i = 0; i < zeros; ++i) { push(0, map->last_time); }
+}
+
+void graph_history::push(double value, double now) {
+  if (map == nullptr) { return; }
+
+  samples()[map->head] = static_cast<float>(value);
+  if (++map->head == map->width) { map->head = 0; }
+  map->last_time = now;
+}
+
+void graph_history::load(double *out, unsigned int n) const {
+  unsigned int w = width();
+
+  for (unsigned int i = 0; i < n; ++i) {
+    /* newest first, from the slot before head backwards */
+    out[i] = i < w ? samples()[(map->head + w - 1 - i) % w] : 0;
+  }
+}
+
+}  // namespace conky
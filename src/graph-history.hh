@@ -0,0 +1,92 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GRAPH_HISTORY_HH
+#define GRAPH_HISTORY_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace conky {
+
+/*
+ * The samples of one graph, kept in a file so that they survive restarts.
+ * The file is a small header followed by a ring of floats, and is mmap()ed:
+ * push() is a couple of plain stores and the kernel writes the pages back
+ * whenever it likes. A graph keeps drawing from its own array of doubles;
+ * this only seeds that array when the graph is created.
+ *
+ * The header remembers when the last sample was pushed, so a graph that was
+ * not updated for a while (conky was not running) shows the gap as zeros.
+ */
+class graph_history {
+  struct header {
+    uint32_t magic;
+    uint32_t width;
+    uint32_t head;  // where the next sample goes, i.e. the oldest one
+    uint32_t reserved;
+    double last_time;
+  };
+
+  int fd;
+  header *map;
+  size_t length;
+
+  graph_history(const graph_history &) = delete;
+  graph_history &operator=(const graph_history &) = delete;
+
+  static size_t file_length(unsigned int width);
+  float *samples() const { return reinterpret_cast<float *>(map + 1); }
+  bool resize(unsigned int width);
+
+ public:
+  graph_history() : fd(-1), map(nullptr), length(0) {}
+  ~graph_history() { close(); }
+
+  /* Maps path, creating it if needed. A file written for a different width
+   * keeps its newest samples. */
+  bool open(const std::string &path, unsigned int width);
+  void close();
+  bool is_open() const { return map != nullptr; }
+  unsigned int width() const { return map != nullptr ? map->width : 0; }
+  /* the length of the mapping */
+  size_t mapped() const { return length; }
+
+  /* Pushes one zero for every interval that passed since the last sample,
+   * up to the width of the graph. */
+  void catch_up(double now, double interval);
+  void push(double value, double now);
+
+  /* Copies the newest n samples into out, newest first. */
+  void load(double *out, unsigned int n) const;
+};
+
+}  // namespace conky
+
+#endif /* GRAPH_HISTORY_HH */
@@ -0,0 +1,80 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "graph-ring.hh"
+
+#include <algorithm>
+
+namespace conky {
+
+void graph_ring::add_candidate(double value, uint64_t value_seq) {
+  while (!maxima.empty() && maxima.back().value <= value) {
+    maxima.pop_back();
+  }
+  maxima.push_back({value, value_seq});
+}
+
+void graph_ring::rebuild() {
+  maxima.clear();
+  /* every sample needs a sequence number */
+  seq = std::max<uint64_t>(seq, samples.size());
+  for (size_t i = samples.size(); i-- > 0;) {
+    add_candidate((*this)[i], seq - i);
+  }
+}
+
+void graph_ring::resize(unsigned int width) {
+  if (width == samples.size()) { return; }
+
+  std::vector<double> resized(width, 0.0);
+  for (unsigned int i = 0; i < width && i < samples.size(); ++i) {
+    resized[i] = (*this)[i];
+  }
+  samples.swap(resized);
+  head = 0;
+  rebuild();
+}
+
+void graph_ring::push(double value) {
+  if (samples.empty()) { return; }
+
+  head = head == 0 ? samples.size() - 1 : head - 1;
+  samples[head] = value;
+  ++seq;
+  add_candidate(value, seq);
+  /* the oldest sample just fell out of the graph */
+  while (maxima.front().seq + samples.size() <= seq) { maxima.pop_front(); }
+}
+
+void graph_ring::assign(const double *values) {
+  std::copy(values, values + samples.size(), samples.begin());
+  head = 0;
+  rebuild();
+}
+
+}  // namespace conky
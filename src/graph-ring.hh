@@ -0,0 +1,91 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GRAPH_RING_HH
+#define GRAPH_RING_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace conky {
+
+/*
+ * The samples of one graph, newest first, in a ring so adding one doesn't
+ * move the others. The largest sample, which auto-scaled graphs are scaled
+ * to, is kept in a monotonic deque: every sample enters and leaves it once,
+ * so push() and max() are amortized O(1).
+ */
+class graph_ring {
+ public:
+  unsigned int width() const { return samples.size(); }
+
+  /* keeps the newest samples, a wider ring is padded with older zeroes */
+  void resize(unsigned int width);
+
+  void push(double value);
+
+  /* replaces the samples with values[0 .. width()), newest first */
+  void assign(const double *values);
+
+  /* the i-th newest sample, i < width() */
+  double operator[](unsigned int i) const {
+    size_t k = head + i;
+    if (k >= samples.size()) { k -= samples.size(); }
+    return samples[k];
+  }
+
+  /* the largest sample, 0 if there are none */
+  double max() const { return maxima.empty() ? 0 : maxima.front().value; }
+
+  /* what the samples take on the heap */
+  size_t memory() const {
+    return samples.capacity() * sizeof(double) +
+           maxima.size() * sizeof(candidate);
+  }
+
+ private:
+  struct candidate {
+    double value;
+    uint64_t seq;
+  };
+
+  std::vector<double> samples;
+  size_t head{0};  /* where the newest sample is */
+  uint64_t seq{0}; /* of the newest sample, the i-th newest has seq - i */
+  /* the samples no newer one is at least as large as, oldest first */
+  std::deque<candidate> maxima;
+
+  void add_candidate(double value, uint64_t value_seq);
+  void rebuild();
+};
+
+}  // namespace conky
+
+#endif /* GRAPH_RING_HH */
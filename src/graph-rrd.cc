@@ -0,0 +1,120 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "graph-rrd.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace conky {
+
+graph_rrd::graph_rrd() {
+  for (const auto &l : {std::make_pair(1.0, 600), std::make_pair(10.0, 360),
+                        std::make_pair(60.0, 1440)}) {
+    levels.push_back({l.first, -1, 0, std::vector<bucket>(l.second)});
+  }
+}
+
+void graph_rrd::push(double value, double now) {
+  auto v = static_cast<float>(value);
+
+  for (auto &l : levels) {
+    auto slot = static_cast<int64_t>(std::floor(now / l.step));
+    if (l.slot < 0) {
+      l.slot = slot;
+    } else if (slot > l.slot) {
+      /* start a new bucket, emptying those no sample fell into */
+      auto advance = std::min<int64_t>(slot - l.slot, l.ring.size());
+      for (int64_t i = 0; i < advance; ++i) {
+        l.head = (l.head + 1) % l.ring.size();
+        l.ring[l.head] = bucket();
+      }
+      l.slot = slot;
+    }
+    /* if the clock went backwards, the sample joins the newest bucket */
+
+    bucket &b = l.ring[l.head];
+    b.min = b.count == 0 ? v : std::min(b.min, v);
+    b.max = b.count == 0 ? v : std::max(b.max, v);
+    b.sum += value;
+    ++b.count;
+  }
+}
+
+const graph_rrd::level &graph_rrd::level_for(double span) const {
+  /* the finest one that still reaches back far enough */
+  for (const auto &l : levels) {
+    if (l.step * l.ring.size() >= span) { return l; }
+  }
+  return levels.back();
+}
+
+void graph_rrd::fill(double *out, unsigned int width, double span, double now,
+                     consolidation cf) const {
+  const level &l = level_for(span);
+  const auto size = static_cast<int64_t>(l.ring.size());
+  const double column = span / std::max(width, 1u);
+  double last = 0;
+
+  /* oldest column first, so an empty one can repeat the one before it */
+  for (unsigned int i = width; i-- > 0;) {
+    /* the buckets that start within the column */
+    auto first =
+        static_cast<int64_t>(std::ceil((now - (i + 1) * column) / l.step));
+    auto end = static_cast<int64_t>(std::ceil((now - i * column) / l.step));
+    first = std::max(first, l.slot - size + 1);
+    end = std::min(end, l.slot + 1);
+
+    bucket c{};
+    for (int64_t s = first; l.slot >= 0 && s < end; ++s) {
+      const bucket &b = l.ring[(l.head + size - (l.slot - s)) % size];
+      if (b.count == 0) { continue; }
+      c.min = c.count == 0 ? b.min : std::min(c.min, b.min);
+      c.max = c.count == 0 ? b.max : std::max(c.max, b.max);
+      c.sum += b.sum;
+      c.count += b.count;
+    }
+
+    if (c.count != 0) {
+      switch (cf) {
+        case MINIMUM:
+          last = c.min;
+          break;
+        case MAXIMUM:
+          last = c.max;
+          break;
+        default:
+          last = c.sum / c.count;
+          break;
+      }
+    }
+    out[i] = last;
+  }
+}
+
+}  // namespace conky
@@ -0,0 +1,92 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef GRAPH_RRD_HH
+#define GRAPH_RRD_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace conky {
+
+/*
+ * Round-robin samples of one graph at several resolutions, like rrdtool:
+ * 10 minutes of 1 s buckets, an hour of 10 s buckets and a day of 1 min
+ * buckets. Every bucket keeps the minimum, maximum and average of the
+ * samples that fell into it, so a graph can show any span up to a day
+ * without keeping one value per update or shifting arrays around.
+ */
+class graph_rrd {
+ public:
+  enum consolidation { AVERAGE, MINIMUM, MAXIMUM };
+
+  /* the longest span fill() can cover */
+  static const unsigned int max_span = 86400;
+
+  graph_rrd();
+
+  void push(double value, double now);
+
+  /*
+   * Fills out[0 .. width) with span seconds up to now, newest first, one
+   * consolidated value per column. Columns without samples repeat the one
+   * before them in time, so a long update_interval does not show as gaps.
+   */
+  void fill(double *out, unsigned int width, double span, double now,
+            consolidation cf = AVERAGE) const;
+
+  /* what the buckets take on the heap */
+  size_t memory() const {
+    size_t size = levels.capacity() * sizeof(level);
+    for (const auto &l : levels) { size += l.ring.capacity() * sizeof(bucket); }
+    return size;
+  }
+
+ private:
+  struct bucket {
+    float min, max;
+    double sum;
+    uint32_t count;
+  };
+
+  struct level {
+    double step;   // seconds per bucket
+    int64_t slot;  // which step the newest bucket, at head, is for
+    size_t head;
+    std::vector<bucket> ring;
+  };
+
+  std::vector<level> levels;
+
+  const level &level_for(double span) const;
+};
+
+}  // namespace conky
+
+#endif /* GRAPH_RRD_HH */
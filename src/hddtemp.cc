@@ -34,12 +34,27 @@
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <cmath>
+#include <mutex>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "conky.h"
+#include "core.h"
 #include "logging.h"
+#include "net-endpoint.hh"
 #include "temphelper.h"
 #include "text_object.h"
+#include "update-cb.hh"
 
 #define BUFLEN 512
+/* seconds between queries, to limit tcp connection overhead */
+#define DEFAULT_HDDTEMP_INTERVAL 5
+/* how long a frame waits for the daemon, in seconds */
+#define HDDTEMP_DEADLINE 0.25
+/* how long talking to the daemon may take in the background, in seconds */
+#define HDDTEMP_TIMEOUT 5
 
 static conky::simple_config_setting<std::string> hddtemp_host("hddtemp_host",
                                                               "localhost",
@@ -47,194 +62,163 @@ static conky::simple_config_setting<std::string> hddtemp_host("hddtemp_host",
 static conky::simple_config_setting<std::string> hddtemp_port("hddtemp_port",
                                                               "7634", false);
 
-class hdd_info {
- public:
-  hdd_info() : next(0) {}
-  hdd_info *next;
-  char *dev;
+namespace {
+struct hdd_info {
+  std::string dev;
   short temp;
   char unit;
-  void reset() {
-    next = 0;
-    dev = 0;
-    temp = 0;
-    unit = 0;
-  }
 };
 
-hdd_info hdd_info_head;
+struct hddtemp_result {
+  /* in the order the daemon reported them */
+  std::vector<hdd_info> disks;
+  /* index into disks by device name */
+  std::unordered_map<std::string, size_t> by_dev;
+};
 
-static void __free_hddtemp_info(hdd_info *hdi) {
-  if (hdi->next) __free_hddtemp_info(hdi->next);
-  free(hdi->dev);
-  delete hdi;
-}
+/*
+ * Asks the hddtemp daemon at host and port for the temperatures of all the
+ * disks it knows. An unresponsive daemon only delays the frame until
+ * HDDTEMP_DEADLINE; the objects show the last temperatures meanwhile, and
+ * one that keeps failing is asked less and less often, see net_endpoint.
+ * The daemon closes the connection after every answer, so there is no
+ * connection to keep.
+ */
+class hddtemp_cb
+    : public conky::callback<hddtemp_result, std::string, std::string> {
+  typedef conky::callback<hddtemp_result, std::string, std::string> Base;
 
-static void free_hddtemp_info(void) {
-  DBGP("free_hddtemp_info() called");
-  if (!hdd_info_head.next) return;
-  __free_hddtemp_info(hdd_info_head.next);
-  hdd_info_head.next = nullptr;
-}
+  std::shared_ptr<conky::net_endpoint> endpoint;
 
-static void add_hddtemp_info(char *dev, short temp, char unit) {
-  hdd_info *hdi = &hdd_info_head;
+  bool fetch(std::string &data);
 
-  DBGP("add_hddtemp_info(%s, %d, %c) being called", dev, temp, unit);
-  while (hdi->next) hdi = hdi->next;
+ protected:
+  void work() override;
 
-  hdi->next = new hdd_info;
-  hdi->next->reset();
-  hdi->next->dev = strdup(dev);
-  hdi->next->temp = temp;
-  hdi->next->unit = unit;
-}
+ public:
+  hddtemp_cb(double period, const std::string &host, const std::string &port)
+      : Base(period, true, Base::Tuple(host, port)),
+        /* XXX: hddtemp has no ipv6 support (yet?) */
+        endpoint(conky::net_endpoint::get(host, port, AF_INET)) {
+    set_deadline(HDDTEMP_DEADLINE);
+  }
+};
+
+struct hddtemp_obj {
+  std::string dev; /* empty for the first disk */
+  conky::callback_handle<hddtemp_cb> cb;
+};
+}  // namespace
 
-static char *fetch_hddtemp_output(void) {
+bool hddtemp_cb::fetch(std::string &data) {
+  char buf[BUFLEN];
+  ssize_t rlen;
   int sockfd;
-  char *buf = nullptr;
-  int buflen, offset = 0, rlen;
-  struct addrinfo hints, *result, *rp;
-  int i;
-
-  memset(&hints, 0, sizeof(hints));
-  hints.ai_family = AF_INET; /* XXX: hddtemp has no ipv6 support (yet?) */
-  hints.ai_socktype = SOCK_STREAM;
-
-  if ((i = getaddrinfo(hddtemp_host.get(*state).c_str(),
-                       hddtemp_port.get(*state).c_str(), &hints, &result))) {
-    NORM_ERR("getaddrinfo(): %s", gai_strerror(i));
-    return nullptr;
-  }
 
-  for (rp = result; rp; rp = rp->ai_next) {
-    sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-    if (sockfd == -1) continue;
-    if (connect(sockfd, rp->ai_addr, rp->ai_addrlen) != -1) break;
-    close(sockfd);
-  }
-  if (!rp) {
-    NORM_ERR("could not connect to hddtemp host");
-    goto GET_OUT;
+  if (!endpoint->ready()) { return false; }
+  if ((sockfd = endpoint->connect(HDDTEMP_TIMEOUT)) == -1) {
+    NORM_ERR("could not connect to hddtemp host: %s", strerror(errno));
+    return false;
   }
 
-  buflen = 1024;
-  buf = (char *)malloc(buflen);
-  while ((rlen = recv(sockfd, buf + offset, buflen - offset - 1, 0)) > 0) {
-    offset += rlen;
-    if (buflen - offset < 1) {
-      buflen += 1024;
-      buf = (char *)realloc(buf, buflen);
-    }
+  while ((rlen = recv(sockfd, buf, sizeof(buf), 0)) > 0) {
+    data.append(buf, rlen);
   }
-  if (rlen < 0) perror("recv");
-
-  buf[offset] = '\0';
-
   close(sockfd);
-GET_OUT:
-  freeaddrinfo(result);
-  return buf;
-}
 
-/* this is an iterator:
- * set line to nullptr in consecutive calls to get the next field
- * note that exhausing iteration is assumed - otherwise *saveptr
- * is not being freed!
- */
-static int read_hdd_val(const char *line, char **dev, short *val, char *unit,
-                        char **saveptr) {
-  char *line_s, *cval, *endptr;
-  static char *p = 0;
-
-  if (line) {
-    *saveptr = strdup(line);
-    p = *saveptr;
-  }
-  line_s = *saveptr;
-
-again:
-  if (!*p) goto out_fail;
-  /* read the device */
-  *dev = ++p;
-  if (!(p = strchr(p, line_s[0]))) goto out_fail;
-  *(p++) = '\0';
-  /* jump over the devname */
-  if (!(p = strchr(p, line_s[0]))) goto out_fail;
-  /* read the value */
-  cval = ++p;
-  if (!(p = strchr(p, line_s[0]))) goto out_fail;
-  *(p++) = '\0';
-  *unit = *(p++);
-  *val = strtol(cval, &endptr, 10);
-  if (*endptr) {
-    if (!(p = strchr(p, line_s[0]))) goto out_fail;
-
-    p++;
-    goto again;
+  if (rlen < 0) {
+    NORM_ERR("hddtemp: recv(): %s", strerror(errno));
+    endpoint->failed();
+    return false;
   }
-
-  /* preset p for next call */
-  p++;
-
-  return 0;
-out_fail:
-  free(*saveptr);
-  return 1;
+  endpoint->succeeded();
+  return true;
 }
 
-int update_hddtemp(void) {
-  char *data, *dev, unit, *saveptr;
-  short val;
-  static double last_hddtemp_update = 0.0;
+/*
+ * Parses an answer like "|/dev/sda|WDC WD5000|41|C||/dev/sdb|...|C|", where
+ * the first character is the separator and every disk has its device, model,
+ * temperature and unit. Disks without a temperature, e.g. sleeping ones, are
+ * left out.
+ */
+static void parse_hddtemp_output(const std::string &data,
+                                 hddtemp_result &out) {
+  if (data.empty()) { return; }
+
+  const char sep = data[0];
+  size_t pos = 0;
+  while (pos < data.size() && data[pos] == sep) {
+    std::string fields[4];
+    size_t p = pos + 1;
+
+    for (auto &field : fields) {
+      size_t end = data.find(sep, p);
+      if (end == std::string::npos) { return; }
+      field.assign(data, p, end - p);
+      p = end + 1;
+    }
+    pos = p;
 
-  /* limit tcp connection overhead */
-  if (current_update_time - last_hddtemp_update < 5) return 0;
-  last_hddtemp_update = current_update_time;
+    char *endptr;
+    long temp = strtol(fields[2].c_str(), &endptr, 10);
+    if (fields[2].empty() || *endptr != '\0' || fields[3].empty()) {
+      continue;
+    }
+    out.by_dev.emplace(fields[0], out.disks.size());
+    out.disks.push_back(
+        hdd_info{fields[0], static_cast<short>(temp), fields[3][0]});
+  }
+}
 
-  free_hddtemp_info();
+void hddtemp_cb::work() {
+  hddtemp_result parsed;
+  std::string data;
 
-  if (!(data = fetch_hddtemp_output())) return 0;
+  if (fetch(data)) { parse_hddtemp_output(data, parsed); }
 
-  if (read_hdd_val(data, &dev, &val, &unit, &saveptr)) {
-    free(data);
-    return 0;
-  }
-  do {
-    add_hddtemp_info(dev, val, unit);
-  } while (!read_hdd_val(nullptr, &dev, &val, &unit, &saveptr));
-  free(data);
-  return 0;
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = std::move(parsed);
 }
 
-void free_hddtemp(struct text_object *obj) {
-  free_hddtemp_info();
-  free_and_zero(obj->data.s);
-}
+void parse_hddtemp_arg(struct text_object *obj, const char *arg) {
+  std::string rest;
+  double interval;
 
-static int get_hddtemp_info(const char *dev, short *val, char *unit) {
-  hdd_info *hdi = hdd_info_head.next;
+  arg = take_interval_arg(arg, rest, interval);
+  if (interval < 0) { interval = DEFAULT_HDDTEMP_INTERVAL; }
+  double period = interval;
 
-  /* if no dev is given, just use hdd_info_head->next */
-  while (dev && hdi) {
-    if (!strcmp(dev, hdi->dev)) break;
-    hdi = hdi->next;
-  }
-  if (!hdi) return 1;
+  obj->data.opaque = new hddtemp_obj{
+      arg != nullptr ? arg : "",
+      conky::register_cb<hddtemp_cb>(period, hddtemp_host.get(*state),
+                                     hddtemp_port.get(*state))};
+}
 
-  *val = hdi->temp;
-  *unit = hdi->unit;
-  return 0;
+void free_hddtemp(struct text_object *obj) {
+  delete static_cast<hddtemp_obj *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
 }
 
 void print_hddtemp(struct text_object *obj, char *p, unsigned int p_max_size) {
-  short val;
-  char unit;
+  auto *hdd = static_cast<hddtemp_obj *>(obj->data.opaque);
+  const hdd_info *hdi = nullptr;
+
+  if (hdd != nullptr) {
+    const hddtemp_result &result = hdd->cb->read_result();
+
+    /* if no dev is given, just use the first one */
+    if (hdd->dev.empty()) {
+      if (!result.disks.empty()) { hdi = &result.disks.front(); }
+    } else {
+      auto it = result.by_dev.find(hdd->dev);
+      if (it != result.by_dev.end()) { hdi = &result.disks[it->second]; }
+    }
+  }
 
-  if (get_hddtemp_info(obj->data.s, &val, &unit)) {
+  if (hdi == nullptr) {
     snprintf(p, p_max_size, "%s", "N/A");
   } else {
-    temp_print(p, p_max_size, (double)val,
-               (unit == 'C' ? TEMP_CELSIUS : TEMP_FAHRENHEIT), 1);
+    temp_print(p, p_max_size, (double)hdi->temp,
+               (hdi->unit == 'C' ? TEMP_CELSIUS : TEMP_FAHRENHEIT), 1);
   }
 }
@@ -26,7 +26,7 @@
 #ifndef HDDTEMP_H_
 #define HDDTEMP_H_
 
-int update_hddtemp(void);
+void parse_hddtemp_arg(struct text_object *, const char *);
 void free_hddtemp(struct text_object *);
 void print_hddtemp(struct text_object *, char *, unsigned int);
 
@@ -33,6 +33,7 @@
 #include <string.h>
 #include "conky.h"
 #include "logging.h"
+#include "proc-file.hh"
 #include "temphelper.h"
 #include "text_object.h"
 
@@ -51,29 +52,27 @@ struct _i8k {
 
 /* FIXME: there should be an ioctl interface to request specific data */
 #define PROC_I8K "/proc/i8k"
-#define I8K_DELIM " "
-static char *i8k_procbuf = nullptr;
+#define I8K_DELIM " \n"
+/* the fields of i8k point into this copy of the last read of PROC_I8K, which
+ * all of the i8k objects print from */
+static char i8k_procbuf[128];
 int update_i8k(void) {
-  FILE *fp;
-
-  if (!i8k_procbuf) { i8k_procbuf = (char *)malloc(128 * sizeof(char)); }
-  if ((fp = fopen(PROC_I8K, "r")) == nullptr) {
-    free_and_zero(i8k_procbuf);
-    /*THREAD_CRIT_ERR(nullptr, NULL, "/proc/i8k doesn't exist! use insmod to
-      make sure the kernel " "driver is loaded...");*/
-    NORM_ERR(
-        "/proc/i8k doesn't exist! use insmod to make sure the kernel driver is "
-        "loaded...");
-    clean_up_without_threads(nullptr, NULL);
+  static conky::proc_file file(PROC_I8K);
+  static int reported = 0;
+
+  bool first = reported == 0;
+  const char *text = file.read(&reported);
+  if (text == nullptr) {
+    if (first) {
+      NORM_ERR(
+          "/proc/i8k doesn't exist! use insmod to make sure the kernel driver "
+          "is loaded...");
+    }
+    memset(&i8k, 0, sizeof(i8k));
     return 1;
   }
-
-  memset(&i8k_procbuf[0], 0, 128);
-  if (fread(&i8k_procbuf[0], sizeof(char), 128, fp) == 0) {
-    NORM_ERR("something wrong with /proc/i8k...");
-  }
-
-  fclose(fp);
+  if (*text == '\0') { NORM_ERR("something wrong with /proc/i8k..."); }
+  snprintf(i8k_procbuf, sizeof(i8k_procbuf), "%s", text);
 
   DBGP("read `%s' from /proc/i8k\n", i8k_procbuf);
 
@@ -111,7 +110,9 @@ void print_i8k_cpu_temp(struct text_object *obj, char *p,
 
   (void)obj;
 
-  sscanf(i8k.cpu_temp, "%d", &cpu_temp);
+  if (i8k.cpu_temp == nullptr || sscanf(i8k.cpu_temp, "%d", &cpu_temp) != 1) {
+    return;
+  }
   temp_print(p, p_max_size, (double)cpu_temp, TEMP_CELSIUS, 1);
 }
 
@@ -127,7 +128,10 @@ void print_i8k_ac_status(struct text_object *obj, char *p,
 
   (void)obj;
 
-  sscanf(i8k.ac_status, "%d", &ac_status);
+  if (i8k.ac_status == nullptr ||
+      sscanf(i8k.ac_status, "%d", &ac_status) != 1) {
+    return;
+  }
   if (ac_status == -1) {
     snprintf(p, p_max_size, "%s", "disabled (read i8k docs)");
   }
@@ -135,11 +139,11 @@ void print_i8k_ac_status(struct text_object *obj, char *p,
   if (ac_status == 1) { snprintf(p, p_max_size, "%s", "on"); }
 }
 
-#define I8K_PRINT_GENERATOR(name)                         \
-  void print_i8k_##name(struct text_object *obj, char *p, \
-                        unsigned int p_max_size) {        \
-    (void)obj;                                            \
-    snprintf(p, p_max_size, "%s", i8k.name);              \
+#define I8K_PRINT_GENERATOR(name)                            \
+  void print_i8k_##name(struct text_object *obj, char *p,    \
+                        unsigned int p_max_size) {           \
+    (void)obj;                                               \
+    snprintf(p, p_max_size, "%s", i8k.name ? i8k.name : ""); \
   }
 
 I8K_PRINT_GENERATOR(version)
@@ -30,16 +30,22 @@
 
 #include "ibm.h"
 #include <ctype.h>
-#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "config.h"
 #include "conky.h"
 #include "logging.h"
+#include "proc-file.hh"
 #include "temphelper.h"
 
+/* what the update functions below last read, for all of the ibm objects */
+static unsigned int ibm_acpi_fan_speed;
 static int ibm_acpi_temps[8];
+static int ibm_acpi_volume_level = -1;
+static bool ibm_acpi_muted;
+static unsigned int ibm_acpi_brightness_level;
+static char ibm_acpi_light_status[8];
 
 /* Here come the IBM ACPI-specific things. For reference, see
  * http://ibm-acpi.sourceforge.net/README
@@ -65,6 +71,31 @@ volume
 
 #define IBM_ACPI_DIR "/proc/acpi/ibm"
 
+/* Rereads /proc/acpi/ibm/<name> through an fd kept open across updates.
+ * Returns its contents, or nullptr after reporting the failure once. */
+static const char *ibm_acpi_read(conky::proc_file &file, int &reported) {
+  bool first = reported == 0;
+  const char *text = file.read(&reported);
+  if (text == nullptr && first) {
+    NORM_ERR("You are not using the IBM ACPI. Remove ibm* from your "
+             PACKAGE_NAME " config file.");
+  }
+  return text;
+}
+
+/* scanf()s the first line of text that matches format */
+template <typename... Args>
+static bool ibm_acpi_scan(const char *text, const char *format,
+                          Args... args) {
+  for (; text != nullptr && *text != '\0'; text = strchr(text, '\n')) {
+    if (*text == '\n') { text++; }
+    if (sscanf(text, format, args...) == static_cast<int>(sizeof...(Args))) {
+      return true;
+    }
+  }
+  return false;
+}
+
 /* get fan speed on IBM/Lenovo laptops running the ibm acpi.
  * /proc/acpi/ibm/fan looks like this (3 lines):
 status:         disabled
@@ -72,35 +103,23 @@ speed:          2944
 commands:       enable, disable
  * Peter Tarjan (ptarjan@citromail.hu) */
 
+int update_ibm_acpi_fan(void) {
+  static conky::proc_file file(IBM_ACPI_DIR "/fan");
+  static int reported = 0;
+
+  ibm_acpi_fan_speed = 0;
+  ibm_acpi_scan(ibm_acpi_read(file, reported), "speed: %u",
+                &ibm_acpi_fan_speed);
+  return 0;
+}
+
 void get_ibm_acpi_fan(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-  FILE *fp;
-  unsigned int speed = 0;
-  char fan[128];
-
   (void)obj;
 
   if (!p || p_max_size <= 0) { return; }
 
-  snprintf(fan, 127, "%s/fan", IBM_ACPI_DIR);
-
-  fp = fopen(fan, "r");
-  if (fp != nullptr) {
-    while (!feof(fp)) {
-      char line[256];
-
-      if (fgets(line, 255, fp) == nullptr) { break; }
-      if (sscanf(line, "speed: %u", &speed)) { break; }
-    }
-  } else {
-    CRIT_ERR(nullptr, NULL,
-             "can't open '%s': %s\nYou are not using the IBM ACPI. Remove "
-             "ibm* from your " PACKAGE_NAME " config file.",
-             fan, strerror(errno));
-  }
-
-  fclose(fp);
-  snprintf(p, p_max_size, "%d", speed);
+  snprintf(p, p_max_size, "%d", ibm_acpi_fan_speed);
 }
 
 /* get the measured temperatures from the temperature sensors
@@ -125,32 +144,14 @@ temperatures:   41 43 31 46 33 -128 29 -128
  * Peter Tarjan (ptarjan@citromail.hu) */
 
 int get_ibm_acpi_temps(void) {
-  FILE *fp;
-  char thermal[128];
-
-  snprintf(thermal, 127, "%s/thermal", IBM_ACPI_DIR);
-  fp = fopen(thermal, "r");
-
-  if (fp != nullptr) {
-    while (!feof(fp)) {
-      char line[256];
-
-      if (fgets(line, 255, fp) == nullptr) { break; }
-      if (sscanf(line, "temperatures: %d %d %d %d %d %d %d %d",
-                 &ibm_acpi_temps[0], &ibm_acpi_temps[1], &ibm_acpi_temps[2],
-                 &ibm_acpi_temps[3], &ibm_acpi_temps[4], &ibm_acpi_temps[5],
-                 &ibm_acpi_temps[6], &ibm_acpi_temps[7])) {
-        break;
-      }
-    }
-  } else {
-    CRIT_ERR(nullptr, NULL,
-             "can't open '%s': %s\nYou are not using the IBM ACPI. Remove "
-             "ibm* from your " PACKAGE_NAME " config file.",
-             thermal, strerror(errno));
-  }
-
-  fclose(fp);
+  static conky::proc_file file(IBM_ACPI_DIR "/thermal");
+  static int reported = 0;
+
+  ibm_acpi_scan(ibm_acpi_read(file, reported),
+                "temperatures: %d %d %d %d %d %d %d %d", &ibm_acpi_temps[0],
+                &ibm_acpi_temps[1], &ibm_acpi_temps[2], &ibm_acpi_temps[3],
+                &ibm_acpi_temps[4], &ibm_acpi_temps[5], &ibm_acpi_temps[6],
+                &ibm_acpi_temps[7]);
   return 0;
 }
 
@@ -164,45 +165,29 @@ commands:       up, down, mute
 commands:       level <level> (<level> is 0-15)
  * Peter Tarjan (ptarjan@citromail.hu) */
 
+int update_ibm_acpi_volume(void) {
+  static conky::proc_file file(IBM_ACPI_DIR "/volume");
+  static int reported = 0;
+  const char *text = ibm_acpi_read(file, reported);
+  char mute[4] = "";
+
+  ibm_acpi_volume_level = -1;
+  ibm_acpi_scan(text, "level: %d", &ibm_acpi_volume_level);
+  ibm_acpi_muted =
+      ibm_acpi_scan(text, "mute: %3s", mute) && strcmp(mute, "on") == 0;
+  return 0;
+}
+
 void get_ibm_acpi_volume(struct text_object *obj, char *p,
                          unsigned int p_max_size) {
-  FILE *fp;
-  char volume[128];
-  unsigned int vol = -1;
-  char mute[3] = "";
-
   (void)obj;
 
   if (!p || p_max_size <= 0) { return; }
 
-  snprintf(volume, 127, "%s/volume", IBM_ACPI_DIR);
-
-  fp = fopen(volume, "r");
-  if (fp != nullptr) {
-    while (!feof(fp)) {
-      char line[256];
-      unsigned int read_vol = -1;
-
-      if (fgets(line, 255, fp) == nullptr) { break; }
-      if (sscanf(line, "level: %u", &read_vol)) {
-        vol = read_vol;
-        continue;
-      }
-      if (sscanf(line, "mute: %s", mute)) { break; }
-    }
-  } else {
-    CRIT_ERR(nullptr, NULL,
-             "can't open '%s': %s\nYou are not using the IBM ACPI. Remove "
-             "ibm* from your " PACKAGE_NAME " config file.",
-             volume, strerror(errno));
-  }
-
-  fclose(fp);
-
-  if (strcmp(mute, "on") == 0)
+  if (ibm_acpi_muted)
     snprintf(p, p_max_size, "%s", "mute");
   else
-    snprintf(p, p_max_size, "%d", vol);
+    snprintf(p, p_max_size, "%d", ibm_acpi_volume_level);
 }
 
 /* static FILE *fp = nullptr; */
@@ -214,36 +199,23 @@ commands:       up, down
 commands:       level <level> (<level> is 0-7)
  * Peter Tarjan (ptarjan@citromail.hu) */
 
+int update_ibm_acpi_brightness(void) {
+  static conky::proc_file file(IBM_ACPI_DIR "/brightness");
+  static int reported = 0;
+
+  ibm_acpi_brightness_level = 0;
+  ibm_acpi_scan(ibm_acpi_read(file, reported), "level: %u",
+                &ibm_acpi_brightness_level);
+  return 0;
+}
+
 void get_ibm_acpi_brightness(struct text_object *obj, char *p,
                              unsigned int p_max_size) {
-  FILE *fp;
-  unsigned int brightness = 0;
-  char filename[128];
-
   (void)obj;
 
   if (!p || p_max_size <= 0) { return; }
 
-  snprintf(filename, 127, "%s/brightness", IBM_ACPI_DIR);
-
-  fp = fopen(filename, "r");
-  if (fp != nullptr) {
-    while (!feof(fp)) {
-      char line[256];
-
-      if (fgets(line, 255, fp) == nullptr) { break; }
-      if (sscanf(line, "level: %u", &brightness)) { break; }
-    }
-  } else {
-    CRIT_ERR(nullptr, NULL,
-             "can't open '%s': %s\nYou are not using the IBM ACPI. Remove "
-             "ibm* from your " PACKAGE_NAME " config file.",
-             filename, strerror(errno));
-  }
-
-  fclose(fp);
-
-  snprintf(p, p_max_size, "%d", brightness);
+  snprintf(p, p_max_size, "%d", ibm_acpi_brightness_level);
 }
 
 /* get ThinkLight status on IBM/Lenovo laptops running the ibm acpi.
@@ -254,35 +226,23 @@ commands:       on, off
  * get "unknown" for a few models that do not make the status available.
  * Lluis Esquerda (eskerda@gmail.com) */
 
+int update_ibm_acpi_thinklight(void) {
+  static conky::proc_file file(IBM_ACPI_DIR "/light");
+  static int reported = 0;
+
+  ibm_acpi_light_status[0] = '\0';
+  ibm_acpi_scan(ibm_acpi_read(file, reported), "status: %7s",
+                ibm_acpi_light_status);
+  return 0;
+}
+
 void get_ibm_acpi_thinklight(struct text_object *obj, char *p,
                              unsigned int p_max_size) {
-  FILE *fp;
-  char thinklight[8];
-  char filename[128];
-
   (void)obj;
 
   if (!p || p_max_size <= 0) { return; }
 
-  snprintf(filename, 127, "%s/light", IBM_ACPI_DIR);
-
-  fp = fopen(filename, "r");
-  if (fp != nullptr) {
-    while (!feof(fp)) {
-      char line[256];
-
-      if (fgets(line, 255, fp) == nullptr) { break; }
-      if (sscanf(line, "status: %s", thinklight)) { break; }
-    }
-  } else {
-    CRIT_ERR(nullptr, NULL,
-             "can't open '%s': %s\nYou are not using the IBM "
-             "ACPI. Remove ibm* from your " PACKAGE_NAME " config file.",
-             filename, strerror(errno));
-  }
-
-  fclose(fp);
-  snprintf(p, p_max_size, "%s", thinklight);
+  snprintf(p, p_max_size, "%s", ibm_acpi_light_status);
 }
 
 void parse_ibm_temps_arg(struct text_object *obj, const char *arg) {
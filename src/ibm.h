@@ -25,8 +25,14 @@
 #ifndef _IBM_H
 #define _IBM_H
 
-void get_ibm_acpi_fan(struct text_object *, char *, unsigned int);
+/* each reads one file of /proc/acpi/ibm per update for all of its objects */
+int update_ibm_acpi_fan(void);
 int get_ibm_acpi_temps(void);
+int update_ibm_acpi_volume(void);
+int update_ibm_acpi_brightness(void);
+int update_ibm_acpi_thinklight(void);
+
+void get_ibm_acpi_fan(struct text_object *, char *, unsigned int);
 void get_ibm_acpi_volume(struct text_object *, char *, unsigned int);
 void get_ibm_acpi_brightness(struct text_object *, char *, unsigned int);
 void get_ibm_acpi_thinklight(struct text_object *, char *, unsigned int);
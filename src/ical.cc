@@ -23,173 +23,233 @@
  */
 
 #include <libical/ical.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
 #include "conky.h"
 #include "logging.h"
+#include "update-cb.hh"
 
+#ifdef HAVE_SYS_INOTIFY_H
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc99-extensions"
+#include <sys/inotify.h>
+#pragma clang diagnostic pop
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* how far ahead recurring events are expanded, and how often that is done
+ * again while the file stays the same */
+#define ICAL_WINDOW (366 * 24 * 3600)
+#define ICAL_REEXPAND (24 * 3600)
+/* how long a frame waits for a calendar being parsed */
+#define ICAL_DEADLINE 0.25
+
+namespace {
 struct ical_event {
-  icaltimetype start;
-  icalcomponent *event;
-  ical_event *next, *prev;
+  time_t start;
+  std::string summary;
 };
 
-struct obj_ical {
-  struct ical_event *list;
-  icalcomponent *comps;
-  icalparser *parser;
-  unsigned int num;
-};
+/* the occurrences of all events which start within the window, by time */
+typedef std::vector<ical_event> ical_index;
 
 char *read_stream(char *s, size_t size, void *d) {
-  return fgets(s, size, (FILE *)d);
+  return fgets(s, size, static_cast<FILE *>(d));
+}
+
+void add_occurrence(icalcomponent *comp, struct icaltime_span *span,
+                    void *data) {
+  const char *summary = icalcomponent_get_summary(comp);
+  static_cast<ical_index *>(data)->push_back(
+      {span->start, summary != nullptr ? summary : ""});
 }
 
-struct ical_event *add_event(struct ical_event *listend,
-                             icalcomponent *new_ev) {
-  struct ical_event *ev_new, *ev_cur;
-  icaltimetype start;
-
-  start = icalcomponent_get_dtstart(new_ev);
-  if (icaltime_compare(
-          start, icaltime_from_timet_with_zone(time(nullptr), 0, NULL)) <= 0) {
-    icalproperty *rrule =
-        icalcomponent_get_first_property(new_ev, ICAL_RRULE_PROPERTY);
-    if (rrule) {
-      icalrecur_iterator *ritr =
-          icalrecur_iterator_new(icalproperty_get_rrule(rrule), start);
-      icaltimetype nexttime = icalrecur_iterator_next(ritr);
-      while (!icaltime_is_null_time(nexttime)) {
-        if (icaltime_compare(nexttime, icaltime_from_timet_with_zone(
-                                           time(nullptr), 0, NULL)) > 0) {
-          start = nexttime;
-          break;
-        }
-        nexttime = icalrecur_iterator_next(ritr);
-      }
-      icalrecur_iterator_free(ritr);
-    } else
-      return nullptr;
+/*
+ * Loads one calendar for all ${ical}s showing it. The file is only parsed
+ * again when it changed (inotify tells, or else its modification time) and
+ * once a day, to move the window recurrences are expanded in.
+ */
+class ical_cb : public conky::callback<std::shared_ptr<const ical_index>,
+                                       std::string> {
+  typedef conky::callback<std::shared_ptr<const ical_index>, std::string>
+      Base;
+
+  struct timespec mtime {};
+  ino_t ino{0};
+  off_t size{-1};
+  time_t expanded{0};
+#ifdef HAVE_SYS_INOTIFY_H
+  int inotify_fd{-1};
+  bool watching{false};
+
+  bool read_events();
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  bool changed();
+  std::shared_ptr<const ical_index> load(time_t now);
+
+ protected:
+  void work() override;
+
+ public:
+  ical_cb(double period, const std::string &path)
+      : Base(period, true, Base::Tuple(path)) {
+    set_deadline(ICAL_DEADLINE);
+#ifdef HAVE_SYS_INOTIFY_H
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif /* HAVE_SYS_INOTIFY_H */
   }
-  ev_new = (struct ical_event *)malloc(sizeof(struct ical_event));
-  memset(ev_new, 0, sizeof(struct ical_event));
-  ev_new->event = new_ev;
-  ev_new->start = start;
-  if (listend) {  // list already contains events
-    ev_cur = listend;
-    while (icaltime_compare(ev_new->start, ev_cur->start) <= 0) {
-      if (!ev_cur->prev) {  // ev_new starts first
-        ev_new->next = ev_cur;
-        ev_cur->prev = ev_new;
-        return listend;
-      }
-      ev_cur = ev_cur->prev;
+
+  ~ical_cb() override {
+#ifdef HAVE_SYS_INOTIFY_H
+    if (inotify_fd >= 0) { close(inotify_fd); }
+#endif /* HAVE_SYS_INOTIFY_H */
+  }
+};
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* returns whether anything happened to the file since the last call */
+bool ical_cb::read_events() {
+  alignas(struct inotify_event) char buf[1024];
+  bool happened = false;
+  ssize_t len;
+
+  while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+    happened = true;
+    for (char *ptr = buf; ptr < buf + len;) {
+      auto *ev = reinterpret_cast<struct inotify_event *>(ptr);
+      ptr += sizeof(struct inotify_event) + ev->len;
+      /* editors replace the file, so watch whatever is at the path next */
+      if ((ev->mask & IN_IGNORED) != 0) { watching = false; }
     }
-    if (ev_cur == listend) {  // ev_new starts last
-      ev_cur->next = ev_new;
-      ev_new->prev = ev_cur;
-      return ev_new;
+  }
+  return happened;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+bool ical_cb::changed() {
+#ifdef HAVE_SYS_INOTIFY_H
+  if (watching && !read_events()) { return false; }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  struct stat st {};
+  if (stat(get<0>().c_str(), &st) != 0) { return false; }
+#ifdef HAVE_SYS_INOTIFY_H
+  if (!watching && inotify_fd >= 0) {
+    watching = inotify_add_watch(inotify_fd, get<0>().c_str(),
+                                 IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB |
+                                     IN_MOVE_SELF | IN_DELETE_SELF) >= 0;
+  }
+#endif /* HAVE_SYS_INOTIFY_H */
+  if (st.st_mtim.tv_sec == mtime.tv_sec &&
+      st.st_mtim.tv_nsec == mtime.tv_nsec && st.st_ino == ino &&
+      st.st_size == size) {
+    return false;
+  }
+  mtime = st.st_mtim;
+  ino = st.st_ino;
+  size = st.st_size;
+  return true;
+}
+
+std::shared_ptr<const ical_index> ical_cb::load(time_t now) {
+  FILE *file = fopen(get<0>().c_str(), "r");
+  if (file == nullptr) { return nullptr; }
+
+  icalparser *parser = icalparser_new();
+  icalparser_set_gen_data(parser, file);
+  icalcomponent *allc = icalparser_parse(parser, read_stream);
+  fclose(file);
+  icalparser_free(parser);
+  if (allc == nullptr) { return nullptr; }
+
+  auto index = std::make_shared<ical_index>();
+  icaltimetype from = icaltime_from_timet_with_zone(now, 0, nullptr);
+  icaltimetype until =
+      icaltime_from_timet_with_zone(now + ICAL_WINDOW, 0, nullptr);
+  for (icalcomponent *curc =
+           icalcomponent_get_first_component(allc, ICAL_VEVENT_COMPONENT);
+       curc != nullptr;
+       curc = icalcomponent_get_next_component(allc, ICAL_VEVENT_COMPONENT)) {
+    /* handles RRULE, RDATE and EXDATE, and an event without them once */
+    icalcomponent_foreach_recurrence(curc, from, until, &add_occurrence,
+                                     index.get());
+  }
+  icalcomponent_free(allc);
+
+  std::stable_sort(index->begin(), index->end(),
+                   [](const ical_event &a, const ical_event &b) {
+                     return a.start < b.start;
+                   });
+  return index;
+}
+
+void ical_cb::work() {
+  time_t now = time(nullptr);
+  bool file_changed = changed();
+
+  if (!file_changed && now - expanded < ICAL_REEXPAND) { return; }
+  std::shared_ptr<const ical_index> index = load(now);
+  if (!index) {
+    if (file_changed) {
+      NORM_ERR("can't parse ical file %s", get<0>().c_str());
     }
-    // ev_new somewhere in the middle
-    ev_new->prev = ev_cur;
-    ev_new->next = ev_cur->next;
-    ev_cur->next->prev = ev_new;
-    ev_cur->next = ev_new;
-    return listend;
+    return;
   }
-  return ev_new;
+  expanded = now;
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = std::move(index);
 }
+}  // namespace
+
+struct obj_ical {
+  conky::callback_handle<ical_cb> cb;
+  unsigned int num;
+};
 
 void parse_ical_args(struct text_object *obj, const char *arg,
                      void *free_at_crash, void *free_at_crash2) {
   char *filename = strdup(arg);
-  FILE *file;
-  icalparser *parser;
-  icalcomponent *allc, *curc;
-  struct ical_event *ll_start, *ll_end, *ll_new;
-  struct obj_ical *opaque;
   unsigned int num;
 
-  if (sscanf(arg, "%d %s", &num, filename) != 2) {
+  if (sscanf(arg, "%u %s", &num, filename) != 2) {
     free(filename);
-    free(obj);
     CRIT_ERR(free_at_crash, free_at_crash2,
              "wrong number of arguments for $ical");
   }
-  file = fopen(filename, "r");
-  if (!file) {
-    free(obj);
+  if (access(filename, R_OK) != 0) {
     free(free_at_crash);
     CRIT_ERR(filename, free_at_crash2, "Can't read file %s", filename);
     return;
   }
+  obj->data.opaque = new obj_ical{conky::register_cb<ical_cb>(0, filename),
+                                  num};
   free(filename);
-  parser = icalparser_new();
-  icalparser_set_gen_data(parser, file);
-  allc = icalparser_parse(parser, read_stream);
-  fclose(file);
-  curc = icalcomponent_get_first_component(allc, ICAL_VEVENT_COMPONENT);
-  if (!curc) {
-    icalparser_free(parser);
-    icalcomponent_free(allc);
-    NORM_ERR("No ical events available");
-    return;
-  }
-  ll_start = add_event(nullptr, curc);
-  ll_end = ll_start;
-  while (1) {
-    curc = icalcomponent_get_next_component(allc, ICAL_VEVENT_COMPONENT);
-    if (!curc) break;
-    ll_new = add_event(ll_end, curc);
-    if (!ll_start) {  // first component was not added
-      ll_start = ll_new;
-      ll_end = ll_new;
-    } else if (ll_start->prev) {
-      ll_start = ll_start->prev;
-    } else if (ll_end->next) {
-      ll_end = ll_end->next;
-    }
-  }
-  opaque = (struct obj_ical *)malloc(sizeof(struct obj_ical));
-  opaque->list = ll_start;
-  opaque->parser = parser;
-  opaque->comps = allc;
-  opaque->num = num;
-  obj->data.opaque = opaque;
-  free(opaque);
 }
 
 void print_ical(struct text_object *obj, char *p, unsigned int p_max_size) {
-  struct obj_ical *ical_obj = (struct obj_ical *)obj->data.opaque;
-  struct ical_event *ll_current;
-
-  if (!ical_obj) return;
-  ll_current = ical_obj->list;
-  unsigned int i = 1;
-  while (1) {
-    if (!ll_current) return;
-    if (i > ical_obj->num) return;
-    if (i == ical_obj->num) break;
-    if (i < ical_obj->num) {
-      ll_current = ll_current->next;
-      i++;
-    }
-  }
-  snprintf(p, p_max_size, "%s",
-           icalproperty_get_summary(icalcomponent_get_first_property(
-               ll_current->event, ICAL_SUMMARY_PROPERTY)));
+  auto *ical_obj = static_cast<struct obj_ical *>(obj->data.opaque);
+
+  if (ical_obj == nullptr || ical_obj->num == 0) { return; }
+  const std::shared_ptr<const ical_index> &index =
+      ical_obj->cb->read_result();
+  if (!index) { return; }
+
+  /* events that started in the past are ignored */
+  time_t now = time(nullptr);
+  auto first = std::upper_bound(
+      index->begin(), index->end(), now,
+      [](time_t t, const ical_event &ev) { return t < ev.start; });
+  if (static_cast<size_t>(index->end() - first) < ical_obj->num) { return; }
+  snprintf(p, p_max_size, "%s", first[ical_obj->num - 1].summary.c_str());
 }
 
 void free_ical(struct text_object *obj) {
-  struct obj_ical *ical_free_me = (struct obj_ical *)obj->data.opaque;
-
-  if (!ical_free_me) return;
-  icalcomponent_free(ical_free_me->comps);
-  icalparser_free(ical_free_me->parser);
-  while (ical_free_me->list) {
-    if (ical_free_me->list->next) {
-      ical_free_me->list = ical_free_me->list->next;
-      free_and_zero(ical_free_me->list->prev);
-    } else
-      free_and_zero(ical_free_me->list);
-  }
-  free(obj->data.opaque);
+  delete static_cast<struct obj_ical *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
 }
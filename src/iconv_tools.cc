@@ -27,80 +27,131 @@
  *
  */
 
+#include <ctype.h>
 #include <iconv.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 #include "config.h"
 #include "logging.h"
 #include "text_object.h"
 
 #define ICONV_CODEPAGE_LENGTH 20
 
+struct iconv_converter {
+  iconv_t cd;
+  /* nothing to do: both codesets are the same */
+  bool identity;
+  /* the conversion leaves ASCII text as it is */
+  bool keeps_ascii;
+};
+
 static long iconv_selected;
-static long iconv_count = 0;
 static char iconv_converting = 0;
-static iconv_t **iconv_cd = 0;
-
-int register_iconv(iconv_t *new_iconv) {
-  iconv_cd = (void ***)realloc(iconv_cd, sizeof(iconv_t *) * (iconv_count + 1));
-  if (!iconv_cd) { CRIT_ERR(nullptr, NULL, "Out of memory"); }
-  iconv_cd[iconv_count] = (void **)malloc(sizeof(iconv_t));
-  if (!iconv_cd[iconv_count]) { CRIT_ERR(nullptr, NULL, "Out of memory"); }
-  memcpy(iconv_cd[iconv_count], new_iconv, sizeof(iconv_t));
-  iconv_count++;
-  return iconv_count;
+static std::vector<iconv_converter> iconv_cd;
+
+/* the input of iconv(), kept from one call to the next */
+static std::vector<char> iconv_buffer;
+
+/* codeset names compare equal ignoring case, '-' and '_' (utf8, UTF-8) */
+static bool same_codeset(const char *a, const char *b) {
+  for (;; ++a, ++b) {
+    while (*a == '-' || *a == '_') { ++a; }
+    while (*b == '-' || *b == '_') { ++b; }
+    if (tolower(static_cast<unsigned char>(*a)) !=
+        tolower(static_cast<unsigned char>(*b))) {
+      return false;
+    }
+    if (*a == 0) { return true; }
+  }
 }
 
-void free_iconv(struct text_object *obj) {
-  long i;
+/* whether cd converts the printable ASCII characters to themselves, which
+ * it does unless the target is something like UTF-16 or EBCDIC */
+static bool converts_ascii_to_itself(iconv_t cd) {
+  char in[96], out[sizeof(in) * 4];
+  for (size_t i = 0; i < sizeof(in) - 1; ++i) { in[i] = ' ' + i; }
+  in[sizeof(in) - 1] = '\n';
+
+  char *inptr = in, *outptr = out;
+  size_t inleft = sizeof(in), outleft = sizeof(out);
+  iconv(cd, nullptr, nullptr, nullptr, nullptr);
+  bool ok = iconv(cd, &inptr, &inleft, &outptr, &outleft) !=
+                static_cast<size_t>(-1) &&
+            inleft == 0 && outptr - out == sizeof(in) &&
+            memcmp(in, out, sizeof(in)) == 0;
+  iconv(cd, nullptr, nullptr, nullptr, nullptr);
+  return ok;
+}
+
+/* checks 8 bytes at a time whether all of s (of length n) is ASCII */
+static bool is_ascii(const char *s, size_t n) {
+  uint64_t high = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    high |= w;
+  }
+  for (; i < n; ++i) { high |= static_cast<unsigned char>(s[i]); }
+  return (high & 0x8080808080808080ULL) == 0;
+}
+
+static int register_iconv(iconv_t new_iconv, const char *from,
+                          const char *to) {
+  iconv_converter c;
+  c.cd = new_iconv;
+  c.identity = same_codeset(from, to);
+  c.keeps_ascii = c.identity || converts_ascii_to_itself(new_iconv);
+  iconv_cd.push_back(c);
+  return iconv_cd.size();
+}
 
+void free_iconv(struct text_object *obj) {
   (void)obj;
 
-  if (!iconv_cd) return;
+  for (auto &c : iconv_cd) { iconv_close(c.cd); }
+  iconv_cd.clear();
+  std::vector<char>().swap(iconv_buffer);
+}
 
-  for (i = 0; i < iconv_count; i++) {
-    if (iconv_cd[i]) {
-      iconv_close(*iconv_cd[i]);
-      free(iconv_cd[i]);
-    }
+/* converts the *a bytes at p, which has room for p_max_size, and sets *a
+ * to the length of the result */
+void iconv_convert(size_t *a, char *p, size_t p_max_size) {
+  if (*a == 0 || !iconv_converting || iconv_selected <= 0 ||
+      static_cast<size_t>(iconv_selected) > iconv_cd.size()) {
+    return;
   }
-  free(iconv_cd);
-  iconv_cd = 0;
-}
+  const iconv_converter &c = iconv_cd[iconv_selected - 1];
+  if (c.identity || (c.keeps_ascii && is_ascii(p, *a))) { return; }
+
+  if (iconv_buffer.size() < *a) { iconv_buffer.resize(*a); }
+  memcpy(iconv_buffer.data(), p, *a);
 
-void iconv_convert(size_t *a, char *buff_in, char *p, size_t p_max_size) {
-  int bytes;
-  size_t dummy1, dummy2;
 #if defined(__DragonFly__)
-  const char *ptr = buff_in;
+  const char *ptr = iconv_buffer.data();
 #else
-  char *ptr = buff_in;
+  char *ptr = iconv_buffer.data();
 #endif
   char *outptr = p;
+  size_t inleft = *a;
+  size_t outleft = p_max_size - 1;
 
-  if (*a <= 0 || !iconv_converting || iconv_selected <= 0 ||
-      iconv_cd[iconv_selected - 1] == (iconv_t)(-1))
-    return;
-
-  dummy1 = dummy2 = *a;
-
-  strncpy(buff_in, p, p_max_size);
-
-  iconv(*iconv_cd[iconv_selected - 1], nullptr, NULL, NULL, NULL);
-  while (dummy1 > 0) {
-    bytes =
-        iconv(*iconv_cd[iconv_selected - 1], &ptr, &dummy1, &outptr, &dummy2);
-    if (bytes == -1) {
+  iconv(c.cd, nullptr, nullptr, nullptr, nullptr);
+  while (inleft > 0) {
+    if (iconv(c.cd, &ptr, &inleft, &outptr, &outleft) ==
+        static_cast<size_t>(-1)) {
       NORM_ERR("Iconv codeset conversion failed");
       break;
     }
   }
 
-  /* It is necessary when we are converting from multibyte to
-   * singlebyte codepage */
-  // a = outptr - p;
-  //(*a) = *a - dummy2;
+  /* the result can be longer or shorter than the input, e.g. when
+   * converting between multibyte and singlebyte codepages */
+  *outptr = '\0';
   (*a) = outptr - p;
 }
 
@@ -110,12 +161,12 @@ void init_iconv_start(struct text_object *obj, void *free_at_crash,
   char iconv_to[ICONV_CODEPAGE_LENGTH];
 
   if (iconv_converting) {
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "You must stop your last iconv conversion before "
              "starting another");
   }
   if (sscanf(arg, "%s %s", iconv_from, iconv_to) != 2) {
-    CRIT_ERR(obj, free_at_crash, "Invalid arguments for iconv_start");
+    CRIT_ERR(nullptr, free_at_crash, "Invalid arguments for iconv_start");
   } else {
     iconv_t new_iconv;
 
@@ -123,7 +174,7 @@ void init_iconv_start(struct text_object *obj, void *free_at_crash,
     if (new_iconv == (iconv_t)(-1)) {
       NORM_ERR("Can't convert from %s to %s.", iconv_from, iconv_to);
     } else {
-      obj->data.i = register_iconv(&new_iconv);
+      obj->data.i = register_iconv(new_iconv, iconv_from, iconv_to);
       iconv_converting = 1;
     }
   }
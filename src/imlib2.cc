@@ -28,11 +28,17 @@
 #include "text_object.h"
 
 #include <Imlib2.h>
+#include <X11/Xutil.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "x11.h"
 
@@ -43,6 +49,7 @@ struct image_list_s {
   int wh_set;
   char no_cache;
   int flush_interval;
+  time_t mtime; /* of the file, 0 until looked up and -1 if it's missing */
   struct image_list_s *next;
 };
 
@@ -63,6 +70,144 @@ conky::range_config_setting<unsigned int> imlib_cache_flush_interval(
 unsigned int cimlib_cache_flush_last = 0;
 
 conky::simple_config_setting<bool> draw_blended("draw_blended", true, true);
+
+/* Images already scaled to the size they're drawn at, keyed on the path and
+ * the requested size. They're reused until the file's mtime changes, so an
+ * unchanged image is never decoded or rescaled again. */
+struct scaled_image {
+  Imlib_Image image;
+  time_t mtime;
+  int w, h;
+  bool used; /* since the last cimlib_render() */
+};
+std::unordered_map<std::string, scaled_image> scaled_images;
+
+/* what the last cimlib_render() put on screen */
+size_t rendered_key;
+bool rendered_valid = false;
+int rendered_x, rendered_y;
+XRectangle rendered_area;
+/* set by cimlib_clip_damage() when this frame can leave the images alone */
+bool skip_render = false;
+/* else set by it to the part of the images the next cimlib_render() needs
+ * to put on screen, relative to the buffer, if not all of them */
+bool push_clipped = false;
+XRectangle push_area;
+
+/* The images as blended into buffer, which is kept from frame to frame and
+ * only made anew when the window is resized, so that only the layers that
+ * changed are blended again, and only where they changed. */
+struct composed_layer {
+  size_t key;
+  XRectangle area; /* relative to the buffer */
+};
+std::vector<composed_layer> composed;
+int buffer_width = 0, buffer_height = 0;
+bool composed_blended;
+
+inline void hash_mix(size_t &h, size_t v) {
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+}
+
+time_t image_mtime(struct image_list_s *cur) {
+  if (cur->mtime == 0) {
+    struct stat st;
+    cur->mtime = stat(cur->name, &st) == 0 ? st.st_mtime : -1;
+  }
+  return cur->mtime;
+}
+
+std::string scaled_image_key(const struct image_list_s *cur) {
+  std::string key(cur->name);
+  if (cur->wh_set != 0) {
+    key += '@' + std::to_string(cur->w) + 'x' + std::to_string(cur->h);
+  }
+  return key;
+}
+
+/* -n and due -f images are reloaded every time they're drawn */
+bool image_uncached(const struct image_list_s *cur, time_t now) {
+  return cur->no_cache != 0 ||
+         (cur->flush_interval != 0 && now % cur->flush_interval == 0);
+}
+
+void free_scaled_image(scaled_image &s) {
+  imlib_context_set_image(s.image);
+  imlib_free_image();
+}
+
+void flush_scaled_images(bool unused_only) {
+  for (auto it = scaled_images.begin(); it != scaled_images.end();) {
+    if (unused_only && it->second.used) {
+      it->second.used = false;
+      ++it;
+    } else {
+      free_scaled_image(it->second);
+      it = scaled_images.erase(it);
+    }
+  }
+}
+
+bool is_empty(const XRectangle &r) { return r.width == 0 || r.height == 0; }
+
+/* grows r to also cover add */
+void add_rect(XRectangle &r, const XRectangle &add) {
+  if (is_empty(add)) { return; }
+  if (is_empty(r)) {
+    r = add;
+    return;
+  }
+  int x2 = std::max(r.x + r.width, add.x + add.width);
+  int y2 = std::max(r.y + r.height, add.y + add.height);
+  r.x = std::min(r.x, add.x);
+  r.y = std::min(r.y, add.y);
+  r.width = x2 - r.x;
+  r.height = y2 - r.y;
+}
+
+bool intersect_rect(const XRectangle &a, const XRectangle &b,
+                    XRectangle &out) {
+  int x = std::max(a.x, b.x);
+  int y = std::max(a.y, b.y);
+  int x2 = std::min(a.x + a.width, b.x + b.width);
+  int y2 = std::min(a.y + a.height, b.y + b.height);
+  if (x2 <= x || y2 <= y) { return false; }
+  out = XRectangle{static_cast<short>(x), static_cast<short>(y),
+                   static_cast<unsigned short>(x2 - x),
+                   static_cast<unsigned short>(y2 - y)};
+  return true;
+}
+
+/* identifies what a layer puts into the buffer */
+size_t layer_key(struct image_list_s *cur) {
+  size_t key = std::hash<std::string>()(cur->name);
+  hash_mix(key, cur->x);
+  hash_mix(key, cur->y);
+  hash_mix(key, cur->wh_set != 0 ? cur->w : -1);
+  hash_mix(key, cur->wh_set != 0 ? cur->h : -1);
+  hash_mix(key, image_mtime(cur));
+  return key;
+}
+
+/* identifies everything cimlib_render() would draw */
+size_t images_key() {
+  size_t key = draw_blended.get(*state) ? 1 : 0;
+  for (struct image_list_s *cur = image_list_start; cur != nullptr;
+       cur = cur->next) {
+    hash_mix(key, layer_key(cur));
+  }
+  return key;
+}
+
+void free_buffer() {
+  if (buffer != nullptr) {
+    imlib_context_set_image(buffer);
+    imlib_free_image();
+    buffer = nullptr;
+  }
+  buffer_width = buffer_height = 0;
+  composed.clear();
+}
 }  // namespace
 
 void imlib_cache_size_setting::lua_setter(lua::state &l, bool init) {
@@ -94,6 +239,9 @@ void imlib_cache_size_setting::cleanup(lua::state &l) {
 
   if (out_to_x.get(l)) {
     cimlib_cleanup();
+    free_buffer();
+    flush_scaled_images(false);
+    rendered_valid = false;
     imlib_context_disconnect_display();
     imlib_context_pop();
     imlib_context_free(context);
@@ -110,6 +258,28 @@ void cimlib_cleanup() {
   image_list_start = image_list_end = nullptr;
 }
 
+bool cimlib_has_images() { return image_list_start != nullptr; }
+
+size_t cimlib_memory(size_t *cache_limit) {
+  size_t size = 0;
+  for (const auto &s : scaled_images) {
+    size += s.first.capacity() + sizeof(s) +
+            static_cast<size_t>(s.second.w) * s.second.h * 4; /* ARGB */
+  }
+  *cache_limit = imlib_get_cache_size();
+  return size;
+}
+
+bool cimlib_images_changed() {
+  if (!rendered_valid) { return true; }
+  time_t now = time(nullptr);
+  for (struct image_list_s *cur = image_list_start; cur != nullptr;
+       cur = cur->next) {
+    if (image_uncached(cur, now)) { return true; }
+  }
+  return images_key() != rendered_key;
+}
+
 void cimlib_add_image(const char *args) {
   struct image_list_s *cur = nullptr;
   const char *tmp;
@@ -174,71 +344,155 @@ void cimlib_add_image(const char *args) {
   }
 }
 
-static void cimlib_draw_image(struct image_list_s *cur, int *clip_x,
-                              int *clip_y, int *clip_x2, int *clip_y2) {
+/* The image cur is drawn with, scaled to its size, which it sets cur->w and
+ * cur->h to. Loaded into scaled_images if it isn't there yet. nullptr if the
+ * image can't be loaded. */
+static scaled_image *cimlib_scaled_image(struct image_list_s *cur,
+                                         time_t now) {
   int w, h;
-  time_t now = time(nullptr);
   static int rep = 0;
 
   if (imlib_context_get_drawable() != window.drawable) {
     imlib_context_set_drawable(window.drawable);
   }
 
-  image = imlib_load_image(cur->name);
-  if (image == nullptr) {
-    if (rep == 0) { NORM_ERR("Unable to load image '%s'", cur->name); }
-    rep = 1;
-    return;
+  time_t mtime = image_mtime(cur);
+  std::string key = scaled_image_key(cur);
+  auto it = scaled_images.find(key);
+  if (it != scaled_images.end() && it->second.mtime != mtime) {
+    free_scaled_image(it->second);
+    scaled_images.erase(it);
+    it = scaled_images.end();
+  }
+
+  if (it == scaled_images.end()) {
+    image = imlib_load_image(cur->name);
+    if (image == nullptr) {
+      if (rep == 0) { NORM_ERR("Unable to load image '%s'", cur->name); }
+      rep = 1;
+      return nullptr;
+    }
+    rep = 0; /* reset so disappearing images are reported */
+
+    DBGP(
+        "Loading image '%s' scaled to %ix%i, "
+        "caching interval set to %i (with -n opt %i)",
+        cur->name, cur->w, cur->h, cur->flush_interval, cur->no_cache);
+
+    imlib_context_set_image(image);
+    /* turn alpha channel on */
+    imlib_image_set_has_alpha(1);
+    w = imlib_image_get_width();
+    h = imlib_image_get_height();
+
+    scaled_image s;
+    s.w = cur->wh_set != 0 ? cur->w : dpi_scale(w);
+    s.h = cur->wh_set != 0 ? cur->h : dpi_scale(h);
+    s.image = imlib_create_cropped_scaled_image(0, 0, w, h, s.w, s.h);
+    s.mtime = mtime;
+    s.used = false;
+    if (image_uncached(cur, now)) {
+      imlib_free_image_and_decache();
+    } else {
+      imlib_free_image();
+    }
+    if (s.image == nullptr) { return nullptr; }
+    imlib_context_set_image(s.image);
+    imlib_image_set_has_alpha(1);
+    it = scaled_images.emplace(key, s).first;
   }
-  rep = 0; /* reset so disappearing images are reported */
 
-  DBGP(
-      "Drawing image '%s' at (%i,%i) scaled to %ix%i, "
-      "caching interval set to %i (with -n opt %i)",
-      cur->name, cur->x, cur->y, cur->w, cur->h, cur->flush_interval,
-      cur->no_cache);
+  scaled_image &s = it->second;
+  s.used = true;
+  cur->w = s.w;
+  cur->h = s.h;
+  return &s;
+}
+
+/* where cur is drawn, relative to the buffer; empty if it can't be */
+static XRectangle cimlib_layer_area(struct image_list_s *cur, time_t now) {
+  if (cimlib_scaled_image(cur, now) == nullptr) { return XRectangle{}; }
+  return XRectangle{static_cast<short>(cur->x), static_cast<short>(cur->y),
+                    static_cast<unsigned short>(cur->w),
+                    static_cast<unsigned short>(cur->h)};
+}
 
-  imlib_context_set_image(image);
-  /* turn alpha channel on */
-  imlib_image_set_has_alpha(1);
-  w = imlib_image_get_width();
-  h = imlib_image_get_height();
-  if (cur->wh_set == 0) {
-    cur->w = dpi_scale(w);
-    cur->h = dpi_scale(h);
+/* The layers as they are now, and the part of the buffer that differs from
+ * them: where a layer was or is drawn that was added, removed, moved,
+ * changed or is reloaded every time. Relative to the buffer. */
+static XRectangle cimlib_changed_area(time_t now,
+                                      std::vector<composed_layer> &layers) {
+  XRectangle changed{};
+  size_t i = 0;
+  for (struct image_list_s *cur = image_list_start; cur != nullptr;
+       cur = cur->next, ++i) {
+    composed_layer layer{layer_key(cur), cimlib_layer_area(cur, now)};
+    if (i >= composed.size() || composed[i].key != layer.key ||
+        image_uncached(cur, now)) {
+      add_rect(changed, layer.area);
+      if (i < composed.size()) { add_rect(changed, composed[i].area); }
+    }
+    layers.push_back(layer);
   }
+  for (; i < composed.size(); ++i) { add_rect(changed, composed[i].area); }
+  return changed;
+}
+
+/* blends the layers into the buffer again where dirty (relative to it) */
+static void cimlib_compose(time_t now, const XRectangle &dirty) {
   imlib_context_set_image(buffer);
-  imlib_blend_image_onto_image(image, 1, 0, 0, w, h, cur->x, cur->y, cur->w,
-                               cur->h);
-  imlib_context_set_image(image);
-  if ((cur->no_cache != 0) ||
-      ((cur->flush_interval != 0) && now % cur->flush_interval == 0)) {
-    imlib_free_image_and_decache();
+  imlib_context_set_blend(0);
+  imlib_context_set_color(0, 0, 0, 0);
+  imlib_image_fill_rectangle(dirty.x, dirty.y, dirty.width, dirty.height);
+
+  /* check if we should blend when rendering */
+  if (draw_blended.get(*state)) {
+    /* we can blend stuff now */
+    imlib_context_set_blend(1);
   } else {
-    imlib_free_image();
+    imlib_context_set_blend(0);
   }
-  if (cur->x < *clip_x) { *clip_x = cur->x; }
-  if (cur->y < *clip_y) { *clip_y = cur->y; }
-  if (cur->x + cur->w > *clip_x2) { *clip_x2 = cur->x + cur->w; }
-  if (cur->y + cur->h > *clip_y2) { *clip_y2 = cur->y + cur->h; }
-}
 
-static void cimlib_draw_all(int *clip_x, int *clip_y, int *clip_x2,
-                            int *clip_y2) {
-  struct image_list_s *cur = image_list_start;
-  while (cur != nullptr) {
-    cimlib_draw_image(cur, clip_x, clip_y, clip_x2, clip_y2);
-    cur = cur->next;
+  size_t i = 0;
+  for (struct image_list_s *cur = image_list_start; cur != nullptr;
+       cur = cur->next, ++i) {
+    XRectangle part;
+    if (!intersect_rect(composed[i].area, dirty, part)) { continue; }
+    scaled_image *s = cimlib_scaled_image(cur, now);
+    if (s == nullptr) { continue; }
+
+    imlib_context_set_image(buffer);
+    imlib_blend_image_onto_image(s->image, 1, part.x - cur->x,
+                                 part.y - cur->y, part.width, part.height,
+                                 part.x, part.y, part.width, part.height);
+  }
+
+  /* -n and due -f images aren't kept */
+  for (struct image_list_s *cur = image_list_start; cur != nullptr;
+       cur = cur->next) {
+    if (!image_uncached(cur, now)) { continue; }
+    auto it = scaled_images.find(scaled_image_key(cur));
+    if (it != scaled_images.end()) {
+      free_scaled_image(it->second);
+      scaled_images.erase(it);
+    }
   }
 }
 
 void cimlib_render(int x, int y, int width, int height) {
-  int clip_x = INT_MAX, clip_y = INT_MAX;
-  int clip_x2 = 0, clip_y2 = 0;
   time_t now;
+  bool skip = skip_render;
+  bool clipped = push_clipped;
 
+  skip_render = push_clipped = false;
   if (image_list_start == nullptr) {
-    return; /* are we actually drawing anything? */
+    /* are we actually drawing anything? */
+    rendered_key = images_key();
+    rendered_valid = true;
+    rendered_area = XRectangle{};
+    flush_scaled_images(false);
+    free_buffer();
+    return;
   }
 
   /* cheque if it's time to flush our cache */
@@ -249,42 +503,111 @@ void cimlib_render(int x, int y, int width, int height) {
     imlib_set_cache_size(0);
     imlib_set_cache_size(size);
     cimlib_cache_flush_last = now;
+    flush_scaled_images(false);
     DBGP("Flushing Imlib2 cache (%li)\n", now);
   }
 
-  /* take all the little rectangles to redraw and merge them into
-   * something sane for rendering */
-  buffer = imlib_create_image(width, height);
-  /* clear our buffer */
-  imlib_context_set_image(buffer);
-  imlib_image_clear();
-
-  /* check if we should blend when rendering */
-  if (draw_blended.get(*state)) {
-    /* we can blend stuff now */
-    imlib_context_set_blend(1);
-  } else {
-    imlib_context_set_blend(0);
+  /* the drawable still shows these images where it isn't damaged */
+  if (skip && x == rendered_x && y == rendered_y) { return; }
+
+  /* the buffer only gets made anew when the window is resized */
+  if (buffer == nullptr || width != buffer_width || height != buffer_height) {
+    free_buffer();
+    buffer = imlib_create_image(width, height);
+    if (buffer == nullptr) { return; }
+    buffer_width = width;
+    buffer_height = height;
+    imlib_context_set_image(buffer);
+    /* turn alpha channel on */
+    imlib_image_set_has_alpha(1);
   }
 
-  /* turn alpha channel on */
-  imlib_image_set_has_alpha(1);
-
-  cimlib_draw_all(&clip_x, &clip_y, &clip_x2, &clip_y2);
+  std::vector<composed_layer> layers;
+  XRectangle dirty = cimlib_changed_area(now, layers);
+  if (composed.empty() || composed_blended != draw_blended.get(*state)) {
+    dirty = XRectangle{0, 0, static_cast<unsigned short>(width),
+                       static_cast<unsigned short>(height)};
+  }
+  composed.swap(layers);
+  composed_blended = draw_blended.get(*state);
+  if (!is_empty(dirty)) { cimlib_compose(now, dirty); }
+
+  XRectangle area{};
+  for (const auto &layer : composed) { add_rect(area, layer.area); }
+
+  /* moving the images damages all of them */
+  XRectangle push = area;
+  if (clipped && x == rendered_x && y == rendered_y) {
+    push = XRectangle{};
+    intersect_rect(push_area, area, push);
+  }
 
   /* set the buffer image as our current image */
   imlib_context_set_image(buffer);
 
-  /* setup our clip rect */
-  if (clip_x == INT_MAX) { clip_x = 0; }
-  if (clip_y == INT_MAX) { clip_y = 0; }
+  if (!is_empty(push)) {
+    imlib_render_image_part_on_drawable_at_size(
+        push.x, push.y, push.width, push.height, x + push.x, y + push.y,
+        push.width, push.height);
+  }
 
-  /* render the image at 0, 0 */
-  imlib_render_image_part_on_drawable_at_size(
-      clip_x, clip_y, clip_x2 - clip_x, clip_y2 - clip_y, x + clip_x,
-      y + clip_y, clip_x2 - clip_x, clip_y2 - clip_y);
-  /* don't need that temporary buffer image anymore */
-  imlib_free_image();
+  rendered_key = images_key();
+  rendered_valid = true;
+  rendered_x = x;
+  rendered_y = y;
+  rendered_area = area;
+  rendered_area.x += x;
+  rendered_area.y += y;
+  flush_scaled_images(true);
+}
+
+bool cimlib_damage(XRectangle &area) {
+  if (!rendered_valid || composed.empty()) { return false; }
+  std::vector<composed_layer> layers;
+  area = cimlib_changed_area(time(nullptr), layers);
+  area.x += rendered_x;
+  area.y += rendered_y;
+  return true;
+}
+
+void cimlib_clip_damage(Region region) {
+  skip_render = push_clipped = false;
+  bool changed = cimlib_images_changed();
+
+  /* where the images were and are */
+  XRectangle area = rendered_area;
+  if (changed) {
+    time_t now = time(nullptr);
+    for (struct image_list_s *cur = image_list_start; cur != nullptr;
+         cur = cur->next) {
+      XRectangle layer = cimlib_layer_area(cur, now);
+      layer.x += rendered_x;
+      layer.y += rendered_y;
+      add_rect(area, layer);
+    }
+  }
+  if (is_empty(area) || XRectInRegion(region, area.x, area.y, area.width,
+                                      area.height) == RectangleOut) {
+    if (changed) {
+      /* drawn whole then, so whatever they cover must be redrawn too */
+      XUnionRectWithRegion(&area, region, region);
+    } else {
+      skip_render = true;
+    }
+    return;
+  }
+
+  /* only the damaged part of the images is put on screen, which is drawn
+   * over whole, so the region takes in the rest of that rectangle */
+  Region images = XCreateRegion();
+  XUnionRectWithRegion(&area, images, images);
+  XIntersectRegion(images, region, images);
+  XClipBox(images, &push_area);
+  XDestroyRegion(images);
+  XUnionRectWithRegion(&push_area, region, region);
+  push_area.x -= rendered_x;
+  push_area.y -= rendered_y;
+  push_clipped = true;
 }
 
 void print_image_callback(struct text_object *obj, char *, unsigned int) {
@@ -29,6 +29,7 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wvariadic-macros"
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 #pragma GCC diagnostic pop
 
 void cimlib_add_image(const char *args);
@@ -36,6 +37,20 @@ void cimlib_set_cache_size(long size);
 void cimlib_set_cache_flush_interval(long interval);
 void cimlib_render(int x, int y, int width, int height);
 void cimlib_cleanup(void);
+bool cimlib_has_images(void);
+/* the memory held by the scaled images, for ${conky_mem}; cache_limit is set
+ * to how much Imlib2 may keep in its own cache of decoded images, which it
+ * doesn't tell the use of */
+size_t cimlib_memory(size_t *cache_limit);
+/* true if the images differ from what the last cimlib_render() drew */
+bool cimlib_images_changed(void);
+/* if the images changed, sets area to the window's rectangle which they
+ * differ in from the last cimlib_render(); false if that doesn't know */
+bool cimlib_damage(XRectangle &area);
+/* for a drawable that kept the last frame: lets the next cimlib_render()
+ * skip the images if region misses them, else put on screen only the part
+ * of them in region, which is grown to the rectangle of that part */
+void cimlib_clip_damage(Region region);
 
 void print_image_callback(struct text_object *, char *, unsigned int);
 
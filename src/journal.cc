@@ -32,19 +32,56 @@
 #include <systemd/sd-journal.h>
 #include <time.h>
 #include <unistd.h>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <string>
 #include "common.h"
 #include "config.h"
 #include "conky.h"
 #include "logging.h"
 #include "text_object.h"
+#include "update-cb.hh"
 
 #define MAX_JOURNAL_LINES 200
 
+namespace {
+/*
+ * Keeps one sd_journal open for every distinct (lines, flags) pair and
+ * remembers the last lines it formatted. Each run only reads the entries
+ * that were appended since the previous one, instead of opening the journal
+ * and seeking back from the tail every frame.
+ */
+class journal_cb : public conky::callback<std::string, int, int> {
+  typedef conky::callback<std::string, int, int> Base;
+
+  sd_journal *jh = nullptr;
+  std::string cursor;
+  std::deque<std::string> lines;
+
+  bool open(bool *current);
+  bool read_entries(bool current);
+
+ protected:
+  void work() override;
+
+ public:
+  journal_cb(double period, int wantedlines, int flags)
+      : Base(period, false, Base::Tuple(wantedlines, flags)) {
+    set_power_source("journal");
+  }
+
+  ~journal_cb() override {
+    if (jh != nullptr) { sd_journal_close(jh); }
+  }
+};
+}  // namespace
+
 class journal {
  public:
   int wantedlines;
   int flags;
+  std::unique_ptr<conky::callback_handle<journal_cb>> reader;
 
   journal() : wantedlines(0), flags(SD_JOURNAL_LOCAL_ONLY) {}
 };
@@ -66,7 +103,7 @@ void init_journal(const char *type, const char *arg, struct text_object *obj,
   args = sscanf(arg, "%d %6s", &j->wantedlines, tmp.get());
   if (args < 1 || args > 2) {
     free_journal(obj);
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "%s a number of lines as 1st argument and optionally a journal "
              "type as 2nd argument",
              type);
@@ -81,7 +118,7 @@ void init_journal(const char *type, const char *arg, struct text_object *obj,
 #endif /* SD_JOURNAL_CURRENT_USER */
       } else {
         free_journal(obj);
-        CRIT_ERR(obj, free_at_crash,
+        CRIT_ERR(nullptr, free_at_crash,
                  "invalid arg for %s, type must be 'system' or 'user'", type);
       }
     } else {
@@ -90,106 +127,128 @@ void init_journal(const char *type, const char *arg, struct text_object *obj,
 
   } else {
     free_journal(obj);
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "invalid arg for %s, number of lines must be between 1 and %d",
              type, MAX_JOURNAL_LINES);
   }
+  j->reader = std::make_unique<conky::callback_handle<journal_cb>>(
+      conky::register_cb<journal_cb>(0, j->wantedlines, j->flags));
   obj->data.opaque = j;
 }
 
-static int print_field(sd_journal *jh, const char *field, char spacer,
-                       size_t *read, char *p, unsigned int p_max_size) {
-  const void *get;
+/* appends the contents of field, if the entry has it, and then spacer */
+static void append_field(sd_journal *jh, const char *field, char spacer,
+                         std::string &line) {
+  const void *data;
   size_t length;
-  size_t fieldlen = strlen(field) + 1;
+  size_t fieldlen = strlen(field) + 1; /* "FIELD=" */
 
-  int ret = sd_journal_get_data(jh, field, &get, &length);
-  if (ret == -ENOENT) goto out;
-
-  if (ret < 0 || length + *read > p_max_size) return -1;
-
-  memcpy(p + *read, (const char *)get + fieldlen, length - fieldlen);
-  *read += length - fieldlen;
-
-out:
-  if (spacer) {
-    if (p_max_size < *read) {
-      *read = p_max_size - 1;
-    } else {
-      p[(*read)++] = spacer;
-    }
+  if (sd_journal_get_data(jh, field, &data, &length) >= 0 &&
+      length >= fieldlen) {
+    line.append(static_cast<const char *>(data) + fieldlen, length - fieldlen);
   }
-  return length ? length - fieldlen : 0;
+  if (spacer != 0) { line += spacer; }
 }
 
-bool read_log(size_t *read, size_t *length, time_t *time, uint64_t *timestamp,
-              sd_journal *jh, char *p, unsigned int p_max_size) {
+/* formats the current entry like syslog, "date host ident[pid]: message" */
+static bool format_entry(sd_journal *jh, std::string &line) {
+  uint64_t timestamp;
   struct tm tm;
-  if (sd_journal_get_realtime_usec(jh, timestamp) < 0) return false;
-  *time = *timestamp / 1000000;
-  localtime_r(time, &tm);
+  char date[64];
 
-  if ((*length =
-           strftime(p + *read, p_max_size - *read, "%b %d %H:%M:%S", &tm)) <= 0)
-    return false;
-  *read += *length;
-
-  if (p_max_size < *read) {
-    *read = p_max_size - 1;
+  if (sd_journal_get_realtime_usec(jh, &timestamp) < 0) { return false; }
+  time_t time = timestamp / 1000000;
+  localtime_r(&time, &tm);
+  if (strftime(date, sizeof(date), "%b %d %H:%M:%S", &tm) == 0) {
     return false;
   }
-  p[*read++] = ' ';
-
-  if (print_field(jh, "_HOSTNAME", ' ', read, p, p_max_size) < 0) return false;
 
-  if (print_field(jh, "SYSLOG_IDENTIFIER", '[', read, p, p_max_size) < 0)
-    return false;
+  line = date;
+  line += ' ';
+  append_field(jh, "_HOSTNAME", ' ', line);
+  append_field(jh, "SYSLOG_IDENTIFIER", '[', line);
+  append_field(jh, "_PID", ']', line);
+  line += ": ";
+  append_field(jh, "MESSAGE", '\n', line);
+  return true;
+}
 
-  if (print_field(jh, "_PID", ']', read, p, p_max_size) < 0) return false;
+/* leaves the journal on the first of the wanted entries, if there is one */
+bool journal_cb::open(bool *current) {
+  int wantedlines = std::get<0>(tuple);
 
-  if (p_max_size < *read) {
-    *read = p_max_size - 1;
+  if (sd_journal_open(&jh, std::get<1>(tuple)) != 0) {
+    NORM_ERR("unable to open journal");
+    jh = nullptr;
     return false;
   }
-  p[*read++] = ':';
-
-  if (p_max_size < *read) {
-    *read = p_max_size - 1;
+  if (sd_journal_seek_tail(jh) < 0) {
+    NORM_ERR("unable to seek to end of journal");
     return false;
   }
-  p[*read++] = ' ';
-
-  if (print_field(jh, "MESSAGE", '\n', read, p, p_max_size) < 0) return false;
+  int skipped = sd_journal_previous_skip(jh, wantedlines);
+  if (skipped < 0) {
+    NORM_ERR("unable to seek back %d lines", wantedlines);
+    return false;
+  }
+  *current = skipped > 0;
   return true;
 }
 
-void print_journal(struct text_object *obj, char *p, unsigned int p_max_size) {
-  journal *j = (journal *)obj->data.opaque;
-  sd_journal *jh = nullptr;
-  size_t read = 0;
-  size_t length;
-  time_t time;
-  uint64_t timestamp;
-
-  if (sd_journal_open(&jh, j->flags) != 0) {
-    NORM_ERR("unable to open journal");
-    goto out;
+/* formats every entry after the current position, and the current one too
+ * if asked; returns whether any were found */
+bool journal_cb::read_entries(bool current) {
+  auto wantedlines = static_cast<size_t>(std::get<0>(tuple));
+  bool changed = false;
+  std::string line;
+
+  for (bool more = current || sd_journal_next(jh) > 0; more;
+       more = sd_journal_next(jh) > 0) {
+    char *c;
+    if (sd_journal_get_cursor(jh, &c) >= 0) {
+      cursor = c;
+      free(c);
+    }
+    if (!format_entry(jh, line)) { continue; }
+    lines.push_back(std::move(line));
+    if (lines.size() > wantedlines) { lines.pop_front(); }
+    changed = true;
   }
+  return changed;
+}
 
-  if (sd_journal_seek_tail(jh) < 0) {
-    NORM_ERR("unable to seek to end of journal");
-    goto out;
-  }
-  if (sd_journal_previous_skip(jh, j->wantedlines) < 0) {
-    NORM_ERR("unable to seek back %d lines", j->wantedlines);
-    goto out;
+void journal_cb::work() {
+  bool current = false;
+
+  if (jh == nullptr) {
+    if (!open(&current)) {
+      if (jh != nullptr) { sd_journal_close(jh); }
+      jh = nullptr;
+      return;
+    }
+    lines.clear();
+  } else {
+    int ret = sd_journal_process(jh);
+    if (ret == SD_JOURNAL_NOP) { return; }
+    /* journal files were added or removed, so find our place again */
+    if (ret == SD_JOURNAL_INVALIDATE && !cursor.empty() &&
+        sd_journal_seek_cursor(jh, cursor.c_str()) >= 0) {
+      sd_journal_next(jh);
+    }
   }
 
-  while (read_log(&read, &length, &time, &timestamp, jh, p, p_max_size) &&
-         sd_journal_next(jh))
-    ;
+  if (!read_entries(current)) { return; }
+
+  std::string text;
+  for (const auto &l : lines) { text += l; }
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = std::move(text);
+}
+
+void print_journal(struct text_object *obj, char *p, unsigned int p_max_size) {
+  auto *j = static_cast<journal *>(obj->data.opaque);
 
-out:
-  if (jh) sd_journal_close(jh);
-  p[read] = '\0';
+  p[0] = '\0';
+  if (j == nullptr || !j->reader) { return; }
+  snprintf(p, p_max_size, "%s", (*j->reader)->read_result().c_str());
 }
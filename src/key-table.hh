@@ -0,0 +1,142 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef KEY_TABLE_HH
+#define KEY_TABLE_HH
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace conky {
+
+/*
+ * A fixed set of keys with a perfect hash found at compile time: find() costs
+ * one hash of the key and one comparison, however many keys there are. Meant
+ * for "key: value" files like /proc/meminfo, see for_each_key_value().
+ *
+ *   constexpr auto keys = conky::make_key_table("MemTotal", "MemFree");
+ *   static_assert(keys.find("MemFree") == 1);
+ */
+template <size_t N>
+class key_table {
+  /* at least four slots per key, then a seed is quick to find */
+  static constexpr size_t slot_count() {
+    size_t n = 1;
+    while (n < 4 * N) { n *= 2; }
+    return n;
+  }
+  static constexpr size_t SLOTS = slot_count();
+  static constexpr uint8_t EMPTY = 0xff;
+  static_assert(N < EMPTY, "too many keys");
+
+  std::array<std::string_view, N> keys;
+  std::array<uint8_t, SLOTS> slots;
+  uint32_t seed;
+
+  static constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+    /* FNV-1a, starting from the seed */
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : key) {
+      h ^= static_cast<unsigned char>(c);
+      h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+  }
+
+  constexpr bool try_seed(uint32_t s) {
+    for (auto &slot : slots) { slot = EMPTY; }
+    for (size_t i = 0; i < N; ++i) {
+      uint8_t &slot = slots[hash(keys[i], s) & (SLOTS - 1)];
+      if (slot != EMPTY) { return false; }
+      slot = static_cast<uint8_t>(i);
+    }
+    seed = s;
+    return true;
+  }
+
+ public:
+  static constexpr size_t npos = N;
+
+  constexpr explicit key_table(const std::array<std::string_view, N> &keys_)
+      : keys(keys_), slots(), seed(0) {
+    for (uint32_t s = 0; !try_seed(s); ++s) {}
+  }
+
+  /* Returns the position of key in the table, npos if it isn't in it. */
+  constexpr size_t find(std::string_view key) const {
+    uint8_t slot = slots[hash(key, seed) & (SLOTS - 1)];
+    return slot != EMPTY && keys[slot] == key ? slot : npos;
+  }
+
+  constexpr size_t size() const { return N; }
+};
+
+template <typename... Keys>
+constexpr key_table<sizeof...(Keys)> make_key_table(Keys... keys) {
+  return key_table<sizeof...(Keys)>({std::string_view(keys)...});
+}
+
+/*
+ * Goes through the lines of buf, up to end, that start with a key of table
+ * and calls fn(index of the key, start of the value, end of the line) for
+ * each. A key ends at ':', '=' or a blank, so this reads /proc/meminfo
+ * ("MemTotal:  16318412 kB"), /proc/vmstat and cgroup memory.stat
+ * ("nr_free_pages 1234") and /proc/pressure/* ("some avg10=0.00 ...").
+ */
+template <size_t N, typename Fn>
+void for_each_key_value(const char *buf, const char *end,
+                        const key_table<N> &table, Fn &&fn) {
+  const char *p = buf;
+  while (p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) { eol = end; }
+
+    const char *key_end = p;
+    while (key_end < eol && *key_end != ':' && *key_end != '=' &&
+           *key_end != ' ' && *key_end != '\t') {
+      ++key_end;
+    }
+    size_t index = table.find(std::string_view(p, key_end - p));
+    if (index != table.npos) {
+      const char *value = key_end;
+      while (value < eol && (*value == ':' || *value == '=' || *value == ' ' ||
+                             *value == '\t')) {
+        ++value;
+      }
+      fn(index, value, eol);
+    }
+    p = eol + 1;
+  }
+}
+
+}  // namespace conky
+
+#endif /* KEY_TABLE_HH */
@@ -715,6 +715,7 @@ mpd_Status *mpd_getStatus(mpd_Connection *connection) {
   status->songid = 0;
   status->elapsedTime = 0;
   status->totalTime = 0;
+  status->elapsed = -1;
   status->bitRate = 0;
   status->sampleRate = 0;
   status->bits = 0;
@@ -765,6 +766,8 @@ mpd_Status *mpd_getStatus(mpd_Connection *connection) {
         status->elapsedTime = strtol(re->value, nullptr, 10);
         status->totalTime = strtol(tok + 1, nullptr, 10);
       }
+    } else if (strcmp(re->name, "elapsed") == 0) {
+      status->elapsed = strtof(re->value, nullptr);
     } else if (strcmp(re->name, "error") == 0) {
       status->error = strndup(re->value, text_buffer_size.get(*state));
     } else if (strcmp(re->name, "xfade") == 0) {
@@ -1796,6 +1799,20 @@ char *mpd_getNextCommand(mpd_Connection *connection) {
   return mpd_getNextReturnElementNamed(connection, "command");
 }
 
+void mpd_sendIdleCommand(mpd_Connection *connection, const char *subsystems) {
+  int len = strlen("idle") + 1 + strlen(subsystems) + 2;
+  auto *string = static_cast<char *>(malloc(len));
+
+  snprintf(string, len, "idle %s\n", subsystems);
+  mpd_executeCommand(connection, string);
+  free(string);
+}
+
+/** Get the next subsystem reported by idle */
+char *mpd_getNextChanged(mpd_Connection *connection) {
+  return mpd_getNextReturnElementNamed(connection, "changed");
+}
+
 void mpd_sendUrlHandlersCommand(mpd_Connection *connection) {
   mpd_executeCommand(connection, "urlhandlers\n");
 }
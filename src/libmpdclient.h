@@ -179,6 +179,8 @@ typedef struct mpd_Status {
   int elapsedTime;
   /* length in seconds of the currently playing/paused song */
   int totalTime;
+  /* elapsedTime with sub-second precision, or -1 if mpd doesn't send it */
+  float elapsed;
   /* current bit rate in kbs */
   int bitRate;
   /* audio sample rate */
@@ -551,6 +553,22 @@ void mpd_sendNotCommandsCommand(mpd_Connection *connection);
  * @returns a string, needs to be freed */
 char *mpd_getNextCommand(mpd_Connection *connection);
 
+/**
+ * @param connection a #mpd_Connection
+ * @param subsystems space separated subsystems to wait for, all if empty
+ *
+ * Waits until something changes in one of the subsystems. Nothing else may
+ * be sent until the answer arrived. */
+void mpd_sendIdleCommand(mpd_Connection *connection, const char *subsystems);
+
+/**
+ * @param connection a #mpd_Connection
+ *
+ * returns the next subsystem that changed after mpd_sendIdleCommand().
+ *
+ * @returns a string, needs to be freed */
+char *mpd_getNextChanged(mpd_Connection *connection);
+
 void mpd_sendUrlHandlersCommand(mpd_Connection *connection);
 
 char *mpd_getNextHandler(mpd_Connection *connection);
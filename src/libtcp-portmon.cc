@@ -27,11 +27,24 @@
 
 #include "libtcp-portmon.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
+#ifdef __linux__
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <unistd.h>
+#endif
+
 /* -------------------------------------------------------------------
  * IMPLEMENTATION INTERFACE
  *
@@ -78,12 +91,24 @@ bool operator==(const tcp_connection_t &a, const tcp_connection_t &b) {
 }
 
 /* ------------------------------------------------------------------------
- * A hash table containing tcp connection
+ * What a monitor keeps about a connection
  *
- * The second parameter provides the mechanism for removing connections if
- * they are not seen again in subsequent update cycles.
+ * The age provides the mechanism for removing connections if they are not
+ * seen again in subsequent update cycles.  The peekable items are formatted
+ * when first peeked and kept for as long as the connection is.
  * ------------------------------------------------------------------------ */
-typedef std::unordered_map<tcp_connection_t, int, tcp_connection_hash>
+struct tcp_connection_state_t {
+  int age;
+  std::string text[LOCALSERVICE + 1];
+
+  tcp_connection_state_t(int age) : age(age) {}
+};
+
+/* ------------------------------------------------------------------------
+ * A hash table containing tcp connection
+ * ------------------------------------------------------------------------ */
+typedef std::unordered_map<tcp_connection_t, tcp_connection_state_t,
+                           tcp_connection_hash>
     connection_hash_t;
 
 /* start and end of port monitor range. Set start=end to monitor a single port
@@ -110,35 +135,39 @@ struct _tcp_port_monitor_t {
   connection_hash_t hash;
   /* array of connection pointers for O(1) peeking
    * these point into the hash table*/
-  std::vector<const tcp_connection_t *> p_peek;
+  mutable std::vector<connection_hash_t::value_type *> p_peek;
+  /* the hash changed since the peek table was built */
+  mutable bool peek_dirty;
 
   _tcp_port_monitor_t(int max_connections)
       : hash(),
         p_peek(max_connections,
-               static_cast<const tcp_connection_t *>(nullptr)) {}
+               static_cast<connection_hash_t::value_type *>(nullptr)),
+        peek_dirty(false) {}
 
   _tcp_port_monitor_t(const _tcp_port_monitor_t &other)
       : hash(other.hash),
         p_peek(other.p_peek.size(),
-               static_cast<const tcp_connection_t *>(nullptr)) {
-    // we must rebuild the peek table because the pointers are no longer valid
-    rebuild_peek_table();
+               static_cast<connection_hash_t::value_type *>(nullptr)),
+        peek_dirty(true) {
+    // the peek table is rebuilt when peeked, the pointers are no longer valid
   }
 
-  void rebuild_peek_table() {
+  void rebuild_peek_table() const {
     /* Run through the monitor's connections and rebuild the peek table of
      * connection pointers.  This is done so peeking into the monitor can be
      * done in O(1) time instead of O(n) time for each peek. */
 
     /* zero out the peek array */
     std::fill(p_peek.begin(), p_peek.end(),
-              static_cast<tcp_connection_t *>(nullptr));
+              static_cast<connection_hash_t::value_type *>(nullptr));
 
     size_t i = 0;
-    for (connection_hash_t::iterator j = hash.begin(); j != hash.end();
+    for (connection_hash_t::const_iterator j = hash.begin(); j != hash.end();
          ++j, ++i) {
-      p_peek[i] = &j->first;
+      p_peek[i] = const_cast<connection_hash_t::value_type *>(&*j);
     }
+    peek_dirty = false;
   }
 
  private:
@@ -146,12 +175,76 @@ struct _tcp_port_monitor_t {
   const _tcp_port_monitor_t &operator=(const _tcp_port_monitor_t &);
 };
 
+namespace {
+/* ------------------------------------------------------------------------
+ * Index from a local port to the monitors whose range covers it
+ *
+ * The port space is cut at the range boundaries into segments, each listing
+ * the monitors covering all of it, so finding the monitors interested in a
+ * connection is a binary search instead of a visit to every monitor.
+ * ------------------------------------------------------------------------ */
+struct port_index_t {
+  /* first port of each segment, sorted, starting with 0 */
+  std::vector<unsigned> starts;
+  std::vector<std::vector<tcp_port_monitor_t *> > covering;
+  bool dirty = true;
+
+  void rebuild(monitor_hash_t &monitors);
+
+  /* the monitors interested in port, or nullptr if there are none */
+  const std::vector<tcp_port_monitor_t *> *find(in_port_t port) const {
+    if (starts.empty()) { return nullptr; }
+    size_t i = std::upper_bound(starts.begin(), starts.end(), port) -
+               starts.begin() - 1;
+    return covering[i].empty() ? nullptr : &covering[i];
+  }
+};
+
+void port_index_t::rebuild(monitor_hash_t &monitors) {
+  starts.assign(1, 0);
+  for (monitor_hash_t::iterator i = monitors.begin(); i != monitors.end();
+       ++i) {
+    starts.push_back(i->first.first);
+    starts.push_back(i->first.second + 1u);
+  }
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+  /* the segment after port 65535 is never looked up */
+  if (starts.back() > 65535) { starts.pop_back(); }
+
+  covering.assign(starts.size(), std::vector<tcp_port_monitor_t *>());
+  for (monitor_hash_t::iterator i = monitors.begin(); i != monitors.end();
+       ++i) {
+    size_t j = std::lower_bound(starts.begin(), starts.end(),
+                                unsigned(i->first.first)) -
+               starts.begin();
+    for (; j < starts.size() && starts[j] <= i->first.second; ++j) {
+      covering[j].push_back(&i->second);
+    }
+  }
+  dirty = false;
+}
+
+}  // namespace
+
 /* -----------------------------
  * A tcp port monitor collection
  * ----------------------------- */
 struct _tcp_port_monitor_collection_t {
   /* hash table of monitors */
   monitor_hash_t hash;
+  /* the monitors by port, rebuilt when one is added */
+  port_index_t index;
+#ifdef __linux__
+  /* sock_diag socket, -1 if not open yet */
+  int diag_fd = -1;
+  /* sock_diag failed for AF_INET or AF_INET6, use /proc/net instead */
+  bool diag_failed[2] = {false, false};
+
+  ~_tcp_port_monitor_collection_t() {
+    if (diag_fd >= 0) { close(diag_fd); }
+  }
+#endif
 };
 
 namespace {
@@ -172,7 +265,7 @@ void age_tcp_port_monitor(monitor_hash_t::value_type &monitor, void *p_void) {
 
   for (connection_hash_t::iterator i = monitor.second.hash.begin();
        i != monitor.second.hash.end();) {
-    if (--i->second >= 0)
+    if (--i->second.age >= 0)
       ++i;
     else {
       /* connection is old.  remove connection from the hash. */
@@ -180,57 +273,46 @@ void age_tcp_port_monitor(monitor_hash_t::value_type &monitor, void *p_void) {
       monitor.second.hash.erase(i++);
     }
   }
-}
 
-void rebuild_tcp_port_monitor_peek_table(monitor_hash_t::value_type &monitor,
-                                         void *p_void) {
-  if (p_void) { /* p_void should be nullptr in this context */
-    return;
-  }
-
-  monitor.second.rebuild_peek_table();
+  /* connections came and went, the peek table is rebuilt on the next peek */
+  monitor.second.peek_dirty = true;
 }
 
-void show_connection_to_tcp_port_monitor(monitor_hash_t::value_type &monitor,
-                                         void *p_void) {
-  /* The monitor gets to look at each connection to see if it falls within
-   * the monitor's port range of interest.  Connections of interest are first
-   * looked up in the hash to see if they are already there.  If they are, we
-   * reset the age of the connection so it is not deleted.  If the connection
-   * is not in the hash, we add it, but only if we haven't exceeded the
-   * maximum connection limit for the monitor.
+void show_connection_to_tcp_port_monitor(tcp_port_monitor_t &monitor,
+                                         const tcp_connection_t &conn) {
+  /* The monitor gets to look at a connection within its port range of
+   * interest.  The connection is first looked up in the hash to see if it is
+   * already there.  If it is, we reset the age of the connection so it is
+   * not deleted.  If the connection is not in the hash, we add it, but only
+   * if we haven't exceeded the maximum connection limit for the monitor.
    * The function takes O(1) time. */
 
-  tcp_connection_t *p_connection;
-
-  if (!p_void) { return; }
-
-  /* This p_connection is on caller's stack and not the heap.
-   * If we are interested, we will create a copy of the connection
-   * (on the heap) and add it to our list. */
-  p_connection = (tcp_connection_t *)p_void;
+  /* first check the hash to see if the connection is already there. */
+  connection_hash_t::iterator i = monitor.hash.find(conn);
+  if (i != monitor.hash.end()) {
+    /* it's already in the hash.  reset the age of the connection. */
+    i->second.age = TCP_CONNECTION_STARTING_AGE;
 
-  /* inspect the local port number of the connection to see if we're
-   * interested. */
-  if ((monitor.first.first <= p_connection->local_port) &&
-      (p_connection->local_port <= monitor.first.second)) {
-    /* the connection is in the range of the monitor. */
+    return;
+  }
 
-    /* first check the hash to see if the connection is already there. */
-    connection_hash_t::iterator i = monitor.second.hash.find(*p_connection);
-    if (i != monitor.second.hash.end()) {
-      /* it's already in the hash.  reset the age of the connection. */
-      i->second = TCP_CONNECTION_STARTING_AGE;
+  /* Connection is not yet in the hash.
+   * Add it if max_connections not exceeded. */
+  if (monitor.hash.size() < monitor.p_peek.size()) {
+    monitor.hash.insert(
+        connection_hash_t::value_type(conn, TCP_CONNECTION_STARTING_AGE));
+  }
+}
 
-      return;
-    }
+/* shows the connection to every monitor whose range covers its local port */
+void show_connection_to_collection(tcp_port_monitor_collection_t *p_collection,
+                                   const tcp_connection_t &conn) {
+  const std::vector<tcp_port_monitor_t *> *monitors =
+      p_collection->index.find(conn.local_port);
 
-    /* Connection is not yet in the hash.
-     * Add it if max_connections not exceeded. */
-    if (monitor.second.hash.size() < monitor.second.p_peek.size()) {
-      monitor.second.hash.insert(connection_hash_t::value_type(
-          *p_connection, TCP_CONNECTION_STARTING_AGE));
-    }
+  if (!monitors) { return; }
+  for (size_t i = 0; i < monitors->size(); ++i) {
+    show_connection_to_tcp_port_monitor(*(*monitors)[i], conn);
   }
 }
 
@@ -288,12 +370,63 @@ void print_host(char *p_buffer, size_t buffer_size, const struct in6_addr *addr,
               fqdn ? 0 : NI_NUMERICHOST);
 }
 
-/* converts the textual representation of an IPv4 or IPv6 address to struct
- * in6_addr */
+/* The lines of /proc/net/tcp{,6} are parsed by hand, there can be a lot of
+ * them on a busy machine and most are thrown away after the state and port.
+ * These return where parsing should go on, or nullptr at an unexpected
+ * character. */
+
+/* reads a hexadecimal number */
+const char *parse_hex(const char *p, unsigned long *value) {
+  const char *start = p;
+  unsigned long v = 0;
+
+  for (;; ++p) {
+    unsigned digit;
+
+    if (*p >= '0' && *p <= '9') {
+      digit = *p - '0';
+    } else if ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'f') {
+      digit = (*p | 0x20) - 'a' + 10;
+    } else {
+      break;
+    }
+    v = v * 16 + digit;
+  }
+  *value = v;
+  return p == start ? nullptr : p;
+}
+
+const char *skip_spaces(const char *p) {
+  while (*p == ' ') { ++p; }
+  return p;
+}
+
+/* skips a field and the spaces after it */
+const char *skip_field(const char *p) {
+  if (*p == ' ' || *p == '\0') { return nullptr; }
+  while (*p != ' ' && *p != '\0') { ++p; }
+  return skip_spaces(p);
+}
+
+/* reads an address:port pair, leaving the address text to be converted later;
+ * the address is 8 hex digits for IPv4 and 32 for IPv6 */
+const char *parse_endpoint(const char *p, const char **addr, in_port_t *port) {
+  unsigned long value;
+  const char *colon = std::strchr(p, ':');
+
+  if (!colon || (colon - p != 8 && colon - p != 32)) { return nullptr; }
+  *addr = p;
+  if (!(p = parse_hex(colon + 1, &value)) || value > 0xffff) { return nullptr; }
+  *port = value;
+  return skip_spaces(p);
+}
+
+/* converts an address as printed in /proc/net/tcp{,6} to struct in6_addr,
+ * each group of 8 digits is a 32 bit word in host byte order */
 void string_to_addr(struct in6_addr *addr, const char *p_buffer) {
   size_t i;
 
-  if (std::strlen(p_buffer) < 32) {  // IPv4 address
+  if (p_buffer[8] == ':') {  // IPv4 address
     i = sizeof(prefix_4on6);
     std::memcpy(addr->s6_addr, prefix_4on6, i);
   } else {
@@ -301,7 +434,13 @@ void string_to_addr(struct in6_addr *addr, const char *p_buffer) {
   }
 
   for (; i < sizeof(addr->s6_addr); i += 4, p_buffer += 8) {
-    std::sscanf(p_buffer, "%8x", (unsigned *)&addr->s6_addr[i]);
+    uint32_t word = 0;
+
+    for (int j = 0; j < 8; ++j) {
+      char c = p_buffer[j] | 0x20;
+      word = word * 16 + (c <= '9' ? c - '0' : c - 'a' + 10);
+    }
+    std::memcpy(&addr->s6_addr[i], &word, sizeof(word));
   }
 }
 
@@ -310,10 +449,11 @@ void process_file(tcp_port_monitor_collection_t *p_collection,
                   const char *file) {
   std::FILE *fp;
   char buf[256];
-  char local_addr[40];
-  char remote_addr[40];
+  const char *local_addr;
+  const char *remote_addr;
   tcp_connection_t conn;
-  unsigned long inode, uid, state;
+  unsigned long state;
+  bool reported = false;
 
   if ((fp = std::fopen(file, "r")) == nullptr) { return; }
 
@@ -323,30 +463,176 @@ void process_file(tcp_port_monitor_collection_t *p_collection,
     return;
   }
 
-  /* read all tcp connections */
+  /* read all tcp connections, e.g.
+   * "0: 0100007F:0277 00000000:0000 0A 00000000:00000000 00:00000000 "
+   * "00000000 0 0 23456 ..." */
   while (std::fgets(buf, sizeof(buf), fp) != nullptr) {
-    if (std::sscanf(buf,
-                    "%*d: %39[0-9a-fA-F]:%hx %39[0-9a-fA-F]:%hx %lx %*x:%*x "
-                    "%*x:%*x %*x %lu %*d %lu",
-                    local_addr, &conn.local_port, remote_addr,
-                    &conn.remote_port, (unsigned long *)&state,
-                    (unsigned long *)&uid, (unsigned long *)&inode) != 7) {
-      std::fprintf(stderr, "%s: bad file format\n", file);
+    const char *p = std::strchr(buf, ':');
+
+    if (!p || !(p = parse_endpoint(skip_spaces(p + 1), &local_addr,
+                                   &conn.local_port)) ||
+        !(p = parse_endpoint(p, &remote_addr, &conn.remote_port)) ||
+        !(p = parse_hex(p, &state))) {
+      if (!reported) { std::fprintf(stderr, "%s: bad file format\n", file); }
+      reported = true;
+      continue;
     }
     /** TCP_ESTABLISHED equals 1, but is not (always??) included **/
-    // if ((inode == 0) || (state != TCP_ESTABLISHED)) {
-    if ((inode == 0) || (state != 1)) { continue; }
+    if (state != 1) { continue; }
+
+    /* nobody is interested in this port */
+    if (!p_collection->index.find(conn.local_port)) { continue; }
+
+    /* skip tx_queue:rx_queue, tr:tm->when, retrnsmt, uid and timeout */
+    p = skip_spaces(p);
+    for (int i = 0; p && i < 5; ++i) { p = skip_field(p); }
+    if (!p || std::strtoul(p, nullptr, 10) == 0) { continue; }
 
     string_to_addr(&conn.local_addr, local_addr);
     string_to_addr(&conn.remote_addr, remote_addr);
 
-    /* show the connection to each port monitor. */
-    for_each_tcp_port_monitor_in_collection(
-        p_collection, &show_connection_to_tcp_port_monitor, (void *)&conn);
+    show_connection_to_collection(p_collection, conn);
   }
 
   std::fclose(fp);
 }
+
+#ifdef __linux__
+/* Asks the kernel for the established connections of the family, filtered to
+ * the monitored port ranges, and adds them to the collection.  Returns false
+ * if sock_diag can't be used, so the caller reads /proc/net instead. */
+bool process_sock_diag(tcp_port_monitor_collection_t *p_collection,
+                       int family) {
+  bool &failed = p_collection->diag_failed[family == AF_INET6];
+  static unsigned int seq = 0;
+
+  if (failed) { return false; }
+  if (p_collection->diag_fd < 0) {
+    p_collection->diag_fd =
+        socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (p_collection->diag_fd < 0) {
+      p_collection->diag_failed[0] = p_collection->diag_failed[1] = true;
+      return false;
+    }
+  }
+
+  /* The filter accepts a connection if its local port is within one of the
+   * ranges.  Each range is "sport >= begin" and "sport <= end", moving on to
+   * the next range when either fails, then a jump to the end, which accepts.
+   * Failing the last range jumps past the end, which rejects. */
+  struct range_filter {
+    struct inet_diag_bc_op ge[2];
+    struct inet_diag_bc_op le[2];
+    struct inet_diag_bc_op accept;
+  };
+  std::vector<range_filter> filter;
+  /* the jump offsets are 16 bits */
+  if (p_collection->hash.size() < 1024) {
+    filter.resize(p_collection->hash.size());
+  }
+  size_t i = 0;
+  for (monitor_hash_t::iterator j = p_collection->hash.begin();
+       i < filter.size(); ++j, ++i) {
+    unsigned short left = (filter.size() - i) * sizeof(range_filter);
+    bool last = i + 1 == filter.size();
+
+    filter[i].ge[0].code = INET_DIAG_BC_S_GE;
+    filter[i].ge[0].yes = sizeof(filter[i].ge);
+    filter[i].ge[0].no = last ? left + 4 : sizeof(range_filter);
+    filter[i].ge[1].no = j->first.first;
+    filter[i].le[0].code = INET_DIAG_BC_S_LE;
+    filter[i].le[0].yes = sizeof(filter[i].le);
+    filter[i].le[0].no =
+        last ? left - sizeof(filter[i].ge) + 4
+             : sizeof(range_filter) - sizeof(filter[i].ge);
+    filter[i].le[1].no = j->first.second;
+    filter[i].accept.code = INET_DIAG_BC_JMP;
+    filter[i].accept.yes = sizeof(filter[i].accept);
+    filter[i].accept.no = left - offsetof(range_filter, accept);
+  }
+
+  struct {
+    struct nlmsghdr nlh;
+    struct inet_diag_req_v2 req;
+    struct nlattr bytecode;
+  } request;
+  std::memset(&request, 0, sizeof(request));
+  size_t filter_size = filter.size() * sizeof(range_filter);
+  request.nlh.nlmsg_len = sizeof(request) + filter_size;
+  request.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+  request.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.nlh.nlmsg_seq = ++seq;
+  request.req.sdiag_family = family;
+  request.req.sdiag_protocol = IPPROTO_TCP;
+  /** TCP_ESTABLISHED equals 1 **/
+  request.req.idiag_states = 1 << 1;
+  request.bytecode.nla_type = INET_DIAG_REQ_BYTECODE;
+  request.bytecode.nla_len = sizeof(request.bytecode) + filter_size;
+  if (filter.empty()) { request.nlh.nlmsg_len -= sizeof(request.bytecode); }
+
+  struct sockaddr_nl kernel;
+  std::memset(&kernel, 0, sizeof(kernel));
+  kernel.nl_family = AF_NETLINK;
+  struct iovec iov[2] = {{&request, sizeof(request)},
+                         {filter.data(), filter_size}};
+  if (filter.empty()) { iov[0].iov_len -= sizeof(request.bytecode); }
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_name = &kernel;
+  msg.msg_namelen = sizeof(kernel);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  if (sendmsg(p_collection->diag_fd, &msg, 0) < 0) {
+    failed = true;
+    return false;
+  }
+
+  /* read the dump until it's done */
+  static char buf[32768] __attribute__((aligned(NLMSG_ALIGNTO)));
+  for (;;) {
+    ssize_t len = recv(p_collection->diag_fd, buf, sizeof(buf), 0);
+    if (len < 0) {
+      if (errno == EINTR) { continue; }
+      failed = true;
+      return false;
+    }
+
+    for (struct nlmsghdr *nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+         nlh = NLMSG_NEXT(nlh, len)) {
+      /* left over from an earlier dump */
+      if (nlh->nlmsg_seq != seq) { continue; }
+      if (nlh->nlmsg_type == NLMSG_DONE) { return true; }
+      if (nlh->nlmsg_type == NLMSG_ERROR) {
+        failed = true;
+        return false;
+      }
+      if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY) { continue; }
+
+      const struct inet_diag_msg *diag =
+          (const struct inet_diag_msg *)NLMSG_DATA(nlh);
+      tcp_connection_t conn;
+
+      /* like in /proc/net/tcp, connections without an inode are skipped */
+      if (diag->idiag_inode == 0) { continue; }
+
+      conn.local_port = ntohs(diag->id.idiag_sport);
+      conn.remote_port = ntohs(diag->id.idiag_dport);
+      if (diag->idiag_family == AF_INET) {
+        std::memcpy(conn.local_addr.s6_addr, prefix_4on6, sizeof(prefix_4on6));
+        std::memcpy(&conn.local_addr.s6_addr[12], diag->id.idiag_src, 4);
+        std::memcpy(conn.remote_addr.s6_addr, prefix_4on6,
+                    sizeof(prefix_4on6));
+        std::memcpy(&conn.remote_addr.s6_addr[12], diag->id.idiag_dst, 4);
+      } else {
+        std::memcpy(&conn.local_addr, diag->id.idiag_src, 16);
+        std::memcpy(&conn.remote_addr, diag->id.idiag_dst, 16);
+      }
+
+      show_connection_to_collection(p_collection, conn);
+    }
+  }
+}
+#endif /* __linux__ */
 }  // namespace
 
 /* ----------------------------------------------------------------------
@@ -375,66 +661,70 @@ int peek_tcp_port_monitor(const tcp_port_monitor_t *p_monitor, int item,
 
   sa.sin_family = AF_INET;
 
+  if (item == COUNT) {
+    std::snprintf(p_buffer, buffer_size, "%u",
+                  unsigned(p_monitor->hash.size()));
+    return 0;
+  }
+  if (item < 0 || item > LOCALSERVICE) { return -1; }
+
   /* if the connection index is out of range, we simply return with no error,
    * having first cleared the client-supplied buffer. */
-  if ((item != COUNT) &&
-      (connection_index >= ssize_t(p_monitor->hash.size()))) {
+  if (connection_index >= ssize_t(p_monitor->hash.size())) { return 0; }
+
+  /* rebuild the connection peek table so clients can peek in O(1) time */
+  if (p_monitor->peek_dirty) { p_monitor->rebuild_peek_table(); }
+
+  const tcp_connection_t &conn = p_monitor->p_peek[connection_index]->first;
+  std::string &text = p_monitor->p_peek[connection_index]->second.text[item];
+
+  /* formatted when peeked before */
+  if (!text.empty()) {
+    std::snprintf(p_buffer, buffer_size, "%s", text.c_str());
     return 0;
   }
 
   switch (item) {
-    case COUNT:
-
-      std::snprintf(p_buffer, buffer_size, "%u",
-                    unsigned(p_monitor->hash.size()));
-      break;
-
     case REMOTEIP:
 
-      print_host(p_buffer, buffer_size,
-                 &p_monitor->p_peek[connection_index]->remote_addr, 0);
+      print_host(p_buffer, buffer_size, &conn.remote_addr, 0);
       break;
 
     case REMOTEHOST:
 
-      print_host(p_buffer, buffer_size,
-                 &p_monitor->p_peek[connection_index]->remote_addr, 1);
+      print_host(p_buffer, buffer_size, &conn.remote_addr, 1);
       break;
 
     case REMOTEPORT:
 
-      std::snprintf(p_buffer, buffer_size, "%d",
-                    p_monitor->p_peek[connection_index]->remote_port);
+      std::snprintf(p_buffer, buffer_size, "%d", conn.remote_port);
       break;
 
     case REMOTESERVICE:
 
-      sa.sin_port = htons(p_monitor->p_peek[connection_index]->remote_port);
+      sa.sin_port = htons(conn.remote_port);
       getnameinfo((struct sockaddr *)&sa, sizeof(struct sockaddr_in), nullptr,
                   0, p_buffer, buffer_size, NI_NUMERICHOST);
       break;
 
     case LOCALIP:
 
-      print_host(p_buffer, buffer_size,
-                 &p_monitor->p_peek[connection_index]->local_addr, 0);
+      print_host(p_buffer, buffer_size, &conn.local_addr, 0);
       break;
 
     case LOCALHOST:
 
-      print_host(p_buffer, buffer_size,
-                 &p_monitor->p_peek[connection_index]->local_addr, 1);
+      print_host(p_buffer, buffer_size, &conn.local_addr, 1);
       break;
 
     case LOCALPORT:
 
-      std::snprintf(p_buffer, buffer_size, "%d",
-                    p_monitor->p_peek[connection_index]->local_port);
+      std::snprintf(p_buffer, buffer_size, "%d", conn.local_port);
       break;
 
     case LOCALSERVICE:
 
-      sa.sin_port = htons(p_monitor->p_peek[connection_index]->local_port);
+      sa.sin_port = htons(conn.local_port);
       getnameinfo((struct sockaddr *)&sa, sizeof(struct sockaddr_in), nullptr,
                   0, p_buffer, buffer_size, NI_NUMERICHOST);
       break;
@@ -443,6 +733,7 @@ int peek_tcp_port_monitor(const tcp_port_monitor_t *p_monitor, int item,
       return -1;
   }
 
+  text = p_buffer;
   return 0;
 }
 
@@ -467,17 +758,23 @@ void update_tcp_port_monitor_collection(
     tcp_port_monitor_collection_t *p_collection) {
   if (!p_collection) { return; }
 
-  process_file(p_collection, "/proc/net/tcp");
-  process_file(p_collection, "/proc/net/tcp6");
+  if (p_collection->hash.empty()) { return; }
+  if (p_collection->index.dirty) {
+    p_collection->index.rebuild(p_collection->hash);
+  }
+
+#ifdef __linux__
+  if (!process_sock_diag(p_collection, AF_INET))
+#endif
+    process_file(p_collection, "/proc/net/tcp");
+#ifdef __linux__
+  if (!process_sock_diag(p_collection, AF_INET6))
+#endif
+    process_file(p_collection, "/proc/net/tcp6");
 
   /* age the connections in all port monitors. */
   for_each_tcp_port_monitor_in_collection(p_collection, &age_tcp_port_monitor,
                                           nullptr);
-
-  /* rebuild the connection peek tables of all monitors
-   * so clients can peek in O(1) time */
-  for_each_tcp_port_monitor_in_collection(
-      p_collection, &rebuild_tcp_port_monitor_peek_table, nullptr);
 }
 
 /* Creation of redundant monitors is silently ignored */
@@ -489,6 +786,7 @@ int insert_new_tcp_port_monitor_into_collection(
   p_collection->hash.insert(monitor_hash_t::value_type(
       port_range_t(port_range_begin, port_range_end),
       tcp_port_monitor_t(p_creation_args->max_port_monitor_connections)));
+  p_collection->index.dirty = true;
 
   return 0;
 }
@@ -36,9 +36,14 @@
 #include "common.h"
 #include "conky.h"
 #include "diskio.h"
+#include "key-table.hh"
 #include "logging.h"
 #include "net_stat.h"
+#include "proc-connector.hh"
+#include "proc-file.hh"
 #include "proc.h"
+#include "rtnetlink.hh"
+#include "sample-ring.hh"
 #include "temphelper.h"
 #ifndef HAVE_CLOCK_GETTIME
 #include <sys/time.h>
@@ -47,9 +52,14 @@
 #include <unistd.h>
 // #include <assert.h>
 #include <time.h>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "setting.hh"
 #include "top.h"
+#include "uevent.hh"
+#include "update-cb.hh"
 
 #include <arpa/inet.h>
 #include <linux/sockios.h>
@@ -57,14 +67,19 @@
 #include <netinet/in.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #ifdef _NET_IF_H
 #define _LINUX_IF_H
 #endif
+#include <linux/netlink.h>
+#include <linux/perf_event.h>
 #include <linux/route.h>
 #include <linux/version.h>
 #include <math.h>
 #include <pthread.h>
+#include <algorithm>
 #include <atomic>
+#include <memory>
 #include <mutex>
 
 /* The following ifdefs were adapted from gkrellm */
@@ -90,12 +105,19 @@
 #include <iwlib.h>
 #endif
 
+struct sensor_file;
+
 struct sysfs {
-  int fd;
+  struct sensor_file *file;
   int arg;
   char devtype[256];
   char type[64];
   float factor, offset;
+  /* what to resolve again when the sensor index changes */
+  const char *dir;
+  char dev[64];
+  int n;
+  uint64_t generation;
 };
 
 /* To be used inside upspeed/f downspeed/f as ${gw_iface} variable */
@@ -135,9 +157,10 @@ int update_uptime(void) {
 #endif
   {
     static int reported = 0;
+    static conky::proc_file uptime_file("/proc/uptime");
     FILE *fp;
 
-    if (!(fp = open_file("/proc/uptime", &reported))) {
+    if (!(fp = uptime_file.open(&reported))) {
       info.uptime = 0.0;
       return 0;
     }
@@ -173,12 +196,14 @@ int check_mount(struct text_object *obj) {
 /* these things are also in sysinfo except Buffers:
  * (that's why I'm reading them from proc) */
 
+/* the fields of /proc/meminfo update_meminfo() looks at */
+static constexpr auto meminfo_keys = conky::make_key_table(
+    "MemTotal", "MemFree", "SwapTotal", "SwapFree", "Buffers", "Cached",
+    "Dirty", "MemAvailable", "Shmem", "SReclaimable");
+
 int update_meminfo(void) {
-  FILE *meminfo_fp;
   static int reported = 0;
-
-  /* unsigned int a; */
-  char buf[256];
+  static conky::proc_file meminfo_file("/proc/meminfo");
 
   /* With multi-threading, calculations that require
    * multiple steps to reach a final result can cause havok
@@ -194,33 +219,21 @@ int update_meminfo(void) {
           info.memeasyfree = info.legacymem = info.shmem = info.memavail =
               info.free_bufcache = 0;
 
-  if (!(meminfo_fp = open_file("/proc/meminfo", &reported))) { return 0; }
-
-  while (!feof(meminfo_fp)) {
-    if (fgets(buf, 255, meminfo_fp) == nullptr) { break; }
-
-    if (strncmp(buf, "MemTotal:", 9) == 0) {
-      sscanf(buf, "%*s %llu", &info.memmax);
-    } else if (strncmp(buf, "MemFree:", 8) == 0) {
-      sscanf(buf, "%*s %llu", &info.memfree);
-    } else if (strncmp(buf, "SwapTotal:", 10) == 0) {
-      sscanf(buf, "%*s %llu", &info.swapmax);
-    } else if (strncmp(buf, "SwapFree:", 9) == 0) {
-      sscanf(buf, "%*s %llu", &info.swapfree);
-    } else if (strncmp(buf, "Buffers:", 8) == 0) {
-      sscanf(buf, "%*s %llu", &info.buffers);
-    } else if (strncmp(buf, "Cached:", 7) == 0) {
-      sscanf(buf, "%*s %llu", &info.cached);
-    } else if (strncmp(buf, "Dirty:", 6) == 0) {
-      sscanf(buf, "%*s %llu", &info.memdirty);
-    } else if (strncmp(buf, "MemAvailable:", 13) == 0) {
-      sscanf(buf, "%*s %llu", &info.memavail);
-    } else if (strncmp(buf, "Shmem:", 6) == 0) {
-      sscanf(buf, "%*s %llu", &info.shmem);
-    } else if (strncmp(buf, "SReclaimable:", 13) == 0) {
-      sscanf(buf, "%*s %llu", &sreclaimable);
-    }
-  }
+  const char *buf = meminfo_file.read(&reported);
+  if (buf == nullptr) { return 0; }
+
+  /* in the order of meminfo_keys */
+  unsigned long long *const fields[] = {
+      &info.memmax,  &info.memfree,  &info.swapmax,  &info.swapfree,
+      &info.buffers, &info.cached,   &info.memdirty, &info.memavail,
+      &info.shmem,   &sreclaimable};
+  static_assert(sizeof fields / sizeof *fields == meminfo_keys.size(),
+                "a field for every key");
+  conky::for_each_key_value(
+      buf, buf + meminfo_file.size(), meminfo_keys,
+      [&](size_t key, const char *value, const char *eol) {
+        scan_decimal(value, eol, fields[key]);
+      });
 
   curmem = info.memwithbuffers = info.memmax - info.memfree;
   cureasyfree = info.memfree;
@@ -263,7 +276,6 @@ int update_meminfo(void) {
       info.memmax - (info.memfree + info.buffers + info.cached + sreclaimable);
   info.free_bufcache = info.cached + info.buffers + sreclaimable;
 
-  fclose(meminfo_fp);
   return 0;
 }
 
@@ -335,6 +347,9 @@ char *save_set_string(char *x, char *y) {
   return x;
 }
 
+/* tells when the routes and addresses need to be read again */
+static conky::rtnetlink_events net_events;
+
 void update_gateway_info_failure(const char *reason) {
   if (reason != nullptr) { perror(reason); }
   // 2 pointers to 1 location causes a crash when we try to free them both
@@ -374,13 +389,18 @@ int update_gateway_info2(void) {
   unsigned int x = 1;
   unsigned int z = 1;
   int strcmpreturn;
+  static unsigned long routes_seen = 0;
 
+  if (!net_events.changed(conky::rtnetlink_events::ROUTES, routes_seen)) {
+    return 0;
+  }
   if ((fp = check_procroute()) != nullptr) {
     while (!feof(fp)) {
       strcmpreturn = 1;
       if (fscanf(fp, RT_ENTRY_FORMAT, iface, &dest, &gate, &flags, &mask) !=
           5) {
         update_gateway_info_failure("fscanf()");
+        routes_seen = 0; /* try again next time */
         break;
       }
       if (!(dest || mask) && ((flags & RTF_GATEWAY) || !gate)) {
@@ -400,6 +420,8 @@ int update_gateway_info2(void) {
       }
     }
     fclose(fp);
+  } else {
+    routes_seen = 0;
   }
   return 0;
 }
@@ -410,7 +432,11 @@ int update_gateway_info(void) {
   char iface[iface_len];
   unsigned long dest, gate, mask;
   unsigned int flags;
+  static unsigned long routes_seen = 0;
 
+  if (!net_events.changed(conky::rtnetlink_events::ROUTES, routes_seen)) {
+    return 0;
+  }
   gw_info.reset();
   gw_info.count = 0;
 
@@ -419,6 +445,7 @@ int update_gateway_info(void) {
       if (fscanf(fp, RT_ENTRY_FORMAT, iface, &dest, &gate, &flags, &mask) !=
           5) {
         update_gateway_info_failure("fscanf()");
+        routes_seen = 0; /* try again next time */
         break;
       }
       if (!(dest || mask) && ((flags & RTF_GATEWAY) || !gate)) {
@@ -431,6 +458,8 @@ int update_gateway_info(void) {
       }
     }
     fclose(fp);
+  } else {
+    routes_seen = 0;
   }
   return 0;
 }
@@ -485,19 +514,174 @@ void print_gateway_ip(struct text_object *obj, char *p,
   snprintf(p, p_max_size, "%s", gw_info.ip);
 }
 
-void update_net_interfaces(FILE *net_dev_fp, bool is_first_update,
-                           double time_between_updates) {
-  /* read each interface */
+/* Moves the statistics of ns on to the total rx and tx byte counts r and t
+ * just read. */
+static void update_net_counters(struct net_stat *ns, long long r, long long t,
+                                bool is_first_update,
+                                double time_between_updates) {
+  long long last_recv, last_trans;
+
+  /* if the interface is parsed the first time, then set recv and trans
+   * to currently received, meaning the change in network traffic is 0 */
+  if (ns->last_read_recv == -1) {
+    ns->recv = r;
+    is_first_update = true;
+    ns->last_read_recv = r;
+  }
+  if (ns->last_read_trans == -1) {
+    ns->trans = t;
+    is_first_update = true;
+    ns->last_read_trans = t;
+  }
+  /* move current traffic statistic to last thereby obsoleting the
+   * current statistic */
+  last_recv = ns->recv;
+  last_trans = ns->trans;
+
+  /* If recv or trans is less than last time, an overflow happened.
+   * In that case set the last traffic to the current one, don't set
+   * it to 0, else a spike in the download and upload speed will occur! */
+  if (r < ns->last_read_recv) {
+    last_recv = r;
+  } else {
+    ns->recv += (r - ns->last_read_recv);
+  }
+  ns->last_read_recv = r;
+
+  if (t < ns->last_read_trans) {
+    last_trans = t;
+  } else {
+    ns->trans += (t - ns->last_read_trans);
+  }
+  ns->last_read_trans = t;
+
+  /* calculate instantaneous speeds, and average them over the last
+   * net_avg_samples */
+  const int samples = net_avg_samples.get(*state);
+  ns->recv_samples.set_window(samples);
+  ns->trans_samples.set_window(samples);
+  if (!is_first_update) {
+    ns->recv_samples.push((ns->recv - last_recv) / time_between_updates);
+    ns->trans_samples.push((ns->trans - last_trans) / time_between_updates);
+  }
+  ns->recv_speed = ns->recv_samples.average();
+  ns->trans_speed = ns->trans_samples.average();
+}
+
+/* Forgets the addresses of an interface that is about to be refreshed. */
+static void reset_net_addrs(struct net_stat *ns) {
+  ns->up = 1;
+  memset(&(ns->addr.sa_data), 0, 14);
+  ns->addrs.clear();
+}
+
+static void add_net_addr(const char *dev, const struct sockaddr *addr) {
+  struct net_stat *ns = find_net_stat(dev);
+  if (ns == nullptr) { return; }
+
+  ns->addr = *addr;
+  char temp_addr[18];
+  snprintf(temp_addr, sizeof(temp_addr), "%u.%u.%u.%u, ",
+           ns->addr.sa_data[2] & 255, ns->addr.sa_data[3] & 255,
+           ns->addr.sa_data[4] & 255, ns->addr.sa_data[5] & 255);
+  if (ns->addrs.find(temp_addr) == std::string::npos) ns->addrs += temp_addr;
+}
+
 #ifdef BUILD_WLAN
-  // wireless info variables
-  struct wireless_info *winfo;
+/* What an interface keeps while it stays associated: the basic config, the
+ * access point and the range, whose ioctl is by far the most expensive. It
+ * is asked again after rtnetlink reported a link change, which is also how
+ * wireless extensions send association and roaming events. */
+struct wireless_cache {
+  unsigned long links_seen{0};
+  bool has_basic{false};
+  struct wireless_config b;
+  bool has_range{false};
+  struct iw_range range;
+  bool has_ap_addr{false};
+  struct sockaddr ap_addr;
+};
+
+/* Only interfaces a wireless object refers to are asked, the ioctls are
+ * wasted on the rest. Only the statistics and the bitrate are polled. */
+static void update_wireless_info(struct net_stat *ns) {
+  static int skfd = -1;
+  static std::unordered_map<std::string, struct wireless_cache> caches;
   struct iwreq wrq;
-#endif
 
-  for (int i = 0; i < MAX_NET_INTERFACES; i++) {
+  if (skfd < 0 && (skfd = iw_sockets_open()) < 0) { return; }
+
+  struct wireless_cache &c = caches[ns->dev];
+  if (net_events.changed(conky::rtnetlink_events::LINKS, c.links_seen)) {
+    memset(&c.b, 0, sizeof(c.b));
+    c.has_basic = iw_get_basic_config(skfd, ns->dev, &c.b) > -1;
+    c.has_range =
+        c.has_basic && iw_get_range_info(skfd, ns->dev, &c.range) >= 0;
+    c.has_ap_addr = false;
+    if (c.has_basic && iw_get_ext(skfd, ns->dev, SIOCGIWAP, &wrq) >= 0) {
+      c.has_ap_addr = true;
+      memcpy(&c.ap_addr, &(wrq.u.ap_addr), sizeof(sockaddr));
+    }
+    /* not wireless (yet), look again next time */
+    if (!c.has_basic) { c.links_seen = 0; }
+  }
+  if (!c.has_basic) { return; }
+
+  // get bitrate
+  if (iw_get_ext(skfd, ns->dev, SIOCGIWRATE, &wrq) >= 0) {
+    iw_print_bitrate(ns->bitrate, 16, wrq.u.bitrate.value);
+  }
+
+  // get link quality
+  struct iw_statistics stats;
+  if (c.has_range &&
+      iw_get_stats(skfd, ns->dev, &stats, &c.range, c.has_range) >= 0) {
+    bool has_qual_level =
+        (stats.qual.level != 0) || (stats.qual.updated & IW_QUAL_DBM);
+
+    if (has_qual_level && !(stats.qual.updated & IW_QUAL_QUAL_INVALID)) {
+      ns->link_qual = stats.qual.qual;
+
+      if (c.range.max_qual.qual > 0) {
+        ns->link_qual_max = c.range.max_qual.qual;
+      }
+    }
+  }
+
+  // get ap mac
+  if (c.has_ap_addr) { iw_sawap_ntop(&c.ap_addr, ns->ap); }
+
+  // get essid
+  if (c.b.has_essid) {
+    if (c.b.essid_on) {
+      snprintf(ns->essid, 34, "%s", c.b.essid);
+    } else {
+      snprintf(ns->essid, 34, "%s", "off/any");
+    }
+  }
+
+  // get channel and freq
+  if (c.b.has_freq) {
+    if (c.has_range) {
+      ns->channel = iw_freq_to_channel(c.b.freq, &c.range);
+      iw_print_freq_value(ns->freq, 16, c.b.freq);
+    } else {
+      ns->channel = 0;
+      ns->freq[0] = 0;
+    }
+  }
+
+  snprintf(ns->mode, 16, "%s", iw_operation_mode[c.b.mode]);
+}
+#endif /* BUILD_WLAN */
+
+void update_net_interfaces(FILE *net_dev_fp, bool is_first_update,
+                           double time_between_updates) {
+  /* read each interface */
+  for (;;) {
     struct net_stat *ns;
     char *s, *p;
-    long long r, t, last_recv, last_trans;
+    long long r, t;
 
     /* quit only after all non-header lines from /proc/net/dev parsed */
     // FIXME: arbitrary size chosen to keep code simple.
@@ -517,257 +701,247 @@ void update_net_interfaces(FILE *net_dev_fp, bool is_first_update,
     *p = '\0';
     p++;
 
-    /* get pointer to interface statistics with the interface name in s */
-    ns = get_net_stat(s, nullptr, NULL);
-    ns->up = 1;
-    memset(&(ns->addr.sa_data), 0, 14);
-
-    memset(ns->addrs, 0,
-           17 * MAX_NET_INTERFACES +
-               1); /* Up to 17 chars per ip, max MAX_NET_INTERFACES interfaces.
-                      Nasty memory usage... */
+    /* get pointer to interface statistics with the interface name in s,
+     * skipping interfaces nothing asked about */
+    ns = find_net_stat(s);
+    if (ns == nullptr) { continue; }
+    reset_net_addrs(ns);
 
     /* bytes packets errs drop fifo frame compressed multicast|bytes ... */
     sscanf(p, "%lld  %*d     %*d  %*d  %*d  %*d   %*d        %*d       %lld",
            &r, &t);
 
-    /* if the interface is parsed the first time, then set recv and trans
-     * to currently received, meaning the change in network traffic is 0 */
-    if (ns->last_read_recv == -1) {
-      ns->recv = r;
-      is_first_update = true;
-      ns->last_read_recv = r;
-    }
-    if (ns->last_read_trans == -1) {
-      ns->trans = t;
-      is_first_update = true;
-      ns->last_read_trans = t;
-    }
-    /* move current traffic statistic to last thereby obsoleting the
-     * current statistic */
-    last_recv = ns->recv;
-    last_trans = ns->trans;
-
-    /* If recv or trans is less than last time, an overflow happened.
-     * In that case set the last traffic to the current one, don't set
-     * it to 0, else a spike in the download and upload speed will occur! */
-    if (r < ns->last_read_recv) {
-      last_recv = r;
-    } else {
-      ns->recv += (r - ns->last_read_recv);
-    }
-    ns->last_read_recv = r;
+    update_net_counters(ns, r, t, is_first_update, time_between_updates);
 
-    if (t < ns->last_read_trans) {
-      last_trans = t;
-    } else {
-      ns->trans += (t - ns->last_read_trans);
-    }
-    ns->last_read_trans = t;
+#ifdef BUILD_WLAN
+    if (ns->wireless) { update_wireless_info(ns); }
+#endif /* BUILD_WLAN */
+  }
 
-    /*** ip addr patch ***/
-    int file_descriptor = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
+  /*** ip addr patch ***/
+  int file_descriptor = socket(PF_INET, SOCK_DGRAM, IPPROTO_IP);
 
-    struct ifconf conf;
-    conf.ifc_buf = (char *)malloc(sizeof(struct ifreq) * MAX_NET_INTERFACES);
-    conf.ifc_len = sizeof(struct ifreq) * MAX_NET_INTERFACES;
-    memset(conf.ifc_buf, 0, conf.ifc_len);
+  /* without a buffer, SIOCGIFCONF tells how large one it needs */
+  struct ifconf conf {};
+  ioctl(file_descriptor, SIOCGIFCONF, &conf);
+  conf.ifc_buf = (char *)calloc(1, conf.ifc_len);
+  if (conf.ifc_buf != nullptr) { ioctl(file_descriptor, SIOCGIFCONF, &conf); }
 
-    ioctl(file_descriptor, SIOCGIFCONF, &conf);
+  for (unsigned int k = 0; k < conf.ifc_len / sizeof(struct ifreq); k++) {
+    if (!(((struct ifreq *)conf.ifc_buf) + k)) break;
 
-    for (unsigned int k = 0; k < conf.ifc_len / sizeof(struct ifreq); k++) {
-      struct net_stat *ns2;
+    add_net_addr(((struct ifreq *)conf.ifc_buf)[k].ifr_ifrn.ifrn_name,
+                 &((struct ifreq *)conf.ifc_buf)[k].ifr_ifru.ifru_addr);
+  }
 
-      if (!(((struct ifreq *)conf.ifc_buf) + k)) break;
+  close(file_descriptor);
 
-      ns2 = get_net_stat(((struct ifreq *)conf.ifc_buf)[k].ifr_ifrn.ifrn_name,
-                         nullptr, NULL);
-      ns2->addr = ((struct ifreq *)conf.ifc_buf)[k].ifr_ifru.ifru_addr;
-      char temp_addr[18];
-      snprintf(temp_addr, sizeof(temp_addr), "%u.%u.%u.%u, ",
-               ns2->addr.sa_data[2] & 255, ns2->addr.sa_data[3] & 255,
-               ns2->addr.sa_data[4] & 255, ns2->addr.sa_data[5] & 255);
-      if (nullptr == strstr(ns2->addrs, temp_addr))
-        strncpy(ns2->addrs + strlen(ns2->addrs), temp_addr, 17);
-    }
+  free(conf.ifc_buf);
+  /*** end ip addr patch ***/
+}
 
-    close(file_descriptor);
+/* What interface_up() asks about every interface it is given, from dumps of
+ * the link and address tables which are only made again after rtnetlink
+ * reported a change to them. Only one recv() per update when nothing changed,
+ * however many interfaces are asked about. */
+struct link_state_cache {
+  conky::rtnetlink rtnl;
+  bool failed{false};
+  double checked_at{-1};
+  unsigned long links_seen{0};
+  unsigned long addrs_seen{0};
+  bool have_addrs{false};
+  std::unordered_map<std::string, unsigned int> flags;
+  std::unordered_set<std::string> addressed;
+};
 
-    free(conf.ifc_buf);
-    /*** end ip addr patch ***/
+bool get_link_state(const char *dev, unsigned int &flags, bool *has_addr) {
+  static link_state_cache c;
 
-    if (!is_first_update) {
-      /* calculate instantaneous speeds */
-      ns->net_rec[0] = (ns->recv - last_recv) / time_between_updates;
-      ns->net_trans[0] = (ns->trans - last_trans) / time_between_updates;
-    }
+  if (c.failed) { return false; }
+  if (!c.rtnl.is_open() && !c.rtnl.open()) {
+    c.failed = true;
+    return false;
+  }
 
-    unsigned int curtmp1 = 0;
-    unsigned int curtmp2 = 0;
-    /* get an average over the last speed samples */
-    int samples = net_avg_samples.get(*state);
-    /* is OpenMP actually useful here? How large is samples? > 1000 ? */
-#ifdef HAVE_OPENMP
-#pragma omp parallel for reduction(+ : curtmp1, curtmp2) schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-    for (int j = 0; j < samples; j++) {
-      curtmp1 = curtmp1 + ns->net_rec[j];
-      curtmp2 = curtmp2 + ns->net_trans[j];
-    }
-    ns->recv_speed = curtmp1 / (double)samples;
-    ns->trans_speed = curtmp2 / (double)samples;
-    if (samples > 1) {
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-      for (int j = samples; j > 1; j--) {
-        ns->net_rec[j - 1] = ns->net_rec[j - 2];
-        ns->net_trans[j - 1] = ns->net_trans[j - 2];
+  if (c.checked_at != current_update_time) {
+    c.checked_at = current_update_time;
+    if (net_events.changed(conky::rtnetlink_events::LINKS, c.links_seen)) {
+      std::unordered_map<std::string, unsigned int> dumped;
+      if (!c.rtnl.dump_links(
+              [&dumped](const char *name, unsigned int link_flags,
+                        const struct rtnl_link_stats64 &) {
+                dumped[name] = link_flags;
+              })) {
+        /* dump again next time */
+        c.links_seen = 0;
+        c.checked_at = -1;
+        return false;
       }
+      c.flags.swap(dumped);
     }
+    if (net_events.changed(conky::rtnetlink_events::ADDRS, c.addrs_seen)) {
+      c.have_addrs = false;
+    }
+  }
 
-#ifdef BUILD_WLAN
-    /* update wireless info */
-    winfo = (struct wireless_info *)malloc(sizeof(struct wireless_info));
-    memset(winfo, 0, sizeof(struct wireless_info));
-
-    int skfd = iw_sockets_open();
-    if (iw_get_basic_config(skfd, s, &(winfo->b)) > -1) {
-      // set present winfo variables
-      if (iw_get_range_info(skfd, s, &(winfo->range)) >= 0) {
-        winfo->has_range = 1;
-      }
-      if (iw_get_stats(skfd, s, &(winfo->stats), &winfo->range,
-                       winfo->has_range) >= 0) {
-        winfo->has_stats = 1;
-      }
-      if (iw_get_ext(skfd, s, SIOCGIWAP, &wrq) >= 0) {
-        winfo->has_ap_addr = 1;
-        memcpy(&(winfo->ap_addr), &(wrq.u.ap_addr), sizeof(sockaddr));
-      }
-
-      // get bitrate
-      if (iw_get_ext(skfd, s, SIOCGIWRATE, &wrq) >= 0) {
-        memcpy(&(winfo->bitrate), &(wrq.u.bitrate), sizeof(iwparam));
-        iw_print_bitrate(ns->bitrate, 16, winfo->bitrate.value);
-      }
-
-      // get link quality
-      if (winfo->has_range && winfo->has_stats) {
-        bool has_qual_level = (winfo->stats.qual.level != 0) ||
-                              (winfo->stats.qual.updated & IW_QUAL_DBM);
-
-        if (has_qual_level &&
-            !(winfo->stats.qual.updated & IW_QUAL_QUAL_INVALID)) {
-          ns->link_qual = winfo->stats.qual.qual;
-
-          if (winfo->range.max_qual.qual > 0) {
-            ns->link_qual_max = winfo->range.max_qual.qual;
-          }
-        }
-      }
-
-      // get ap mac
-      if (winfo->has_ap_addr) { iw_sawap_ntop(&winfo->ap_addr, ns->ap); }
-
-      // get essid
-      if (winfo->b.has_essid) {
-        if (winfo->b.essid_on) {
-          snprintf(ns->essid, 34, "%s", winfo->b.essid);
-        } else {
-          snprintf(ns->essid, 34, "%s", "off/any");
-        }
+  /* only dumped for if_up_strictness address */
+  if (has_addr != nullptr) {
+    if (!c.have_addrs) {
+      std::unordered_set<std::string> dumped;
+      if (!c.rtnl.dump_ipv4_addrs(
+              [&dumped](const char *label, const struct in_addr &in) {
+                if (in.s_addr != 0u) { dumped.insert(label); }
+              })) {
+        return false;
       }
+      c.addressed.swap(dumped);
+      c.have_addrs = true;
+    }
+    *has_addr = c.addressed.count(dev) != 0;
+  }
 
-      // get channel and freq
-      if (winfo->b.has_freq) {
-        if (winfo->has_range == 1) {
-          ns->channel = iw_freq_to_channel(winfo->b.freq, &(winfo->range));
-          iw_print_freq_value(ns->freq, 16, winfo->b.freq);
-        } else {
-          ns->channel = 0;
-          ns->freq[0] = 0;
-        }
-      }
+  auto it = c.flags.find(dev);
+  flags = it != c.flags.end() ? it->second : 0;
+  return true;
+}
 
-      snprintf(ns->mode, 16, "%s", iw_operation_mode[winfo->b.mode]);
+/* The same as update_net_interfaces(), from one rtnetlink dump of the links
+ * and one of their addresses. */
+static bool update_net_interfaces_rtnl(conky::rtnetlink &rtnl,
+                                       bool is_first_update,
+                                       double time_between_updates) {
+  bool links = rtnl.dump_links(
+      [&](const char *dev, unsigned int,
+          const struct rtnl_link_stats64 &stats) {
+        struct net_stat *ns = find_net_stat(dev);
+        if (ns == nullptr) { return; }
+        reset_net_addrs(ns);
+        update_net_counters(ns, stats.rx_bytes, stats.tx_bytes,
+                            is_first_update, time_between_updates);
+#ifdef BUILD_WLAN
+        if (ns->wireless) { update_wireless_info(ns); }
+#endif /* BUILD_WLAN */
+      });
+  if (!links) { return false; }
+
+  /* the addresses are only dumped again when they changed */
+  static std::vector<std::pair<std::string, struct in_addr>> addrs;
+  static unsigned long addrs_seen = 0;
+  if (net_events.changed(conky::rtnetlink_events::ADDRS, addrs_seen)) {
+    std::vector<std::pair<std::string, struct in_addr>> dumped;
+    if (!rtnl.dump_ipv4_addrs(
+            [&dumped](const char *label, const struct in_addr &in) {
+              dumped.emplace_back(label, in);
+            })) {
+      addrs_seen = 0;
+      return false;
     }
-
-    iw_sockets_close(skfd);
-    free(winfo);
-#endif
+    addrs.swap(dumped);
   }
+  for (const auto &a : addrs) {
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr = a.second;
+    add_net_addr(a.first.c_str(), reinterpret_cast<struct sockaddr *>(&addr));
+  }
+  return true;
 }
 
 #ifdef BUILD_IPV6
-void update_ipv6_net_stats() {
+struct ipv6_addr_entry {
+  std::string dev;
+  struct v6addr addr;
+};
+
+/* /proc/net/if_inet6, parsed again when the addresses changed */
+static void read_ipv6_addrs(std::vector<struct ipv6_addr_entry> &addrs) {
   FILE *file;
   char v6addr[33];
   char devname[21];
   unsigned int netmask, scope;
-  struct net_stat *ns;
-  struct v6addr *lastv6;
-
-  // remove the old v6 addresses otherwise they are listed multiple times
-  for (unsigned int i = 0; i < MAX_NET_INTERFACES; i++) {
-    ns = &netstats[i];
-    while (ns->v6addrs != nullptr) {
-      lastv6 = ns->v6addrs;
-      ns->v6addrs = ns->v6addrs->next;
-      free(lastv6);
-    }
-  }
 
+  addrs.clear();
   if ((file = fopen(PROCDIR "/net/if_inet6", "r")) == nullptr) { return; }
 
   while (fscanf(file, "%32s %*02x %02x %02x %*02x %20s\n", v6addr, &netmask,
                 &scope, devname) != EOF) {
-    ns = get_net_stat(devname, nullptr, NULL);
-
-    if (ns->v6addrs == nullptr) {
-      lastv6 = (struct v6addr *)malloc(sizeof(struct v6addr));
-      ns->v6addrs = lastv6;
-    } else {
-      lastv6 = ns->v6addrs;
-      while (lastv6->next) lastv6 = lastv6->next;
-      lastv6->next = (struct v6addr *)malloc(sizeof(struct v6addr));
-      lastv6 = lastv6->next;
-    }
+    struct ipv6_addr_entry entry {};
+    entry.dev = devname;
 
     for (int i = 0; i < 16; i++)
-      sscanf(v6addr + 2 * i, "%2hhx", &(lastv6->addr.s6_addr[i]));
+      sscanf(v6addr + 2 * i, "%2hhx", &(entry.addr.addr.s6_addr[i]));
 
-    lastv6->netmask = netmask;
+    entry.addr.netmask = netmask;
 
     switch (scope) {
       case 0:  // global
-        lastv6->scope = 'G';
+        entry.addr.scope = 'G';
         break;
       case 16:  // host-local
-        lastv6->scope = 'H';
+        entry.addr.scope = 'H';
         break;
       case 32:  // link-local
-        lastv6->scope = 'L';
+        entry.addr.scope = 'L';
         break;
       case 64:  // site-local
-        lastv6->scope = 'S';
+        entry.addr.scope = 'S';
         break;
       case 128:  // compat
-        lastv6->scope = 'C';
+        entry.addr.scope = 'C';
         break;
       default:
-        lastv6->scope = '?';
+        entry.addr.scope = '?';
     }
 
-    lastv6->next = nullptr;
+    addrs.push_back(entry);
   }
 
   fclose(file);
 }
+
+void update_ipv6_net_stats() {
+  static std::vector<struct ipv6_addr_entry> addrs;
+  static unsigned long addrs_seen = 0;
+  struct net_stat *ns;
+  struct v6addr *lastv6;
+
+  // remove the old v6 addresses otherwise they are listed multiple times
+  for_each_net_stat([](struct net_stat *ns) {
+    while (ns->v6addrs != nullptr) {
+      struct v6addr *lastv6 = ns->v6addrs;
+      ns->v6addrs = ns->v6addrs->next;
+      free(lastv6);
+    }
+  });
+
+  if (net_events.changed(conky::rtnetlink_events::ADDRS, addrs_seen)) {
+    read_ipv6_addrs(addrs);
+  }
+
+  for (const auto &entry : addrs) {
+    ns = find_net_stat(entry.dev.c_str());
+    if (ns == nullptr) { continue; }
+
+    if (ns->v6addrs == nullptr) {
+      lastv6 = (struct v6addr *)malloc(sizeof(struct v6addr));
+      ns->v6addrs = lastv6;
+    } else {
+      lastv6 = ns->v6addrs;
+      while (lastv6->next) lastv6 = lastv6->next;
+      lastv6->next = (struct v6addr *)malloc(sizeof(struct v6addr));
+      lastv6 = lastv6->next;
+    }
+
+    *lastv6 = entry.addr;
+    lastv6->next = nullptr;
+  }
+}
 #endif /* BUILD_IPV6 */
 
 /**
- * Parses information from /proc/net/dev and stores them in ???
+ * Gets the statistics of every interface over rtnetlink, or parses them
+ * from /proc/net/dev if that fails, and stores those of the tracked ones.
  *
  * For the output format of /proc/net/dev @see http://linux.die.net/man/5/proc
  *
@@ -779,6 +953,7 @@ int update_net_stats(void) {
   update_gateway_info2();
   FILE *net_dev_fp;
   static int reported = 0;
+  static conky::proc_file net_dev_file("/proc/net/dev");
   /* variable to notify the parts averaging the download speed, that this
    * is the first call ever to this function. This variable can't be used
    * to decide if this is the first time an interface was parsed as there
@@ -794,9 +969,33 @@ int update_net_stats(void) {
   time_between_updates = current_update_time - last_update_time;
   if (time_between_updates <= 0.0001) { return 0; }
 
+  /* one dump of every link beats parsing /proc/net/dev, which is only
+   * read when rtnetlink can't be used */
+  static conky::rtnetlink rtnl;
+  static bool rtnl_failed = false;
+  if (!rtnl_failed && !rtnl.is_open() && !rtnl.open()) {
+    NORM_ERR("can't open rtnetlink socket, reading /proc/net/dev instead: %s",
+             strerror(errno));
+    rtnl_failed = true;
+  }
+  if (!rtnl_failed) {
+    if (update_net_interfaces_rtnl(rtnl, is_first_update,
+                                   time_between_updates)) {
+#ifdef BUILD_IPV6
+      update_ipv6_net_stats();
+#endif /* BUILD_IPV6 */
+      is_first_update = false;
+      return 0;
+    }
+    NORM_ERR("rtnetlink dump failed, reading /proc/net/dev instead: %s",
+             strerror(errno));
+    rtnl.close();
+    rtnl_failed = true;
+  }
+
   /* open file /proc/net/dev. If not something went wrong, clear all
    * network statistics */
-  if (!(net_dev_fp = open_file("/proc/net/dev", &reported))) {
+  if (!(net_dev_fp = net_dev_file.open(&reported))) {
     clear_net_stats();
     return 0;
   }
@@ -826,21 +1025,10 @@ int update_net_stats(void) {
 int result;
 
 int update_total_processes(void) {
-  DIR *dir;
-  struct dirent *entry;
-  int ignore1;
-  char ignore2;
-
-  info.procs = 0;
-  dir = opendir("/proc");
-  if (dir) {
-    while ((entry = readdir(dir))) {
-      if (sscanf(entry->d_name, "%d%c", &ignore1, &ignore2) == 1) {
-        info.procs++;
-      }
-    }
-    closedir(dir);
-  }
+  size_t count = 0;
+
+  count_proc_pids(&count);
+  info.procs = count;
   return 0;
 }
 
@@ -855,9 +1043,10 @@ int update_threads(void) {
 #endif
   {
     static int reported = 0;
+    static conky::proc_file loadavg_file("/proc/loadavg");
     FILE *fp;
 
-    if (!(fp = open_file("/proc/loadavg", &reported))) {
+    if (!(fp = loadavg_file.open(&reported))) {
       info.threads = 0;
       return 0;
     }
@@ -867,23 +1056,41 @@ int update_threads(void) {
   return 0;
 }
 
-#define CPU_SAMPLE_COUNT 15
+/* The jiffies of every cpu, by slot in info.cpu_usage. The arrays follow the
+ * struct in the same allocation, so it is freed with it, and lie side by side
+ * so cpu_usage_deltas() works out all usages in one loop. They are doubles,
+ * which hold jiffy counts exactly and, unlike 64 bit integers, convert
+ * nowhere in that loop. */
 struct cpu_info {
-  unsigned long long cpu_user;
-  unsigned long long cpu_system;
-  unsigned long long cpu_nice;
-  unsigned long long cpu_idle;
-  unsigned long long cpu_iowait;
-  unsigned long long cpu_irq;
-  unsigned long long cpu_softirq;
-  unsigned long long cpu_steal;
-  unsigned long long cpu_total;
-  unsigned long long cpu_active_total;
-  unsigned long long cpu_last_total;
-  unsigned long long cpu_last_active_total;
-  double cpu_val[CPU_SAMPLE_COUNT];
+  double *total;
+  double *active;
+  double *last_total;
+  double *last_active;
 };
 static short cpu_setup = 0;
+/* the last cpu_avg_samples usages of each cpu in global_cpu */
+static conky::sample_block<double> cpu_history;
+/* slot in info.cpu_usage (1 based, 0 if not present) of each cpu number, so
+ * cpus going offline don't shift the ones after them */
+static std::vector<unsigned int> cpu_slot;
+
+/* The aggregates of cpus asked for by name, like "socket1". Their usages
+ * follow those of the cpus in info.cpu_usage, and update_stat() sums the
+ * jiffies of their cpus so that they go through the same loop. */
+struct cpu_group {
+  std::string name;
+  std::vector<unsigned int> slots;
+};
+static std::vector<cpu_group> cpu_groups;
+
+/* where each cpu number sits, -1 where sysfs doesn't say */
+struct cpu_place {
+  int socket;
+  int core; /* counted over all sockets, so SMT siblings share it */
+  int node;
+  int llc; /* the last level cache */
+};
+static std::vector<cpu_place> cpu_places;
 
 /* Determine if this kernel gives us "extended" statistics information in
  * /proc/stat.
@@ -926,6 +1133,7 @@ void get_cpu_count(void) {
   char *saveptr1, *saveptr2;
   int subtoken1 = -1;
   int subtoken2 = -1;
+  unsigned int slots = 0;
 
   if (info.cpu_usage) { return; }
 
@@ -934,6 +1142,10 @@ void get_cpu_count(void) {
   }
 
   info.cpu_count = 0;
+  cpu_slot.clear();
+  cpu_groups.clear();
+  cpu_places.clear();
+  info.cpu_groups = 0;
 
   while (!feof(stat_fp)) {
     if (fgets(buf, 255, stat_fp) == nullptr) { break; }
@@ -959,6 +1171,15 @@ void get_cpu_count(void) {
           subtoken2 = strtol(subtoken, nullptr, 10);
       }
       if (subtoken2 > 0) info.cpu_count += subtoken2 - subtoken1;
+
+      int last = subtoken2 > 0 ? subtoken2 : subtoken1;
+      if (subtoken1 < 0 || last < subtoken1) { continue; }
+      if (cpu_slot.size() <= static_cast<size_t>(last)) {
+        cpu_slot.resize(last + 1, 0);
+      }
+      for (int n = subtoken1; n <= last; ++n) {
+        if (cpu_slot[n] == 0) { cpu_slot[n] = ++slots; }
+      }
     }
   }
   info.cpu_usage = (float *)malloc((info.cpu_count + 1) * sizeof(float));
@@ -966,136 +1187,304 @@ void get_cpu_count(void) {
   fclose(stat_fp);
 }
 
-#define TMPL_LONGSTAT "%*s %llu %llu %llu %llu %llu %llu %llu %llu"
-#define TMPL_SHORTSTAT "%*s %llu %llu %llu %llu"
+static int read_sysfs_int(const char *path, int fallback) {
+  FILE *fp = fopen(path, "re");
+  int value = fallback;
+
+  if (fp != nullptr) {
+    if (fscanf(fp, "%d", &value) != 1) { value = fallback; }
+    fclose(fp);
+  }
+  return value;
+}
+
+static void read_cpu_places() {
+  std::map<std::pair<int, int>, int> cores;
+  std::map<std::string, int> caches;
+  char path[256];
+
+  cpu_places.assign(cpu_slot.size(), cpu_place{-1, -1, -1, -1});
+  for (size_t n = 0; n < cpu_slot.size(); ++n) {
+    if (cpu_slot[n] == 0) { continue; }
+    cpu_place &place = cpu_places[n];
+    int len = snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%zu", n);
+
+    snprintf(path + len, sizeof path - len, "/topology/physical_package_id");
+    place.socket = read_sysfs_int(path, 0);
+    snprintf(path + len, sizeof path - len, "/topology/core_id");
+    int core_id = read_sysfs_int(path, static_cast<int>(n));
+    place.core = cores
+                     .emplace(std::make_pair(place.socket, core_id),
+                              static_cast<int>(cores.size()))
+                     .first->second;
+
+    path[len] = '\0';
+    if (DIR *dir = opendir(path)) {
+      while (struct dirent *entry = readdir(dir)) {
+        if (sscanf(entry->d_name, "node%d", &place.node) == 1) { break; }
+        place.node = -1;
+      }
+      closedir(dir);
+    }
+
+    /* the cache of the highest level; its id if the kernel has them, else
+     * the caches are numbered as they come up */
+    int level = 0;
+    for (int i = 0;; ++i) {
+      snprintf(path + len, sizeof path - len, "/cache/index%d/level", i);
+      int l = read_sysfs_int(path, -1);
+      if (l < 0) { break; }
+      if (l < level) { continue; }
+      level = l;
+      snprintf(path + len, sizeof path - len, "/cache/index%d/id", i);
+      place.llc = read_sysfs_int(path, -1);
+      if (place.llc >= 0) { continue; }
+      snprintf(path + len, sizeof path - len,
+               "/cache/index%d/shared_cpu_list", i);
+      char shared[256] = "";
+      if (FILE *fp = fopen(path, "re")) {
+        if (fgets(shared, sizeof shared, fp) == nullptr) { shared[0] = 0; }
+        fclose(fp);
+      }
+      place.llc =
+          caches.emplace(shared, static_cast<int>(caches.size())).first->second;
+    }
+  }
+}
+
+int cpu_group_slot(const char *kind, int n) {
+  int cpu_place::*field;
+
+  if (strcmp(kind, "socket") == 0) {
+    field = &cpu_place::socket;
+  } else if (strcmp(kind, "core") == 0) {
+    field = &cpu_place::core;
+  } else if (strcmp(kind, "node") == 0) {
+    field = &cpu_place::node;
+  } else if (strcmp(kind, "llc") == 0) {
+    field = &cpu_place::llc;
+  } else {
+    return -1;
+  }
+
+  get_cpu_count();
+  if (info.cpu_usage == nullptr) { return 0; }
+  std::string name = kind + std::to_string(n);
+  for (size_t g = 0; g < cpu_groups.size(); ++g) {
+    if (cpu_groups[g].name == name) { return info.cpu_count + 1 + g; }
+  }
+
+  if (cpu_places.empty()) { read_cpu_places(); }
+  cpu_group group{name, {}};
+  for (size_t c = 0; c < cpu_places.size(); ++c) {
+    if (cpu_slot[c] != 0 && cpu_places[c].*field == n) {
+      group.slots.push_back(cpu_slot[c]);
+    }
+  }
+  if (group.slots.empty()) {
+    NORM_ERR("there is no cpu in %s, showing all of them", name.c_str());
+    return 0;
+  }
+
+  /* update_stat() makes room for the new slot in its own arrays */
+  cpu_groups.push_back(std::move(group));
+  info.cpu_groups = cpu_groups.size();
+  size_t slots = info.cpu_count + 1 + info.cpu_groups;
+  info.cpu_usage =
+      static_cast<float *>(realloc(info.cpu_usage, slots * sizeof(float)));
+  info.cpu_usage[slots - 1] = 0;
+  return slots - 1;
+}
+
+const char *scan_decimal(const char *p, const char *end,
+                         unsigned long long *value) {
+  unsigned long long v = 0;
+
+  while (p < end && *p == ' ') { ++p; }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  /* take eight digits at a time while we can, most jiffy counts are longer
+   * than that on machines that have been up for a while */
+  while (end - p >= 8) {
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof chunk);
+    /* every byte in '0'..'9': high nibble 3, and no carry out of it when
+     * adding 6 */
+    if (((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+         (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) !=
+        0x3333333333333333ULL) {
+      break;
+    }
+    /* combine neighbouring digits, then pairs, then quadruples */
+    chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    chunk = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+    v = v * 100000000ULL + (chunk & 0xFFFFFFFFULL);
+    p += 8;
+  }
+#endif
+
+  while (p < end && *p >= '0' && *p <= '9') { v = v * 10 + (*p++ - '0'); }
+  *value = v;
+  return p;
+}
+
+static struct cpu_info *new_cpu_info(size_t n) {
+  void *block = calloc(1, sizeof(struct cpu_info) + 4 * n * sizeof(double));
+  auto *cpu = static_cast<struct cpu_info *>(block);
+  auto *arrays = reinterpret_cast<double *>(cpu + 1);
+  cpu->total = arrays;
+  cpu->active = arrays + n;
+  cpu->last_total = arrays + 2 * n;
+  cpu->last_active = arrays + 3 * n;
+  return cpu;
+}
+
+/* The share of the jiffies since the last update that each of n cpus spent
+ * busy, with no branches and no calls so it vectorizes. */
+static void cpu_usage_deltas(const struct cpu_info *cpu, size_t n,
+                             double *__restrict usage) {
+  const double *__restrict now_total = cpu->total;
+  const double *__restrict now_active = cpu->active;
+  const double *__restrict last_total = cpu->last_total;
+  const double *__restrict last_active = cpu->last_active;
+
+  for (size_t i = 0; i < n; ++i) {
+    double total = now_total[i] - last_total[i];
+    double active = now_active[i] - last_active[i];
+    /* no time passing counts as fully busy, and is 1 / 1 rather than a
+     * branch around the division */
+    double none = total == 0 ? 1.0 : 0.0;
+    usage[i] = (active + none) / (total + none);
+  }
+}
 
 int update_stat(void) {
-  FILE *stat_fp;
   static int reported = 0;
+  static conky::proc_file stat_file("/proc/stat");
+  /* cpus found in this read, kept around to not allocate every update */
+  static std::vector<char> seen;
+  /* the usage of each cpu in this update, before averaging */
+  static std::vector<double> usage;
+  /* how many slots global_cpu was made for */
+  static size_t cpu_info_slots = 0;
   struct cpu_info *cpu = nullptr;
-  char buf[256];
-  int i;
   unsigned int idx;
-  double curtmp;
-  const char *stat_template = nullptr;
-  unsigned int malloc_cpu_size = 0;
   extern void *global_cpu;
 
-  static pthread_mutex_t last_stat_update_mutex = PTHREAD_MUTEX_INITIALIZER;
-  static double last_stat_update = 0.0;
-  float cur_total = 0.0;
-
-  /* since we use wrappers for this function, the update machinery
-   * can't eliminate double invocations of this function. Check for
-   * them here, otherwise cpu_usage counters are freaking out. */
-  pthread_mutex_lock(&last_stat_update_mutex);
-  if (last_stat_update == current_update_time) {
-    pthread_mutex_unlock(&last_stat_update_mutex);
-    return 0;
-  }
-  last_stat_update = current_update_time;
-  pthread_mutex_unlock(&last_stat_update_mutex);
+  /* update_cpu_usage() and update_running_processes() are registered as
+   * aliases of this function (see create_cb_handle()), so it runs exactly
+   * once per update. */
 
   /* add check for !info.cpu_usage since that mem is freed on a SIGUSR1 */
   if (!cpu_setup || !info.cpu_usage) {
     get_cpu_count();
     cpu_setup = 1;
   }
-
-  if (!stat_template) {
-    stat_template =
-        KFLAG_ISSET(KFLAG_IS_LONGSTAT) ? TMPL_LONGSTAT : TMPL_SHORTSTAT;
+  if (!info.cpu_usage) { return 0; }
+
+  const size_t cpus = info.cpu_count + 1;
+  const size_t slots = cpus + cpu_groups.size();
+  if (global_cpu && cpu_info_slots != slots) {
+    /* a group was added, the cpus start over from their next read */
+    free(global_cpu);
+    global_cpu = nullptr;
   }
-
   if (global_cpu) {
     cpu = reinterpret_cast<struct cpu_info *>(global_cpu);
   } else {
-    malloc_cpu_size = (info.cpu_count + 1) * sizeof(struct cpu_info);
-    cpu = (struct cpu_info *)malloc(malloc_cpu_size);
-    memset(cpu, 0, malloc_cpu_size);
+    cpu = new_cpu_info(slots);
     global_cpu = cpu;
+    cpu_info_slots = slots;
+    cpu_history = conky::sample_block<double>(slots);
   }
 
-  if (!(stat_fp = open_file("/proc/stat", &reported))) {
+  const char *p = stat_file.read(&reported);
+  if (p == nullptr) {
     info.run_threads = 0;
-    if (info.cpu_usage) {
-      memset(info.cpu_usage, 0, info.cpu_count * sizeof(float));
-    }
+    memset(info.cpu_usage, 0, slots * sizeof(float));
     return 0;
   }
-
-  idx = 0;
-  while (!feof(stat_fp)) {
-    if (fgets(buf, 255, stat_fp) == nullptr) { break; }
-
-    if (strncmp(buf, "procs_running ", 14) == 0) {
-      sscanf(buf, "%*s %hu", &info.run_threads);
-    } else if (strncmp(buf, "cpu", 3) == 0) {
-      double delta;
-      if (isdigit((unsigned char)buf[3])) {
-        idx++;  // just increment here since the CPU index can skip numbers
+  const char *end = p + stat_file.size();
+
+  const bool sample = current_update_time - last_update_time > 0.001;
+  const int samples = cpu_avg_samples.get(*state);
+  const int fields = KFLAG_ISSET(KFLAG_IS_LONGSTAT) ? 8 : 4;
+  seen.assign(slots, 0);
+
+  /* the whole file is in memory, so skip the long intr and softirq lines
+   * with memchr() instead of going through them in line sized pieces */
+  while (p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) { eol = end; }
+
+    if (eol - p > 3 && memcmp(p, "cpu", 3) == 0) {
+      const char *q = p + 3;
+      if (isdigit((unsigned char)*q)) {
+        unsigned long long n;
+        q = scan_decimal(q, eol, &n);
+        idx = n < cpu_slot.size() ? cpu_slot[n] : 0;
+        if (idx == 0 || idx > info.cpu_count) { q = nullptr; }
       } else {
         idx = 0;
       }
-      if (idx > info.cpu_count) { continue; }
-      sscanf(buf, stat_template, &(cpu[idx].cpu_user), &(cpu[idx].cpu_nice),
-             &(cpu[idx].cpu_system), &(cpu[idx].cpu_idle),
-             &(cpu[idx].cpu_iowait), &(cpu[idx].cpu_irq),
-             &(cpu[idx].cpu_softirq), &(cpu[idx].cpu_steal));
-
-      cpu[idx].cpu_total = cpu[idx].cpu_user + cpu[idx].cpu_nice +
-                           cpu[idx].cpu_system + cpu[idx].cpu_idle +
-                           cpu[idx].cpu_iowait + cpu[idx].cpu_irq +
-                           cpu[idx].cpu_softirq + cpu[idx].cpu_steal;
-
-      cpu[idx].cpu_active_total =
-          cpu[idx].cpu_total - (cpu[idx].cpu_idle + cpu[idx].cpu_iowait);
-
-      delta = current_update_time - last_update_time;
-
-      if (delta <= 0.001) { break; }
-
-      cur_total = (float)(cpu[idx].cpu_total - cpu[idx].cpu_last_total);
-      if (cur_total == 0.0) {
-        cpu[idx].cpu_val[0] = 1.0;
-      } else {
-        cpu[idx].cpu_val[0] =
-            (cpu[idx].cpu_active_total - cpu[idx].cpu_last_active_total) /
-            cur_total;
+      if (q != nullptr && sample) {
+        /* user nice system idle iowait irq softirq steal */
+        unsigned long long v[8] = {0};
+        for (int i = 0; i < fields; ++i) { q = scan_decimal(q, eol, &v[i]); }
+        unsigned long long total =
+            v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+        cpu->total[idx] = static_cast<double>(total);
+        cpu->active[idx] = static_cast<double>(total - (v[3] + v[4]));
+        seen[idx] = 1;
       }
-      curtmp = 0;
+    } else if (eol - p > 14 && memcmp(p, "procs_running ", 14) == 0) {
+      unsigned long long n;
+      scan_decimal(p + 14, eol, &n);
+      info.run_threads = n;
+    }
+    p = eol + 1;
+  }
 
-      int samples = std::min(cpu_avg_samples.get(*state), CPU_SAMPLE_COUNT);
-      for (i = 0; i < samples; i++) { curtmp = curtmp + cpu[idx].cpu_val[i]; }
-      info.cpu_usage[idx] = curtmp / samples;
+  if (!sample) { return 0; }
 
-      cpu[idx].cpu_last_total = cpu[idx].cpu_total;
-      cpu[idx].cpu_last_active_total = cpu[idx].cpu_active_total;
-      for (i = samples - 1; i > 0 && i < CPU_SAMPLE_COUNT; i--) {
-        cpu[idx].cpu_val[i] = cpu[idx].cpu_val[i - 1];
-      }
+  for (size_t g = 0; g < cpu_groups.size(); ++g) {
+    double total = 0;
+    double active = 0;
+    char any = 0;
+    for (unsigned int member : cpu_groups[g].slots) {
+      total += cpu->total[member];
+      active += cpu->active[member];
+      any |= seen[member];
     }
+    cpu->total[cpus + g] = total;
+    cpu->active[cpus + g] = active;
+    seen[cpus + g] = any;
   }
-  fclose(stat_fp);
-  return 0;
-}
 
-int update_running_processes(void) {
-  update_stat();
-  return 0;
-}
-
-int update_cpu_usage(void) {
-  struct timespec tc = {0L, 100L * 1000000L};
-  update_stat();
-  if (-1 == (nanosleep(&tc, NULL))) {
-    NORM_ERR("update_cpu_usage(): nanosleep() failed");
-    return 0;
+  usage.resize(slots);
+  cpu_usage_deltas(cpu, slots, usage.data());
+  /* offline cpus keep their slot but aren't busy */
+  for (idx = 0; idx < slots; ++idx) {
+    if (!seen[idx]) { usage[idx] = 0; }
+  }
+  std::copy_n(cpu->total, slots, cpu->last_total);
+  std::copy_n(cpu->active, slots, cpu->last_active);
+
+  cpu_history.resize(slots, samples);
+  cpu_history.push(usage.data());
+  cpu_history.averages(info.cpu_usage);
+  for (idx = 1; idx < slots; ++idx) {
+    if (!seen[idx]) { info.cpu_usage[idx] = 0; }
   }
-  update_stat();
   return 0;
 }
 
+/* these are only used to look up update_stat() when registering callbacks */
+int update_running_processes(void) { return update_stat(); }
+
+int update_cpu_usage(void) { return update_stat(); }
+
 void free_cpu(struct text_object *) { /* no-op */
 }
 
@@ -1133,9 +1522,10 @@ int update_load_average(void) {
 #endif
   {
     static int reported = 0;
+    static conky::proc_file loadavg_file("/proc/loadavg");
     FILE *fp;
 
-    if (!(fp = open_file("/proc/loadavg", &reported))) {
+    if (!(fp = loadavg_file.open(&reported))) {
       info.loadavg[0] = info.loadavg[1] = info.loadavg[2] = 0.0;
       return 0;
     }
@@ -1181,85 +1571,192 @@ static int get_first_file_in_a_directory(const char *dir, char *s,
   }
 }
 
+/* a sensor input opened once and shared by every object reading it */
+struct sensor_file {
+  std::string path;
+  int fd;
+  int refs;
+};
+
+namespace {
+/*
+ * What resolving sensor arguments needs from sysfs: the entries of the sensor
+ * directories and the names of the hwmon devices. It is filled lazily, kept
+ * across config reloads and dropped when a uevent says that a hwmon, i2c or
+ * platform device came or went, at which point generation() changes and the
+ * objects resolve their sensors again. Without uevents nothing is cached.
+ */
+class sensor_index {
+  std::unordered_map<std::string, std::vector<std::string>> listings;
+  std::unordered_map<std::string, std::string> names;
+  std::unordered_map<std::string, sensor_file> files;
+  conky::uevent_monitor monitor;
+  bool monitor_failed = false;
+  double last_refresh = -1;
+  uint64_t gen = 1;
+
+ public:
+  /* looks for device changes, at most once per update */
+  void refresh();
+  uint64_t generation() const { return gen; }
+
+  /* the entries of dir without the dot files, sorted */
+  std::vector<std::string> list(const std::string &dir);
+  /* the contents of dir/entry/name without the newline */
+  std::string name(const std::string &dir, const std::string &entry);
+
+  sensor_file *open(const std::string &path);
+  void release(sensor_file *file);
+};
+
+void sensor_index::refresh() {
+  if (last_refresh == current_update_time) { return; }
+  last_refresh = current_update_time;
+
+  if (!monitor.is_open() && !monitor_failed && !monitor.open()) {
+    NORM_ERR("can't listen for uevents, sensors won't follow device changes: "
+             "%s",
+             strerror(errno));
+    monitor_failed = true;
+  }
+  if (!monitor.is_open()) { return; }
+
+  bool changed = false;
+  auto on_event = [&changed](const char *action, const char *subsystem) {
+    if (strcmp(subsystem, "hwmon") != 0 && strcmp(subsystem, "i2c") != 0 &&
+        strcmp(subsystem, "platform") != 0) {
+      return;
+    }
+    if (strcmp(action, "add") == 0 || strcmp(action, "remove") == 0 ||
+        strcmp(action, "bind") == 0 || strcmp(action, "unbind") == 0 ||
+        strcmp(action, "move") == 0) {
+      changed = true;
+    }
+  };
+  if (!monitor.read_events(on_event)) { changed = true; }
+
+  if (changed) {
+    listings.clear();
+    names.clear();
+    ++gen;
+  }
+}
+
+std::vector<std::string> sensor_index::list(const std::string &dir) {
+  auto it = listings.find(dir);
+  if (it != listings.end()) { return it->second; }
+
+  std::vector<std::string> entries;
+  struct dirent **namelist;
+  int n = scandir(dir.c_str(), &namelist, no_dots, alphasort);
+  if (n < 0) {
+    NORM_ERR("scandir for %s: %s", dir.c_str(), strerror(errno));
+    return entries;
+  }
+  for (int i = 0; i < n; i++) {
+    entries.emplace_back(namelist[i]->d_name);
+    free(namelist[i]);
+  }
+  free(namelist);
+
+  if (monitor.is_open()) { listings[dir] = entries; }
+  return entries;
+}
+
+std::string sensor_index::name(const std::string &dir,
+                               const std::string &entry) {
+  std::string path = dir + entry + "/name";
+  auto it = names.find(path);
+  if (it != names.end()) { return it->second; }
+
+  std::string name;
+  char buf[256];
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if (len > 0) { name.assign(buf, len); }
+    close(fd);
+  }
+  while (!name.empty() && name.back() == '\n') { name.pop_back(); }
+
+  if (monitor.is_open()) { names[path] = name; }
+  return name;
+}
+
+sensor_file *sensor_index::open(const std::string &path) {
+  auto it = files.find(path);
+  if (it != files.end()) {
+    it->second.refs++;
+    return &it->second;
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { return nullptr; }
+  sensor_file &file = files[path];
+  file.path = path;
+  file.fd = fd;
+  file.refs = 1;
+  return &file;
+}
+
+void sensor_index::release(sensor_file *file) {
+  if (file == nullptr || --file->refs > 0) { return; }
+  if (file->fd >= 0) { close(file->fd); }
+  files.erase(file->path);
+}
+
+sensor_index &sensors() {
+  static sensor_index index;
+  return index;
+}
+}  // namespace
+
 /*
  * Convert @dev "0" (hwmon number) or "k10temp" (hwmon name) to "hwmon2/device"
  */
 static void get_dev_path(const char *dir, const char *dev, char *out_buf) {
-  struct dirent **namelist;
-  char path[256] = {'\0'};
-  char name[256] = {'\0'};
-  bool found = false;
-  size_t size;
-  int name_fd;
-  int i;
   int n;
-  int ret;
 
   /* "0" numbered case */
-  ret = sscanf(dev, "%d", &n);
-  if (ret == 1) {
+  if (sscanf(dev, "%d", &n) == 1) {
     snprintf(out_buf, 255, "hwmon%d/device", n);
     return;
   }
 
-  /* "k10temp" name case, need to search hwmon*->name to find a match */
-  n = scandir(dir, &namelist, no_dots, alphasort);
-  if (n < 0) {
-    NORM_ERR("scandir for %s: %s", dir, strerror(errno));
-    goto not_found;
-  }
-  if (n == 0) goto not_found;
-
-  /* Search each hwmon%s/name */
-  for (i = 0; i < n; i++) {
-    if (found) continue;
-
-    snprintf(path, 256, "%s%s/name", dir, namelist[i]->d_name);
-    name_fd = open(path, O_RDONLY);
-    if (name_fd < 0) continue;
-    size = read(name_fd, name, strlen(dev));
-    if (size < strlen(dev)) {
-      close(name_fd);
-      continue;
-    }
-    ret = strncmp(dev, name, strlen(dev));
-    if (!ret) {
-      found = true;
-      snprintf(out_buf, 255, "%s/device", namelist[i]->d_name);
+  /* "k10temp" name case, search hwmon*->name for a match */
+  size_t len = strlen(dev);
+  for (const auto &entry : sensors().list(dir)) {
+    std::string name = sensors().name(dir, entry);
+    if (name.size() >= len && name.compare(0, len, dev) == 0) {
+      snprintf(out_buf, 255, "%s/device", entry.c_str());
+      return;
     }
-    close(name_fd);
   }
-
-  /* cleanup */
-  for (i = 0; i < n; i++) free(namelist[i]);
-  free(namelist);
-  if (found) return;
-
-not_found:
   out_buf[0] = '\0';
-  return;
 }
 
-static int open_sysfs_sensor(const char *dir, const char *dev, const char *type,
-                             int n, int *divisor, char *devtype) {
+static struct sensor_file *open_sysfs_sensor(const char *dir, const char *dev,
+                                             const char *type, int n,
+                                             int *divisor, char *devtype) {
   char path[256];
   char buf[256];
-  int fd;
+  struct sensor_file *file;
   int divfd;
 
   memset(buf, 0, sizeof(buf));
 
   /* if device is nullptr or *, get first */
   if (dev == nullptr || strcmp(dev, "*") == 0) {
-    static int reported = 0;
+    std::vector<std::string> entries = sensors().list(dir);
 
-    if (!get_first_file_in_a_directory(dir, buf, &reported)) { return -1; }
+    if (entries.empty()) { return nullptr; }
+    strncpy(buf, entries[0].c_str(), 255);
     dev = buf;
   }
 
   if (strcmp(dir, "/sys/class/hwmon/") == 0) {
     if (*buf) {
-      /* buf holds result from get_first_file_in_a_directory() above,
+      /* buf holds result from the directory listing above,
        * e.g. "hwmon0" -- append "/device" */
       strncat(buf, "/device", 255 - strnlen(buf, 255));
     } else {
@@ -1273,7 +1770,7 @@ static int open_sysfs_sensor(const char *dir, const char *dev, const char *type,
       /* Not found */
       if (buf[0] == '\0') {
         NORM_ERR("can't parse device \"%s\"", dev);
-        return -1;
+        return nullptr;
       }
       dev = buf;
     }
@@ -1293,14 +1790,14 @@ static int open_sysfs_sensor(const char *dir, const char *dev, const char *type,
   snprintf(path, 255, "%s%s/%s%d_input", dir, dev, type, n);
 
   /* first, attempt to open file in /device */
-  fd = open(path, O_RDONLY);
-  if (fd < 0) {
+  file = sensors().open(path);
+  if (file == nullptr) {
     /* if it fails, strip the /device from dev and attempt again */
     size_t len_to_trunc = std::max((size_t)7, strnlen(buf, 255)) - 7;
     buf[len_to_trunc] = 0;
     snprintf(path, 255, "%s%s/%s%d_input", dir, dev, type, n);
-    fd = open(path, O_RDONLY);
-    if (fd < 0) {
+    file = sensors().open(path);
+    if (file == nullptr) {
       NORM_ERR(
           "can't open '%s': %s\nplease check your device or remove this "
           "var from " PACKAGE_NAME,
@@ -1317,7 +1814,7 @@ static int open_sysfs_sensor(const char *dir, const char *dev, const char *type,
     *divisor = 0;
   }
   /* fan does not use *_div as a read divisor */
-  if (strcmp("fan", type) == 0) { return fd; }
+  if (strcmp("fan", type) == 0) { return file; }
 
   /* test if *_div file exist, open it and use it as divisor */
   if (strcmp(type, "tempf") == 0) {
@@ -1344,36 +1841,40 @@ static int open_sysfs_sensor(const char *dir, const char *dev, const char *type,
     close(divfd);
   }
 
-  return fd;
+  return file;
 }
 
-static double get_sysfs_info(int *fd, int divisor, char *devtype, char *type) {
+static double get_sysfs_info(struct sensor_file *file, int divisor,
+                             char *devtype, char *type) {
   int val = 0;
 
-  if (*fd <= 0) { return 0; }
-
-  lseek(*fd, 0, SEEK_SET);
+  if (file == nullptr || file->fd < 0) { return 0; }
 
-  /* read integer */
+  /* read integer, the fd stays open between reads */
   {
     char buf[64];
     int n;
-    n = read(*fd, buf, 63);
+    n = pread(file->fd, buf, 63, 0);
+    if (n < 0 && (errno == ESTALE || errno == ENODEV)) {
+      /* the device went away and came back, e.g. a replugged sensor */
+      close(file->fd);
+      file->fd = open(devtype, O_RDONLY | O_CLOEXEC);
+      if (file->fd < 0) {
+        LIMITED_ERR("can't open '%s': %s", devtype, strerror(errno));
+        return 0;
+      }
+      n = pread(file->fd, buf, 63, 0);
+    }
     /* should read until n == 0 but I doubt that kernel will give these
      * in multiple pieces. :) */
     if (n < 0) {
-      NORM_ERR("get_sysfs_info(): read from %s failed\n", devtype);
+      LIMITED_ERR("get_sysfs_info(): read from %s failed", devtype);
     } else {
       buf[n] = '\0';
       val = strtol(buf, nullptr, 10);
     }
   }
 
-  close(*fd);
-  /* open file */
-  *fd = open(devtype, O_RDONLY);
-  if (*fd < 0) { NORM_ERR("can't open '%s': %s", devtype, strerror(errno)); }
-
   /* My dirty hack for computing CPU value
    * Filedil, from forums.gentoo.org */
   /* if (strstr(devtype, "temp1_input") != nullptr) {
@@ -1448,8 +1949,13 @@ static void parse_sysfs_sensor(struct text_object *obj, const char *arg,
        offset);
   sf = (struct sysfs *)malloc(sizeof(struct sysfs));
   memset(sf, 0, sizeof(struct sysfs));
-  sf->fd = open_sysfs_sensor(path, (*buf1) ? buf1 : 0, buf2, n, &sf->arg,
-                             sf->devtype);
+  sensors().refresh();
+  sf->file = open_sysfs_sensor(path, (*buf1) ? buf1 : 0, buf2, n, &sf->arg,
+                               sf->devtype);
+  sf->generation = sensors().generation();
+  sf->dir = path;
+  strncpy(sf->dev, buf1, 63);
+  sf->n = n;
   strncpy(sf->type, buf2, 63);
   sf->factor = factor;
   sf->offset = offset;
@@ -1470,9 +1976,19 @@ void print_sysfs_sensor(struct text_object *obj, char *p,
   double r;
   struct sysfs *sf = (struct sysfs *)obj->data.opaque;
 
-  if (!sf || sf->fd < 0) return;
+  if (!sf) return;
+
+  /* a device came or went, so the sensor may be somewhere else now */
+  sensors().refresh();
+  if (sf->generation != sensors().generation()) {
+    sensors().release(sf->file);
+    sf->file = open_sysfs_sensor(sf->dir, (*sf->dev) ? sf->dev : 0, sf->type,
+                                 sf->n, &sf->arg, sf->devtype);
+    sf->generation = sensors().generation();
+  }
+  if (!sf->file) return;
 
-  r = get_sysfs_info(&sf->fd, sf->arg, sf->devtype, sf->type);
+  r = get_sysfs_info(sf->file, sf->arg, sf->devtype, sf->type);
 
   r = r * sf->factor + sf->offset;
 
@@ -1492,93 +2008,233 @@ void free_sysfs_sensor(struct text_object *obj) {
 
   if (!sf) return;
 
-  if (sf->fd >= 0) close(sf->fd);
+  sensors().release(sf->file);
   free_and_zero(obj->data.opaque);
 }
 
 #define CPUFREQ_PREFIX "/sys/devices/system/cpu"
 #define CPUFREQ_POSTFIX "cpufreq/scaling_cur_freq"
 
+/* the frequency of each cpu in MHz as of the last update_cpu_freq(), 0 if it
+ * isn't known */
+static std::vector<double> cpu_freqs;
+/* the scaling_cur_freq of each cpu, nullptr if it has none */
+static std::vector<std::unique_ptr<conky::proc_file>> cpu_freq_files;
+
+/* Takes the frequencies /sys has no file for from /proc/cpuinfo, which has
+ * them all in one read. */
+static void read_cpuinfo_freqs() {
+  static conky::proc_file cpuinfo_file("/proc/cpuinfo");
+  static int reported = 0;
+  const char *p = cpuinfo_file.read(&reported);
+  if (p == nullptr) { return; }
+
+  /* the number of the cpu the lines are about, -1 before the first one */
+  long cpu = -1;
+  for (; *p != '\0'; p = strchrnul(p, '\n'), p += *p != '\0' ? 1 : 0) {
+    double freq;
+    if (strncmp(p, "processor", 9) == 0) {
+      ++cpu;
+      continue;
+    }
+#if defined(__i386) || defined(__x86_64)
+    // and search for the cpu mhz
+    if (strncmp(p, "cpu MHz", 7) != 0) { continue; }
+    freq = strtod(strchrnul(p, ':') + 1, nullptr);
+#else
+#if defined(__alpha)
+    // different on alpha, and in Hz
+    if (strncmp(p, "cycle frequency [Hz]", 20) != 0) { continue; }
+    freq = strtod(strchrnul(p, ':') + 1, nullptr) / 1000000;
+#else
+    // this is different on ppc for some reason
+    if (strncmp(p, "clock", 5) != 0) { continue; }
+    freq = strtod(strchrnul(p, ':') + 1, nullptr);
+#endif  // defined(__alpha)
+#endif  // defined(__i386) || defined(__x86_64)
+
+    /* a frequency before the first processor applies to all of them */
+    for (size_t i = cpu < 0 ? 0 : cpu; i < cpu_freqs.size(); ++i) {
+      if (prefer_proc || cpu_freq_files[i] == nullptr) { cpu_freqs[i] = freq; }
+      if (cpu >= 0) { break; }
+    }
+  }
+}
+
+/* Samples the frequencies of all cpus at once, for ${freq} and ${freq_g}. */
+int update_cpu_freq(void) {
+  get_cpu_count();
+
+  if (cpu_freq_files.size() != info.cpu_count) {
+    cpu_freq_files.clear();
+    for (unsigned int i = 0; i < info.cpu_count; ++i) {
+      char path[128];
+      snprintf(path, sizeof path, "%s/cpu%u/%s", CPUFREQ_PREFIX, i,
+               CPUFREQ_POSTFIX);
+      cpu_freq_files.emplace_back(
+          access(path, R_OK) == 0 ? new conky::proc_file(path) : nullptr);
+    }
+  }
+  cpu_freqs.assign(info.cpu_count, 0);
+
+  bool missing = prefer_proc;
+  for (size_t i = 0; i < cpu_freq_files.size() && !prefer_proc; ++i) {
+    static int reported = 0;
+    const char *s = cpu_freq_files[i] != nullptr
+                        ? cpu_freq_files[i]->read(&reported)
+                        : nullptr;
+    if (s == nullptr) {
+      missing = true;
+      continue;
+    }
+    /* in kHz */
+    cpu_freqs[i] = strtod(s, nullptr) / 1000;
+  }
+  if (missing) { read_cpuinfo_freqs(); }
+  return 0;
+}
+
 /* return system frequency in MHz (use divisor=1) or GHz (use divisor=1000) */
 char get_freq(char *p_client_buffer, size_t client_buffer_size,
               const char *p_format, int divisor, unsigned int cpu) {
-  FILE *f;
-  static int reported = 0;
-  char frequency[32];
-  char s[256];
-  double freq = 0;
-
   if (!p_client_buffer || client_buffer_size <= 0 || !p_format ||
       divisor <= 0) {
     return 0;
   }
 
-  if (!prefer_proc) {
-    char current_freq_file[128];
-
-    snprintf(current_freq_file, 127, "%s/cpu%d/%s", CPUFREQ_PREFIX, cpu - 1,
-             CPUFREQ_POSTFIX);
-    f = fopen(current_freq_file, "r");
-    if (f) {
-      /* if there's a cpufreq /sys node, read the current frequency from
-       * this node and divide by 1000 to get Mhz. */
-      if (fgets(s, sizeof(s), f)) {
-        s[strlen(s) - 1] = '\0';
-        freq = strtod(s, nullptr);
-      }
-      fclose(f);
-      snprintf(p_client_buffer, client_buffer_size, p_format,
-               (freq / 1000) / divisor);
-      return 1;
+  double freq = cpu >= 1 && cpu <= cpu_freqs.size() ? cpu_freqs[cpu - 1] : 0;
+  snprintf(p_client_buffer, client_buffer_size, p_format, freq / divisor);
+  return 1;
+}
+
+/* The cycles and instructions each cpu ran, from hardware counters. Reading
+ * them from all cpus needs perf_event_paranoid <= 0 or CAP_PERFMON. */
+struct cpu_counter {
+  int fd = -1;          /* the cycles, leading the group read through it */
+  int instructions_fd = -1;
+  uint64_t cycles = 0, instructions = 0, time = 0; /* time in ns */
+};
+
+struct cpu_perf_rate {
+  double mhz = 0; /* millions of cycles per second */
+  double ipc = 0; /* instructions per cycle */
+};
+
+static std::vector<cpu_counter> cpu_counters;
+/* all cpus together first, then each cpu */
+static std::vector<cpu_perf_rate> cpu_perf_rates;
+
+static int open_cpu_counter(unsigned int cpu, uint64_t config, int group) {
+  struct perf_event_attr attr {};
+
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof attr;
+  attr.config = config;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return syscall(SYS_perf_event_open, &attr, -1, cpu, group,
+                 PERF_FLAG_FD_CLOEXEC);
+}
+
+static void close_cpu_counters() {
+  for (auto &c : cpu_counters) {
+    if (c.instructions_fd >= 0) { close(c.instructions_fd); }
+    if (c.fd >= 0) { close(c.fd); }
+  }
+  cpu_counters.clear();
+}
+
+static bool open_cpu_counters() {
+  close_cpu_counters();
+  cpu_counters.resize(info.cpu_count);
+  for (unsigned int i = 0; i < info.cpu_count; ++i) {
+    cpu_counter &c = cpu_counters[i];
+    c.fd = open_cpu_counter(i, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (c.fd >= 0) {
+      c.instructions_fd =
+          open_cpu_counter(i, PERF_COUNT_HW_INSTRUCTIONS, c.fd);
+    }
+    if (c.instructions_fd < 0) {
+      NORM_ERR("can't count the cycles of cpu %u: %s", i, strerror(errno));
+      close_cpu_counters();
+      return false;
     }
   }
+  return true;
+}
+
+/* Samples the cycle and instruction counters of all cpus, for ${cpu_cycles}
+ * and ${cpu_ipc}. */
+int update_cpu_perf(void) {
+  static bool failed = false;
 
-  // open the CPU information file
-  f = open_file("/proc/cpuinfo", &reported);
-  if (!f) {
-    perror(PACKAGE_NAME ": Failed to access '/proc/cpuinfo' at get_freq()");
+  get_cpu_count();
+  if (failed) { return 0; }
+  if (cpu_counters.size() != info.cpu_count && !open_cpu_counters()) {
+    failed = true;
     return 0;
   }
 
-  // read the file
-  while (fgets(s, sizeof(s), f) != nullptr) {
-#if defined(__i386) || defined(__x86_64)
-    // and search for the cpu mhz
-    if (strncmp(s, "cpu MHz", 7) == 0 && cpu == 0) {
-#else
-#if defined(__alpha)
-    // different on alpha
-    if (strncmp(s, "cycle frequency [Hz]", 20) == 0 && cpu == 0) {
-#else
-    // this is different on ppc for some reason
-    if (strncmp(s, "clock", 5) == 0 && cpu == 0) {
-#endif  // defined(__alpha)
-#endif  // defined(__i386) || defined(__x86_64)
-
-      // copy just the number
-      strncpy(frequency, strchr(s, ':') + 2, 32);
-#if defined(__alpha)
-      // strip " est.\n"
-      frequency[strlen(frequency) - 6] = '\0';
-      // kernel reports in Hz
-      freq = strtod(frequency, nullptr) / 1000000;
-#else
-      // strip \n
-      frequency[strlen(frequency) - 1] = '\0';
-      freq = strtod(frequency, nullptr);
-#endif
-      break;
-    }
-    if (strncmp(s, "processor", 9) == 0) {
-      cpu--;
+  cpu_perf_rates.assign(info.cpu_count + 1, {});
+  uint64_t all_cycles = 0, all_instructions = 0;
+  double all_time = 0;
+  for (size_t i = 0; i < cpu_counters.size(); ++i) {
+    cpu_counter &c = cpu_counters[i];
+    /* nr, time enabled, time running, cycles, instructions */
+    uint64_t values[5];
+    if (read(c.fd, values, sizeof values) != sizeof values ||
+        values[2] == 0) {
       continue;
     }
+    /* make up for the time the counters were not on the cpu */
+    double scale = static_cast<double>(values[1]) / values[2];
+    auto cycles = static_cast<uint64_t>(values[3] * scale);
+    auto instructions = static_cast<uint64_t>(values[4] * scale);
+
+    if (c.time != 0 && values[1] > c.time) {
+      uint64_t d_cycles = cycles - c.cycles;
+      uint64_t d_instructions = instructions - c.instructions;
+      double d_time = values[1] - c.time;
+      /* cycles per ns, times 1000 */
+      cpu_perf_rates[i + 1].mhz = d_cycles * 1000.0 / d_time;
+      if (d_cycles > 0) {
+        cpu_perf_rates[i + 1].ipc =
+            static_cast<double>(d_instructions) / d_cycles;
+      }
+      all_cycles += d_cycles;
+      all_instructions += d_instructions;
+      all_time = std::max(all_time, d_time);
+    }
+    c.cycles = cycles;
+    c.instructions = instructions;
+    c.time = values[1];
+  }
+  if (all_time > 0) { cpu_perf_rates[0].mhz = all_cycles * 1000.0 / all_time; }
+  if (all_cycles > 0) {
+    cpu_perf_rates[0].ipc = static_cast<double>(all_instructions) / all_cycles;
   }
+  return 0;
+}
 
-  fclose(f);
-  snprintf(p_client_buffer, client_buffer_size, p_format,
-           (float)freq / divisor);
-  return 1;
+void parse_cpu_perf_arg(struct text_object *obj, const char *arg) {
+  get_cpu_count();
+  obj->data.i = arg != nullptr ? strtol(arg, nullptr, 10) : 0;
+  if (obj->data.i < 0 ||
+      static_cast<unsigned int>(obj->data.i) > info.cpu_count) {
+    NORM_ERR("cpu %d doesn't exist, using all of them", obj->data.i);
+    obj->data.i = 0;
+  }
+}
+
+void print_cpu_cycles(struct text_object *obj, char *p,
+                      unsigned int p_max_size) {
+  if (static_cast<size_t>(obj->data.i) >= cpu_perf_rates.size()) { return; }
+  snprintf(p, p_max_size, "%.0f", cpu_perf_rates[obj->data.i].mhz);
+}
+
+void print_cpu_ipc(struct text_object *obj, char *p, unsigned int p_max_size) {
+  if (static_cast<size_t>(obj->data.i) >= cpu_perf_rates.size()) { return; }
+  snprintf(p, p_max_size, "%.2f", cpu_perf_rates[obj->data.i].ipc);
 }
 
 #define CPUFREQ_GOVERNOR "cpufreq/scaling_governor"
@@ -1826,7 +2482,7 @@ int open_acpi_temperature(const char *name) {
   }
 
   fd = open(path, O_RDONLY);
-  if (fd < 0) { NORM_ERR("can't open '%s': %s", path, strerror(errno)); }
+  if (fd < 0) { LIMITED_ERR("can't open '%s': %s", path, strerror(errno)); }
 
   return fd;
 }
@@ -1945,10 +2601,26 @@ monitori pll mutta ilman verkkovirtaa
 #define APM_PATH "/proc/apm"
 #define MAX_BATTERY_COUNT 4
 
-static FILE *sysfs_bat_fp[MAX_BATTERY_COUNT] = {nullptr, NULL, NULL, NULL};
-static FILE *acpi_bat_fp[MAX_BATTERY_COUNT] = {nullptr, NULL, NULL, NULL};
 static FILE *apm_bat_fp[MAX_BATTERY_COUNT] = {nullptr, NULL, NULL, NULL};
 
+enum battery_source { BATTERY_NONE, BATTERY_SYSFS, BATTERY_ACPI };
+
+/* what the sysfs uevent or ACPI state file of a battery said */
+struct battery_snapshot {
+  double time = -1;
+  enum battery_source source = BATTERY_NONE;
+  char present[5] = "";
+  char charging_state[64] = "unknown";
+  int present_rate = -1;
+  int remaining_capacity = -1;
+  /* sysfs only, -1 if not reported */
+  int full_capacity = -1;
+  long current_now = -1;
+  long voltage_now = -1;
+};
+
+static struct battery_snapshot battery_snapshots[MAX_BATTERY_COUNT];
+
 static int batteries_initialized = 0;
 static char batteries[MAX_BATTERY_COUNT][32];
 
@@ -1968,37 +2640,107 @@ static double last_battery_perct_time[MAX_BATTERY_COUNT];
 void init_batteries(void) {
   int idx;
 
-  if (batteries_initialized) { return; }
-#ifdef HAVE_OPENMP
-#pragma omp parallel for schedule(dynamic, 10)
-#endif /* HAVE_OPENMP */
-  for (idx = 0; idx < MAX_BATTERY_COUNT; idx++) { batteries[idx][0] = '\0'; }
-  batteries_initialized = 1;
-}
+  if (batteries_initialized) { return; }
+#ifdef HAVE_OPENMP
+#pragma omp parallel for schedule(dynamic, 10)
+#endif /* HAVE_OPENMP */
+  for (idx = 0; idx < MAX_BATTERY_COUNT; idx++) { batteries[idx][0] = '\0'; }
+  batteries_initialized = 1;
+}
+
+int get_battery_idx(const char *bat) {
+  int idx;
+
+  for (idx = 0; idx < MAX_BATTERY_COUNT; idx++) {
+    if (!strlen(batteries[idx]) || !strcmp(batteries[idx], bat)) { break; }
+  }
+
+  /* if not found, enter a new entry */
+  if (!strlen(batteries[idx])) { snprintf(batteries[idx], 31, "%s", bat); }
+
+  return idx;
+}
+
+void set_return_value(char *buffer, unsigned int n, int item, int idx);
+
+/*
+ * Reads the state of battery idx, first from SYSFS and if that fails from
+ * ACPI. The files are read at most once per update, however many battery
+ * objects show that battery.
+ */
+static const struct battery_snapshot &read_battery(int idx, const char *bat) {
+  static int rep = 0, rep1 = 0;
+  struct battery_snapshot &snap = battery_snapshots[idx];
+  char path[128];
+  FILE *fp;
+
+  if (snap.time == current_update_time) { return snap; }
+  snap = battery_snapshot();
+  snap.time = current_update_time;
+
+  snprintf(path, 127, SYSFS_BATTERY_BASE_PATH "/%s/uevent", bat);
+  if ((fp = open_file(path, &rep)) != nullptr) {
+    snap.source = BATTERY_SYSFS;
+    while (!feof(fp)) {
+      char buf[256];
+      if (fgets(buf, 256, fp) == nullptr) break;
+
+      /* let's just hope units are ok */
+      if (strncmp(buf, "POWER_SUPPLY_PRESENT=1", 22) == 0)
+        strncpy(snap.present, "yes", 4);
+      else if (strncmp(buf, "POWER_SUPPLY_PRESENT=0", 22) == 0)
+        strncpy(snap.present, "no", 4);
+      else if (strncmp(buf, "POWER_SUPPLY_STATUS=", 20) == 0)
+        sscanf(buf, "POWER_SUPPLY_STATUS=%63s", snap.charging_state);
+      /* present_rate is not the same as the current flowing now but it
+       * is the same value which was used in the past. so we continue the
+       * tradition! */
+      else if (strncmp(buf, "POWER_SUPPLY_CURRENT_NOW=", 25) == 0) {
+        sscanf(buf, "POWER_SUPPLY_CURRENT_NOW=%d", &snap.present_rate);
+        sscanf(buf, "POWER_SUPPLY_CURRENT_NOW=%ld", &snap.current_now);
+      } else if (strncmp(buf, "POWER_SUPPLY_VOLTAGE_NOW=", 25) == 0)
+        sscanf(buf, "POWER_SUPPLY_VOLTAGE_NOW=%ld", &snap.voltage_now);
+      else if (strncmp(buf, "POWER_SUPPLY_POWER_NOW=", 23) == 0)
+        sscanf(buf, "POWER_SUPPLY_POWER_NOW=%d", &snap.present_rate);
+      else if (strncmp(buf, "POWER_SUPPLY_ENERGY_NOW=", 24) == 0)
+        sscanf(buf, "POWER_SUPPLY_ENERGY_NOW=%d", &snap.remaining_capacity);
+      else if (strncmp(buf, "POWER_SUPPLY_ENERGY_FULL=", 25) == 0)
+        sscanf(buf, "POWER_SUPPLY_ENERGY_FULL=%d", &snap.full_capacity);
+      else if (strncmp(buf, "POWER_SUPPLY_CHARGE_NOW=", 24) == 0)
+        sscanf(buf, "POWER_SUPPLY_CHARGE_NOW=%d", &snap.remaining_capacity);
+      else if (strncmp(buf, "POWER_SUPPLY_CHARGE_FULL=", 25) == 0)
+        sscanf(buf, "POWER_SUPPLY_CHARGE_FULL=%d", &snap.full_capacity);
+    }
+    fclose(fp);
+    return snap;
+  }
+
+  snprintf(path, 127, ACPI_BATTERY_BASE_PATH "/%s/state", bat);
+  if ((fp = open_file(path, &rep1)) != nullptr) {
+    snap.source = BATTERY_ACPI;
+    while (!feof(fp)) {
+      char buf[256];
 
-int get_battery_idx(const char *bat) {
-  int idx;
+      if (fgets(buf, 256, fp) == nullptr) { break; }
 
-  for (idx = 0; idx < MAX_BATTERY_COUNT; idx++) {
-    if (!strlen(batteries[idx]) || !strcmp(batteries[idx], bat)) { break; }
+      if (strncmp(buf, "present:", 8) == 0) {
+        sscanf(buf, "present: %4s", snap.present);
+      } else if (strncmp(buf, "charging state:", 15) == 0) {
+        sscanf(buf, "charging state: %63s", snap.charging_state);
+      } else if (strncmp(buf, "present rate:", 13) == 0) {
+        sscanf(buf, "present rate: %d", &snap.present_rate);
+      } else if (strncmp(buf, "remaining capacity:", 19) == 0) {
+        sscanf(buf, "remaining capacity: %d", &snap.remaining_capacity);
+      }
+    }
+    fclose(fp);
   }
-
-  /* if not found, enter a new entry */
-  if (!strlen(batteries[idx])) { snprintf(batteries[idx], 31, "%s", bat); }
-
-  return idx;
+  return snap;
 }
 
-void set_return_value(char *buffer, unsigned int n, int item, int idx);
-
 void get_battery_stuff(char *buffer, unsigned int n, const char *bat,
                        int item) {
-  static int idx, rep = 0, rep1 = 0, rep2 = 0;
-  char acpi_path[128];
-  char sysfs_path[128];
-
-  snprintf(acpi_path, 127, ACPI_BATTERY_BASE_PATH "/%s/state", bat);
-  snprintf(sysfs_path, 127, SYSFS_BATTERY_BASE_PATH "/%s/uevent", bat);
+  static int idx, rep2 = 0;
 
   init_batteries();
 
@@ -2015,57 +2757,16 @@ void get_battery_stuff(char *buffer, unsigned int n, const char *bat,
   memset(last_battery_str[idx], 0, sizeof(last_battery_str[idx]));
   memset(last_battery_time_str[idx], 0, sizeof(last_battery_time_str[idx]));
 
-  /* first try SYSFS if that fails try ACPI */
-
-  if (sysfs_bat_fp[idx] == nullptr && acpi_bat_fp[idx] == NULL &&
-      apm_bat_fp[idx] == nullptr) {
-    sysfs_bat_fp[idx] = open_file(sysfs_path, &rep);
-  }
-
-  if (sysfs_bat_fp[idx] == nullptr && acpi_bat_fp[idx] == NULL &&
-      apm_bat_fp[idx] == nullptr) {
-    acpi_bat_fp[idx] = open_file(acpi_path, &rep1);
-  }
+  const struct battery_snapshot &snap = read_battery(idx, bat);
 
-  if (sysfs_bat_fp[idx] != nullptr) {
+  if (snap.source == BATTERY_SYSFS) {
     /* SYSFS */
-    int present_rate = -1;
-    int remaining_capacity = -1;
-    char charging_state[64];
-    char present[4];
-
-    strncpy(charging_state, "unknown", 64);
-
-    while (!feof(sysfs_bat_fp[idx])) {
-      char buf[256];
-      if (fgets(buf, 256, sysfs_bat_fp[idx]) == nullptr) break;
-
-      /* let's just hope units are ok */
-      if (strncmp(buf, "POWER_SUPPLY_PRESENT=1", 22) == 0)
-        strncpy(present, "yes", 4);
-      else if (strncmp(buf, "POWER_SUPPLY_PRESENT=0", 22) == 0)
-        strncpy(present, "no", 4);
-      else if (strncmp(buf, "POWER_SUPPLY_STATUS=", 20) == 0)
-        sscanf(buf, "POWER_SUPPLY_STATUS=%63s", charging_state);
-      /* present_rate is not the same as the current flowing now but it
-       * is the same value which was used in the past. so we continue the
-       * tradition! */
-      else if (strncmp(buf, "POWER_SUPPLY_CURRENT_NOW=", 25) == 0)
-        sscanf(buf, "POWER_SUPPLY_CURRENT_NOW=%d", &present_rate);
-      else if (strncmp(buf, "POWER_SUPPLY_POWER_NOW=", 23) == 0)
-        sscanf(buf, "POWER_SUPPLY_POWER_NOW=%d", &present_rate);
-      else if (strncmp(buf, "POWER_SUPPLY_ENERGY_NOW=", 24) == 0)
-        sscanf(buf, "POWER_SUPPLY_ENERGY_NOW=%d", &remaining_capacity);
-      else if (strncmp(buf, "POWER_SUPPLY_ENERGY_FULL=", 25) == 0)
-        sscanf(buf, "POWER_SUPPLY_ENERGY_FULL=%d", &acpi_last_full[idx]);
-      else if (strncmp(buf, "POWER_SUPPLY_CHARGE_NOW=", 24) == 0)
-        sscanf(buf, "POWER_SUPPLY_CHARGE_NOW=%d", &remaining_capacity);
-      else if (strncmp(buf, "POWER_SUPPLY_CHARGE_FULL=", 25) == 0)
-        sscanf(buf, "POWER_SUPPLY_CHARGE_FULL=%d", &acpi_last_full[idx]);
-    }
+    int present_rate = snap.present_rate;
+    int remaining_capacity = snap.remaining_capacity;
+    const char *charging_state = snap.charging_state;
+    const char *present = snap.present;
 
-    fclose(sysfs_bat_fp[idx]);
-    sysfs_bat_fp[idx] = nullptr;
+    if (snap.full_capacity >= 0) acpi_last_full[idx] = snap.full_capacity;
 
     /* Hellf[i]re notes that remaining capacity can exceed acpi_last_full */
     if (remaining_capacity > acpi_last_full[idx])
@@ -2150,12 +2851,12 @@ void get_battery_stuff(char *buffer, unsigned int n, const char *bat,
       else
         strncpy(last_battery_str[idx], "not present", 64);
     }
-  } else if (acpi_bat_fp[idx] != nullptr) {
+  } else if (snap.source == BATTERY_ACPI) {
     /* ACPI */
-    int present_rate = -1;
-    int remaining_capacity = -1;
-    char charging_state[64];
-    char present[5];
+    int present_rate = snap.present_rate;
+    int remaining_capacity = snap.remaining_capacity;
+    const char *charging_state = snap.charging_state;
+    const char *present = snap.present;
 
     /* read last full capacity if it's zero */
     if (acpi_last_full[idx] == 0) {
@@ -2179,26 +2880,6 @@ void get_battery_stuff(char *buffer, unsigned int n, const char *bat,
       }
     }
 
-    fseek(acpi_bat_fp[idx], 0, SEEK_SET);
-
-    strncpy(charging_state, "unknown", 8);
-
-    while (!feof(acpi_bat_fp[idx])) {
-      char buf[256];
-
-      if (fgets(buf, 256, acpi_bat_fp[idx]) == nullptr) { break; }
-
-      /* let's just hope units are ok */
-      if (strncmp(buf, "present:", 8) == 0) {
-        sscanf(buf, "present: %4s", present);
-      } else if (strncmp(buf, "charging state:", 15) == 0) {
-        sscanf(buf, "charging state: %63s", charging_state);
-      } else if (strncmp(buf, "present rate:", 13) == 0) {
-        sscanf(buf, "present rate: %d", &present_rate);
-      } else if (strncmp(buf, "remaining capacity:", 19) == 0) {
-        sscanf(buf, "remaining capacity: %d", &remaining_capacity);
-      }
-    }
     /* Hellf[i]re notes that remaining capacity can exceed acpi_last_full */
     if (remaining_capacity > acpi_last_full[idx]) {
       /* normalize to 100% */
@@ -2277,8 +2958,6 @@ void get_battery_stuff(char *buffer, unsigned int n, const char *bat,
         strncpy(last_battery_str[idx], "not present", 64);
       }
     }
-    fclose(acpi_bat_fp[idx]);
-    acpi_bat_fp[idx] = nullptr;
   } else {
     /* APM */
     if (apm_bat_fp[idx] == nullptr) {
@@ -2352,47 +3031,22 @@ void get_battery_short_status(char *buffer, unsigned int n, const char *bat) {
 }
 
 void get_battery_power_draw(char *buffer, unsigned int n, const char *bat) {
-  static int reported = 0;
-  char current_now_path[256], voltage_now_path[256], current_now_val[256],
-      voltage_now_val[256];
-  char *ptr;
-  long current_now, voltage_now;
-  FILE *current_now_file;
-  FILE *voltage_now_file;
-  double result;
-
-  snprintf(current_now_path, 255, SYSFS_BATTERY_BASE_PATH "/%s/current_now",
-           bat);
-  snprintf(voltage_now_path, 255, SYSFS_BATTERY_BASE_PATH "/%s/voltage_now",
-           bat);
-
-  current_now_file = open_file(current_now_path, &reported);
-  voltage_now_file = open_file(voltage_now_path, &reported);
-
-  if (current_now_file != nullptr && voltage_now_file != nullptr) {
-    fgets(current_now_val, 256, current_now_file);
-    fgets(voltage_now_val, 256, voltage_now_file);
-
-    current_now = strtol(current_now_val, &ptr, 10);
-    voltage_now = strtol(voltage_now_val, &ptr, 10);
-
-    result = (double)(current_now * voltage_now) / (double)1000000000000;
+  init_batteries();
+
+  const struct battery_snapshot &snap =
+      read_battery(get_battery_idx(bat), bat);
+
+  if (snap.current_now >= 0 && snap.voltage_now >= 0) {
+    double result =
+        (double)(snap.current_now * snap.voltage_now) / (double)1000000000000;
     snprintf(buffer, n, "%.1f", result);
-    fclose(current_now_file);
-    fclose(voltage_now_file);
   }
 }
 
 int _get_battery_perct(const char *bat) {
-  static int reported = 0;
   int idx;
-  char acpi_path[128];
-  char sysfs_path[128];
   int remaining_capacity = -1;
 
-  snprintf(acpi_path, 127, ACPI_BATTERY_BASE_PATH "/%s/state", bat);
-  snprintf(sysfs_path, 127, SYSFS_BATTERY_BASE_PATH "/%s/uevent", bat);
-
   idx = get_battery_idx(bat);
 
   /* don't update battery too often */
@@ -2402,39 +3056,15 @@ int _get_battery_perct(const char *bat) {
   last_battery_perct_time[idx] = current_update_time;
 
   /* Only check for SYSFS or ACPI */
+  const struct battery_snapshot &snap = read_battery(idx, bat);
+  remaining_capacity = snap.remaining_capacity;
 
-  if (sysfs_bat_fp[idx] == nullptr && acpi_bat_fp[idx] == NULL &&
-      apm_bat_fp[idx] == nullptr) {
-    sysfs_bat_fp[idx] = open_file(sysfs_path, &reported);
-    reported = 0;
-  }
-
-  if (sysfs_bat_fp[idx] == nullptr && acpi_bat_fp[idx] == NULL &&
-      apm_bat_fp[idx] == nullptr) {
-    acpi_bat_fp[idx] = open_file(acpi_path, &reported);
-  }
-
-  if (sysfs_bat_fp[idx] != nullptr) {
+  if (snap.source == BATTERY_SYSFS) {
     /* SYSFS */
-    while (!feof(sysfs_bat_fp[idx])) {
-      char buf[256];
-      if (fgets(buf, 256, sysfs_bat_fp[idx]) == nullptr) break;
-
-      if (strncmp(buf, "POWER_SUPPLY_CHARGE_NOW=", 24) == 0) {
-        sscanf(buf, "POWER_SUPPLY_CHARGE_NOW=%d", &remaining_capacity);
-      } else if (strncmp(buf, "POWER_SUPPLY_CHARGE_FULL=", 25) == 0) {
-        sscanf(buf, "POWER_SUPPLY_CHARGE_FULL=%d", &acpi_design_capacity[idx]);
-      } else if (strncmp(buf, "POWER_SUPPLY_ENERGY_NOW=", 24) == 0) {
-        sscanf(buf, "POWER_SUPPLY_ENERGY_NOW=%d", &remaining_capacity);
-      } else if (strncmp(buf, "POWER_SUPPLY_ENERGY_FULL=", 25) == 0) {
-        sscanf(buf, "POWER_SUPPLY_ENERGY_FULL=%d", &acpi_design_capacity[idx]);
-      }
+    if (snap.full_capacity >= 0) {
+      acpi_design_capacity[idx] = snap.full_capacity;
     }
-
-    fclose(sysfs_bat_fp[idx]);
-    sysfs_bat_fp[idx] = nullptr;
-
-  } else if (acpi_bat_fp[idx] != nullptr) {
+  } else if (snap.source == BATTERY_ACPI) {
     /* ACPI */
     /* read last full capacity if it's zero */
     if (acpi_design_capacity[idx] == 0) {
@@ -2457,18 +3087,6 @@ int _get_battery_perct(const char *bat) {
         fclose(fp);
       }
     }
-
-    fseek(acpi_bat_fp[idx], 0, SEEK_SET);
-
-    while (!feof(acpi_bat_fp[idx])) {
-      char buf[256];
-
-      if (fgets(buf, 256, acpi_bat_fp[idx]) == nullptr) { break; }
-
-      if (buf[0] == 'r') {
-        sscanf(buf, "remaining capacity: %d", &remaining_capacity);
-      }
-    }
   }
   if (remaining_capacity < 0) { return 0; }
   /* compute the battery percentage */
@@ -2718,50 +3336,194 @@ int is_disk(char *dev) {
   return dev_list[orig] = !(access(syspath.c_str(), F_OK));
 }
 
+/* What update_diskio() needs to know about a line of /proc/diskstats, kept
+ * by device number so the lines don't have to be matched by name and
+ * checked in /sys every update. */
+struct diskio_dev {
+  struct diskio_stat *stat; /* nullptr if no object tracks the device */
+  bool counted;             /* whether it adds up to the totals */
+};
+
+/* Kernel uevents tell when block devices come and go. Anyone may listen to
+ * them, but if it fails anyway, changes in the number of devices still
+ * catch most of that. */
+static int open_block_uevents(void) {
+  int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) { return -1; }
+
+  struct sockaddr_nl addr {};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = 1; /* the kernel's own events, not udev's */
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Reads all pending uevents, returns true if any was about a block device. */
+static bool block_devices_changed(int fd) {
+  static const char subsystem[] = "SUBSYSTEM=block";
+  char buf[4096];
+  bool changed = false;
+  ssize_t len;
+
+  while ((len = recv(fd, buf, sizeof buf, 0)) > 0 || errno == EINTR) {
+    /* ACTION@DEVPATH, then KEY=value pairs, all terminated by a '\0' */
+    if (len > 0 && memmem(buf, len, subsystem, sizeof subsystem) != nullptr) {
+      changed = true;
+    }
+  }
+  /* ENOBUFS means events got lost, which may have been any */
+  return changed || errno == ENOBUFS;
+}
+
+/* Reads up to max numbers at p, moving p past them. Returns how many there
+ * were. */
+static int scan_decimals(const char *&p, const char *end,
+                         unsigned long long *values, int max) {
+  int n = 0;
+  while (n < max) {
+    const char *q = scan_decimal(p, end, &values[n]);
+    if (q == p || !isdigit(static_cast<unsigned char>(q[-1]))) { break; }
+    p = q;
+    ++n;
+  }
+  return n;
+}
+
+/* With no object showing the totals, only the tracked devices are read, each
+ * from its own stat file in /sys. These stay open, and there are only a few
+ * of them, while /proc/diskstats may list thousands of devices. */
+static int update_tracked_diskio(void) {
+  struct tracked_dev {
+    std::unique_ptr<conky::proc_file> file;
+    int reported;
+  };
+  static std::unordered_map<struct diskio_stat *, tracked_dev> devs;
+  static unsigned int devs_generation = UINT_MAX;
+
+  if (devs_generation != diskio_stats_generation) {
+    devs.clear();
+    devs_generation = diskio_stats_generation;
+  }
+
+  for (struct diskio_stat *cur = stats.next; cur; cur = cur->next) {
+    auto it = devs.find(cur);
+    if (it == devs.end()) {
+      /* as in /sys/block, a / in the name (cciss/c0d0) becomes a ! */
+      std::string name(cur->dev);
+      std::replace(name.begin(), name.end(), '/', '!');
+      std::string path = "/sys/class/block/" + name + "/stat";
+      tracked_dev dev{std::make_unique<conky::proc_file>(path.c_str()), 0};
+      it = devs.emplace(cur, std::move(dev)).first;
+    }
+
+    const char *p = it->second.file->read(&it->second.reported);
+    if (p == nullptr) { continue; }
+    /* the same fields as in /proc/diskstats, without the device */
+    unsigned long long v[7];
+    if (scan_decimals(p, p + it->second.file->size(), v, 7) == 7) {
+      update_diskio_values(cur, v[2], v[6]);
+    }
+  }
+  return 0;
+}
+
 int update_diskio(void) {
-  FILE *fp;
   static int reported = 0;
-  char buf[512], devbuf[64];
-  unsigned int major, minor;
-  int col_count = 0;
-  struct diskio_stat *cur;
+  static conky::proc_file diskstats_file("/proc/diskstats");
+  static std::unordered_map<uint64_t, struct diskio_dev> devs;
+  static unsigned int devs_generation = UINT_MAX;
+  static size_t devs_lines = 0;
+  static int uevent_fd = open_block_uevents();
+  char devbuf[64];
   unsigned int reads, writes;
   unsigned int total_reads = 0, total_writes = 0;
+  size_t lines = 0;
 
   stats.current = 0;
   stats.current_read = 0;
   stats.current_write = 0;
 
-  if (!(fp = open_file("/proc/diskstats", &reported))) { return 0; }
+  if (!diskio_total_used) { return update_tracked_diskio(); }
+
+  const char *p = diskstats_file.read(&reported);
+  if (p == nullptr) { return 0; }
+  const char *end = p + diskstats_file.size();
+
+  /* start over when objects were added or freed, or devices changed */
+  if (devs_generation != diskio_stats_generation ||
+      (uevent_fd >= 0 && block_devices_changed(uevent_fd))) {
+    devs.clear();
+    dev_list.clear();
+    devs_generation = diskio_stats_generation;
+  }
 
   /* read reads and writes from all disks (minor = 0), including cd-roms
    * and floppies, and sum them up */
-  while (fgets(buf, 512, fp)) {
-    col_count = sscanf(buf, "%u %u %s %*u %*u %u %*u %*u %*u %u", &major,
-                       &minor, devbuf, &reads, &writes);
-    /* ignore subdevices (they have only 3 matching entries in their line)
-     * and virtual devices (LVM, network block devices, RAM disks, Loopback)
-     *
-     * XXX: ignore devices which are part of a SW RAID (MD_MAJOR) */
-    if (col_count == 5 && major != LVM_BLK_MAJOR && major != NBD_MAJOR &&
-        major != RAMDISK_MAJOR && major != LOOP_MAJOR && major != DM_MAJOR) {
-      /* check needed for kernel >= 2.6.31, see sf #2942117 */
-      if (is_disk(devbuf)) {
-        total_reads += reads;
-        total_writes += writes;
+  while (p < end) {
+    const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+    if (eol == nullptr) { eol = end; }
+    const char *line = p;
+    p = eol + 1;
+
+    unsigned long long id[2], v[7];
+    if (scan_decimals(line, eol, id, 2) != 2) { continue; }
+    while (line < eol && *line == ' ') { ++line; }
+    const char *name = line;
+    while (line < eol && *line != ' ') { ++line; }
+    size_t name_len = line - name;
+
+    /* partitions of kernels before 2.6.25 have only four fields */
+    int fields = scan_decimals(line, eol, v, 7);
+    bool full = fields == 7;
+    if (name_len == 0 || (!full && fields < 4)) { continue; }
+    reads = full ? v[2] : v[1];
+    writes = full ? v[6] : v[3];
+    ++lines;
+
+    unsigned int major = id[0];
+    uint64_t key = (id[0] << 32) | id[1];
+    auto it = devs.find(key);
+    if (it == devs.end()) {
+      struct diskio_dev dev {};
+
+      snprintf(devbuf, sizeof devbuf, "%.*s", static_cast<int>(name_len),
+               name);
+
+      dev.stat = stats.next;
+      while (dev.stat && strcmp(devbuf, dev.stat->dev)) {
+        dev.stat = dev.stat->next;
       }
-    } else {
-      col_count = sscanf(buf, "%u %u %s %*u %u %*u %u", &major, &minor, devbuf,
-                         &reads, &writes);
-      if (col_count != 5) { continue; }
+      /* ignore subdevices (they have only 3 matching entries in their line)
+       * and virtual devices (LVM, network block devices, RAM disks,
+       * Loopback)
+       *
+       * XXX: ignore devices which are part of a SW RAID (MD_MAJOR) */
+      dev.counted = full && major != LVM_BLK_MAJOR && major != NBD_MAJOR &&
+                    major != RAMDISK_MAJOR && major != LOOP_MAJOR &&
+                    major != DM_MAJOR &&
+                    /* check needed for kernel >= 2.6.31, see sf #2942117 */
+                    is_disk(devbuf);
+      it = devs.emplace(key, dev).first;
     }
-    cur = stats.next;
-    while (cur && strcmp(devbuf, cur->dev)) cur = cur->next;
 
-    if (cur) update_diskio_values(cur, reads, writes);
+    if (it->second.counted) {
+      total_reads += reads;
+      total_writes += writes;
+    }
+    if (it->second.stat) update_diskio_values(it->second.stat, reads, writes);
   }
   update_diskio_values(&stats, total_reads, total_writes);
-  fclose(fp);
+
+  /* a device number may have been reused for a different device */
+  if (lines != devs_lines) {
+    devs.clear();
+    dev_list.clear();
+    devs_lines = lines;
+  }
   return 0;
 }
 
@@ -2872,57 +3634,27 @@ static void calc_io_each(void) {
 #define PROCFS_TEMPLATE "/proc/%d/stat"
 #define PROCFS_CMDLINE_TEMPLATE "/proc/%d/cmdline"
 
-/* These are the guts that extract information out of /proc.
- * Anyone hoping to port wmtop should look here first. */
-static void process_parse_stat(struct process *process) {
-  char line[BUFFER_LEN] = {0}, filename[BUFFER_LEN], procname[BUFFER_LEN];
-  char cmdline[BUFFER_LEN] = {0}, cmdline_filename[BUFFER_LEN],
-       cmdline_procname[BUFFER_LEN];
-  char basename[BUFFER_LEN] = {0};
+/* Reads /proc/<pid>/cmdline and puts the name of the program plus its
+ * arguments, e.g. "python program.py" for "/usr/bin/python program.py", in
+ * cmdline_procname. */
+static bool process_read_cmdline(pid_t pid, char *cmdline_procname) {
+  char cmdline[BUFFER_LEN] = {0}, cmdline_filename[BUFFER_LEN];
   char tmpstr[BUFFER_LEN] = {0};
-  char state[4];
-  int ps, cmdline_ps;
-  unsigned long user_time = 0;
-  unsigned long kernel_time = 0;
-  int rc;
+  int cmdline_ps;
   int endl;
-  int nice_val;
-  char *lparen, *rparen;
-  struct stat process_stat;
 
-  snprintf(filename, sizeof(filename), PROCFS_TEMPLATE, process->pid);
   snprintf(cmdline_filename, sizeof(cmdline_filename), PROCFS_CMDLINE_TEMPLATE,
-           process->pid);
-
-  ps = open(filename, O_RDONLY);
-  if (ps == -1) {
-    /* The process must have finished in the last few jiffies! */
-    return;
-  }
-
-  if (fstat(ps, &process_stat) != 0) {
-    close(ps);
-    return;
-  }
-  process->uid = process_stat.st_uid;
-
-  /* Mark process as up-to-date. */
-  process->time_stamp = g_time;
-
-  rc = read(ps, line, BUFFER_LEN - 1);
-  close(ps);
-  if (rc < 0) { return; }
+           pid);
 
-  /* Read /proc/<pid>/cmdline */
   cmdline_ps = open(cmdline_filename, O_RDONLY);
   if (cmdline_ps < 0) {
     /* The process must have finished in the last few jiffies! */
-    return;
+    return false;
   }
 
   endl = read(cmdline_ps, cmdline, BUFFER_LEN - 1);
   close(cmdline_ps);
-  if (endl < 0) { return; }
+  if (endl < 0) { return false; }
 
   /* Some processes have null-separated arguments (see proc(5)); let's fix it */
   int i = endl;
@@ -2960,6 +3692,48 @@ static void process_parse_stat(struct process *process) {
     strncpy(cmdline_procname, cmdline + slash_pos + 1, BUFFER_LEN - slash_pos);
     cmdline_procname[BUFFER_LEN - slash_pos] = 0;
   }
+  return true;
+}
+
+/* These are the guts that extract information out of /proc.
+ * Anyone hoping to port wmtop should look here first. The command line is
+ * re-read only for processes not seen before, pids that were reused, or
+ * when full_names asks for arguments rewritten since. */
+static void process_parse_stat(struct process *process, size_t name_len,
+                               bool full_names, int *running) {
+  char line[BUFFER_LEN] = {0}, filename[BUFFER_LEN], procname[BUFFER_LEN];
+  char cmdline_procname[BUFFER_LEN];
+  char basename[BUFFER_LEN] = {0};
+  char state[4];
+  int ps;
+  unsigned long user_time = 0;
+  unsigned long kernel_time = 0;
+  unsigned long long starttime;
+  int rc;
+  int nice_val;
+  char *lparen, *rparen;
+  struct stat process_stat;
+
+  snprintf(filename, sizeof(filename), PROCFS_TEMPLATE, process->pid);
+
+  ps = open(filename, O_RDONLY);
+  if (ps == -1) {
+    /* The process must have finished in the last few jiffies! */
+    return;
+  }
+
+  if (fstat(ps, &process_stat) != 0) {
+    close(ps);
+    return;
+  }
+  process->uid = process_stat.st_uid;
+
+  /* Mark process as up-to-date. */
+  process->time_stamp = g_time;
+
+  rc = read(ps, line, BUFFER_LEN - 1);
+  close(ps);
+  if (rc < 0) { return; }
 
   /* Extract cpu times from data in /proc filesystem */
   lparen = strchr(line, '(');
@@ -2971,25 +3745,28 @@ static void process_parse_stat(struct process *process) {
   procname[rc] = '\0';
   strncpy(basename, procname, strlen(procname) + 1);
 
-  if (strlen(procname) < strlen(cmdline_procname))
-    strncpy(procname, cmdline_procname, strlen(cmdline_procname) + 1);
-
   rc = sscanf(rparen + 1,
               "%3s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %lu "
-              "%lu %*s %*s %*s %d %*s %*s %*s %llu %llu",
+              "%lu %*s %*s %*s %d %*s %*s %llu %llu %llu",
               state, &process->user_time, &process->kernel_time, &nice_val,
-              &process->vsize, &process->rss);
-  if (rc < 6) {
+              &starttime, &process->vsize, &process->rss);
+  if (rc < 7) {
     NORM_ERR("scanning data for %s failed, got only %d fields", procname, rc);
     return;
   }
 
-  if (state[0] == 'R') ++info.run_procs;
+  if (state[0] == 'R') ++*running;
 
-  free_and_zero(process->name);
-  free_and_zero(process->basename);
-  process->name = strndup(procname, text_buffer_size.get(*::state));
-  process->basename = strndup(basename, text_buffer_size.get(*::state));
+  if (full_names || process->name == nullptr ||
+      process->starttime != starttime) {
+    if (!process_read_cmdline(process->pid, cmdline_procname)) { return; }
+    if (strlen(procname) < strlen(cmdline_procname))
+      strncpy(procname, cmdline_procname, strlen(cmdline_procname) + 1);
+    process->starttime = starttime;
+    process_set_name(process, procname, basename, name_len);
+  } else {
+    process_set_name(process, process->name, basename, name_len);
+  }
   process->rss *= getpagesize();
 
   process->total_cpu_time = process->user_time + process->kernel_time;
@@ -3022,6 +3799,16 @@ static void process_parse_stat(struct process *process) {
 
 #ifdef BUILD_IOSTATS
 #define PROCFS_TEMPLATE_IO "/proc/%d/io"
+/* how many updates pass before /proc/<pid>/io is tried again after the
+ * kernel denied it, which it does for other users' processes */
+#define PROCESS_IO_RETRY_UPDATES 60
+static void process_deny_io(struct process *process) {
+  process->io_retry_time = g_time + PROCESS_IO_RETRY_UPDATES;
+  /* the counts start over once it can be read again */
+  process->read_bytes = process->write_bytes = 0;
+  process->previous_read_bytes = process->previous_write_bytes = ULLONG_MAX;
+}
+
 static void process_parse_io(struct process *process) {
   static const char *read_bytes_str = "read_bytes:";
   static const char *write_bytes_str = "write_bytes:";
@@ -3032,6 +3819,8 @@ static void process_parse_io(struct process *process) {
   char *pos, *endpos;
   unsigned long long read_bytes, write_bytes;
 
+  if (process->io_retry_time > g_time) { return; }
+
   snprintf(filename, sizeof(filename), PROCFS_TEMPLATE_IO, process->pid);
 
   ps = open(filename, O_RDONLY);
@@ -3039,12 +3828,16 @@ static void process_parse_io(struct process *process) {
     /* The process must have finished in the last few jiffies!
      * Or, the kernel doesn't support I/O accounting.
      */
+    if (errno == EACCES || errno == EPERM) { process_deny_io(process); }
     return;
   }
 
   rc = read(ps, line, BUFFER_LEN - 1);
   close(ps);
-  if (rc < 0) { return; }
+  if (rc < 0) {
+    if (errno == EACCES || errno == EPERM) { process_deny_io(process); }
+    return;
+  }
 
   pos = strstr(line, read_bytes_str);
   if (pos == nullptr) {
@@ -3088,12 +3881,13 @@ static void process_parse_io(struct process *process) {
 
 /* This function seems to hog all of the CPU time.
  * I can't figure out why - it doesn't do much. */
-static void calculate_stats(struct process *process) {
+static void calculate_stats(struct process *process, size_t name_len,
+                            bool full_names, int *running) {
   /* compute each process cpu usage by reading /proc/<proc#>/stat */
-  process_parse_stat(process);
+  process_parse_stat(process, name_len, full_names, running);
 
 #ifdef BUILD_IOSTATS
-  process_parse_io(process);
+  if (top_io_fields != 0) { process_parse_io(process); }
 #endif /* BUILD_IOSTATS */
 
   /*
@@ -3108,27 +3902,91 @@ static void calculate_stats(struct process *process) {
  * Update process table					  *
  ******************************************/
 
-static void update_process_table(void) {
-  DIR *dir;
-  struct dirent *entry;
+/* how many processes one task of the parallel scan parses */
+#define PROCESS_SCAN_SHARD 64
+/* with top_proc_connector, how many updates pass between /proc rescans that
+ * pick up anything the events missed */
+#define PROCESS_RESCAN_UPDATES 60
 
-  if (!(dir = opendir("/proc"))) { return; }
+static conky::simple_config_setting<bool> top_proc_connector(
+    "top_proc_connector", false, false);
 
-  info.run_procs = 0;
+static bool scan_proc_pids(std::unordered_set<pid_t> &pids) {
+  static std::vector<pid_t> listed;
+
+  if (!get_proc_pids(listed)) { return false; }
+  pids.clear();
+  pids.insert(listed.begin(), listed.end());
+  return true;
+}
 
-  /* Get list of processes from /proc directory */
-  while ((entry = readdir(dir))) {
-    pid_t pid;
+/* Get list of processes, either from the /proc directory or, if enabled and
+ * permitted, by following fork and exit events between occasional rescans
+ * of it. */
+static bool update_live_pids(std::unordered_set<pid_t> &pids) {
+  static conky::proc_connector connector;
+  static bool connector_failed = false;
+  static unsigned int updates_since_scan = 0;
+
+  if (!top_proc_connector.get(*state) || connector_failed) {
+    connector.close();
+    return scan_proc_pids(pids);
+  }
 
-    if (sscanf(entry->d_name, "%d", &pid) > 0) {
-      /* compute each process cpu usage */
-      calculate_stats(get_process(pid));
+  if (!connector.is_open()) {
+    if (!connector.open()) {
+      NORM_ERR("can't listen to process events, scanning /proc instead: %s",
+               strerror(errno));
+      connector_failed = true;
+      return scan_proc_pids(pids);
     }
+    /* events from now on are covered, the rescan catches up the rest */
+    updates_since_scan = PROCESS_RESCAN_UPDATES;
+  }
+
+  bool complete = connector.read_events([&](pid_t pid) { pids.insert(pid); },
+                                        [&](pid_t pid) { pids.erase(pid); });
+  if (!complete || ++updates_since_scan >= PROCESS_RESCAN_UPDATES) {
+    updates_since_scan = 0;
+    return scan_proc_pids(pids);
   }
+  return true;
+}
 
-  closedir(dir);
+static void update_process_table(void) {
+  /* kept around so the pid lists aren't reallocated every update */
+  static std::unordered_set<pid_t> pids;
+  static std::vector<struct process *> processes;
+
+  if (!update_live_pids(pids)) { return; }
+
+  /* The process table isn't thread-safe, so look them all up first. */
+  processes.clear();
+  for (pid_t pid : pids) { processes.push_back(get_process(pid)); }
+
+  /* compute each process cpu usage; each process is only touched by the
+   * shard it is in, and nothing below may read settings */
+  const size_t name_len = text_buffer_size.get(*state);
+  const bool full_names = top_name_verbose.get(*state);
+  std::atomic<int> run_procs(0);
+  conky::parallel_for(
+      (processes.size() + PROCESS_SCAN_SHARD - 1) / PROCESS_SCAN_SHARD,
+      [&](size_t shard) {
+        size_t end =
+            std::min(processes.size(), (shard + 1) * PROCESS_SCAN_SHARD);
+        int running = 0;
+        for (size_t i = shard * PROCESS_SCAN_SHARD; i < end; ++i) {
+          calculate_stats(processes[i], name_len, full_names, &running);
+        }
+        run_procs += running;
+      });
+  info.run_procs = run_procs;
 }
 
+/* the cpu time which passed during the last get_top_info(), for the views of
+ * top_view */
+static unsigned long long top_cpu_total = 0;
+
 void get_top_info(void) {
   unsigned long long total = 0;
 
@@ -3136,6 +3994,254 @@ void get_top_info(void) {
   update_process_table();   /* update the table with process list */
   calc_cpu_each(total);     /* and then the percentage for each task */
 #ifdef BUILD_IOSTATS
-  calc_io_each(); /* percentage of I/O for each task */
-#endif            /* BUILD_IOSTATS */
+  if (top_io_fields != 0) { calc_io_each(); } /* percentage of I/O */
+#endif /* BUILD_IOSTATS */
+  top_cpu_total = total;
+}
+
+/******************************************
+ * Threads and cgroups for top_view		  *
+ ******************************************/
+
+/* the threads of the busiest processes, by tid */
+static std::unordered_map<pid_t, struct process> top_threads;
+
+/* the cgroup of each process, with when the process started so a reused pid
+ * is noticed */
+struct process_cgroup {
+  unsigned long long starttime;
+  std::string path;
+};
+static std::unordered_map<pid_t, process_cgroup> process_cgroups;
+
+/* the processes of each cgroup summed up, by path */
+static std::unordered_map<std::string, struct process> top_cgroups;
+
+/* Reads the name and cpu times of thread t of process p. user_time and
+ * kernel_time are what it used since the last time. */
+static bool thread_parse_stat(const struct process *p, struct process *t,
+                              size_t name_len) {
+  char line[BUFFER_LEN], filename[BUFFER_LEN], comm[BUFFER_LEN];
+  unsigned long user_time, kernel_time;
+
+  snprintf(filename, sizeof(filename), "/proc/%d/task/%d/stat", p->pid,
+           t->pid);
+  int fd = open(filename, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  ssize_t rc = read(fd, line, sizeof(line) - 1);
+  close(fd);
+  if (rc <= 0) return false;
+  line[rc] = '\0';
+
+  /* the name may contain spaces and parentheses itself */
+  const char *lparen = strchr(line, '(');
+  const char *rparen = strrchr(line, ')');
+  if (lparen == nullptr || rparen == nullptr || rparen < lparen) return false;
+  if (sscanf(rparen + 1, "%*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %*s %lu %lu",
+             &user_time, &kernel_time) != 2) {
+    return false;
+  }
+
+  size_t len = std::min<size_t>(rparen - lparen - 1, sizeof(comm) - 1);
+  memcpy(comm, lparen + 1, len);
+  comm[len] = '\0';
+  process_set_name(t, comm, comm, name_len);
+
+  if (t->previous_user_time == ULONG_MAX || t->previous_user_time > user_time)
+    t->previous_user_time = user_time;
+  if (t->previous_kernel_time == ULONG_MAX ||
+      t->previous_kernel_time > kernel_time)
+    t->previous_kernel_time = kernel_time;
+  t->user_time = user_time - t->previous_user_time;
+  t->kernel_time = kernel_time - t->previous_kernel_time;
+  t->previous_user_time = user_time;
+  t->previous_kernel_time = kernel_time;
+  t->total_cpu_time = user_time + kernel_time;
+  return true;
+}
+
+static void free_view_entry(struct process *p) {
+  free_and_zero(p->name);
+  free_and_zero(p->basename);
+}
+
+void get_top_threads(struct process **candidates,
+                     std::vector<struct process *> &entries) {
+  const size_t name_len = text_buffer_size.get(*state);
+  float mul = 100.0;
+  if (top_cpu_separate.get(*state)) mul *= info.cpu_count;
+
+  entries.clear();
+  std::unordered_set<pid_t> scanned;
+  for (int i = 0; i < MAX_SP && candidates[i] != nullptr; ++i) {
+    struct process *p = candidates[i];
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/%d/task", p->pid);
+    DIR *dir = opendir(path);
+    if (dir == nullptr) continue;
+    scanned.insert(p->pid);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      pid_t tid;
+      if (sscanf(entry->d_name, "%d", &tid) != 1) continue;
+
+      auto it = top_threads.find(tid);
+      if (it == top_threads.end()) {
+        it = top_threads.emplace(tid, process{}).first;
+        it->second.pid = tid;
+        it->second.previous_user_time = ULONG_MAX;
+        it->second.previous_kernel_time = ULONG_MAX;
+      }
+      struct process *t = &it->second;
+      if (!thread_parse_stat(p, t, name_len)) continue;
+
+      /* memory and I/O are shared by the threads of a process */
+      t->uid = p->uid;
+      t->starttime = p->starttime;
+      t->vsize = p->vsize;
+      t->rss = p->rss;
+#ifdef BUILD_IOSTATS
+      t->read_bytes = p->read_bytes;
+      t->write_bytes = p->write_bytes;
+      t->io_perc = p->io_perc;
+#endif /* BUILD_IOSTATS */
+      t->amount = top_cpu_total != 0
+                      ? mul * (t->user_time + t->kernel_time) /
+                            (float)top_cpu_total
+                      : 0;
+      t->time_stamp = g_time;
+      entries.push_back(t);
+    }
+    closedir(dir);
+  }
+
+  /* forget the threads which ended or whose process isn't busy enough any
+   * more */
+  for (auto it = top_threads.begin(); it != top_threads.end();) {
+    if (it->second.time_stamp != g_time) {
+      free_view_entry(&it->second);
+      it = top_threads.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  /* the rest are too idle to have busy threads, they are shown whole */
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    if (scanned.count(p->pid) == 0) entries.push_back(p);
+  }
+}
+
+/* Reads the path of the cgroup of pid: the unified hierarchy if there is one,
+ * else the hierarchy of the cpu controller, else the first one listed. */
+static std::string read_process_cgroup(pid_t pid) {
+  char filename[64], line[BUFFER_LEN];
+  std::string path;
+  bool found = false;
+
+  snprintf(filename, sizeof(filename), "/proc/%d/cgroup", pid);
+  FILE *fp = fopen(filename, "r");
+  if (fp == nullptr) return path;
+
+  /* lines look like "hierarchy-id:controller,...:path" */
+  while (!found && fgets(line, sizeof(line), fp) != nullptr) {
+    line[strcspn(line, "\n")] = '\0';
+    char *controllers = strchr(line, ':');
+    if (controllers == nullptr) continue;
+    *controllers++ = '\0';
+    char *cgroup = strchr(controllers, ':');
+    if (cgroup == nullptr) continue;
+    *cgroup++ = '\0';
+
+    if (strcmp(line, "0") == 0 && *controllers == '\0') {
+      found = true;
+    } else {
+      char *saveptr = nullptr;
+      for (char *c = strtok_r(controllers, ",", &saveptr); c != nullptr;
+           c = strtok_r(nullptr, ",", &saveptr)) {
+        if (strcmp(c, "cpu") == 0) found = true;
+      }
+      if (!found && !path.empty()) continue;
+    }
+    path = cgroup;
+  }
+  fclose(fp);
+  return path;
+}
+
+void get_top_cgroups(std::vector<struct process *> &entries) {
+  const size_t name_len = text_buffer_size.get(*state);
+  std::unordered_map<pid_t, process_cgroup> seen;
+
+  seen.reserve(process_cgroups.size());
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    process_cgroup cg;
+    auto it = process_cgroups.find(p->pid);
+    if (it != process_cgroups.end() && it->second.starttime == p->starttime) {
+      cg = std::move(it->second);
+    } else {
+      cg.starttime = p->starttime;
+      cg.path = read_process_cgroup(p->pid);
+    }
+    if (cg.path.empty()) continue;
+
+    struct process *g = &top_cgroups[cg.path];
+    if (g->time_stamp != g_time) {
+      /* the first process of this cgroup this time */
+      size_t slash = cg.path.find_last_of('/');
+      std::string base = cg.path;
+      if (slash != std::string::npos && slash + 1 < cg.path.size())
+        base = cg.path.substr(slash + 1);
+      process_set_name(g, cg.path.c_str(), base.c_str(), name_len);
+      g->pid = 0;
+      g->amount = 0;
+      g->user_time = g->kernel_time = g->total_cpu_time = 0;
+      g->vsize = g->rss = 0;
+#ifdef BUILD_IOSTATS
+      g->read_bytes = g->write_bytes = 0;
+      g->io_perc = 0;
+#endif /* BUILD_IOSTATS */
+      g->uid = p->uid;
+      g->starttime = p->starttime;
+      g->time_stamp = g_time;
+    }
+    /* pid is how many processes there are in the cgroup */
+    g->pid++;
+    g->amount += p->amount;
+    g->user_time += p->user_time;
+    g->kernel_time += p->kernel_time;
+    g->total_cpu_time += p->total_cpu_time;
+    g->vsize += p->vsize;
+    g->rss += p->rss;
+#ifdef BUILD_IOSTATS
+    g->read_bytes += p->read_bytes;
+    g->write_bytes += p->write_bytes;
+    g->io_perc += p->io_perc;
+#endif /* BUILD_IOSTATS */
+    g->starttime = std::min(g->starttime, p->starttime);
+
+    seen.emplace(p->pid, std::move(cg));
+  }
+  process_cgroups.swap(seen);
+
+  entries.clear();
+  for (auto it = top_cgroups.begin(); it != top_cgroups.end();) {
+    if (it->second.time_stamp != g_time) {
+      free_view_entry(&it->second);
+      it = top_cgroups.erase(it);
+    } else {
+      entries.push_back(&it->second);
+      ++it;
+    }
+  }
+}
+
+void free_top_views(void) {
+  for (auto &t : top_threads) free_view_entry(&t.second);
+  top_threads.clear();
+  for (auto &g : top_cgroups) free_view_entry(&g.second);
+  top_cgroups.clear();
+  process_cgroups.clear();
 }
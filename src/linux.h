@@ -33,6 +33,12 @@ void print_ioscheduler(struct text_object *, char *, unsigned int);
 void print_laptop_mode(struct text_object *, char *, unsigned int);
 void print_cpugovernor(struct text_object *, char *, unsigned int);
 
+/* The IFF_* flags of dev (0 if there is no such interface) and, unless
+ * has_addr is nullptr, whether it has an IPv4 address, as rtnetlink last
+ * reported them. Returns false if rtnetlink can't be used. Main thread
+ * only. */
+bool get_link_state(const char *dev, unsigned int &flags, bool *has_addr);
+
 int update_gateway_info(void);
 int update_gateway_info2(void);
 void free_gateway_info(struct text_object *obj);
@@ -55,6 +61,20 @@ int get_entropy_avail(unsigned int *);
 int get_entropy_poolsize(unsigned int *);
 
 int update_stat(void);
+/* The slot in info.cpu_usage of the cpus in socket, core, node or llc
+ * (last level cache) n, set up on first use. 0 if there are none, -1 if
+ * kind is none of these. */
+int cpu_group_slot(const char *kind, int n);
+int update_cpu_freq(void);
+int update_cpu_perf(void);
+void parse_cpu_perf_arg(struct text_object *, const char *);
+void print_cpu_cycles(struct text_object *, char *, unsigned int);
+void print_cpu_ipc(struct text_object *, char *, unsigned int);
+/* Parses the decimal number after any spaces at p, stopping at end. Returns
+ * the position after the number. */
+const char *scan_decimal(const char *p, const char *end,
+                         unsigned long long *value);
+void update_net_interfaces(FILE *, bool, double);
 
 void print_distribution(struct text_object *, char *, unsigned int);
 
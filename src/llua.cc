@@ -24,8 +24,19 @@
 #include "llua.h"
 #include <config.h>
 #include "build.h"
+#include "common.h"
 #include "conky.h"
+#include "core.h"
 #include "logging.h"
+#include "net_stat.h"
+#include "profiling.hh"
+#include "update-cb.hh"
+
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
 
 extern "C" {
 #include <tolua++.h>
@@ -43,9 +54,28 @@ static int llua_block_notify = 0;
 #endif /* HAVE_SYS_INOTIFY_H */
 
 static void llua_load(const char *script);
+static void llua_unsubscribe(const std::string *script);
+static void llua_release_info();
 
 lua_State *lua_L = nullptr;
 
+/* who runs the collector of lua_L, see llua_collect_garbage() */
+enum lua_gc_mode { LUA_GC_AUTO, LUA_GC_FRAME, LUA_GC_GENERATIONAL };
+
+template <>
+conky::lua_traits<lua_gc_mode>::Map conky::lua_traits<lua_gc_mode>::map = {
+    {"auto", LUA_GC_AUTO},
+    {"frame", LUA_GC_FRAME},
+    {"generational", LUA_GC_GENERATIONAL}};
+
+/* the share of the time left until the next update spent collecting */
+#define LLUA_GC_BUDGET_SHARE 0.5
+
+/* bumped whenever a new lua_L is created, and whenever a script is (re)loaded
+ * into it, so that resolved calls know when to look their function up again */
+static unsigned long llua_state_id = 0;
+static unsigned long llua_loads = 0;
+
 namespace {
 class lua_load_setting : public conky::simple_config_setting<std::string> {
   using Base = conky::simple_config_setting<std::string>;
@@ -78,6 +108,8 @@ class lua_load_setting : public conky::simple_config_setting<std::string> {
     llua_rm_notifies();
 #endif /* HAVE_SYS_INOTIFY_H */
     if (lua_L == nullptr) { return; }
+    llua_unsubscribe(nullptr);
+    llua_release_info();
     lua_close(lua_L);
     lua_L = nullptr;
   }
@@ -87,11 +119,15 @@ class lua_load_setting : public conky::simple_config_setting<std::string> {
 };
 
 lua_load_setting lua_load;
+/* outside of this namespace the name clashes with lua_load() */
+std::string lua_load_files() { return lua_load.get(*state); }
 conky::simple_config_setting<std::string> lua_startup_hook("lua_startup_hook",
                                                            std::string(), true);
 conky::simple_config_setting<std::string> lua_shutdown_hook("lua_shutdown_hook",
                                                             std::string(),
                                                             true);
+conky::simple_config_setting<std::string> lua_click_hook("lua_click_hook",
+                                                         std::string(), true);
 #ifdef BUILD_GUI
 conky::simple_config_setting<std::string> lua_draw_hook_pre("lua_draw_hook_pre",
                                                             std::string(),
@@ -99,6 +135,7 @@ conky::simple_config_setting<std::string> lua_draw_hook_pre("lua_draw_hook_pre",
 conky::simple_config_setting<std::string> lua_draw_hook_post(
     "lua_draw_hook_post", std::string(), true);
 #endif
+conky::simple_config_setting<lua_gc_mode> gc_mode("lua_gc", LUA_GC_AUTO, true);
 }  // namespace
 
 static int llua_conky_parse(lua_State *L) {
@@ -122,6 +159,52 @@ static int llua_conky_parse(lua_State *L) {
   return 1; /* number of results */
 }
 
+/* conky_values{key = text, ...} evaluates every text like conky_parse(), but
+ * returns a table with the same keys holding numbers where possible: the raw
+ * value of single meter and percentage objects, or the evaluated text if it
+ * is a number. Anything else is returned as a string. */
+static int llua_conky_values(lua_State *L) {
+  /* static, as lua_error() doesn't unwind the C++ stack */
+  static std::vector<char> buf;
+
+  if (lua_gettop(L) != 1 || !lua_istable(L, 1)) {
+    lua_pushstring(L,
+                   "incorrect arguments, conky_values(table) takes exactly 1 "
+                   "table argument");
+    lua_error(L);
+  }
+  buf.resize(std::max(max_user_text.get(*state), 1u));
+
+  lua_newtable(L);
+  lua_pushnil(L);
+  while (lua_next(L, 1) != 0) {
+    if (lua_type(L, -1) != LUA_TSTRING) {
+      lua_pushstring(L, "incorrect table value (expecting a string)");
+      lua_error(L);
+    }
+    const char *text = lua_tostring(L, -1);
+    double value;
+
+    lua_pushvalue(L, -2);
+    if (evaluate_value(text, &value)) {
+      lua_pushnumber(L, value);
+    } else {
+      evaluate(text, buf.data(), buf.size());
+      char *end;
+      value = strtod(buf.data(), &end);
+      while (isspace(static_cast<unsigned char>(*end)) != 0) { ++end; }
+      if (end != buf.data() && *end == 0) {
+        lua_pushnumber(L, value);
+      } else {
+        lua_pushstring(L, buf.data());
+      }
+    }
+    lua_settable(L, 2);
+    lua_pop(L, 1);
+  }
+  return 1;
+}
+
 static int llua_conky_set_update_interval(lua_State *L) {
   int n = lua_gettop(L); /* number of arguments */
   if (n != 1) {
@@ -139,46 +222,197 @@ static int llua_conky_set_update_interval(lua_State *L) {
   return 0; /* number of results */
 }
 
-void llua_init() {
+/* values passed between the main Lua state and the lua_async workers */
+static std::mutex llua_shared_mutex;
+static std::map<std::string, std::string> llua_shared_values;
+
+static int llua_set_shared(lua_State *L) {
+  if (lua_gettop(L) != 2 || lua_isstring(L, 1) == 0) {
+    lua_pushstring(L,
+                   "incorrect arguments, conky_set_shared(key, value) takes "
+                   "exactly 2 arguments");
+    lua_error(L);
+  }
+  std::string key = lua_tostring(L, 1);
+  std::lock_guard<std::mutex> lock(llua_shared_mutex);
+  if (lua_isnil(L, 2)) {
+    llua_shared_values.erase(key);
+  } else if (lua_isstring(L, 2) != 0) {
+    llua_shared_values[key] = lua_tostring(L, 2);
+  } else {
+    lua_pushstring(L, "incorrect argument (expecting a string or nil)");
+    lua_error(L);
+  }
+  return 0;
+}
+
+static int llua_get_shared(lua_State *L) {
+  if (lua_gettop(L) != 1 || lua_isstring(L, 1) == 0) {
+    lua_pushstring(L,
+                   "incorrect arguments, conky_get_shared(key) takes exactly "
+                   "1 argument");
+    lua_error(L);
+  }
+  std::string key = lua_tostring(L, 1);
+  std::lock_guard<std::mutex> lock(llua_shared_mutex);
+  auto it = llua_shared_values.find(key);
+  if (it == llua_shared_values.end()) {
+    lua_pushnil(L);
+  } else {
+    lua_pushlstring(L, it->second.data(), it->second.size());
+  }
+  return 1;
+}
+
+/*
+ * conky_on_change(text, function) subscriptions. The text is evaluated once
+ * an update, and the function called with its value whenever that comes out
+ * differently (and on the first update). Objects with generation counters
+ * keep their cached output until their data source changes, see
+ * generate_text_internal(), so re-evaluating them on an update which brought
+ * nothing new is cheap.
+ */
+struct llua_subscription {
+  std::string script; /* the script which subscribed, see llua_load() */
+  std::string text;
+  std::string value;
+  bool fired;
+  int ref; /* the function, in the registry of lua_L */
+};
+static std::vector<llua_subscription> llua_subscriptions;
+/* the script run by llua_load() */
+static std::string llua_loading_script;
+/* set by conky_redraw(), taken by the next llua_run_subscriptions() */
+static bool llua_redraw_pending = false;
+/* set if a subscribed value changed or a redraw was asked for this update */
+static bool llua_inputs_changed = true;
+
+static int llua_on_change(lua_State *L) {
+  if (lua_gettop(L) != 2 || lua_isstring(L, 1) == 0 ||
+      !lua_isfunction(L, 2)) {
+    lua_pushstring(L,
+                   "incorrect arguments, conky_on_change(text, function) "
+                   "takes a string and a function");
+    lua_error(L);
+  }
+  std::string text = lua_tostring(L, 1);
+  lua_pushvalue(L, 2);
+  int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  llua_subscriptions.push_back(
+      llua_subscription{llua_loading_script, text, std::string(), false, ref});
+  return 0;
+}
+
+static int llua_redraw(lua_State *L) {
+  (void)L;
+  llua_redraw_pending = true;
+  return 0;
+}
+
+/* drops the subscriptions of script, or all of them if it is null */
+static void llua_unsubscribe(const std::string *script) {
+  auto it = llua_subscriptions.begin();
+  while (it != llua_subscriptions.end()) {
+    if (script == nullptr || it->script == *script) {
+      luaL_unref(lua_L, LUA_REGISTRYINDEX, it->ref);
+      it = llua_subscriptions.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void llua_run_subscriptions() {
+  bool changed = false;
+
+  if (lua_L != nullptr && !llua_subscriptions.empty()) {
+    static std::vector<char> buf;
+    buf.resize(std::max(max_user_text.get(*state), 1u));
+
+    /* functions may subscribe in turn, which moves the entries around */
+    for (size_t i = 0; i < llua_subscriptions.size(); ++i) {
+      llua_subscription &sub = llua_subscriptions[i];
+      evaluate(sub.text.c_str(), buf.data(), buf.size());
+      if (sub.fired && sub.value == buf.data()) { continue; }
+      sub.value = buf.data();
+      sub.fired = true;
+      changed = true;
+
+      lua_rawgeti(lua_L, LUA_REGISTRYINDEX, sub.ref);
+      lua_pushstring(lua_L, buf.data());
+      if (lua_pcall(lua_L, 1, 0, 0) != 0) {
+        NORM_ERR("conky_on_change: function for '%s' failed: %s",
+                 llua_subscriptions[i].text.c_str(), lua_tostring(lua_L, -1));
+        lua_pop(lua_L, 1);
+      }
+    }
+  }
+  llua_inputs_changed = changed || llua_redraw_pending;
+  llua_redraw_pending = false;
+}
+
+/* libraries and globals common to the main state and the lua_async ones */
+static void llua_setup_state(lua_State *L) {
   std::string libs(PACKAGE_LIBDIR "/lib?.so;");
   std::string old_path, new_path;
-  if (lua_L != nullptr) { return; }
-  lua_L = luaL_newstate();
 
   /* add our library path to the lua package.cpath global var */
-  luaL_openlibs(lua_L);
-  lua_getglobal(lua_L, "package");
-  lua_getfield(lua_L, -1, "cpath");
+  luaL_openlibs(L);
+  lua_getglobal(L, "package");
+  lua_getfield(L, -1, "cpath");
 
-  old_path = std::string(lua_tostring(lua_L, -1));
+  old_path = std::string(lua_tostring(L, -1));
   new_path = libs + old_path;
 
-  lua_pushstring(lua_L, new_path.c_str());
-  lua_setfield(lua_L, -3, "cpath");
-  lua_pop(lua_L, 2);
+  lua_pushstring(L, new_path.c_str());
+  lua_setfield(L, -3, "cpath");
+  lua_pop(L, 2);
+
+  lua_pushstring(L, PACKAGE_NAME " " VERSION " compiled " BUILD_DATE
+                                 " for " BUILD_ARCH);
+  lua_setglobal(L, "conky_build_info");
+
+  lua_pushstring(L, VERSION);
+  lua_setglobal(L, "conky_version");
 
-  lua_pushstring(lua_L, PACKAGE_NAME " " VERSION " compiled " BUILD_DATE
-                                     " for " BUILD_ARCH);
-  lua_setglobal(lua_L, "conky_build_info");
+  lua_pushstring(L, BUILD_DATE);
+  lua_setglobal(L, "conky_build_date");
 
-  lua_pushstring(lua_L, VERSION);
-  lua_setglobal(lua_L, "conky_version");
+  lua_pushstring(L, BUILD_ARCH);
+  lua_setglobal(L, "conky_build_arch");
 
-  lua_pushstring(lua_L, BUILD_DATE);
-  lua_setglobal(lua_L, "conky_build_date");
+  lua_pushstring(L, current_config.c_str());
+  lua_setglobal(L, "conky_config");
 
-  lua_pushstring(lua_L, BUILD_ARCH);
-  lua_setglobal(lua_L, "conky_build_arch");
+  lua_pushcfunction(L, &llua_set_shared);
+  lua_setglobal(L, "conky_set_shared");
 
-  lua_pushstring(lua_L, current_config.c_str());
-  lua_setglobal(lua_L, "conky_config");
+  lua_pushcfunction(L, &llua_get_shared);
+  lua_setglobal(L, "conky_get_shared");
+}
+
+void llua_init() {
+  if (lua_L != nullptr) { return; }
+  lua_L = luaL_newstate();
+  ++llua_state_id;
+
+  llua_setup_state(lua_L);
 
   lua_pushcfunction(lua_L, &llua_conky_parse);
   lua_setglobal(lua_L, "conky_parse");
 
+  lua_pushcfunction(lua_L, &llua_conky_values);
+  lua_setglobal(lua_L, "conky_values");
+
   lua_pushcfunction(lua_L, &llua_conky_set_update_interval);
   lua_setglobal(lua_L, "conky_set_update_interval");
 
+  lua_pushcfunction(lua_L, &llua_on_change);
+  lua_setglobal(lua_L, "conky_on_change");
+
+  lua_pushcfunction(lua_L, &llua_redraw);
+  lua_setglobal(lua_L, "conky_redraw");
+
 #if defined(BUILD_X11)
   /* register tolua++ user types */
   tolua_open(lua_L);
@@ -194,7 +428,12 @@ void llua_load(const char *script) {
   llua_init();
 
   std::string path = to_real_path(script);
+  /* a reloaded script subscribes all over again */
+  llua_unsubscribe(&path);
+  llua_loading_script = path;
   error = luaL_dofile(lua_L, path.c_str());
+  llua_loading_script.clear();
+  ++llua_loads;
   if (error != 0) {
     NORM_ERR("llua_load: %s", lua_tostring(lua_L, -1));
     lua_pop(lua_L, 1);
@@ -241,46 +480,108 @@ static const char *tokenize(const char *str, size_t *len) {
 }
 
 /*
-   llua_do_call does a flexible call to any Lua function
-string: <function> [par1] [par2...]
-retc: the number of return values expected
+ * A call to a Lua function, "<function> [par1] [par2...]", split up once.
+ * The function and its arguments are kept as registry references, so that
+ * calling it is just a few lua_rawgeti()s rather than a global lookup and
+ * re-interning every argument string.
  */
-static char *llua_do_call(const char *string, int retc) {
-  static char func[64];
-  int argc = 0;
+struct llua_call {
+  std::string text;
+  std::string func;
+  std::vector<std::string> args;
+  /* function followed by its arguments; empty if not resolved */
+  std::vector<int> refs;
+  unsigned long state_id = 0;
+  unsigned long loads = 0;
+
+  explicit llua_call(const char *string = "") { parse(string); }
+  ~llua_call() { unref(); }
+  llua_call(const llua_call &) = delete;
+  llua_call &operator=(const llua_call &) = delete;
+
+  void parse(const char *string) {
+    unref();
+    text = string;
+    func.clear();
+    args.clear();
+
+    size_t len = 0;
+    const char *ptr = tokenize(string, &len);
+    /* proceed only if the function name is present */
+    if (len == 0U) { return; }
+
+    /* call only conky_ prefixed functions */
+    if (strncmp(ptr, LUAPREFIX, strlen(LUAPREFIX)) != 0) { func = LUAPREFIX; }
+    func.append(ptr, len);
+
+    while (ptr = tokenize(ptr, &len), len != 0u) {
+      args.emplace_back(ptr, len);
+    }
+  }
 
-  size_t len = 0;
+  void unref() {
+    if (lua_L != nullptr && state_id == llua_state_id) {
+      for (int ref : refs) { luaL_unref(lua_L, LUA_REGISTRYINDEX, ref); }
+    }
+    refs.clear();
+  }
 
-  const char *ptr = tokenize(string, &len);
+  /* push the function and its arguments to the stack */
+  void push() {
+    if (state_id != llua_state_id || loads != llua_loads) {
+      unref();
+      state_id = llua_state_id;
+      loads = llua_loads;
+    }
 
-  /* proceed only if the function name is present */
-  if (len == 0U) { return nullptr; }
+    if (refs.empty()) {
+      lua_getglobal(lua_L, func.c_str());
+      for (const auto &arg : args) {
+        lua_pushlstring(lua_L, arg.data(), arg.size());
+      }
+      /* the function may still be defined later on, so keep looking it up
+       * until it is */
+      if (!lua_isfunction(lua_L, -1 - static_cast<int>(args.size()))) {
+        return;
+      }
+      for (int i = -1 - static_cast<int>(args.size()); i < 0; ++i) {
+        lua_pushvalue(lua_L, i);
+        refs.push_back(luaL_ref(lua_L, LUA_REGISTRYINDEX));
+      }
+      return;
+    }
 
-  /* call only conky_ prefixed functions */
-  if (strncmp(ptr, LUAPREFIX, strlen(LUAPREFIX)) != 0) {
-    snprintf(func, sizeof func, "%s", LUAPREFIX);
-  } else {
-    *func = 0;
+    for (int ref : refs) { lua_rawgeti(lua_L, LUA_REGISTRYINDEX, ref); }
   }
-  strncat(func, ptr, std::min(len, sizeof(func) - strlen(func) - 1));
+};
 
-  /* push the function name to stack */
-  lua_getglobal(lua_L, func);
+/*
+   llua_do_call does a flexible call to any Lua function
+call: the parsed <function> [par1] [par2...]
+retc: the number of return values expected
+ */
+static const char *llua_do_call(llua_call &call, int retc) {
+  /* proceed only if the function name is present */
+  if (call.func.empty()) { return nullptr; }
 
-  /* parse all function parameters from args and push them to the stack */
-  while (ptr = tokenize(ptr, &len), len != 0u) {
-    lua_pushlstring(lua_L, ptr, len);
-    argc++;
-  }
+  conky::profile::span trace(call.func.c_str());
+  call.push();
 
-  if (lua_pcall(lua_L, argc, retc, 0) != 0) {
-    NORM_ERR("llua_do_call: function %s execution failed: %s", func,
-             lua_tostring(lua_L, -1));
+  if (lua_pcall(lua_L, static_cast<int>(call.args.size()), retc, 0) != 0) {
+    NORM_ERR("llua_do_call: function %s execution failed: %s",
+             call.func.c_str(), lua_tostring(lua_L, -1));
     lua_pop(lua_L, -1);
     return nullptr;
   }
 
-  return func;
+  return call.func.c_str();
+}
+
+/* same as above, for calls given by settings which may change on reload */
+static const char *llua_do_call(llua_call &call, const std::string &string,
+                                int retc) {
+  if (call.text != string) { call.parse(string.c_str()); }
+  return llua_do_call(call, retc);
 }
 
 #if 0
@@ -309,13 +610,13 @@ static char *llua_do_read_call(const char *function, const char *arg, int retc)
 #endif
 
 /* call a function with args, and return a string from it (must be free'd) */
-static char *llua_getstring(const char *args) {
-  char *func;
+static char *llua_getstring(llua_call &call) {
+  const char *func;
   char *ret = nullptr;
 
   if (lua_L == nullptr) { return nullptr; }
 
-  func = llua_do_call(args, 1);
+  func = llua_do_call(call, 1);
   if (func != nullptr) {
     if (lua_isstring(lua_L, -1) == 0) {
       NORM_ERR(
@@ -355,12 +656,12 @@ static char *llua_getstring_read(const char *function, const char *arg)
 #endif
 
 /* call a function with args, and put the result in ret */
-static int llua_getnumber(const char *args, double *ret) {
-  char *func;
+static int llua_getnumber(llua_call &call, double *ret) {
+  const char *func;
 
   if (lua_L == nullptr) { return 0; }
 
-  func = llua_do_call(args, 1);
+  func = llua_do_call(call, 1);
   if (func != nullptr) {
     if (lua_isnumber(lua_L, -1) == 0) {
       NORM_ERR(
@@ -454,25 +755,190 @@ void llua_set_number(const char *key, double value) {
   lua_setfield(lua_L, -2, key);
 }
 
+/*
+ * A table filled in from C every update, such as conky_window. It is kept in
+ * the registry instead of being looked up by its global name, its keys are
+ * interned there once, and a field is only set when its value changed, so
+ * that updating it makes no garbage and costs next to nothing when nothing
+ * changed.
+ */
+class llua_table {
+  unsigned long state_id = 0;
+  int ref = LUA_NOREF;
+  std::vector<const char *> names;
+  std::vector<int> keys;
+  std::vector<double> values;
+  std::vector<double> items;
+
+ public:
+  llua_table(std::initializer_list<const char *> names_) : names(names_) {}
+
+  /* whether the table is one of the current lua_L */
+  bool valid() const { return lua_L != nullptr && state_id == llua_state_id; }
+
+  /* makes the table in the current lua_L, with index as the __index of its
+   * metatable if given */
+  void create(lua_CFunction index = nullptr) {
+    lua_createtable(lua_L, 0, static_cast<int>(names.size()));
+    if (index != nullptr) {
+      lua_createtable(lua_L, 0, 1);
+      lua_pushcfunction(lua_L, index);
+      lua_setfield(lua_L, -2, "__index");
+      lua_setmetatable(lua_L, -2);
+    }
+    ref = luaL_ref(lua_L, LUA_REGISTRYINDEX);
+
+    keys.clear();
+    for (const char *name : names) {
+      lua_pushstring(lua_L, name);
+      keys.push_back(luaL_ref(lua_L, LUA_REGISTRYINDEX));
+    }
+    /* NaN is unequal to everything, so the first set() of a field sets it */
+    values.assign(names.size(), NAN);
+    items.clear();
+    state_id = llua_state_id;
+  }
+
+  void push() const { lua_rawgeti(lua_L, LUA_REGISTRYINDEX, ref); }
+
+  /* set the fields of the table on top of the stack: the one with the
+   * field-th of the names, or item i */
+  void set(size_t field, double value) {
+    if (value == values[field]) { return; }
+    values[field] = value;
+    lua_rawgeti(lua_L, LUA_REGISTRYINDEX, keys[field]);
+    lua_pushnumber(lua_L, value);
+    lua_rawset(lua_L, -3);
+  }
+
+  void set_item(size_t i, double value) {
+    if (i >= items.size()) { items.resize(i + 1, NAN); }
+    if (value == items[i]) { return; }
+    items[i] = value;
+    lua_pushnumber(lua_L, value);
+    lua_rawseti(lua_L, -2, static_cast<int>(i));
+  }
+};
+
 void llua_startup_hook() {
   if ((lua_L == nullptr) || lua_startup_hook.get(*state).empty()) { return; }
-  llua_do_call(lua_startup_hook.get(*state).c_str(), 0);
+  static llua_call call;
+  llua_do_call(call, lua_startup_hook.get(*state), 0);
 }
 
 void llua_shutdown_hook() {
   if ((lua_L == nullptr) || lua_shutdown_hook.get(*state).empty()) { return; }
-  llua_do_call(lua_shutdown_hook.get(*state).c_str(), 0);
+  static llua_call call;
+  llua_do_call(call, lua_shutdown_hook.get(*state), 0);
+}
+
+void llua_click_hook(int block, int button, int x, int y, int relative_x,
+                     int relative_y) {
+  if ((lua_L == nullptr) || lua_click_hook.get(*state).empty()) { return; }
+  static llua_call call;
+  if (call.text != lua_click_hook.get(*state)) {
+    call.parse(lua_click_hook.get(*state).c_str());
+  }
+  if (call.func.empty()) { return; }
+
+  /* the arguments of the setting come first, then a table of the click */
+  call.push();
+  lua_newtable(lua_L);
+  llua_set_number("block", block);
+  llua_set_number("button", button);
+  llua_set_number("x", x);
+  llua_set_number("y", y);
+  llua_set_number("relative_x", relative_x);
+  llua_set_number("relative_y", relative_y);
+  if (lua_pcall(lua_L, static_cast<int>(call.args.size()) + 1, 0, 0) != 0) {
+    NORM_ERR("llua_click_hook: function %s execution failed: %s",
+             call.func.c_str(), lua_tostring(lua_L, -1));
+    lua_pop(lua_L, 1);
+  }
+}
+
+/* the state and mode the collector of lua_L was set up for */
+static unsigned long llua_gc_state_id = 0;
+static lua_gc_mode llua_gc_mode = LUA_GC_AUTO;
+/* the heap in KiB when the last cycle of the frame mode finished */
+static int llua_gc_heap = 0;
+
+static void llua_set_gc_mode(lua_gc_mode mode) {
+#if LUA_VERSION_NUM >= 504
+  if (mode == LUA_GC_GENERATIONAL) {
+    lua_gc(lua_L, LUA_GCGEN, 0, 0);
+  } else {
+    lua_gc(lua_L, LUA_GCINC, 0, 0, 0);
+  }
+#else
+  if (mode == LUA_GC_GENERATIONAL) {
+    NORM_ERR("lua_gc: generational needs Lua 5.4, using auto");
+  }
+#endif
+  /* in the frame mode, the collector only runs when we step it */
+  lua_gc(lua_L, mode == LUA_GC_FRAME ? LUA_GCSTOP : LUA_GCRESTART, 0);
+  llua_gc_heap = lua_gc(lua_L, LUA_GCCOUNT, 0);
+  llua_gc_state_id = llua_state_id;
+  llua_gc_mode = mode;
+}
+
+size_t llua_memory() {
+  size_t size = 0;
+  if (lua_L != nullptr) {
+    size = static_cast<size_t>(lua_gc(lua_L, LUA_GCCOUNT, 0)) * 1024 +
+           lua_gc(lua_L, LUA_GCCOUNTB, 0);
+  }
+  if (state != nullptr) {
+    size += static_cast<size_t>(state->gc(LUA_GCCOUNT, 0)) * 1024 +
+            state->gc(LUA_GCCOUNTB, 0);
+  }
+  return size;
+}
+
+void llua_collect_garbage(double budget) {
+  if (lua_L == nullptr) { return; }
+
+  lua_gc_mode mode = gc_mode.get(*state);
+  if (llua_gc_state_id != llua_state_id || llua_gc_mode != mode) {
+    llua_set_gc_mode(mode);
+  }
+  if (mode != LUA_GC_FRAME) { return; }
+
+  conky::profile::scope timing(
+      conky::profile::stage_record(conky::profile::LUA_GC));
+  double until = get_time() + budget * LLUA_GC_BUDGET_SHARE;
+  /* like Lua's default pause of 200%: a cycle which should have finished
+   * by now is finished, whatever the budget */
+  bool overdue = lua_gc(lua_L, LUA_GCCOUNT, 0) > 2 * llua_gc_heap;
+  do {
+    if (lua_gc(lua_L, LUA_GCSTEP, 0) != 0) {
+      llua_gc_heap = lua_gc(lua_L, LUA_GCCOUNT, 0);
+      break;
+    }
+  } while (overdue || get_time() < until);
 }
 
 #ifdef BUILD_GUI
 void llua_draw_pre_hook() {
   if ((lua_L == nullptr) || lua_draw_hook_pre.get(*state).empty()) { return; }
-  llua_do_call(lua_draw_hook_pre.get(*state).c_str(), 0);
+  static llua_call call;
+  llua_do_call(call, lua_draw_hook_pre.get(*state), 0);
 }
 
 void llua_draw_post_hook() {
   if ((lua_L == nullptr) || lua_draw_hook_post.get(*state).empty()) { return; }
-  llua_do_call(lua_draw_hook_post.get(*state).c_str(), 0);
+  static llua_call call;
+  llua_do_call(call, lua_draw_hook_post.get(*state), 0);
+}
+
+bool llua_has_draw_hooks() {
+  return (lua_L != nullptr) && (!lua_draw_hook_pre.get(*state).empty() ||
+                                !lua_draw_hook_post.get(*state).empty());
+}
+
+bool llua_draw_hooks_dirty() {
+  /* scripts without subscriptions poll conky_parse() from their hooks */
+  return llua_subscriptions.empty() || llua_inputs_changed;
 }
 
 void llua_set_userdata(const char *key, const char *type, void *value) {
@@ -480,82 +946,338 @@ void llua_set_userdata(const char *key, const char *type, void *value) {
   lua_setfield(lua_L, -2, key);
 }
 
+enum {
+  WINDOW_WIDTH,
+  WINDOW_HEIGHT,
+  WINDOW_BORDER_INNER_MARGIN,
+  WINDOW_BORDER_OUTER_MARGIN,
+  WINDOW_BORDER_WIDTH,
+  WINDOW_TEXT_START_X,
+  WINDOW_TEXT_START_Y,
+  WINDOW_TEXT_WIDTH,
+  WINDOW_TEXT_HEIGHT
+};
+
+static llua_table window_table{"width",
+                                "height",
+                                "border_inner_margin",
+                                "border_outer_margin",
+                                "border_width",
+                                "text_start_x",
+                                "text_start_y",
+                                "text_width",
+                                "text_height"};
+
 void llua_setup_window_table(int text_start_x, int text_start_y, int text_width,
                              int text_height) {
-  if (lua_L == nullptr) { return; }
-  lua_newtable(lua_L);
-
-  if (out_to_x.get(*state)) {
-    llua_set_userdata("drawable", "Drawable", (void *)&window.drawable);
-    llua_set_userdata("visual", "Visual", window.visual);
-    llua_set_userdata("display", "Display", display);
+  if ((lua_L == nullptr) || !out_to_x.get(*state)) { return; }
+  if (!window_table.valid()) { window_table.create(); }
+  window_table.push();
 
-    llua_set_number("width", window.width);
-    llua_set_number("height", window.height);
-    llua_set_number("border_inner_margin", border_inner_margin.get(*state));
-    llua_set_number("border_outer_margin", border_outer_margin.get(*state));
-    llua_set_number("border_width", border_width.get(*state));
+  llua_set_userdata("drawable", "Drawable", (void *)&window.drawable);
+  llua_set_userdata("visual", "Visual", window.visual);
+  llua_set_userdata("display", "Display", display);
 
-    llua_set_number("text_start_x", text_start_x);
-    llua_set_number("text_start_y", text_start_y);
-    llua_set_number("text_width", text_width);
-    llua_set_number("text_height", text_height);
+  window_table.set(WINDOW_BORDER_INNER_MARGIN, border_inner_margin.get(*state));
+  window_table.set(WINDOW_BORDER_OUTER_MARGIN, border_outer_margin.get(*state));
+  window_table.set(WINDOW_BORDER_WIDTH, border_width.get(*state));
 
-    lua_setglobal(lua_L, "conky_window");
-  }
+  lua_setglobal(lua_L, "conky_window");
+  llua_update_window_table(text_start_x, text_start_y, text_width,
+                           text_height);
 }
 
 void llua_update_window_table(int text_start_x, int text_start_y,
                               int text_width, int text_height) {
-  if (lua_L == nullptr) { return; }
+  /* the window table isn't populated yet */
+  if (!window_table.valid()) { return; }
+  window_table.push();
 
-  lua_getglobal(lua_L, "conky_window");
-  if (lua_isnil(lua_L, -1)) {
-    /* window table isn't populated yet */
-    lua_pop(lua_L, 1);
-    return;
+  window_table.set(WINDOW_WIDTH, window.width);
+  window_table.set(WINDOW_HEIGHT, window.height);
+
+  window_table.set(WINDOW_TEXT_START_X, text_start_x);
+  window_table.set(WINDOW_TEXT_START_Y, text_start_y);
+  window_table.set(WINDOW_TEXT_WIDTH, text_width);
+  window_table.set(WINDOW_TEXT_HEIGHT, text_height);
+
+  lua_pop(lua_L, 1);
+}
+#endif /* BUILD_GUI */
+
+enum { INFO_UPDATE_INTERVAL, INFO_CPU_COUNT };
+enum {
+  MEM_MEM,
+  MEM_MEMMAX,
+  MEM_MEMFREE,
+  MEM_MEMEASYFREE,
+  MEM_BUFFERS,
+  MEM_CACHED,
+  MEM_SWAP,
+  MEM_SWAPMAX,
+  MEM_SWAPFREE
+};
+enum { NET_DOWN, NET_UP, NET_TOTAL_DOWN, NET_TOTAL_UP };
+
+static llua_table info_table{"update_interval", "cpu_count"};
+static llua_table cpu_table{};
+static llua_table mem_table{"mem",     "memmax", "memfree",
+                            "memeasyfree", "buffers", "cached",
+                            "swap",    "swapmax", "swapfree"};
+static llua_table net_table{};
+static std::map<std::string, llua_table> net_dev_tables;
+
+static void llua_fill_cpu() {
+  if (info.cpu_usage == nullptr) { return; }
+  for (unsigned int i = 0; i <= info.cpu_count; ++i) {
+    cpu_table.set_item(i, 100.0 * info.cpu_usage[i]);
   }
+}
 
-  llua_set_number("width", window.width);
-  llua_set_number("height", window.height);
+static void llua_fill_mem() {
+  const double k = 1024;
+  mem_table.set(MEM_MEM, k * info.mem);
+  mem_table.set(MEM_MEMMAX, k * info.memmax);
+  mem_table.set(MEM_MEMFREE, k * info.memfree);
+  mem_table.set(MEM_MEMEASYFREE, k * info.memeasyfree);
+  mem_table.set(MEM_BUFFERS, k * info.buffers);
+  mem_table.set(MEM_CACHED, k * info.cached);
+  mem_table.set(MEM_SWAP, k * info.swap);
+  mem_table.set(MEM_SWAPMAX, k * info.swapmax);
+  mem_table.set(MEM_SWAPFREE, k * info.swapfree);
+}
 
-  llua_set_number("text_start_x", text_start_x);
-  llua_set_number("text_start_y", text_start_y);
-  llua_set_number("text_width", text_width);
-  llua_set_number("text_height", text_height);
+static void llua_fill_net_dev(const std::string &dev, llua_table &table) {
+  struct net_stat *ns = find_net_stat(dev.c_str());
+  if (ns == nullptr) { return; }
+  table.push();
+  table.set(NET_DOWN, ns->recv_speed);
+  table.set(NET_UP, ns->trans_speed);
+  table.set(NET_TOTAL_DOWN, ns->recv);
+  table.set(NET_TOTAL_UP, ns->trans);
+  lua_pop(lua_L, 1);
+}
 
-  lua_setglobal(lua_L, "conky_window");
+static void llua_fill_net() {
+  for (auto &dev : net_dev_tables) { llua_fill_net_dev(dev.first, dev.second); }
 }
-#endif /* BUILD_GUI */
 
-void llua_setup_info(struct information *i, double u_interval) {
-  if (lua_L == nullptr) { return; }
-  lua_newtable(lua_L);
+/* conky_info.net.<interface>, which starts tracking the interface */
+static int llua_net_index(lua_State *L) {
+  if (lua_type(L, 2) != LUA_TSTRING) { return 0; }
+  std::string dev(lua_tostring(L, 2));
+  get_net_stat(dev.c_str(), nullptr, nullptr);
+
+  llua_table &table =
+      net_dev_tables
+          .emplace(dev, llua_table{"down", "up", "total_down", "total_up"})
+          .first->second;
+  if (!table.valid()) { table.create(); }
+  llua_fill_net_dev(dev, table);
+  /* found in net from now on */
+  table.push();
+  lua_setfield(L, 1, dev.c_str());
+  table.push();
+  return 1;
+}
 
-  llua_set_number("update_interval", u_interval);
-  llua_set_number("cpu_count", i->cpu_count);
+/* The counters of conky_info, whose sources only run while a script reads
+ * them, like those of the objects of conky.text. */
+struct llua_info_source {
+  const char *name;
+  int (*update)();
+  llua_table &table;
+  void (*fill)();
+  lua_CFunction index;
+  std::unique_ptr<legacy_cb_handle> handle;
+};
+
+static llua_info_source info_sources[] = {
+    {"cpu", &update_cpu_usage, cpu_table, &llua_fill_cpu, nullptr, nullptr},
+    {"mem", &update_meminfo, mem_table, &llua_fill_mem, nullptr, nullptr},
+    {"net", &update_net_stats, net_table, &llua_fill_net, &llua_net_index,
+     nullptr},
+};
+
+/* conky_info.cpu, .mem and .net, which are left out of conky_info so that
+ * every read of them comes here and keeps their source running */
+static int llua_info_index(lua_State *L) {
+  if (lua_type(L, 2) != LUA_TSTRING) { return 0; }
+  const char *key = lua_tostring(L, 2);
+
+  for (auto &source : info_sources) {
+    if (strcmp(key, source.name) != 0) { continue; }
+    if (!source.handle) {
+      if (source.update == &update_cpu_usage) { get_cpu_count(); }
+      source.handle.reset(create_cb_handle(source.update, -1));
+    }
+    (*source.handle)->wanted();
+    if (!source.table.valid()) {
+      source.table.create(source.index);
+      source.table.push();
+      source.fill();
+      lua_pop(L, 1);
+    }
+    source.table.push();
+    return 1;
+  }
+  return 0;
+}
 
-  lua_setglobal(lua_L, "conky_info");
+static void llua_release_info() {
+  for (auto &source : info_sources) { source.handle.reset(); }
+  net_dev_tables.clear();
 }
 
-void llua_update_info(struct information *i, double u_interval) {
+void llua_setup_info(struct information *i, double u_interval) {
   if (lua_L == nullptr) { return; }
+  if (!info_table.valid()) {
+    info_table.create(&llua_info_index);
+    info_table.push();
+    lua_setglobal(lua_L, "conky_info");
+  }
+  llua_update_info(i, u_interval);
+}
 
-  lua_getglobal(lua_L, "conky_info");
-  if (lua_isnil(lua_L, -1)) {
-    /* window table isn't populated yet */
+void llua_update_info(struct information *i, double u_interval) {
+  /* the info table isn't populated yet */
+  if (!info_table.valid()) { return; }
+
+  info_table.push();
+  info_table.set(INFO_UPDATE_INTERVAL, u_interval);
+  info_table.set(INFO_CPU_COUNT, i->cpu_count);
+  lua_pop(lua_L, 1);
+
+  for (auto &source : info_sources) {
+    if (!source.handle || !source.table.valid()) { continue; }
+    source.table.push();
+    source.fill();
     lua_pop(lua_L, 1);
+  }
+}
+
+/*
+ * Runs a Lua function in a Lua state of its own on the callback threads, so
+ * that slow functions never hold up the main loop. The state loads the same
+ * lua_load scripts as the main one when first used; it has no conky_parse()
+ * or window tables, but can exchange strings with the main state through
+ * conky_set_shared() and conky_get_shared().
+ */
+class lua_async_cb : public conky::callback<std::string, std::string,
+                                            std::string> {
+  typedef conky::callback<std::string, std::string, std::string> Base;
+
+  lua_State *L = nullptr;
+  std::string func;
+  std::vector<std::string> args;
+
+ protected:
+  void work() override;
+
+ public:
+  lua_async_cb(double period, bool wait, const std::string &call,
+               const std::string &scripts)
+      : Base(period, wait, Base::Tuple(call, scripts)) {
+    size_t len = 0;
+    const char *ptr = tokenize(call.c_str(), &len);
+    if (len == 0U) { return; }
+
+    if (strncmp(ptr, LUAPREFIX, strlen(LUAPREFIX)) != 0) { func = LUAPREFIX; }
+    func.append(ptr, len);
+    while (ptr = tokenize(ptr, &len), len != 0u) {
+      args.emplace_back(ptr, len);
+    }
+  }
+
+  ~lua_async_cb() override {
+    if (L != nullptr) { lua_close(L); }
+  }
+};
+
+void lua_async_cb::work() {
+  if (func.empty()) { return; }
+
+  if (L == nullptr) {
+    L = luaL_newstate();
+    llua_setup_state(L);
+
+    std::string files = std::get<1>(tuple);
+    while (!files.empty()) {
+      std::string::size_type pos = files.find(' ');
+      if (pos > 0) {
+        std::string path = to_real_path(std::string(files, 0, pos));
+        if (luaL_dofile(L, path.c_str()) != 0) {
+          NORM_ERR("lua_async: %s", lua_tostring(L, -1));
+          lua_pop(L, 1);
+        }
+      }
+      files.erase(0, pos == std::string::npos ? pos : pos + 1);
+    }
+  }
+
+  lua_getglobal(L, func.c_str());
+  for (const auto &arg : args) { lua_pushlstring(L, arg.data(), arg.size()); }
+
+  if (lua_pcall(L, static_cast<int>(args.size()), 1, 0) != 0) {
+    NORM_ERR("lua_async: function %s execution failed: %s", func.c_str(),
+             lua_tostring(L, -1));
+    lua_pop(L, 1);
     return;
   }
 
-  llua_set_number("update_interval", u_interval);
-  (void)i;
+  if (lua_isstring(L, -1) == 0) {
+    NORM_ERR(
+        "lua_async: function %s didn't return a string, result discarded",
+        func.c_str());
+  } else {
+    std::lock_guard<std::mutex> l(result_mutex);
+    result = lua_tostring(L, -1);
+  }
+  lua_pop(L, 1);
+}
+
+void scan_lua_async(struct text_object *obj, const char *arg) {
+  float interval = 0;
+  int n = 0;
 
-  lua_setglobal(lua_L, "conky_info");
+  if (sscanf(arg, "%f %n", &interval, &n) <= 0 || arg[n] == 0) {
+    NORM_ERR(
+        "lua_async needs arguments: <interval> <function name> [function "
+        "parameters]");
+    return;
+  }
+
+  double period = interval;
+  obj->data.opaque = new conky::callback_handle<lua_async_cb>(
+      conky::register_cb<lua_async_cb>(period, false, arg + n,
+                                       lua_load_files()));
+}
+
+void print_lua_async(struct text_object *obj, char *p,
+                     unsigned int p_max_size) {
+  auto *handle =
+      static_cast<conky::callback_handle<lua_async_cb> *>(obj->data.opaque);
+  if (handle != nullptr) {
+    snprintf(p, p_max_size, "%s", (*handle)->read_result().c_str());
+  }
+}
+
+void free_lua_async(struct text_object *obj) {
+  delete static_cast<conky::callback_handle<lua_async_cb> *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
+
+void llua_parse_call(struct text_object *obj, const char *arg) {
+  obj->data.opaque = new llua_call(arg != nullptr ? arg : "");
+}
+
+void llua_free_call(struct text_object *obj) {
+  delete static_cast<llua_call *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
 }
 
 void print_lua(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *str = llua_getstring(obj->data.s);
+  char *str = llua_getstring(*static_cast<llua_call *>(obj->data.opaque));
   if (str != nullptr) {
     snprintf(p, p_max_size, "%s", str);
     free(str);
@@ -564,7 +1286,7 @@ void print_lua(struct text_object *obj, char *p, unsigned int p_max_size) {
 
 void print_lua_parse(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  char *str = llua_getstring(obj->data.s);
+  char *str = llua_getstring(*static_cast<llua_call *>(obj->data.opaque));
   if (str != nullptr) {
     evaluate(str, p, p_max_size);
     free(str);
@@ -573,6 +1295,8 @@ void print_lua_parse(struct text_object *obj, char *p,
 
 double lua_barval(struct text_object *obj) {
   double per;
-  if (llua_getnumber(obj->data.s, &per) != 0) { return per; }
+  if (llua_getnumber(*static_cast<llua_call *>(obj->data.opaque), &per) != 0) {
+    return per;
+  }
   return 0;
 }
@@ -45,10 +45,29 @@ void llua_inotify_query(int wd, int mask);
 
 void llua_startup_hook(void);
 void llua_shutdown_hook(void);
+/* calls lua_click_hook for a click on the blocks of out_to_i3bar */
+void llua_click_hook(int block, int button, int x, int y, int relative_x,
+                     int relative_y);
+
+/* calls the conky_on_change() functions whose text changed; call once an
+ * update, after the data sources were updated */
+void llua_run_subscriptions(void);
+
+/* with lua_gc set to frame, steps the collector of the Lua scripts for part
+ * of budget, the seconds left until the next update; call between frames */
+void llua_collect_garbage(double budget);
+
+/* the heap of the Lua scripts and that of the configuration, in bytes */
+size_t llua_memory(void);
 
 #ifdef BUILD_GUI
 void llua_draw_pre_hook(void);
 void llua_draw_post_hook(void);
+/* true if the draw hooks may paint anywhere in the window */
+bool llua_has_draw_hooks(void);
+/* false if the hooks would paint the same as last time: the scripts
+ * subscribed to their inputs, and none changed and no redraw was asked for */
+bool llua_draw_hooks_dirty(void);
 
 void llua_setup_window_table(int text_start_x, int text_start_y, int text_width,
                              int text_height);
@@ -59,8 +78,13 @@ void llua_update_window_table(int text_start_x, int text_start_y,
 void llua_setup_info(struct information *i, double u_interval);
 void llua_update_info(struct information *i, double u_interval);
 
+void llua_parse_call(struct text_object *, const char *);
+void llua_free_call(struct text_object *);
 void print_lua(struct text_object *, char *, unsigned int);
 void print_lua_parse(struct text_object *, char *, unsigned int);
 double lua_barval(struct text_object *);
+void scan_lua_async(struct text_object *, const char *);
+void print_lua_async(struct text_object *, char *, unsigned int);
+void free_lua_async(struct text_object *);
 
 #endif /* LUA_H_*/
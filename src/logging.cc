@@ -0,0 +1,117 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "logging.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace conky {
+namespace {
+
+const std::chrono::seconds MIN_BACKOFF(1);
+const std::chrono::seconds MAX_BACKOFF(3600);
+
+/* Call sites are static objects of functions, which may log while static
+ * objects are being destroyed, so the list is never destroyed. */
+struct log_limiters {
+  std::mutex mutex;
+  std::vector<log_limiter *> limiters;
+};
+
+log_limiters &get_log_limiters() {
+  static auto *l = new log_limiters;
+  return *l;
+}
+
+}  // namespace
+
+log_limiter::log_limiter(const char *file_, int line_)
+    : file(file_),
+      line(line_),
+      backoff(0),
+      held_back(0),
+      printed(0),
+      suppressed(0) {
+  log_limiters &l = get_log_limiters();
+  std::lock_guard<std::mutex> lock(l.mutex);
+  l.limiters.push_back(this);
+}
+
+void log_limiter::log(const std::string &message) {
+  std::string text(message);
+  while (!text.empty() && text.back() == '\n') { text.pop_back(); }
+
+  auto now = std::chrono::steady_clock::now();
+  uint64_t held;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (text == last && now < quiet_until) {
+      ++held_back;
+      ++suppressed;
+      return;
+    }
+    /* a message which keeps coming back waits longer every time, unless it
+     * stayed away for as long as it was told to */
+    if (text != last || now - quiet_until > backoff) {
+      last = text;
+      backoff = MIN_BACKOFF;
+    } else {
+      backoff = std::min(backoff * 2, MAX_BACKOFF);
+    }
+    quiet_until = now + backoff;
+    held = held_back;
+    held_back = 0;
+    ++printed;
+  }
+
+  if (held > 0) {
+    NORM_ERR("%s (%llu more suppressed)", text.c_str(),
+             static_cast<unsigned long long>(held));
+  } else {
+    NORM_ERR("%s", text.c_str());
+  }
+}
+
+std::vector<log_limiter::stats> log_limiter::all_stats() {
+  std::vector<stats> ret;
+  log_limiters &l = get_log_limiters();
+  std::lock_guard<std::mutex> lock(l.mutex);
+
+  for (auto *limiter : l.limiters) {
+    std::lock_guard<std::mutex> site_lock(limiter->mutex);
+    if (limiter->printed == 0) { continue; }
+    const char *name = strrchr(limiter->file, '/');
+    name = name != nullptr ? name + 1 : limiter->file;
+    ret.push_back({std::string(name) + ":" + std::to_string(limiter->line),
+                   limiter->last, limiter->printed, limiter->suppressed});
+  }
+  return ret;
+}
+
+}  // namespace conky
@@ -30,8 +30,13 @@
 #ifndef _LOGGING_H
 #define _LOGGING_H
 
+#include <chrono>
+#include <cstdint>
 #include <cstdio>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <vector>
 #include "config.h"
 #include "i18n.h"
 
@@ -80,6 +85,66 @@ void NORM_ERR(const char *format, Args &&...args) {
   fputs("\n", stderr);
 }
 
+namespace conky {
+/*
+ * The state of one LIMITED_ERR() call site. A message is printed the first
+ * time, and the same message again only once the call site has been quiet
+ * for a while: 1 second after the first repeat, then 2, 4, ... up to an
+ * hour, so a sensor which fails on every update ends up in the log a few
+ * times an hour instead of several times a second. The number of messages
+ * held back is printed with the next one. A different message is printed
+ * straight away and starts over.
+ */
+class log_limiter {
+ public:
+  log_limiter(const char *file_, int line_);
+
+  log_limiter(const log_limiter &) = delete;
+  log_limiter &operator=(const log_limiter &) = delete;
+
+  void log(const std::string &message);
+
+  const char *const file;
+  const int line;
+
+  struct stats {
+    std::string site; /* file:line */
+    std::string message;
+    uint64_t printed;
+    uint64_t suppressed;
+  };
+  /* of every call site which has logged something, for conky_profile */
+  static std::vector<stats> all_stats();
+
+ private:
+  std::mutex mutex;
+  std::string last;
+  std::chrono::steady_clock::time_point quiet_until;
+  std::chrono::seconds backoff;
+  uint64_t held_back; /* since the last message printed */
+  uint64_t printed;
+  uint64_t suppressed;
+};
+
+template <typename... Args>
+inline std::string format_log_message(const char *format, Args &&...args) {
+  char buf[512];
+  snprintf(buf, sizeof buf, _(format), args...);
+  return buf;
+}
+
+inline std::string format_log_message(const char *format) {
+  return _(format);
+}
+}  // namespace conky
+
+/* NORM_ERR() for paths which may fail on every update, see log_limiter */
+#define LIMITED_ERR(...)                                     \
+  do {                                                       \
+    static conky::log_limiter log_site_(__FILE__, __LINE__); \
+    log_site_.log(conky::format_log_message(__VA_ARGS__));   \
+  } while (0)
+
 /* critical error */
 template <typename... Args>
 inline void CRIT_ERR(void *memtofree1, void *memtofree2, const char *format,
@@ -40,5 +40,6 @@ void export_symbols(lua::state &l) {
     l.rawsetfield(-2, "config");
   }
   l.setglobal("conky");
+  invalidate_config_settings();
 }
 }  // namespace conky
@@ -34,6 +34,7 @@
 #include "common.h"
 #include "conky.h"
 #include "logging.h"
+#include "net-endpoint.hh"
 #include "text_object.h"
 
 #include <netdb.h>
@@ -51,14 +52,43 @@
 
 #include <dirent.h>
 #include <termios.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc99-extensions"
+#include <sys/inotify.h>
+#pragma clang diagnostic pop
+#endif /* HAVE_SYS_INOTIFY_H */
 
 #include <cmath>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
 
 #include "update-cb.hh"
 
+/* how long connecting to a mail server, or waiting for it while talking to
+ * it, may take in seconds */
+#define MAIL_TIMEOUT 60
+
+/* incremental state of a maildir: the message names found in cur/ and new/
+ * and the inotify watches that keep them up to date between full scans */
+struct maildir_state {
+  std::unordered_set<std::string> names[2]; /* indexed by in_new */
+  int inotify_fd{-1};
+  int wd[2]{-1, -1};
+  double last_scan{0};
+  bool valid{false};
+
+  ~maildir_state() {
+    if (inotify_fd >= 0) { close(inotify_fd); }
+  }
+};
+
 struct local_mail_s {
   char *mbox;
   int mail_count;
@@ -77,6 +107,7 @@ struct local_mail_s {
   time_t last_mtime;
   time_t last_ctime; /* needed for mutt at least */
   double last_update;
+  struct maildir_state *maildir;
 };
 
 class mail_fail : public std::runtime_error {
@@ -114,36 +145,18 @@ class mail_cb
       Base;
 
  protected:
-  addrinfo *ai;
+  std::shared_ptr<conky::net_endpoint> endpoint;
 
   uint16_t fail;
   uint16_t retries;
 
-  void resolve_host() {
-    struct addrinfo hints {};
-    char portbuf[8];
-
-    memset(&hints, 0, sizeof(struct addrinfo));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    snprintf(portbuf, 8, "%" SCNu16, get<MP_PORT>());
-
-    if (int res = getaddrinfo(get<MP_HOST>().c_str(), portbuf, &hints, &ai)) {
-      throw mail_fail(std::string("IMAP getaddrinfo: ") + gai_strerror(res));
-    }
-  }
-
   int connect() {
-    for (struct addrinfo *rp = ai; rp != nullptr; rp = rp->ai_next) {
-      int sockfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-      if (sockfd == -1) { continue; }
-      if (::connect(sockfd, rp->ai_addr, rp->ai_addrlen) != -1) {
-        return sockfd;
-      }
-      close(sockfd);
+    int sockfd = endpoint->connect(MAIL_TIMEOUT);
+    if (sockfd == -1) {
+      throw mail_fail("Unable to connect to mail server: " +
+                      strerror_r(errno));
     }
-    throw mail_fail("Unable to connect to mail server");
+    return sockfd;
   }
 
   void merge(callback_base &&other) override {
@@ -156,36 +169,115 @@ class mail_cb
     Base::merge(std::move(other));
   }
 
-  mail_cb(uint32_t period, const Tuple &tuple, uint16_t retries_)
+  mail_cb(double period, const Tuple &tuple, uint16_t retries_)
       : Base(period, false, tuple, true),
-        ai(nullptr),
+        endpoint(conky::net_endpoint::get(
+            std::get<MP_HOST>(tuple),
+            std::to_string(std::get<MP_PORT>(tuple)))),
         fail(0),
         retries(retries_) {}
-
-  ~mail_cb() override {
-    if (ai != nullptr) { freeaddrinfo(ai); }
-  }
 };
 
 struct mail_param_ex : public mail_cb::Tuple {
   uint16_t retries{0};
-  uint32_t period{1};
+  double period{0};
 
   mail_param_ex() = default;
 };
 
+/*
+ * A logged in IMAP connection shared by the imap_cbs of all the folders of
+ * one account, so that several folders on a server take one socket and one
+ * login instead of one each. It stays open between updates, and a STATUS for
+ * every folder is sent in one go whenever one of them wants a fresh count.
+ * Accounts with a single folder keep IDLEing on a connection of their own.
+ */
+class imap_account {
+  struct folder {
+    unsigned users{0};
+    bool valid{false};
+    mail_result status;
+  };
+
+  std::string host, user, pass;
+  in_port_t port;
+
+  std::shared_ptr<conky::net_endpoint> endpoint;
+  int sockfd{-1};
+  std::map<std::string, folder> folders;
+
+  void login();
+  void disconnect();
+  void status_all();
+
+ public:
+  /* held while using the connection or the folder list */
+  std::mutex mutex;
+  /* bumped after every round of STATUS commands */
+  unsigned long round{0};
+
+  imap_account(const std::string &host_, in_port_t port_,
+               const std::string &user_, const std::string &pass_)
+      : host(host_),
+        user(user_),
+        pass(pass_),
+        port(port_),
+        endpoint(conky::net_endpoint::get(host_, std::to_string(port_))) {}
+  ~imap_account() {
+    disconnect();
+  }
+
+  void add_folder(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++folders[name].users;
+  }
+  void remove_folder(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = folders.find(name);
+    if (it != folders.end() && --it->second.users == 0) { folders.erase(it); }
+  }
+  size_t folder_count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return folders.size();
+  }
+
+  /* Fetch the status of all folders, unless that has happened since round
+   * was last_round. Call with mutex held; throws mail_fail. */
+  mail_result status(const std::string &name, unsigned long last_round);
+
+  static std::shared_ptr<imap_account> get(const std::string &host,
+                                           in_port_t port,
+                                           const std::string &user,
+                                           const std::string &pass);
+};
+
 class imap_cb : public mail_cb {
   using Base = mail_cb;
 
+  std::shared_ptr<imap_account> account;
+  /* the account's round our result comes from */
+  unsigned long last_round;
+  unsigned long last_unseen;
+  unsigned long last_messages;
+
   void check_status(char *recvbuf);
   void unseen_command(unsigned long old_unseen, unsigned long old_messages);
+  void work_shared();
 
  protected:
   void work() override;
 
  public:
-  imap_cb(uint32_t period, const Tuple &tuple, uint16_t retries_)
-      : Base(period, tuple, retries_) {}
+  imap_cb(double period, const Tuple &tuple, uint16_t retries_)
+      : Base(period, tuple, retries_),
+        account(imap_account::get(get<MP_HOST>(), get<MP_PORT>(),
+                                   get<MP_USER>(), get<MP_PASS>())),
+        last_round(0),
+        last_unseen(ULONG_MAX),
+        last_messages(ULONG_MAX) {
+    account->add_folder(get<MP_FOLDER>());
+  }
+  ~imap_cb() override { account->remove_folder(get<MP_FOLDER>()); }
 };
 
 class pop3_cb : public mail_cb {
@@ -195,20 +287,197 @@ class pop3_cb : public mail_cb {
   void work() override;
 
  public:
-  pop3_cb(uint32_t period, const Tuple &tuple, uint16_t retries_)
+  pop3_cb(double period, const Tuple &tuple, uint16_t retries_)
       : Base(period, tuple, retries_) {}
 };
 
 struct mail_param_ex *global_mail;
 }  // namespace
 
+#if HAVE_DIRENT_H
+namespace {
+/* full rescans still happen this often, in case a watch missed something */
+const double MAILDIR_RESCAN_INTERVAL = 600;
+
+/* adds (delta = 1) or removes (delta = -1) one message to the counters,
+ * using the flags encoded in its file name */
+void count_maildir_message(struct local_mail_s *mail, const char *name,
+                           bool in_new, int delta) {
+  mail->mail_count += delta;
+  if (in_new) {
+    mail->new_mail_count += delta;
+    mail->unseen_mail_count += delta; /* new messages cannot have been seen */
+    return;
+  }
+
+  const char *mailflags = strrchr(name, ',');
+  if (mailflags == nullptr) { mailflags = ""; }
+
+  if (strchr(mailflags, 'T') != nullptr) { /* The message is in the trash */
+    mail->trashed_mail_count += delta;
+    return;
+  }
+  if (strchr(mailflags, 'S') != nullptr) { /* The message has been seen */
+    mail->seen_mail_count += delta;
+  } else {
+    mail->unseen_mail_count += delta;
+  }
+  if (strchr(mailflags, 'F') != nullptr) { /* The message was flagged */
+    mail->flagged_mail_count += delta;
+  } else {
+    mail->unflagged_mail_count += delta;
+  }
+  if (strchr(mailflags, 'P') != nullptr) { /* The message was forwarded */
+    mail->forwarded_mail_count += delta;
+  } else {
+    mail->unforwarded_mail_count += delta;
+  }
+  if (strchr(mailflags, 'R') != nullptr) { /* The message was replied */
+    mail->replied_mail_count += delta;
+  } else {
+    mail->unreplied_mail_count += delta;
+  }
+  if (strchr(mailflags, 'D') != nullptr) { /* The message is a draft */
+    mail->draft_mail_count += delta;
+  }
+}
+
+/* the name sets make adding and removing idempotent, so events that
+ * overlap a full scan are never counted twice */
+void add_maildir_message(struct local_mail_s *mail, bool in_new,
+                         const char *name) {
+  /* . and .. as well as hidden files are skipped */
+  if (name[0] == '.') { return; }
+  if (mail->maildir->names[in_new].insert(name).second) {
+    count_maildir_message(mail, name, in_new, 1);
+  }
+}
+
+void remove_maildir_message(struct local_mail_s *mail, bool in_new,
+                            const char *name) {
+  if (mail->maildir->names[in_new].erase(name) != 0) {
+    count_maildir_message(mail, name, in_new, -1);
+  }
+}
+
+void scan_maildir(struct local_mail_s *mail) {
+  struct maildir_state *md = mail->maildir;
+
+  mail->mail_count = mail->new_mail_count = 0;
+  mail->seen_mail_count = mail->unseen_mail_count = 0;
+  mail->flagged_mail_count = mail->unflagged_mail_count = 0;
+  mail->forwarded_mail_count = mail->unforwarded_mail_count = 0;
+  mail->replied_mail_count = mail->unreplied_mail_count = 0;
+  mail->draft_mail_count = mail->trashed_mail_count = 0;
+  md->names[0].clear();
+  md->names[1].clear();
+  md->valid = false;
+  md->last_scan = current_update_time;
+
+  for (bool in_new : {false, true}) {
+    std::string dirname = std::string(mail->mbox) + (in_new ? "/new" : "/cur");
+    DIR *dir = opendir(dirname.c_str());
+    if (dir == nullptr) {
+      NORM_ERR("cannot open directory");
+      return;
+    }
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != nullptr) {
+      add_maildir_message(mail, in_new, dirent->d_name);
+    }
+    closedir(dir);
+  }
+  md->valid = true;
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+void close_maildir_watch(struct maildir_state *md) {
+  if (md->inotify_fd >= 0) { close(md->inotify_fd); }
+  md->inotify_fd = -1;
+  md->wd[0] = md->wd[1] = -1;
+}
+
+/* must run before the scan it guards, so nothing falls between the two */
+bool open_maildir_watch(struct local_mail_s *mail) {
+  struct maildir_state *md = mail->maildir;
+  const uint32_t mask = IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |
+                        IN_DELETE_SELF | IN_MOVE_SELF;
+
+  md->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (md->inotify_fd < 0) { return false; }
+  for (bool in_new : {false, true}) {
+    std::string dirname = std::string(mail->mbox) + (in_new ? "/new" : "/cur");
+    md->wd[in_new] = inotify_add_watch(md->inotify_fd, dirname.c_str(), mask);
+    if (md->wd[in_new] < 0) {
+      close_maildir_watch(md);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* applies the queued events to the counters; returns false when they can't
+ * be trusted and a full scan is needed */
+bool read_maildir_events(struct local_mail_s *mail) {
+  struct maildir_state *md = mail->maildir;
+  alignas(struct inotify_event) char buf[4096];
+  bool ok = true;
+  ssize_t len;
+
+  while ((len = read(md->inotify_fd, buf, sizeof(buf))) > 0) {
+    for (char *ptr = buf; ptr < buf + len;) {
+      auto *ev = reinterpret_cast<struct inotify_event *>(ptr);
+      ptr += sizeof(struct inotify_event) + ev->len;
+
+      if ((ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF |
+                       IN_MOVE_SELF)) != 0) {
+        ok = false;
+        continue;
+      }
+      if (ev->len == 0 || (ev->mask & IN_ISDIR) != 0) { continue; }
+      bool in_new = ev->wd == md->wd[1];
+      if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+        add_maildir_message(mail, in_new, ev->name);
+      } else if ((ev->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) {
+        remove_maildir_message(mail, in_new, ev->name);
+      }
+    }
+  }
+  if (len < 0 && errno != EAGAIN && errno != EINTR) { ok = false; }
+  return ok;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+void update_maildir_count(struct local_mail_s *mail) {
+  if (mail->maildir == nullptr) { mail->maildir = new maildir_state; }
+  struct maildir_state *md = mail->maildir;
+  bool rescan = !md->valid ||
+                current_update_time - md->last_scan >= MAILDIR_RESCAN_INTERVAL;
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (md->inotify_fd < 0) {
+    rescan = true;
+    open_maildir_watch(mail);
+  } else if (!read_maildir_events(mail)) {
+    /* the directories may have been replaced, so watch them anew */
+    close_maildir_watch(md);
+    open_maildir_watch(mail);
+    rescan = true;
+  }
+#else
+  rescan = true;
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  if (rescan) { scan_maildir(mail); }
+}
+}  // namespace
+#endif /* HAVE_DIRENT_H */
+
 static void update_mail_count(struct local_mail_s *mail) {
   struct stat st {};
 
   if (mail == nullptr) { return; }
 
-  /* TODO: use that fine file modification notify on Linux 2.4 */
-
   /* don't check mail so often (9.5s is minimum interval) */
   if (current_update_time - mail->last_update < 9.5) { return; }
   mail->last_update = current_update_time;
@@ -225,94 +494,7 @@ static void update_mail_count(struct local_mail_s *mail) {
 #if HAVE_DIRENT_H
   /* maildir format */
   if (S_ISDIR(st.st_mode)) {
-    DIR *dir;
-    std::string dirname(mail->mbox);
-    struct dirent *dirent;
-    char *mailflags;
-
-    mail->mail_count = mail->new_mail_count = 0;
-    mail->seen_mail_count = mail->unseen_mail_count = 0;
-    mail->flagged_mail_count = mail->unflagged_mail_count = 0;
-    mail->forwarded_mail_count = mail->unforwarded_mail_count = 0;
-    mail->replied_mail_count = mail->unreplied_mail_count = 0;
-    mail->draft_mail_count = mail->trashed_mail_count = 0;
-    /* checking the cur subdirectory */
-    dirname = dirname + "/cur";
-
-    dir = opendir(dirname.c_str());
-    if (dir == nullptr) {
-      NORM_ERR("cannot open directory");
-      return;
-    }
-    dirent = readdir(dir);
-    while (dirent != nullptr) {
-      /* . and .. are skipped */
-      if (dirent->d_name[0] != '.') {
-        mail->mail_count++;
-        mailflags = static_cast<char *>(
-            malloc(sizeof(char) * strlen(strrchr(dirent->d_name, ','))));
-        if (mailflags == nullptr) {
-          NORM_ERR("malloc");
-          return;
-        }
-        strncpy(mailflags, strrchr(dirent->d_name, ','),
-                strlen(strrchr(dirent->d_name, ',')));
-        if (strchr(mailflags, 'T') ==
-            nullptr) { /* The message is not in the trash */
-          if (strchr(mailflags, 'S') !=
-              nullptr) { /*The message has been seen */
-            mail->seen_mail_count++;
-          } else {
-            mail->unseen_mail_count++;
-          }
-          if (strchr(mailflags, 'F') != nullptr) { /*The message was flagged */
-            mail->flagged_mail_count++;
-          } else {
-            mail->unflagged_mail_count++;
-          }
-          if (strchr(mailflags, 'P') !=
-              nullptr) { /*The message was forwarded */
-            mail->forwarded_mail_count++;
-          } else {
-            mail->unforwarded_mail_count++;
-          }
-          if (strchr(mailflags, 'R') != nullptr) { /*The message was replied */
-            mail->replied_mail_count++;
-          } else {
-            mail->unreplied_mail_count++;
-          }
-          if (strchr(mailflags, 'D') != nullptr) { /*The message is a draft */
-            mail->draft_mail_count++;
-          }
-        } else {
-          mail->trashed_mail_count++;
-        }
-        free(mailflags);
-      }
-      dirent = readdir(dir);
-    }
-    closedir(dir);
-
-    dirname.resize(dirname.size() - 3);
-    dirname = dirname + "new";
-
-    dir = opendir(dirname.c_str());
-    if (dir == nullptr) {
-      NORM_ERR("cannot open directory");
-      return;
-    }
-    dirent = readdir(dir);
-    while (dirent != nullptr) {
-      /* . and .. are skipped */
-      if (dirent->d_name[0] != '.') {
-        mail->new_mail_count++;
-        mail->mail_count++;
-        mail->unseen_mail_count++; /* new messages cannot have been seen */
-      }
-      dirent = readdir(dir);
-    }
-    closedir(dir);
-
+    update_maildir_count(mail);
     return;
   }
 #endif
@@ -456,6 +638,7 @@ void free_local_mails(struct text_object *obj) {
 
   if (locmail == nullptr) { return; }
 
+  delete locmail->maildir;
   free_and_zero(locmail->mbox);
   free_and_zero(obj->data.opaque);
 }
@@ -520,7 +703,7 @@ std::unique_ptr<mail_param_ex> parse_mail_args(mail_type type,
     tmp += 3;
     sscanf(tmp, "%f", &interval);
   }
-  mail->period = std::max(lround(interval / active_update_interval()), 1l);
+  mail->period = interval;
 
   tmp = const_cast<char *>(strstr(arg, "-p "));
   if (tmp != nullptr) {
@@ -715,6 +898,158 @@ void imap_cb::unseen_command(unsigned long old_unseen,
   }
 }
 
+std::shared_ptr<imap_account> imap_account::get(const std::string &host,
+                                                in_port_t port,
+                                                const std::string &user,
+                                                const std::string &pass) {
+  typedef std::tuple<std::string, in_port_t, std::string, std::string> key;
+  static std::mutex accounts_mutex;
+  static std::map<key, std::weak_ptr<imap_account>> accounts;
+
+  std::lock_guard<std::mutex> lock(accounts_mutex);
+  std::weak_ptr<imap_account> &weak = accounts[key(host, port, user, pass)];
+  std::shared_ptr<imap_account> account = weak.lock();
+  if (!account) {
+    account = std::make_shared<imap_account>(host, port, user, pass);
+    weak = account;
+  }
+  return account;
+}
+
+void imap_account::disconnect() {
+  if (sockfd != -1) {
+    close(sockfd);
+    sockfd = -1;
+  }
+}
+
+void imap_account::login() {
+  char recvbuf[MAXDATASIZE];
+
+  if ((sockfd = endpoint->connect(MAIL_TIMEOUT)) == -1) {
+    throw mail_fail("Unable to connect to mail server: " + strerror_r(errno));
+  }
+
+  command(sockfd, "", recvbuf, "* OK");
+
+  std::ostringstream str;
+  str << "a1 login " << user << " {" << pass.length() << "}\r\n";
+  command(sockfd, str.str(), recvbuf, "+");
+  command(sockfd, pass + "\r\n", recvbuf, "a1 OK");
+}
+
+void imap_account::status_all() {
+  std::vector<folder *> tagged;
+  std::string request;
+
+  /* pipeline the commands, tagged s0, s1, ... */
+  for (auto &f : folders) {
+    request += "s" + std::to_string(tagged.size()) + " STATUS \"" + f.first +
+               "\" (MESSAGES UNSEEN)\r\n";
+    tagged.push_back(&f.second);
+  }
+  if (tagged.empty()) { return; }
+
+  if (send(sockfd, request.c_str(), request.length(), 0) == -1) {
+    throw mail_fail("send: " + strerror_r(errno));
+  }
+
+  const std::string last = "s" + std::to_string(tagged.size() - 1) + " ";
+  std::string response;
+  mail_result pending;
+  bool have_pending = false;
+  size_t done = 0;
+  while (done < tagged.size()) {
+    size_t eol;
+    while ((eol = response.find("\r\n")) == std::string::npos) {
+      struct timeval fetchtimeout {};
+      fd_set fdset;
+      char buf[MAXDATASIZE];
+
+      fetchtimeout.tv_sec = 60;
+      FD_ZERO(&fdset);
+      FD_SET(sockfd, &fdset);
+      if (select(sockfd + 1, &fdset, nullptr, nullptr, &fetchtimeout) <= 0) {
+        throw mail_fail("select: read timeout");
+      }
+      ssize_t n = recv(sockfd, buf, sizeof buf, 0);
+      if (n <= 0) { throw mail_fail("Unexpected response from server"); }
+      response.append(buf, n);
+    }
+    std::string line(response, 0, eol);
+    response.erase(0, eol + 2);
+    DBGP2("imap status received: %s", line.c_str());
+
+    size_t pos;
+    unsigned int tag;
+    if (line.compare(0, 9, "* STATUS ") == 0 &&
+        (pos = line.find("(MESSAGES ")) != std::string::npos) {
+      have_pending =
+          sscanf(line.c_str() + pos, "(MESSAGES %lu UNSEEN %lu",
+                 &pending.messages, &pending.unseen) == 2;
+    } else if (line.compare(0, 5, "* BYE") == 0) {
+      throw mail_fail("Server closed the connection");
+    } else if (sscanf(line.c_str(), "s%u ", &tag) == 1 && tag < tagged.size()) {
+      folder &f = *tagged[tag];
+      f.valid = have_pending && line.find(" OK") != std::string::npos;
+      if (f.valid) { f.status = pending; }
+      have_pending = false;
+      ++done;
+    }
+  }
+  ++round;
+}
+
+mail_result imap_account::status(const std::string &name,
+                                 unsigned long last_round) {
+  if (round == last_round || !folders[name].valid) {
+    /* the connection may have timed out while we weren't using it, so try
+     * a fresh one before giving up */
+    for (int attempt = 0;; ++attempt) {
+      try {
+        if (sockfd == -1) { login(); }
+        status_all();
+        break;
+      } catch (mail_fail &e) {
+        disconnect();
+        if (attempt > 0) { throw; }
+      }
+    }
+  }
+  folder &f = folders[name];
+  if (!f.valid) { throw mail_fail("STATUS failed for folder " + name); }
+  return f.status;
+}
+
+void imap_cb::work_shared() {
+  while (fail < retries) {
+    try {
+      std::lock_guard<std::mutex> lock(account->mutex);
+      mail_result status = account->status(get<MP_FOLDER>(), last_round);
+      last_round = account->round;
+      {
+        std::lock_guard<std::mutex> l(result_mutex);
+        result.messages = status.messages;
+        result.unseen = status.unseen;
+      }
+      unseen_command(last_unseen, last_messages);
+      last_unseen = result.unseen;
+      last_messages = result.messages;
+      fail = 0;
+      return;
+    } catch (mail_fail &e) {
+      ++fail;
+      NORM_ERR("Error while communicating with IMAP server: %s", e.what());
+      NORM_ERR("Trying IMAP connection again for %s@%s (try %u/%u)",
+               get<MP_USER>().c_str(), get<MP_HOST>().c_str(), fail + 1,
+               retries);
+      sleep(fail); /* sleep more for the more failures we have */
+    }
+
+    if (is_done()) { return; }
+  }
+}
+
 void imap_cb::work() {
   int sockfd, numbytes;
   char recvbuf[MAXDATASIZE];
@@ -722,13 +1057,16 @@ void imap_cb::work() {
   unsigned long old_messages = ULONG_MAX;
   bool has_idle = false;
 
+  if (account->folder_count() > 1) {
+    work_shared();
+    return;
+  }
+
   while (fail < retries) {
     struct timeval fetchtimeout {};
     int res;
     fd_set fdset;
 
-    if (ai == nullptr) { resolve_host(); }
-
     try {
       sockfd = connect();
 
@@ -873,8 +1211,6 @@ void imap_cb::work() {
       }
     } catch (mail_fail &e) {
       if (sockfd != -1) { close(sockfd); }
-      freeaddrinfo(ai);
-      ai = nullptr;
 
       ++fail;
       if (*e.what() != 0) {
@@ -898,7 +1234,7 @@ void print_imap_unseen(struct text_object *obj, char *p,
 
   auto cb = conky::register_cb<imap_cb>(mail->period, *mail, mail->retries);
 
-  snprintf(p, p_max_size, "%lu", cb->get_result_copy().unseen);
+  snprintf(p, p_max_size, "%lu", cb->read_result().unseen);
 }
 
 void print_imap_messages(struct text_object *obj, char *p,
@@ -909,7 +1245,7 @@ void print_imap_messages(struct text_object *obj, char *p,
 
   auto cb = conky::register_cb<imap_cb>(mail->period, *mail, mail->retries);
 
-  snprintf(p, p_max_size, "%lu", cb->get_result_copy().messages);
+  snprintf(p, p_max_size, "%lu", cb->read_result().messages);
 }
 
 void pop3_cb::work() {
@@ -919,8 +1255,6 @@ void pop3_cb::work() {
   unsigned long old_unseen = ULONG_MAX;
 
   while (fail < retries) {
-    if (ai == nullptr) { resolve_host(); }
-
     try {
       sockfd = connect();
 
@@ -946,8 +1280,6 @@ void pop3_cb::work() {
       return;
     } catch (mail_fail &e) {
       if (sockfd != -1) { close(sockfd); }
-      freeaddrinfo(ai);
-      ai = nullptr;
 
       ++fail;
       if (*e.what() != 0) {
@@ -971,7 +1303,7 @@ void print_pop3_unseen(struct text_object *obj, char *p,
 
   auto cb = conky::register_cb<pop3_cb>(mail->period, *mail, mail->retries);
 
-  snprintf(p, p_max_size, "%lu", cb->get_result_copy().unseen);
+  snprintf(p, p_max_size, "%lu", cb->read_result().unseen);
 }
 
 void print_pop3_used(struct text_object *obj, char *p,
@@ -982,5 +1314,5 @@ void print_pop3_used(struct text_object *obj, char *p,
 
   auto cb = conky::register_cb<pop3_cb>(mail->period, *mail, mail->retries);
 
-  snprintf(p, p_max_size, "%.1f", cb->get_result_copy().used / 1024.0 / 1024.0);
+  snprintf(p, p_max_size, "%.1f", cb->read_result().used / 1024.0 / 1024.0);
 }
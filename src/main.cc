@@ -35,6 +35,9 @@
 #include "conky.h"
 #include "display-output.hh"
 #include "lua-config.hh"
+#include "profiling.hh"
+#include "session-capture.hh"
+#include "shared-info.hh"
 
 #ifdef BUILD_X11
 #include "x11.h"
@@ -110,6 +113,9 @@ static void print_version() {
 #ifdef BUILD_NVIDIA
             << _("  * nvidia\n")
 #endif /* BUILD_NVIDIA */
+#ifdef BUILD_NVML
+            << _("  * nvidia (NVML)\n")
+#endif /* BUILD_NVML */
 #ifdef BUILD_BUILTIN_CONFIG
             << _("  * builtin default configuration\n")
 #endif /* BUILD_BUILTIN_CONFIG */
@@ -163,12 +169,18 @@ static void print_version() {
 #ifdef BUILD_XINERAMA
             << _("  * Xinerama extension (virtual display)\n")
 #endif /* BUILD_XINERAMA */
+#ifdef BUILD_XRANDR
+            << _("  * XRandR extension (screen changes)\n")
+#endif /* BUILD_XRANDR */
 #ifdef BUILD_XSHAPE
             << _("  * Xshape extension (click through)\n")
 #endif /* BUILD_XSHAPE */
 #ifdef BUILD_XDBE
             << _("  * XDBE (double buffer extension)\n")
 #endif /* BUILD_XDBE */
+#ifdef BUILD_XDPMS
+            << _("  * DPMS (monitor power)\n")
+#endif /* BUILD_XDPMS */
 #ifdef BUILD_XFT
             << _("  * Xft\n")
 #endif /* BUILD_XFT */
@@ -251,7 +263,23 @@ static void print_help(const char *prog_name) {
          "   -i COUNT                  number of times to update " PACKAGE_NAME
          " (and quit)\n"
          "   -p, --pause=SECS          pause for SECS seconds at startup "
-         "before doing anything\n",
+         "before doing anything\n"
+         "       --startup-profile     print how long each phase of startup "
+         "takes\n"
+         "       --trace[=FILE]        trace each stage, callback and flush, "
+         "SIGUSR2 writes\n"
+         "                             the trace to FILE\n"
+         "       --record=DIR          copy the /proc and /sys files read on "
+         "every update into DIR\n"
+         "       --replay=DIR          read the files recorded in DIR instead "
+         "of the system's\n"
+         "       --bench=N             run N updates without waiting or "
+         "drawing, then print\n"
+         "                             how long each stage took\n"
+         "       --collector[=NAME]    collect system information for clients "
+         "too\n"
+         "       --client[=NAME]       use what a collector collects, if one "
+         "runs\n",
          prog_name);
 }
 
@@ -276,19 +304,9 @@ int main(int argc, char **argv) {
   g_sighup_pending = 0;
   g_sigusr2_pending = 0;
 
-#ifdef BUILD_CURL
-  struct curl_global_initializer {
-    curl_global_initializer() {
-      if (curl_global_init(CURL_GLOBAL_ALL)) {
-        NORM_ERR(
-            "curl_global_init() failed, you may not be able to use curl "
-            "variables");
-      }
-    }
-    ~curl_global_initializer() { curl_global_cleanup(); }
-  };
-  curl_global_initializer curl_global;
-#endif
+  conky::shared_info_mode shared_mode = conky::shared_info_mode::none;
+  std::string shared_name;
+  std::string record_dir, replay_dir;
 
   /* handle command line parameters that don't change configs */
 #ifdef BUILD_X11
@@ -312,6 +330,24 @@ int main(int argc, char **argv) {
       case 'c':
         current_config = optarg;
         break;
+      case OPT_STARTUP_PROFILE:
+        conky::profile::enable_startup_profile();
+        break;
+      case OPT_TRACE:
+        conky::profile::enable_tracing(optarg != nullptr ? optarg : "");
+        break;
+      case OPT_RECORD:
+        record_dir = optarg;
+        break;
+      case OPT_REPLAY:
+        replay_dir = optarg;
+        break;
+      case OPT_COLLECTOR:
+      case OPT_CLIENT:
+        shared_mode = c == OPT_COLLECTOR ? conky::shared_info_mode::collector
+                                         : conky::shared_info_mode::client;
+        shared_name = optarg != nullptr ? optarg : "";
+        break;
       case 'q':
         if (freopen("/dev/null", "w", stderr) == nullptr) {
           CRIT_ERR(nullptr, nullptr, "could not open /dev/null as stderr!");
@@ -339,12 +375,21 @@ int main(int argc, char **argv) {
   try {
     set_current_config();
 
+    if (!replay_dir.empty()) {
+      conky::start_replay(replay_dir);
+    } else if (!record_dir.empty()) {
+      conky::start_recording(record_dir);
+    }
+
     state = std::make_unique<lua::state>();
 
     conky::export_symbols(*state);
+    conky::profile::startup_mark("lua");
 
     setup_inotify();
 
+    conky::open_shared_info(shared_mode, shared_name);
+
     initialisation(argc, argv);
 
     first_pass = 0; /* don't ever call fork() again */
@@ -357,13 +402,16 @@ int main(int argc, char **argv) {
   } catch (obj_create_error &e) {
     std::cerr << e.what() << std::endl;
     clean_up(nullptr, nullptr);
+    conky::close_shared_info();
     return EXIT_FAILURE;
   } catch (std::exception &e) {
     std::cerr << PACKAGE_NAME ": " << e.what() << std::endl;
+    conky::close_shared_info();
     return EXIT_FAILURE;
   }
 
   conky::shutdown_display_outputs();
+  conky::close_shared_info();
 
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
   kvm_close(kd);
@@ -30,7 +30,10 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <cerrno>
+#include <cstdio>
+#include <deque>
 #include <memory>
+#include <string>
 #include "conky.h"
 #include "logging.h"
 #include "mail.h"
@@ -41,13 +44,24 @@
 #define PRINT_MAILS 5
 #define TIME_DELAY 5
 
-struct ring_list {
-  char *from;
-  char *subject;
-  struct ring_list *previous;
-  struct ring_list *next;
+struct mbox_message {
+  std::string from;
+  std::string subject;
 };
 
+/* what a scan leaves behind, so the next one can continue from the end of
+ * the mbox instead of starting over when mail is only appended */
+struct mbox_index {
+  std::deque<mbox_message> messages; /* the last unread ones, newest last */
+  off_t offset{0};                   /* end of the last complete line */
+  bool in_body{true};
+  ino_t inode{0};
+  off_t last_from_offset{-1}; /* where the newest "From " line starts */
+  std::string last_from_line;
+};
+
+static mbox_index mbox_idx;
+
 static time_t last_ctime; /* needed for mutt at least */
 static time_t last_mtime; /* not sure what to test: testing both now */
 static double last_update;
@@ -61,12 +75,11 @@ static int time_delay;
 static char mbox_mail_spool[DEFAULT_TEXT_BUFFER_SIZE];
 
 static void mbox_scan(char *args, char *output, size_t max_len) {
-  int i, u, flag;
+  int i;
   int force_rescan = 0;
   std::unique_ptr<char[]> buf_(new char[text_buffer_size.get(*state)]);
   char *buf = buf_.get();
   struct stat statbuf {};
-  struct ring_list *curr = nullptr, *prev = nullptr, *startlist = nullptr;
   FILE *fp;
 
   /* output was set to 1 after malloc'ing in conky.c */
@@ -179,185 +192,111 @@ static void mbox_scan(char *args, char *output, size_t max_len) {
   last_ctime = statbuf.st_ctime;
   last_mtime = statbuf.st_mtime;
 
-  /* build up double-linked ring-list to hold data, while scanning down the
-   * mbox */
-  for (i = 0; i < print_num_mails; i++) {
-    curr = static_cast<struct ring_list *>(malloc(sizeof(struct ring_list)));
-    curr->from = static_cast<char *>(malloc(from_width + 1));
-    curr->subject = static_cast<char *>(malloc(subject_width + 1));
-    curr->from[0] = '\0';
-    curr->subject[0] = '\0';
-
-    if (i == 0) { startlist = curr; }
-    if (i > 0) {
-      curr->previous = prev;
-      prev->next = curr;
-    }
-    prev = curr;
-  }
-
-  if (startlist == nullptr) { return; }
-  /* connect end to start for an endless loop-ring */
-  startlist->previous = curr;
-  curr->next = startlist;
+  bool incremental = force_rescan == 0 && statbuf.st_ino == mbox_idx.inode &&
+                     statbuf.st_size > mbox_idx.offset &&
+                     mbox_idx.last_from_offset >= 0;
 
   /* mbox */
   fp = fopen(mbox_mail_spool, "re");
   if (fp == nullptr) { return; }
 
-  /* first find a "From " to set it to 0 for header-sarchings */
-  flag = 1;
-  while (feof(fp) == 0) {
-    if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-
-    if (strncmp(buf, "From ", 5) == 0) {
-      curr = curr->next;
+  char *line = nullptr;
+  size_t line_size = 0;
+  ssize_t len;
 
-      /* skip until \n */
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
+  /* anything but an append (the newest "From " line is no longer where it
+   * was, e.g. because a message was marked read) needs a full scan */
+  if (incremental) {
+    incremental =
+        fseeko(fp, mbox_idx.last_from_offset, SEEK_SET) == 0 &&
+        getline(&line, &line_size, fp) > 0 && mbox_idx.last_from_line == line;
+  }
+  if (!incremental) {
+    mbox_idx = mbox_index();
+    mbox_idx.inode = statbuf.st_ino;
+  }
+  fseeko(fp, mbox_idx.offset, SEEK_SET);
+
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    /* a line still being written is picked up by the next scan */
+    if (line[len - 1] != '\n') { break; }
+    off_t line_offset = mbox_idx.offset;
+    mbox_idx.offset += len;
+
+    if (strncmp(line, "From ", 5) == 0) {
+      mbox_idx.messages.emplace_back();
+      if (mbox_idx.messages.size() > static_cast<size_t>(print_num_mails)) {
+        mbox_idx.messages.pop_front();
       }
-
-      flag = 0; /* in the headers now */
+      mbox_idx.last_from_offset = line_offset;
+      mbox_idx.last_from_line = line;
+      mbox_idx.in_body = false; /* in the headers now */
       continue;
     }
 
-    if (flag == 1) { /* in the body, so skip */
-      continue;
-    }
+    if (mbox_idx.in_body) { continue; }
 
-    if (buf[0] == '\n') {
-      /* beyond the headers now (empty line), skip until \n */
-      /* then search for new mail ("From ") */
-
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-      }
-      flag = 1; /* in the body now */
+    if (line[0] == '\n') {
+      /* beyond the headers now (empty line), search for new mail ("From ") */
+      mbox_idx.in_body = true;
       continue;
     }
 
-    if ((strncmp(buf, "X-Status: ", 10) == 0) ||
-        (strncmp(buf, "Status: R", 9) == 0)) {
+    if ((strncmp(line, "X-Status: ", 10) == 0) ||
+        (strncmp(line, "Status: R", 9) == 0)) {
       /* Mail was read or something, so skip that message */
-      flag = 1; /* search for next From */
-      curr->subject[0] = '\0';
-      curr->from[0] = '\0';
-      /* (will get current again on new 'From ' finding) */
-      curr = curr->previous;
-      /* Skip until \n */
-      while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-        if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) { break; }
-      }
+      mbox_idx.in_body = true; /* search for next From */
+      mbox_idx.messages.pop_back();
       continue;
     }
 
-    /* that covers ^From: and ^from: ^From:<tab> */
-    if (strncmp(buf + 1, "rom:", 4) == 0) {
-      i = 0;
-      u = 6; /* no "From: " string needed, so skip */
-      while (1) {
-        if (buf[u] == '"') { /* no quotes around names */
-          u++;
-          continue;
-        }
+    mbox_message &curr = mbox_idx.messages.back();
 
+    /* that covers ^From: and ^from: ^From:<tab> */
+    if (strncmp(line + 1, "rom:", 4) == 0) {
+      curr.from.clear();
+      /* no "From: " string needed, so skip */
+      for (ssize_t u = 6; u < len; u++) {
+        if (line[u] == '"') { continue; } /* no quotes around names */
         /* some are: From: <foo@bar.com> */
-        if (buf[u] == '<' && i > 1) {
-          curr->from[i] = '\0';
-          /* skip until \n */
-          while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-            if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) {
-              break;
-            }
-          }
-          break;
-        }
-
-        if (buf[u] == '\n') {
-          curr->from[i] = '\0';
-          break;
-        }
-
-        if (buf[u] == '\0') {
-          curr->from[i] = '\0';
-          break;
-        }
-
-        if (i >= from_width) {
-          curr->from[i] = '\0';
-          /* skip until \n */
-          while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-            if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) {
-              break;
-            }
-          }
-          break;
-        }
-
-        /* nothing special so just set it */
-        curr->from[i++] = buf[u++];
+        if (line[u] == '<' && curr.from.size() > 1) { break; }
+        if (line[u] == '\n') { break; }
+        if (curr.from.size() >= static_cast<size_t>(from_width)) { break; }
+        curr.from += line[u];
       }
     }
 
     /* that covers ^Subject: and ^subject: and ^Subjec:<tab> */
-    if (strncmp(buf + 1, "ubject:", 7) == 0) {
-      i = 0;
-      u = 9; /* no "Subject: " string needed, so skip */
-      while (1) {
-        if (buf[u] == '\n') {
-          curr->subject[i] = '\0';
-          break;
-        }
-        if (buf[u] == '\0') {
-          curr->subject[i] = '\0';
-          break;
-        }
-        if (i >= subject_width) {
-          curr->subject[i] = '\0';
-
-          /* skip until \n */
-          while (strchr(buf, '\n') == nullptr && (feof(fp) == 0)) {
-            if (fgets(buf, text_buffer_size.get(*state), fp) == nullptr) {
-              break;
-            }
-          }
+    if (strncmp(line + 1, "ubject:", 7) == 0) {
+      curr.subject.clear();
+      /* no "Subject: " string needed, so skip */
+      for (ssize_t u = 9; u < len; u++) {
+        if (line[u] == '\n') { break; }
+        if (curr.subject.size() >= static_cast<size_t>(subject_width)) {
           break;
         }
-
-        /* nothing special so just set it */
-        curr->subject[i++] = buf[u++];
+        curr.subject += line[u];
       }
     }
   }
 
+  free(line);
   fclose(fp);
 
   output[0] = '\0';
 
-  i = print_num_mails;
-  while (i != 0) {
-    struct ring_list *tmp;
-    if (curr->from[0] != '\0') {
-      if (i != print_num_mails) {
-        snprintf(buf, text_buffer_size.get(*state), "\nF: %-*s S: %-*s",
-                 from_width, curr->from, subject_width, curr->subject);
-      } else { /* first time - no \n in front */
-        snprintf(buf, text_buffer_size.get(*state), "F: %-*s S: %-*s",
-                 from_width, curr->from, subject_width, curr->subject);
-      }
+  /* newest first, unused slots as empty lines */
+  auto it = mbox_idx.messages.rbegin();
+  for (i = 0; i < print_num_mails; i++) {
+    if (it != mbox_idx.messages.rend() && !it->from.empty()) {
+      snprintf(buf, text_buffer_size.get(*state), "%sF: %-*s S: %-*s",
+               i != 0 ? "\n" : "", from_width, it->from.c_str(),
+               subject_width, it->subject.c_str());
     } else {
       snprintf(buf, text_buffer_size.get(*state), "%s", "\n");
     }
-    strncat(output, buf, max_len - strlen(output));
-
-    tmp = curr->previous;
-    free(curr->from);
-    free(curr->subject);
-    free(curr);
-    curr = tmp;
-
-    i--;
+    if (it != mbox_idx.messages.rend()) { ++it; }
+    strncat(output, buf, max_len - strlen(output) - 1);
   }
 }
 
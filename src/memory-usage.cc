@@ -0,0 +1,221 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "memory-usage.hh"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include "config.h"
+#include "conky.h"
+#include "llua.h"
+#include "logging.h"
+#include "specials.h"
+#include "text_object.h"
+#include "top.h"
+#include "update-cb.hh"
+
+#if defined(HAVE_MALLOC_USABLE_SIZE) || defined(HAVE_MALLINFO2)
+#include <malloc.h>
+#endif
+
+#ifdef BUILD_GUI
+#include "fonts.h"
+#endif /* BUILD_GUI */
+#ifdef BUILD_IMLIB2
+#include "imlib2.h"
+#endif /* BUILD_IMLIB2 */
+
+namespace conky {
+namespace memory {
+
+namespace {
+enum part {
+  ALL = -1,
+  OBJECTS,
+  SPECIALS,
+  CALLBACKS,
+  LUA,
+  IMLIB2,
+  FONTS,
+  PROCESSES,
+  HEAP, /* the parts before this are in it */
+  RESIDENT,
+  PART_COUNT
+};
+
+/* the ${conky_mem} arguments, by part */
+const char *const part_names[PART_COUNT] = {
+    "objects", "specials",  "callbacks", "lua",     "imlib2",
+    "fonts",   "processes", "heap",      "resident"};
+
+size_t heap_in_use() {
+#ifdef HAVE_MALLINFO2
+  struct mallinfo2 mi = mallinfo2();
+  return mi.uordblks + mi.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+size_t resident_set() {
+#ifdef __linux__
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp == nullptr) { return 0; }
+  unsigned long size, resident;
+  int n = fscanf(fp, "%lu %lu", &size, &resident);
+  fclose(fp);
+  if (n != 2) { return 0; }
+  return static_cast<size_t>(resident) * sysconf(_SC_PAGESIZE);
+#else
+  return 0;
+#endif /* __linux__ */
+}
+
+size_t measure(part p, size_t *count) {
+  *count = 0;
+  switch (p) {
+    case OBJECTS:
+      return text_memory(count);
+    case SPECIALS:
+      return specials_memory(count);
+    case CALLBACKS:
+      return callbacks_memory(count);
+    case LUA:
+      return llua_memory();
+#ifdef BUILD_IMLIB2
+    case IMLIB2: {
+      size_t cache_limit;
+      return cimlib_memory(&cache_limit);
+    }
+#endif /* BUILD_IMLIB2 */
+#ifdef BUILD_GUI
+    case FONTS:
+      return fonts_memory(count);
+#endif /* BUILD_GUI */
+    case PROCESSES:
+      return process_table_memory(count);
+    case HEAP:
+      return heap_in_use();
+    case RESIDENT:
+      return resident_set();
+    default:
+      return 0;
+  }
+}
+
+std::string describe(const usage &u) {
+  char bytes[64];
+  human_readable(u.bytes, bytes, sizeof bytes);
+  std::string ret = std::string(u.name) + ": " + bytes;
+  if (u.count > 0) { ret += " (" + std::to_string(u.count) + ")"; }
+  return ret;
+}
+}  // namespace
+
+size_t allocated(const void *p) {
+#ifdef HAVE_MALLOC_USABLE_SIZE
+  return p != nullptr ? malloc_usable_size(const_cast<void *>(p)) : 0;
+#else
+  (void)p;
+  return 0;
+#endif
+}
+
+std::vector<usage> collect() {
+  std::vector<usage> ret;
+  for (int i = 0; i < PART_COUNT; ++i) {
+    usage u{part_names[i], 0, 0};
+    u.bytes = measure(static_cast<part>(i), &u.count);
+    ret.push_back(u);
+  }
+  return ret;
+}
+
+void dump(FILE *out) {
+  std::vector<usage> all = collect();
+  size_t parts = 0;
+
+  fprintf(out, "conky memory:\n");
+  for (int i = 0; i < PART_COUNT; ++i) {
+    fprintf(out, "  %s\n", describe(all[i]).c_str());
+    if (i < HEAP) { parts += all[i].bytes; }
+  }
+#ifdef BUILD_IMLIB2
+  size_t cache_limit;
+  cimlib_memory(&cache_limit);
+  fprintf(out, "  imlib2 may keep up to %zu bytes of decoded images\n",
+          cache_limit);
+#endif /* BUILD_IMLIB2 */
+  if (all[HEAP].bytes > parts) {
+    fprintf(out, "  %zu bytes of the heap are not accounted for\n",
+            all[HEAP].bytes - parts);
+  }
+}
+
+}  // namespace memory
+}  // namespace conky
+
+void parse_conky_mem_arg(struct text_object *obj, const char *arg) {
+  using namespace conky::memory;
+
+  obj->data.i = ALL;
+  if (arg == nullptr) { return; }
+
+  for (int i = 0; i < PART_COUNT; ++i) {
+    if (strcmp(arg, part_names[i]) == 0) {
+      obj->data.i = i;
+      return;
+    }
+  }
+  NORM_ERR(
+      "conky_mem: unknown argument '%s', use one of objects, specials, "
+      "callbacks, lua, imlib2, fonts, processes, heap or resident",
+      arg);
+}
+
+void print_conky_mem(struct text_object *obj, char *p,
+                     unsigned int p_max_size) {
+  using namespace conky::memory;
+
+  if (obj->data.i != ALL) {
+    size_t count;
+    human_readable(measure(static_cast<part>(obj->data.i), &count), p,
+                   p_max_size);
+    return;
+  }
+
+  std::string out;
+  for (const auto &u : collect()) {
+    if (!out.empty()) { out += '\n'; }
+    out += describe(u);
+  }
+  snprintf(p, p_max_size, "%s", out.c_str());
+}
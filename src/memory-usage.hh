@@ -0,0 +1,69 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MEMORY_USAGE_HH
+#define MEMORY_USAGE_HH
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+struct text_object;
+
+namespace conky {
+namespace memory {
+
+/* the size of the block p points to if the C library can tell, else 0; p
+ * must be null or come from malloc() */
+size_t allocated(const void *p);
+
+/* what one part of conky holds */
+struct usage {
+  const char *name;
+  size_t bytes;
+  size_t count; /* of the things it is made of, 0 if that means nothing */
+};
+
+/*
+ * The memory held by each part of conky that keeps data around, then the
+ * malloc() heap in use and the resident set of the process where the
+ * platform tells them. The parts are estimates, from what the containers
+ * and the C library show, so they add up to less than the heap.
+ */
+std::vector<usage> collect();
+
+/* print collect() */
+void dump(FILE *out);
+
+}  // namespace memory
+}  // namespace conky
+
+void parse_conky_mem_arg(struct text_object *, const char *);
+void print_conky_mem(struct text_object *, char *, unsigned int);
+
+#endif /* MEMORY_USAGE_HH */
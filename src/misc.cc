@@ -36,53 +36,32 @@
 #include <unistd.h>
 #include "conky.h"
 #include "core.h"
+#include "file-watch.hh"
 #include "logging.h"
 #include "specials.h"
 #include "text_object.h"
 
-static inline void read_file(const char *data, char *buf, const int size) {
-  FILE *fp;
+/* the start of the file without its final newline */
+static inline std::string read_file(struct text_object *obj,
+                                    const unsigned int size) {
+  conky::watched_file *file = get_watched_file(obj);
 
-  memset(buf, 0, size);
+  if (file == nullptr || size == 0) return std::string();
 
-  if (!data) return;
-
-  fp = fopen(data, "r");
-  if (fp) {
-    int length;
-
-    length = fread(buf, 1, size - 1, fp);
-    fclose(fp);
-    buf[length] = '\0';
-    if (length > 0 && buf[length - 1] == '\n') { buf[length - 1] = '\0'; }
-  } else {
-    buf[0] = '\0';
-  }
-}
-
-static inline unsigned int file_buffer_size(const char *data,
-                                            const unsigned int maxsize) {
-  struct stat buf;
-  if (stat(data, &buf)) return maxsize;
-  if (buf.st_size < 0 || buf.st_size > maxsize) return maxsize;
-  if (buf.st_size < 10) return 10;
-  return buf.st_size + 1;
+  std::string text = file->head(size - 1);
+  if (!text.empty() && text.back() == '\n') { text.pop_back(); }
+  return text;
 }
 
 void print_cat(struct text_object *obj, char *p, unsigned int p_max_size) {
-  read_file(obj->data.s, p, p_max_size);
+  if (p_max_size == 0) return;
+  snprintf(p, p_max_size, "%s", read_file(obj, p_max_size).c_str());
 }
 
 void print_catp(struct text_object *obj, char *p, unsigned int p_max_size) {
-  const unsigned int sz =
-      file_buffer_size(obj->data.s, text_buffer_size.get(*state));
-  char *buf = new char[sz];
-
-  read_file(obj->data.s, buf, sz);
-
-  evaluate(buf, p, p_max_size);
+  std::string text = read_file(obj, text_buffer_size.get(*state));
 
-  delete[] buf;
+  evaluate(text.c_str(), p, p_max_size);
 }
 
 void print_startcase(struct text_object *obj, char *p,
@@ -77,17 +77,34 @@ int mixer_init(const char *name) {
   return -1;
 }
 
+/* Each channel is read at most once per update, however many objects show
+ * it; OSS can't tell when a volume changed, so it still has to be read. */
 static int mixer_get(int i) {
   static char rep = 0;
+  static int values[SOUND_MIXER_NRDEVICES];
+  static double read_at[SOUND_MIXER_NRDEVICES];
+  static bool initialised = false;
   int val = -1;
 
+  if (!initialised) {
+    for (double &t : read_at) { t = -1; }
+    initialised = true;
+  }
+  bool cached = i >= 0 && i < SOUND_MIXER_NRDEVICES;
+  if (cached && read_at[i] == current_update_time) { return values[i]; }
+
   if (ioctl(mixer_fd, MIXER_READ(i), &val) == -1) {
     if (!rep) { NORM_ERR("mixer ioctl: %s", strerror(errno)); }
     rep = 1;
-    return 0;
+    val = 0;
+  } else {
+    rep = 0;
   }
-  rep = 0;
 
+  if (cached) {
+    values[i] = val;
+    read_at[i] = current_update_time;
+  }
   return val;
 }
 
@@ -24,6 +24,11 @@
 #include "logging.h"
 #include "text_object.h"
 
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
 #include <cmath>
 #include <cstdio>
 #include <cstdlib>
@@ -32,6 +37,8 @@
 
 #include "update-cb.hh"
 
+extern char **environ;
+
 namespace {
 struct moc_result {
   std::string state;
@@ -50,57 +57,98 @@ struct moc_result {
 class moc_cb : public conky::callback<moc_result> {
   using Base = conky::callback<moc_result>;
 
+  /* output of the last mocp -i, reused so reading it doesn't allocate once it
+   * is big enough */
+  std::string output;
+
+  bool run_mocp();
+
  protected:
   void work() override;
 
  public:
-  explicit moc_cb(uint32_t period) : Base(period, false, Tuple()) {}
+  explicit moc_cb(double period) : Base(period, false, Tuple()) {}
 };
 
+/* Runs mocp -i, leaving what it printed in output. mocp is started directly
+ * instead of through popen()'s shell, which saves a fork and an exec on each
+ * update. Returns false if mocp couldn't be started. */
+bool moc_cb::run_mocp() {
+  char *argv[] = {const_cast<char *>("mocp"), const_cast<char *>("-i"),
+                  nullptr};
+  int ends[2];
+  pid_t child;
+
+  if (pipe2(ends, O_CLOEXEC) != 0) { return false; }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  // the dup2()ed descriptor has close-on-exec turned off
+  posix_spawn_file_actions_adddup2(&actions, ends[1], 1);
+  posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+  int err = posix_spawnp(&child, argv[0], &actions, nullptr, argv, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  close(ends[1]);
+
+  if (err != 0) {
+    close(ends[0]);
+    return false;
+  }
+
+  output.clear();
+  for (;;) {
+    char buf[1024];
+    ssize_t n = read(ends[0], buf, sizeof(buf));
+    if (n > 0) {
+      output.append(buf, n);
+    } else if (n == 0 || errno != EINTR) {
+      break;
+    }
+  }
+  close(ends[0]);
+  while (waitpid(child, nullptr, 0) == -1 && errno == EINTR) {}
+  return true;
+}
+
 void moc_cb::work() {
   moc_result moc;
-  FILE *fp;
 
-  fp = popen("mocp -i", "r");
-  if (fp == nullptr) {
+  if (!run_mocp()) {
     moc.state = "Can't run 'mocp -i'";
-  } else {
-    while (1) {
-      char line[100];
-      char *p;
-
-      /* Read a line from the pipe and strip the possible '\n'. */
-      if (fgets(line, 100, fp) == nullptr) { break; }
-      if ((p = strrchr(line, '\n')) != nullptr) { *p = '\0'; }
-
-      /* Parse infos. */
-      if (strncmp(line, "State:", 6) == 0) {
-        moc.state = line + 7;
-      } else if (strncmp(line, "File:", 5) == 0) {
-        moc.file = line + 6;
-      } else if (strncmp(line, "Title:", 6) == 0) {
-        moc.title = line + 7;
-      } else if (strncmp(line, "Artist:", 7) == 0) {
-        moc.artist = line + 8;
-      } else if (strncmp(line, "SongTitle:", 10) == 0) {
-        moc.song = line + 11;
-      } else if (strncmp(line, "Album:", 6) == 0) {
-        moc.album = line + 7;
-      } else if (strncmp(line, "TotalTime:", 10) == 0) {
-        moc.totaltime = line + 11;
-      } else if (strncmp(line, "TimeLeft:", 9) == 0) {
-        moc.timeleft = line + 10;
-      } else if (strncmp(line, "CurrentTime:", 12) == 0) {
-        moc.curtime = line + 13;
-      } else if (strncmp(line, "Bitrate:", 8) == 0) {
-        moc.bitrate = line + 9;
-      } else if (strncmp(line, "Rate:", 5) == 0) {
-        moc.rate = line + 6;
-      }
-    }
+    output.clear();
   }
 
-  pclose(fp);
+  for (size_t start = 0, end; start < output.size(); start = end + 1) {
+    end = output.find('\n', start);
+    if (end == std::string::npos) { end = output.size(); }
+    output[end] = '\0';
+    const char *line = &output[start];
+
+    /* Parse infos. */
+    if (strncmp(line, "State:", 6) == 0) {
+      moc.state = line + 7;
+    } else if (strncmp(line, "File:", 5) == 0) {
+      moc.file = line + 6;
+    } else if (strncmp(line, "Title:", 6) == 0) {
+      moc.title = line + 7;
+    } else if (strncmp(line, "Artist:", 7) == 0) {
+      moc.artist = line + 8;
+    } else if (strncmp(line, "SongTitle:", 10) == 0) {
+      moc.song = line + 11;
+    } else if (strncmp(line, "Album:", 6) == 0) {
+      moc.album = line + 7;
+    } else if (strncmp(line, "TotalTime:", 10) == 0) {
+      moc.totaltime = line + 11;
+    } else if (strncmp(line, "TimeLeft:", 9) == 0) {
+      moc.timeleft = line + 10;
+    } else if (strncmp(line, "CurrentTime:", 12) == 0) {
+      moc.curtime = line + 13;
+    } else if (strncmp(line, "Bitrate:", 8) == 0) {
+      moc.bitrate = line + 9;
+    } else if (strncmp(line, "Rate:", 5) == 0) {
+      moc.rate = line + 6;
+    }
+  }
 
   std::lock_guard<std::mutex> l(result_mutex);
   result = moc;
@@ -111,11 +159,9 @@ void moc_cb::work() {
   void print_moc_##type(struct text_object *obj, char *p,                     \
                         unsigned int p_max_size) {                            \
     (void)obj;                                                                \
-    uint32_t period = std::max(                                               \
-        lround(music_player_interval.get(*state) / active_update_interval()), \
-        1l);                                                                  \
+    double period = music_player_interval.get(*state);                        \
     const moc_result &moc =                                                   \
-        conky::register_cb<moc_cb>(period)->get_result_copy();                \
+        conky::register_cb<moc_cb>(period)->read_result();                    \
     snprintf(p, p_max_size, "%s",                                             \
              (moc.type.length() ? moc.type.c_str() : (alt)));                 \
   }
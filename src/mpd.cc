@@ -26,15 +26,25 @@
  *
  */
 
+#include "config.h"
+
 #include "mpd.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
 #include <cmath>
 #include <mutex>
+#include "c++wrap.hh"
 #include "conky.h"
 #include "libmpdclient.h"
 #include "logging.h"
+#include "reactor.hh"
 #include "timeinfo.h"
 #include "update-cb.hh"
 
+extern double next_update_time;
+
 namespace {
 
 /* this is true if the current host was set from MPD_HOST */
@@ -113,9 +123,7 @@ mpd_host_setting mpd_host;
 mpd_password_setting mpd_password;
 
 struct mpd_result {
-  float progress{};
   int bitrate{};
-  int elapsed{};
   int is_playing{};
   int length{};
   int vol{};
@@ -131,180 +139,292 @@ struct mpd_result {
   std::string status;
   std::string title;
   std::string track;
+
+  /* elapsed seconds as precise as mpd sent them, when they were read and
+   * whether they keep running, so that the time and progress shown between
+   * two reads can be worked out locally */
+  double position{};
+  double sampled{};
+  bool advancing{};
 };
 
+/* the mpd objects only show what these report changes for */
+const char mpd_idle_subsystems[] = "player mixer options";
+
+/* Keeps a connection to mpd open and waits for it to report changes with the
+ * idle command, so the objects are refreshed as soon as something happens and
+ * music_player_interval only governs reconnecting. With an mpd too old for
+ * idle, the status is read once per interval instead. */
 class mpd_cb : public conky::callback<mpd_result> {
   using Base = conky::callback<mpd_result>;
 
   mpd_Connection *conn;
+  bool can_idle;
+
+  /* written by the worker to make the main loop update right away */
+  std::pair<int, int> wakefd;
+
+  bool connect();
+  void disconnect();
+  bool read_status(mpd_result &info);
+  bool read_song(mpd_result &info);
+  bool wait_for_changes(bool &song_changed);
+  void deliver(const mpd_result &info);
 
  protected:
   void work() override;
 
  public:
-  explicit mpd_cb(uint32_t period)
-      : Base(period, false, Tuple()), conn(nullptr) {}
+  explicit mpd_cb(double period)
+      : Base(period, false, Tuple(), true),
+        conn(nullptr),
+        can_idle(false),
+        wakefd(pipe2(O_CLOEXEC | O_NONBLOCK)) {
+    conky::main_reactor().add(wakefd.first, [this] {
+      char buf[64];
+      while (read(wakefd.first, buf, sizeof buf) > 0) {}
+      next_update_time = get_time();
+    });
+  }
 
   ~mpd_cb() override {
+    conky::main_reactor().remove(wakefd.first);
+    close(wakefd.first);
+    close(wakefd.second);
     if (conn != nullptr) { mpd_closeConnection(conn); }
   }
 };
 
-void mpd_cb::work() {
-  mpd_Status *status;
-  mpd_InfoEntity *entity;
-  mpd_result mpd_info;
+bool mpd_cb::connect() {
+  conn = mpd_newConnection(mpd_host.get(*state).c_str(), mpd_port.get(*state),
+                           10);
 
-  do {
-    if (conn == nullptr) {
-      conn = mpd_newConnection(mpd_host.get(*state).c_str(),
-                               mpd_port.get(*state), 10);
-    }
+  /* the password holds for as long as the connection does */
+  if (conn->error == 0 && !mpd_password.get(*state).empty()) {
+    mpd_sendPasswordCommand(conn, mpd_password.get(*state).c_str());
+    mpd_finishCommand(conn);
+  }
 
-    if (static_cast<unsigned int>(!mpd_password.get(*state).empty()) != 0u) {
-      mpd_sendPasswordCommand(conn, mpd_password.get(*state).c_str());
-      mpd_finishCommand(conn);
-    }
+  if (conn->error != 0) {
+    NORM_ERR("MPD error: %s\n", conn->errorStr);
+    disconnect();
+    return false;
+  }
 
-    if (conn->error != 0) {
-      NORM_ERR("MPD error: %s\n", conn->errorStr);
-      mpd_closeConnection(conn);
-      conn = nullptr;
+  /* idle came with protocol version 0.14 */
+  can_idle = conn->version[0] > 0 || conn->version[1] >= 14;
+  return true;
+}
 
-      mpd_info.status = "MPD not responding";
-      break;
-    }
+void mpd_cb::disconnect() {
+  mpd_closeConnection(conn);
+  conn = nullptr;
+}
 
-    mpd_sendStatusCommand(conn);
-    if ((status = mpd_getStatus(conn)) == nullptr) {
-      NORM_ERR("MPD error: %s\n", conn->errorStr);
-      mpd_closeConnection(conn);
-      conn = nullptr;
+bool mpd_cb::read_status(mpd_result &info) {
+  mpd_Status *status;
+
+  mpd_sendStatusCommand(conn);
+  if ((status = mpd_getStatus(conn)) == nullptr) { return false; }
+  mpd_finishCommand(conn);
+  if (conn->error != 0) {
+    mpd_freeStatus(status);
+    return false;
+  }
+
+  info.vol = status->volume;
+  if (status->random == 0) {
+    info.random = "Off";
+  } else if (status->random == 1) {
+    info.random = "On";
+  } else {
+    info.random = "";
+  }
+  if (status->repeat == 0) {
+    info.repeat = "Off";
+  } else if (status->repeat == 1) {
+    info.repeat = "On";
+  } else {
+    info.repeat = "";
+  }
 
-      mpd_info.status = "MPD not responding";
+  switch (status->state) {
+    case MPD_STATUS_STATE_PLAY:
+      info.status = "Playing";
       break;
-    }
-    mpd_finishCommand(conn);
-    if ((conn == nullptr) || (conn->error != 0)) {
-      // fprintf(stderr, "%s\n", conn->errorStr);
-      mpd_closeConnection(conn);
-      conn = nullptr;
+    case MPD_STATUS_STATE_STOP:
+      info.status = "Stopped";
       break;
-    }
-
-    mpd_info.vol = status->volume;
-    if (status->random == 0) {
-      mpd_info.random = "Off";
-    } else if (status->random == 1) {
-      mpd_info.random = "On";
-    } else {
-      mpd_info.random = "";
-    }
-    if (status->repeat == 0) {
-      mpd_info.repeat = "Off";
-    } else if (status->repeat == 1) {
-      mpd_info.repeat = "On";
-    } else {
-      mpd_info.repeat = "";
-    }
-    /* if (status->error) {
-       printf("error: %s\n", status->error);
-       } */
-
-    switch (status->state) {
-      case MPD_STATUS_STATE_PLAY:
-        mpd_info.status = "Playing";
-        break;
-      case MPD_STATUS_STATE_STOP:
-        mpd_info.status = "Stopped";
-        break;
-      case MPD_STATUS_STATE_PAUSE:
-        mpd_info.status = "Paused";
-        break;
-      default:
-        mpd_info.status = "";
-        break;
-    }
+    case MPD_STATUS_STATE_PAUSE:
+      info.status = "Paused";
+      break;
+    default:
+      info.status = "";
+      break;
+  }
 
-    if (status->state == MPD_STATUS_STATE_PLAY ||
-        status->state == MPD_STATUS_STATE_PAUSE) {
-      mpd_info.is_playing = 1;
-      mpd_info.bitrate = status->bitRate;
-      mpd_info.progress =
-          ((0 != status->totalTime)
-               ? static_cast<float>(status->elapsedTime) / status->totalTime
-               : 0.0);
-      mpd_info.elapsed = status->elapsedTime;
-      mpd_info.length = status->totalTime;
-    } else {
-      mpd_info.progress = 0;
-      mpd_info.is_playing = 0;
-      mpd_info.elapsed = 0;
-    }
+  info.sampled = get_time();
+  info.advancing = status->state == MPD_STATUS_STATE_PLAY;
+  if (status->state == MPD_STATUS_STATE_PLAY ||
+      status->state == MPD_STATUS_STATE_PAUSE) {
+    info.is_playing = 1;
+    info.bitrate = status->bitRate;
+    info.position =
+        status->elapsed >= 0 ? status->elapsed : status->elapsedTime;
+    info.length = status->totalTime;
+  } else {
+    info.is_playing = 0;
+    info.position = 0;
+  }
 
-    if (conn->error != 0) {
-      // fprintf(stderr, "%s\n", conn->errorStr);
-      mpd_closeConnection(conn);
-      conn = nullptr;
-      break;
-    }
+  mpd_freeStatus(status);
+  return true;
+}
 
-    mpd_sendCurrentSongCommand(conn);
-    while ((entity = mpd_getNextInfoEntity(conn)) != nullptr) {
-      mpd_Song *song = entity->info.song;
+bool mpd_cb::read_song(mpd_result &info) {
+  mpd_InfoEntity *entity;
 
-      if (entity->type != MPD_INFO_ENTITY_TYPE_SONG) {
-        mpd_freeInfoEntity(entity);
-        continue;
-      }
+  /* nothing comes back when there is no current song */
+  info.album.clear();
+  info.albumartist.clear();
+  info.artist.clear();
+  info.comment.clear();
+  info.date.clear();
+  info.file.clear();
+  info.name.clear();
+  info.title.clear();
+  info.track.clear();
+
+  mpd_sendCurrentSongCommand(conn);
+  while ((entity = mpd_getNextInfoEntity(conn)) != nullptr) {
+    mpd_Song *song = entity->info.song;
+
+    if (entity->type != MPD_INFO_ENTITY_TYPE_SONG) {
+      mpd_freeInfoEntity(entity);
+      continue;
+    }
 #define SETSTRING(a, b) \
   if (b)                \
     (a) = b;            \
   else                  \
     (a) = "";
-      SETSTRING(mpd_info.album, song->album);
-      SETSTRING(mpd_info.albumartist, song->albumartist);
-      SETSTRING(mpd_info.artist, song->artist);
-      SETSTRING(mpd_info.comment, song->comment);
-      SETSTRING(mpd_info.date, song->date);
-      SETSTRING(mpd_info.file, song->file);
-      SETSTRING(mpd_info.name, song->name);
-      SETSTRING(mpd_info.title, song->title);
-      SETSTRING(mpd_info.track, song->track);
-      if (entity != nullptr) {
-        mpd_freeInfoEntity(entity);
-        entity = nullptr;
-      }
+    SETSTRING(info.album, song->album);
+    SETSTRING(info.albumartist, song->albumartist);
+    SETSTRING(info.artist, song->artist);
+    SETSTRING(info.comment, song->comment);
+    SETSTRING(info.date, song->date);
+    SETSTRING(info.file, song->file);
+    SETSTRING(info.name, song->name);
+    SETSTRING(info.title, song->title);
+    SETSTRING(info.track, song->track);
+#undef SETSTRING
+    mpd_freeInfoEntity(entity);
+  }
+  mpd_finishCommand(conn);
+  return conn->error == 0;
+}
+
+/* Blocks until mpd reports a change in mpd_idle_subsystems, setting
+ * song_changed if the current song may be a different one. Returns false if
+ * the callback is being stopped or the connection can't idle. */
+bool mpd_cb::wait_for_changes(bool &song_changed) {
+  mpd_sendIdleCommand(conn, mpd_idle_subsystems);
+  if (conn->error != 0) {
+    NORM_ERR("MPD error: %s\n", conn->errorStr);
+    disconnect();
+    return false;
+  }
+
+  struct pollfd fds[2] = {{conn->sock, POLLIN, 0}, {donefd(), POLLIN, 0}};
+  while (poll(fds, 2, -1) == -1) {
+    if (errno != EINTR) {
+      disconnect();
+      return false;
     }
-    mpd_finishCommand(conn);
-    if ((conn != nullptr) && (conn->error != 0)) {
-      // fprintf(stderr, "%s\n", conn->errorStr);
-      mpd_closeConnection(conn);
-      conn = nullptr;
+  }
+  /* mpd forgets the idle along with the connection */
+  if (fds[1].revents != 0) { return false; }
+
+  char *changed;
+  song_changed = false;
+  while ((changed = mpd_getNextChanged(conn)) != nullptr) {
+    if (strcmp(changed, "player") == 0) { song_changed = true; }
+    free(changed);
+  }
+  mpd_finishCommand(conn);
+
+  if (conn->error == MPD_ERROR_ACK) {
+    /* not allowed to idle, read the status once per interval instead */
+    can_idle = false;
+    mpd_clearError(conn);
+    return false;
+  }
+  if (conn->error != 0) {
+    NORM_ERR("MPD error: %s\n", conn->errorStr);
+    disconnect();
+    return false;
+  }
+  return true;
+}
+
+void mpd_cb::deliver(const mpd_result &info) {
+  {
+    std::lock_guard<std::mutex> lock(Base::result_mutex);
+    result = info;  // don't forget to save results!
+  }
+  if (!can_idle) { return; }
+
+  /* the next update would be up to music_player_interval away */
+  publish_now();
+  if (write(wakefd.second, "", 1) == -1) {
+    // the main loop is awake anyway when the pipe is full
+  }
+}
+
+void mpd_cb::work() {
+  mpd_result info;
+  bool song_changed = true;
+
+  while (!is_done()) {
+    if (conn == nullptr && !connect()) {
+      info = mpd_result();
+      info.status = "MPD not responding";
       break;
     }
 
-    if (conn->error != 0) {
-      // fprintf(stderr, "%s\n", conn->errorStr);
-      mpd_closeConnection(conn);
-      conn = nullptr;
+    if (!read_status(info) || (song_changed && !read_song(info))) {
+      NORM_ERR("MPD error: %s\n", conn->errorStr);
+      disconnect();
+
+      info = mpd_result();
+      info.status = "MPD not responding";
       break;
     }
 
-    mpd_freeStatus(status);
-    /* if (conn) {
-       mpd_closeConnection(conn);
-       conn = 0;
-       } */
-  } while (0);
-  std::lock_guard<std::mutex> lock(Base::result_mutex);
-  result = mpd_info;  // don't forget to save results!
+    deliver(info);
+    if (!can_idle || !wait_for_changes(song_changed)) { return; }
+  }
+  deliver(info);
+}
+
+const mpd_result &get_mpd() {
+  double period = music_player_interval.get(*state);
+  return conky::register_cb<mpd_cb>(period)->read_result();
+}
+
+/* seconds into the current song, counting on from the last read while it
+ * plays */
+double mpd_position(const mpd_result &info) {
+  double position = info.position;
+
+  if (info.advancing) { position += get_time() - info.sampled; }
+  if (info.length > 0 && position > info.length) { position = info.length; }
+  return position;
 }
 
-mpd_result get_mpd() {
-  uint32_t period = std::max(
-      lround(music_player_interval.get(*state) / active_update_interval()), 1l);
-  return conky::register_cb<mpd_cb>(period)->get_result_copy();
+float mpd_progress(const mpd_result &info) {
+  if (info.length <= 0) { return 0; }
+  return mpd_position(info) / info.length;
 }
 }  // namespace
 
@@ -336,7 +456,8 @@ static inline void format_media_player_time(char *buf, const int size,
 void print_mpd_elapsed(struct text_object *obj, char *p,
                        unsigned int p_max_size) {
   (void)obj;
-  format_media_player_time(p, p_max_size, get_mpd().elapsed);
+  format_media_player_time(p, p_max_size,
+                           static_cast<int>(mpd_position(get_mpd())));
 }
 
 void print_mpd_length(struct text_object *obj, char *p,
@@ -347,12 +468,12 @@ void print_mpd_length(struct text_object *obj, char *p,
 
 uint8_t mpd_percentage(struct text_object *obj) {
   (void)obj;
-  return round_to_positive_int(get_mpd().progress * 100.0f);
+  return round_to_positive_int(mpd_progress(get_mpd()) * 100.0f);
 }
 
 double mpd_barval(struct text_object *obj) {
   (void)obj;
-  return get_mpd().progress;
+  return mpd_progress(get_mpd());
 }
 
 void print_mpd_smart(struct text_object *obj, char *p,
@@ -0,0 +1,198 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "net-endpoint.hh"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+#include "common.h"
+#include "logging.h"
+
+/* how long a looked up address is used before asking again */
+#define NET_RESOLVE_TTL 300
+/* the backoff starts here after a failure and doubles up to the maximum */
+#define NET_BACKOFF_MIN 1
+#define NET_BACKOFF_MAX 300
+
+namespace conky {
+
+std::shared_ptr<net_endpoint> net_endpoint::get(const std::string &host,
+                                                const std::string &port,
+                                                int family) {
+  static std::mutex mutex;
+  static std::map<std::tuple<std::string, std::string, int>,
+                  std::weak_ptr<net_endpoint>>
+      endpoints;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &weak = endpoints[std::make_tuple(host, port, family)];
+  auto endpoint = weak.lock();
+  if (!endpoint) {
+    endpoint = std::make_shared<net_endpoint>(host, port, family);
+    weak = endpoint;
+  }
+  return endpoint;
+}
+
+bool net_endpoint::resolve(double now) {
+  if (!addresses.empty() && now < expires) { return true; }
+
+  struct addrinfo hints {};
+  struct addrinfo *ai;
+
+  hints.ai_family = family;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  if (int res = getaddrinfo(host.c_str(), port.c_str(), &hints, &ai)) {
+    NORM_ERR("%s: getaddrinfo: %s", host.c_str(), gai_strerror(res));
+    errno = EHOSTUNREACH;
+    return false;
+  }
+
+  addresses.clear();
+  for (struct addrinfo *rp = ai; rp != nullptr; rp = rp->ai_next) {
+    address a{};
+    memcpy(&a.addr, rp->ai_addr, rp->ai_addrlen);
+    a.len = rp->ai_addrlen;
+    a.family = rp->ai_family;
+    a.socktype = rp->ai_socktype;
+    a.protocol = rp->ai_protocol;
+    addresses.push_back(a);
+  }
+  freeaddrinfo(ai);
+  expires = now + NET_RESOLVE_TTL;
+  return !addresses.empty();
+}
+
+void net_endpoint::backoff(double now) {
+  if (delay == 0) {
+    delay = NET_BACKOFF_MIN;
+  } else {
+    delay = std::min(delay * 2, static_cast<double>(NET_BACKOFF_MAX));
+  }
+  retry_at = now + delay;
+}
+
+bool net_endpoint::ready() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return get_time() >= retry_at;
+}
+
+/* connect() with a timeout; returns a blocking socket or -1 */
+static int connect_with_timeout(const struct sockaddr *addr, socklen_t len,
+                                int family, int socktype, int protocol,
+                                double timeout) {
+  int fd = socket(family, socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, protocol);
+  if (fd == -1) { return -1; }
+
+  if (::connect(fd, addr, len) == -1) {
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    int err = errno;
+    socklen_t errlen = sizeof(err);
+
+    if (err == EINPROGRESS) {
+      int res;
+      while ((res = poll(&pfd, 1, lround(timeout * 1000))) == -1 &&
+             errno == EINTR) {}
+      if (res == 0) {
+        err = ETIMEDOUT;
+      } else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &errlen) == -1) {
+        err = errno;
+      }
+    }
+    if (err != 0) {
+      close(fd);
+      errno = err;
+      return -1;
+    }
+  }
+
+  struct timeval tv {};
+  tv.tv_sec = static_cast<time_t>(timeout);
+  tv.tv_usec = static_cast<suseconds_t>((timeout - tv.tv_sec) * 1000000);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  return fd;
+}
+
+int net_endpoint::connect(double timeout) {
+  std::unique_lock<std::mutex> lock(mutex);
+  double now = get_time();
+
+  if (!resolve(now)) {
+    int err = errno;
+    backoff(now);
+    errno = err;
+    return -1;
+  }
+  /* connect without the lock, others may only want ready() meanwhile */
+  std::vector<address> targets(addresses);
+  lock.unlock();
+
+  int fd = -1;
+  for (const auto &a : targets) {
+    fd = connect_with_timeout(
+        reinterpret_cast<const struct sockaddr *>(&a.addr), a.len, a.family,
+        a.socktype, a.protocol, timeout);
+    if (fd != -1) { break; }
+  }
+  if (fd != -1) { return fd; }
+
+  int err = errno;
+  lock.lock();
+  /* the server may have moved, look it up again next time */
+  addresses.clear();
+  backoff(get_time());
+  errno = err;
+  return -1;
+}
+
+void net_endpoint::succeeded() {
+  std::lock_guard<std::mutex> lock(mutex);
+  delay = 0;
+  retry_at = 0;
+}
+
+void net_endpoint::failed() {
+  std::lock_guard<std::mutex> lock(mutex);
+  backoff(get_time());
+}
+
+}  // namespace conky
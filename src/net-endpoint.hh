@@ -0,0 +1,100 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NET_ENDPOINT_HH
+#define NET_ENDPOINT_HH
+
+#include <sys/socket.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace conky {
+
+/*
+ * A host and port that data sources such as hddtemp, apcupsd and the mail
+ * objects talk to. All the objects using the same one share it, so the
+ * address is looked up once for all of them and kept for a while, and a
+ * server that stops answering is only given one attempt per backoff period
+ * instead of holding up every update of every object using it.
+ *
+ * Safe to use from any thread; callbacks usually hold one for their lifetime.
+ */
+class net_endpoint {
+  struct address {
+    struct sockaddr_storage addr;
+    socklen_t len;
+    int family;
+    int socktype;
+    int protocol;
+  };
+
+  const std::string host, port;
+  const int family;
+
+  std::mutex mutex;
+  std::vector<address> addresses;
+  double expires{0};  /* when addresses are to be looked up again */
+  double retry_at{0}; /* not to be tried before this */
+  double delay{0};    /* the current backoff, 0 after a success */
+
+  bool resolve(double now);
+  void backoff(double now);
+
+ public:
+  net_endpoint(const std::string &host_, const std::string &port_,
+               int family_)
+      : host(host_), port(port_), family(family_) {}
+
+  /* the endpoint for host and port, shared with whoever else uses it */
+  static std::shared_ptr<net_endpoint> get(const std::string &host,
+                                           const std::string &port,
+                                           int family = AF_UNSPEC);
+
+  const std::string &get_host() const { return host; }
+
+  /* false while backing off after failures; a caller that would rather show
+   * its last values than wait should skip talking to the endpoint then */
+  bool ready();
+
+  /* Connects a blocking TCP socket, trying every address the host has and
+   * giving up on each after timeout seconds. Sends and receives on the
+   * socket time out after as long. Returns -1 with errno set on failure,
+   * which counts towards the backoff. */
+  int connect(double timeout);
+
+  /* report how the exchange over a connected socket went */
+  void succeeded();
+  void failed();
+};
+
+}  // namespace conky
+
+#endif /* NET_ENDPOINT_HH */
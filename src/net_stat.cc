@@ -34,7 +34,11 @@
 #include <unistd.h>
 #include <cerrno>
 #include <cstring>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 #include "conky.h"
+#include "file-watch.hh"
 #include "logging.h"
 #include "net/if.h"
 #include "specials.h"
@@ -69,51 +73,50 @@ conky::lua_traits<if_up_strictness_>::Map
 static conky::simple_config_setting<if_up_strictness_> if_up_strictness(
     "if_up_strictness", IFUP_UP, true);
 /**
- * global array of structs containing network statistics for each interface
+ * Statistics of every interface that has been asked for, found by name. A
+ * deque never moves what it holds, so text objects can keep pointers into
+ * it; the lock is there for the updaters adding interfaces as they go.
  **/
-struct net_stat netstats[MAX_NET_INTERFACES];
-struct net_stat foo_netstats;
+static std::deque<struct net_stat> net_stats;
+static std::unordered_map<std::string, struct net_stat *> net_stats_by_name;
+static std::mutex net_stats_mutex;
 
 /**
- * Returns pointer to specified interface in netstats array.
- * If not found then add the specified interface to the array.
- * The added interface will have all its members initialized to 0,
- * because clear_net_stats() is called from main() in conky.cc!
+ * Returns pointer to specified interface in the net_stats registry.
+ * If not found then add the specified interface to it.
+ * The added interface will have all its members initialized to 0.
  *
  * @param[in] dev  device / interface name. Silently ignores char * == nullptr
  **/
 struct net_stat *get_net_stat(const char *dev, void * /*free_at_crash1*/,
                               void * /*free_at_crash2*/) {
-  unsigned int i;
-
   if (dev == nullptr) { return nullptr; }
 
-  /* find interface stat */
-  for (i = 0; i < MAX_NET_INTERFACES; i++) {
-    if ((netstats[i].dev != nullptr) && strcmp(netstats[i].dev, dev) == 0) {
-      return &netstats[i];
-    }
-  }
+  std::lock_guard<std::mutex> lock(net_stats_mutex);
+  auto it = net_stats_by_name.find(dev);
+  if (it != net_stats_by_name.end()) { return it->second; }
 
   /* wasn't found? add it */
-  for (i = 0; i < MAX_NET_INTERFACES; i++) {
-    if (netstats[i].dev == nullptr) {
-      netstats[i].dev = strndup(dev, text_buffer_size.get(*state));
-      /* initialize last_read_recv and last_read_trans to -1 denoting
-       * that they were never read before */
-      netstats[i].last_read_recv = -1;
-      netstats[i].last_read_trans = -1;
-      return &netstats[i];
-    }
-  }
-
-  clear_net_stats(&foo_netstats);
-  foo_netstats.dev = strndup(dev, text_buffer_size.get(*state));
+  net_stats.emplace_back();
+  struct net_stat *ns = &net_stats.back();
+  ns->dev = strndup(dev, text_buffer_size.get(*state));
   /* initialize last_read_recv and last_read_trans to -1 denoting
    * that they were never read before */
-  foo_netstats.last_read_recv = -1;
-  foo_netstats.last_read_trans = -1;
-  return &foo_netstats;
+  ns->last_read_recv = -1;
+  ns->last_read_trans = -1;
+  net_stats_by_name.emplace(dev, ns);
+  return ns;
+}
+
+struct net_stat *find_net_stat(const char *dev) {
+  std::lock_guard<std::mutex> lock(net_stats_mutex);
+  auto it = net_stats_by_name.find(dev);
+  return it != net_stats_by_name.end() ? it->second : nullptr;
+}
+
+void for_each_net_stat(const std::function<void(struct net_stat *)> &fn) {
+  std::lock_guard<std::mutex> lock(net_stats_mutex);
+  for (struct net_stat &ns : net_stats) { fn(&ns); }
 }
 
 void parse_net_stat_arg(struct text_object *obj, const char *arg,
@@ -203,55 +206,55 @@ void parse_net_stat_bar_arg(struct text_object *obj, const char *arg,
   }
 }
 
-void print_downspeed(struct text_object *obj, char *p,
-                     unsigned int p_max_size) {
+int print_downspeed(struct text_object *obj, char *p,
+                    unsigned int p_max_size) {
   auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
 
-  if (ns == nullptr) { return; }
+  if (ns == nullptr) { return 0; }
 
-  human_readable(ns->recv_speed, p, p_max_size);
+  return human_readable(ns->recv_speed, p, p_max_size);
 }
 
-void print_downspeedf(struct text_object *obj, char *p,
-                      unsigned int p_max_size) {
+int print_downspeedf(struct text_object *obj, char *p,
+                     unsigned int p_max_size) {
   auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
 
-  if (ns == nullptr) { return; }
+  if (ns == nullptr) { return 0; }
 
-  spaced_print(p, p_max_size, "%.1f", 8, ns->recv_speed / 1024.0);
+  return spaced_print(p, p_max_size, "%.1f", 8, ns->recv_speed / 1024.0);
 }
 
-void print_upspeed(struct text_object *obj, char *p, unsigned int p_max_size) {
+int print_upspeed(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
 
-  if (ns == nullptr) { return; }
+  if (ns == nullptr) { return 0; }
 
-  human_readable(ns->trans_speed, p, p_max_size);
+  return human_readable(ns->trans_speed, p, p_max_size);
 }
 
-void print_upspeedf(struct text_object *obj, char *p, unsigned int p_max_size) {
+int print_upspeedf(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
 
-  if (ns == nullptr) { return; }
+  if (ns == nullptr) { return 0; }
 
-  spaced_print(p, p_max_size, "%.1f", 8, ns->trans_speed / 1024.0);
+  return spaced_print(p, p_max_size, "%.1f", 8, ns->trans_speed / 1024.0);
 }
 
-void print_totaldown(struct text_object *obj, char *p,
-                     unsigned int p_max_size) {
+int print_totaldown(struct text_object *obj, char *p,
+                    unsigned int p_max_size) {
   auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
 
-  if (ns == nullptr) { return; }
+  if (ns == nullptr) { return 0; }
 
-  human_readable(ns->recv, p, p_max_size);
+  return human_readable(ns->recv, p, p_max_size);
 }
 
-void print_totalup(struct text_object *obj, char *p, unsigned int p_max_size) {
+int print_totalup(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
 
-  if (ns == nullptr) { return; }
+  if (ns == nullptr) { return 0; }
 
-  human_readable(ns->trans, p, p_max_size);
+  return human_readable(ns->trans, p, p_max_size);
 }
 
 void print_addr(struct text_object *obj, char *p, unsigned int p_max_size) {
@@ -275,9 +278,10 @@ void print_addrs(struct text_object *obj, char *p, unsigned int p_max_size) {
 
   if (!ns) return;
 
-  if (0 != ns->addrs[0] && strlen(ns->addrs) > 2) {
-    ns->addrs[strlen(ns->addrs) - 2] = 0; /* remove ", " from end of string */
-    strncpy(p, ns->addrs, p_max_size);
+  if (ns->addrs.size() > 2) {
+    /* remove ", " from end of string */
+    snprintf(p, p_max_size, "%.*s", static_cast<int>(ns->addrs.size() - 2),
+             ns->addrs.c_str());
   } else {
     strncpy(p, "0.0.0.0", p_max_size);
   }
@@ -373,17 +377,31 @@ double upspeedgraphval(struct text_object *obj) {
 #endif /* BUILD_GUI */
 
 #ifdef BUILD_WLAN
+void parse_wireless_arg(struct text_object *obj, const char *arg,
+                        void *free_at_crash) {
+  parse_net_stat_arg(obj, arg, free_at_crash);
+  static_cast<struct net_stat *>(obj->data.opaque)->wireless = true;
+}
+
+void parse_wireless_bar_arg(struct text_object *obj, const char *arg,
+                            void *free_at_crash) {
+  parse_net_stat_bar_arg(obj, arg, free_at_crash);
+  auto *ns = static_cast<struct net_stat *>(obj->data.opaque);
+  if (ns != nullptr) { ns->wireless = true; }
+}
+
 void print_wireless_essid(struct text_object *obj, char *p,
                           unsigned int p_max_size) {
   struct net_stat *ns = (struct net_stat *)obj->data.opaque;
 
   if (!ns) {
-    for (unsigned int i = 0; *(netstats[i].dev) != 0; i++) {
-      if (*(netstats[i].essid) != 0) {
-        snprintf(p, p_max_size, "%s", netstats[i].essid);
-        return;
+    bool found = false;
+    for_each_net_stat([&](struct net_stat *other) {
+      if (!found && *(other->essid) != 0) {
+        snprintf(p, p_max_size, "%s", other->essid);
+        found = true;
       }
-    }
+    });
     return;
   }
 
@@ -476,25 +494,13 @@ double wireless_link_barval(struct text_object *obj) {
 #endif /* BUILD_WLAN */
 
 /**
- * Clears the global array of net_stat structs which contains networks
- * statistics for every interface.
+ * Forgets every tracked interface along with its network statistics.
  **/
 void clear_net_stats() {
-#ifdef BUILD_IPV6
-  struct v6addr *nextv6;
-#endif /* BUILD_IPV6 */
-  int i;
-  for (i = 0; i < MAX_NET_INTERFACES; i++) {
-    free_and_zero(netstats[i].dev);
-#ifdef BUILD_IPV6
-    while (netstats[i].v6addrs) {
-      nextv6 = netstats[i].v6addrs;
-      netstats[i].v6addrs = netstats[i].v6addrs->next;
-      free_and_zero(nextv6);
-    }
-#endif /* BUILD_IPV6 */
-  }
-  memset(netstats, 0, sizeof(netstats));
+  std::lock_guard<std::mutex> lock(net_stats_mutex);
+  for (struct net_stat &ns : net_stats) { clear_net_stats(&ns); }
+  net_stats_by_name.clear();
+  net_stats.clear();
 }
 
 void clear_net_stats(net_stat *in) {
@@ -525,6 +531,22 @@ int interface_up(struct text_object *obj) {
 
   if (dev == nullptr) { return 0; }
 
+#if defined(__linux__)
+  /* a lookup in the tables kept from rtnetlink instead of a socket and an
+   * ioctl or two per interface and frame */
+  unsigned int flags;
+  bool has_addr = false;
+  if (get_link_state(dev, flags,
+                     if_up_strictness.get(*state) == IFUP_ADDR ? &has_addr
+                                                               : nullptr)) {
+    if ((flags & IFF_UP) == 0) { return 0; }
+    if (if_up_strictness.get(*state) == IFUP_UP) { return 1; }
+    if ((flags & IFF_RUNNING) == 0) { return 0; }
+    if (if_up_strictness.get(*state) == IFUP_LINK) { return 1; }
+    return has_addr ? 1 : 0;
+  }
+#endif /* __linux__ */
+
 #if defined(__APPLE__) && defined(__MACH__)
   if ((fd = socket(PF_INET, SOCK_DGRAM, 0)) < 0) {
 #else
@@ -572,12 +594,19 @@ class _dns_data {
   _dns_data() = default;
   int nscount{0};
   char **ns_list{nullptr};
+  /* whether ns_list is what resolv.conf had when its hash was hash */
+  bool parsed{false};
+  uint64_t hash{0};
   void reset() {
     nscount = 0;
     ns_list = nullptr;
+    parsed = false;
   }
 };
 
+/* more than any resolv.conf has */
+#define RESOLV_CONF_MAX 0x10000
+
 static _dns_data dns_data;
 
 void free_dns_data(struct text_object *obj) {
@@ -591,31 +620,34 @@ void free_dns_data(struct text_object *obj) {
 }
 
 int update_dns_data() {
-  FILE *fp;
-  char line[256];
-  // static double last_dns_update = 0.0;
+  /* watched, and followed to e.g. /run/systemd/resolve/resolv.conf when it
+   * is a link, so it is only parsed again after it changed */
+  static std::shared_ptr<conky::watched_file> resolv_conf =
+      conky::watched_file::get("/etc/resolv.conf");
 
-  /* maybe updating too often causes higher load because of /etc lying on a real
-  FS if (current_update_time - last_dns_update < 10.0) return 0;
-
-  last_dns_update = current_update_time;
-  */
+  resolv_conf->refresh();
+  uint64_t hash = resolv_conf->hash();
+  if (dns_data.parsed && hash == dns_data.hash) { return 0; }
 
   free_dns_data(nullptr);
-
-  if ((fp = fopen("/etc/resolv.conf", "re")) == nullptr) { return 0; }
-  while (feof(fp) == 0) {
-    if (fgets(line, 255, fp) == nullptr) { break; }
-    if (strncmp(line, "nameserver ", 11) == 0) {
-      line[strlen(line) - 1] = '\0';  // remove trailing newline
+  dns_data.parsed = true;
+  dns_data.hash = hash;
+
+  std::string text = resolv_conf->head(RESOLV_CONF_MAX);
+  for (size_t start = 0; start < text.size();) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos) { end = text.size(); }
+    if (text.compare(start, 11, "nameserver ") == 0) {
       dns_data.nscount++;
       dns_data.ns_list = static_cast<char **>(
           realloc(dns_data.ns_list, dns_data.nscount * sizeof(char *)));
       dns_data.ns_list[dns_data.nscount - 1] =
-          strndup(line + 11, text_buffer_size.get(*state));
+          strndup(text.c_str() + start + 11,
+                  std::min<size_t>(end - start - 11,
+                                   text_buffer_size.get(*state)));
     }
+    start = end + 1;
   }
-  fclose(fp);
   return 0;
 }
 
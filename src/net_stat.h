@@ -32,7 +32,10 @@
 
 #include <netinet/in.h> /* struct in6_addr */
 #include <sys/socket.h> /* struct sockaddr */
+#include <functional>
+#include <string>
 #include "config.h"
+#include "sample-ring.hh"
 
 #ifdef BUILD_IPV6
 struct v6addr {
@@ -66,13 +69,15 @@ struct net_stat {
   bool v6show_sc;
 #endif /* BUILD_IPV6 */
 #if defined(__linux__)
-  char addrs[17 * MAX_NET_INTERFACES + 1];
+  /* every IPv4 address, each followed by ", " */
+  std::string addrs;
 #endif /* __linux__ */
   /* network speeds between two conky calls in bytes per second.
    * An average over these samples is calculated in recv_speed and
    * trans_speed */
-  double net_rec[15], net_trans[15];
-  // wireless extensions
+  conky::sample_ring<double> recv_samples, trans_samples;
+  // wireless extensions, only queried if a wireless object refers to it
+  bool wireless;
   char essid[35];
   int channel;
   char freq[16];
@@ -83,18 +88,26 @@ struct net_stat {
   char ap[18];
 };
 
-extern struct net_stat netstats[];
-
+/* Returns the statistics of an interface, which start being tracked on the
+ * first call for it. They stay where they are until clear_net_stats(). */
 struct net_stat *get_net_stat(const char *, void *, void *);
+/* Returns the statistics of an interface if it is tracked, nullptr if not. */
+struct net_stat *find_net_stat(const char *);
+/* Calls fn for every tracked interface. fn must not call get_net_stat(). */
+void for_each_net_stat(const std::function<void(struct net_stat *)> &fn);
 
 void parse_net_stat_arg(struct text_object *, const char *, void *);
 void parse_net_stat_bar_arg(struct text_object *, const char *, void *);
-void print_downspeed(struct text_object *, char *, unsigned int);
-void print_downspeedf(struct text_object *, char *, unsigned int);
-void print_upspeed(struct text_object *, char *, unsigned int);
-void print_upspeedf(struct text_object *, char *, unsigned int);
-void print_totaldown(struct text_object *, char *, unsigned int);
-void print_totalup(struct text_object *, char *, unsigned int);
+#ifdef BUILD_WLAN
+void parse_wireless_arg(struct text_object *, const char *, void *);
+void parse_wireless_bar_arg(struct text_object *, const char *, void *);
+#endif /* BUILD_WLAN */
+int print_downspeed(struct text_object *, char *, unsigned int);
+int print_downspeedf(struct text_object *, char *, unsigned int);
+int print_upspeed(struct text_object *, char *, unsigned int);
+int print_upspeedf(struct text_object *, char *, unsigned int);
+int print_totaldown(struct text_object *, char *, unsigned int);
+int print_totalup(struct text_object *, char *, unsigned int);
 void print_addr(struct text_object *, char *, unsigned int);
 #ifdef __linux__
 void print_addrs(struct text_object *, char *, unsigned int);
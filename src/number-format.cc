@@ -0,0 +1,56 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "number-format.hh"
+
+#include <cstdio>
+
+namespace conky {
+
+text_writer &text_writer::append_fixed(double value, int precision) {
+  char digits[64];
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  /* floating point to_chars() rounds exactly like printf(), but not every
+   * standard library (e.g. older libc++) has it */
+  std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), value,
+                                         std::chars_format::fixed, precision);
+  if (r.ec == std::errc()) { return append(digits, r.ptr - digits); }
+#endif
+
+  int n = snprintf(digits, sizeof(digits), "%.*f", precision, value);
+  if (n < 0) { return *this; }
+  if (static_cast<size_t>(n) < sizeof(digits)) { return append(digits, n); }
+
+  /* too long for digits: keep what fits and count the rest */
+  append(digits, sizeof(digits) - 1);
+  length += n - (sizeof(digits) - 1);
+  return *this;
+}
+
+}  // namespace conky
@@ -0,0 +1,98 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef NUMBER_FORMAT_HH
+#define NUMBER_FORMAT_HH
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace conky {
+
+/*
+ * Builds text in a fixed size buffer the way a series of snprintf() calls
+ * would, but without parsing a format string for every number. Whatever
+ * doesn't fit is dropped and still counted, so finish() returns what
+ * snprintf() would have.
+ */
+class text_writer {
+  char *buf;
+  size_t size;
+  size_t length;
+
+ public:
+  text_writer(char *buf_, size_t size_) : buf(buf_), size(size_), length(0) {}
+
+  text_writer &append(const char *s, size_t n) {
+    if (length + 1 < size) {
+      size_t room = size - 1 - length;
+      memcpy(buf + length, s, n < room ? n : room);
+    }
+    length += n;
+    return *this;
+  }
+
+  text_writer &append(const char *s) { return append(s, strlen(s)); }
+
+  /* appends n times the character c, for padding */
+  text_writer &fill(char c, size_t n) {
+    if (length + 1 < size) {
+      size_t room = size - 1 - length;
+      memset(buf + length, c, n < room ? n : room);
+    }
+    length += n;
+    return *this;
+  }
+
+  /* appends an integer like "%d", "%ld" or "%u" do */
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value &&
+                              !std::is_same<T, char>::value,
+                          text_writer &>::type
+  append(T value) {
+    char digits[24];
+    std::to_chars_result r =
+        std::to_chars(digits, digits + sizeof(digits), value);
+    return append(digits, r.ptr - digits);
+  }
+
+  /* appends value like "%.*f" does with the given precision */
+  text_writer &append_fixed(double value, int precision);
+
+  /* NUL-terminates the text and returns its length like snprintf() */
+  int finish() {
+    if (size > 0) { buf[length < size ? length : size - 1] = '\0'; }
+    return static_cast<int>(length);
+  }
+};
+
+}  // namespace conky
+
+#endif /* NUMBER_FORMAT_HH */
@@ -93,15 +93,28 @@
  */
 
 #include "nvidia.h"
+#include "config.h"
+#ifdef BUILD_NVIDIA
 #include <X11/Xlib.h>
 #include "NVCtrl/NVCtrl.h"
 #include "NVCtrl/NVCtrlLib.h"
+#include "x11.h"
+#endif /* BUILD_NVIDIA */
+#ifdef BUILD_NVML
+#include <nvml.h>
+#include "update-cb.hh"
+#endif /* BUILD_NVML */
 #include "conky.h"
 #include "logging.h"
 #include "temphelper.h"
-#include "x11.h"
 
 #include <memory>
+#ifdef BUILD_NVML
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+#endif /* BUILD_NVML */
 
 // Separators for nvidia string parsing
 // (sample: "perf=0, nvclock=324, nvclockmin=324, nvclockmax=324 ; perf=1,
@@ -195,6 +208,7 @@ typedef enum _ARG_ID {
   ARG_UNKNOWN
 } ARG_ID;
 
+#ifdef BUILD_NVIDIA
 // Nvidia query targets
 const int translate_nvidia_target[] = {
     NV_CTRL_TARGET_TYPE_X_SCREEN,
@@ -207,6 +221,7 @@ const int translate_nvidia_target[] = {
     NV_CTRL_TARGET_TYPE_3D_VISION_PRO_TRANSCEIVER,
     NV_CTRL_TARGET_TYPE_DISPLAY,
 };
+#endif /* BUILD_NVIDIA */
 
 // Enum for nvidia query targets
 typedef enum _TARGET_ID {
@@ -221,6 +236,7 @@ typedef enum _TARGET_ID {
   TARGET_DISPLAY
 } TARGET_ID;
 
+#ifdef BUILD_NVIDIA
 // Nvidia query attributes
 const int translate_nvidia_attribute[] = {
     NV_CTRL_GPU_CORE_TEMPERATURE,
@@ -251,6 +267,7 @@ const int translate_nvidia_attribute[] = {
     NV_CTRL_STRING_PRODUCT_NAME,
     NV_CTRL_STRING_NVIDIA_DRIVER_VERSION,
 };
+#endif /* BUILD_NVIDIA */
 
 // Enum for nvidia query attributes
 typedef enum _ATTR_ID {
@@ -297,6 +314,30 @@ typedef enum _SEARCH_ID {
   SEARCH_MAX
 } SEARCH_ID;
 
+#ifdef BUILD_NVML
+// Values sampled per GPU by the NVML backend
+typedef enum _NVML_ID {
+  NVML_GPU_TEMP,
+  NVML_GPU_TEMP_THRESHOLD,
+  NVML_GPU_FREQ,
+  NVML_GPU_FREQ_MIN,
+  NVML_GPU_FREQ_MAX,
+  NVML_MEM_FREQ,
+  NVML_MEM_FREQ_MIN,
+  NVML_MEM_FREQ_MAX,
+  NVML_GPU_UTIL,
+  NVML_MEM_BW_UTIL,
+  NVML_VIDEO_UTIL,
+  NVML_MEM_USED,
+  NVML_MEM_TOTAL,
+  NVML_FAN_LEVEL,
+  NVML_MODEL_NAME,
+  NVML_DRIVER_VERSION,
+
+  NVML_NONE  // not served by NVML, left to NV-CONTROL
+} NVML_ID;
+#endif /* BUILD_NVML */
+
 // Translate special_type into command string
 const char *translate_nvidia_special_type[] = {
     "nvidia",       // NONSPECIAL
@@ -341,8 +382,14 @@ class nvidia_s {
   //  added new field for GPU id
   int target_id;
   bool is_percentage;
+#ifdef BUILD_NVML
+  // Value printed from the NVML sample and the set of values it needs
+  NVML_ID nvml = NVML_NONE;
+  uint32_t nvml_mask = 0;
+#endif /* BUILD_NVML */
 };
 
+#ifdef BUILD_NVIDIA
 // Cache by value
 struct nvidia_c_value {
   int memtotal = -1;
@@ -421,6 +468,375 @@ void nvidia_display_setting::cleanup(lua::state &l) {
 
 nvidia_display_setting nvidia_display;
 }  // namespace
+#endif /* BUILD_NVIDIA */
+
+#ifdef BUILD_NVML
+namespace {
+
+// Values some nvidia object asked for. Objects update this from the main
+// thread as they are created and freed, the sampler reads it on the pool.
+std::atomic<uint32_t> nvml_wanted(0);
+unsigned int nvml_refs[NVML_NONE];
+
+inline uint32_t nvml_bit(NVML_ID id) { return 1u << id; }
+
+void nvml_acquire(uint32_t mask) {
+  for (int id = 0; id < NVML_NONE; id++) {
+    if ((mask & (1u << id)) != 0) { nvml_refs[id]++; }
+  }
+  nvml_wanted.fetch_or(mask, std::memory_order_relaxed);
+}
+
+void nvml_release(uint32_t mask) {
+  uint32_t unused = 0;
+  for (int id = 0; id < NVML_NONE; id++) {
+    if ((mask & (1u << id)) != 0 && --nvml_refs[id] == 0) {
+      unused |= 1u << id;
+    }
+  }
+  nvml_wanted.fetch_and(~unused, std::memory_order_relaxed);
+}
+
+enum nvml_status { NVML_PENDING, NVML_READY, NVML_FAILED };
+
+struct nvml_gpu {
+  int values[NVML_NONE];
+  std::string name;
+};
+
+struct nvml_sample {
+  nvml_status status = NVML_PENDING;
+  std::vector<nvml_gpu> gpus;
+  std::string driver;
+};
+
+// Read the values that stay put while conky runs
+nvml_gpu read_nvml_fixed(nvmlDevice_t dev) {
+  nvml_gpu gpu;
+  char name[NVML_DEVICE_NAME_BUFFER_SIZE];
+  unsigned int v;
+  nvmlMemory_t mem;
+
+  std::fill(std::begin(gpu.values), std::end(gpu.values), -1);
+  if (nvmlDeviceGetName(dev, name, sizeof(name)) == NVML_SUCCESS) {
+    gpu.name = name;
+  }
+  if (nvmlDeviceGetTemperatureThreshold(
+          dev, NVML_TEMPERATURE_THRESHOLD_SLOWDOWN, &v) == NVML_SUCCESS) {
+    gpu.values[NVML_GPU_TEMP_THRESHOLD] = v;
+  }
+  if (nvmlDeviceGetMaxClockInfo(dev, NVML_CLOCK_GRAPHICS, &v) ==
+      NVML_SUCCESS) {
+    gpu.values[NVML_GPU_FREQ_MAX] = v;
+  }
+  if (nvmlDeviceGetMaxClockInfo(dev, NVML_CLOCK_MEM, &v) == NVML_SUCCESS) {
+    gpu.values[NVML_MEM_FREQ_MAX] = v;
+  }
+  if (nvmlDeviceGetMemoryInfo(dev, &mem) == NVML_SUCCESS) {
+    gpu.values[NVML_MEM_TOTAL] = static_cast<int>(mem.total >> 20);
+  }
+
+  // The lowest clocks are the bottom of the supported clock tables, which
+  // many consumer cards don't expose
+  unsigned int mem_clocks[128];
+  unsigned int gpu_clocks[256];
+  unsigned int count = sizeof(mem_clocks) / sizeof(mem_clocks[0]);
+  if (nvmlDeviceGetSupportedMemoryClocks(dev, &count, mem_clocks) ==
+          NVML_SUCCESS &&
+      count > 0) {
+    unsigned int mem_min = *std::min_element(mem_clocks, mem_clocks + count);
+    gpu.values[NVML_MEM_FREQ_MIN] = mem_min;
+    count = sizeof(gpu_clocks) / sizeof(gpu_clocks[0]);
+    if (nvmlDeviceGetSupportedGraphicsClocks(dev, mem_min, &count,
+                                             gpu_clocks) == NVML_SUCCESS &&
+        count > 0) {
+      gpu.values[NVML_GPU_FREQ_MIN] =
+          *std::min_element(gpu_clocks, gpu_clocks + count);
+    }
+  }
+  return gpu;
+}
+
+// Read the changing values, skipping the ones nobody prints
+void read_nvml_current(nvmlDevice_t dev, uint32_t wanted, nvml_gpu &gpu) {
+  unsigned int v;
+
+  if ((wanted & nvml_bit(NVML_GPU_TEMP)) != 0 &&
+      nvmlDeviceGetTemperature(dev, NVML_TEMPERATURE_GPU, &v) ==
+          NVML_SUCCESS) {
+    gpu.values[NVML_GPU_TEMP] = v;
+  }
+  if ((wanted & nvml_bit(NVML_GPU_FREQ)) != 0 &&
+      nvmlDeviceGetClockInfo(dev, NVML_CLOCK_GRAPHICS, &v) == NVML_SUCCESS) {
+    gpu.values[NVML_GPU_FREQ] = v;
+  }
+  if ((wanted & nvml_bit(NVML_MEM_FREQ)) != 0 &&
+      nvmlDeviceGetClockInfo(dev, NVML_CLOCK_MEM, &v) == NVML_SUCCESS) {
+    gpu.values[NVML_MEM_FREQ] = v;
+  }
+  if ((wanted & (nvml_bit(NVML_GPU_UTIL) | nvml_bit(NVML_MEM_BW_UTIL))) != 0) {
+    nvmlUtilization_t util;
+    if (nvmlDeviceGetUtilizationRates(dev, &util) == NVML_SUCCESS) {
+      gpu.values[NVML_GPU_UTIL] = util.gpu;
+      gpu.values[NVML_MEM_BW_UTIL] = util.memory;
+    }
+  }
+  if ((wanted & nvml_bit(NVML_VIDEO_UTIL)) != 0) {
+    // NV-CONTROL reports the busier of the encoder and decoder
+    unsigned int enc;
+    unsigned int dec;
+    unsigned int period;
+    if (nvmlDeviceGetEncoderUtilization(dev, &enc, &period) ==
+            NVML_SUCCESS &&
+        nvmlDeviceGetDecoderUtilization(dev, &dec, &period) == NVML_SUCCESS) {
+      gpu.values[NVML_VIDEO_UTIL] = std::max(enc, dec);
+    }
+  }
+  if ((wanted & nvml_bit(NVML_MEM_USED)) != 0) {
+    nvmlMemory_t mem;
+    if (nvmlDeviceGetMemoryInfo(dev, &mem) == NVML_SUCCESS) {
+      gpu.values[NVML_MEM_USED] = static_cast<int>(mem.used >> 20);
+    }
+  }
+  if ((wanted & nvml_bit(NVML_FAN_LEVEL)) != 0 &&
+      nvmlDeviceGetFanSpeed(dev, &v) == NVML_SUCCESS) {
+    gpu.values[NVML_FAN_LEVEL] = v;
+  }
+}
+
+/*
+ * Samples every value the config asks for, on every GPU, in one pass per
+ * update on the callback pool. NVML talks to the kernel driver directly, so
+ * unlike NV-CONTROL it needs no X server.
+ */
+class nvml_cb : public conky::callback<nvml_sample> {
+  typedef conky::callback<nvml_sample> Base;
+
+  nvml_status status = NVML_PENDING;
+  std::vector<nvmlDevice_t> devices;
+  std::vector<nvml_gpu> fixed;
+  std::string driver;
+
+  bool load();
+
+ protected:
+  virtual void work();
+
+ public:
+  explicit nvml_cb(double period) : Base(period, false, Tuple()) {
+    set_power_source("nvidia");
+  }
+  ~nvml_cb() {
+    if (status == NVML_READY) { nvmlShutdown(); }
+  }
+};
+
+bool nvml_cb::load() {
+  char version[NVML_SYSTEM_DRIVER_VERSION_BUFFER_SIZE];
+  unsigned int count;
+
+  nvmlReturn_t ret = nvmlInit();
+  if (ret != NVML_SUCCESS) {
+    NORM_ERR("nvidia: can't initialise NVML: %s", nvmlErrorString(ret));
+    return false;
+  }
+  if (nvmlSystemGetDriverVersion(version, sizeof(version)) == NVML_SUCCESS) {
+    driver = version;
+  }
+  if (nvmlDeviceGetCount(&count) != NVML_SUCCESS) { count = 0; }
+  for (unsigned int i = 0; i < count; i++) {
+    nvmlDevice_t dev;
+    if (nvmlDeviceGetHandleByIndex(i, &dev) != NVML_SUCCESS) { break; }
+    devices.push_back(dev);
+    fixed.push_back(read_nvml_fixed(dev));
+  }
+  return true;
+}
+
+void nvml_cb::work() {
+  nvml_sample sample;
+
+  if (status == NVML_PENDING) { status = load() ? NVML_READY : NVML_FAILED; }
+  sample.status = status;
+  if (status == NVML_READY) {
+    uint32_t wanted = nvml_wanted.load(std::memory_order_relaxed);
+    sample.gpus = fixed;
+    sample.driver = driver;
+    for (size_t i = 0; i < devices.size(); i++) {
+      read_nvml_current(devices[i], wanted, sample.gpus[i]);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = std::move(sample);
+}
+
+// Pick the value an object prints and everything needed to scale it
+void nvml_prepare(nvidia_s *nvs) {
+  uint32_t mask = 0;
+
+  switch (nvs->attribute) {
+    case ATTR_GPU_TEMP:
+      nvs->nvml = NVML_GPU_TEMP;
+      mask = nvml_bit(NVML_GPU_TEMP_THRESHOLD);
+      break;
+    case ATTR_GPU_TEMP_THRESHOLD:
+      nvs->nvml = NVML_GPU_TEMP_THRESHOLD;
+      break;
+    case ATTR_GPU_FREQ:
+      nvs->nvml = NVML_GPU_FREQ;
+      mask = nvml_bit(NVML_GPU_FREQ_MAX);
+      break;
+    case ATTR_MEM_FREQ:
+      nvs->nvml = NVML_MEM_FREQ;
+      mask = nvml_bit(NVML_MEM_FREQ_MAX);
+      break;
+    case ATTR_PERFMODES_STRING:
+      if (strcmp(nvs->token, "nvclockmin") == 0) {
+        nvs->nvml = NVML_GPU_FREQ_MIN;
+      } else if (strcmp(nvs->token, "nvclockmax") == 0) {
+        nvs->nvml = NVML_GPU_FREQ_MAX;
+      } else if (strcmp(nvs->token, "memclockmin") == 0) {
+        nvs->nvml = NVML_MEM_FREQ_MIN;
+      } else if (strcmp(nvs->token, "memclockmax") == 0) {
+        nvs->nvml = NVML_MEM_FREQ_MAX;
+      }
+      break;
+    case ATTR_UTILS_STRING:
+      if (strcmp(nvs->token, "graphics") == 0) {
+        nvs->nvml = NVML_GPU_UTIL;
+      } else if (strcmp(nvs->token, "memory") == 0) {
+        nvs->nvml = NVML_MEM_BW_UTIL;
+      } else if (strcmp(nvs->token, "video") == 0) {
+        nvs->nvml = NVML_VIDEO_UTIL;
+      }
+      break;
+    case ATTR_MEM_USED:
+    case ATTR_MEM_FREE:
+    case ATTR_MEM_UTIL:
+      nvs->nvml = NVML_MEM_USED;
+      mask = nvml_bit(NVML_MEM_TOTAL);
+      break;
+    case ATTR_MEM_TOTAL:
+      nvs->nvml = NVML_MEM_TOTAL;
+      break;
+    case ATTR_FAN_LEVEL:
+      nvs->nvml = NVML_FAN_LEVEL;
+      break;
+    case ATTR_FAN_SPEED:
+      // NVML has no RPM reading, but the bars draw fanlevel anyway
+      mask = nvml_bit(NVML_FAN_LEVEL);
+      break;
+    case ATTR_MODEL_NAME:
+      nvs->nvml = NVML_MODEL_NAME;
+      break;
+    case ATTR_DRIVER_VERSION:
+      nvs->nvml = NVML_DRIVER_VERSION;
+      break;
+    default:
+      break;
+  }
+  if (nvs->nvml != NVML_NONE) { mask |= nvml_bit(nvs->nvml); }
+  nvs->nvml_mask = mask;
+  nvml_acquire(mask);
+}
+
+inline int nvml_percent(int value, int max) {
+  if (value < 0 || max <= 0) { return -1; }
+  return ((float)value * 100 / (float)max) + 0.5;
+}
+
+// Return the sample for this GPU, or nullptr if NV-CONTROL should answer
+const nvml_gpu *nvml_lookup(const nvidia_s *nvs, const nvml_sample &sample) {
+  if (sample.status != NVML_READY) { return nullptr; }
+  if (nvs->target_id >= static_cast<int>(sample.gpus.size())) {
+    return nullptr;
+  }
+  return &sample.gpus[nvs->target_id];
+}
+
+// Answer a query from the last sample; false leaves it to NV-CONTROL
+bool nvml_query(const nvidia_s *nvs, int &value, char *&str) {
+  if (nvs->nvml == NVML_NONE) { return false; }
+
+  const nvml_sample &sample =
+      conky::register_cb<nvml_cb>(0)->read_result();
+  if (sample.status == NVML_PENDING) { return true; }
+  const nvml_gpu *gpu = nvml_lookup(nvs, sample);
+  if (gpu == nullptr) { return false; }
+
+  int used = gpu->values[NVML_MEM_USED];
+  int total = gpu->values[NVML_MEM_TOTAL];
+  switch (nvs->attribute) {
+    case ATTR_MODEL_NAME:
+      if (!gpu->name.empty()) { str = strdup(gpu->name.c_str()); }
+      break;
+    case ATTR_DRIVER_VERSION:
+      if (!sample.driver.empty()) { str = strdup(sample.driver.c_str()); }
+      break;
+    case ATTR_MEM_FREE:
+      if (used >= 0 && total >= 0) { value = total - used; }
+      break;
+    case ATTR_MEM_UTIL:
+      value = nvml_percent(used, total);
+      break;
+    default:
+      value = gpu->values[nvs->nvml];
+      break;
+  }
+  return value != -1 || str != nullptr;
+}
+
+// Same as nvml_query() for the bar, gauge and graph values
+bool nvml_barval(const nvidia_s *nvs, double &value) {
+  if (nvs->nvml_mask == 0) { return false; }
+
+  const nvml_sample &sample =
+      conky::register_cb<nvml_cb>(0)->read_result();
+  if (sample.status == NVML_PENDING) {
+    value = 0;
+    return true;
+  }
+  const nvml_gpu *gpu = nvml_lookup(nvs, sample);
+  if (gpu == nullptr) { return false; }
+
+  const int *v = gpu->values;
+  int result;
+  switch (nvs->attribute) {
+    case ATTR_UTILS_STRING:
+      result = v[nvs->nvml];
+      break;
+    case ATTR_FAN_SPEED:
+    case ATTR_FAN_LEVEL:
+      result = v[NVML_FAN_LEVEL];
+      break;
+    case ATTR_MEM_UTIL:
+    case ATTR_MEM_USED:
+      result = nvml_percent(v[NVML_MEM_USED], v[NVML_MEM_TOTAL]);
+      break;
+    case ATTR_MEM_FREE:
+      result = v[NVML_MEM_USED] < 0 || v[NVML_MEM_TOTAL] < 0
+                   ? -1
+                   : v[NVML_MEM_TOTAL] - v[NVML_MEM_USED];
+      break;
+    case ATTR_GPU_TEMP:
+      result = nvml_percent(v[NVML_GPU_TEMP], v[NVML_GPU_TEMP_THRESHOLD]);
+      break;
+    case ATTR_GPU_FREQ:
+      result = nvml_percent(v[NVML_GPU_FREQ], v[NVML_GPU_FREQ_MAX]);
+      break;
+    case ATTR_MEM_FREQ:
+      result = nvml_percent(v[NVML_MEM_FREQ], v[NVML_MEM_FREQ_MAX]);
+      break;
+    default:
+      return false;
+  }
+  if (result < 0) { return false; }
+  value = result;
+  return true;
+}
+}  // namespace
+#endif /* BUILD_NVML */
 
 // Evaluate module parameters and prepare query
 int set_nvidia_query(struct text_object *obj, const char *arg,
@@ -456,12 +872,14 @@ int set_nvidia_query(struct text_object *obj, const char *arg,
     case BAR:
       arg = scan_bar(obj, arg, 100);
       break;
+#ifdef BUILD_GUI
     case GRAPH:
       arg = scan_graph(obj, arg, 100);
       break;
     case GAUGE:
       arg = scan_gauge(obj, arg, 100);
       break;
+#endif /* BUILD_GUI */
     default:
       break;
   }
@@ -690,9 +1108,13 @@ int set_nvidia_query(struct text_object *obj, const char *arg,
       // Error printed by core.cc
       return 1;
   }
+#ifdef BUILD_NVML
+  nvml_prepare(nvs);
+#endif /* BUILD_NVML */
   return 0;
 }
 
+#ifdef BUILD_NVIDIA
 // Return the amount of targets present or raise error)
 static inline int get_nvidia_target_count(Display *dpy, TARGET_ID tid) {
   int num_tgts;
@@ -949,15 +1371,11 @@ bool validate_target_id(Display *dpy, int target_id, ATTR_ID attribute) {
   return true;
 }
 
-// Perform query and print result
-void print_nvidia_value(struct text_object *obj, char *p,
-                        unsigned int p_max_size) {
-  nvidia_s *nvs = static_cast<nvidia_s *>(obj->data.opaque);
-  int value;
+// Perform query via NV-CONTROL
+static void nvctrl_query(nvidia_s *nvs, int &value, char *&str) {
   int temp1;
   int temp2;
   int result;
-  char *str;
   int event_base;
   int error_base;
 
@@ -974,13 +1392,8 @@ void print_nvidia_value(struct text_object *obj, char *p,
     return;
   }
 
-  // Assume failure
-  value = -1;
-  str = nullptr;
-
   // Perform query if the query exists and isnt stupid
-  if (nvs != nullptr &&
-      validate_target_id(dpy, nvs->target_id, nvs->attribute)) {
+  if (validate_target_id(dpy, nvs->target_id, nvs->attribute)) {
     // Execute switch by query type
     switch (nvs->query) {
       case QUERY_VALUE:
@@ -1041,24 +1454,10 @@ void print_nvidia_value(struct text_object *obj, char *p,
         break;
     }
   }
-
-  // Print result
-  if (value != -1) {
-    if (nvs->is_percentage) {
-      percent_print(p, p_max_size, value);
-    } else {
-      snprintf(p, p_max_size, "%d", value);
-    }
-  } else if (str != nullptr) {
-    snprintf(p, p_max_size, "%s", str);
-    free_and_zero(str);
-  } else {
-    snprintf(p, p_max_size, "%s", "N/A");
-  }
 }
 
-double get_nvidia_barval(struct text_object *obj) {
-  nvidia_s *nvs = static_cast<nvidia_s *>(obj->data.opaque);
+// Perform query via NV-CONTROL and return the bar/gauge/graph value
+static double nvctrl_barval(nvidia_s *nvs) {
   int temp1;
   int temp2;
   double value;
@@ -1083,8 +1482,7 @@ double get_nvidia_barval(struct text_object *obj) {
 
   // Convert query_result to a percentage using ((val-min)÷(max-min)×100)+0.5 if
   // needed.
-  if (nvs != nullptr &&
-      validate_target_id(dpy, nvs->target_id, nvs->attribute)) {
+  if (validate_target_id(dpy, nvs->target_id, nvs->attribute)) {
     switch (nvs->attribute) {
       case ATTR_UTILS_STRING:  // one of the percentage utils (gpuutil,
                                // membwutil, videoutil and pcieutil)
@@ -1179,10 +1577,64 @@ double get_nvidia_barval(struct text_object *obj) {
   // Return the percentage
   return value;
 }
+#endif /* BUILD_NVIDIA */
+
+// Perform query and print result
+void print_nvidia_value(struct text_object *obj, char *p,
+                        unsigned int p_max_size) {
+  nvidia_s *nvs = static_cast<nvidia_s *>(obj->data.opaque);
+
+  // Assume failure
+  int value = -1;
+  char *str = nullptr;
+
+  if (nvs != nullptr) {
+#ifdef BUILD_NVML
+    if (!nvml_query(nvs, value, str)) {
+#ifdef BUILD_NVIDIA
+      nvctrl_query(nvs, value, str);
+#endif /* BUILD_NVIDIA */
+    }
+#else
+    nvctrl_query(nvs, value, str);
+#endif /* BUILD_NVML */
+  }
+
+  // Print result
+  if (value != -1) {
+    if (nvs->is_percentage) {
+      percent_print(p, p_max_size, value);
+    } else {
+      snprintf(p, p_max_size, "%d", value);
+    }
+  } else if (str != nullptr) {
+    snprintf(p, p_max_size, "%s", str);
+    free_and_zero(str);
+  } else {
+    snprintf(p, p_max_size, "%s", "N/A");
+  }
+}
+
+double get_nvidia_barval(struct text_object *obj) {
+  nvidia_s *nvs = static_cast<nvidia_s *>(obj->data.opaque);
+  double value = 0;
+
+  if (nvs == nullptr) { return 0; }
+#ifdef BUILD_NVML
+  if (nvml_barval(nvs, value)) { return value; }
+#endif /* BUILD_NVML */
+#ifdef BUILD_NVIDIA
+  value = nvctrl_barval(nvs);
+#endif /* BUILD_NVIDIA */
+  return value;
+}
 
 // Cleanup
 void free_nvidia(struct text_object *obj) {
   nvidia_s *nvs = static_cast<nvidia_s *>(obj->data.opaque);
+#ifdef BUILD_NVML
+  if (nvs != nullptr) { nvml_release(nvs->nvml_mask); }
+#endif /* BUILD_NVML */
   delete nvs;
   obj->data.opaque = nullptr;
 }
@@ -57,6 +57,8 @@
 #include <net80211/ieee80211.h>
 #include <net80211/ieee80211_ioctl.h>
 
+#include <mutex>
+
 #include "conky.h"
 #include "diskio.h"
 #include "logging.h"
@@ -93,6 +95,29 @@ static int kvm_init() {
   return 1;
 }
 
+/* bumped before each update, see get_procs() */
+static unsigned long update_generation = 0;
+static std::mutex kvm_proc_mutex;
+
+/* Returns the process table as of this update. It is copied out of the
+ * kernel only once per update for all the process objects and top. The
+ * array belongs to kd, so only use it while holding kvm_proc_mutex. */
+static struct kinfo_proc2 *get_procs(int *n_processes) {
+  static unsigned long procs_generation = 0;
+  static struct kinfo_proc2 *procs = nullptr;
+  static int procs_n = 0;
+
+  if (procs == nullptr || procs_generation != update_generation) {
+    kvm_init();
+    procs = kvm_getproc2(kd, KERN_PROC_ALL, 0, sizeof(struct kinfo_proc2),
+                         &procs_n);
+    if (procs == nullptr) { procs_n = 0; }
+    procs_generation = update_generation;
+  }
+  *n_processes = procs_n;
+  return procs;
+}
+
 /* note: swapmode taken from 'top' source */
 /* swapmode is rewritten by Tobias Weingartner <weingart@openbsd.org>
  * to be based on the new swapctl(2) system call. */
@@ -254,8 +279,8 @@ void update_net_stats() {
 int update_total_processes() {
   int n_processes;
 
-  kvm_init();
-  kvm_getprocs(kd, KERN_PROC_ALL, 0, &n_processes);
+  std::lock_guard<std::mutex> guard(kvm_proc_mutex);
+  get_procs(&n_processes);
 
   info.procs = n_processes;
 
@@ -267,10 +292,8 @@ void update_running_processes() {
   int n_processes;
   int i, cnt = 0;
 
-  kvm_init();
-  int max_size = sizeof(struct kinfo_proc2);
-
-  p = kvm_getproc2(kd, KERN_PROC_ALL, 0, max_size, &n_processes);
+  std::lock_guard<std::mutex> guard(kvm_proc_mutex);
+  p = get_procs(&n_processes);
   for (i = 0; i < n_processes; i++) {
     if (p[i].p_stat == SRUN) { cnt++; }
   }
@@ -642,10 +665,8 @@ void get_top_info(void) {
   int n_processes;
   int i;
 
-  kvm_init();
-
-  p = kvm_getproc2(kd, KERN_PROC_ALL, 0, sizeof(struct kinfo_proc2),
-                   &n_processes);
+  std::lock_guard<std::mutex> guard(kvm_proc_mutex);
+  p = get_procs(&n_processes);
 
   for (i = 0; i < n_processes; i++) {
     if (!((p[i].p_flag & P_SYSTEM)) && p[i].p_comm != nullptr) {
@@ -660,9 +681,9 @@ void get_top_info(void) {
   }
 }
 
-/* empty stubs so conky links */
-void prepare_update() {}
+void prepare_update() { ++update_generation; }
 
+/* empty stubs so conky links */
 int get_entropy_avail(unsigned int *val) { return 1; }
 
 int get_entropy_poolsize(unsigned int *val) { return 1; }
@@ -0,0 +1,131 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "proc-connector.hh"
+
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace conky {
+
+bool proc_connector::open() {
+  close();
+
+  fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+              NETLINK_CONNECTOR);
+  if (fd < 0) { return false; }
+
+  struct sockaddr_nl addr {};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = CN_IDX_PROC;
+  addr.nl_pid = 0; /* let the kernel pick a unique id */
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0) {
+    int err = errno;
+    close();
+    errno = err;
+    return false;
+  }
+
+  /* a netlink message carrying a connector message carrying the op */
+  const enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+  alignas(struct nlmsghdr) char req[NLMSG_SPACE(sizeof(struct cn_msg) +
+                                                sizeof op)] = {0};
+  auto *nl = reinterpret_cast<struct nlmsghdr *>(req);
+  auto *cn = static_cast<struct cn_msg *>(NLMSG_DATA(nl));
+  nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof op);
+  nl->nlmsg_type = NLMSG_DONE;
+  nl->nlmsg_pid = getpid();
+  cn->id.idx = CN_IDX_PROC;
+  cn->id.val = CN_VAL_PROC;
+  cn->len = sizeof op;
+  memcpy(cn->data, &op, sizeof op);
+  if (send(fd, req, nl->nlmsg_len, 0) < 0) {
+    int err = errno;
+    close();
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+void proc_connector::close() {
+  if (fd >= 0) { ::close(fd); }
+  fd = -1;
+}
+
+bool proc_connector::read_events(const std::function<void(pid_t)> &on_fork,
+                                 const std::function<void(pid_t)> &on_exit) {
+  if (fd < 0) { return false; }
+
+  alignas(struct nlmsghdr) char buf[8192];
+  for (;;) {
+    ssize_t len = recv(fd, buf, sizeof buf, 0);
+    if (len < 0) {
+      if (errno == EINTR) { continue; }
+      /* ENOBUFS: the socket overflowed and events are gone */
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    for (auto *nl = reinterpret_cast<struct nlmsghdr *>(buf);
+         NLMSG_OK(nl, len); nl = NLMSG_NEXT(nl, len)) {
+      if (nl->nlmsg_type == NLMSG_ERROR || nl->nlmsg_type == NLMSG_NOOP) {
+        continue;
+      }
+      auto *cn = static_cast<struct cn_msg *>(NLMSG_DATA(nl));
+      if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) {
+        continue;
+      }
+      auto *ev = reinterpret_cast<struct proc_event *>(cn->data);
+      switch (ev->what) {
+        case proc_event::PROC_EVENT_FORK:
+          /* new threads show up here too, only follow processes */
+          if (ev->event_data.fork.child_pid ==
+              ev->event_data.fork.child_tgid) {
+            on_fork(ev->event_data.fork.child_tgid);
+          }
+          break;
+        case proc_event::PROC_EVENT_EXIT:
+          if (ev->event_data.exit.process_pid ==
+              ev->event_data.exit.process_tgid) {
+            on_exit(ev->event_data.exit.process_tgid);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+}  // namespace conky
@@ -0,0 +1,70 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PROC_CONNECTOR_HH
+#define PROC_CONNECTOR_HH
+
+#include <sys/types.h>
+
+#include <functional>
+
+namespace conky {
+
+/*
+ * Process fork and exit notifications from the netlink proc connector, so the
+ * process table can follow the set of live processes without going through
+ * /proc every update. Listening needs CAP_NET_ADMIN.
+ */
+class proc_connector {
+  int fd;
+
+  proc_connector(const proc_connector &) = delete;
+  proc_connector &operator=(const proc_connector &) = delete;
+
+ public:
+  proc_connector() : fd(-1) {}
+  ~proc_connector() { close(); }
+
+  /* Starts listening. Returns false (with errno set) if that's not possible.
+   */
+  bool open();
+  void close();
+  bool is_open() const { return fd >= 0; }
+
+  /*
+   * Passes the processes (not threads) created and gone since the last call
+   * to the callbacks. Returns false if events were lost, in which case the
+   * caller has to rescan /proc.
+   */
+  bool read_events(const std::function<void(pid_t)> &on_fork,
+                   const std::function<void(pid_t)> &on_exit);
+};
+
+}  // namespace conky
+
+#endif /* PROC_CONNECTOR_HH */
@@ -0,0 +1,103 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "proc-file.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "common.h"
+#include "logging.h"
+#include "session-capture.hh"
+
+namespace conky {
+
+proc_file::proc_file(const char *file_)
+    : file(file_), fd(-1), generation(0), buffer(4096), length(0) {}
+
+proc_file::~proc_file() {
+  if (fd >= 0) { close(fd); }
+}
+
+bool proc_file::reopen(int *reported) {
+  if (fd >= 0) { close(fd); }
+  generation = session_generation();
+  fd = ::open(open_file_path(file.c_str()).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if ((reported == nullptr) || *reported == 0) {
+      NORM_ERR("can't open %s: %s", file.c_str(), strerror(errno));
+      if (reported != nullptr) { *reported = 1; }
+    }
+    return false;
+  }
+  return true;
+}
+
+const char *proc_file::read(int *reported) {
+  /* recorded and replayed sessions have another copy of the file for
+   * every update */
+  if ((fd < 0 || generation != session_generation()) && !reopen(reported)) {
+    return nullptr;
+  }
+
+  for (bool retried = false;; retried = true) {
+    ssize_t n;
+    length = 0;
+    /* leave room for the terminating NUL */
+    while ((n = pread(fd, buffer.data() + length, buffer.size() - length - 1,
+                      length)) > 0) {
+      length += n;
+      if (length + 1 == buffer.size()) { buffer.resize(buffer.size() * 2); }
+    }
+    if (n == 0) { break; }
+    if (errno == EINTR) { continue; }
+
+    if (!retried && (errno == ESTALE || errno == ENODEV)) {
+      if (!reopen(reported)) { return nullptr; }
+      continue;
+    }
+    if ((reported == nullptr) || *reported == 0) {
+      NORM_ERR("can't read %s: %s", file.c_str(), strerror(errno));
+      if (reported != nullptr) { *reported = 1; }
+    }
+    return nullptr;
+  }
+
+  buffer[length] = '\0';
+  return buffer.data();
+}
+
+FILE *proc_file::open(int *reported) {
+  if (read(reported) == nullptr || length == 0) { return nullptr; }
+  return fmemopen(buffer.data(), length, "r");
+}
+
+}  // namespace conky
@@ -0,0 +1,79 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PROC_FILE_HH
+#define PROC_FILE_HH
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace conky {
+
+/*
+ * A /proc or /sys file that stays open between updates. Every read() pread()s
+ * the whole file from offset 0 into a buffer that is reused (and only ever
+ * grows), so a refresh costs one or two syscalls instead of an
+ * open/read/close cycle. The file is only reopened if the kernel tells us the
+ * old descriptor went stale (ESTALE, ENODEV), e.g. after a device was
+ * replugged.
+ *
+ * Paths go through open_file_path(), like open_file(). An instance must not be
+ * used by two threads at once; give each update function its own.
+ */
+class proc_file {
+  const std::string file;
+  int fd;
+  unsigned long generation; /* session_generation() when fd was opened */
+  std::vector<char> buffer;
+  size_t length;
+
+  proc_file(const proc_file &) = delete;
+  proc_file &operator=(const proc_file &) = delete;
+
+  bool reopen(int *reported);
+
+ public:
+  explicit proc_file(const char *file_);
+  ~proc_file();
+
+  /* Rereads the file. Returns its NUL terminated contents, or nullptr on
+   * failure, which is reported once through *reported like open_file(). The
+   * pointer is valid until the next read(). */
+  const char *read(int *reported);
+  size_t size() const { return length; }
+
+  /* read() wrapped in a stream for existing fgets()/fscanf() parsers. The
+   * stream is backed by the buffer and must be fclose()d before the next
+   * read(). Returns nullptr on failure or if the file is empty. */
+  FILE *open(int *reported);
+};
+
+}  // namespace conky
+
+#endif /* PROC_FILE_HH */
@@ -29,10 +29,20 @@
 
 #include "proc.h"
 #include <dirent.h>
+#include <fcntl.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif /* __linux__ */
 #include <cctype>
 #include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "conky.h"
 #include "core.h"
 #include "logging.h"
@@ -100,12 +110,162 @@ int inlist(struct ll_string *front, char *string) {
   return 0;
 }
 
+/*
+ * The /proc/<pid> files the ${pid_*} objects read, kept for one update. Each
+ * file is read and split into its fields the first time an object of that
+ * update asks for it, so any number of objects showing the same process cost
+ * one read per file. Main thread only.
+ */
+enum pid_file_type { PID_STATUS, PID_STAT, PID_IO, PID_FILE_TYPES };
+
+namespace {
+const char *const pid_file_names[PID_FILE_TYPES] = {"status", "stat", "io"};
+
+struct pid_file {
+  bool read{false};
+  bool ok{false};
+  std::string text;
+  /* keys are empty for stat, whose fields are numbered */
+  std::vector<std::pair<std::string_view, std::string_view>> fields;
+};
+
+struct pid_snapshot {
+  double time{-1};
+  pid_file files[PID_FILE_TYPES];
+};
+
+std::unordered_map<std::string, pid_snapshot> pid_snapshots;
+double pid_snapshots_time = -1;
+
+/* "Key:<whitespace>value" lines, like status and io */
+void split_pid_lines(pid_file &f) {
+  std::string_view text(f.text);
+
+  while (!text.empty()) {
+    size_t nl = text.find('\n');
+    std::string_view line = text.substr(0, nl);
+    text = nl == std::string_view::npos ? std::string_view()
+                                        : text.substr(nl + 1);
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) { continue; }
+    size_t value = line.find_first_not_of(" \t", colon + 1);
+    f.fields.emplace_back(line.substr(0, colon),
+                          value == std::string_view::npos
+                              ? std::string_view()
+                              : line.substr(value));
+  }
+}
+
+/* stat, with the command name (which may have spaces) as one field */
+void split_pid_stat(pid_file &f) {
+  std::string_view text(f.text);
+  size_t lparen = text.find('(');
+  size_t rparen = text.rfind(')');
+
+  if (lparen == std::string_view::npos || rparen == std::string_view::npos ||
+      rparen < lparen) {
+    f.ok = false;
+    return;
+  }
+  f.fields.emplace_back(std::string_view(), text.substr(0, lparen - 1));
+  f.fields.emplace_back(std::string_view(),
+                        text.substr(lparen + 1, rparen - lparen - 1));
+  text = text.substr(rparen + 1);
+  for (;;) {
+    size_t start = text.find_first_not_of(" \n");
+    if (start == std::string_view::npos) { break; }
+    size_t end = text.find_first_of(" \n", start);
+    f.fields.emplace_back(std::string_view(),
+                          text.substr(start, end - start));
+    if (end == std::string_view::npos) { break; }
+    text = text.substr(end);
+  }
+}
+
+std::string pid_file_path(const char *pid, pid_file_type type) {
+  return std::string(PROCDIR "/") + pid + "/" + pid_file_names[type];
+}
+
+const pid_file *get_pid_file(const char *pid, pid_file_type type) {
+  if (pid_snapshots_time != current_update_time) {
+    /* keep the processes shown last time, the rest are probably gone */
+    for (auto it = pid_snapshots.begin(); it != pid_snapshots.end();) {
+      if (it->second.time != pid_snapshots_time) {
+        it = pid_snapshots.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    pid_snapshots_time = current_update_time;
+  }
+
+  pid_snapshot &snapshot = pid_snapshots[pid];
+  if (snapshot.time != current_update_time) {
+    snapshot.time = current_update_time;
+    for (pid_file &f : snapshot.files) { f.read = false; }
+  }
+
+  pid_file &f = snapshot.files[type];
+  if (!f.read) {
+    int bytes_read;
+    char *buf = readfile(pid_file_path(pid, type).c_str(), &bytes_read, 1);
+
+    f.read = true;
+    f.ok = buf != nullptr;
+    f.text.assign(buf != nullptr ? buf : "", bytes_read);
+    f.fields.clear();
+    free(buf);
+    if (f.ok) {
+      if (type == PID_STAT) {
+        split_pid_stat(f);
+      } else {
+        split_pid_lines(f);
+      }
+    }
+  }
+  return f.ok ? &f : nullptr;
+}
+}  // namespace
+
+/* Looks up key in the status or io file of pid. Returns false if the file
+ * can't be read (which readfile() reports), or if key isn't in it, which is
+ * reported with notfound. */
+static bool get_pid_field(const char *pid, pid_file_type type, const char *key,
+                          const char *notfound, std::string_view &value) {
+  const pid_file *f = get_pid_file(pid, type);
+
+  if (f == nullptr) { return false; }
+  for (const auto &field : f->fields) {
+    if (field.first == key) {
+      value = field.second;
+      return true;
+    }
+  }
+  NORM_ERR(notfound, pid_file_path(pid, type).c_str());
+  return false;
+}
+
+/* field n of the stat file of pid, numbered like in proc(5) */
+static bool get_pid_stat(const char *pid, size_t n, std::string_view &value) {
+  const pid_file *f = get_pid_file(pid, PID_STAT);
+
+  if (f == nullptr || n < 1 || n > f->fields.size()) { return false; }
+  value = f->fields[n - 1].second;
+  return true;
+}
+
+static void print_view(char *p, unsigned int p_max_size,
+                       std::string_view value) {
+  snprintf(p, p_max_size, "%.*s", static_cast<int>(value.size()),
+           value.data());
+}
+
 void print_pid_chroot(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> buf(new char[max_user_text.get(*state)]);
+  conky::scratch_text buf(max_user_text.get(*state));
 
-  generate_text_internal(buf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(buf.get(), buf.size(), *obj->sub);
   pathstream << PROCDIR "/" << buf.get() << "/root";
   pid_readlink(pathstream.str().c_str(), p, p_max_size);
 }
@@ -115,9 +275,9 @@ void print_pid_cmdline(struct text_object *obj, char *p,
   char *buf;
   int i, bytes_read;
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
     pathstream << PROCDIR "/" << objbuf.get() << "/cmdline";
@@ -138,9 +298,9 @@ void print_pid_cwd(struct text_object *obj, char *p, unsigned int p_max_size) {
   std::unique_ptr<char[]> buf(new char[p_max_size]);
   int bytes_read;
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
   pathstream << PROCDIR "/" << objbuf.get() << "/cwd";
   bytes_read = readlink(pathstream.str().c_str(), buf.get(), p_max_size);
   if (bytes_read != -1) {
@@ -156,11 +316,11 @@ void print_pid_environ(struct text_object *obj, char *p,
   int i, total_read;
   pid_t pid;
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
   char *buf, *var = strdup(obj->data.s);
   ;
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
   if (sscanf(objbuf.get(), "%d %s", &pid, var) == 2) {
     for (i = 0; var[i] != 0; i++) {
       var[i] = toupper(static_cast<unsigned char>(var[i]));
@@ -191,9 +351,9 @@ void print_pid_environ_list(struct text_object *obj, char *p,
   int bytes_read, total_read;
   int i = 0;
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
   pathstream << PROCDIR "/" << objbuf.get() << "/environ";
 
   buf = readfile(pathstream.str().c_str(), &total_read, 1);
@@ -213,32 +373,22 @@ void print_pid_environ_list(struct text_object *obj, char *p,
 
 void print_pid_exe(struct text_object *obj, char *p, unsigned int p_max_size) {
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
   pathstream << PROCDIR "/" << objbuf.get() << "/exe";
   pid_readlink(pathstream.str().c_str(), p, p_max_size);
 }
 
 void print_pid_nice(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  long int nice_value;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (!obj->data.s) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      sscanf(buf,
-             "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d "
-             "%*d %*d %ld",
-             &nice_value);
-      snprintf(p, p_max_size, "%ld", nice_value);
-      free(buf);
+    if (get_pid_stat(objbuf.get(), 19, value)) {
+      print_view(p, p_max_size, value);
     }
   } else {
     NORM_ERR("$pid_nice didn't receive a argument");
@@ -253,9 +403,9 @@ void print_pid_openfiles(struct text_object *obj, char *p,
   int length, totallength = 0;
   struct ll_string *files_front = nullptr;
   struct ll_string *files_back = nullptr;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   dir = opendir(objbuf.get());
   if (dir != nullptr) {
@@ -283,117 +433,70 @@ void print_pid_openfiles(struct text_object *obj, char *p,
 
 void print_pid_parent(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-#define PARENT_ENTRY "PPid:\t"
-#define PARENTNOTFOUND "Can't find the process parent in '%s'"
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
-
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, PARENT_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(PARENT_ENTRY);
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      NORM_ERR(PARENTNOTFOUND, pathstream.str().c_str());
-    }
-    free(buf);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+  if (get_pid_field(objbuf.get(), PID_STATUS, "PPid",
+                    "Can't find the process parent in '%s'", value)) {
+    print_view(p, p_max_size, value);
   }
 }
 
 void print_pid_priority(struct text_object *obj, char *p,
                         unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  long int priority;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      sscanf(buf,
-             "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d "
-             "%*d %ld",
-             &priority);
-      snprintf(p, p_max_size, "%ld", priority);
-      free(buf);
+    if (get_pid_stat(objbuf.get(), 18, value)) {
+      print_view(p, p_max_size, value);
     }
   } else {
     NORM_ERR("$pid_priority didn't receive a argument");
   }
 }
 
+#define STATENOTFOUND "Can't find the process state in '%s'"
 void print_pid_state(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-#define STATE_ENTRY "State:\t"
-#define STATENOTFOUND "Can't find the process state in '%s'"
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
-
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, STATE_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(STATE_ENTRY) +
-               3;  // +3 will strip the char representing the short state and
-                   // the space and '(' that follow
-      end = strchr(begin, '\n');
-      if (end != nullptr) {
-        *(end - 1) = 0;  // -1 strips the ')'
-      }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      NORM_ERR(STATENOTFOUND, pathstream.str().c_str());
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
+
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+  if (get_pid_field(objbuf.get(), PID_STATUS, "State", STATENOTFOUND,
+                    value)) {
+    /* "S (sleeping)" */
+    size_t lparen = value.find('(');
+    if (lparen != std::string_view::npos) {
+      value = value.substr(lparen + 1);
+      if (!value.empty() && value.back() == ')') { value.remove_suffix(1); }
     }
-    free(buf);
+    print_view(p, p_max_size, value);
   }
 }
 
 void print_pid_state_short(struct text_object *obj, char *p,
                            unsigned int p_max_size) {
-  char *begin, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, STATE_ENTRY);
-    if (begin != nullptr) {
-      snprintf(p, p_max_size, "%c", *begin);
-    } else {
-      NORM_ERR(STATENOTFOUND, pathstream.str().c_str());
-    }
-    free(buf);
+  if (get_pid_field(objbuf.get(), PID_STATUS, "State", STATENOTFOUND,
+                    value)) {
+    print_view(p, p_max_size, value.substr(0, 1));
   }
 }
 
 void print_pid_stderr(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   pathstream << PROCDIR "/" << objbuf.get() << "/fd/2";
   pid_readlink(pathstream.str().c_str(), p, p_max_size);
@@ -401,10 +504,10 @@ void print_pid_stderr(struct text_object *obj, char *p,
 
 void print_pid_stdin(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
   std::ostringstream pathstream;
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   pathstream << PROCDIR "/" << objbuf.get() << "/fd/0";
   pid_readlink(pathstream.str().c_str(), p, p_max_size);
@@ -413,94 +516,192 @@ void print_pid_stdin(struct text_object *obj, char *p,
 void print_pid_stdout(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   pathstream << PROCDIR "/" << objbuf.get() << "/fd/1";
   pid_readlink(pathstream.str().c_str(), p, p_max_size);
 }
 
+struct cmdline_to_pid_data {
+  char *cmdline;
+  /* the process found last time, checked first */
+  pid_t pid;
+};
+
 void scan_cmdline_to_pid_arg(struct text_object *obj, const char *arg,
                              void *free_at_crash) {
   unsigned int i;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
   /* FIXME */
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (strlen(arg) > 0) {
-    obj->data.s = strdup(arg);
-    for (i = 0; obj->data.s[i] != 0; i++) {
-      while (obj->data.s[i] == ' ' && obj->data.s[i + 1] == ' ') {
-        memmove(obj->data.s + i, obj->data.s + i + 1,
-                strlen(obj->data.s + i + 1) + 1);
+    auto *cd = new cmdline_to_pid_data;
+    cd->cmdline = strdup(arg);
+    cd->pid = 0;
+    for (i = 0; cd->cmdline[i] != 0; i++) {
+      while (cd->cmdline[i] == ' ' && cd->cmdline[i + 1] == ' ') {
+        memmove(cd->cmdline + i, cd->cmdline + i + 1,
+                strlen(cd->cmdline + i + 1) + 1);
       }
     }
-    if (obj->data.s[i - 1] == ' ') { obj->data.s[i - 1] = 0; }
+    if (cd->cmdline[i - 1] == ' ') { cd->cmdline[i - 1] = 0; }
+    obj->data.opaque = cd;
   } else {
-    CRIT_ERR(obj, free_at_crash, "${cmdline_to_pid commandline}");
+    CRIT_ERR(nullptr, free_at_crash, "${cmdline_to_pid commandline}");
   }
 }
 
-void print_cmdline_to_pid(struct text_object *obj, char *p,
-                          unsigned int p_max_size) {
-  DIR *dir;
-  struct dirent *entry;
-  char *buf;
-  int bytes_read, i;
-  std::ostringstream pathstream;
+/* refreshed by get_proc_pids() and count_proc_pids(), which the callbacks
+ * of ${processes} and ${top} may call at the same time */
+static std::mutex proc_pids_mutex;
+static std::vector<pid_t> proc_pids;
+static double proc_pids_time = -1;
 
-  dir = opendir(PROCDIR);
-  if (dir != nullptr) {
-    while ((entry = readdir(dir)) != nullptr) {
-      pathstream << PROCDIR "/" << entry->d_name << "/cmdline";
+/* the pid a /proc entry's name stands for, 0 if it isn't a process */
+static pid_t proc_entry_pid(const char *name) {
+  pid_t pid = 0;
 
-      buf = readfile(pathstream.str().c_str(), &bytes_read, 0);
-      if (buf != nullptr) {
-        for (i = 0; i < bytes_read - 1; i++) {
-          if (buf[i] == 0) { buf[i] = ' '; }
-        }
-        if (strstr(buf, obj->data.s) != nullptr) {
-          snprintf(p, p_max_size, "%s", entry->d_name);
-          free(buf);
-          closedir(dir);
-          return;
-        }
-        free(buf);
-      }
+  if (*name < '1' || *name > '9') { return 0; }
+  for (; *name != '\0'; ++name) {
+    if (*name < '0' || *name > '9') { return 0; }
+    pid = pid * 10 + (*name - '0');
+  }
+  return pid;
+}
+
+#ifdef __linux__
+/* Lists /proc with getdents64() into a buffer that is kept, through a
+ * descriptor that is kept open and rewound. */
+static bool list_proc_pids(std::vector<pid_t> &pids) {
+  static int fd = -1;
+  static std::vector<char> buffer(64 * 1024);
+  long n;
+
+  if (fd < 0) { fd = open(PROCDIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC); }
+  if (fd < 0 || lseek(fd, 0, SEEK_SET) < 0) { return false; }
+
+  pids.clear();
+  while ((n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size())) >
+         0) {
+    for (long at = 0; at < n;) {
+      auto *entry = reinterpret_cast<struct dirent64 *>(&buffer[at]);
+      pid_t pid = proc_entry_pid(entry->d_name);
+      if (pid > 0) { pids.push_back(pid); }
+      at += entry->d_reclen;
     }
-    closedir(dir);
-  } else {
-    NORM_ERR(READERR, PROCDIR);
   }
+  return n == 0;
 }
+#else  /* __linux__ */
+static bool list_proc_pids(std::vector<pid_t> &pids) {
+  DIR *dir = opendir(PROCDIR);
+  struct dirent *entry;
 
-void print_pid_threads(struct text_object *obj, char *p,
-                       unsigned int p_max_size) {
-#define THREADS_ENTRY "Threads:\t"
-#define THREADSNOTFOUND \
-  "Can't find the number of the threads of the process in '%s'"
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
+  if (dir == nullptr) { return false; }
+  pids.clear();
+  while ((entry = readdir(dir)) != nullptr) {
+    pid_t pid = proc_entry_pid(entry->d_name);
+    if (pid > 0) { pids.push_back(pid); }
+  }
+  closedir(dir);
+  return true;
+}
+#endif /* __linux__ */
+
+/* lists the pids again if that hasn't happened in this update yet, with
+ * proc_pids_mutex held */
+static bool refresh_proc_pids() {
+  if (proc_pids_time == current_update_time) { return true; }
+  if (!list_proc_pids(proc_pids)) {
+    proc_pids.clear();
+    proc_pids_time = -1;
+    return false;
+  }
+  proc_pids_time = current_update_time;
+  return true;
+}
+
+bool get_proc_pids(std::vector<pid_t> &pids) {
+  std::lock_guard<std::mutex> lock(proc_pids_mutex);
+
+  if (!refresh_proc_pids()) { return false; }
+  pids = proc_pids;
+  return true;
+}
+
+bool count_proc_pids(size_t *count) {
+  std::lock_guard<std::mutex> lock(proc_pids_mutex);
+
+  if (!refresh_proc_pids()) { return false; }
+  *count = proc_pids.size();
+  return true;
+}
+
+static bool cmdline_contains(const char *pid, const char *cmdline) {
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  int bytes_read;
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
+  pathstream << PROCDIR "/" << pid << "/cmdline";
+  char *buf = readfile(pathstream.str().c_str(), &bytes_read, 0);
+  if (buf == nullptr) { return false; }
+  for (int i = 0; i < bytes_read - 1; i++) {
+    if (buf[i] == 0) { buf[i] = ' '; }
+  }
+  bool found = strstr(buf, cmdline) != nullptr;
+  free(buf);
+  return found;
+}
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, THREADS_ENTRY);
-    if (begin != nullptr) {
-      begin += strlen(THREADS_ENTRY);
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      NORM_ERR(THREADSNOTFOUND, pathstream.str().c_str());
+void print_cmdline_to_pid(struct text_object *obj, char *p,
+                          unsigned int p_max_size) {
+  auto *cd = static_cast<struct cmdline_to_pid_data *>(obj->data.opaque);
+  static std::vector<pid_t> pids;
+
+  /* processes rarely go away, so try the last one before walking them all */
+  if (cd->pid > 0 &&
+      cmdline_contains(std::to_string(cd->pid).c_str(), cd->cmdline)) {
+    snprintf(p, p_max_size, "%d", cd->pid);
+    return;
+  }
+  cd->pid = 0;
+
+  if (!get_proc_pids(pids)) {
+    NORM_ERR(READERR, PROCDIR);
+    return;
+  }
+  for (pid_t pid : pids) {
+    if (cmdline_contains(std::to_string(pid).c_str(), cd->cmdline)) {
+      snprintf(p, p_max_size, "%d", pid);
+      cd->pid = pid;
+      break;
     }
-    free(buf);
+  }
+}
+
+void free_cmdline_to_pid(struct text_object *obj) {
+  auto *cd = static_cast<struct cmdline_to_pid_data *>(obj->data.opaque);
+
+  if (cd == nullptr) { return; }
+  free(cd->cmdline);
+  delete cd;
+  obj->data.opaque = nullptr;
+}
+
+void print_pid_threads(struct text_object *obj, char *p,
+                       unsigned int p_max_size) {
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
+
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+  if (get_pid_field(
+          objbuf.get(), PID_STATUS, "Threads",
+          "Can't find the number of the threads of the process in '%s'",
+          value)) {
+    print_view(p, p_max_size, value);
   }
 }
 
@@ -510,9 +711,9 @@ void print_pid_thread_list(struct text_object *obj, char *p,
   struct dirent *entry;
   int totallength = 0;
   std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
   pathstream << PROCDIR "/" << objbuf.get() << "/task";
 
   dir = opendir(pathstream.str().c_str());
@@ -533,24 +734,29 @@ void print_pid_thread_list(struct text_object *obj, char *p,
   }
 }
 
+/* utime and stime are fields 14 and 15 of stat, in clock ticks */
+static bool get_pid_times(const char *pid, unsigned long *utime,
+                          unsigned long *stime) {
+  std::string_view u, s;
+
+  if (!get_pid_stat(pid, 14, u) || !get_pid_stat(pid, 15, s)) {
+    return false;
+  }
+  *utime = strtoul(std::string(u).c_str(), nullptr, 10);
+  *stime = strtoul(std::string(s).c_str(), nullptr, 10);
+  return true;
+}
+
 void print_pid_time_kernelmode(struct text_object *obj, char *p,
                                unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  unsigned long int umtime;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  unsigned long int utime, stime;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      sscanf(buf, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu",
-             &umtime);
-      snprintf(p, p_max_size, "%.2f", static_cast<float>(umtime) / 100);
-      free(buf);
+    if (get_pid_times(objbuf.get(), &utime, &stime)) {
+      snprintf(p, p_max_size, "%.2f", static_cast<float>(stime) / 100);
     }
   } else {
     NORM_ERR("$pid_time_kernelmode didn't receive a argument");
@@ -559,22 +765,14 @@ void print_pid_time_kernelmode(struct text_object *obj, char *p,
 
 void print_pid_time_usermode(struct text_object *obj, char *p,
                              unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  unsigned long int kmtime;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  unsigned long int utime, stime;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      sscanf(buf, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %lu",
-             &kmtime);
-      snprintf(p, p_max_size, "%.2f", static_cast<float>(kmtime) / 100);
-      free(buf);
+    if (get_pid_times(objbuf.get(), &utime, &stime)) {
+      snprintf(p, p_max_size, "%.2f", static_cast<float>(utime) / 100);
     }
   } else {
     NORM_ERR("$pid_time_usermode didn't receive a argument");
@@ -582,23 +780,15 @@ void print_pid_time_usermode(struct text_object *obj, char *p,
 }
 
 void print_pid_time(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *buf = nullptr;
-  int bytes_read;
-  unsigned long int umtime, kmtime;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  unsigned long int utime, stime;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   if (*(objbuf.get()) != 0) {
-    pathstream << PROCDIR "/" << objbuf.get() << "/stat";
-    buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-    if (buf != nullptr) {
-      sscanf(buf, "%*d %*s %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
-             &umtime, &kmtime);
+    if (get_pid_times(objbuf.get(), &utime, &stime)) {
       snprintf(p, p_max_size, "%.2f",
-               static_cast<float>(umtime + kmtime) / 100);
-      free(buf);
+               static_cast<float>(utime + stime) / 100);
     }
   } else {
     NORM_ERR("$pid_time didn't receive a argument");
@@ -609,124 +799,63 @@ enum xid_type { egid, euid, fsgid, fsuid, gid, sgid, suid, uid };
 
 void print_pid_Xid(struct text_object *obj, char *p, int p_max_size,
                    xid_type type) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
+  std::string_view value;
   std::string errorstring;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
+  const char *key = "Uid";
+  int column = 0;
+  conky::scratch_text objbuf(max_user_text.get(*state));
+
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+
+  /* "Uid:\treal\teffective\tsaved set\tfile system" and the same for Gid */
+  errorstring = "Can't find the process ";
+  switch (type) {
+    case egid:
+      key = "Gid";
+      column = 1;
+      errorstring.append("effective gid");
+      break;
+    case euid:
+      column = 1;
+      errorstring.append("effective uid");
+      break;
+    case fsgid:
+      key = "Gid";
+      column = 3;
+      errorstring.append("process file system gid");
+      break;
+    case fsuid:
+      column = 3;
+      errorstring.append("process file system uid");
+      break;
+    case gid:
+      key = "Gid";
+      errorstring.append("real gid");
+      break;
+    case sgid:
+      key = "Gid";
+      column = 2;
+      errorstring.append("saved set gid");
+      break;
+    case suid:
+      column = 2;
+      errorstring.append("saved set uid");
+      break;
+    case uid:
+      errorstring.append("real uid");
+      break;
+    default:
+      break;
+  }
+  errorstring.append(" in '%s'");
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    switch (type) {
-      case egid:
-        begin = strstr(buf, "Gid:\t");
-        break;
-      case euid:
-        begin = strstr(buf, "Uid:\t");
-        break;
-      case fsgid:
-        begin = strstr(buf, "Gid:\t");
-        break;
-      case fsuid:
-        begin = strstr(buf, "Uid:\t");
-        break;
-      case gid:
-        begin = strstr(buf, "Gid:\t");
-        break;
-      case sgid:
-        begin = strstr(buf, "Gid:\t");
-        break;
-      case suid:
-        begin = strstr(buf, "Uid:\t");
-        break;
-      case uid:
-        begin = strstr(buf, "Uid:\t");
-        break;
-      default:
-        break;
-    }
-    if (begin != nullptr) {
-      switch (type) {
-        case gid:
-          begin += strlen("Gid:\t");
-          break;
-        case uid:
-          begin += strlen("Uid:\t");
-          break;
-        case egid:
-        case euid:
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          break;
-        case sgid:
-        case suid:
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          break;
-        case fsgid:
-        case fsuid:
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          begin = strchr(begin, '\t');
-          begin++;
-          break;
-        default:
-          break;
-      }
-      if (type == fsgid || type == fsuid) {
-        end = strchr(begin, '\n');
-      } else {
-        end = strchr(begin, '\t');
-      }
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      errorstring = "Can't find the process ";
-      switch (type) {
-        case egid:
-          errorstring.append("effective gid");
-          break;
-        case euid:
-          errorstring.append("effective uid");
-          break;
-        case fsgid:
-          errorstring.append("process file system gid");
-          break;
-        case fsuid:
-          errorstring.append("process file system uid");
-          break;
-        case gid:
-          errorstring.append("real gid");
-          break;
-        case sgid:
-          errorstring.append("saved set gid");
-          break;
-        case suid:
-          errorstring.append("saved set uid");
-          break;
-        case uid:
-          errorstring.append("real uid");
-          break;
-        default:
-          break;
-      }
-      errorstring.append(" in '%s'");
-      NORM_ERR(errorstring.c_str(), pathstream.str().c_str());
+  if (get_pid_field(objbuf.get(), PID_STATUS, key, errorstring.c_str(),
+                    value)) {
+    for (; column > 0 && value.find('\t') != std::string_view::npos;
+         column--) {
+      value = value.substr(value.find('\t') + 1);
     }
-    free(buf);
+    print_view(p, p_max_size, value.substr(0, value.find('\t')));
   }
 }
 
@@ -766,141 +895,101 @@ void print_pid_uid(struct text_object *obj, char *p, unsigned int p_max_size) {
 
 void internal_print_pid_vm(struct text_object *obj, char *p, int p_max_size,
                            const char *entry, const char *errorstring) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/status";
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, entry);
-    if (begin != nullptr) {
-      begin += strlen(entry);
-      while (*begin == '\t' || *begin == ' ') { begin++; }
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      NORM_ERR(errorstring, pathstream.str().c_str());
-    }
-    free(buf);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+  if (get_pid_field(objbuf.get(), PID_STATUS, entry, errorstring, value)) {
+    print_view(p, p_max_size, value);
   }
 }
 
 void print_pid_vmpeak(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmPeak:\t",
+      obj, p, p_max_size, "VmPeak",
       "Can't find the process peak virtual memory size in '%s'");
 }
 
 void print_pid_vmsize(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmSize:\t",
+  internal_print_pid_vm(obj, p, p_max_size, "VmSize",
                         "Can't find the process virtual memory size in '%s'");
 }
 
 void print_pid_vmlck(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmLck:\t",
+  internal_print_pid_vm(obj, p, p_max_size, "VmLck",
                         "Can't find the process locked memory size in '%s'");
 }
 
 void print_pid_vmhwm(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmHWM:\t",
+      obj, p, p_max_size, "VmHWM",
       "Can't find the process peak resident set size in '%s'");
 }
 
 void print_pid_vmrss(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmHWM:\t",
+  internal_print_pid_vm(obj, p, p_max_size, "VmRSS",
                         "Can't find the process resident set size in '%s'");
 }
 
 void print_pid_vmdata(struct text_object *obj, char *p,
                       unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmData:\t",
+  internal_print_pid_vm(obj, p, p_max_size, "VmData",
                         "Can't find the process data segment size in '%s'");
 }
 
 void print_pid_vmstk(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmData:\t",
+  internal_print_pid_vm(obj, p, p_max_size, "VmStk",
                         "Can't find the process stack segment size in '%s'");
 }
 
 void print_pid_vmexe(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  internal_print_pid_vm(obj, p, p_max_size, "VmData:\t",
+  internal_print_pid_vm(obj, p, p_max_size, "VmExe",
                         "Can't find the process text segment size in '%s'");
 }
 
 void print_pid_vmlib(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmLib:\t",
+      obj, p, p_max_size, "VmLib",
       "Can't find the process shared library code size in '%s'");
 }
 
 void print_pid_vmpte(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
   internal_print_pid_vm(
-      obj, p, p_max_size, "VmPTE:\t",
+      obj, p, p_max_size, "VmPTE",
       "Can't find the process page table entries size in '%s'");
 }
 
-#define READ_ENTRY "read_bytes: "
-#define READNOTFOUND "Can't find the amount of bytes read in '%s'"
 void print_pid_read(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/io";
-
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, READ_ENTRY);
-    if (begin != nullptr) {
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      NORM_ERR(READNOTFOUND, pathstream.str().c_str());
-    }
-    free(buf);
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
+
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+  if (get_pid_field(objbuf.get(), PID_IO, "read_bytes",
+                    "Can't find the amount of bytes read in '%s'", value)) {
+    snprintf(p, p_max_size, "read_bytes: %.*s",
+             static_cast<int>(value.size()), value.data());
   }
 }
 
-#define WRITE_ENTRY "write_bytes: "
-#define WRITENOTFOUND "Can't find the amount of bytes written in '%s'"
 void print_pid_write(struct text_object *obj, char *p,
                      unsigned int p_max_size) {
-  char *begin, *end, *buf = nullptr;
-  int bytes_read;
-  std::ostringstream pathstream;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
-
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
-  pathstream << PROCDIR "/" << objbuf.get() << "/io";
-
-  buf = readfile(pathstream.str().c_str(), &bytes_read, 1);
-  if (buf != nullptr) {
-    begin = strstr(buf, WRITE_ENTRY);
-    if (begin != nullptr) {
-      end = strchr(begin, '\n');
-      if (end != nullptr) { *(end) = 0; }
-      snprintf(p, p_max_size, "%s", begin);
-    } else {
-      NORM_ERR(WRITENOTFOUND, pathstream.str().c_str());
-    }
-    free(buf);
+  std::string_view value;
+  conky::scratch_text objbuf(max_user_text.get(*state));
+
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
+  if (get_pid_field(objbuf.get(), PID_IO, "write_bytes",
+                    "Can't find the amount of bytes written in '%s'",
+                    value)) {
+    snprintf(p, p_max_size, "write_bytes: %.*s",
+             static_cast<int>(value.size()), value.data());
   }
 }
@@ -34,6 +34,15 @@
 #define READERR "Can't read '%s'"
 #define READSIZE 128
 
+#include <sys/types.h>
+#include <cstddef>
+#include <vector>
+
+/* The pids in /proc, listed at most once per update and shared by everyone
+ * who needs them. Return false if /proc can't be read. */
+bool get_proc_pids(std::vector<pid_t> &pids);
+bool count_proc_pids(size_t *count);
+
 void print_pid_chroot(struct text_object *obj, char *p,
                       unsigned int p_max_size);
 void print_pid_cmdline(struct text_object *obj, char *p,
@@ -96,5 +105,6 @@ void scan_cmdline_to_pid_arg(struct text_object *obj, const char *arg,
                              void *free_at_crash);
 void print_cmdline_to_pid(struct text_object *obj, char *p,
                           unsigned int p_max_size);
+void free_cmdline_to_pid(struct text_object *obj);
 
 #endif /* CONKY_PROC_H */
@@ -0,0 +1,540 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "profiling.hh"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "config.h"
+#include "conky.h"
+#include "logging.h"
+#include "text_object.h"
+
+namespace conky {
+namespace profile {
+
+/* a consistent copy of a record */
+class snapshot {
+ public:
+  /* histogram buckets, upper bounds in microseconds */
+  static constexpr uint32_t limits[] = {100,   200,   500,   1000,
+                                        2000,  5000,  10000, 20000,
+                                        50000, 100000, UINT32_MAX};
+  enum { BUCKETS = sizeof limits / sizeof limits[0] };
+
+  std::string name;
+  uint64_t count;
+  uint32_t last;
+  uint32_t worst;
+  uint32_t average;
+  uint32_t buckets[BUCKETS];
+
+  explicit snapshot(record &r);
+};
+
+constexpr uint32_t snapshot::limits[];
+
+namespace {
+/* the argument selecting each stage in ${conky_profile} */
+const char *stage_args[STAGE_COUNT] = {"update", "generate", "layout", "draw",
+                                       "gc"};
+enum { ALL_STAGES = -1, CALLBACKS = STAGE_COUNT, FLUSHES, LOG };
+
+/*
+ * Callbacks may be destroyed during static destruction, so the list of their
+ * records must outlive everything else. We therefore never destroy it.
+ */
+struct callback_records {
+  std::mutex mutex;
+  std::vector<callback_record *> records;
+};
+
+callback_records &get_callback_records() {
+  static auto *r = new callback_records;
+  return *r;
+}
+
+record stages[STAGE_COUNT] = {record("update_stuff"), record("generate_text"),
+                              record("update_text_area"), record("draw_stuff"),
+                              record("lua_gc")};
+std::map<std::string, std::unique_ptr<record>> flushes;
+
+bool keep_all = false;
+
+bool startup_profile = false;
+/* as close to the start of the process as static initialisation gets */
+const std::chrono::steady_clock::time_point startup_begin =
+    std::chrono::steady_clock::now();
+std::chrono::steady_clock::time_point startup_last = startup_begin;
+
+/*
+ * The trace events of one thread. Only that thread writes: it fills the slot
+ * at head, then publishes it by incrementing head. A reader copies the slots
+ * below head and afterwards drops those which the writer may have started to
+ * overwrite meanwhile, so no lock is held on either side.
+ */
+struct trace_ring {
+  /* one slot more than are read, the one being written */
+  enum { EVENTS = 2048, SLOTS = EVENTS + 1, NAME = 56 };
+
+  struct event {
+    char name[NAME];
+    int64_t begin; /* microseconds since startup_begin */
+    int64_t duration;
+  };
+
+  std::atomic<uint64_t> head{0};
+  event events[SLOTS];
+  int tid = 0;
+  std::atomic<bool> in_use{false};
+};
+
+/* Rings are kept for the thread ids to stay stable in a trace and so that
+ * threads started later (the pool after a reload) reuse them; like the
+ * callback records, they are never destroyed. */
+struct trace_rings {
+  std::mutex mutex;
+  std::vector<trace_ring *> rings;
+};
+
+trace_rings &get_trace_rings() {
+  static auto *r = new trace_rings;
+  return *r;
+}
+
+std::string trace_path;
+
+/* hands the ring of a thread back once the thread ends */
+struct trace_ring_owner {
+  trace_ring *ring = nullptr;
+  ~trace_ring_owner() {
+    if (ring != nullptr) { ring->in_use.store(false); }
+  }
+};
+
+trace_ring &thread_trace_ring() {
+  static thread_local trace_ring_owner owner;
+  if (owner.ring != nullptr) { return *owner.ring; }
+
+  trace_rings &tr = get_trace_rings();
+  std::lock_guard<std::mutex> lock(tr.mutex);
+  for (auto *r : tr.rings) {
+    bool free = false;
+    if (r->in_use.compare_exchange_strong(free, true)) {
+      owner.ring = r;
+      return *r;
+    }
+  }
+  owner.ring = new trace_ring;
+  owner.ring->tid = static_cast<int>(tr.rings.size()) + 1;
+  owner.ring->in_use.store(true);
+  tr.rings.push_back(owner.ring);
+  return *owner.ring;
+}
+
+void append_json_string(std::string &out, const char *str) {
+  out += '"';
+  for (; *str != 0; ++str) {
+    auto c = static_cast<unsigned char>(*str);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof buf, "\\u%04x", c);
+      out += buf;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  out += '"';
+}
+
+void format_time(char *buf, size_t size, uint32_t us) {
+  if (us < 1000) {
+    snprintf(buf, size, "%uus", us);
+  } else if (us < 1000000) {
+    snprintf(buf, size, "%.2fms", us / 1000.0);
+  } else {
+    snprintf(buf, size, "%.2fs", us / 1000000.0);
+  }
+}
+
+std::string describe(const snapshot &s) {
+  char last[16], average[16], worst[16], buf[256];
+
+  format_time(last, sizeof last, s.last);
+  format_time(average, sizeof average, s.average);
+  format_time(worst, sizeof worst, s.worst);
+  snprintf(buf, sizeof buf, "%s: last %s avg %s max %s", s.name.c_str(), last,
+           average, worst);
+  return buf;
+}
+
+std::string describe_histogram(const snapshot &s) {
+  std::string ret;
+  char limit[16], buf[64];
+
+  for (size_t i = 0; i < snapshot::BUCKETS; ++i) {
+    if (s.buckets[i] == 0) { continue; }
+    if (snapshot::limits[i] == UINT32_MAX) {
+      format_time(limit, sizeof limit, snapshot::limits[i - 1]);
+      snprintf(buf, sizeof buf, " >=%s:%u", limit, s.buckets[i]);
+    } else {
+      format_time(limit, sizeof limit, snapshot::limits[i]);
+      snprintf(buf, sizeof buf, " <%s:%u", limit, s.buckets[i]);
+    }
+    ret += buf;
+  }
+  return ret;
+}
+
+// slowest first
+std::vector<snapshot> callback_snapshots() {
+  std::vector<snapshot> ret;
+  callback_records &cr = get_callback_records();
+  {
+    std::lock_guard<std::mutex> lock(cr.mutex);
+    for (auto *r : cr.records) { ret.emplace_back(*r); }
+  }
+  std::sort(ret.begin(), ret.end(), [](const snapshot &a, const snapshot &b) {
+    return a.average > b.average;
+  });
+  return ret;
+}
+
+/* the LIMITED_ERR() call sites which held messages back, most first */
+std::vector<std::string> describe_log_limiters() {
+  std::vector<log_limiter::stats> all = log_limiter::all_stats();
+  std::sort(all.begin(), all.end(),
+            [](const log_limiter::stats &a, const log_limiter::stats &b) {
+              return a.suppressed > b.suppressed;
+            });
+
+  std::vector<std::string> ret;
+  char buf[128];
+  for (const auto &s : all) {
+    if (s.suppressed == 0) { continue; }
+    snprintf(buf, sizeof buf, "%s: printed %llu suppressed %llu",
+             s.site.c_str(), static_cast<unsigned long long>(s.printed),
+             static_cast<unsigned long long>(s.suppressed));
+    ret.emplace_back(buf);
+  }
+  return ret;
+}
+
+std::vector<snapshot> flush_snapshots() {
+  std::vector<snapshot> ret;
+  for (auto &f : flushes) { ret.emplace_back(*f.second); }
+  return ret;
+}
+}  // namespace
+
+record::record(std::string name_)
+    : name(std::move(name_)), history(), count(0), worst(0) {}
+
+void record::add(std::chrono::steady_clock::duration d) {
+  auto us = static_cast<uint32_t>(std::min<int64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(d).count(),
+      UINT32_MAX));
+
+  std::lock_guard<std::mutex> lock(mutex);
+  history[count % HISTORY] = us;
+  if (keep_all) { samples.push_back(us); }
+  ++count;
+  worst = std::max(worst, us);
+}
+
+snapshot::snapshot(record &r) : name(r.name), buckets() {
+  std::lock_guard<std::mutex> lock(r.mutex);
+
+  count = r.count;
+  worst = r.worst;
+  last = count > 0 ? r.history[(count - 1) % record::HISTORY] : 0;
+
+  size_t n = std::min<uint64_t>(count, record::HISTORY);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += r.history[i];
+    size_t b = 0;
+    while (b < BUCKETS - 1 && r.history[i] >= limits[b]) { ++b; }
+    ++buckets[b];
+  }
+  average = n > 0 ? sum / n : 0;
+}
+
+callback_record::callback_record(std::string name_) : record(std::move(name_)) {
+  callback_records &cr = get_callback_records();
+  std::lock_guard<std::mutex> lock(cr.mutex);
+  cr.records.push_back(this);
+}
+
+callback_record::~callback_record() {
+  callback_records &cr = get_callback_records();
+  std::lock_guard<std::mutex> lock(cr.mutex);
+  cr.records.erase(std::find(cr.records.begin(), cr.records.end(), this));
+}
+
+record &stage_record(stage s) { return stages[s]; }
+
+record &flush_record(const std::string &output) {
+  auto &r = flushes[output];
+  if (!r) { r.reset(new record("flush " + output)); }
+  return *r;
+}
+
+void dump(FILE *out) {
+  std::vector<snapshot> all;
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    all.emplace_back(stage_record(static_cast<stage>(i)));
+  }
+  for (auto &s : flush_snapshots()) { all.push_back(std::move(s)); }
+  for (auto &s : callback_snapshots()) { all.push_back(std::move(s)); }
+
+  fprintf(out, "conky profile (last %d samples):\n", record::HISTORY);
+  for (const auto &s : all) {
+    fprintf(out, "  %s\n", describe(s).c_str());
+    if (s.count > 0) { fprintf(out, "   %s\n", describe_histogram(s).c_str()); }
+  }
+  for (const auto &l : describe_log_limiters()) {
+    fprintf(out, "  %s\n", l.c_str());
+  }
+  fflush(out);
+}
+
+void keep_all_samples() { keep_all = true; }
+
+void print_percentiles(FILE *out) {
+  std::vector<record *> records;
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    records.push_back(&stage_record(static_cast<stage>(i)));
+  }
+  for (auto &f : flushes) { records.push_back(f.second.get()); }
+  callback_records &cr = get_callback_records();
+  std::lock_guard<std::mutex> cr_lock(cr.mutex);
+  for (auto *r : cr.records) { records.push_back(r); }
+
+  fprintf(out, "%-32s %8s %10s %10s %10s %10s\n", "stage", "samples", "p50",
+          "p90", "p99", "max");
+  for (record *r : records) {
+    std::vector<uint32_t> sorted;
+    {
+      std::lock_guard<std::mutex> lock(r->mutex);
+      sorted = r->samples;
+    }
+    if (sorted.empty()) { continue; }
+    std::sort(sorted.begin(), sorted.end());
+
+    char p50[16], p90[16], p99[16], max[16];
+    auto at = [&sorted](double q) {
+      return sorted[static_cast<size_t>(q * (sorted.size() - 1) + 0.5)];
+    };
+    format_time(p50, sizeof p50, at(0.5));
+    format_time(p90, sizeof p90, at(0.9));
+    format_time(p99, sizeof p99, at(0.99));
+    format_time(max, sizeof max, sorted.back());
+    fprintf(out, "%-32s %8zu %10s %10s %10s %10s\n", r->name.c_str(),
+            sorted.size(), p50, p90, p99, max);
+  }
+  fflush(out);
+}
+
+std::atomic<bool> trace_enabled{false};
+
+void trace_event(const char *name, std::chrono::steady_clock::time_point begin,
+                 std::chrono::steady_clock::time_point end) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  trace_ring &r = thread_trace_ring();
+  uint64_t h = r.head.load(std::memory_order_relaxed);
+  trace_ring::event &e = r.events[h % trace_ring::SLOTS];
+  strncpy(e.name, name, trace_ring::NAME - 1);
+  e.name[trace_ring::NAME - 1] = 0;
+  e.begin = duration_cast<microseconds>(begin - startup_begin).count();
+  e.duration = duration_cast<microseconds>(end - begin).count();
+  r.head.store(h + 1, std::memory_order_release);
+}
+
+void enable_tracing(const std::string &path) {
+  trace_path = path;
+  /* the main thread is the first one, thread 1 of the trace */
+  thread_trace_ring();
+  trace_enabled.store(true);
+}
+
+std::string trace_json() {
+  std::vector<trace_ring *> rings;
+  {
+    trace_rings &tr = get_trace_rings();
+    std::lock_guard<std::mutex> lock(tr.mutex);
+    rings = tr.rings;
+  }
+
+  std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  char buf[128];
+  const int pid = getpid();
+  bool first = true;
+  std::vector<trace_ring::event> events;
+  for (trace_ring *r : rings) {
+    char name[32] = "main";
+    if (r->tid != 1) { snprintf(name, sizeof name, "thread %d", r->tid); }
+    snprintf(buf, sizeof buf,
+             "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+             "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+             first ? "" : ",", pid, r->tid, name);
+    out += buf;
+    first = false;
+
+    uint64_t end = r->head.load(std::memory_order_acquire);
+    uint64_t begin = end > trace_ring::EVENTS ? end - trace_ring::EVENTS : 0;
+    events.clear();
+    for (uint64_t i = begin; i < end; ++i) {
+      events.push_back(r->events[i % trace_ring::SLOTS]);
+    }
+    /* the writer fills slot head % SLOTS before publishing it */
+    uint64_t now = r->head.load(std::memory_order_acquire);
+    uint64_t valid = now > trace_ring::EVENTS ? now - trace_ring::EVENTS : 0;
+
+    for (uint64_t i = std::max(begin, valid); i < end; ++i) {
+      const trace_ring::event &e = events[i - begin];
+      out += ",{\"name\":";
+      append_json_string(out, e.name);
+      snprintf(buf, sizeof buf,
+               ",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,"
+               "\"tid\":%d}",
+               static_cast<long long>(e.begin),
+               static_cast<long long>(e.duration), pid, r->tid);
+      out += buf;
+    }
+  }
+  out += "]}\n";
+  return out;
+}
+
+void write_trace() {
+  if (!tracing() || trace_path.empty()) { return; }
+  std::string json = trace_json();
+  FILE *f = fopen(trace_path.c_str(), "w");
+  if (f == nullptr) {
+    NORM_ERR("can't write the trace to '%s': %s", trace_path.c_str(),
+             strerror(errno));
+    return;
+  }
+  fwrite(json.data(), 1, json.size(), f);
+  fclose(f);
+  NORM_ERR("trace written to '%s'", trace_path.c_str());
+}
+
+void enable_startup_profile() { startup_profile = true; }
+
+void startup_mark(const char *phase) {
+  using std::chrono::duration;
+
+  if (!startup_profile) { return; }
+  auto now = std::chrono::steady_clock::now();
+  fprintf(stderr, "startup: %-16s %8.2fms (total %8.2fms)\n", phase,
+          duration<double, std::milli>(now - startup_last).count(),
+          duration<double, std::milli>(now - startup_begin).count());
+  startup_last = now;
+}
+
+void startup_done() {
+  startup_mark("first frame");
+  startup_profile = false;
+}
+
+}  // namespace profile
+}  // namespace conky
+
+void parse_conky_profile_arg(struct text_object *obj, const char *arg) {
+  using namespace conky::profile;
+
+  obj->data.i = ALL_STAGES;
+  if (arg == nullptr) { return; }
+
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    if (strcmp(arg, stage_args[i]) == 0) {
+      obj->data.i = i;
+      return;
+    }
+  }
+  if (strcmp(arg, "callbacks") == 0) {
+    obj->data.i = CALLBACKS;
+  } else if (strcmp(arg, "flush") == 0) {
+    obj->data.i = FLUSHES;
+  } else if (strcmp(arg, "log") == 0) {
+    obj->data.i = LOG;
+  } else {
+    NORM_ERR(
+        "conky_profile: unknown argument '%s', use one of update, generate, "
+        "layout, draw, gc, callbacks, flush or log",
+        arg);
+  }
+}
+
+void print_conky_profile(struct text_object *obj, char *p,
+                         unsigned int p_max_size) {
+  using namespace conky::profile;
+
+  if (obj->data.i == LOG) {
+    std::string out;
+    for (const auto &l : describe_log_limiters()) {
+      if (!out.empty()) { out += '\n'; }
+      out += l;
+    }
+    snprintf(p, p_max_size, "%s", out.c_str());
+    return;
+  }
+
+  std::vector<snapshot> snapshots;
+  if (obj->data.i == CALLBACKS) {
+    snapshots = callback_snapshots();
+  } else if (obj->data.i == FLUSHES) {
+    snapshots = flush_snapshots();
+  } else if (obj->data.i == ALL_STAGES) {
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+      snapshots.emplace_back(stage_record(static_cast<stage>(i)));
+    }
+  } else {
+    snapshots.emplace_back(stage_record(static_cast<stage>(obj->data.i)));
+  }
+
+  std::string out;
+  for (const auto &s : snapshots) {
+    if (!out.empty()) { out += '\n'; }
+    out += describe(s);
+  }
+  snprintf(p, p_max_size, "%s", out.c_str());
+}
@@ -0,0 +1,173 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef PROFILING_HH
+#define PROFILING_HH
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct text_object;
+
+namespace conky {
+namespace profile {
+
+/* the stages of a frame which are timed */
+enum stage {
+  UPDATE_STUFF,     /* update_stuff() */
+  GENERATE_TEXT,    /* generate_text_internal() on conky.text */
+  UPDATE_TEXT_AREA, /* update_text_area() */
+  DRAW_STUFF,       /* draw_stuff() */
+  LUA_GC,           /* llua_collect_garbage(), between frames */
+  STAGE_COUNT
+};
+
+/*
+ * The timings of one piece of code. Keeps the last HISTORY samples, from
+ * which the histogram is computed, and the worst case since startup. Samples
+ * can be added from any thread.
+ */
+class record {
+ public:
+  enum { HISTORY = 128 };
+
+  explicit record(std::string name_);
+
+  record(const record &) = delete;
+  record &operator=(const record &) = delete;
+
+  void add(std::chrono::steady_clock::duration d);
+
+  const std::string name;
+
+ private:
+  std::mutex mutex;
+  uint32_t history[HISTORY]; /* in microseconds */
+  std::vector<uint32_t> samples; /* all of them, see keep_all_samples() */
+  uint64_t count;
+  uint32_t worst;
+
+  friend class snapshot;
+  friend void print_percentiles(FILE *out);
+};
+
+/*
+ * --trace: while enabled, every scope and span is also kept as a trace event
+ * in a ring buffer of the thread it ran on, the last TRACE_EVENTS of each.
+ * The rings are written without locks and read by trace_json().
+ */
+extern std::atomic<bool> trace_enabled;
+
+inline bool tracing() { return trace_enabled.load(std::memory_order_relaxed); }
+
+void trace_event(const char *name, std::chrono::steady_clock::time_point begin,
+                 std::chrono::steady_clock::time_point end);
+
+/* measures the lifetime of the object */
+class scope {
+  record &r;
+  const std::chrono::steady_clock::time_point start;
+
+ public:
+  explicit scope(record &r_)
+      : r(r_), start(std::chrono::steady_clock::now()) {}
+  ~scope() {
+    auto end = std::chrono::steady_clock::now();
+    r.add(end - start);
+    if (tracing()) { trace_event(r.name.c_str(), start, end); }
+  }
+};
+
+/* a trace event lasting the lifetime of the object, not kept in any record;
+ * costs nothing but the check while tracing is off */
+class span {
+  const char *name;
+  std::chrono::steady_clock::time_point start;
+
+ public:
+  explicit span(const char *name_) : name(tracing() ? name_ : nullptr) {
+    if (name != nullptr) { start = std::chrono::steady_clock::now(); }
+  }
+  ~span() {
+    if (name != nullptr) {
+      trace_event(name, start, std::chrono::steady_clock::now());
+    }
+  }
+};
+
+/* a record owned by a callback (see update-cb.hh), listed while it lives */
+class callback_record : public record {
+ public:
+  explicit callback_record(std::string name_);
+  ~callback_record();
+};
+
+record &stage_record(stage s);
+
+/* the record of a display output's flush(), created on first use */
+record &flush_record(const std::string &output);
+
+/* print all records and their histograms */
+void dump(FILE *out);
+
+/* makes records keep every sample rather than the last HISTORY, for
+ * print_percentiles() */
+void keep_all_samples();
+/* print the percentiles of all samples of every record which has any */
+void print_percentiles(FILE *out);
+
+/* start tracing; write_trace() then writes to path, if it isn't empty */
+void enable_tracing(const std::string &path);
+/* the trace events of all threads in the Chrome trace event format, which
+ * chrome://tracing and Perfetto load */
+std::string trace_json();
+/* called for SIGUSR2, writes trace_json() to the --trace file */
+void write_trace();
+
+/*
+ * --startup-profile: each startup_mark() prints to stderr how long the named
+ * phase took, that is the time since the previous mark or since the process
+ * started. startup_done() ends the phase leading to the first frame and stops
+ * printing.
+ */
+void enable_startup_profile();
+void startup_mark(const char *phase);
+void startup_done();
+
+}  // namespace profile
+}  // namespace conky
+
+void parse_conky_profile_arg(struct text_object *, const char *);
+void print_conky_profile(struct text_object *, char *, unsigned int);
+
+#endif /* PROFILING_HH */
@@ -20,6 +20,9 @@
 #include "prss.h"
 #include <libxml/parser.h>
 #include <libxml/tree.h>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
 #include "conky.h"
 #include "logging.h"
 
@@ -27,9 +30,7 @@
 #define PARSE_OPTIONS 0
 #endif
 
-void prss_parse_doc(PRSS *result, xmlDocPtr doc);
-
-PRSS::PRSS(const std::string &xml_data)
+PRSS::PRSS()
     : version(nullptr),
       title(nullptr),
       link(nullptr),
@@ -44,15 +45,50 @@ PRSS::PRSS(const std::string &xml_data)
       copyright(nullptr),
       ttl(nullptr),
       items(nullptr),
-      item_count(0) {
-  std::unique_ptr<xmlDoc, void (*)(xmlDoc *)> doc(
-      xmlReadMemory(xml_data.c_str(), xml_data.length(), "", nullptr,
-                    PARSE_OPTIONS),
-      xmlFreeDoc);
+      item_count(0) {}
+
+PRSS::PRSS(const std::string &xml_data) : PRSS() {
+  PRSS_parser parser;
+  parser.feed(xml_data.c_str(), xml_data.length());
+  std::unique_ptr<PRSS> res = parser.finish();
+
+  std::swap(version, res->version);
+  std::swap(title, res->title);
+  std::swap(link, res->link);
+  std::swap(description, res->description);
+  std::swap(language, res->language);
+  std::swap(generator, res->generator);
+  std::swap(managingEditor, res->managingEditor);
+  std::swap(webMaster, res->webMaster);
+  std::swap(docs, res->docs);
+  std::swap(lastBuildDate, res->lastBuildDate);
+  std::swap(pubDate, res->pubDate);
+  std::swap(copyright, res->copyright);
+  std::swap(ttl, res->ttl);
+  std::swap(items, res->items);
+  std::swap(item_count, res->item_count);
+}
 
-  if (!doc) throw std::runtime_error("Unable to parse rss data");
+static size_t string_size(const char *s) {
+  return s != nullptr ? strlen(s) + 1 : 0;
+}
 
-  prss_parse_doc(this, doc.get());
+size_t PRSS::heap_size() const {
+  size_t size = string_size(version) + string_size(title) +
+                string_size(link) + string_size(description) +
+                string_size(language) + string_size(generator) +
+                string_size(managingEditor) + string_size(webMaster) +
+                string_size(docs) + string_size(lastBuildDate) +
+                string_size(pubDate) + string_size(copyright) +
+                string_size(ttl);
+  for (int i = 0; i < item_count; ++i) {
+    const PRSS_Item &item = items[i];
+    size += sizeof(PRSS_Item) + string_size(item.title) +
+            string_size(item.link) + string_size(item.description) +
+            string_size(item.category) + string_size(item.pubDate) +
+            string_size(item.guid);
+  }
+  return size;
 }
 
 void free_rss_items(PRSS *data) {
@@ -91,146 +127,195 @@ PRSS::~PRSS() {
   free(ttl);
 }
 
-static inline void prss_null_item(PRSS_Item *i) {
-  if (i != nullptr) { memset(i, 0, sizeof(*i)); }
-}
-
-static inline void read_item(PRSS_Item *res, xmlNodePtr data) {
-  prss_null_item(res);
-
-  for (; data; data = data->next) {
-    xmlNodePtr child;
-
-    if (data->type != XML_ELEMENT_NODE) { continue; }
-    child = data->children;
-
-    if (!child) { continue; }
-
-#define ASSIGN(a)                                          \
-  if (strcasecmp((const char *)data->name, #a) == EQUAL) { \
-    free_and_zero(res->a);                                 \
-    res->a = strdup((const char *)child->content);         \
-    continue;                                              \
-  }
-    ASSIGN(title);
-    ASSIGN(link);
-    ASSIGN(description);
-    ASSIGN(category);
-    ASSIGN(pubDate);
-    ASSIGN(guid);
-#undef ASSIGN
+/*
+ * The parser follows the documents the old tree walk understood: an <rss>
+ * root with the feed fields and items inside its <channel> (RSS 2.0 and
+ * before), or an <RDF> root with a <channel> holding the feed fields and
+ * the items next to it (RSS 1.0). Fields get the text directly inside them.
+ */
+struct PRSS_parser::state {
+  xmlSAXHandler sax;
+  xmlParserCtxtPtr ctxt{nullptr};
+  std::unique_ptr<PRSS> res{new PRSS};
+  std::vector<PRSS_Item> items;
+  int max_items;
+
+  bool rdf{false};
+  int depth{0};          /* of the element being parsed, the root is 1 */
+  int channel_depth{-1}; /* of the <channel> we are in */
+  int item_depth{-1};    /* of the <item> we are in */
+  int field_depth{-1};   /* of the element whose text goes to field */
+  char **field{nullptr};
+  std::string text;
+  bool done{false};   /* max_items have been read */
+  bool failed{false}; /* the document isn't well-formed */
+
+  explicit state(int max) : max_items(max) {}
+  ~state() {
+    for (auto &item : items) {
+      free(item.title);
+      free(item.link);
+      free(item.description);
+      free(item.category);
+      free(item.pubDate);
+      free(item.guid);
+    }
+    if (ctxt != nullptr) { xmlFreeParserCtxt(ctxt); }
   }
-}
-static inline void read_element(PRSS *res, xmlNodePtr n) {
-  xmlNodePtr child;
-
-  if (n->type != XML_ELEMENT_NODE) { return; }
-  child = n->children;
 
-  if (!child) { return; }
-
-#define ASSIGN(a)                                       \
-  if (strcasecmp((const char *)n->name, #a) == EQUAL) { \
-    free_and_zero(res->a);                              \
-    res->a = strdup((const char *)child->content);      \
-    return;                                             \
+  char **channel_field(const char *name) {
+#define FIELD(a) \
+  if (strcasecmp(name, #a) == EQUAL) { return &res->a; }
+    FIELD(title);
+    FIELD(link);
+    FIELD(description);
+    FIELD(language);
+    FIELD(pubDate);
+    FIELD(lastBuildDate);
+    FIELD(generator);
+    FIELD(docs);
+    FIELD(managingEditor);
+    FIELD(webMaster);
+    FIELD(copyright);
+    FIELD(ttl);
+#undef FIELD
+    return nullptr;
   }
-  ASSIGN(title);
-  ASSIGN(link);
-  ASSIGN(description);
-  ASSIGN(language);
-  ASSIGN(pubDate);
-  ASSIGN(lastBuildDate);
-  ASSIGN(generator);
-  ASSIGN(docs);
-  ASSIGN(managingEditor);
-  ASSIGN(webMaster);
-  ASSIGN(copyright);
-  ASSIGN(ttl);
-#undef ASSIGN
-  if (!strcasecmp((const char *)n->name, "item")) {
-    read_item(&res->items[res->item_count++], n->children);
+
+  char **item_field(const char *name) {
+    PRSS_Item &item = items.back();
+#define FIELD(a) \
+  if (strcasecmp(name, #a) == EQUAL) { return &item.a; }
+    FIELD(title);
+    FIELD(link);
+    FIELD(description);
+    FIELD(category);
+    FIELD(pubDate);
+    FIELD(guid);
+#undef FIELD
+    return nullptr;
   }
-}
 
-static inline int parse_rss_2_0(PRSS *res, xmlNodePtr root) {
-  xmlNodePtr channel = root->children;
-  xmlNodePtr n;
-  int items = 0;
+  bool is_item(const char *name) const {
+    if (rdf) { return depth == 2 && strcmp(name, "item") == EQUAL; }
+    return channel_depth == 2 && depth == 3 &&
+           strcasecmp(name, "item") == EQUAL;
+  }
 
-  DBGP("parsing rss 2.0 or <1 doc");
+  void start(const char *name) {
+    ++depth;
+    if (depth == 1) {
+      if (strcmp(name, "RDF") == EQUAL) {
+        DBGP("parsing rss 1.0 doc");
+        rdf = true;
+        res->version = strdup("1.0");
+      } else if (strcmp(name, "rss") == EQUAL) {
+        DBGP("parsing rss 2.0 or <1 doc");
+        res->version = strdup("2.0");
+      }
+      return;
+    }
+    if (res->version == nullptr || field != nullptr) { return; }
+
+    if (item_depth > 0) {
+      if (depth == item_depth + 1) { field = item_field(name); }
+    } else if (is_item(name)) {
+      item_depth = depth;
+      items.emplace_back();
+      memset(&items.back(), 0, sizeof(PRSS_Item));
+    } else if (channel_depth > 0) {
+      if (depth == channel_depth + 1) { field = channel_field(name); }
+    } else if (depth == 2 && strcmp(name, "channel") == EQUAL) {
+      channel_depth = depth;
+    }
 
-  while (channel && (channel->type != XML_ELEMENT_NODE ||
-                     strcmp((const char *)channel->name, "channel"))) {
-    channel = channel->next;
+    if (field != nullptr) {
+      field_depth = depth;
+      text.clear();
+    }
   }
-  if (!channel) { return 0; }
 
-  for (n = channel->children; n; n = n->next) {
-    if (n->type == XML_ELEMENT_NODE && !strcmp((const char *)n->name, "item")) {
-      ++items;
+  void end() {
+    if (field != nullptr && depth == field_depth) {
+      /* like the tree walk, leave empty elements alone */
+      if (!text.empty()) {
+        free(*field);
+        *field = strdup(text.c_str());
+      }
+      field = nullptr;
+    } else if (depth == item_depth) {
+      item_depth = -1;
+      if (static_cast<int>(items.size()) >= max_items) {
+        done = true;
+        xmlStopParser(ctxt);
+      }
+    } else if (depth == channel_depth) {
+      channel_depth = -1;
     }
+    --depth;
   }
 
-  free_and_zero(res->version);
-  res->version = strndup("2.0", text_buffer_size.get(*state));
-  free_rss_items(res);
-  res->items = (PRSS_Item *)malloc(items * sizeof(PRSS_Item));
-  res->item_count = 0;
-
-  for (n = channel->children; n; n = n->next) { read_element(res, n); }
-
-  return 1;
-}
-static inline int parse_rss_1_0(PRSS *res, xmlNodePtr root) {
-  int items = 0;
-  xmlNodePtr n;
-
-  DBGP("parsing rss 1.0 doc");
+  static void start_cb(void *ctx, const xmlChar *localname, const xmlChar *,
+                       const xmlChar *, int, const xmlChar **, int, int,
+                       const xmlChar **) {
+    static_cast<state *>(ctx)->start(reinterpret_cast<const char *>(localname));
+  }
 
-  for (n = root->children; n; n = n->next) {
-    if (n->type == XML_ELEMENT_NODE) {
-      if (!strcmp((const char *)n->name, "item")) {
-        ++items;
-      } else if (!strcmp((const char *)n->name, "channel")) {
-        xmlNodePtr i;
+  static void end_cb(void *ctx, const xmlChar *, const xmlChar *,
+                     const xmlChar *) {
+    static_cast<state *>(ctx)->end();
+  }
 
-        for (i = n->children; i; i = i->next) { read_element(res, i); }
-      }
+  static void text_cb(void *ctx, const xmlChar *ch, int len) {
+    auto *st = static_cast<state *>(ctx);
+    if (st->field != nullptr && st->depth == st->field_depth) {
+      st->text.append(reinterpret_cast<const char *>(ch), len);
     }
   }
+};
+
+PRSS_parser::PRSS_parser(int max_items) : s(new state(max_items)) {
+  memset(&s->sax, 0, sizeof(s->sax));
+  s->sax.initialized = XML_SAX2_MAGIC;
+  s->sax.startElementNs = &state::start_cb;
+  s->sax.endElementNs = &state::end_cb;
+  s->sax.characters = &state::text_cb;
+  s->sax.cdataBlock = &state::text_cb;
+
+  s->ctxt = xmlCreatePushParserCtxt(&s->sax, s.get(), nullptr, 0, nullptr);
+  if (s->ctxt == nullptr) {
+    throw std::runtime_error("Unable to create rss parser");
+  }
+  xmlCtxtUseOptions(s->ctxt, PARSE_OPTIONS);
+}
 
-  free_and_zero(res->version);
-  res->version = strndup("1.0", text_buffer_size.get(*state));
-  free_rss_items(res);
-  res->items = (PRSS_Item *)malloc(items * sizeof(PRSS_Item));
-  res->item_count = 0;
+PRSS_parser::~PRSS_parser() = default;
 
-  for (n = root->children; n; n = n->next) {
-    if (n->type == XML_ELEMENT_NODE && !strcmp((const char *)n->name, "item")) {
-      read_item(&res->items[res->item_count++], n->children);
-    }
-  }
+bool PRSS_parser::feed(const char *data, size_t len) {
+  if (s->done || s->failed) { return false; }
 
-  return 1;
+  if (xmlParseChunk(s->ctxt, data, len, 0) != 0 && !s->done) {
+    s->failed = true;
+  }
+  return !s->done && !s->failed;
 }
 
-void prss_parse_doc(PRSS *result, xmlDocPtr doc) {
-  xmlNodePtr root = xmlDocGetRootElement(doc);
-
-  do {
-    if (root->type == XML_ELEMENT_NODE) {
-      if (!strcmp((const char *)root->name, "RDF")) {
-        // RSS 1.0 document
-        parse_rss_1_0(result, root);
-        return;
-      } else if (!strcmp((const char *)root->name, "rss")) {
-        // RSS 2.0 or <1.0 document
-        parse_rss_2_0(result, root);
-        return;
-      }
+std::unique_ptr<PRSS> PRSS_parser::finish() {
+  if (!s->done && !s->failed) {
+    if (xmlParseChunk(s->ctxt, nullptr, 0, 1) != 0 ||
+        s->ctxt->wellFormed == 0) {
+      s->failed = true;
     }
-    root = root->next;
-  } while (root);
-  return;
+  }
+  if (s->failed) { throw std::runtime_error("Unable to parse rss data"); }
+
+  PRSS &res = *s->res;
+  if (!s->items.empty()) {
+    res.items =
+        static_cast<PRSS_Item *>(malloc(s->items.size() * sizeof(PRSS_Item)));
+    memcpy(res.items, s->items.data(), s->items.size() * sizeof(PRSS_Item));
+    res.item_count = s->items.size();
+    s->items.clear();
+  }
+  return std::move(s->res);
 }
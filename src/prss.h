@@ -19,6 +19,8 @@
 #define PRSS_H
 
 #include <libxml/parser.h>
+#include <climits>
+#include <memory>
 #include <string>
 
 typedef struct PRSS_Item_ {
@@ -50,8 +52,30 @@ class PRSS {
   PRSS_Item *items;
   int item_count;
 
+  PRSS();
   explicit PRSS(const std::string &xml_data);
   ~PRSS();
+
+  /* the length of the strings and the items, for ${conky_mem} */
+  size_t heap_size() const;
+};
+
+/*
+ * Parses a feed as it is being downloaded, without building a document tree,
+ * and stops once max_items items have been read.
+ */
+class PRSS_parser {
+  struct state;
+  std::unique_ptr<state> s;
+
+ public:
+  explicit PRSS_parser(int max_items = INT_MAX);
+  ~PRSS_parser();
+
+  // returns false once the rest of the feed isn't needed
+  bool feed(const char *data, size_t len);
+  // throws std::runtime_error if the data wasn't valid xml
+  std::unique_ptr<PRSS> finish();
 };
 
 #endif /* PRSS_H */
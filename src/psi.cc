@@ -0,0 +1,164 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "psi.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+#include "common.h"
+#include "conky.h"
+#include "key-table.hh"
+#include "logging.h"
+#include "reactor.hh"
+#include "text_object.h"
+
+extern double next_update_time;
+
+double psi_avg10(const char *buf, const char *end, bool full) {
+  /* some avg10=0.12 avg60=0.05 avg300=0.01 total=1234 */
+  static constexpr auto keys = conky::make_key_table("some", "full");
+  double value = 0;
+
+  conky::for_each_key_value(buf, end, keys,
+                            [&](size_t i, const char *v, const char *) {
+                              if ((i == 1) == full &&
+                                  strncmp(v, "avg10=", 6) == 0) {
+                                value = strtod(v + 6, nullptr);
+                              }
+                            });
+  return value;
+}
+
+psi_cb::psi_cb(double period, const std::string &resource, bool full)
+    : Base(period, true, Base::Tuple(resource, full)),
+      file(("/proc/pressure/" + resource).c_str()),
+      reported(0) {}
+
+void psi_cb::work() {
+  const char *buf = file.read(&reported);
+  double value = buf != nullptr ? psi_avg10(buf, buf + file.size(), get<1>())
+                                : 0;
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = value;
+}
+
+struct psi_obj {
+  conky::callback_handle<psi_cb> cb;
+  /* a PSI trigger of its own, or -1 if the object only polls */
+  int trigger_fd;
+};
+
+/*
+ * Arms a PSI trigger: the kernel reports POLLPRI on the fd once tasks have
+ * been stalled for stall_ms within a window_ms window. The update is then
+ * pulled forward to now, so the next reactor wait returns at once.
+ */
+static int psi_open_trigger(const std::string &resource, bool full,
+                            unsigned long stall_ms, unsigned long window_ms) {
+  std::string path = open_file_path(("/proc/pressure/" + resource).c_str());
+  int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    NORM_ERR("pressure: can't open %s: %s", path.c_str(), strerror(errno));
+    return -1;
+  }
+
+  char trigger[64];
+  snprintf(trigger, sizeof trigger, "%s %lu %lu", full ? "full" : "some",
+           stall_ms * 1000, window_ms * 1000);
+  /* the kernel wants the terminating NUL too */
+  if (write(fd, trigger, strlen(trigger) + 1) == -1) {
+    NORM_ERR("pressure: can't set trigger '%s' on %s: %s", trigger,
+             path.c_str(), strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  conky::main_reactor().add(fd, [] { next_update_time = get_time(); },
+                            POLLPRI);
+  return fd;
+}
+
+void parse_psi_arg(struct text_object *obj, const char *arg) {
+  char resource[8] = "", word[8] = "";
+  unsigned long stall_ms = 0, window_ms = 1000;
+  bool full = false, trigger = false;
+  int n = 0;
+
+  if (arg == nullptr || sscanf(arg, "%7s %n", resource, &n) < 1 ||
+      (strcmp(resource, "cpu") != 0 && strcmp(resource, "memory") != 0 &&
+       strcmp(resource, "io") != 0)) {
+    NORM_ERR("pressure needs a resource: cpu, memory or io");
+    return;
+  }
+  arg += n;
+  if (sscanf(arg, "%7s %n", word, &n) == 1 &&
+      (strcmp(word, "some") == 0 || strcmp(word, "full") == 0)) {
+    full = word[0] == 'f';
+    arg += n;
+  }
+  if (sscanf(arg, "trigger %lu %n", &stall_ms, &n) == 1) {
+    trigger = true;
+    arg += n;
+    sscanf(arg, "%lu", &window_ms);
+  } else if (*arg != 0) {
+    NORM_ERR("pressure: ignoring '%s', expected trigger <stall ms> [window ms]",
+             arg);
+  }
+
+  auto *psi = new psi_obj{conky::register_cb<psi_cb>(0, resource, full), -1};
+  if (trigger) {
+    psi->trigger_fd = psi_open_trigger(resource, full, stall_ms, window_ms);
+  }
+  obj->data.opaque = psi;
+}
+
+uint8_t psi_percentage(struct text_object *obj) {
+  auto *psi = static_cast<psi_obj *>(obj->data.opaque);
+
+  if (psi == nullptr) { return 0; }
+  return round_to_positive_int(psi->cb->read_result());
+}
+
+void free_psi(struct text_object *obj) {
+  auto *psi = static_cast<psi_obj *>(obj->data.opaque);
+
+  if (psi == nullptr) { return; }
+  if (psi->trigger_fd != -1) {
+    conky::main_reactor().remove(psi->trigger_fd);
+    close(psi->trigger_fd);
+  }
+  delete psi;
+  obj->data.opaque = nullptr;
+}
@@ -0,0 +1,61 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _PSI_H
+#define _PSI_H
+
+#include <string>
+
+#include "proc-file.hh"
+#include "update-cb.hh"
+
+/* avg10 of the "some" or "full" line of a PSI file, in percent */
+double psi_avg10(const char *buf, const char *end, bool full);
+
+/**
+ * Reads one of /proc/pressure/{cpu,memory,io} every update. Objects asking
+ * for the same resource and line share it, and with it the open file.
+ */
+class psi_cb : public conky::callback<double, std::string, bool> {
+  typedef conky::callback<double, std::string, bool> Base;
+
+  conky::proc_file file;
+  int reported;
+
+ protected:
+  virtual void work();
+
+ public:
+  psi_cb(double period, const std::string &resource, bool full);
+};
+
+void parse_psi_arg(struct text_object *, const char *);
+uint8_t psi_percentage(struct text_object *);
+void free_psi(struct text_object *);
+
+#endif /* _PSI_H */
@@ -38,87 +38,137 @@
 #include "specials.h"
 #include "text_object.h"
 
-struct pulseaudio_default_results get_result_copy();
-
-const struct pulseaudio_default_results pulseaudio_result0 = {std::string(),
-                                                              std::string(),
-                                                              std::string(),
-                                                              std::string(),
-                                                              0,
-                                                              0,
-                                                              0,
-                                                              0,
-                                                              std::string(),
-                                                              std::string(),
-                                                              0};
+const struct pulseaudio_default_results pulseaudio_result0;
 pulseaudio_c *pulseaudio = nullptr;
 
+/* Everything below up to init_pulseaudio() runs on the mainloop thread, or
+ * with the mainloop locked. The queries only go out when the subscription
+ * reports a change to the default sink, its card or the server, so reading
+ * the objects never waits for the sound server. */
+
+/* hands a copy of pending to the main thread */
+static void publish_pulseaudio(pulseaudio_c *puau) {
+  std::lock_guard<std::mutex> lock(puau->shared_mutex);
+  puau->shared = puau->pending;
+  ++puau->generation;
+}
+
+static void track_query(pulseaudio_c *puau, pa_operation *op,
+                        const char *error_msg) {
+  if (op == nullptr) {
+    NORM_ERR(error_msg);
+    return;
+  }
+  ++puau->queries;
+  pa_operation_unref(op);
+}
+
+/* called by each query callback once it got its last answer */
+static void query_done(pulseaudio_c *puau) {
+  --puau->queries;
+  pa_threaded_mainloop_signal(puau->mainloop, 0);
+}
+
+void pa_sink_info_callback(pa_context *c, const pa_sink_info *i, int eol,
+                           void *data);
+void pa_card_info_callback(pa_context *c, const pa_card_info *card, int eol,
+                           void *userdata);
+
+static void query_sink(pulseaudio_c *puau) {
+  track_query(puau,
+              pa_context_get_sink_info_by_name(
+                  puau->context, puau->pending.sink_name.c_str(),
+                  pa_sink_info_callback, puau),
+              "pa_context_get_sink_info_by_name() failed");
+}
+
+static void query_card(pulseaudio_c *puau) {
+  track_query(puau,
+              pa_context_get_card_info_by_index(
+                  puau->context, puau->pending.sink_card,
+                  pa_card_info_callback, puau),
+              "pa_context_get_card_info_by_index() failed");
+}
+
 void pa_sink_info_callback(pa_context *c, const pa_sink_info *i, int eol,
                            void *data) {
-  if (i != nullptr && data) {
-    struct pulseaudio_default_results *pdr =
-        (struct pulseaudio_default_results *)data;
-    pdr->sink_description.assign(i->description);
-    pdr->sink_mute = i->mute;
+  auto *puau = static_cast<pulseaudio_c *>(data);
+  (void)c;
+
+  if (eol != 0) {
+    query_done(puau);
+    return;
+  }
+  if (i == nullptr) { return; }
+
+  struct pulseaudio_default_results *pdr = &puau->pending;
+  pdr->sink_description.assign(i->description);
+  pdr->sink_mute = i->mute;
+  pdr->sink_index = i->index;
+  if (i->active_port != nullptr) {
+    pdr->sink_active_port_name.assign(i->active_port->name);
+    pdr->sink_active_port_description.assign(i->active_port->description);
+  } else {
+    pdr->sink_active_port_name.erase();
+    pdr->sink_active_port_description.erase();
+  }
+  pdr->sink_volume = round_to_positive_int(
+      100.0f * (float)pa_cvolume_avg(&(i->volume)) / (float)PA_VOLUME_NORM);
+
+  /* card events keep the card up to date as long as the sink stays on it */
+  if (i->card != pdr->sink_card) {
     pdr->sink_card = i->card;
-    pdr->sink_index = i->index;
-    if (i->active_port != nullptr) {
-      pdr->sink_active_port_name.assign(i->active_port->name);
-      pdr->sink_active_port_description.assign(i->active_port->description);
-    } else {
-      pdr->sink_active_port_name.erase();
-      pdr->sink_active_port_description.erase();
-    }
-    pdr->sink_volume = round_to_positive_int(
-        100.0f * (float)pa_cvolume_avg(&(i->volume)) / (float)PA_VOLUME_NORM);
-    pa_threaded_mainloop_signal(pulseaudio->mainloop, 0);
+    pdr->card_index = PA_INVALID_INDEX;
+    pdr->card_name.erase();
+    pdr->card_active_profile_description.erase();
+    if (pdr->sink_card != PA_INVALID_INDEX) { query_card(puau); }
   }
-  (void)c;
-  ++eol;
+  publish_pulseaudio(puau);
 }
 
 void pa_server_info_callback(pa_context *c, const pa_server_info *i,
                              void *userdata) {
-  if (i != nullptr) {
-    struct pulseaudio_default_results *pdr =
-        (struct pulseaudio_default_results *)userdata;
-    pdr->sink_name.assign(i->default_sink_name);
-    pa_threaded_mainloop_signal(pulseaudio->mainloop, 0);
-  }
+  auto *puau = static_cast<pulseaudio_c *>(userdata);
   (void)c;
-}
 
-void pa_server_sink_info_callback(pa_context *c, const pa_server_info *i,
-                                  void *userdata) {
   if (i != nullptr) {
-    struct pulseaudio_default_results *pdr =
-        (struct pulseaudio_default_results *)userdata;
-    pdr->sink_name.assign(i->default_sink_name);
-    if (pdr->sink_name.empty()) return;
-    pa_operation *op;
-    if (!(op = pa_context_get_sink_info_by_name(c, pdr->sink_name.c_str(),
-                                                pa_sink_info_callback, pdr))) {
-      NORM_ERR("pa_context_get_sink_info_by_index() failed");
-      return;
+    struct pulseaudio_default_results *pdr = &puau->pending;
+    const char *name =
+        i->default_sink_name != nullptr ? i->default_sink_name : "";
+
+    if (pdr->sink_name != name) {
+      /* everything else is about the old default sink */
+      *pdr = pulseaudio_default_results();
+      pdr->sink_name.assign(name);
+      if (!pdr->sink_name.empty()) { query_sink(puau); }
+      publish_pulseaudio(puau);
     }
-    pa_operation_unref(op);
   }
-  (void)c;
+  query_done(puau);
 }
 
 void pa_card_info_callback(pa_context *c, const pa_card_info *card, int eol,
                            void *userdata) {
-  if (card) {
-    struct pulseaudio_default_results *pdr =
-        (struct pulseaudio_default_results *)userdata;
-    pdr->card_name.assign(card->name);
-    pdr->card_index = card->index;
+  auto *puau = static_cast<pulseaudio_c *>(userdata);
+  (void)c;
+
+  if (eol != 0) {
+    query_done(puau);
+    return;
+  }
+  /* the sink may have moved on while the answer was on its way */
+  if (card == nullptr || card->index != puau->pending.sink_card) { return; }
+
+  struct pulseaudio_default_results *pdr = &puau->pending;
+  pdr->card_name.assign(card->name);
+  pdr->card_index = card->index;
+  if (card->active_profile != nullptr) {
     pdr->card_active_profile_description.assign(
         card->active_profile->description);
-    pa_threaded_mainloop_signal(pulseaudio->mainloop, 0);
+  } else {
+    pdr->card_active_profile_description.erase();
   }
-  (void)c;
-  eol++;
+  publish_pulseaudio(puau);
 }
 
 void context_state_cb(pa_context *c, void *userdata) {
@@ -142,56 +192,39 @@ void context_state_cb(pa_context *c, void *userdata) {
     default:
       return;
   }
+  pa_threaded_mainloop_signal(puau_int->mainloop, 0);
 }
 
-#define PULSEAUDIO_OP(command, error_msg) \
-  if (!(op = command)) {                  \
-    NORM_ERR(error_msg);                  \
-    return;                               \
-  }                                       \
-  pa_operation_unref(op);
-
 void subscribe_cb(pa_context *c, pa_subscription_event_type_t t, uint32_t index,
                   void *userdata) {
-  struct pulseaudio_default_results *res =
-      (struct pulseaudio_default_results *)userdata;
+  auto *puau = static_cast<pulseaudio_c *>(userdata);
+  struct pulseaudio_default_results *res = &puau->pending;
+  (void)c;
+
+  /* a removed default sink or card comes with a server event naming the new
+   * one */
+  if ((t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) == PA_SUBSCRIPTION_EVENT_REMOVE) {
+    return;
+  }
 
   switch (t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) {
-    case PA_SUBSCRIPTION_EVENT_SINK: {
-      if (res->sink_name.empty()) return;
-      pa_operation *op;
-      PULSEAUDIO_OP(pa_context_get_sink_info_by_name(
-                        c, res->sink_name.c_str(), pa_sink_info_callback, res),
-                    "pa_context_get_sink_info_by_name failed");
-    } break;
+    case PA_SUBSCRIPTION_EVENT_SINK:
+      if (index == res->sink_index) { query_sink(puau); }
+      break;
 
     case PA_SUBSCRIPTION_EVENT_CARD:
-      if (index == res->card_index && res->card_index != (uint32_t)-1) {
-        pa_operation *op;
-        PULSEAUDIO_OP(pa_context_get_card_info_by_index(
-                          c, index, pa_card_info_callback, res),
-                      "pa_context_get_card_info_by_index() failed")
-      }
+      if (index == res->sink_card) { query_card(puau); }
       break;
 
-    case PA_SUBSCRIPTION_EVENT_SERVER: {
-      pa_operation *op;
-      PULSEAUDIO_OP(
-          pa_context_get_server_info(c, pa_server_sink_info_callback, res),
-          "pa_context_get_server_info() failed");
-    } break;
+    case PA_SUBSCRIPTION_EVENT_SERVER:
+      track_query(puau,
+                  pa_context_get_server_info(puau->context,
+                                             pa_server_info_callback, puau),
+                  "pa_context_get_server_info() failed");
+      break;
   }
 }
 
-#define PULSEAUDIO_WAIT(COMMAND)                                 \
-  {                                                              \
-    op = COMMAND;                                                \
-    while (pa_operation_get_state(op) == PA_OPERATION_RUNNING) { \
-      pa_threaded_mainloop_wait(pulseaudio->mainloop);           \
-    }                                                            \
-    pa_operation_unref(op);                                      \
-  }
-
 void init_pulseaudio(struct text_object *obj) {
   // already initialized
   (void)obj;
@@ -224,43 +257,24 @@ void init_pulseaudio(struct text_object *obj) {
     CRIT_ERR(nullptr, NULL, "Cannot connect to pulseaudio");
     return;
   }
-  pa_threaded_mainloop_start(pulseaudio->mainloop);
 
-  while (pulseaudio->cstate != PULSE_CONTEXT_READY) {
-    struct timespec req;
-    struct timespec rem;
-    req.tv_sec = 1;
-    req.tv_nsec = 200000;
+  pa_threaded_mainloop_lock(pulseaudio->mainloop);
+  pa_threaded_mainloop_start(pulseaudio->mainloop);
 
-    nanosleep(&req, &rem);
+  while (pulseaudio->cstate == PULSE_CONTEXT_INITIALIZING) {
+    pa_threaded_mainloop_wait(pulseaudio->mainloop);
   }
-
-  // Initial parameters update
-
-  pa_operation *op;
-  PULSEAUDIO_WAIT(pa_context_get_server_info(
-      pulseaudio->context, pa_server_info_callback, &pulseaudio->result));
-
-  if (pulseaudio->result.sink_name.empty()) return;
-
-  PULSEAUDIO_WAIT(pa_context_get_sink_info_by_name(
-      pulseaudio->context, pulseaudio->result.sink_name.c_str(),
-      pa_sink_info_callback, &pulseaudio->result));
-
-  if (pulseaudio->result.sink_name.empty()) {
-    NORM_ERR("Incorrect pulseaudio sink information.");
+  if (pulseaudio->cstate != PULSE_CONTEXT_READY) {
+    pa_threaded_mainloop_unlock(pulseaudio->mainloop);
+    NORM_ERR("Cannot connect to pulseaudio");
     return;
   }
 
-  if (pulseaudio->result.sink_card != (uint32_t)-1)
-    PULSEAUDIO_WAIT(pa_context_get_card_info_by_index(
-        pulseaudio->context, pulseaudio->result.sink_card,
-        pa_card_info_callback, &pulseaudio->result));
-
   // get notification when something changes in PA
   pa_context_set_subscribe_callback(pulseaudio->context, subscribe_cb,
-                                    &pulseaudio->result);
+                                    pulseaudio);
 
+  pa_operation *op;
   if (!(op = pa_context_subscribe(
             pulseaudio->context,
             (pa_subscription_mask_t)(PA_SUBSCRIPTION_MASK_SINK |
@@ -268,9 +282,24 @@ void init_pulseaudio(struct text_object *obj) {
                                      PA_SUBSCRIPTION_MASK_CARD),
             nullptr, NULL))) {
     NORM_ERR("pa_context_subscribe() failed");
-    return;
+  } else {
+    pa_operation_unref(op);
+  }
+
+  // Initial parameters update, the server info brings the sink and its card
+  track_query(pulseaudio,
+              pa_context_get_server_info(pulseaudio->context,
+                                         pa_server_info_callback, pulseaudio),
+              "pa_context_get_server_info() failed");
+  while (pulseaudio->queries > 0 &&
+         pulseaudio->cstate == PULSE_CONTEXT_READY) {
+    pa_threaded_mainloop_wait(pulseaudio->mainloop);
+  }
+  pa_threaded_mainloop_unlock(pulseaudio->mainloop);
+
+  if (pulseaudio->pending.sink_name.empty()) {
+    NORM_ERR("Incorrect pulseaudio sink information.");
   }
-  pa_operation_unref(op);
 }
 
 void free_pulseaudio(struct text_object *obj) {
@@ -285,24 +314,31 @@ void free_pulseaudio(struct text_object *obj) {
 
   puau_int->cstate = PULSE_CONTEXT_FINISHED;
 
+  if (puau_int->mainloop) { pa_threaded_mainloop_stop(puau_int->mainloop); }
   if (puau_int->context) {
     pa_context_set_state_callback(puau_int->context, nullptr, NULL);
     pa_context_disconnect(puau_int->context);
     pa_context_unref(puau_int->context);
   }
-  if (puau_int->mainloop) {
-    pa_threaded_mainloop_stop(puau_int->mainloop);
-    pa_threaded_mainloop_free(puau_int->mainloop);
-  }
+  if (puau_int->mainloop) { pa_threaded_mainloop_free(puau_int->mainloop); }
+  if (pulseaudio == puau_int) { pulseaudio = nullptr; }
   delete puau_int;
   puau_int = nullptr;
 }
 
-struct pulseaudio_default_results get_pulseaudio(struct text_object *obj) {
+/* takes the latest values from the mainloop thread if there are any, so
+ * the objects read them without a copy or a lock most of the time */
+const struct pulseaudio_default_results &get_pulseaudio(
+    struct text_object *obj) {
   pulseaudio_c *puau_int = static_cast<pulseaudio_c *>(obj->data.opaque);
-  if (puau_int && puau_int->cstate == PULSE_CONTEXT_READY)
-    return puau_int->result;
-  return pulseaudio_result0;
+  if (!puau_int || puau_int->cstate != PULSE_CONTEXT_READY)
+    return pulseaudio_result0;
+  if (puau_int->generation.load() != puau_int->seen) {
+    std::lock_guard<std::mutex> lock(puau_int->shared_mutex);
+    puau_int->result = puau_int->shared;
+    puau_int->seen = puau_int->generation.load();
+  }
+  return puau_int->result;
 }
 
 uint8_t puau_vol(struct text_object *obj) {
@@ -31,6 +31,10 @@
 #define _PULSEAUDIO_H
 
 #include <pulse/pulseaudio.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
 #include "text_object.h"
 
 void init_pulseaudio(struct text_object *obj);
@@ -55,15 +59,15 @@ struct pulseaudio_default_results {
   std::string sink_description;
   std::string sink_active_port_name;
   std::string sink_active_port_description;
-  uint32_t sink_card;
-  int sink_mute;
-  uint32_t sink_index;
-  unsigned int sink_volume;  // percentage
+  uint32_t sink_card = PA_INVALID_INDEX;
+  int sink_mute = 0;
+  uint32_t sink_index = PA_INVALID_INDEX;
+  unsigned int sink_volume = 0;  // percentage
 
   // default card
   std::string card_active_profile_description;
   std::string card_name;
-  uint32_t card_index;
+  uint32_t card_index = PA_INVALID_INDEX;
 };
 
 enum pulseaudio_state {
@@ -79,15 +83,31 @@ class pulseaudio_c {
   pa_context *context;
   volatile enum pulseaudio_state cstate;
   int ninits;
+
+  /* kept up to date from the subscription events on the mainloop thread */
+  struct pulseaudio_default_results pending;
+  /* queries sent and not yet answered, mainloop thread only */
+  int queries;
+
+  /* the last copy of pending the mainloop thread handed over */
+  std::mutex shared_mutex;
+  struct pulseaudio_default_results shared;
+  std::atomic<uint64_t> generation;
+
+  /* what the objects read, main thread only; refreshed from shared once per
+   * change */
   struct pulseaudio_default_results result;
+  uint64_t seen;
+
   pulseaudio_c()
       : mainloop(nullptr),
         mainloop_api(nullptr),
         context(nullptr),
         cstate(PULSE_CONTEXT_INITIALIZING),
         ninits(0),
-        result({std::string(), std::string(), std::string(), std::string(), 0,
-                0, 0, 0, std::string(), std::string(), 0}){};
+        queries(0),
+        generation(0),
+        seen(0){};
 };
 
 #endif /* _PULSEAUDIO_H */
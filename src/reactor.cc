@@ -0,0 +1,211 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "reactor.hh"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+#include "c++wrap.hh"
+#include "common.h"
+#include "logging.h"
+
+namespace conky {
+
+reactor::reactor() : epoll_fd(-1), timer_fd(-1) {
+  std::tie(wake_read, wake_write) = pipe2(O_CLOEXEC);
+  fcntl(wake_read, F_SETFL, fcntl(wake_read, F_GETFL) | O_NONBLOCK);
+  fcntl(wake_write, F_SETFL, fcntl(wake_write, F_GETFL) | O_NONBLOCK);
+
+#ifdef __linux__
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (epoll_fd != -1 && timer_fd != -1) {
+    struct epoll_event ev {};
+    ev.events = EPOLLIN;
+    ev.data.fd = wake_read;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_read, &ev);
+    ev.data.fd = timer_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev);
+  } else {
+    NORM_ERR("can't set up epoll, falling back to poll(): %s",
+             strerror(errno));
+    if (epoll_fd != -1) { close(epoll_fd); }
+    if (timer_fd != -1) { close(timer_fd); }
+    epoll_fd = timer_fd = -1;
+  }
+#endif
+}
+
+reactor::~reactor() {
+  if (epoll_fd != -1) { close(epoll_fd); }
+  if (timer_fd != -1) { close(timer_fd); }
+  close(wake_read);
+  close(wake_write);
+}
+
+void reactor::add(int fd, std::function<void()> on_ready, short events) {
+  handlers[fd] = watch{events, std::move(on_ready)};
+#ifdef __linux__
+  if (epoll_fd != -1) {
+    struct epoll_event ev {};
+    ev.events = ((events & POLLIN) != 0 ? EPOLLIN : 0) |
+                ((events & POLLPRI) != 0 ? EPOLLPRI : 0) |
+                ((events & POLLOUT) != 0 ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    /* closing an fd drops it from the epoll set, so re-adding is fine */
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1 && errno != EEXIST) {
+      NORM_ERR("can't watch fd %d: %s", fd, strerror(errno));
+    }
+  }
+#endif
+}
+
+void reactor::remove(int fd) {
+  if (handlers.erase(fd) == 0) { return; }
+#ifdef __linux__
+  if (epoll_fd != -1) { epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr); }
+#endif
+}
+
+void reactor::wake() {
+  int saved_errno = errno;
+  char c = 0;
+  /* a full pipe already guarantees a wakeup */
+  if (write(wake_write, &c, 1) == -1) {}
+  errno = saved_errno;
+}
+
+void reactor::drain_wakeups() {
+  char buf[64];
+  while (read(wake_read, buf, sizeof buf) > 0) {}
+}
+
+bool reactor::wait(double deadline) {
+  double timeout = deadline - get_time();
+  if (timeout <= 0) { return true; }
+
+#ifdef __linux__
+  bool expired = epoll_fd != -1 ? wait_epoll(timeout) : wait_poll(timeout);
+#else
+  bool expired = wait_poll(timeout);
+#endif
+  return expired || get_time() >= deadline;
+}
+
+#ifdef __linux__
+bool reactor::wait_epoll(double timeout) {
+  struct itimerspec its {};
+  its.it_value.tv_sec = static_cast<time_t>(timeout);
+  its.it_value.tv_nsec =
+      static_cast<long>((timeout - its.it_value.tv_sec) * 1000000000L);
+  /* an all-zero it_value would disarm the timer instead */
+  if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+    its.it_value.tv_nsec = 1;
+  }
+  timerfd_settime(timer_fd, 0, &its, nullptr);
+
+  struct epoll_event events[16];
+  int n = epoll_wait(epoll_fd, events, 16, -1);
+  if (n == -1) {
+    if (errno != EINTR) {
+      NORM_ERR("can't epoll_wait(): %s", strerror(errno));
+    }
+    return false;
+  }
+
+  bool expired = false;
+  for (int i = 0; i < n; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == timer_fd) {
+      uint64_t ticks;
+      if (read(timer_fd, &ticks, sizeof ticks) > 0) { expired = true; }
+    } else if (fd == wake_read) {
+      drain_wakeups();
+    } else {
+      /* a handler may remove fds, so look each one up again */
+      auto it = handlers.find(fd);
+      if (it != handlers.end()) {
+        auto handler = it->second.handler;
+        handler();
+      }
+    }
+  }
+  return expired;
+}
+#endif
+
+bool reactor::wait_poll(double timeout) {
+  std::vector<struct pollfd> fds;
+  fds.reserve(handlers.size() + 1);
+  fds.push_back({wake_read, POLLIN, 0});
+  for (const auto &h : handlers) {
+    fds.push_back({h.first, h.second.events, 0});
+  }
+
+  int n = poll(fds.data(), fds.size(),
+               static_cast<int>(std::ceil(timeout * 1000)));
+  if (n == -1) {
+    if (errno != EINTR) { NORM_ERR("can't poll(): %s", strerror(errno)); }
+    return false;
+  }
+  if (n == 0) { return true; }
+
+  if ((fds[0].revents & POLLIN) != 0) { drain_wakeups(); }
+  for (size_t i = 1; i < fds.size(); ++i) {
+    if (fds[i].revents == 0) { continue; }
+    auto it = handlers.find(fds[i].fd);
+    if (it != handlers.end()) {
+      auto handler = it->second.handler;
+      handler();
+    }
+  }
+  return false;
+}
+
+reactor &main_reactor() {
+  static reactor r;
+  return r;
+}
+
+}  // namespace conky
@@ -0,0 +1,97 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef REACTOR_HH
+#define REACTOR_HH
+
+#include <poll.h>
+
+#include <functional>
+#include <unordered_map>
+
+namespace conky {
+
+/*
+ * Single wait point of the main loop. Everything that can make conky do work
+ * between two updates (the X connection, inotify, signals) is a file
+ * descriptor registered here, and the update interval is the deadline passed
+ * to wait(). On Linux this is an epoll set with a timerfd for the deadline,
+ * elsewhere a plain poll().
+ *
+ * Handlers run on the main thread from inside wait(). They should only record
+ * that something happened; the main loop does the real work once wait()
+ * returns, when it is safe to e.g. reload the config or close the display.
+ */
+class reactor {
+  struct watch {
+    short events;
+    std::function<void()> handler;
+  };
+
+  std::unordered_map<int, watch> handlers;
+  int wake_read;
+  int wake_write;
+  int epoll_fd;
+  int timer_fd;
+
+  reactor(const reactor &) = delete;
+  reactor &operator=(const reactor &) = delete;
+
+  void drain_wakeups();
+  bool wait_poll(double timeout);
+#ifdef __linux__
+  bool wait_epoll(double timeout);
+#endif
+
+ public:
+  reactor();
+  ~reactor();
+
+  /* events are poll() bits; POLLPRI is for files such as PSI triggers that
+   * always poll readable and signal with an exceptional condition, POLLOUT
+   * for sockets still connecting. Changing the events of an fd takes a
+   * remove() first. */
+  void add(int fd, std::function<void()> on_ready, short events = POLLIN);
+  void remove(int fd);
+
+  /* Make a pending or the next wait() return. Async-signal-safe. */
+  void wake();
+
+  /*
+   * Block until a registered fd becomes readable, wake() is called or the
+   * get_time() based deadline passes. Returns true iff the deadline has been
+   * reached.
+   */
+  bool wait(double deadline);
+};
+
+reactor &main_reactor();
+
+}  // namespace conky
+
+#endif /* REACTOR_HH */
@@ -30,212 +30,294 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
-#include <sys/time.h>
+#include <sys/socket.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cerrno>
 #include <cinttypes>
 #include <cstdlib>
+#include <ctime>
+#include <mutex>
 #include <string>
+#include <vector>
 #include "conky.h"
 #include "logging.h"
+#include "reactor.hh"
 #include "text_object.h"
+#include "update-cb.hh"
 
 #ifndef SOCK_CLOEXEC
 #define SOCK_CLOEXEC O_CLOEXEC
 #endif /* SOCK_CLOEXEC */
 
-struct read_tcpip_data {
-  char *host;
-  unsigned int port;
+#define DEFAULT_TCP_PING_PORT 80
+/* seconds tcp_ping waits for the connection before the host is down */
+#define TCP_PING_TIMEOUT 10
+#define TCP_PING_FAILED "down"
+/* seconds read_tcp and read_udp wait for an answer */
+#define READ_TCPIP_TIMEOUT 1
+/* seconds before a host is resolved again, or after a failed attempt */
+#define READ_TCPIP_RESOLVE_TTL 300
+#define READ_TCPIP_RESOLVE_RETRY 10
+
+namespace {
+struct resolved_addr {
+  struct sockaddr_storage addr;
+  socklen_t len;
 };
 
-void parse_read_tcpip_arg(struct text_object *obj, const char *arg,
-                          void *free_at_crash) {
-  struct read_tcpip_data *rtd;
-
-  rtd = static_cast<struct read_tcpip_data *>(
-      malloc(sizeof(struct read_tcpip_data)));
-  memset(rtd, 0, sizeof(struct read_tcpip_data));
-
-  rtd->host = static_cast<char *>(malloc(text_buffer_size.get(*state)));
-  sscanf(arg, "%s", rtd->host);
-  sscanf(arg + strlen(rtd->host), "%u", &(rtd->port));
-  if (rtd->port == 0) {
-    rtd->port = strtol(rtd->host, nullptr, 10);
-    strncpy(rtd->host, "localhost", 10);
+/*
+ * Resolves host and port for a protocol on the callback pool, so that
+ * getaddrinfo() never holds up the text. It runs every update but only asks
+ * again once the answer is READ_TCPIP_RESOLVE_TTL seconds old.
+ */
+class resolve_cb : public conky::callback<std::vector<resolved_addr>,
+                                          std::string, std::string, int> {
+  typedef conky::callback<std::vector<resolved_addr>, std::string,
+                          std::string, int>
+      Base;
+
+  time_t next_lookup = 0;
+
+ protected:
+  void work() override;
+
+ public:
+  resolve_cb(double period, const std::string &host, const std::string &port,
+             int protocol)
+      : Base(period, false, Base::Tuple(host, port, protocol)) {}
+};
+
+void resolve_cb::work() {
+  struct addrinfo hints {};
+  struct addrinfo *airesult, *rp;
+  std::vector<resolved_addr> addrs;
+  time_t now = time(nullptr);
+
+  if (now < next_lookup) { return; }
+
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = get<2>() == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM;
+  hints.ai_protocol = get<2>();
+  if (getaddrinfo(get<0>().c_str(), get<1>().c_str(), &hints, &airesult) !=
+      0) {
+    NORM_ERR("%s: Problem with resolving the hostname '%s'",
+             get<2>() == IPPROTO_TCP ? "tcp" : "udp", get<0>().c_str());
+    next_lookup = now + READ_TCPIP_RESOLVE_RETRY;
+    return;
   }
-  if (rtd->port < 1 || rtd->port > 65535) {
-    CRIT_ERR(obj, free_at_crash,
-             "read_tcp and read_udp need a port from 1 to 65535 as argument");
+  for (rp = airesult; rp != nullptr; rp = rp->ai_next) {
+    resolved_addr addr{};
+    memcpy(&addr.addr, rp->ai_addr, rp->ai_addrlen);
+    addr.len = rp->ai_addrlen;
+    addrs.push_back(addr);
   }
+  freeaddrinfo(airesult);
+  next_lookup = now + READ_TCPIP_RESOLVE_TTL;
 
-  obj->data.opaque = rtd;
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = std::move(addrs);
 }
 
-void parse_tcp_ping_arg(struct text_object *obj, const char *arg,
-                        void *free_at_crash) {
-#define DEFAULT_TCP_PING_PORT 80
-  struct sockaddr_in *addr;
-  char *hostname;
-  struct hostent *he;
-
-  addr = static_cast<struct sockaddr_in *>(malloc(sizeof(struct sockaddr_in)));
-  obj->data.opaque = addr;
-  memset(addr, 0, sizeof(struct sockaddr_in));
-  hostname = static_cast<char *>(malloc(strlen(arg) + 1));
-  switch (sscanf(arg, "%s %" SCNu16, hostname, &(addr->sin_port))) {
-    case 1:
-      addr->sin_port = DEFAULT_TCP_PING_PORT;
-      break;
-    case 2:
-      break;
-    default:  // this point should never be reached
-      free(hostname);
-      CRIT_ERR(obj, free_at_crash, "tcp_ping: Reading arguments failed");
+/*
+ * A ${tcp_ping}, ${read_tcp} or ${read_udp} object. Printing it shows the
+ * result of the last probe and starts the next one once that is done. The
+ * socket of a probe is non-blocking and handled by the main reactor between
+ * updates, so an unreachable host never stalls the text.
+ */
+struct tcpip_probe {
+  int protocol; /* IPPROTO_TCP or IPPROTO_UDP */
+  bool ping;    /* time the connection instead of reading from it */
+  conky::callback_handle<resolve_cb> resolver;
+  int fd{-1};
+  bool connected{false};
+  double started{0};
+  size_t max_size{0};
+  std::string result;
+
+  tcpip_probe(const std::string &host, const std::string &port, int protocol_,
+              bool ping_)
+      : protocol(protocol_),
+        ping(ping_),
+        resolver(conky::register_cb<resolve_cb>(0, host, port, protocol_)) {}
+  ~tcpip_probe() { stop(); }
+
+  const char *name() const {
+    if (ping) { return "tcp_ping"; }
+    return protocol == IPPROTO_TCP ? "read_tcp" : "read_udp";
   }
-  if ((he = gethostbyname(hostname)) == nullptr) {
-    NORM_ERR("tcp_ping: Problem with resolving '%s', using 'localhost' instead",
-             hostname);
-    if ((he = gethostbyname("localhost")) == nullptr) {
-      free(hostname);
-      CRIT_ERR(obj, free_at_crash,
-               "tcp_ping: Resolving 'localhost' also failed");
-    }
+
+  void watch(short events) {
+    conky::main_reactor().remove(fd);
+    conky::main_reactor().add(fd, [this]() { on_ready(); }, events);
   }
-  if (he != nullptr) {
-    free(hostname);
-    addr->sin_port = htons(addr->sin_port);
-    addr->sin_family = he->h_addrtype;
-    memcpy(&(addr->sin_addr), he->h_addr, he->h_length);
+
+  void stop() {
+    if (fd != -1) {
+      conky::main_reactor().remove(fd);
+      close(fd);
+      fd = -1;
+    }
   }
-}
 
-void print_tcp_ping(struct text_object *obj, char *p, unsigned int p_max_size) {
-  struct timeval tv1 {
-  }, tv2{}, timeout{};
-  auto *addr = static_cast<struct sockaddr_in *>(obj->data.opaque);
-  int addrlen = sizeof(struct sockaddr);
-  int sock = socket(addr->sin_family, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
-  unsigned long long usecdiff;
-  fd_set writefds;
-
-  if (sock != -1) {
-    fcntl(sock, F_SETFL, O_NONBLOCK | fcntl(sock, F_GETFL));
-
-    FD_ZERO(&writefds);
-    FD_SET(sock, &writefds);
-#define TCP_PING_TIMEOUT 10
-    timeout.tv_sec = TCP_PING_TIMEOUT;
-    timeout.tv_usec = (TCP_PING_TIMEOUT - timeout.tv_sec) * 1000000;
-    connect(sock, reinterpret_cast<struct sockaddr *>(addr),
-            addrlen);  // this will "fail" because sock is non-blocking
-    if (errno == EINPROGRESS) {  // but EINPROGRESS is only a "false fail"
-      gettimeofday(&tv1, nullptr);
-      if (select(sock + 1, nullptr, &writefds, nullptr, &timeout) != -1) {
-        gettimeofday(&tv2, nullptr);
-        usecdiff =
-            ((tv2.tv_sec - tv1.tv_sec) * 1000000) + tv2.tv_usec - tv1.tv_usec;
-        if (usecdiff <= TCP_PING_TIMEOUT * 1000000) {
-          snprintf(p, p_max_size, "%llu", (usecdiff / 1000U));
-        } else {
-#define TCP_PING_FAILED "down"
-          snprintf(p, p_max_size, "%s", TCP_PING_FAILED);
-        }
-      } else {
-        NORM_ERR("tcp_ping: Couldn't wait on the 'pong'");
-      }
-    } else {
-      NORM_ERR("tcp_ping: Couldn't start connection");
+  void start();
+  void on_connected();
+  void on_ready();
+
+  /* gives up on a probe that took too long, and starts the next one */
+  void check(size_t size) {
+    max_size = size;
+    if (fd != -1) {
+      double timeout = ping ? TCP_PING_TIMEOUT : READ_TCPIP_TIMEOUT;
+      if (get_time() - started < timeout) { return; }
+      result = ping ? TCP_PING_FAILED : "";
+      stop();
     }
-    close(sock);
-  } else {
-    NORM_ERR("tcp_ping: Couldn't create socket");
+    start();
   }
-}
+};
 
-void print_read_tcpip(struct text_object *obj, char *p, int p_max_size,
-                      int protocol) {
-  int sock, received;
-  fd_set readfds;
-  struct timeval tv {};
-  auto *rtd = static_cast<struct read_tcpip_data *>(obj->data.opaque);
-  struct addrinfo hints {};
-  struct addrinfo *airesult, *rp;
-  char portbuf[8];
+void tcpip_probe::start() {
+  const std::vector<resolved_addr> &addrs = resolver->read_result();
 
-  if (rtd == nullptr) { return; }
+  /* not resolved yet */
+  if (addrs.empty()) { return; }
 
-  memset(&hints, 0, sizeof(struct addrinfo));
-  hints.ai_family = AF_UNSPEC;
-  hints.ai_socktype = protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM;
-  hints.ai_flags = 0;
-  hints.ai_protocol = protocol;
-  snprintf(portbuf, 8, "%u", rtd->port);
-  if (getaddrinfo(rtd->host, portbuf, &hints, &airesult) != 0) {
-    NORM_ERR("%s: Problem with resolving the hostname",
-             protocol == IPPROTO_TCP ? "read_tcp" : "read_udp");
+  const resolved_addr &addr = addrs.front();
+  fd = socket(addr.addr.ss_family,
+              (protocol == IPPROTO_TCP ? SOCK_STREAM : SOCK_DGRAM) |
+                  SOCK_CLOEXEC,
+              protocol);
+  if (fd == -1) {
+    NORM_ERR("%s: Couldn't create socket", name());
     return;
   }
-  for (rp = airesult; rp != nullptr; rp = rp->ai_next) {
-    sock = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
-    if (sock == -1) { continue; }
-    if (connect(sock, rp->ai_addr, rp->ai_addrlen) != -1) { break; }
-    close(sock);
-    return;
+  fcntl(fd, F_SETFL, O_NONBLOCK | fcntl(fd, F_GETFL));
+
+  started = get_time();
+  connected = false;
+  if (connect(fd, reinterpret_cast<const struct sockaddr *>(&addr.addr),
+              addr.len) == 0) {
+    on_connected();
+  } else if (errno == EINPROGRESS) {
+    watch(POLLOUT);
+  } else {
+    NORM_ERR("%s: Couldn't start connection", name());
+    stop();
   }
-  freeaddrinfo(airesult);
-  if (rp == nullptr) {
-    if (protocol == IPPROTO_TCP) {
-      NORM_ERR("read_tcp: Couldn't create a connection");
-    } else {
-      NORM_ERR("read_udp: Couldn't listen");  // other error because udp is
-                                              // connectionless
-    }
+}
+
+void tcpip_probe::on_connected() {
+  connected = true;
+  if (ping) {
+    result = std::to_string(
+        static_cast<unsigned long long>((get_time() - started) * 1000));
+    stop();
     return;
   }
   if (protocol == IPPROTO_UDP) {
     // when using udp send a zero-length packet to let the other end know of our
     // existence
-    if (write(sock, nullptr, 0) < 0) {
+    if (write(fd, nullptr, 0) < 0) {
       NORM_ERR("read_udp: Couldn't create a empty package");
     }
   }
-  FD_ZERO(&readfds);
-  FD_SET(sock, &readfds);
-  tv.tv_sec = 1;
-  tv.tv_usec = 0;
-  if (select(sock + 1, &readfds, nullptr, nullptr, &tv) > 0) {
-    received = recv(sock, p, p_max_size, 0);
-    if (received != -1) {
-      p[received] = 0;
-    } else {
-      p[0] = 0;
+  watch(POLLIN);
+}
+
+void tcpip_probe::on_ready() {
+  if (!connected) {
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0) { err = errno; }
+    /* a refused connection still is a 'pong', an unreachable host is not */
+    if (ping && err != 0 && err != ECONNREFUSED) {
+      result = TCP_PING_FAILED;
+      stop();
+      return;
+    }
+    if (!ping && err != 0) {
+      if (protocol == IPPROTO_TCP) {
+        NORM_ERR("read_tcp: Couldn't create a connection");
+      } else {
+        NORM_ERR("read_udp: Couldn't listen");  // other error because udp is
+                                                // connectionless
+      }
+      stop();
+      return;
     }
+    on_connected();
+    return;
   }
-  close(sock);
+
+  std::vector<char> buf(std::max<size_t>(max_size, 1));
+  ssize_t received = recv(fd, buf.data(), buf.size() - 1, 0);
+  if (received == -1 && (errno == EAGAIN || errno == EINTR)) { return; }
+  result.assign(buf.data(), received > 0 ? received : 0);
+  stop();
 }
+}  // namespace
 
-void print_read_tcp(struct text_object *obj, char *p, unsigned int p_max_size) {
-  print_read_tcpip(obj, p, p_max_size, IPPROTO_TCP);
+void parse_read_tcpip_arg(struct text_object *obj, const char *arg,
+                          void *free_at_crash, int protocol) {
+  std::vector<char> host(text_buffer_size.get(*state));
+  unsigned int port = 0;
+
+  sscanf(arg, "%s", host.data());
+  sscanf(arg + strlen(host.data()), "%u", &port);
+  if (port == 0) {
+    port = strtol(host.data(), nullptr, 10);
+    strncpy(host.data(), "localhost", 10);
+  }
+  if (port < 1 || port > 65535) {
+    CRIT_ERR(nullptr, free_at_crash,
+             "read_tcp and read_udp need a port from 1 to 65535 as argument");
+  }
+
+  obj->data.opaque = new tcpip_probe(host.data(), std::to_string(port),
+                                     protocol, false);
 }
 
-void print_read_udp(struct text_object *obj, char *p, unsigned int p_max_size) {
-  print_read_tcpip(obj, p, p_max_size, IPPROTO_UDP);
+void parse_tcp_ping_arg(struct text_object *obj, const char *arg,
+                        void *free_at_crash) {
+  std::vector<char> hostname(strlen(arg) + 1);
+  uint16_t port = DEFAULT_TCP_PING_PORT;
+
+  if (sscanf(arg, "%s %" SCNu16, hostname.data(), &port) < 1) {
+    // this point should never be reached
+    CRIT_ERR(nullptr, free_at_crash, "tcp_ping: Reading arguments failed");
+  }
+
+  obj->data.opaque = new tcpip_probe(hostname.data(), std::to_string(port),
+                                     IPPROTO_TCP, true);
 }
 
-void free_read_tcpip(struct text_object *obj) {
-  auto *rtd = static_cast<struct read_tcpip_data *>(obj->data.opaque);
+static void print_tcpip_probe(struct text_object *obj, char *p,
+                              unsigned int p_max_size) {
+  auto *probe = static_cast<tcpip_probe *>(obj->data.opaque);
 
-  if (rtd == nullptr) { return; }
+  if (probe == nullptr) { return; }
 
-  free_and_zero(rtd->host);
-  free_and_zero(obj->data.opaque);
+  probe->check(p_max_size);
+  snprintf(p, p_max_size, "%s", probe->result.c_str());
 }
 
-void free_tcp_ping(struct text_object *obj) {
-  auto *addr = static_cast<struct sockaddr_in *>(obj->data.opaque);
+void print_tcp_ping(struct text_object *obj, char *p, unsigned int p_max_size) {
+  print_tcpip_probe(obj, p, p_max_size);
+}
+
+void print_read_tcp(struct text_object *obj, char *p, unsigned int p_max_size) {
+  print_tcpip_probe(obj, p, p_max_size);
+}
 
-  if (addr == nullptr) { return; }
+void print_read_udp(struct text_object *obj, char *p, unsigned int p_max_size) {
+  print_tcpip_probe(obj, p, p_max_size);
+}
 
-  free_and_zero(obj->data.opaque);
+void free_read_tcpip(struct text_object *obj) {
+  delete static_cast<tcpip_probe *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
 }
+
+void free_tcp_ping(struct text_object *obj) { free_read_tcpip(obj); }
@@ -30,7 +30,11 @@
 #ifndef _READ_TCP_H
 #define _READ_TCP_H
 
-void parse_read_tcpip_arg(struct text_object *, const char *, void *);
+#include <netinet/in.h>
+
+/* protocol is IPPROTO_TCP for read_tcp and IPPROTO_UDP for read_udp */
+void parse_read_tcpip_arg(struct text_object *, const char *, void *,
+                          int protocol);
 void parse_tcp_ping_arg(struct text_object *obj, const char *arg,
                         void *free_at_crash);
 void print_read_tcp(struct text_object *, char *, unsigned int);
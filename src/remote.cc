@@ -0,0 +1,286 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "remote.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include "common.h"
+#include "conky.h"
+#include "logging.h"
+#include "net-endpoint.hh"
+#include "text_object.h"
+#include "update-cb.hh"
+
+/* how long connecting to a node may take, in seconds */
+#define REMOTE_CONNECT_TIMEOUT 5
+/* how long to wait before trying a socket path again, in seconds */
+#define REMOTE_RETRY_DELAY 5
+/* frames larger than this are taken for garbage */
+#define REMOTE_MAX_FRAME (1 << 20)
+
+namespace {
+bool get_varint(const char *&p, const char *end, uint64_t &v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    auto byte = static_cast<unsigned char>(*p++);
+    v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) { return true; }
+  }
+  return false;
+}
+
+bool get_zigzag(const char *&p, const char *end, int64_t &v) {
+  uint64_t u;
+  if (!get_varint(p, end, u)) { return false; }
+  v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+  return true;
+}
+}  // namespace
+
+bool apply_remote_frame(const char *data, size_t size, remote_frames &frames) {
+  const char *p = data, *end = data + size;
+  uint64_t count;
+  int64_t time;
+
+  if (size < 1 || (*p != 'K' && *p != 'D')) { return false; }
+  bool key = *p++ == 'K';
+  if (!get_varint(p, end, count) || count > size || !get_zigzag(p, end, time)) {
+    return false;
+  }
+  if (!key && (!frames.synced || count != frames.values.size())) {
+    return false;
+  }
+
+  std::vector<int64_t> values(count);
+  for (uint64_t i = 0; i < count; i++) {
+    if (!get_zigzag(p, end, values[i])) { return false; }
+    if (!key) { values[i] += frames.values[i]; }
+  }
+  if (p != end) { return false; }
+
+  frames.values = std::move(values);
+  frames.time = key ? time : frames.time + time;
+  frames.synced = true;
+  return true;
+}
+
+namespace {
+struct remote_result {
+  std::vector<double> values;
+  bool connected = false;
+};
+
+/*
+ * Follows the out_to_socket stream of another conky, at "host:port" or the
+ * path of a Unix domain socket. The connection is kept open for as long as
+ * any object uses the node, and every frame that arrives is published right
+ * away. After the node went away, connecting again is left to the next
+ * update, and net_endpoint backs off from nodes that keep failing.
+ */
+class remote_cb : public conky::callback<remote_result, std::string> {
+  typedef conky::callback<remote_result, std::string> Base;
+
+  std::shared_ptr<conky::net_endpoint> endpoint; /* nullptr for a path */
+  int fd;
+  double retry_at; /* for a path, net_endpoint does this for the others */
+
+  int connect_node();
+  void forward(int fd);
+
+ protected:
+  void work() override;
+
+ public:
+  remote_cb(double period, const std::string &address)
+      : Base(period, false, Base::Tuple(address), true),
+        fd(-1),
+        retry_at(0) {
+    if (address.find('/') != std::string::npos) { return; }
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+      endpoint = conky::net_endpoint::get("localhost", address);
+    } else {
+      endpoint = conky::net_endpoint::get(address.substr(0, colon),
+                                          address.substr(colon + 1));
+    }
+  }
+
+  ~remote_cb() override {
+    if (fd >= 0) { close(fd); }
+  }
+};
+
+struct remote_obj {
+  unsigned int index; /* of the value, counting from 0 */
+  conky::callback_handle<remote_cb> cb;
+};
+}  // namespace
+
+int remote_cb::connect_node() {
+  const std::string &address = get<0>();
+
+  if (endpoint) {
+    if (!endpoint->ready()) { return -1; }
+    int sock = endpoint->connect(REMOTE_CONNECT_TIMEOUT);
+    if (sock < 0) {
+      NORM_ERR("remote: can't connect to '%s': %s", address.c_str(),
+               strerror(errno));
+    }
+    return sock;
+  }
+
+  if (get_time() < retry_at) { return -1; }
+  retry_at = get_time() + REMOTE_RETRY_DELAY;
+
+  struct sockaddr_un addr {};
+  if (address.size() >= sizeof addr.sun_path) {
+    NORM_ERR("remote: path '%s' is too long", address.c_str());
+    return -1;
+  }
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, address.c_str(), sizeof addr.sun_path - 1);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) { return -1; }
+  fcntl(sock, F_SETFD, FD_CLOEXEC);
+  if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) !=
+      0) {
+    NORM_ERR("remote: can't connect to '%s': %s", address.c_str(),
+             strerror(errno));
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+/* Reads frames from sock until it closes, breaks or the callback is
+ * stopped. */
+void remote_cb::forward(int sock) {
+  remote_frames frames;
+  std::string buffer;
+  char chunk[4096];
+
+  for (;;) {
+    struct pollfd fds[2] = {{sock, POLLIN, 0}, {donefd(), POLLIN, 0}};
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) { continue; }
+      return;
+    }
+    if (fds[1].revents != 0) { return; }
+
+    ssize_t n = recv(sock, chunk, sizeof chunk, 0);
+    if (n <= 0) {
+      if (n < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+      return;
+    }
+    buffer.append(chunk, n);
+
+    size_t pos = 0;
+    bool changed = false;
+    while (buffer.size() - pos >= 4) {
+      uint32_t size = 0;
+      for (int i = 0; i < 4; i++) {
+        size |= static_cast<uint32_t>(
+                    static_cast<unsigned char>(buffer[pos + i]))
+                << (8 * i);
+      }
+      if (size > REMOTE_MAX_FRAME) { return; }
+      if (buffer.size() - pos - 4 < size) { break; }
+      if (!apply_remote_frame(buffer.data() + pos + 4, size, frames)) {
+        NORM_ERR("remote: bad frame from '%s'", get<0>().c_str());
+        return;
+      }
+      pos += 4 + size;
+      changed = true;
+    }
+    buffer.erase(0, pos);
+
+    if (changed) {
+      if (endpoint && !result.connected) { endpoint->succeeded(); }
+      {
+        std::lock_guard<std::mutex> lock(result_mutex);
+        result.connected = true;
+        result.values.resize(frames.values.size());
+        for (size_t i = 0; i < frames.values.size(); i++) {
+          result.values[i] = frames.values[i] / 1000.0;
+        }
+      }
+      publish_now();
+    }
+  }
+}
+
+void remote_cb::work() {
+  if (is_done()) { return; }
+  if (fd < 0 && (fd = connect_node()) < 0) { return; }
+
+  forward(fd);
+  close(fd);
+  fd = -1;
+  if (is_done()) { return; }
+
+  /* the objects show nothing until we are connected again */
+  if (endpoint) { endpoint->failed(); }
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result.connected = false;
+}
+
+void parse_remote_arg(struct text_object *obj, const char *arg,
+                      void *free_at_crash) {
+  char address[256];
+  unsigned int n = 0;
+
+  if (sscanf(arg, "%255s %u", address, &n) != 2 || n == 0) {
+    CRIT_ERR(nullptr, free_at_crash,
+             "remote needs arguments: <host:port|socket path> <n>");
+  }
+  obj->data.opaque =
+      new remote_obj{n - 1, conky::register_cb<remote_cb>(0, address)};
+}
+
+void print_remote(struct text_object *obj, char *p, unsigned int p_max_size) {
+  auto *ro = static_cast<remote_obj *>(obj->data.opaque);
+
+  if (ro == nullptr) { return; }
+  const remote_result &result = ro->cb->read_result();
+  if (!result.connected || ro->index >= result.values.size()) { return; }
+  snprintf(p, p_max_size, "%.12g", result.values[ro->index]);
+}
+
+void free_remote(struct text_object *obj) {
+  delete static_cast<remote_obj *>(obj->data.opaque);
+  obj->data.opaque = nullptr;
+}
@@ -0,0 +1,52 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _REMOTE_H
+#define _REMOTE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* what the frames of an out_to_socket stream applied so far add up to */
+struct remote_frames {
+  std::vector<int64_t> values; /* in thousandths */
+  int64_t time = 0;            /* in milliseconds since the epoch */
+  bool synced = false;         /* a key frame was seen */
+};
+
+/* Applies one frame, without the size in front of it, to frames. Returns
+ * false for a broken frame or a delta frame that doesn't fit, after which
+ * the stream has to start over with a key frame. */
+bool apply_remote_frame(const char *data, size_t size, remote_frames &frames);
+
+void parse_remote_arg(struct text_object *, const char *, void *);
+void print_remote(struct text_object *, char *, unsigned int);
+void free_remote(struct text_object *);
+
+#endif /* _REMOTE_H */
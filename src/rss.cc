@@ -25,7 +25,9 @@
 
 #include <assert.h>
 #include <time.h>
+#include <atomic>
 #include <cmath>
+#include <memory>
 #include <mutex>
 #include "ccurl_thread.h"
 #include "conky.h"
@@ -45,19 +47,50 @@ namespace {
 class rss_cb : public curl_callback<std::shared_ptr<PRSS>> {
   typedef curl_callback<std::shared_ptr<PRSS>> Base;
 
+  /* the feed is parsed as it is downloaded, up to the last item any of our
+   * objects shows */
+  std::unique_ptr<PRSS_parser> parser;
+  std::atomic<int> max_items;
+
  protected:
+  virtual void begin_data() {
+    parser.reset();
+    try {
+      parser.reset(new PRSS_parser(max_items));
+    } catch (std::runtime_error &e) { NORM_ERR("%s", e.what()); }
+  }
+
+  virtual bool receive_data(const char *ptr, size_t size) {
+    return parser && parser->feed(ptr, size);
+  }
+
   virtual void process_data() {
+    if (!parser) { return; }
     try {
-      std::shared_ptr<PRSS> tmp(new PRSS(data));
+      std::shared_ptr<PRSS> tmp(parser->finish());
 
       std::unique_lock<std::mutex> lock(Base::result_mutex);
       Base::result = tmp;
     } catch (std::runtime_error &e) { NORM_ERR("%s", e.what()); }
+    parser.reset();
+  }
+
+  /* the parsed feed is shared between the slots, count it once */
+  virtual size_t memory() {
+    std::unique_lock<std::mutex> lock(Base::result_mutex);
+    size_t size = Base::data_size;
+    if (Base::result) { size += sizeof(PRSS) + Base::result->heap_size(); }
+    return size;
   }
 
  public:
-  rss_cb(uint32_t period, const std::string &uri)
-      : Base(period, Base::Tuple(uri)) {}
+  rss_cb(double period, const std::string &uri)
+      : Base(period, Base::Tuple(uri)), max_items(1) {}
+
+  void want_items(int n) {
+    int current = max_items;
+    while (n > current && !max_items.compare_exchange_weak(current, n)) {}
+  }
 };
 }  // namespace
 
@@ -66,13 +99,19 @@ static void rss_process_info(char *p, int p_max_size, const std::string &uri,
                              unsigned int nrspaces) {
   char *str;
 
-  uint32_t period = std::max(lround(interval / active_update_interval()), 1l);
+  double period = interval;
 
   auto cb = conky::register_cb<rss_cb>(period, uri);
 
   assert(act_par >= 0 && action);
 
-  std::shared_ptr<PRSS> data = cb->get_result_copy();
+  if (strcmp(action, "item_titles") == EQUAL) {
+    cb->want_items(act_par);
+  } else if (strcmp(action, "feed_title") != EQUAL) {
+    cb->want_items(act_par + 1);
+  }
+
+  std::shared_ptr<PRSS> data = cb->read_result();
 
   if (!data || data->item_count < 1) {
     *p = 0;
@@ -0,0 +1,238 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "rtnetlink.hh"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace conky {
+
+bool rtnetlink::open() {
+  close();
+
+  fd = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0) { return false; }
+
+  struct sockaddr_nl addr {};
+  addr.nl_family = AF_NETLINK;
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0) {
+    int err = errno;
+    close();
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+void rtnetlink::close() {
+  if (fd >= 0) { ::close(fd); }
+  fd = -1;
+}
+
+bool rtnetlink::dump(uint16_t type, const void *req, size_t req_len,
+                     const std::function<void(const struct nlmsghdr *)> &fn) {
+  if (fd < 0) { return false; }
+
+  /* ifinfomsg is the larger of the request headers */
+  alignas(struct nlmsghdr) char msg[NLMSG_SPACE(sizeof(struct ifinfomsg))] = {
+      0};
+  if (req_len > sizeof msg - NLMSG_HDRLEN) {
+    errno = EINVAL;
+    return false;
+  }
+  auto *nl = reinterpret_cast<struct nlmsghdr *>(msg);
+  nl->nlmsg_len = NLMSG_LENGTH(req_len);
+  nl->nlmsg_type = type;
+  nl->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  nl->nlmsg_seq = ++seq;
+  memcpy(NLMSG_DATA(nl), req, req_len);
+
+  struct sockaddr_nl kernel {};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(fd, msg, nl->nlmsg_len, 0,
+             reinterpret_cast<struct sockaddr *>(&kernel), sizeof kernel) < 0) {
+    return false;
+  }
+
+  /* the kernel sizes the parts of a dump after the buffers we read them
+   * with, 32k fits a few hundred links per part */
+  alignas(struct nlmsghdr) char buf[32768];
+  for (;;) {
+    ssize_t len = recv(fd, buf, sizeof buf, 0);
+    if (len < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+
+    for (auto *reply = reinterpret_cast<struct nlmsghdr *>(buf);
+         NLMSG_OK(reply, len); reply = NLMSG_NEXT(reply, len)) {
+      /* leftovers of an earlier dump that was given up on */
+      if (reply->nlmsg_seq != seq) { continue; }
+      if (reply->nlmsg_type == NLMSG_DONE) { return true; }
+      if (reply->nlmsg_type == NLMSG_ERROR) {
+        auto *err = static_cast<struct nlmsgerr *>(NLMSG_DATA(reply));
+        errno = -err->error;
+        return false;
+      }
+      fn(reply);
+    }
+  }
+}
+
+rtnetlink_events::~rtnetlink_events() {
+  if (fd >= 0) { ::close(fd); }
+}
+
+void rtnetlink_events::read_events() {
+  alignas(struct nlmsghdr) char buf[8192];
+  ssize_t len;
+
+  while ((len = recv(fd, buf, sizeof buf, 0)) > 0 || errno == EINTR) {
+    for (auto *msg = reinterpret_cast<struct nlmsghdr *>(buf);
+         NLMSG_OK(msg, len); msg = NLMSG_NEXT(msg, len)) {
+      switch (msg->nlmsg_type) {
+        case RTM_NEWLINK:
+        case RTM_DELLINK:
+          /* a link going away or being renamed takes its addresses and
+           * routes with it */
+          for (unsigned long &g : generation) { ++g; }
+          break;
+        case RTM_NEWADDR:
+        case RTM_DELADDR:
+          ++generation[ADDRS];
+          break;
+        case RTM_NEWROUTE:
+        case RTM_DELROUTE:
+          ++generation[ROUTES];
+          break;
+        default:
+          break;
+      }
+    }
+  }
+  /* ENOBUFS means notifications got lost, which may have been any */
+  if (len < 0 && errno == ENOBUFS) {
+    for (unsigned long &g : generation) { ++g; }
+  }
+}
+
+bool rtnetlink_events::changed(table t, unsigned long &seen) {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (fd < 0 && !failed) {
+    fd = socket(PF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                NETLINK_ROUTE);
+    struct sockaddr_nl addr {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV4_ROUTE |
+                     RTMGRP_IPV6_IFADDR | RTMGRP_IPV6_ROUTE;
+    if (fd >= 0 && bind(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                        sizeof addr) < 0) {
+      ::close(fd);
+      fd = -1;
+    }
+    failed = fd < 0;
+  }
+  if (failed) { return true; }
+
+  read_events();
+  bool result = seen != generation[t];
+  seen = generation[t];
+  return result;
+}
+
+bool rtnetlink::dump_links(
+    const std::function<void(const char *, unsigned int,
+                             const struct rtnl_link_stats64 &)> &fn) {
+  struct ifinfomsg req {};
+  req.ifi_family = AF_UNSPEC;
+
+  return dump(RTM_GETLINK, &req, sizeof req, [&](const struct nlmsghdr *msg) {
+    const auto *ifi = static_cast<const struct ifinfomsg *>(NLMSG_DATA(msg));
+    int len = IFLA_PAYLOAD(msg);
+    const char *name = nullptr;
+    struct rtnl_link_stats64 stats {};
+    bool have_stats = false;
+
+    for (auto *rta = IFLA_RTA(ifi); RTA_OK(rta, len);
+         rta = RTA_NEXT(rta, len)) {
+      if (rta->rta_type == IFLA_IFNAME) {
+        name = static_cast<const char *>(RTA_DATA(rta));
+      } else if (rta->rta_type == IFLA_STATS64 &&
+                 RTA_PAYLOAD(rta) >= sizeof stats) {
+        /* only 4 byte aligned in the message */
+        memcpy(&stats, RTA_DATA(rta), sizeof stats);
+        have_stats = true;
+      } else if (rta->rta_type == IFLA_STATS && !have_stats &&
+                 RTA_PAYLOAD(rta) >= sizeof(struct rtnl_link_stats)) {
+        struct rtnl_link_stats stats32;
+        memcpy(&stats32, RTA_DATA(rta), sizeof stats32);
+        stats.rx_bytes = stats32.rx_bytes;
+        stats.tx_bytes = stats32.tx_bytes;
+      }
+    }
+    if (name != nullptr) { fn(name, ifi->ifi_flags, stats); }
+  });
+}
+
+bool rtnetlink::dump_ipv4_addrs(
+    const std::function<void(const char *, const struct in_addr &)> &fn) {
+  struct ifaddrmsg req {};
+  req.ifa_family = AF_INET;
+
+  return dump(RTM_GETADDR, &req, sizeof req, [&](const struct nlmsghdr *msg) {
+    const auto *ifa = static_cast<const struct ifaddrmsg *>(NLMSG_DATA(msg));
+    if (ifa->ifa_family != AF_INET) { return; }
+    int len = IFA_PAYLOAD(msg);
+    const char *label = nullptr;
+    struct in_addr addr {};
+    bool have_addr = false;
+
+    for (auto *rta = IFA_RTA(ifa); RTA_OK(rta, len);
+         rta = RTA_NEXT(rta, len)) {
+      if (rta->rta_type == IFA_LABEL) {
+        label = static_cast<const char *>(RTA_DATA(rta));
+      } else if (rta->rta_type == IFA_LOCAL ||
+                 (rta->rta_type == IFA_ADDRESS && !have_addr)) {
+        /* IFA_ADDRESS is the peer on point to point links */
+        memcpy(&addr, RTA_DATA(rta), sizeof addr);
+        have_addr = true;
+      }
+    }
+    if (label != nullptr && have_addr) { fn(label, addr); }
+  });
+}
+
+}  // namespace conky
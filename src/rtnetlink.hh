@@ -0,0 +1,109 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef RTNETLINK_HH
+#define RTNETLINK_HH
+
+#include <linux/if_link.h>
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+namespace conky {
+
+/*
+ * Dumps of the kernel's link and address tables over rtnetlink. Each dump
+ * covers every interface in one request, where /proc/net/dev has to be
+ * parsed line by line and addresses fetched with one ioctl per interface.
+ */
+class rtnetlink {
+  int fd;
+  uint32_t seq;
+
+  rtnetlink(const rtnetlink &) = delete;
+  rtnetlink &operator=(const rtnetlink &) = delete;
+
+  bool dump(uint16_t type, const void *req, size_t req_len,
+            const std::function<void(const struct nlmsghdr *)> &fn);
+
+ public:
+  rtnetlink() : fd(-1), seq(0) {}
+  ~rtnetlink() { close(); }
+
+  /* Returns false (with errno set) if the socket can't be opened. */
+  bool open();
+  void close();
+  bool is_open() const { return fd >= 0; }
+
+  /* Passes the name, flags (IFF_UP, IFF_RUNNING, ...) and 64 bit counters
+   * of every link to fn. */
+  bool dump_links(const std::function<void(const char *, unsigned int,
+                                           const struct rtnl_link_stats64 &)>
+                      &fn);
+
+  /* Passes the label (the interface name or an alias of it) and address of
+   * every IPv4 address to fn. */
+  bool dump_ipv4_addrs(
+      const std::function<void(const char *, const struct in_addr &)> &fn);
+};
+
+/*
+ * Notifications of changes to the kernel's links, addresses and routes, so
+ * tables that change perhaps once a day needn't be read every update. Like
+ * the block device uevents of update_diskio(), the socket is only looked at
+ * when an update asks, one recv() when nothing happened. Thread-safe.
+ */
+class rtnetlink_events {
+ public:
+  enum table { LINKS, ADDRS, ROUTES, TABLES };
+
+ private:
+  std::mutex mutex;
+  int fd;
+  bool failed;
+  unsigned long generation[TABLES];
+
+  rtnetlink_events(const rtnetlink_events &) = delete;
+  rtnetlink_events &operator=(const rtnetlink_events &) = delete;
+
+  void read_events();
+
+ public:
+  rtnetlink_events() : fd(-1), failed(false), generation{1, 1, 1} {}
+  ~rtnetlink_events();
+
+  /* Whether t changed since the call that last set seen, which should start
+   * out 0. Always true if the notifications can't be had. */
+  bool changed(table t, unsigned long &seen);
+};
+
+}  // namespace conky
+
+#endif /* RTNETLINK_HH */
@@ -0,0 +1,184 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SAMPLE_RING_HH
+#define SAMPLE_RING_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+namespace conky {
+
+/*
+ * The last window() samples of something that is averaged over time, like
+ * network or disk speeds. Pushing is O(1) whatever the window: the oldest
+ * sample is overwritten and the sum kept up to date. The sum is recomputed
+ * every time the ring wraps around, so floating point error can't build up.
+ */
+template <typename T>
+class sample_ring {
+  std::vector<T> samples;
+  size_t head;  // where the next sample goes, i.e. the oldest one
+  T total;
+
+ public:
+  explicit sample_ring(size_t window = 1)
+      : samples(std::max<size_t>(window, 1), T()), head(0), total() {}
+
+  size_t window() const { return samples.size(); }
+
+  /* Changes the number of samples kept, keeping the most recent ones. */
+  void set_window(size_t window) {
+    window = std::max<size_t>(window, 1);
+    if (window == samples.size()) { return; }
+
+    std::vector<T> resized(window, T());
+    size_t keep = std::min(window, samples.size());
+    for (size_t i = 0; i < keep; ++i) {
+      /* newest first, from the slot before head backwards */
+      resized[keep - 1 - i] =
+          samples[(head + samples.size() - 1 - i) % samples.size()];
+    }
+    samples.swap(resized);
+    head = keep % window;
+    total = std::accumulate(samples.begin(), samples.end(), T());
+  }
+
+  void push(T value) {
+    total += value - samples[head];
+    samples[head] = value;
+    if (++head == samples.size()) {
+      head = 0;
+      total = std::accumulate(samples.begin(), samples.end(), T());
+    }
+  }
+
+  /* Forgets every sample. */
+  void clear() {
+    std::fill(samples.begin(), samples.end(), T());
+    head = 0;
+    total = T();
+  }
+
+  T sum() const { return total; }
+
+  /* Average over the whole window, samples not pushed yet count as 0. */
+  double average() const {
+    return static_cast<double>(total) / static_cast<double>(samples.size());
+  }
+};
+
+/*
+ * The last window() samples of count() series that are sampled together,
+ * like the usage of every cpu. It works like a sample_ring for each, but
+ * with one head for all and the series side by side, so a push is a loop
+ * over plain arrays the compiler can vectorize.
+ */
+template <typename T>
+class sample_block {
+  std::vector<T> samples;  // window() rows of count() samples each
+  std::vector<T> totals;
+  size_t n;
+  size_t head;  // the row the next samples go in, i.e. the oldest one
+
+  void recompute() {
+    std::fill(totals.begin(), totals.end(), T());
+    T *sum = totals.data();
+    for (size_t row = 0; row < window(); ++row) {
+      const T *s = &samples[row * n];
+      for (size_t i = 0; i < n; ++i) { sum[i] += s[i]; }
+    }
+  }
+
+ public:
+  explicit sample_block(size_t count = 0, size_t window = 1)
+      : samples(count * std::max<size_t>(window, 1), T()),
+        totals(count, T()),
+        n(count),
+        head(0) {}
+
+  size_t count() const { return n; }
+  size_t window() const { return n == 0 ? 0 : samples.size() / n; }
+
+  /* Changes the number of samples kept, keeping the most recent ones, or
+   * forgets everything if the number of series changes. */
+  void resize(size_t count, size_t window) {
+    window = std::max<size_t>(window, 1);
+    if (count != n) {
+      *this = sample_block(count, window);
+      return;
+    }
+    if (n == 0 || window == this->window()) { return; }
+
+    size_t old_window = this->window();
+    std::vector<T> resized(n * window, T());
+    size_t keep = std::min(window, old_window);
+    for (size_t i = 0; i < keep; ++i) {
+      /* newest first, from the row before head backwards */
+      size_t from = (head + old_window - 1 - i) % old_window;
+      std::copy_n(&samples[from * n], n, &resized[(keep - 1 - i) * n]);
+    }
+    samples.swap(resized);
+    head = keep % window;
+    recompute();
+  }
+
+  /* Adds values[i] to the i-th series, for all count() of them. */
+  void push(const T *values) {
+    if (n == 0) { return; }
+    T *row = &samples[head * n];
+    T *sum = totals.data();
+    for (size_t i = 0; i < n; ++i) {
+      sum[i] += values[i] - row[i];
+      row[i] = values[i];
+    }
+    if (++head == window()) {
+      head = 0;
+      recompute();
+    }
+  }
+
+  const T *sums() const { return totals.data(); }
+
+  /* Writes the average of each series over the whole window to out, samples
+   * not pushed yet count as 0. */
+  template <typename U>
+  void averages(U *out) const {
+    const T *sum = totals.data();
+    const double scale = n == 0 ? 0 : 1.0 / static_cast<double>(window());
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = static_cast<U>(static_cast<double>(sum[i]) * scale);
+    }
+  }
+};
+
+}  // namespace conky
+
+#endif /* SAMPLE_RING_HH */
@@ -26,106 +26,97 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
+#include <algorithm>
+#include <string>
 #include <vector>
 #include "conky.h"
 #include "core.h"
 #include "logging.h"
+#include "number-format.hh"
 #include "specials.h"
 #include "text_object.h"
 #include "x11.h"
 
-/**
- * Length of a character in bytes.
- * @param c first byte of the character
- */
-inline int scroll_character_length(char c) {
-#ifdef BUILD_GUI
-  if (utf8_mode.get(*state)) {
-    auto uc = static_cast<unsigned char>(c);
-    int len = 0;
-
-    if ((uc & 0x80) == 0) { return 1; }
-
-    while (len < 7 && (uc & (0x80 >> len)) != 0) { ++len; }
-
-    return len;
-  }
-#else  /* BUILD_X11 */
-  (void)c;
-#endif /* BUILD_X11 */
-
-  return 1;
-}
-
-/**
- * Check if a byte should be skipped when counting characters to scroll text to
- * right.
- */
-inline bool scroll_check_skip_byte(char c) {
-#ifdef BUILD_GUI
-  // Check if byte matches UTF-8 continuation byte pattern (0b10xxxxxx)
-  if (utf8_mode.get(*state) && (c & 0xC0) == 0x80) { return true; }
-#endif
-
-  return SPECIAL_CHAR == c;
-}
-
 #define SCROLL_LEFT 1
 #define SCROLL_RIGHT 2
 #define SCROLL_WAIT 3
 
+// place all the lines behind each other with LINESEPARATOR between them
+#define LINESEPARATOR '|'
+
 struct scroll_data {
   char *text;
   unsigned int show;
   unsigned int step;
   int wait;
   unsigned int wait_arg;
-  signed int start;
+  signed int start; /* index in units of the first one shown */
   long resetcolor;
   int direction;
+
+  std::vector<char> buf; /* what the inner text printed this time */
+
+  /* The text the table below was built for, as it was printed and as it is
+   * shown. They are only rebuilt when the inner text prints something else,
+   * so scrolling doesn't have to look at each byte every time. */
+  std::string printed;
+  bool printed_utf8;
+  std::string shown;
+  /* where each character or colour change starts in shown, and shown.size()
+   * at the end */
+  std::vector<unsigned int> units;
+  /* how many of units before an index are characters, i.e. not colour
+   * changes, one more entry than units has */
+  std::vector<unsigned int> chars_before;
+  /* the index in units of each character */
+  std::vector<unsigned int> chars;
+
+  unsigned int unit_count() const { return units.size() - 1; }
+  unsigned int char_count() const { return chars.size(); }
+  bool is_special(unsigned int unit) const {
+    return chars_before[unit + 1] == chars_before[unit];
+  }
 };
 
 /**
- * Get count of characters to right from (sd->start) position.
+ * Rebuilds the tables of sd for the text in sd->buf, unless it is the same as
+ * last time.
  */
-static unsigned int scroll_count_characters_to_right(
-    struct scroll_data *sd, const std::vector<char> &buf) {
-  unsigned int n = 0;
-  unsigned int offset = sd->start;
-
-  while ('\0' != buf[offset] && offset < buf.size()) {
-    offset += scroll_character_length(buf[offset]);
-    ++n;
-  }
-
-  return n;
-}
-
-static void scroll_scroll_left(struct scroll_data *sd,
-                               const std::vector<char> &buf,
-                               unsigned int amount) {
-  for (unsigned int i = 0; (i < amount) && (buf[sd->start] != '\0') &&
-                           (static_cast<unsigned int>(sd->start) < buf.size());
-       ++i) {
-    sd->start += scroll_character_length(buf[sd->start]);
-  }
+static void scroll_index_text(struct scroll_data *sd) {
+  const char *text = sd->buf.data();
+  bool utf8 = false;
+#ifdef BUILD_GUI
+  utf8 = utf8_mode.get(*state);
+#endif /* BUILD_GUI */
 
-  if (buf[sd->start] == 0 ||
-      static_cast<unsigned int>(sd->start) > strlen(buf.data())) {
-    sd->start = 0;
+  if (!sd->units.empty() && utf8 == sd->printed_utf8 &&
+      sd->printed.compare(text) == 0) {
+    return;
   }
-}
-
-static void scroll_scroll_right(struct scroll_data *sd,
-                                const std::vector<char> &buf,
-                                unsigned int amount) {
-  for (unsigned int i = 0; i < amount; ++i) {
-    if (sd->start <= 0) { sd->start = static_cast<int>(strlen(&(buf[0]))); }
-
-    while (--(sd->start) >= 0) {
-      if (!scroll_check_skip_byte(buf[sd->start])) { break; }
+  sd->printed = text;
+  sd->printed_utf8 = utf8;
+  sd->shown = sd->printed;
+  sd->units.clear();
+  sd->chars_before.assign(1, 0);
+  sd->chars.clear();
+
+  for (unsigned int i = 0; i < sd->shown.size();) {
+    auto c = static_cast<unsigned char>(sd->shown[i]);
+    unsigned int len = 1;
+
+    if (c == '\n') {
+      sd->shown[i] = LINESEPARATOR;
+    } else if (utf8 && (c & 0x80) != 0) {
+      // the number of leading ones is the length of the character
+      len = 0;
+      while (len < 7 && (c & (0x80 >> len)) != 0) { ++len; }
     }
+    if (c != SPECIAL_CHAR) { sd->chars.push_back(sd->units.size()); }
+    sd->units.push_back(i);
+    sd->chars_before.push_back(sd->chars.size());
+    i += len;
   }
+  sd->units.push_back(sd->shown.size());
 }
 
 void parse_scroll_arg(struct text_object *obj, const char *arg,
@@ -134,8 +125,7 @@ void parse_scroll_arg(struct text_object *obj, const char *arg,
   int n1 = 0, n2 = 0;
   char dirarg[6];
 
-  sd = static_cast<struct scroll_data *>(malloc(sizeof(struct scroll_data)));
-  memset(sd, 0, sizeof(struct scroll_data));
+  sd = new scroll_data();
 
   sd->resetcolor = get_current_text_color();
   sd->step = 1;
@@ -154,12 +144,12 @@ void parse_scroll_arg(struct text_object *obj, const char *arg,
   }
 
   if ((arg == nullptr) || sscanf(arg + n1, "%u %n", &sd->show, &n2) <= 0) {
-    free(sd);
+    delete sd;
 #ifdef BUILD_GUI
     free(obj->next);
 #endif
     free(free_at_crash2);
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "scroll needs arguments: [left|right|wait] <length> [<step>] "
              "[interval] <text>");
   }
@@ -204,92 +194,61 @@ void parse_scroll_arg(struct text_object *obj, const char *arg,
 
 void print_scroll(struct text_object *obj, char *p, unsigned int p_max_size) {
   auto *sd = static_cast<struct scroll_data *>(obj->data.opaque);
-  unsigned int j, colorchanges = 0, frontcolorchanges = 0,
-                  visibcolorchanges = 0;
-  std::vector<char> buf(max_user_text.get(*state), static_cast<char>(0));
 
   if (sd == nullptr) { return; }
 
-  generate_text_internal(&(buf[0]), max_user_text.get(*state), *obj->sub);
-  for (j = 0; buf[j] != 0; j++) {
-    if (buf[j] == '\n') {
-      // place all the lines behind each other with LINESEPARATOR between them
-#define LINESEPARATOR '|'
-      buf[j] = LINESEPARATOR;
-    } else if (buf[j] == SPECIAL_CHAR) {
-      colorchanges++;
-    }
-  }
+  size_t size = max_user_text.get(*state);
+  if (sd->buf.size() != size) { sd->buf.resize(size); }
+  generate_text_internal(sd->buf.data(), size, *obj->sub);
+  scroll_index_text(sd);
 
-  // no scrolling necessary if the length of the text to scroll is too short
-  if (strlen(&(buf[0])) - colorchanges <= sd->show) {
-    snprintf(p, p_max_size, "%s", &(buf[0]));
+  const std::string &shown = sd->shown;
+  unsigned int units = sd->unit_count();
+  unsigned int colorchanges = units - sd->char_count();
+
+  // no scrolling necessary if the text to scroll is too short
+  if (sd->char_count() <= sd->show) {
+    snprintf(p, p_max_size, "%s", shown.c_str());
     return;
   }
 
   // if length of text changed to shorter so the (sd->start) is already
   // outside of actual text then reset (sd->start)
-  if (static_cast<unsigned int>(sd->start) >= strlen(&(buf[0]))) {
+  if (sd->start < 0 || static_cast<unsigned int>(sd->start) >= units) {
     sd->start = 0;
   }
 
   // make sure a colorchange at the front is not part of the string we are going
   // to show
-  while (buf[sd->start] == SPECIAL_CHAR) { sd->start++; }
-
-  // place all chars that should be visible in p, including colorchanges
-  unsigned int visiblechars;
-  for (j = 0, visiblechars = 0; visiblechars < sd->show;) {
-    char c = buf[sd->start + j];
-    p[j] = c;
-    if (0 == c) { break; }
-
-    ++j;
-
-    if (SPECIAL_CHAR == c) {
-      ++visibcolorchanges;
-    } else {
-      int l = scroll_character_length(c);
-
-      while (--l != 0) {
-        p[j] = buf[sd->start + j];
-        ++j;
-      }
-
-      ++visiblechars;
-    }
-  }
-
-  for (; visiblechars < sd->show; j++, visiblechars++) { p[j] = ' '; }
-  p[j] = 0;
-
-  // count colorchanges in front of the visible part and place that many
-  // colorchanges in front of the visible part
-  for (j = 0; j < static_cast<unsigned>(sd->start); j++) {
-    if (buf[j] == SPECIAL_CHAR) { frontcolorchanges++; }
+  while (static_cast<unsigned int>(sd->start) < units &&
+         sd->is_special(sd->start)) {
+    sd->start++;
   }
 
-  int pwithcolors_len = strlen(p) + 4 + colorchanges - visibcolorchanges;
-  char *pwithcolors = static_cast<char *>(malloc(pwithcolors_len));
-
-  for (j = 0; j < frontcolorchanges; j++) { pwithcolors[j] = SPECIAL_CHAR; }
-  pwithcolors[j] = 0;
-  strncat(pwithcolors, p, pwithcolors_len);
-  unsigned int strend = strlen(pwithcolors);
-  // and place the colorchanges not in front or in the visible part behind the
-  // visible part
-  for (j = 0; j < colorchanges - frontcolorchanges - visibcolorchanges; j++) {
-    pwithcolors[strend + j] = SPECIAL_CHAR;
-  }
-  pwithcolors[strend + j] = 0;
-  strncpy(p, pwithcolors, p_max_size);
-  free(pwithcolors);
-
-  // scroll
+  // the visible part ends right after its last character, and it takes
+  // along the colour changes in between
+  unsigned int first = sd->chars_before[sd->start];
+  unsigned int visiblechars = std::min(sd->show, sd->char_count() - first);
+  unsigned int end =
+      visiblechars > 0 ? sd->chars[first + visiblechars - 1] + 1 : sd->start;
+  unsigned int frontcolorchanges = sd->start - first;
+  unsigned int visibcolorchanges = end - sd->start - visiblechars;
+
+  // place the colorchanges in front of the visible part in front of it, and
+  // the ones that are neither in front nor visible behind it
+  conky::text_writer out(p, p_max_size);
+  out.fill(SPECIAL_CHAR, frontcolorchanges);
+  out.append(shown.data() + sd->units[sd->start],
+             sd->units[end] - sd->units[sd->start]);
+  out.fill(' ', sd->show - visiblechars);
+  out.fill(SPECIAL_CHAR, colorchanges - frontcolorchanges - visibcolorchanges);
+  size_t len = out.finish();
+
+  // scroll, with colorchanges counting like characters to the left
   if (sd->direction == SCROLL_LEFT) {
-    scroll_scroll_left(sd, buf, sd->step);
+    sd->start += sd->step;
   } else if (sd->direction == SCROLL_WAIT) {
-    unsigned int charsleft = scroll_count_characters_to_right(sd, buf);
+    unsigned int charsleft = units - sd->start;
 
     if (sd->show >= charsleft) {
       if (sd->wait_arg == 0) {
@@ -305,24 +264,24 @@ void print_scroll(struct text_object *obj, char *p, unsigned int p_max_size) {
     } else {
       if (sd->wait_arg == 0 || sd->wait_arg == 1 || sd->wait <= 0) {
         sd->wait = 0;
-
-        if (sd->step < charsleft) {
-          scroll_scroll_left(sd, buf, sd->step);
-        } else {
-          scroll_scroll_left(sd, buf, charsleft);
-        }
+        sd->start += std::min(sd->step, charsleft);
       } else {
         sd->wait--;
       }
     }
   } else {
-    scroll_scroll_right(sd, buf, sd->step);
+    // skipping the colorchanges to the right
+    for (unsigned int i = 0; i < sd->step; ++i) {
+      if (sd->start <= 0) { sd->start = units; }
+      while (--(sd->start) >= 0 && sd->is_special(sd->start)) {}
+    }
   }
+  if (static_cast<unsigned int>(sd->start) >= units) { sd->start = 0; }
 
 #ifdef BUILD_GUI
   // reset color when scroll is finished
-  if (out_to_x.get(*state)) {
-    new_special(p + strlen(p), FG)->arg = sd->resetcolor;
+  if (out_to_x.get(*state) && len + 1 < p_max_size) {
+    new_special(p + len, FG)->arg = sd->resetcolor;
   }
 #endif
 }
@@ -335,5 +294,6 @@ void free_scroll(struct text_object *obj) {
   free_and_zero(sd->text);
   free_text_objects(obj->sub);
   free_and_zero(obj->sub);
-  free_and_zero(obj->data.opaque);
+  delete sd;
+  obj->data.opaque = nullptr;
 }
@@ -23,10 +23,22 @@
 #ifndef SEMAPHORE_HH
 #define SEMAPHORE_HH
 
+#include <atomic>
 #include <cerrno>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif /* __linux__ */
 
 #if defined(__APPLE__) && defined(__MACH__)
 
@@ -113,4 +125,70 @@ class semaphore {
 
 #endif /* defined(__APPLE__) && defined(__MACH__) */
 
+/*
+ * Counts down the work a thread waits for, e.g. the callbacks of a frame.
+ * Only the arrive() bringing the count to zero wakes the waiter, and only if
+ * it is asleep, so waiting for n pieces of work costs one wakeup rather than
+ * n. On Linux the count itself is the futex word.
+ */
+class completion_latch {
+  std::atomic<int> count;
+  std::atomic<bool> sleeping;
+#ifndef __linux__
+  std::mutex mutex;
+  std::condition_variable cv;
+#endif /* __linux__ */
+
+  completion_latch(const completion_latch &) = delete;
+  completion_latch &operator=(const completion_latch &) = delete;
+
+  void wake() {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<int *>(&count), FUTEX_WAKE_PRIVATE, 1,
+            nullptr, nullptr, 0);
+#else
+    std::lock_guard<std::mutex> lock(mutex);
+    cv.notify_one();
+#endif /* __linux__ */
+  }
+
+ public:
+  completion_latch() : count(0), sleeping(false) {}
+
+  /* there are n more arrive() to wait for */
+  void add(int n = 1) { count.fetch_add(n); }
+
+  void arrive() {
+    if (count.fetch_sub(1) == 1 && sleeping.load()) { wake(); }
+  }
+
+  /* Returns once every add() has been matched by an arrive(). Spins for up
+   * to spin seconds first, for work that is about to finish. */
+  void wait(double spin = 0) {
+    if (spin > 0 && count.load() > 0) {
+      auto until = std::chrono::steady_clock::now() +
+                   std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::duration<double>(spin));
+      while (count.load() > 0 && std::chrono::steady_clock::now() < until) {
+        std::this_thread::yield();
+      }
+    }
+
+    sleeping.store(true);
+#ifdef __linux__
+    /* an arrive() in between changes the count and makes this return */
+    for (int c; (c = count.load()) > 0;) {
+      syscall(SYS_futex, reinterpret_cast<int *>(&count), FUTEX_WAIT_PRIVATE,
+              c, nullptr, nullptr, 0);
+    }
+#else
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [this] { return count.load() <= 0; });
+    }
+#endif /* __linux__ */
+    sleeping.store(false);
+  }
+};
+
 #endif
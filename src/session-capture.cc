@@ -0,0 +1,167 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "session-capture.hh"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_set>
+#include <vector>
+
+#include "common.h"
+#include "logging.h"
+
+namespace conky {
+namespace {
+
+enum class session_mode { none, record, replay };
+
+session_mode mode = session_mode::none;
+std::string session_dir;
+bool started = false;
+unsigned long frame = 0;  /* the frame being recorded or replayed */
+unsigned long frames = 0; /* the recorded frames, when replaying */
+std::atomic<unsigned long> generation(0);
+unsigned long bench_frames = 0;
+
+/* callbacks open files from their own threads */
+std::mutex record_mutex;
+/* the files copied into the current frame, which later opens reuse */
+std::unordered_set<std::string> recorded;
+
+std::string frame_dir(unsigned long n) {
+  char name[32];
+  snprintf(name, sizeof name, "/frame-%06lu", n);
+  return session_dir + name;
+}
+
+/* creates the directories leading up to path */
+bool make_parents(const std::string &path) {
+  for (size_t pos = path.find('/', 1); pos != std::string::npos;
+       pos = path.find('/', pos + 1)) {
+    std::string dir(path, 0, pos);
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) { return false; }
+  }
+  return true;
+}
+
+/* /proc and /sys files don't have a size until read, so read to the end */
+bool copy_file(const char *from, const std::string &to) {
+  static std::vector<char> buf(64 * 1024);
+  std::string contents;
+
+  int fd = open(from, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { return false; }
+  ssize_t n;
+  while ((n = read(fd, buf.data(), buf.size())) != 0) {
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+    contents.append(buf.data(), n);
+  }
+  close(fd);
+
+  if (!make_parents(to)) { return false; }
+  FILE *out = fopen(to.c_str(), "we");
+  if (out == nullptr) { return false; }
+  bool written = fwrite(contents.data(), 1, contents.size(), out) ==
+                 contents.size();
+  return fclose(out) == 0 && written;
+}
+
+}  // namespace
+
+void start_recording(const std::string &dir) {
+  session_dir = to_real_path(dir);
+  if (!make_parents(session_dir + "/")) {
+    throw std::runtime_error("can't create '" + session_dir +
+                             "': " + strerror(errno));
+  }
+  mode = session_mode::record;
+}
+
+void start_replay(const std::string &dir) {
+  struct stat st {};
+
+  session_dir = to_real_path(dir);
+  for (frames = 0; stat(frame_dir(frames).c_str(), &st) == 0; ++frames) {}
+  if (frames == 0) {
+    throw std::runtime_error("no recorded frames in '" + session_dir + "'");
+  }
+  mode = session_mode::replay;
+}
+
+void next_session_frame() {
+  if (mode == session_mode::none) { return; }
+
+  if (started) { ++frame; }
+  started = true;
+  if (mode == session_mode::replay) {
+    frame %= frames;
+    set_open_file_root(frame_dir(frame));
+  } else {
+    std::lock_guard<std::mutex> lock(record_mutex);
+    recorded.clear();
+  }
+  ++generation;
+}
+
+bool record_session_file(const char *file, std::string &path) {
+  if (mode != session_mode::record ||
+      (strncmp(file, "/proc/", 6) != 0 && strncmp(file, "/sys/", 5) != 0)) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(record_mutex);
+  std::string copy = frame_dir(frame) + file;
+  if (recorded.count(file) == 0) {
+    /* a file which can't be read isn't recorded, and so isn't there when
+     * replaying either */
+    if (!copy_file(file, copy)) { return false; }
+    recorded.insert(file);
+  }
+  path = std::move(copy);
+  return true;
+}
+
+unsigned long session_generation() { return generation.load(); }
+
+void set_bench_frames(unsigned long n) { bench_frames = n; }
+
+bool benchmarking() { return bench_frames > 0; }
+
+}  // namespace conky
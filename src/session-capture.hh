@@ -0,0 +1,67 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SESSION_CAPTURE_HH
+#define SESSION_CAPTURE_HH
+
+#include <string>
+
+namespace conky {
+
+/*
+ * --record DIR copies every /proc and /sys file read through open_file_path()
+ * (so open_file(), proc_file, ...) into DIR/frame-NNNNNN/ as it is opened, one
+ * directory per update, and lets the parsers read the copy. --replay DIR
+ * points open_file_path() at those directories in turn, going round again
+ * after the last one, so a config can be run against the same system state
+ * over and over. Directory listings, sockets and netlink aren't captured;
+ * whatever reads them sees the live system.
+ */
+void start_recording(const std::string &dir);
+void start_replay(const std::string &dir);
+
+/* moves recording or replaying on to the next frame; call at the start of
+ * every update */
+void next_session_frame();
+
+/* If recording, copies file into the current frame and sets path to the
+ * copy. Returns false if file isn't recorded. */
+bool record_session_file(const char *file, std::string &path);
+
+/* bumped whenever files start coming from a different frame, so that files
+ * kept open between updates know to reopen themselves */
+unsigned long session_generation();
+
+/* --bench N: run N updates without waiting and without display outputs,
+ * then print the percentiles of the frame stages */
+void set_bench_frames(unsigned long n);
+bool benchmarking();
+
+}  // namespace conky
+
+#endif /* SESSION_CAPTURE_HH */
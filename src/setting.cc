@@ -96,6 +96,7 @@ size_t get_next_seq_no() {
 }  // namespace
 
 namespace priv {
+std::atomic<uint64_t> settings_version{1};
 
 config_setting_base::config_setting_base(std::string name_)
     : name(std::move(name_)), seq_no(get_next_seq_no()) {
@@ -118,6 +119,7 @@ void config_setting_base::lua_set(lua::state &l) {
 
   l.setfield(-2, name.c_str());
   l.pop();
+  invalidate_config_settings();
 }
 
 /*
@@ -135,6 +137,9 @@ void config_setting_base::process_setting(lua::state &l, bool init) {
   l.pushvalue(-2);
   l.insert(-2);
   l.rawset(-4);
+
+  /* setters may read other settings, so this is done after every one */
+  invalidate_config_settings();
 }
 
 /*
@@ -192,6 +197,7 @@ void set_config_settings(lua::state &l) {
 
   // Force creation of settings map. In the off chance we have no settings.
   get_next_seq_no();
+  invalidate_config_settings();
 
   l.getglobal("conky");
   {
@@ -250,6 +256,11 @@ void cleanup_config_settings(lua::state &l) {
   }
 
   l.pop();
+  invalidate_config_settings();
+}
+
+void invalidate_config_settings() {
+  priv::settings_version.fetch_add(1, std::memory_order_release);
 }
 
 /////////// example settings, remove after real settings are available ///////
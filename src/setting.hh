@@ -23,7 +23,10 @@
 #ifndef SETTING_HH
 #define SETTING_HH
 
+#include <atomic>
+#include <cstdint>
 #include <limits>
+#include <mutex>
 #include <string>
 #include <type_traits>
 
@@ -48,6 +51,13 @@ void set_config_settings(lua::state &l);
  */
 void cleanup_config_settings(lua::state &l);
 
+/*
+ * Makes the settings read their value from lua again on the next get().
+ * Assignments to conky.config and lua_set() do this on their own, it is only
+ * needed when conky.config is replaced as a whole, e.g. by the config file.
+ */
+void invalidate_config_settings();
+
 template <typename T, bool is_integral = std::is_integral<T>::value,
           bool floating_point = std::is_floating_point<T>::value,
           bool is_enum = std::is_enum<T>::value>
@@ -139,6 +149,61 @@ struct lua_traits<T, false, false, true> {
 };
 
 namespace priv {
+/* bumped whenever the value of a setting may have changed, which invalidates
+ * the values cached by config_setting_template<T>::get() */
+extern std::atomic<uint64_t> settings_version;
+
+/*
+ * The value of a setting as of some settings_version. Values that fit into an
+ * atomic are read without any locking, the others are read under the lock of
+ * the lua state, which get() takes for filling the cache anyway.
+ */
+template <typename T, bool lock_free = std::is_trivially_copyable<T>::value>
+class setting_cache {
+  std::atomic<uint64_t> version{0};
+  std::atomic<T> value{T()};
+
+ public:
+  bool try_get(T &out) const {
+    if (version.load(std::memory_order_acquire) !=
+        settings_version.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    out = value.load(std::memory_order_relaxed);
+    return true;
+  }
+
+  bool try_get_locked(T &out) const { return try_get(out); }
+
+  // called with the lua state locked
+  void set(uint64_t version_, const T &value_) {
+    value.store(value_, std::memory_order_relaxed);
+    version.store(version_, std::memory_order_release);
+  }
+};
+
+template <typename T>
+class setting_cache<T, false> {
+  uint64_t version = 0;
+  T value;
+
+ public:
+  bool try_get(T &) const { return false; }
+
+  bool try_get_locked(T &out) const {
+    if (version != settings_version.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    out = value;
+    return true;
+  }
+
+  void set(uint64_t version_, const T &value_) {
+    value = value_;
+    version = version_;
+  }
+};
+
 class config_setting_base {
  private:
   static void process_setting(lua::state &l, bool init);
@@ -207,22 +272,40 @@ class config_setting_template : public priv::config_setting_base {
    * stack on exit:  | ... |
    */
   virtual T getter(lua::state &l) = 0;
+
+ private:
+  priv::setting_cache<T> cache;
 };
 
+/*
+ * Settings are read from lua only the first time they are used after they
+ * changed, which makes get() cheap enough for the per-frame paths.
+ */
 template <typename T>
 T config_setting_template<T>::get(lua::state &l) {
+  T value;
+  if (cache.try_get(value)) { return value; }
+
   std::lock_guard<lua::state> guard(l);
-  lua::stack_sentry s(l);
-  l.checkstack(2);
+  if (cache.try_get_locked(value)) { return value; }
 
-  l.getglobal("conky");
-  l.getfield(-1, "config");
-  l.replace(-2);
+  /* a change made while we read is caught on the next get() */
+  uint64_t version = priv::settings_version.load(std::memory_order_acquire);
+  {
+    lua::stack_sentry s(l);
+    l.checkstack(2);
 
-  l.getfield(-1, name.c_str());
-  l.replace(-2);
+    l.getglobal("conky");
+    l.getfield(-1, "config");
+    l.replace(-2);
+
+    l.getfield(-1, name.c_str());
+    l.replace(-2);
 
-  return getter(l);
+    value = getter(l);
+  }
+  cache.set(version, value);
+  return value;
 }
 
 /*
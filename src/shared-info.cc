@@ -0,0 +1,338 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "shared-info.hh"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#include "common.h"
+#include "conky.h"
+#include "logging.h"
+#include "text_object.h"
+
+namespace conky {
+
+const uint32_t shared_info_groups = LEGACY_CPU | LEGACY_PROCESSES |
+                                    LEGACY_MEMORY | LEGACY_LOADAVG |
+                                    LEGACY_UPTIME;
+
+namespace {
+const uint32_t segment_magic = 0x636f6e6b; /* "conk" */
+/* bump whenever the layout of segment changes */
+const uint32_t segment_layout = 1;
+const unsigned int max_shared_cpus = 1024;
+/* how long a client waits before looking for a collector again */
+const double reopen_delay = 5;
+
+struct segment {
+  uint32_t magic;
+  uint32_t layout;
+  std::atomic<uint32_t> sequence;
+  uint32_t groups;                     /* the ones published so far */
+  double interval;                     /* update interval of the collector */
+  double published[LEGACY_STATE_COUNT]; /* get_time() of the latest */
+
+  /* LEGACY_CPU */
+  unsigned int cpu_count;
+  float cpu_usage[max_shared_cpus + 1];
+  unsigned short run_threads;
+
+  /* LEGACY_PROCESSES */
+  unsigned short procs, run_procs, threads;
+
+  /* LEGACY_MEMORY */
+  unsigned long long mem, memwithbuffers, memavail, memeasyfree, memfree,
+      memmax, memdirty, shmem, legacymem;
+  unsigned long long swap, swapfree, swapmax;
+  unsigned long long bufmem, buffers, cached, free_bufcache;
+
+  /* LEGACY_LOADAVG */
+  float loadavg[3];
+
+  /* LEGACY_UPTIME */
+  double uptime;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "the sequence lock must work across processes");
+
+shared_info_mode mode = shared_info_mode::none;
+std::string segment_name;
+int segment_fd = -1;
+segment *shared = nullptr;
+double last_open_attempt = 0;
+/* the callback pool may publish several groups at once */
+std::mutex publish_mutex;
+
+/* copies field between info and the segment */
+#define SHARE(field)              \
+  if (publish) {                  \
+    shared->field = info.field;   \
+  } else {                        \
+    info.field = shared->field;   \
+  }
+
+/* Copies one group between info and the segment, into the segment if
+ * publish is set. Returns false if info can't take it. */
+bool share_group(uint32_t group, bool publish) {
+  switch (group) {
+    case LEGACY_CPU: {
+      if (info.cpu_usage == nullptr) { return false; }
+      unsigned int count = std::min(info.cpu_count, max_shared_cpus);
+      if (publish) {
+        shared->cpu_count = count;
+      } else {
+        count = std::min(count, shared->cpu_count);
+      }
+      float *from = publish ? info.cpu_usage : shared->cpu_usage;
+      float *to = publish ? shared->cpu_usage : info.cpu_usage;
+      std::copy(from, from + count + 1, to);
+#ifdef __linux__
+      SHARE(run_threads);
+#endif /* __linux__ */
+      return true;
+    }
+    case LEGACY_PROCESSES:
+      SHARE(procs);
+      SHARE(threads);
+#ifndef __linux__
+      /* written by update_top() on Linux, which isn't shared */
+      SHARE(run_procs);
+#endif /* __linux__ */
+      return true;
+    case LEGACY_MEMORY:
+      SHARE(mem);
+      SHARE(memwithbuffers);
+      SHARE(memavail);
+      SHARE(memeasyfree);
+      SHARE(memfree);
+      SHARE(memmax);
+      SHARE(memdirty);
+      SHARE(shmem);
+      SHARE(legacymem);
+      SHARE(swap);
+      SHARE(swapfree);
+      SHARE(swapmax);
+      SHARE(bufmem);
+      SHARE(buffers);
+      SHARE(cached);
+      SHARE(free_bufcache);
+      return true;
+    case LEGACY_LOADAVG:
+      SHARE(loadavg[0]);
+      SHARE(loadavg[1]);
+      SHARE(loadavg[2]);
+      return true;
+    case LEGACY_UPTIME:
+      SHARE(uptime);
+      return true;
+  }
+  return false;
+}
+
+#undef SHARE
+
+void unmap_segment() {
+  if (shared != nullptr) { munmap(shared, sizeof(segment)); }
+  if (segment_fd >= 0) { close(segment_fd); }
+  shared = nullptr;
+  segment_fd = -1;
+}
+
+/* maps the segment of a running collector for a client */
+bool map_client_segment() {
+  last_open_attempt = get_time();
+  segment_fd = shm_open(segment_name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (segment_fd < 0) { return false; }
+
+  struct stat sb {};
+  if (fstat(segment_fd, &sb) != 0 ||
+      static_cast<size_t>(sb.st_size) < sizeof(segment)) {
+    unmap_segment();
+    return false;
+  }
+  void *p =
+      mmap(nullptr, sizeof(segment), PROT_READ, MAP_SHARED, segment_fd, 0);
+  if (p == MAP_FAILED) {
+    unmap_segment();
+    return false;
+  }
+  shared = static_cast<segment *>(p);
+  if (shared->magic != segment_magic || shared->layout != segment_layout) {
+    NORM_ERR("shared memory segment '%s' is from another version of conky",
+             segment_name.c_str());
+    unmap_segment();
+    return false;
+  }
+  return true;
+}
+
+void map_collector_segment() {
+  segment_fd =
+      shm_open(segment_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (segment_fd < 0) {
+    throw std::runtime_error("can't open shared memory segment '" +
+                             segment_name + "': " + strerror(errno));
+  }
+  if (flock(segment_fd, LOCK_EX | LOCK_NB) != 0) {
+    unmap_segment();
+    throw std::runtime_error("another collector uses shared memory segment '" +
+                             segment_name + "'");
+  }
+  if (ftruncate(segment_fd, sizeof(segment)) != 0) {
+    unmap_segment();
+    throw std::runtime_error("can't size shared memory segment '" +
+                             segment_name + "': " + strerror(errno));
+  }
+  void *p = mmap(nullptr, sizeof(segment), PROT_READ | PROT_WRITE, MAP_SHARED,
+                 segment_fd, 0);
+  if (p == MAP_FAILED) {
+    unmap_segment();
+    throw std::runtime_error("can't map shared memory segment '" +
+                             segment_name + "': " + strerror(errno));
+  }
+  shared = static_cast<segment *>(p);
+
+  /* the segment may be left over from a collector that died, keep counting
+   * from where it stopped so clients still reading notice */
+  uint32_t sequence = shared->sequence.load(std::memory_order_relaxed);
+  sequence += sequence & 1;
+  shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  shared->magic = segment_magic;
+  shared->layout = segment_layout;
+  shared->groups = 0;
+  shared->sequence.store(sequence + 2, std::memory_order_release);
+}
+}  // namespace
+
+void open_shared_info(shared_info_mode mode_, const std::string &name) {
+  close_shared_info();
+  if (mode_ == shared_info_mode::none) { return; }
+
+  segment_name = "/" + (name.empty() ? "conky-" + std::to_string(getuid())
+                                     : name);
+  if (mode_ == shared_info_mode::collector) {
+    map_collector_segment();
+  } else if (!map_client_segment()) {
+    NORM_ERR("no collector found at '%s' yet, collecting on our own",
+             segment_name.c_str());
+  }
+  mode = mode_;
+}
+
+void close_shared_info() {
+  if (mode == shared_info_mode::collector && shared != nullptr) {
+    shm_unlink(segment_name.c_str());
+  }
+  unmap_segment();
+  mode = shared_info_mode::none;
+}
+
+shared_info_mode get_shared_info_mode() { return mode; }
+
+void publish_shared_info(uint32_t groups) {
+  groups &= shared_info_groups;
+  if (mode != shared_info_mode::collector || groups == 0) { return; }
+
+  std::lock_guard<std::mutex> lock(publish_mutex);
+  double now = get_time();
+  uint32_t sequence = shared->sequence.load(std::memory_order_relaxed);
+
+  shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (int i = 0; i < LEGACY_STATE_COUNT; ++i) {
+    if ((groups & (1u << i)) == 0 || !share_group(1u << i, true)) {
+      continue;
+    }
+    shared->published[i] = now;
+    shared->groups |= 1u << i;
+  }
+  shared->interval = active_update_interval();
+  shared->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool read_shared_info(uint32_t groups) {
+  if (mode != shared_info_mode::client || groups == 0 ||
+      (groups & ~shared_info_groups) != 0) {
+    return false;
+  }
+
+  double now = get_time();
+  if (shared == nullptr) {
+    if (now - last_open_attempt < reopen_delay || !map_client_segment()) {
+      return false;
+    }
+  }
+
+  for (int attempt = 0; attempt < 64; ++attempt) {
+    uint32_t sequence = shared->sequence.load(std::memory_order_acquire);
+    if ((sequence & 1) != 0) {
+      sched_yield();
+      continue;
+    }
+
+    /* data older than a couple of the collector's updates means it is gone
+     * or stuck */
+    bool fresh = (shared->groups & groups) == groups;
+    double max_age = 2 * shared->interval + 1;
+    for (int i = 0; fresh && i < LEGACY_STATE_COUNT; ++i) {
+      if ((groups & (1u << i)) == 0) { continue; }
+      fresh = now - shared->published[i] <= max_age &&
+              share_group(1u << i, false);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shared->sequence.load(std::memory_order_relaxed) != sequence) {
+      continue;
+    }
+    if (!fresh && now - last_open_attempt >= reopen_delay) {
+      /* look for a collector started since, it makes a new segment */
+      unmap_segment();
+      map_client_segment();
+    }
+    return fresh;
+  }
+  return false;
+}
+
+}  // namespace conky
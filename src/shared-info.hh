@@ -0,0 +1,71 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef SHARED_INFO_HH
+#define SHARED_INFO_HH
+
+#include <cstdint>
+#include <string>
+
+namespace conky {
+
+/*
+ * Lets several conky instances share what the legacy update functions
+ * collect. A --collector instance runs the updaters of the shared parts of
+ * struct information whether or not its text uses them, and publishes their
+ * results in a POSIX shared memory segment after each run. --client
+ * instances copy the results from there instead of reading /proc themselves.
+ * While no collector keeps them fresh, clients collect on their own.
+ *
+ * The segment is guarded by a sequence lock: the collector makes the counter
+ * odd while it writes, and readers retry if it was odd or changed while they
+ * copied, so readers never hold up the collector.
+ */
+enum class shared_info_mode { none, collector, client };
+
+/* the legacy_state flags of what can be shared */
+extern const uint32_t shared_info_groups;
+
+/* Sets up the segment called name (conky-<uid> if empty). Throws if the
+ * collector can't create it or another collector already uses it. */
+void open_shared_info(shared_info_mode mode, const std::string &name);
+void close_shared_info();
+
+shared_info_mode get_shared_info_mode();
+
+/* collector: publishes what the updater that wrote groups (legacy_state
+ * flags) left in info, if it is shared */
+void publish_shared_info(uint32_t groups);
+
+/* client: copies groups from the segment into info and returns true, if they
+ * are all shared and fresh */
+bool read_shared_info(uint32_t groups);
+
+}  // namespace conky
+
+#endif /* SHARED_INFO_HH */
@@ -20,49 +20,70 @@
  * USA.
  *
  */
-#include <errno.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
+#include <map>
+#include <string>
+#include <tuple>
 #include "conky.h" /* text_buffer_size, PACKAGE_NAME, maybe more */
 #include "logging.h"
+#include "proc-file.hh"
 #include "temphelper.h"
 
 #define SYS_SMAPI_PATH "/sys/devices/platform/smapi"
 
+/* A file of SYS_SMAPI_PATH as of this update. Each is read at most once
+ * per update, through an fd kept open across updates, however many objects
+ * show it. */
+struct smapi_file {
+  conky::proc_file file;
+  double read_at;
+  bool ok;
+  char value[256];
+
+  explicit smapi_file(const std::string &path)
+      : file(path.c_str()), read_at(-1), ok(false), value() {}
+};
+
+static std::map<std::string, smapi_file> smapi_files;
+
+static const smapi_file &smapi_read(const char *path) {
+  auto it = smapi_files.find(path);
+  if (it == smapi_files.end()) {
+    it = smapi_files
+             .emplace(std::piecewise_construct, std::forward_as_tuple(path),
+                      std::forward_as_tuple(path))
+             .first;
+  }
+
+  smapi_file &f = it->second;
+  if (f.read_at != current_update_time) {
+    f.read_at = current_update_time;
+    /* missing files are expected, e.g. those of empty battery bays */
+    int reported = 1;
+    const char *text = f.file.read(&reported);
+    f.ok = text != nullptr && sscanf(text, "%255s", f.value) == 1;
+  }
+  return f;
+}
+
 static int smapi_read_int(const char *path) {
-  FILE *fp;
+  const smapi_file &f = smapi_read(path);
   int i = 0;
-  if ((fp = fopen(path, "r"))) {
-    if (fscanf(fp, "%i\n", &i) < 0) perror("fscanf()");
-    fclose(fp);
-  }
+  if (f.ok) { sscanf(f.value, "%i", &i); }
   return i;
 }
 
 static int smapi_bat_installed_internal(int idx) {
   char path[128];
-  struct stat sb;
-  int ret = 0;
 
-  snprintf(path, 127, SYS_SMAPI_PATH "/BAT%i", idx);
-  if (!stat(path, &sb) && (sb.st_mode & S_IFMT) == S_IFDIR) {
-    snprintf(path, 127, SYS_SMAPI_PATH "/BAT%i/installed", idx);
-    ret = (smapi_read_int(path) == 1) ? 1 : 0;
-  }
-  return ret;
+  snprintf(path, 127, SYS_SMAPI_PATH "/BAT%i/installed", idx);
+  return (smapi_read_int(path) == 1) ? 1 : 0;
 }
 
 static char *smapi_read_str(const char *path) {
-  FILE *fp;
-  char str[256] = "failed";
-  if ((fp = fopen(path, "r")) != nullptr) {
-    if (fscanf(fp, "%255s\n", str) < 0) perror("fscanf()");
-    fclose(fp);
-  }
-  return strndup(str, text_buffer_size.get(*state));
+  const smapi_file &f = smapi_read(path);
+  return strndup(f.ok ? f.value : "failed", text_buffer_size.get(*state));
 }
 
 static char *smapi_get_str(const char *fname) {
@@ -29,47 +29,47 @@
  * Yeon-Hyeong Yang <lbird94@gmail.com> */
 
 #include "sony.h"
-#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "config.h"
 #include "conky.h"
 #include "logging.h"
+#include "proc-file.hh"
 #include "text_object.h"
 
 #define SONY_LAPTOP_DIR "/sys/devices/platform/sony-laptop"
 
 /* fanspeed in SONY_LAPTOP_DIR contains an integer value for fanspeed (0~255).
  * I don't know the exact measurement unit, though. I may assume that 0 for
- * 'fan stopped' and 255 for 'maximum fan speed'. */
+ * 'fan stopped' and 255 for 'maximum fan speed'. It is read once per update,
+ * through an fd kept open across updates, for all of the sony_fanspeed
+ * objects. */
+static unsigned int sony_fanspeed;
+
+int update_sony_fanspeed(void) {
+  static conky::proc_file file(SONY_LAPTOP_DIR "/fanspeed");
+  static int reported = 0;
+
+  bool first = reported == 0;
+  const char *text = file.read(&reported);
+  sony_fanspeed = 0;
+  if (text == nullptr) {
+    if (first) {
+      NORM_ERR("Enable sony support or remove sony* from your " PACKAGE_NAME
+               " config file.");
+    }
+    return 0;
+  }
+  sscanf(text, "%u", &sony_fanspeed);
+  return 0;
+}
+
 void get_sony_fanspeed(struct text_object *obj, char *p_client_buffer,
                        unsigned int client_buffer_size) {
-  FILE *fp;
-  unsigned int speed = 0;
-  char fan[128];
-
   (void)obj;
 
   if (!p_client_buffer || client_buffer_size <= 0) { return; }
 
-  snprintf(fan, 127, "%s/fanspeed", SONY_LAPTOP_DIR);
-
-  fp = fopen(fan, "r");
-  if (fp != nullptr) {
-    while (!feof(fp)) {
-      char line[256];
-
-      if (fgets(line, 255, fp) == nullptr) { break; }
-      if (sscanf(line, "%u", &speed)) { break; }
-    }
-  } else {
-    CRIT_ERR(nullptr, NULL,
-             "can't open '%s': %s\nEnable sony support or remove "
-             "sony* from your " PACKAGE_NAME " config file.",
-             fan, strerror(errno));
-  }
-
-  fclose(fp);
-  snprintf(p_client_buffer, client_buffer_size, "%d", speed);
+  snprintf(p_client_buffer, client_buffer_size, "%d", sony_fanspeed);
 }
@@ -31,6 +31,7 @@
 #ifndef _SONY_H
 #define _SONY_H
 
+int update_sony_fanspeed(void);
 void get_sony_fanspeed(struct text_object *, char *, unsigned int);
 
 #endif /* _SONY_H */
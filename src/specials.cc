@@ -38,18 +38,28 @@
 #include <sys/param.h>
 #endif /* HAVE_SYS_PARAM_H */
 #include <algorithm>
+#include <deque>
 #include <map>
+#include <memory>
 #include <sstream>
 #include "colours.h"
 #include "common.h"
 #include "conky.h"
+#include "graph-history.hh"
+#include "graph-rrd.hh"
 
-struct special_t *specials = nullptr;
+static std::vector<special_t> specials;
+/* a deque never moves its elements, so the meters handed out stay valid
+ * while more are added */
+static std::deque<special_meter> meters;
 
-int special_count;
+static int special_count;
+static int meter_count;
 int graph_count = 0;
 
-std::map<int, double *> graphs;
+/* the samples of each graph, by graph id; the specials showing them point
+ * here */
+std::map<int, conky::graph_ring> graphs;
 
 namespace {
 conky::range_config_setting<int> default_bar_width(
@@ -67,6 +77,15 @@ conky::range_config_setting<int> default_gauge_width(
     "default_gauge_width", 0, std::numeric_limits<int>::max(), 40, false);
 conky::range_config_setting<int> default_gauge_height(
     "default_gauge_height", 0, std::numeric_limits<int>::max(), 25, false);
+
+conky::simple_config_setting<std::string> graph_history_dir("graph_history_dir",
+                                                            "", false);
+
+/* by graph id; nullptr if histories are off or the file can't be used */
+std::map<int, std::unique_ptr<conky::graph_history>> graph_histories;
+
+/* by graph id, for graphs with a span= argument */
+std::map<int, conky::graph_rrd> graph_rrds;
 #endif /* BUILD_GUI */
 
 conky::simple_config_setting<std::string> console_graph_ticks(
@@ -100,12 +119,19 @@ struct graph {
   unsigned int first_colour, last_colour;
   double scale;
   char tempgrad;
+  double span; /* seconds shown, 0 for one column per update */
 };
 
 struct stippled_hr {
   int height, arg;
 };
 
+struct heatmap {
+  int cols, rows; /* 0 to fit the cells */
+  int width, height;
+  unsigned int first_colour, last_colour;
+};
+
 struct tab {
   int width, arg;
 };
@@ -187,10 +213,52 @@ void scan_font(struct text_object *obj, const char *args) {
 }
 
 /**
- * parses for [height,width] [color1 color2] [scale] [-t] [-l]
+ * Finds "span=<n>[smhd]" anywhere in args and blanks it out, so the
+ * positional arguments can be scanned as if it was not there.
+ *
+ * @return the span in seconds, 0 if there is none
+ **/
+static double scan_graph_span(char *args) {
+  char *p = strstr(args, SPAN_ARG);
+  while (p != nullptr && p != args && p[-1] != ' ') {
+    p = strstr(p + 1, SPAN_ARG);
+  }
+  if (p == nullptr) { return 0; }
+
+  char *end;
+  double span = strtod(p + strlen(SPAN_ARG), &end);
+  switch (*end) {
+    case 'd':
+      span *= 24;
+      /* falls through */
+    case 'h':
+      span *= 60;
+      /* falls through */
+    case 'm':
+      span *= 60;
+      /* falls through */
+    case 's':
+      ++end;
+      break;
+  }
+  if (*end != 0 && *end != ' ') { span = 0; }
+  if (span <= 0) {
+    NORM_ERR("invalid graph span '%.*s'", static_cast<int>(end - p), p);
+    span = 0;
+  } else if (span > conky::graph_rrd::max_span) {
+    NORM_ERR("graph spans are limited to a day");
+    span = conky::graph_rrd::max_span;
+  }
+  std::fill(p, end, ' ');
+  return span;
+}
+
+/**
+ * parses for [height,width] [color1 color2] [scale] [-t] [-l] [span=<n>]
  *
  * -l will set the showlog flag, enabling logarithmic graph scales
  * -t will set the tempgrad member to true, enabling temperature gradient colors
+ * span= shows that many seconds (or m, h, d) instead of one column per update
  *
  * @param[out] obj  struct in which to save width, height and other options
  * @param[in]  args argument string to parse
@@ -251,6 +319,7 @@ char *scan_graph(struct text_object *obj, const char *args, double defscale) {
         strncmp(argstr, LOGGRAPH, strlen(LOGGRAPH)) == 0) {
       g->flags |= SF_SHOWLOG;
     }
+    g->span = scan_graph_span(argstr);
 
     /* all the following functions try to interpret the beginning of a
      * a string with different formaters. If successfully the return from
@@ -343,38 +412,99 @@ char *scan_graph(struct text_object *obj, const char *args, double defscale) {
  * Printing various special text objects
  */
 
-struct special_t *new_special_t_node() {
-  auto *newnode = new special_t;
-
-  memset(newnode, 0, sizeof *newnode);
-  return newnode;
-}
-
 /**
- * expands the current global linked list specials to special_count elements
+ * returns the next special of the frame, reusing the node from the last frame
+ * at the same index
  *
  * increases special_count
- * @param[out] buf is set to "\x01\x00" not sure why ???
+ * @param[out] buf is set to "\x01\x00", the marker of the special in the text
  * @param[in]  t   special type enum, e.g. alignc, alignr, fg, bg, ...
- * @return pointer to the newly inserted special of type t
+ * @return pointer to the special of type t
  **/
 struct special_t *new_special(char *buf, enum special_types t) {
-  special_t *current;
-
   buf[0] = SPECIAL_CHAR;
   buf[1] = '\0';
-  if (specials == nullptr) { specials = new_special_t_node(); }
-  current = specials;
-  /* allocate special_count linked list elements */
-  for (int i = 0; i < special_count; i++) {
-    if (current->next == nullptr) { current->next = new_special_t_node(); }
-    current = current->next;
+  if (static_cast<size_t>(special_count) == specials.size()) {
+    specials.emplace_back();
   }
+  special_t *current = &specials[special_count++];
+  /* new_font() looks at the font the entry had in the last frame */
+  if (current->type != t) { *current = special_t{}; }
   current->type = t;
-  special_count++;
   return current;
 }
 
+/**
+ * returns the next meter of the frame, reusing the one from the last frame
+ * with the same index among the meters
+ **/
+struct special_meter *new_meter(char *buf, enum special_types t) {
+  if (static_cast<size_t>(meter_count) == meters.size()) {
+    meters.emplace_back();
+  }
+  special_meter *current = &meters[meter_count];
+  new_special(buf, t)->arg = meter_count++;
+  /* a node which showed something else has nothing to move from */
+  if (current->type != t) { current->from_arg = NAN; }
+  current->type = t;
+  return current;
+}
+
+void begin_frame_specials() {
+  special_count = 0;
+  meter_count = 0;
+}
+
+struct special_meter *meter_of(const special_t *s) {
+  return &meters[s->arg];
+}
+
+static double tween_progress = 1;
+
+void set_tween_progress(double progress) {
+  tween_progress = std::isnan(progress) ? 1 : std::clamp(progress, 0.0, 1.0);
+}
+
+double shown_arg(const special_meter *s) {
+  if (std::isnan(s->from_arg) || tween_progress >= 1) { return s->arg; }
+  return s->from_arg + (s->arg - s->from_arg) * tween_progress;
+}
+
+#ifdef BUILD_GUI
+/* moves on from what was drawn last, so that a change arriving before
+ * the previous one was shown in full doesn't jump */
+static void set_tweened_arg(special_meter *s, double arg) {
+  s->from_arg = std::isnan(s->from_arg) ? arg : shown_arg(s);
+  s->arg = arg;
+}
+#endif /* BUILD_GUI */
+
+bool specials_tweening() {
+  if (tween_progress >= 1) { return false; }
+  for (int i = 0; i < meter_count; ++i) {
+    const special_meter &s = meters[i];
+    if ((s.type == BAR || s.type == GAUGE) && !std::isnan(s.from_arg) &&
+        s.from_arg != s.arg) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct special_t *special_at(int index) {
+  if (index < 0 || static_cast<size_t>(index) >= specials.size()) {
+    return nullptr;
+  }
+  return &specials[index];
+}
+
+void free_specials() {
+  specials.clear();
+  meters.clear();
+
+  clear_stored_graphs();
+}
+
 void new_gauge_in_shell(struct text_object *obj, char *p,
                         unsigned int p_max_size, double usage) {
   static const char *gaugevals[] = {"_. ", "\\. ", " | ", " ./", " ._"};
@@ -386,16 +516,16 @@ void new_gauge_in_shell(struct text_object *obj, char *p,
 
 #ifdef BUILD_GUI
 void new_gauge_in_x11(struct text_object *obj, char *buf, double usage) {
-  struct special_t *s = nullptr;
+  struct special_meter *s = nullptr;
   auto *g = static_cast<struct gauge *>(obj->special_data);
 
   if (!out_to_x.get(*state)) { return; }
 
   if (g == nullptr) { return; }
 
-  s = new_special(buf, GAUGE);
+  s = new_meter(buf, GAUGE);
 
-  s->arg = usage;
+  set_tweened_arg(s, usage);
   s->width = dpi_scale(g->width);
   s->height = dpi_scale(g->height);
   s->scale = g->scale;
@@ -436,13 +566,13 @@ void new_font(struct text_object *obj, char *p, unsigned int p_max_size) {
   s = new_special(p, FONT);
 
   if (obj->data.s != nullptr) {
-    if (s->font_added >= static_cast<int>(fonts.size()) ||
-        (s->font_added == 0) || obj->data.s != fonts[s->font_added].name) {
-      selected_font = s->font_added = add_font(obj->data.s);
+    if (s->arg >= static_cast<int>(fonts.size()) || (s->arg == 0) ||
+        obj->data.s != fonts[s->arg].name) {
+      selected_font = s->arg = add_font(obj->data.s);
       selected_font = tmp;
     }
   } else {
-    selected_font = s->font_added = 0;
+    selected_font = s->arg = 0;
     selected_font = tmp;
   }
 }
@@ -450,12 +580,8 @@ void new_font(struct text_object *obj, char *p, unsigned int p_max_size) {
 /**
  * Adds value f to graph possibly truncating and scaling the graph
  **/
-static void graph_append(struct special_t *graph, double f, char showaslog) {
-  int i;
-
-  /* do nothing if we don't even have a graph yet */
-  if (graph->graph == nullptr) { return; }
-
+static double graph_value(struct special_meter *graph, double f,
+                          char showaslog) {
   if (showaslog != 0) {
 #ifdef BUILD_MATH
     f = log10(f + 1);
@@ -463,16 +589,12 @@ static void graph_append(struct special_t *graph, double f, char showaslog) {
   }
 
   if ((graph->scaled == 0) && f > graph->scale) { f = graph->scale; }
+  return f;
+}
 
-  /* shift all the data by 1 */
-  for (i = graph->graph_allocated - 1; i > 0; i--) {
-    graph->graph[i] = graph->graph[i - 1];
-  }
-  graph->graph[0] = f; /* add new data */
-
+static void graph_rescale(struct special_meter *graph) {
   if (graph->scaled != 0) {
-    graph->scale =
-        *std::max_element(graph->graph + 0, graph->graph + graph->graph_width);
+    graph->scale = graph->graph->max();
     if (graph->scale < 1e-47) {
       /* avoid NaN's when the graph is all-zero (e.g. before the first update)
        * there is nothing magical about 1e-47 here */
@@ -481,7 +603,35 @@ static void graph_append(struct special_t *graph, double f, char showaslog) {
   }
 }
 
-void new_graph_in_shell(struct special_t *s, char *buf, int buf_max_size) {
+static void graph_append(struct special_meter *graph, double f,
+                         char showaslog) {
+  /* do nothing if we don't even have a graph yet */
+  if (graph->graph == nullptr) { return; }
+
+  graph->graph->push(graph_value(graph, f, showaslog));
+  graph_rescale(graph);
+}
+
+/**
+ * Redraws a graph with a span from the samples of its graph_rrd, which f is
+ * added to first
+ **/
+static void graph_update_span(struct special_meter *graph, int graph_id,
+                              double span, double f, char showaslog) {
+  if (graph->graph == nullptr) { return; }
+
+  static std::vector<double> columns;
+  conky::graph_rrd &rrd = graph_rrds[graph_id];
+  double now = get_time();
+  rrd.push(graph_value(graph, f, showaslog), now);
+  columns.resize(graph->graph->width());
+  rrd.fill(columns.data(), columns.size(), span, now);
+  graph->graph->assign(columns.data());
+
+  graph_rescale(graph);
+}
+
+void new_graph_in_shell(struct special_meter *s, char *buf, int buf_max_size) {
   // Split config string on comma to avoid the hassle of dealing with the
   // idiosyncrasies of multi-byte unicode on different platforms.
   // TODO(brenden): Parse config string once and cache result.
@@ -495,7 +645,7 @@ void new_graph_in_shell(struct special_t *s, char *buf, int buf_max_size) {
   char *buf_max = buf + (sizeof(char) * buf_max_size);
   double scale = (tickitems.size() - 1) / s->scale;
   for (int i = s->graph_allocated - 1; i >= 0; i--) {
-    const unsigned int v = round_to_positive_int(s->graph[i] * scale);
+    const unsigned int v = round_to_positive_int((*s->graph)[i] * scale);
     const char *tick = tickitems[v].c_str();
     size_t itemlen = tickitems[v].size();
     for (unsigned int j = 0; j < itemlen; j++) {
@@ -507,29 +657,43 @@ graph_buf_end:
   *p = '\0';
 }
 
-double *copy_graph(double *original_graph, int graph_width) {
-  double *new_graph =
-      static_cast<double *>(malloc(graph_width * sizeof(double)));
-
-  memcpy(new_graph, original_graph, graph_width * sizeof(double));
-
-  return new_graph;
+static std::string graph_history_path(int graph_id) {
+  return to_real_path(graph_history_dir.get(*state)) + "/graph-" +
+         std::to_string(graph_id);
 }
 
-double *retrieve_graph(int graph_id, int graph_width) {
-  if (graphs.find(graph_id) == graphs.end()) {
-    return static_cast<double *>(calloc(1, graph_width * sizeof(double)));
-  } else {
-    return copy_graph(graphs[graph_id], graph_width);
+static conky::graph_history *graph_history_for(int graph_id, int width) {
+  auto it = graph_histories.find(graph_id);
+
+  if (it == graph_histories.end()) {
+    /* first use: open the file, or remember that there is none */
+    std::unique_ptr<conky::graph_history> history;
+    if (!graph_history_dir.get(*state).empty()) {
+      history.reset(new conky::graph_history);
+      if (history->open(graph_history_path(graph_id), width)) {
+        history->catch_up(get_time(), active_update_interval());
+      } else {
+        history.reset();
+      }
+    }
+    it = graph_histories.emplace(graph_id, std::move(history)).first;
+  } else if (it->second != nullptr &&
+             it->second->width() != static_cast<unsigned int>(width)) {
+    /* reopening at the new width keeps the newest samples */
+    if (!it->second->open(graph_history_path(graph_id), width)) {
+      it->second.reset();
+    }
   }
+  return it->second.get();
 }
 
-void store_graph(int graph_id, struct special_t *s) {
-  if (s->graph == nullptr) {
-    graphs[graph_id] = nullptr;
-  } else {
-    if (graphs.find(graph_id) != graphs.end()) { free(graphs[graph_id]); }
-    graphs[graph_id] = s->graph;
+/* fills a new graph with what was drawn before conky was last restarted */
+static void seed_graph(int graph_id, conky::graph_ring *graph) {
+  conky::graph_history *history = graph_history_for(graph_id, graph->width());
+  if (history != nullptr) {
+    std::vector<double> samples(graph->width(), 0.0);
+    history->load(samples.data(), samples.size());
+    graph->assign(samples.data());
   }
 }
 
@@ -543,39 +707,30 @@ void store_graph(int graph_id, struct special_t *s) {
  **/
 void new_graph(struct text_object *obj, char *buf, int buf_max_size,
                double val) {
-  struct special_t *s = nullptr;
+  struct special_meter *s = nullptr;
   auto *g = static_cast<struct graph *>(obj->special_data);
 
   if ((g == nullptr) || (buf_max_size == 0)) { return; }
 
-  s = new_special(buf, GRAPH);
+  s = new_meter(buf, GRAPH);
 
   /* set graph (special) width to width in obj */
   s->width = dpi_scale(g->width);
   if (s->width != 0) { s->graph_width = s->width; }
 
-  if (s->graph_width != s->graph_allocated) {
-    auto *graph = static_cast<double *>(
-        realloc(s->graph, s->graph_width * sizeof(double)));
-    DBGP("reallocing graph from %d to %d", s->graph_allocated, s->graph_width);
-    if (s->graph == nullptr) {
-      /* initialize */
-      std::fill_n(graph, s->graph_width, 0.0);
-      s->scale = 100;
-    } else if (graph != nullptr) {
-      if (s->graph_width > s->graph_allocated) {
-        /* initialize the new region */
-        std::fill(graph + s->graph_allocated, graph + s->graph_width, 0.0);
-      }
-    } else {
-      DBGP("reallocing FAILED");
-      graph = s->graph;
-      s->graph_width = s->graph_allocated;
-    }
-    s->graph = graph;
-    s->graph_allocated = s->graph_width;
-    graphs[g->id] = graph;
+  /* the samples belong to the graph's id, not to the special, which may
+   * have shown another graph in the last frame */
+  auto it = graphs.find(g->id);
+  if (it == graphs.end()) {
+    it = graphs.emplace(g->id, conky::graph_ring()).first;
+    it->second.resize(s->graph_width);
+    seed_graph(g->id, &it->second);
+  } else if (static_cast<int>(it->second.width()) != s->graph_width) {
+    DBGP("resizing graph from %u to %d", it->second.width(), s->graph_width);
+    it->second.resize(s->graph_width);
   }
+  s->graph = &it->second;
+  s->graph_allocated = s->graph_width;
   s->height = dpi_scale(g->height);
   s->first_colour = adjust_colours(g->first_colour);
   s->last_colour = adjust_colours(g->last_colour);
@@ -596,11 +751,17 @@ void new_graph(struct text_object *obj, char *buf, int buf_max_size,
   }
 #endif
 
-  if (s->graph) { s->graph = retrieve_graph(g->id, s->graph_width); }
-
-  graph_append(s, val, g->flags);
-
-  store_graph(g->id, s);
+  s->span = g->span;
+  if (g->span != 0) {
+    /* drawn from the graph_rrd, there is nothing worth keeping on disk */
+    graph_update_span(s, g->id, g->span, val, g->flags);
+  } else {
+    graph_append(s, val, g->flags);
+    if (s->graph->width() != 0) {
+      conky::graph_history *history = graph_history_for(g->id, s->graph_width);
+      if (history != nullptr) { history->push((*s->graph)[0], get_time()); }
+    }
+  }
 
   if (out_to_stdout.get(*state)) { new_graph_in_shell(s, buf, buf_max_size); }
 }
@@ -610,7 +771,7 @@ void new_hr(struct text_object *obj, char *p, unsigned int p_max_size) {
 
   if (p_max_size == 0) { return; }
 
-  new_special(p, HORIZONTAL_LINE)->height = dpi_scale(obj->data.l);
+  new_special(p, HORIZONTAL_LINE)->size = dpi_scale(obj->data.l);
 }
 
 void scan_stippled_hr(struct text_object *obj, const char *arg) {
@@ -642,9 +803,77 @@ void new_stippled_hr(struct text_object *obj, char *p,
 
   s = new_special(p, STIPPLED_HR);
 
-  s->height = dpi_scale(sh->height);
+  s->size = dpi_scale(sh->height);
   s->arg = dpi_scale(sh->arg);
 }
+
+/**
+ * parses for [cols rows] [height,width] [color1 color2]
+ **/
+void scan_heatmap(struct text_object *obj, const char *args) {
+  auto *h = static_cast<struct heatmap *>(malloc(sizeof(struct heatmap)));
+  memset(h, 0, sizeof(struct heatmap));
+  obj->special_data = h;
+
+  /* zero width means all space that is available */
+  h->width = default_graph_width.get(*state);
+  h->height = default_graph_height.get(*state);
+  if (args == nullptr) { return; }
+
+  int a, b, n = 0;
+  /* the first %d stops at the comma of a leading height,width */
+  if (sscanf(args, "%d %d %n", &a, &b, &n) == 2) {
+    if (a < 0 || b < 0) {
+      NORM_ERR("heatmap columns and rows can't be negative");
+    } else {
+      h->cols = a;
+      h->rows = b;
+    }
+    args += n;
+  }
+  n = 0;
+  if (sscanf(args, "%d,%d %n", &a, &b, &n) == 2) {
+    h->height = a;
+    h->width = b;
+    args += n;
+  }
+  if (sscanf(args, "%x %x", &h->first_colour, &h->last_colour) != 2) {
+    h->first_colour = h->last_colour = 0;
+  }
+}
+
+/**
+ * Shows values, each from 0 to 1, as the cells of one heatmap
+ **/
+void new_heatmap(struct text_object *obj, char *p, unsigned int p_max_size,
+                 const float *values, int count) {
+  auto *h = static_cast<struct heatmap *>(obj->special_data);
+
+  if (!out_to_x.get(*state)) { return; }
+
+  if ((h == nullptr) || (p_max_size == 0)) { return; }
+
+  struct special_meter *s = new_meter(p, HEATMAP);
+
+  s->width = dpi_scale(h->width);
+  s->height = dpi_scale(h->height);
+  s->first_colour = adjust_colours(h->first_colour);
+  s->last_colour = adjust_colours(h->last_colour);
+
+  count = std::max(count, 0);
+  s->cols = h->cols;
+  s->rows = h->rows;
+  if (s->cols == 0 && s->rows == 0) {
+    s->cols = static_cast<int>(std::ceil(std::sqrt(count)));
+  } else if (s->cols == 0) {
+    s->cols = (count + s->rows - 1) / s->rows;
+  }
+  s->cols = std::max(s->cols, 1);
+  if (s->rows == 0) { s->rows = (count + s->cols - 1) / s->cols; }
+  s->rows = std::max(s->rows, 1);
+
+  s->cells.assign(values, values + std::min(count, s->cols * s->rows));
+}
 #endif /* BUILD_GUI */
 
 void new_fg(struct text_object *obj, char *p, unsigned int p_max_size) {
@@ -694,16 +923,16 @@ static void new_bar_in_shell(struct text_object *obj, char *buffer,
 
 #ifdef BUILD_GUI
 static void new_bar_in_x11(struct text_object *obj, char *buf, double usage) {
-  struct special_t *s = nullptr;
+  struct special_meter *s = nullptr;
   auto *b = static_cast<struct bar *>(obj->special_data);
 
   if (!out_to_x.get(*state)) { return; }
 
   if (b == nullptr) { return; }
 
-  s = new_special(buf, BAR);
+  s = new_meter(buf, BAR);
 
-  s->arg = usage;
+  set_tweened_arg(s, usage);
   s->width = dpi_scale(b->width);
   s->height = dpi_scale(b->height);
   s->scale = b->scale;
@@ -795,11 +1024,34 @@ void new_tab(struct text_object *obj, char *p, unsigned int p_max_size) {
   if ((t == nullptr) || (p_max_size == 0)) { return; }
 
   s = new_special(p, TAB);
-  s->width = dpi_scale(t->width);
+  s->size = dpi_scale(t->width);
   s->arg = dpi_scale(t->arg);
 }
 
+void renumber_graphs() { graph_count = 0; }
+
+size_t specials_memory(size_t *count) {
+  size_t size = 0;
+  size += specials.capacity() * sizeof(special_t);
+  for (const auto &m : meters) {
+    size += sizeof(special_meter) + m.cells.capacity() * sizeof(float);
+  }
+  for (const auto &g : graphs) { size += sizeof(g) + g.second.memory(); }
+#ifdef BUILD_GUI
+  for (const auto &h : graph_histories) {
+    if (h.second) { size += sizeof(conky::graph_history) + h.second->mapped(); }
+  }
+  for (const auto &r : graph_rrds) { size += sizeof(r) + r.second.memory(); }
+#endif /* BUILD_GUI */
+  *count = specials.size();
+  return size;
+}
+
 void clear_stored_graphs() {
   graph_count = 0;
   graphs.clear();
+#ifdef BUILD_GUI
+  graph_histories.clear();
+  graph_rrds.clear();
+#endif /* BUILD_GUI */
 }
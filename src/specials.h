@@ -29,6 +29,11 @@
 #ifndef _SPECIALS_H
 #define _SPECIALS_H
 
+#include <cstdint>
+#include <vector>
+
+#include "graph-ring.hh"
+
 /* special stuff in text_buffer */
 
 #define SPECIAL_CHAR '\x01'
@@ -36,6 +41,7 @@
 // don't use spaces in LOGGRAPH or NORMGRAPH if you change them
 #define LOGGRAPH "-l"
 #define TEMPGRAD "-t"
+#define SPAN_ARG "span="
 
 enum special_types {
   NONSPECIAL = 0,
@@ -54,15 +60,34 @@ enum special_types {
   SAVE_COORDINATES,
   FONT,
   GOTO,
-  TAB
+  TAB,
+  HEATMAP
 };
 
+/*
+ * A special as its SPECIAL_CHAR in the text buffer refers to it. Colours,
+ * fonts, offsets, alignments, gotos, tabs and lines keep all they need in
+ * these 8 bytes; the meters (BAR, GAUGE, GRAPH and HEATMAP) keep the rest in
+ * a special_meter, see meter_of(). The layout and drawing of a line thus walk
+ * a dense array, and only meters cost more.
+ */
 struct special_t {
-  int type;
+  uint8_t type;
+  int16_t size; /* the height of an hr, the step of a TAB */
+  /* an offset or position; the font of a FONT, the pixel of a colour, the
+   * dash length of a STIPPLED_HR, or the index of a meter's special_meter */
+  int32_t arg;
+};
+static_assert(sizeof(special_t) == 8, "special_t should stay compact");
+
+/* what a bar, gauge, graph or heatmap shows */
+struct special_meter {
+  int type; /* what the node showed last, to tell whether from_arg applies */
   short height;
   short width;
   double arg;
-  double *graph;
+  double from_arg; /* the value a bar or gauge moves from, see shown_arg() */
+  conky::graph_ring *graph; /* the samples of the graph's id, or nullptr */
   double scale; /* maximum value */
   short show_scale;
   int graph_width;
@@ -71,14 +96,42 @@ struct special_t {
   int scale_log;
   unsigned long first_colour;  // for graph gradient
   unsigned long last_colour;
-  short font_added;
   char tempgrad;
-  struct special_t *next;
+  double span; /* seconds a graph shows, 0 for one column per update */
+  std::vector<float> cells; /* a heatmap's values from 0 to 1, row by row */
+  int cols, rows;           /* the grid of a heatmap */
 };
 
-/* direct access to the registered specials (FIXME: bad encapsulation) */
-extern struct special_t *specials;
-extern int special_count;
+/* starts the specials of a new frame, before generating the text */
+void begin_frame_specials();
+
+/* the special of the index-th SPECIAL_CHAR in the text buffer, nullptr if
+ * there is none. The entries are kept from one frame to the next, so this
+ * can return one from an earlier frame. The pointer stays valid until the
+ * next special is created. */
+struct special_t *special_at(int index);
+
+/* the meter of a special of type BAR, GAUGE, GRAPH or HEATMAP. Meters are
+ * kept from one frame to the next too (by their order among the meters), and
+ * never move. */
+struct special_meter *meter_of(const struct special_t *s);
+
+/* the colour of an FG, BG or OUTLINE special */
+inline unsigned long special_colour(const struct special_t *s) {
+  return static_cast<uint32_t>(s->arg);
+}
+
+/* frees all specials and the graph samples kept for them */
+void free_specials();
+
+/* How far bars and gauges have moved from their last value to the current
+ * one, from 0 to 1, in the frame about to be drawn. Stays 1 unless
+ * animation_interval is set. */
+void set_tween_progress(double progress);
+/* the value of a bar or gauge to draw in the current frame */
+double shown_arg(const struct special_meter *s);
+/* whether one of the specials of the current frame is still moving */
+bool specials_tweening();
 
 /* forward declare to avoid mutual inclusion between specials.h and
  * text_object.h */
@@ -92,12 +145,15 @@ void scan_font(struct text_object *, const char *);
 char *scan_graph(struct text_object *, const char *, double);
 void scan_tab(struct text_object *, const char *);
 void scan_stippled_hr(struct text_object *, const char *);
+void scan_heatmap(struct text_object *, const char *);
 
 /* printing specials */
 void new_font(struct text_object *, char *, unsigned int);
 void new_graph(struct text_object *, char *, int, double);
 void new_hr(struct text_object *, char *, unsigned int);
 void new_stippled_hr(struct text_object *, char *, unsigned int);
+void new_heatmap(struct text_object *, char *, unsigned int, const float *,
+                 int);
 #endif /* BUILD_GUI */
 void new_gauge(struct text_object *, char *, unsigned int, double);
 void new_bar(struct text_object *, char *, unsigned int, double);
@@ -113,7 +169,15 @@ void new_goto(struct text_object *, char *, unsigned int);
 void new_tab(struct text_object *, char *, unsigned int);
 
 void clear_stored_graphs();
+/* the memory held by the specials and the samples of the graphs, for
+ * ${conky_mem}; count is set to the number of specials */
+size_t specials_memory(size_t *count);
+/* numbers the graphs of a text parsed from now on from 1 again, so they take
+ * over the stored graphs of the graphs at the same place in the old text */
+void renumber_graphs();
 
 struct special_t *new_special(char *buf, enum special_types t);
+/* new_special() for meters */
+struct special_meter *new_meter(char *buf, enum special_types t);
 
 #endif /* _SPECIALS_H */
@@ -31,16 +31,214 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <cctype>
+#include <cerrno>
 #include <cstring>
+#include <deque>
+#include <map>
 #include <memory>
+#include <string>
 #include "common.h"
 #include "config.h"
 #include "conky.h"
+#include "file-watch.hh"
 #include "logging.h"
 #include "text_object.h"
 
+#ifdef HAVE_SYS_INOTIFY_H
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wc99-extensions"
+#include <sys/inotify.h>
+#pragma clang diagnostic pop
+#endif /* HAVE_SYS_INOTIFY_H */
+
 #define MAX_HEADTAIL_LINES 30
 #define DEFAULT_MAX_HEADTAIL_USES 2
+/* how much of a file is read to find its last lines when it's first opened */
+#define TAIL_INITIAL_BYTES 0x10000
+
+namespace {
+/*
+ * Follows one regular file for all ${tail}s that show it. It keeps the last
+ * MAX_HEADTAIL_LINES lines, and when inotify reports a change it reads only
+ * what was appended since the last read. Truncation restarts from the
+ * beginning, and rotation (a new inode at the path) reopens the file once
+ * whatever was left in the old one has been read.
+ */
+class tail_reader {
+  std::string path;
+  int fd{-1};
+  dev_t dev{0};
+  ino_t ino{0};
+  off_t offset{0};
+  bool skip_partial{false}; /* we started reading in the middle of a line */
+  std::string partial;      /* the last line, if it has no '\n' yet */
+  std::deque<std::string> lines;
+#ifdef HAVE_SYS_INOTIFY_H
+  int inotify_fd{-1};
+  bool moved{false}; /* the watched file is no longer at path */
+
+  bool read_events();
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  void reopen();
+  void read_appended();
+  void add_data(const char *data, size_t len);
+
+ public:
+  explicit tail_reader(std::string path_) : path(std::move(path_)) {}
+  ~tail_reader();
+
+  static std::shared_ptr<tail_reader> get(const std::string &path);
+
+  bool is_open() const { return fd >= 0; }
+  void refresh();
+  void print(int wantedlines, char *p, unsigned int p_max_size) const;
+};
+
+tail_reader::~tail_reader() {
+  if (fd >= 0) { close(fd); }
+#ifdef HAVE_SYS_INOTIFY_H
+  if (inotify_fd >= 0) { close(inotify_fd); }
+#endif /* HAVE_SYS_INOTIFY_H */
+}
+
+std::shared_ptr<tail_reader> tail_reader::get(const std::string &path) {
+  static std::map<std::string, std::weak_ptr<tail_reader>> readers;
+
+  std::shared_ptr<tail_reader> reader = readers[path].lock();
+  if (!reader) {
+    reader = std::make_shared<tail_reader>(path);
+    readers[path] = reader;
+  }
+  return reader;
+}
+
+void tail_reader::add_data(const char *data, size_t len) {
+  const char *end = data + len;
+
+  while (data < end) {
+    const char *nl = static_cast<const char *>(memchr(data, '\n', end - data));
+    if (nl == nullptr) {
+      if (!skip_partial) { partial.append(data, end - data); }
+      return;
+    }
+    if (skip_partial) {
+      skip_partial = false;
+    } else {
+      partial.append(data, nl - data);
+      lines.push_back(std::move(partial));
+      if (lines.size() > MAX_HEADTAIL_LINES) { lines.pop_front(); }
+    }
+    partial.clear();
+    data = nl + 1;
+  }
+}
+
+void tail_reader::read_appended() {
+  struct stat st {};
+  char buf[0x4000];
+  ssize_t len;
+
+  if (fstat(fd, &st) != 0) { return; }
+  if (st.st_size < offset) {
+    /* truncated, so everything in it is new */
+    lines.clear();
+    partial.clear();
+    skip_partial = false;
+    offset = 0;
+  }
+  while ((len = pread(fd, buf, sizeof(buf), offset)) > 0) {
+    add_data(buf, len);
+    offset += len;
+  }
+}
+
+void tail_reader::reopen() {
+  struct stat st {};
+
+  if (stat(path.c_str(), &st) != 0) { return; }
+  if (fd >= 0 && st.st_dev == dev && st.st_ino == ino) { return; }
+
+  int newfd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (newfd < 0) { return; }
+  if (fd >= 0) {
+    /* rotated: the new file continues the old one */
+    close(fd);
+    offset = 0;
+  } else if (st.st_size > TAIL_INITIAL_BYTES) {
+    offset = st.st_size - TAIL_INITIAL_BYTES;
+    skip_partial = true;
+  }
+  fd = newfd;
+  dev = st.st_dev;
+  ino = st.st_ino;
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (inotify_fd >= 0) { close(inotify_fd); }
+  moved = false;
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd >= 0 &&
+      inotify_add_watch(inotify_fd, path.c_str(),
+                        IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                            IN_DELETE_SELF) < 0) {
+    close(inotify_fd);
+    inotify_fd = -1;
+  }
+#endif /* HAVE_SYS_INOTIFY_H */
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* returns whether anything happened to the file since the last call */
+bool tail_reader::read_events() {
+  alignas(struct inotify_event) char buf[1024];
+  bool changed = false;
+  ssize_t len;
+
+  while ((len = read(inotify_fd, buf, sizeof(buf))) > 0) {
+    changed = true;
+    for (char *ptr = buf; ptr < buf + len;) {
+      auto *ev = reinterpret_cast<struct inotify_event *>(ptr);
+      ptr += sizeof(struct inotify_event) + ev->len;
+      if ((ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF | IN_IGNORED)) != 0) {
+        moved = true;
+      }
+    }
+  }
+  return changed;
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+void tail_reader::refresh() {
+#ifdef HAVE_SYS_INOTIFY_H
+  /* without a watch (no file yet, or inotify failed) and after the file was
+   * moved away, look every time until it's back */
+  if (fd >= 0 && inotify_fd >= 0 && !read_events() && !moved) { return; }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+  if (fd >= 0) { read_appended(); }
+  reopen();
+  read_appended();
+}
+
+/* the last wantedlines lines without the final newline, cut at the front to
+ * fit into p like the old tailstring() did */
+void tail_reader::print(int wantedlines, char *p,
+                        unsigned int p_max_size) const {
+  std::string text;
+  size_t total = lines.size() + (partial.empty() ? 0 : 1);
+  size_t first = total > static_cast<size_t>(wantedlines) ? total - wantedlines
+                                                          : 0;
+
+  for (size_t i = first; i < total; i++) {
+    if (i != first) { text += '\n'; }
+    text += i < lines.size() ? lines[i] : partial;
+  }
+
+  if (p_max_size == 0) { return; }
+  size_t skip = text.size() >= p_max_size ? text.size() - p_max_size + 1 : 0;
+  snprintf(p, p_max_size, "%s", text.c_str() + skip);
+}
+}  // namespace
 
 struct headtail {
   int wantedlines{0};
@@ -49,6 +247,8 @@ struct headtail {
   int current_use{0};
   int max_uses{0};
   int reported{0};
+  bool fifo{false};
+  std::shared_ptr<tail_reader> reader;
 
   headtail() = default;
 
@@ -91,13 +291,13 @@ void init_tailhead(const char *type, const char *arg, struct text_object *obj,
   args = sscanf(arg, "%s %d %d", tmp.get(), &ht->wantedlines, &ht->max_uses);
   if (args < 2 || args > 3) {
     free_tailhead(obj);
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "%s needs a file as 1st and a number of lines as 2nd argument",
              type);
   }
   if (ht->max_uses < 1) {
     free_tailhead(obj);
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "invalid arg for %s, next_check must be larger than 0", type);
   }
   if (ht->wantedlines > 0 && ht->wantedlines <= MAX_HEADTAIL_LINES) {
@@ -106,7 +306,7 @@ void init_tailhead(const char *type, const char *arg, struct text_object *obj,
     ht->current_use = 0;
   } else {
     free_tailhead(obj);
-    CRIT_ERR(obj, free_at_crash,
+    CRIT_ERR(nullptr, free_at_crash,
              "invalid arg for %s, number of lines must be between 1 and %d",
              type, MAX_HEADTAIL_LINES);
   }
@@ -189,58 +389,49 @@ void print_head(struct text_object *obj, char *p, unsigned int p_max_size) {
 }
 
 void print_tail(struct text_object *obj, char *p, unsigned int p_max_size) {
-  print_tailhead("tail", obj, p, p_max_size);
-}
-
-/* FIXME: use something more general (see also tail.c, head.c */
-#define BUFSZ 0x1000
+  auto *ht = static_cast<struct headtail *>(obj->data.opaque);
+  struct stat st {};
 
-void print_lines(struct text_object *obj, char *p, unsigned int p_max_size) {
-  static int rep = 0;
-  FILE *fp = open_file(obj->data.s, &rep);
-  char buf[BUFSZ];
-  int j, lines;
+  if (ht == nullptr) { return; }
 
-  if (fp == nullptr) {
-    snprintf(p, p_max_size, "%s", "File Unreadable");
+  /* FIFOs can't be followed, so they are still read the old way */
+  if (!ht->reader && !ht->fifo) {
+    if (stat(ht->logfile.c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+      ht->fifo = true;
+    } else {
+      ht->reader = tail_reader::get(ht->logfile);
+    }
+  }
+  if (!ht->reader) {
+    print_tailhead("tail", obj, p, p_max_size);
     return;
   }
 
-  lines = 0;
-  while (fgets(buf, BUFSZ, fp) != nullptr) {
-    for (j = 0; buf[j] != 0; j++) {
-      if (buf[j] == '\n') { lines++; }
-    }
+  ht->reader->refresh();
+  if (!ht->reader->is_open()) {
+    CRIT_ERR(nullptr, nullptr, "$tail can't find information about %s",
+             ht->logfile.c_str());
   }
-  snprintf(p, p_max_size, "%d", lines);
-  fclose(fp);
+  ht->reader->print(ht->wantedlines, p, p_max_size);
 }
 
-void print_words(struct text_object *obj, char *p, unsigned int p_max_size) {
-  static int rep = 0;
-  FILE *fp = open_file(obj->data.s, &rep);
-  char buf[BUFSZ];
-  int j, words;
-  char inword = 0;
+/* the counts are kept by the watched file until the file changes */
+void print_lines(struct text_object *obj, char *p, unsigned int p_max_size) {
+  conky::watched_file *file = get_watched_file(obj);
 
-  if (fp == nullptr) {
+  if (file == nullptr || !file->readable()) {
     snprintf(p, p_max_size, "%s", "File Unreadable");
     return;
   }
+  snprintf(p, p_max_size, "%zu", file->lines());
+}
 
-  words = 0;
-  while (fgets(buf, BUFSZ, fp) != nullptr) {
-    for (j = 0; buf[j] != 0; j++) {
-      if (isspace(static_cast<unsigned char>(buf[j])) == 0) {
-        if (inword == 0) {
-          words++;
-          inword = 1;
-        }
-      } else {
-        inword = 0;
-      }
-    }
+void print_words(struct text_object *obj, char *p, unsigned int p_max_size) {
+  conky::watched_file *file = get_watched_file(obj);
+
+  if (file == nullptr || !file->readable()) {
+    snprintf(p, p_max_size, "%s", "File Unreadable");
+    return;
   }
-  snprintf(p, p_max_size, "%d", words);
-  fclose(fp);
+  snprintf(p, p_max_size, "%zu", file->words());
 }
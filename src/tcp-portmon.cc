@@ -18,13 +18,75 @@
  *
  */
 #include "tcp-portmon.h"
+#include <ctime>
+#include <mutex>
+#include <string>
 #include "conky.h"
 #include "libtcp-portmon.h"
 #include "logging.h"
 #include "text_object.h"
+#include "update-cb.hh"
+
+/* seconds before the name of an address is looked up again */
+#define TCP_PORTMON_DNS_TTL 300
 
 static tcp_port_monitor_collection_t *pmc = nullptr;
 
+namespace {
+/*
+ * Looks up the name of a numeric address on the callback pool, so that rhost
+ * and lhost never wait for DNS while the text is generated. It runs every
+ * update but only asks again once the name is TCP_PORTMON_DNS_TTL seconds
+ * old; until the first answer the objects show the address.
+ */
+class host_name_cb : public conky::callback<std::string, std::string> {
+  typedef conky::callback<std::string, std::string> Base;
+
+  time_t looked_up = 0;
+
+ protected:
+  void work() override;
+
+ public:
+  host_name_cb(double period, const std::string &addr)
+      : Base(period, false, Base::Tuple(addr)) {}
+};
+
+void host_name_cb::work() {
+  union {
+    struct sockaddr_in sa4;
+    struct sockaddr_in6 sa6;
+    struct sockaddr sa;
+  } sa;
+  socklen_t slen;
+  char host[NI_MAXHOST];
+  time_t now = time(nullptr);
+
+  if (looked_up != 0 && now - looked_up < TCP_PORTMON_DNS_TTL) { return; }
+  looked_up = now;
+
+  memset(&sa, 0, sizeof(sa));
+  if (inet_pton(AF_INET, get<0>().c_str(), &sa.sa4.sin_addr) == 1) {
+    sa.sa4.sin_family = AF_INET;
+    slen = sizeof(sa.sa4);
+  } else if (inet_pton(AF_INET6, get<0>().c_str(), &sa.sa6.sin6_addr) == 1) {
+    sa.sa6.sin6_family = AF_INET6;
+    slen = sizeof(sa.sa6);
+  } else {
+    return;
+  }
+
+  /* a failed lookup keeps the last name */
+  if (getnameinfo(&sa.sa, slen, host, sizeof(host), nullptr, 0, NI_NAMEREQD) !=
+      0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(result_mutex);
+  result = host;
+}
+}  // namespace
+
 static conky::range_config_setting<int> max_port_monitor_connections(
     "max_port_monitor_connections", 0, std::numeric_limits<int>::max(),
     MAX_PORT_MONITOR_CONNECTIONS_DEFAULT, false);
@@ -138,10 +200,26 @@ void tcp_portmon_action(struct text_object *obj, char *p,
     return;
   }
 
+  /* host names are looked up in the background, peek the address instead */
+  int item = pmd->item;
+  if (item == REMOTEHOST) {
+    item = REMOTEIP;
+  } else if (item == LOCALHOST) {
+    item = LOCALIP;
+  }
+
   /* now grab the text of interest */
-  if (peek_tcp_port_monitor(p_monitor, pmd->item, pmd->connection_index, p,
+  if (peek_tcp_port_monitor(p_monitor, item, pmd->connection_index, p,
                             p_max_size) != 0) {
     snprintf(p, p_max_size, "%s", "monitor peek error");
+    return;
+  }
+
+  if (item != pmd->item && *p != '\0') {
+    auto cb = conky::register_cb<host_name_cb>(0, std::string(p));
+    const std::string &name = cb->read_result();
+
+    if (!name.empty()) { snprintf(p, p_max_size, "%s", name.c_str()); }
   }
 }
 
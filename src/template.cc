@@ -28,9 +28,12 @@
  */
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
 #include "conky.h"
 #include "logging.h"
+#include "template.h"
 
 namespace {
 conky::simple_config_setting<std::string> _template[10] = {
@@ -39,41 +42,104 @@ conky::simple_config_setting<std::string> _template[10] = {
     {"template4", std::string(), true}, {"template5", std::string(), true},
     {"template6", std::string(), true}, {"template7", std::string(), true},
     {"template8", std::string(), true}, {"template9", std::string(), true}};
-}  // namespace
+
+/* conky.config.templates, the named templates: a table of strings by name */
+class templates_setting : public conky::priv::config_setting_base {
+ public:
+  templates_setting() : config_setting_base("templates") {}
+
+  std::unordered_map<std::string, std::string> templates;
+
+ protected:
+  void lua_setter(lua::state &l, bool init) override;
+  void cleanup(lua::state &l) override {
+    templates.clear();
+    l.pop();
+  }
+};
+
+void templates_setting::lua_setter(lua::state &l, bool) {
+  lua::stack_sentry s(l, -2);
+
+  if (!l.isnil(-2) && l.type(-2) != lua::TTABLE) {
+    NORM_ERR("templates should be a table of named templates");
+    l.replace(-2);
+    ++s;
+    return;
+  }
+
+  templates.clear();
+  if (!l.isnil(-2)) {
+    l.checkstack(2);
+    l.pushnil();
+    while (l.next(-3)) {
+      if (l.type(-2) == lua::TSTRING && l.type(-1) == lua::TSTRING) {
+        templates[l.tostring(-2)] = l.tostring(-1);
+      } else {
+        NORM_ERR("templates: ignoring a template which isn't a named string");
+      }
+      l.pop();
+    }
+  }
+  l.pop();
+  ++s;
+}
+
+templates_setting named_templates;
+
+/* splits the arguments of a template at the spaces which aren't escaped */
+std::vector<std::string> split_args(const std::string &args) {
+  std::vector<std::string> ret;
+  std::vector<char> dup(args.begin(), args.end());
+  dup.push_back(0);
+  char *start = dup.data();
+  char *p = start;
+
+  while (*p != 0) {
+    while ((*p != 0) && (*p == ' ' && (p == start || *(p - 1) != '\\'))) {
+      p++;
+    }
+    if (p > start && *(p - 1) == '\\') { p--; }
+    char *p_old = p;
+    while ((*p != 0) && (*p != ' ' || (p > start && *(p - 1) == '\\'))) {
+      p++;
+    }
+    if (*p != 0) {
+      (*p) = '\0';
+      p++;
+    }
+    ret.emplace_back(p_old);
+  }
+  return ret;
+}
 
 /* backslash_escape - do the actual substitution task for template objects
  *
- * The field templates is used for substituting the \N occurrences. Set it to
- * nullptr to leave them as they are.
+ * Appends src to out, with the \N occurrences replaced by the arguments in
+ * templates. Set it to nullptr to leave them as they are.
  */
-static char *backslash_escape(const char *src, char **templates,
-                              unsigned int template_count) {
-  char *src_dup;
-  const char *p;
-  unsigned int dup_idx = 0, dup_len;
+void backslash_escape(std::string &out, const char *src,
+                      const std::vector<std::string> *templates) {
+  const char *p = src;
 
-  dup_len = strlen(src) + 1;
-  src_dup = static_cast<char *>(malloc(dup_len * sizeof(char)));
-
-  p = src;
   while (*p != 0) {
     switch (*p) {
       case '\\':
         if (*(p + 1) == 0) { break; }
         if (*(p + 1) == '\\') {
-          src_dup[dup_idx++] = '\\';
+          out += '\\';
           p++;
         } else if (*(p + 1) == ' ') {
-          src_dup[dup_idx++] = ' ';
+          out += ' ';
           p++;
         } else if (*(p + 1) == 'n') {
-          src_dup[dup_idx++] = '\n';
+          out += '\n';
           p++;
         } else if (templates != nullptr) {
           unsigned int tmpl_num;
           int digits;
           if ((sscanf(p + 1, "%u%n", &tmpl_num, &digits) <= 0) ||
-              (tmpl_num > template_count)) {
+              (tmpl_num > templates->size())) {
             break;
           }
           if (tmpl_num == 0) {
@@ -81,122 +147,72 @@ static char *backslash_escape(const char *src, char **templates,
                 nullptr, nullptr,
                 "invalid template argument \\0; arguments must start at \\1");
           }
-          dup_len += strlen(templates[tmpl_num - 1]);
-          src_dup =
-              static_cast<char *>(realloc(src_dup, dup_len * sizeof(char)));
-          snprintf(src_dup + dup_idx, dup_len - dup_idx, "%s",
-                   templates[tmpl_num - 1]);
-          dup_idx += strlen(templates[tmpl_num - 1]);
+          out += (*templates)[tmpl_num - 1];
           p += digits;
         }
         break;
       default:
-        src_dup[dup_idx++] = *p;
+        out += *p;
         break;
     }
     p++;
   }
-  src_dup[dup_idx++] = '\0';
-  src_dup = static_cast<char *>(realloc(src_dup, dup_idx * sizeof(char)));
-  return src_dup;
 }
 
-/* handle_template_object - core logic of the template object
- *
- * use config variables like this:
- * template1 = "$\1\2"
- * template2 = "\1: ${fs_bar 4,100 \2} ${fs_used \2} / ${fs_size \2}"
- *
- * and use them like this:
- * ${template1 node name}
- * ${template2 root /}
- * ${template2 cdrom /mnt/cdrom}
- */
-static char *handle_template(const char *tmpl, const char *args) {
-  char *args_dup = nullptr;
-  char *p, *p_old;
-  char **argsp = nullptr;
-  unsigned int argcnt = 0, template_idx, i;
-  char *eval_text;
-
-  if ((sscanf(tmpl, "template%u", &template_idx) != 1) ||
-      (template_idx >= MAX_TEMPLATES)) {
-    return nullptr;
-  }
-
-  if (args != nullptr) {
-    args_dup = strdup(args);
-    p = args_dup;
-    while (*p != 0) {
-      while ((*p != 0) && (*p == ' ' && (p == args_dup || *(p - 1) != '\\'))) {
-        p++;
-      }
-      if (p > args_dup && *(p - 1) == '\\') { p--; }
-      p_old = p;
-      while ((*p != 0) && (*p != ' ' || (p > args_dup && *(p - 1) == '\\'))) {
-        p++;
-      }
-      if (*p != 0) {
-        (*p) = '\0';
-        p++;
-      }
-      argsp = static_cast<char **>(realloc(argsp, ++argcnt * sizeof(char *)));
-      argsp[argcnt - 1] = p_old;
-    }
-    for (i = 0; i < argcnt; i++) {
-      char *tmp;
-      tmp = backslash_escape(argsp[i], nullptr, 0);
-      DBGP2("%s: substituted arg '%s' to '%s'", tmpl, argsp[i], tmp);
-      argsp[i] = tmp;
-    }
+bool find_template(const std::string &name, std::string &body) {
+  unsigned int index;
+  if (sscanf(name.c_str(), "template%u", &index) == 1 &&
+      index < MAX_TEMPLATES) {
+    body = _template[index].get(*state);
+    return true;
   }
-
-  eval_text = backslash_escape(_template[template_idx].get(*state).c_str(),
-                               argsp, argcnt);
-  DBGP("substituted %s, output is '%s'", tmpl, eval_text);
-  free(args_dup);
-  for (i = 0; i < argcnt; i++) { free(argsp[i]); }
-  free(argsp);
-  return eval_text;
+  auto it = named_templates.templates.find(name);
+  if (it == named_templates.templates.end()) { return false; }
+  body = it->second;
+  return true;
 }
+}  // namespace
 
-/* Search inbuf and replace all found template object references
- * with the substituted value. */
-char *find_and_replace_templates(const char *inbuf) {
-  char *outbuf, *indup, *p, *o, *templ, *args, *tmpl_out;
-  int stack, outlen;
+namespace conky {
 
-  outlen = strlen(inbuf) + 1;
-  o = outbuf = static_cast<char *>(calloc(outlen, sizeof(char)));
-  memset(outbuf, 0, outlen * sizeof(char));
+std::string template_expander::expand(const char *text) {
+  too_deep = false;
+  std::string out;
+  out.reserve(strlen(text));
+  expand_into(out, text, 0);
+  return out;
+}
 
-  p = indup = strdup(inbuf);
+/* copies text to out, expanding every template reference on the way */
+void template_expander::expand_into(std::string &out, const char *p,
+                                    int depth) {
   while (*p != 0) {
-    while ((*p != 0) && *p != '$') { *(o++) = *(p++); }
+    const char *plain = p;
+    while ((*p != 0) && *p != '$') { p++; }
+    out.append(plain, p - plain);
 
     if ((*p) == 0) { break; }
 
-    if ((static_cast<int>(strncmp(p, "$template", strlen("$template")) != 0) !=
-         0) &&
-        (strncmp(p, "${template", strlen("${template")) != 0)) {
-      *(o++) = *(p++);
+    if (strncmp(p, "$template", strlen("$template")) != 0 &&
+        strncmp(p, "${template", strlen("${template")) != 0) {
+      out += *(p++);
       continue;
     }
 
+    std::string name;
+    std::string args;
+    bool has_args = false;
     if (*(p + 1) == '{') {
       p += 2;
-      templ = p;
+      const char *templ = p;
       while ((*p != 0) && (isspace(static_cast<unsigned char>(*p)) == 0) &&
              *p != '{' && *p != '}') {
         p++;
       }
-      if (*p == '}') {
-        args = nullptr;
-      } else {
-        args = p;
-      }
+      name.assign(templ, p - templ);
+      const char *args_begin = *p == '}' ? nullptr : p;
 
-      stack = 1;
+      int stack = 1;
       while ((*p != 0) && stack > 0) {
         if (*p == '{') {
           stack++;
@@ -205,40 +221,116 @@ char *find_and_replace_templates(const char *inbuf) {
         }
         p++;
       }
-      if (stack == 0) {
-        // stack is empty. that means the previous char was }, so we zero it
-        *(p - 1) = '\0';
-      } else {
+      if (stack != 0) {
         // we ran into the end of string without finding a closing }, bark
         CRIT_ERR(nullptr, nullptr,
                  "cannot find a closing '}' in template expansion");
       }
+      if (args_begin != nullptr) {
+        /* up to the closing }, which p is right after */
+        args.assign(args_begin, p - 1 - args_begin);
+        has_args = true;
+      }
     } else {
-      templ = p + 1;
+      const char *templ = p + 1;
       p += strlen("$template");
       while ((*p != 0) && (isdigit(static_cast<unsigned char>(*p)) != 0)) {
         p++;
       }
-      args = nullptr;
+      name.assign(templ, p - templ);
     }
-    tmpl_out = handle_template(templ, args);
-    if (tmpl_out != nullptr) {
-      int len = strlen(tmpl_out);
-      outlen += len;
-      *o = '\0';
-      outbuf = static_cast<char *>(realloc(outbuf, outlen * sizeof(char)));
-      strncat(outbuf, tmpl_out, len);
-      free(tmpl_out);
-      o = outbuf + strlen(outbuf);
-    } else {
-      NORM_ERR("failed to handle template '%s' with args '%s'", templ, args);
+    expand_reference(out, name, has_args ? &args : nullptr, depth);
+  }
+}
+
+/* handle_template_object - core logic of the template object
+ *
+ * use config variables like this:
+ * template1 = "$\1\2"
+ * template2 = "\1: ${fs_bar 4,100 \2} ${fs_used \2} / ${fs_size \2}"
+ * templates = { fs = "\1: ${fs_used \2} / ${fs_size \2}" }
+ *
+ * and use them like this:
+ * ${template1 node name}
+ * ${template2 root /}
+ * ${template2 cdrom /mnt/cdrom}
+ * ${template fs root /}
+ */
+void template_expander::expand_reference(std::string &out,
+                                         const std::string &name,
+                                         const std::string *args, int depth) {
+  std::string key = name;
+  key += '\0';
+  if (args != nullptr) { key += *args; }
+  auto it = memo.find(key);
+  if (it != memo.end()) {
+    out += it->second;
+    return;
+  }
+
+  const char *args_text = args != nullptr ? args->c_str() : "";
+  if (depth >= MAX_DEPTH) {
+    NORM_ERR("templates nested too deep at '%s' with args '%s'", name.c_str(),
+             args_text);
+    too_deep = true;
+    return;
+  }
+
+  std::vector<std::string> argv;
+  if (args != nullptr) {
+    for (const std::string &arg : split_args(*args)) {
+      argv.emplace_back();
+      backslash_escape(argv.back(), arg.c_str(), nullptr);
     }
   }
-  *o = '\0';
-  outbuf =
-      static_cast<char *>(realloc(outbuf, (strlen(outbuf) + 1) * sizeof(char)));
-  free(indup);
-  return outbuf;
+  std::string lookup_name = name;
+  if (name == "template") {
+    /* ${template NAME args}, a named one */
+    if (argv.empty()) {
+      NORM_ERR("${template} needs the name of a template");
+      return;
+    }
+    lookup_name = argv.front();
+    argv.erase(argv.begin());
+  }
+
+  std::string body;
+  if (!lookup(lookup_name, body)) {
+    NORM_ERR("failed to handle template '%s' with args '%s'", name.c_str(),
+             args_text);
+    return;
+  }
+
+  std::string substituted;
+  backslash_escape(substituted, body.c_str(),
+                   args != nullptr ? &argv : nullptr);
+  /* what got cut short at the depth limit depends on the depth */
+  bool outer_too_deep = too_deep;
+  too_deep = false;
+  std::string expansion;
+  expand_into(expansion, substituted.c_str(), depth + 1);
+  DBGP("substituted %s, output is '%s'", name.c_str(), expansion.c_str());
+
+  out += expansion;
+  if (!too_deep) { memo.emplace(std::move(key), std::move(expansion)); }
+  too_deep = too_deep || outer_too_deep;
+}
+
+}  // namespace conky
+
+/* Search inbuf and replace all found template object references
+ * with the substituted value. */
+char *find_and_replace_templates(const char *inbuf) {
+  static conky::template_expander expander(&find_template);
+  /* what is remembered holds while no setting changed */
+  static uint64_t version = 0;
+
+  uint64_t now = conky::priv::settings_version.load(std::memory_order_relaxed);
+  if (now != version) {
+    expander.forget();
+    version = now;
+  }
+  return strdup(expander.expand(inbuf).c_str());
 }
 
 /* check text for any template object references */
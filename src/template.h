@@ -30,6 +30,44 @@
 #ifndef _TEMPLATE_H
 #define _TEMPLATE_H
 
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+namespace conky {
+/*
+ * Expands the ${templateN ...}, $templateN and ${template NAME ...}
+ * references of a text in one pass into one output string. What a template
+ * expands to is expanded in turn right away, nested up to MAX_DEPTH deep.
+ * The same template with the same arguments tends to be used many times by
+ * generated configs, so expansions are remembered until forget().
+ */
+class template_expander {
+ public:
+  /* sets body to the template given by name, which is either a templateN
+   * reference as it was written or the NAME of a named one; returns false if
+   * there is no such template */
+  typedef std::function<bool(const std::string &name, std::string &body)>
+      lookup_fn;
+
+  enum { MAX_DEPTH = 32 };
+
+  explicit template_expander(lookup_fn lookup_) : lookup(std::move(lookup_)) {}
+
+  std::string expand(const char *text);
+  void forget() { memo.clear(); }
+
+ private:
+  void expand_into(std::string &out, const char *text, int depth);
+  void expand_reference(std::string &out, const std::string &name,
+                        const std::string *args, int depth);
+
+  lookup_fn lookup;
+  std::unordered_map<std::string, std::string> memo;
+  bool too_deep = false;
+};
+}  // namespace conky
+
 char *find_and_replace_templates(const char *);
 int text_contains_templates(const char *);
 
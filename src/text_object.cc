@@ -28,10 +28,94 @@
 #include "text_object.h"
 #include <cstdio>
 #include <cstdlib>
+#include <algorithm>
 #include <cstring>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <unordered_map>
 #include "config.h"
 #include "conky.h"
 #include "logging.h"
+#include "memory-usage.hh"
+#include "shared-info.hh"
+
+const std::atomic<uint64_t> constant_generation(0);
+
+namespace conky {
+
+text_arena *text_arena::current = nullptr;
+
+/* a text of a few dozen objects fits into one */
+static const size_t TEXT_ARENA_BLOCK = 16 * 1024;
+
+text_arena::~text_arena() {
+  for (char *block : blocks) { free(block); }
+}
+
+void *text_arena::allocate(size_t size) {
+  const size_t align = alignof(std::max_align_t);
+  size = (size + align - 1) & ~(align - 1);
+  if (size > left) {
+    size_t block_size = std::max(size, TEXT_ARENA_BLOCK);
+    next = static_cast<char *>(malloc(block_size));
+    if (next == nullptr) { throw std::bad_alloc(); }
+    blocks.push_back(next);
+    left = block_size;
+    total += block_size;
+  }
+  void *p = next;
+  next += size;
+  left -= size;
+  memset(p, 0, size);
+  return p;
+}
+
+char *text_arena::copy(const char *s) {
+  size_t len = strlen(s) + 1;
+  return static_cast<char *>(memcpy(allocate(len), s, len));
+}
+
+namespace {
+/* by depth; a deque doesn't move the buffers of the outer ones */
+std::deque<std::vector<char>> scratch_buffers;
+size_t scratch_depth = 0;
+}  // namespace
+
+scratch_text::scratch_text(size_t size) : length(std::max<size_t>(size, 1)) {
+  if (scratch_depth == scratch_buffers.size()) {
+    scratch_buffers.emplace_back();
+  }
+  std::vector<char> &buffer = scratch_buffers[scratch_depth++];
+  if (buffer.size() < length) { buffer.resize(length); }
+  data = buffer.data();
+  data[0] = 0;
+}
+
+scratch_text::~scratch_text() { --scratch_depth; }
+
+}  // namespace conky
+
+namespace {
+std::mutex legacy_state_mutex[LEGACY_STATE_COUNT];
+}  // namespace
+
+void legacy_cb::work() {
+  // always lock in the same order, so that we can't deadlock
+  for (int i = 0; i < LEGACY_STATE_COUNT; ++i) {
+    if ((writes & (1u << i)) != 0u) { legacy_state_mutex[i].lock(); }
+  }
+
+  /* clients take what a collector shares, the collector shares it */
+  if (!conky::read_shared_info(writes)) {
+    std::get<0>(tuple)();
+    conky::publish_shared_info(writes);
+  }
+
+  for (int i = LEGACY_STATE_COUNT - 1; i >= 0; --i) {
+    if ((writes & (1u << i)) != 0u) { legacy_state_mutex[i].unlock(); }
+  }
+}
 
 void gen_free_opaque(struct text_object *obj) {
   free_and_zero(obj->data.opaque);
@@ -87,6 +171,127 @@ int append_object(struct text_object *root, struct text_object *obj) {
   return 0;
 }
 
+static inline bool is_print_op(const struct text_op &op) {
+  return op.type == TEXT_OP_PRINT || op.type == TEXT_OP_PRINT_LEN;
+}
+
+/* pick the op for obj, using the same precedence generate_text_internal()
+ * always had; returns false for objects that never print anything */
+static bool make_text_op(struct text_object *obj, struct text_op *op) {
+  op->obj = obj;
+  op->segment = nullptr;
+  op->jump = 0;
+  if (obj->callbacks.print != nullptr) {
+    if (obj->callbacks.print == &gen_print_nothing) { return false; }
+    op->type = TEXT_OP_PRINT;
+    op->cb.print = obj->callbacks.print;
+  } else if (obj->callbacks.print_len != nullptr) {
+    op->type = TEXT_OP_PRINT_LEN;
+    op->cb.print_len = obj->callbacks.print_len;
+  } else if (obj->callbacks.iftest != nullptr) {
+    op->type = TEXT_OP_IFTEST;
+    op->cb.iftest = obj->callbacks.iftest;
+  } else if (obj->callbacks.barval != nullptr) {
+    op->type = TEXT_OP_BAR;
+    op->cb.meter = obj->callbacks.barval;
+  } else if (obj->callbacks.gaugeval != nullptr) {
+    op->type = TEXT_OP_GAUGE;
+    op->cb.meter = obj->callbacks.gaugeval;
+#ifdef BUILD_GUI
+  } else if (obj->callbacks.graphval != nullptr) {
+    op->type = TEXT_OP_GRAPH;
+    op->cb.meter = obj->callbacks.graphval;
+#endif /* BUILD_GUI */
+  } else if (obj->callbacks.percentage != nullptr) {
+    op->type = TEXT_OP_PERCENTAGE;
+    op->cb.percentage = obj->callbacks.percentage;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void free_text_ops(struct text_object *root) {
+  for (uint32_t i = 0; i < root->segment_count; ++i) {
+    free(root->segments[i].text);
+  }
+  free_and_zero(root->segments);
+  root->segment_count = 0;
+  free_and_zero(root->ops);
+  root->op_count = 0;
+}
+
+size_t text_objects_memory(const struct text_object *root, size_t *count) {
+  using conky::memory::allocated;
+
+  size_t size = root->op_count * sizeof(struct text_op) +
+                root->segment_count * sizeof(struct text_segment);
+  /* the objects themselves and the plain text */
+  if (root->arena != nullptr) { size += root->arena->capacity(); }
+  for (uint32_t i = 0; i < root->segment_count; ++i) {
+    size += root->segments[i].size;
+  }
+  for (const struct text_object *obj = root->next; obj != nullptr;
+       obj = obj->next) {
+    ++*count;
+    size += allocated(obj->special_data);
+    /* other free callbacks may not have a pointer in data */
+    if (obj->callbacks.free == &gen_free_opaque) {
+      size += allocated(obj->data.opaque);
+    }
+    if (obj->sub != nullptr) {
+      size += sizeof(struct text_object) + text_objects_memory(obj->sub, count);
+    }
+  }
+  return size;
+}
+
+void compile_text_objects(struct text_object *root) {
+  /* ops[resume[obj]] is the first op after obj */
+  std::unordered_map<const struct text_object *, uint32_t> resume;
+  struct text_op op;
+  uint32_t count = 0;
+  uint32_t segments = 0;
+
+  for (struct text_object *obj = root->next; obj != nullptr; obj = obj->next) {
+    if (make_text_op(obj, &op)) {
+      ++count;
+      if (is_print_op(op) && obj->generation != nullptr) {
+        ++segments;
+      }
+    }
+    resume[obj] = count;
+  }
+
+  free_text_ops(root);
+  if (count == 0) { return; }
+
+  root->op_count = count;
+  root->ops = static_cast<struct text_op *>(malloc(count * sizeof(text_op)));
+  if (segments > 0) {
+    root->segment_count = segments;
+    root->segments = static_cast<struct text_segment *>(
+        calloc(segments, sizeof(struct text_segment)));
+  }
+
+  uint32_t i = 0;
+  uint32_t j = 0;
+  for (struct text_object *obj = root->next; obj != nullptr; obj = obj->next) {
+    if (!make_text_op(obj, &root->ops[i])) { continue; }
+    /* a failed iftest continues after its else or endif, like the list walk
+     * used to */
+    root->ops[i].jump = i + 1;
+    if (root->ops[i].type == TEXT_OP_IFTEST && obj->ifblock_next != nullptr) {
+      auto target = resume.find(obj->ifblock_next);
+      if (target != resume.end()) { root->ops[i].jump = target->second; }
+    }
+    if (is_print_op(root->ops[i]) && obj->generation != nullptr) {
+      root->ops[i].segment = &root->segments[j++];
+    }
+    ++i;
+  }
+}
+
 /* ifblock handlers for the object list
  *
  * - each if points to it's else or endif
@@ -181,9 +386,14 @@ int ifblock_stack_empty(void **opaque) {
 }
 
 void obj_be_plain_text(struct text_object *obj, const char *text) {
-  obj->data.s = strdup(text);
-
   memset(&obj->callbacks, 0, sizeof(obj->callbacks));
+  if (conky::text_arena::current != nullptr) {
+    /* goes with the arena */
+    obj->data.s = conky::text_arena::current->copy(text);
+  } else {
+    obj->data.s = strdup(text);
+    obj->callbacks.free = &gen_free_opaque;
+  }
   obj->callbacks.print = &gen_print_obj_data_s;
-  obj->callbacks.free = &gen_free_opaque;
+  obj->generation = &constant_generation;
 }
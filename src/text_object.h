@@ -30,6 +30,9 @@
 #define _TEXT_OBJECT_H
 
 #include <stdint.h> /* uint8_t */
+#include <atomic>
+#include <cstddef>
+#include <vector>
 #include "config.h" /* for the defines */
 #include "exec.h"
 #include "specials.h" /* enum special_types */
@@ -39,6 +42,11 @@ struct obj_cb {
   /* text object: print obj's output to p */
   void (*print)(struct text_object *obj, char *p, unsigned int p_max_size);
 
+  /* text object: like print, but returns the length of the output the way
+   * snprintf() does, so that generate_text_internal() doesn't have to measure
+   * it. Used if print isn't set. */
+  int (*print_len)(struct text_object *obj, char *p, unsigned int p_max_size);
+
   /* ifblock object: return zero to trigger jumping */
   int (*iftest)(struct text_object *obj);
 
@@ -75,20 +83,137 @@ void gen_print_nothing(struct text_object *, char *, unsigned int);
  * used by the $text object */
 void gen_print_obj_data_s(struct text_object *, char *, unsigned int);
 
+/* Shared state written by the legacy update functions. Functions writing the
+ * same state never run at the same time, the rest run concurrently. */
+enum legacy_state {
+  LEGACY_CPU = 1 << 0,       /* info.cpu_usage, info.run_threads */
+  LEGACY_PROCESSES = 1 << 1, /* info.procs, info.run_procs, info.threads */
+  LEGACY_TOP = 1 << 2,       /* process list, info.cpu, info.memu, ... */
+  LEGACY_MEMORY = 1 << 3,    /* info.mem*, info.swap*, info.buffers, ... */
+  LEGACY_NET = 1 << 4,       /* netstats */
+  LEGACY_DISKIO = 1 << 5,    /* diskio stats */
+  LEGACY_LOADAVG = 1 << 6,   /* info.loadavg */
+  LEGACY_UPTIME = 1 << 7,    /* info.uptime */
+  LEGACY_USERS = 1 << 8,     /* info.users */
+  LEGACY_STATE_COUNT = 9
+};
+
 class legacy_cb : public conky::callback<void *, int (*)()> {
   typedef conky::callback<void *, int (*)()> Base;
 
+  const uint32_t writes; /* legacy_state flags */
+  const char *name;
+
  protected:
-  virtual void work() { std::get<0>(tuple)(); }
+  virtual void work();
+  virtual std::string profile_name() { return name; }
 
  public:
-  legacy_cb(uint32_t period, int (*fn)())
-      : Base(period, true, Base::Tuple(fn)) {}
+  legacy_cb(double period, int (*fn)(), uint32_t writes_, const char *name_,
+            bool on_demand, const char *power_source)
+      : Base(period, true, Base::Tuple(fn)), writes(writes_), name(name_) {
+    set_on_demand(on_demand);
+    set_power_source(power_source);
+  }
 };
 
 typedef conky::callback_handle<legacy_cb> legacy_cb_handle;
 typedef conky::callback_handle<exec_cb> exec_cb_handle;
 
+struct text_object;
+
+namespace conky {
+/*
+ * Storage for the objects of a parsed text. Memory is handed out in order
+ * from large blocks and only given back, all of it at once, when the arena is
+ * destroyed along with the text. The texts parsed for the objects of a text
+ * share its arena.
+ */
+class text_arena {
+  std::vector<char *> blocks;
+  char *next = nullptr;
+  size_t left = 0; /* bytes free at next */
+  size_t total = 0;
+
+ public:
+  /* the arena of the text being parsed, if any */
+  static text_arena *current;
+
+  text_arena() = default;
+  text_arena(const text_arena &) = delete;
+  text_arena &operator=(const text_arena &) = delete;
+  ~text_arena();
+
+  /* zeroed memory, aligned for any type */
+  void *allocate(size_t size);
+  char *copy(const char *s);
+  size_t capacity() const { return total; }
+};
+
+/*
+ * Scratch space for the text of a nested object which has to be worked on
+ * before any of it goes into the output, like the pid of ${pid_cmdline}.
+ * Objects which print their nested text as it is generate it right into
+ * their output instead. The buffers are kept from one frame to the next, one
+ * per nesting depth, so only a frame nesting deeper than any before
+ * allocates. For the main thread, which generates the text.
+ */
+class scratch_text {
+  char *data;
+  size_t length;
+
+ public:
+  explicit scratch_text(size_t size);
+  scratch_text(const scratch_text &) = delete;
+  scratch_text &operator=(const scratch_text &) = delete;
+  ~scratch_text();
+
+  char *get() const { return data; }
+  size_t size() const { return length; }
+};
+}  // namespace conky
+
+/* kinds of text_op, see compile_text_objects() */
+enum text_op_type : uint8_t {
+  TEXT_OP_PRINT,
+  TEXT_OP_PRINT_LEN,
+  TEXT_OP_IFTEST,
+  TEXT_OP_BAR,
+  TEXT_OP_GAUGE,
+  TEXT_OP_GRAPH,
+  TEXT_OP_PERCENTAGE
+};
+
+/* The last output of a print op whose object has a generation counter. It is
+ * reused while the counter keeps the value it had when the text was made. */
+struct text_segment {
+  uint64_t generation;
+  char *text;
+  uint32_t len;
+  uint32_t size; /* allocated size of text */
+  bool valid;
+};
+
+/* One step of a compiled object list. The callback is picked from the
+ * object's obj_cb when the list is compiled, and ifblocks are resolved to the
+ * index of the op to continue at when the test returns zero. */
+struct text_op {
+  struct text_object *obj;
+  union {
+    void (*print)(struct text_object *obj, char *p, unsigned int p_max_size);
+    int (*print_len)(struct text_object *obj, char *p, unsigned int p_max_size);
+    int (*iftest)(struct text_object *obj);
+    double (*meter)(struct text_object *obj);
+    uint8_t (*percentage)(struct text_object *obj);
+  } cb;
+  struct text_segment *segment; /* only for print ops with a generation */
+  uint32_t jump;
+  enum text_op_type type;
+};
+
+/* generation counter for objects whose output never changes */
+extern const std::atomic<uint64_t> constant_generation;
+
 /**
  * This is where Conky collects information on the conky.text objects in your
  * config
@@ -124,11 +249,38 @@ struct text_object {
    * pointers so we can instantiate them later. */
   exec_cb_handle *exec_handle;
   legacy_cb_handle *cb_handle;
+
+  /* If set, the print callback's output only depends on this counter (e.g.
+   * the generation of the callback it prints), so generate_text_internal()
+   * may reuse what it printed last time while the counter is unchanged. */
+  const std::atomic<uint64_t> *generation;
+
+  /* only set on list roots: the list compiled by compile_text_objects() */
+  struct text_op *ops;
+  uint32_t op_count;
+  struct text_segment *segments;
+  uint32_t segment_count;
+  /* and the arena holding the objects, unless they are in that of an
+   * enclosing text */
+  conky::text_arena *arena;
 };
 
 /* text object list helpers */
 int append_object(struct text_object *root, struct text_object *obj);
 
+/* (re)build root->ops from the list root points to. Objects without a
+ * callback produce no op. extract_variable_text_internal() calls this once the
+ * list is complete; free_text_objects() releases the ops. */
+void compile_text_objects(struct text_object *root);
+
+/* release root->ops and root->segments */
+void free_text_ops(struct text_object *root);
+
+/* the memory held by the objects of the list root points to, including their
+ * sub lists and the data freed with gen_free_opaque(), for ${conky_mem};
+ * count is increased by the number of objects */
+size_t text_objects_memory(const struct text_object *root, size_t *count);
+
 /* ifblock helpers
  *
  * Opaque is a pointer to the address of the ifblock stack's top object.
@@ -0,0 +1,199 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "config.h"
+
+#include "thread-qos.hh"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif /* __linux__ */
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include "conky.h"
+#include "logging.h"
+#include "setting.hh"
+
+template <>
+conky::lua_traits<conky::thread_qos::policy_type>::Map
+    conky::lua_traits<conky::thread_qos::policy_type>::map = {
+        {"normal", conky::thread_qos::NORMAL},
+        {"batch", conky::thread_qos::BATCH},
+        {"idle", conky::thread_qos::IDLE}};
+
+namespace conky {
+namespace {
+enum { MAX_CPU = 4095 };
+
+simple_config_setting<thread_qos::policy_type> collector_sched(
+    "collector_sched", thread_qos::NORMAL, false);
+range_config_setting<int> collector_nice("collector_nice", 0, 19, 0, false);
+simple_config_setting<std::string> collector_cpus("collector_cpus",
+                                                  std::string(), false);
+simple_config_setting<std::string> render_cpus("render_cpus", std::string(),
+                                               false);
+
+std::atomic<bool> policy_warned{false}, nice_warned{false},
+    cpus_warned{false};
+
+/* complains about the first failure of each kind only, as every thread of
+ * the pool would report the same */
+void warn_once(std::atomic<bool> &warned, const char *what) {
+  if (!warned.exchange(true)) {
+    NORM_ERR("unable to set the %s of a thread: %s", what, strerror(errno));
+  }
+}
+
+/* the last list a CPU setting had and what it was parsed into, so that it
+ * isn't parsed (and complained about) at every update */
+struct cpus_cache {
+  std::string list;
+  std::vector<int> cpus;
+};
+
+const std::vector<int> &parse_cpus_setting(cpus_cache &cache,
+                                           const char *name,
+                                           const std::string &list) {
+  if (list != cache.list) {
+    cache.list = list;
+    if (!parse_cpu_list(list, cache.cpus)) {
+      NORM_ERR("invalid CPU list '%s' for %s, ignoring it", list.c_str(),
+               name);
+      cache.cpus.clear();
+    }
+  }
+  return cache.cpus;
+}
+
+/* the efficient cores of a hybrid CPU, empty on others; the kernel lists
+ * them for the cpu_atom PMU */
+const std::vector<int> &efficient_cpus() {
+  static std::vector<int> cpus;
+  static bool read = false;
+  if (!read) {
+    read = true;
+    std::ifstream f("/sys/devices/cpu_atom/cpus");
+    std::string list;
+    if (std::getline(f, list) && !parse_cpu_list(list, cpus)) {
+      cpus.clear();
+    }
+  }
+  return cpus;
+}
+}  // namespace
+
+bool parse_cpu_list(const std::string &list, std::vector<int> &cpus) {
+  cpus.clear();
+  const char *p = list.c_str();
+  while (*p == ' ') { ++p; }
+  if (*p == 0) { return true; }
+  for (;;) {
+    char *end;
+    long first = strtol(p, &end, 10);
+    if (end == p || first < 0) { return false; }
+    long last = first;
+    p = end;
+    if (*p == '-') {
+      ++p;
+      last = strtol(p, &end, 10);
+      if (end == p || last < first) { return false; }
+      p = end;
+    }
+    if (last > MAX_CPU) { return false; }
+    for (long cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(static_cast<int>(cpu));
+    }
+    while (*p == ' ' || *p == '\n') { ++p; }
+    if (*p == 0) { return true; }
+    if (*p++ != ',') { return false; }
+  }
+}
+
+void thread_qos::apply() const {
+#ifdef SCHED_IDLE
+  if (policy != NORMAL) {
+    sched_param param{};
+    int err = pthread_setschedparam(
+        pthread_self(), policy == IDLE ? SCHED_IDLE : SCHED_BATCH, &param);
+    if (err != 0) {
+      errno = err;
+      warn_once(policy_warned, "scheduling policy");
+    }
+  }
+#endif /* SCHED_IDLE */
+#ifdef __linux__
+  /* the nice value is per thread on Linux */
+  if (nice > 0) {
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    errno = 0;
+    int current = getpriority(PRIO_PROCESS, tid);
+    if ((current == -1 && errno != 0) ||
+        setpriority(PRIO_PROCESS, tid, current + nice) != 0) {
+      warn_once(nice_warned, "nice value");
+    }
+  }
+  if (!cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+      if (cpu < CPU_SETSIZE) { CPU_SET(cpu, &set); }
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      warn_once(cpus_warned, "CPU affinity");
+    }
+  }
+#endif /* __linux__ */
+}
+
+thread_qos collector_thread_qos() {
+  thread_qos qos;
+  qos.policy = collector_sched.get(*state);
+  qos.nice = collector_nice.get(*state);
+  static cpus_cache cache;
+  std::string list = collector_cpus.get(*state);
+  qos.cpus = list.empty() ? efficient_cpus()
+                          : parse_cpus_setting(cache, "collector_cpus", list);
+  return qos;
+}
+
+thread_qos render_thread_qos() {
+  thread_qos qos;
+  static cpus_cache cache;
+  qos.cpus = parse_cpus_setting(cache, "render_cpus", render_cpus.get(*state));
+  return qos;
+}
+}  // namespace conky
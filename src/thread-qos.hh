@@ -0,0 +1,72 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef THREAD_QOS_HH
+#define THREAD_QOS_HH
+
+#include <string>
+#include <vector>
+
+namespace conky {
+/*
+ * How a thread is scheduled, so that conky can be kept out of the way of
+ * what else runs on the machine. The collector settings are used for the
+ * threads of the callback pool, of callbacks with a thread of their own and
+ * of the http output, render_cpus for the main thread.
+ */
+struct thread_qos {
+  enum policy_type { NORMAL, BATCH, IDLE };
+
+  policy_type policy = NORMAL;
+  int nice = 0;          /* added to the nice value the thread inherited */
+  std::vector<int> cpus; /* empty keeps the CPUs the thread inherited */
+
+  bool operator==(const thread_qos &other) const {
+    return policy == other.policy && nice == other.nice && cpus == other.cpus;
+  }
+  bool operator!=(const thread_qos &other) const { return !(*this == other); }
+
+  /* Applies it to the calling thread. What the system doesn't allow is
+   * reported once and otherwise left as it is. */
+  void apply() const;
+};
+
+/* what collector_sched, collector_nice and collector_cpus ask for, the
+ * efficient cores of a hybrid CPU if collector_cpus is empty; main thread
+ * only */
+thread_qos collector_thread_qos();
+
+/* what render_cpus asks for; main thread only */
+thread_qos render_thread_qos();
+
+/* Parses a list of CPUs like "0-3,8" the way the kernel prints them into
+ * cpus. Returns false if the list is malformed. */
+bool parse_cpu_list(const std::string &list, std::vector<int> &cpus);
+}  // namespace conky
+
+#endif /* THREAD_QOS_HH */
@@ -0,0 +1,391 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "time-zone.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "logging.h"
+
+namespace conky {
+
+namespace {
+
+uint32_t be32(const unsigned char *p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+         (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+int64_t be64(const unsigned char *p) {
+  return static_cast<int64_t>((uint64_t(be32(p)) << 32) | be32(p + 4));
+}
+
+bool is_leap(int64_t year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/* days from 1970-01-01 to the given date of the proleptic Gregorian
+ * calendar, month and day counting from 1 */
+int64_t days_from_civil(int64_t y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+int64_t year_of(int64_t t) {
+  int64_t days = t / 86400 - (t % 86400 < 0);
+  int64_t y = 1970 + days / 366;
+
+  while (days_from_civil(y + 1, 1, 1) <= days) { y++; }
+  while (days_from_civil(y, 1, 1) > days) { y--; }
+  return y;
+}
+
+/* the local time given by d in the year, in seconds since the epoch */
+int64_t rule_time(const time_zone::rule_date &d, int64_t year) {
+  int64_t days = days_from_civil(year, 1, 1);
+
+  if (d.kind == 'J') {
+    days += d.day - 1 + (is_leap(year) && d.day >= 60);
+  } else if (d.kind == 'D') {
+    days += d.day;
+  } else {
+    static const int month_days[] = {31, 28, 31, 30, 31, 30,
+                                     31, 31, 30, 31, 30, 31};
+    int length = month_days[d.month - 1] + (d.month == 2 && is_leap(year));
+    int64_t first = days_from_civil(year, d.month, 1);
+    int64_t weekday = ((first + 4) % 7 + 7) % 7;
+    int64_t day = (d.day - weekday + 7) % 7 + (d.week - 1) * 7;
+
+    if (day >= length) { day -= 7; }
+    days = first + day;
+  }
+  return days * 86400 + d.time;
+}
+
+/* reads a decimal number of at most max_digits digits into out */
+const char *parse_number(const char *s, int max_digits, int min, int max,
+                         int &out) {
+  int digits = 0;
+
+  out = 0;
+  while (isdigit(static_cast<unsigned char>(*s)) && digits < max_digits) {
+    out = out * 10 + (*s++ - '0');
+    digits++;
+  }
+  if (digits == 0 || out < min || out > max) { return nullptr; }
+  return s;
+}
+
+/* [+-]hh[:mm[:ss]], with hours up to 167 as RFC 8536 allows */
+const char *parse_time(const char *s, int32_t &out) {
+  int sign = 1;
+  int h;
+  int m = 0;
+  int sec = 0;
+
+  if (*s == '+' || *s == '-') { sign = *s++ == '-' ? -1 : 1; }
+  if ((s = parse_number(s, 3, 0, 167, h)) == nullptr) { return nullptr; }
+  if (*s == ':') {
+    if ((s = parse_number(s + 1, 2, 0, 59, m)) == nullptr) { return nullptr; }
+    if (*s == ':') {
+      if ((s = parse_number(s + 1, 2, 0, 59, sec)) == nullptr) {
+        return nullptr;
+      }
+    }
+  }
+  out = sign * (h * 3600 + m * 60 + sec);
+  return s;
+}
+
+/* three or more letters, or anything but '>' between '<' and '>' */
+const char *parse_abbr(const char *s, std::string &out) {
+  const char *e;
+
+  if (*s == '<') {
+    if ((e = strchr(s + 1, '>')) == nullptr || e - s < 4) { return nullptr; }
+    out.assign(s + 1, e);
+    return e + 1;
+  }
+  for (e = s; isalpha(static_cast<unsigned char>(*e)) != 0; e++) {}
+  if (e - s < 3) { return nullptr; }
+  out.assign(s, e);
+  return e;
+}
+
+const char *parse_date(const char *s, time_zone::rule_date &d) {
+  d = time_zone::rule_date();
+  if (*s == 'J') {
+    d.kind = 'J';
+    s = parse_number(s + 1, 3, 1, 365, d.day);
+  } else if (*s == 'M') {
+    d.kind = 'M';
+    if ((s = parse_number(s + 1, 2, 1, 12, d.month)) == nullptr ||
+        *s != '.' ||
+        (s = parse_number(s + 1, 1, 1, 5, d.week)) == nullptr ||
+        *s != '.') {
+      return nullptr;
+    }
+    s = parse_number(s + 1, 1, 0, 6, d.day);
+  } else {
+    d.kind = 'D';
+    s = parse_number(s, 3, 0, 365, d.day);
+  }
+  if (s != nullptr && *s == '/') { s = parse_time(s + 1, d.time); }
+  return s;
+}
+
+}  // namespace
+
+bool time_zone::parse_rule(const char *s, rule &r) {
+  int32_t offset;
+
+  r = rule();
+  if ((s = parse_abbr(s, r.std_abbr)) == nullptr ||
+      (s = parse_time(s, offset)) == nullptr) {
+    return false;
+  }
+  /* POSIX counts the offsets west of UTC */
+  r.std_offset = -offset;
+  if (*s == '\0') { return true; }
+
+  if ((s = parse_abbr(s, r.dst_abbr)) == nullptr) { return false; }
+  r.has_dst = true;
+  r.dst_offset = r.std_offset + 3600;
+  if (*s != ',' && *s != '\0') {
+    if ((s = parse_time(s, offset)) == nullptr) { return false; }
+    r.dst_offset = -offset;
+  }
+  if (*s == '\0') {
+    /* no rule given, use the one of the United States like glibc does */
+    parse_date("M3.2.0", r.start);
+    parse_date("M11.1.0", r.end);
+    return true;
+  }
+  if (*s != ',' || (s = parse_date(s + 1, r.start)) == nullptr ||
+      *s != ',' || (s = parse_date(s + 1, r.end)) == nullptr) {
+    return false;
+  }
+  return *s == '\0';
+}
+
+bool time_zone::load(const std::string &path) {
+  FILE *f = fopen(path.c_str(), "re");
+  if (f == nullptr) { return false; }
+
+  std::string data;
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) { data.append(buf, n); }
+  fclose(f);
+
+  auto *p = reinterpret_cast<const unsigned char *>(data.data());
+  const unsigned char *end = p + data.size();
+  /* isutcnt, isstdcnt, leapcnt, timecnt, typecnt and charcnt */
+  uint32_t counts[6];
+  auto read_header = [&]() {
+    if (end - p < 44 || memcmp(p, "TZif", 4) != 0) { return false; }
+    for (int i = 0; i < 6; i++) { counts[i] = be32(p + 20 + 4 * i); }
+    p += 44;
+    return true;
+  };
+  auto data_size = [&](size_t time_size) {
+    return counts[3] * time_size + counts[3] + counts[4] * 6 + counts[5] +
+           counts[2] * (time_size + 4) + counts[1] + counts[0];
+  };
+
+  if (!read_header()) { return false; }
+  size_t time_size = 4;
+  if (data[4] >= '2') {
+    /* skip the 32-bit data for the 64-bit one */
+    if (static_cast<size_t>(end - p) < data_size(4)) { return false; }
+    p += data_size(4);
+    if (!read_header()) { return false; }
+    time_size = 8;
+  }
+  if (static_cast<size_t>(end - p) < data_size(time_size) || counts[4] == 0) {
+    return false;
+  }
+
+  uint32_t timecnt = counts[3];
+  uint32_t typecnt = counts[4];
+  uint32_t charcnt = counts[5];
+  transitions.resize(timecnt);
+  for (uint32_t i = 0; i < timecnt; i++, p += time_size) {
+    transitions[i] = time_size == 8 ? be64(p) : int32_t(be32(p));
+  }
+  transition_types.assign(p, p + timecnt);
+  p += timecnt;
+  types.resize(typecnt);
+  for (uint32_t i = 0; i < typecnt; i++, p += 6) {
+    types[i] = {static_cast<int32_t>(be32(p)), p[4] != 0, p[5]};
+    if (p[5] >= charcnt) { types[i].abbr = 0; }
+  }
+  abbrs.assign(reinterpret_cast<const char *>(p), charcnt);
+  /* make sure that every abbreviation ends */
+  abbrs.push_back('\0');
+  p += data_size(time_size) - timecnt * (time_size + 1) - typecnt * 6;
+  for (auto &t : transition_types) {
+    if (t >= typecnt) { t = 0; }
+  }
+
+  /* the footer holds the rule for the times after the last transition */
+  if (time_size == 8 && p < end && *p == '\n') {
+    auto *footer = reinterpret_cast<const char *>(p + 1);
+    auto *footer_end = static_cast<const char *>(
+        memchr(footer, '\n', end - (p + 1)));
+    if (footer_end != nullptr && footer_end > footer) {
+      has_rule = parse_rule(std::string(footer, footer_end).c_str(), tz_rule);
+    }
+  }
+  return true;
+}
+
+time_zone::time_zone(const std::string &name) {
+  std::string file = name[0] == ':' ? name.substr(1) : name;
+
+  if (!file.empty()) {
+    if (file[0] != '/') {
+      const char *dir = getenv("TZDIR");
+      file = std::string(dir != nullptr ? dir : "/usr/share/zoneinfo") + "/" +
+             file;
+    }
+    if (load(file)) { return; }
+  }
+  /* like tzset(), try the name as a POSIX TZ string and fall back to UTC */
+  has_rule = name[0] != ':' && parse_rule(name.c_str(), tz_rule);
+  if (!has_rule) {
+    if (!name.empty()) { NORM_ERR("unknown time zone '%s'", name.c_str()); }
+    tz_rule.std_abbr = "UTC";
+    has_rule = true;
+  }
+}
+
+time_zone &time_zone::get(const std::string &name) {
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<time_zone>> zones;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto &zone = zones[name];
+  if (!zone) { zone.reset(new time_zone(name)); }
+  return *zone;
+}
+
+time_zone::span time_zone::rule_span(int64_t t) const {
+  const rule &r = tz_rule;
+
+  if (!r.has_dst) {
+    return {INT64_MIN, INT64_MAX, r.std_offset, false, r.std_abbr.c_str()};
+  }
+  /* the start is given in standard time, the end in daylight saving time */
+  auto start = [&](int64_t year) {
+    return rule_time(r.start, year) - r.std_offset;
+  };
+  auto end = [&](int64_t year) {
+    return rule_time(r.end, year) - r.dst_offset;
+  };
+  span std_span = {0, 0, r.std_offset, false, r.std_abbr.c_str()};
+  span dst_span = {0, 0, r.dst_offset, true, r.dst_abbr.c_str()};
+  int64_t year = year_of(t + r.std_offset);
+  int64_t s = start(year);
+  int64_t e = end(year);
+
+  if (s < e) {
+    if (t < s) {
+      std_span.from = end(year - 1);
+      std_span.until = s;
+      return std_span;
+    }
+    if (t < e) {
+      dst_span.from = s;
+      dst_span.until = e;
+      return dst_span;
+    }
+    std_span.from = e;
+    std_span.until = start(year + 1);
+    return std_span;
+  }
+  /* the southern hemisphere, daylight saving time spans the new year */
+  if (t < e) {
+    dst_span.from = start(year - 1);
+    dst_span.until = e;
+    return dst_span;
+  }
+  if (t < s) {
+    std_span.from = e;
+    std_span.until = s;
+    return std_span;
+  }
+  dst_span.from = s;
+  dst_span.until = end(year + 1);
+  return dst_span;
+}
+
+time_zone::span time_zone::find(int64_t t) const {
+  if (types.empty() ||
+      (has_rule && (transitions.empty() || t >= transitions.back()))) {
+    span s = rule_span(t);
+    if (!transitions.empty()) { s.from = std::max(s.from, transitions.back()); }
+    return s;
+  }
+
+  /* the first type holds before the first transition */
+  size_t i = std::upper_bound(transitions.begin(), transitions.end(), t) -
+             transitions.begin();
+  const type &tt = types[i == 0 ? 0 : transition_types[i - 1]];
+  return {i == 0 ? INT64_MIN : transitions[i - 1],
+          i == transitions.size() ? INT64_MAX : transitions[i], tt.offset,
+          tt.isdst, abbrs.c_str() + tt.abbr};
+}
+
+struct tm *time_zone::localtime(time_t t, struct tm *tm) {
+  if (!have_last_time || t != last_time) {
+    if (t < current.from || t >= current.until) { current = find(t); }
+    time_t local = t + current.offset;
+    gmtime_r(&local, &last_tm);
+    last_tm.tm_isdst = current.isdst ? 1 : 0;
+    last_tm.tm_gmtoff = current.offset;
+    last_tm.tm_zone = const_cast<char *>(current.abbr);
+    last_time = t;
+    have_last_time = true;
+  }
+  *tm = last_tm;
+  return tm;
+}
+
+}  // namespace conky
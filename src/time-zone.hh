@@ -0,0 +1,121 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TIME_ZONE_HH
+#define TIME_ZONE_HH
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace conky {
+
+/*
+ * A time zone as named by a TZ value, converting times without setting TZ
+ * and calling tzset(). Its zoneinfo file is read once. Past the last
+ * transition in the file, or when the name is a POSIX TZ string itself,
+ * the zone follows the POSIX rule. The offset that was found is kept
+ * along with the interval it holds for, and so is the broken-down time of
+ * the last second, so most conversions cost next to nothing.
+ *
+ * Zones are shared by everything that names them and are only ever used
+ * from the main thread.
+ */
+class time_zone {
+ public:
+  /* a date in a POSIX TZ rule, like "M3.5.0/3" or "J60" */
+  struct rule_date {
+    char kind = 'M'; /* 'J' (1-365, no leap day), 'D' (0-365) or 'M' */
+    int month = 0;
+    int week = 0; /* 1-5, where 5 is the last one */
+    int day = 0;  /* the day of the year, or of the week with 'M' */
+    int32_t time = 7200;
+  };
+
+  /* the rule of a POSIX TZ string, like "CET-1CEST,M3.5.0,M10.5.0/3" */
+  struct rule {
+    std::string std_abbr;
+    std::string dst_abbr;
+    int32_t std_offset = 0; /* seconds east of UTC */
+    int32_t dst_offset = 0;
+    bool has_dst = false;
+    rule_date start;
+    rule_date end;
+  };
+
+  /* the offset in effect from one transition to the next */
+  struct span {
+    int64_t from;  /* first UTC second */
+    int64_t until; /* first UTC second after it */
+    int32_t offset;
+    bool isdst;
+    const char *abbr;
+  };
+
+  /* the zone for a TZ value, loaded when first asked for */
+  static time_zone &get(const std::string &name);
+
+  explicit time_zone(const std::string &name);
+
+  /* localtime_r() as if TZ were set to the name of the zone */
+  struct tm *localtime(time_t t, struct tm *tm);
+
+  span find(int64_t t) const;
+
+  /* returns false unless s is a valid POSIX TZ string */
+  static bool parse_rule(const char *s, rule &r);
+
+ private:
+  struct type {
+    int32_t offset;
+    bool isdst;
+    uint8_t abbr;
+  };
+
+  /* from the zoneinfo file */
+  std::vector<int64_t> transitions;
+  std::vector<uint8_t> transition_types;
+  std::vector<type> types;
+  std::string abbrs;
+
+  bool has_rule = false;
+  rule tz_rule;
+
+  span current = {INT64_MAX, INT64_MIN, 0, false, ""};
+  time_t last_time = 0;
+  bool have_last_time = false;
+  struct tm last_tm {};
+
+  bool load(const std::string &path);
+  span rule_span(int64_t t) const;
+};
+
+}  // namespace conky
+
+#endif /* TIME_ZONE_HH */
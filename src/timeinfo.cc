@@ -38,12 +38,14 @@
 #include "conky.h"
 #include "logging.h"
 #include "text_object.h"
+#include "time-zone.hh"
 
 #include <memory>
 
 struct tztime_s {
   char *tz;  /* timezone variable */
   char *fmt; /* time display formatting */
+  conky::time_zone *zone;
 };
 
 conky::simple_config_setting<bool> times_in_seconds("times_in_seconds", false,
@@ -75,15 +77,30 @@ void scan_tztime(struct text_object *obj, const char *arg) {
   ts->fmt =
       strndup(fmt != nullptr ? fmt : "%F %T", text_buffer_size.get(*state));
   ts->tz = tz != nullptr ? strndup(tz, text_buffer_size.get(*state)) : nullptr;
+  ts->zone = tz != nullptr ? &conky::time_zone::get(ts->tz) : nullptr;
   obj->data.opaque = ts;
 }
 
+/* the local time, broken down once a second for all the objects showing it */
+static void local_time(time_t t, struct tm *tm) {
+  static time_t last_time;
+  static bool have_last_time = false;
+  static struct tm last_tm;
+
+  if (!have_last_time || t != last_time) {
+    localtime_r(&t, &last_tm);
+    last_time = t;
+    have_last_time = true;
+  }
+  *tm = last_tm;
+}
+
 void print_time(struct text_object *obj, char *p, unsigned int p_max_size) {
-  time_t t = time(nullptr);
-  struct tm *tm = localtime(&t);
+  struct tm tm;
+  local_time(time(nullptr), &tm);
 
   setlocale(LC_TIME, "");
-  strftime(p, p_max_size, static_cast<char *>(obj->data.opaque), tm);
+  strftime(p, p_max_size, static_cast<char *>(obj->data.opaque), &tm);
 }
 
 void print_utime(struct text_object *obj, char *p, unsigned int p_max_size) {
@@ -95,30 +112,19 @@ void print_utime(struct text_object *obj, char *p, unsigned int p_max_size) {
 }
 
 void print_tztime(struct text_object *obj, char *p, unsigned int p_max_size) {
-  char *oldTZ = nullptr;
-  time_t t;
-  struct tm *tm;
+  struct tm tm;
   auto *ts = static_cast<tztime_s *>(obj->data.opaque);
 
   if (ts == nullptr) { return; }
 
-  if (ts->tz != nullptr) {
-    oldTZ = getenv("TZ");
-    setenv("TZ", ts->tz, 1);
-    tzset();
+  if (ts->zone != nullptr) {
+    ts->zone->localtime(time(nullptr), &tm);
+  } else {
+    local_time(time(nullptr), &tm);
   }
-  t = time(nullptr);
-  tm = localtime(&t);
 
   setlocale(LC_TIME, "");
-  strftime(p, p_max_size, ts->fmt, tm);
-  if (oldTZ != nullptr) {
-    setenv("TZ", oldTZ, 1);
-    tzset();
-  } else {
-    unsetenv("TZ");
-  }
-  // Needless to free oldTZ since getenv gives ptr to static data
+  strftime(p, p_max_size, ts->fmt, &tm);
 }
 
 void free_time(struct text_object *obj) { free_and_zero(obj->data.opaque); }
@@ -314,9 +320,9 @@ static void do_format_time(struct text_object *obj, char *p,
 
 void print_format_time(struct text_object *obj, char *p,
                        unsigned int p_max_size) {
-  std::unique_ptr<char[]> buf(new char[max_user_text.get(*state)]);
+  conky::scratch_text buf(max_user_text.get(*state));
 
-  generate_text_internal(buf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(buf.get(), buf.size(), *obj->sub);
   obj->data.s = buf.get();
   do_format_time(obj, p, p_max_size);
 }
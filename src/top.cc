@@ -30,124 +30,207 @@
 
 #include "top.h"
 #include "logging.h"
-#include "prioqueue.h"
 
-/* hash table size - always a power of 2 */
-#define HTABSIZE 256
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 struct process *first_process = nullptr;
 
 unsigned long g_time = 0;
 
-/* a simple hash table to speed up find_process() */
-struct proc_hash_entry {
-  struct proc_hash_entry *next;
-  struct process *proc;
-};
-static struct proc_hash_entry proc_hash_table[HTABSIZE];
-
-static void hash_process(struct process *p) {
-  struct proc_hash_entry *phe;
-  static char first_run = 1;
-  int bucket;
-
-  /* better make sure all next pointers are zero upon first access */
-  if (first_run != 0) {
-    memset(proc_hash_table, 0, sizeof(struct proc_hash_entry) * HTABSIZE);
-    first_run = 0;
-  }
-
-  /* get the bucket index */
-  bucket = p->pid & (HTABSIZE - 1);
-
-  /* insert a new element on bucket's top */
-  phe = static_cast<struct proc_hash_entry *>(
-      malloc(sizeof(struct proc_hash_entry)));
-  phe->proc = p;
-  phe->next = proc_hash_table[bucket].next;
-  proc_hash_table[bucket].next = phe;
-}
-
-static void unhash_process(struct process *p) {
-  struct proc_hash_entry *phe, *tmp;
-
-  /* get the bucket head */
-  phe = &proc_hash_table[p->pid & (HTABSIZE - 1)];
-  /* find the entry pointing to p and drop it */
-  while (phe->next != nullptr) {
-    if (phe->next->proc == p) {
-      tmp = phe->next;
-      phe->next = phe->next->next;
-      free(tmp);
-      return;
+/* Process records are carved out of slabs and recycled through a free list
+ * (chained by ->next), so tracking a pid doesn't cost a malloc(). */
+#define PROCESS_SLAB_SIZE 256
+static std::vector<struct process *> process_slabs;
+static struct process *free_processes = nullptr;
+
+static struct process *alloc_process() {
+  if (free_processes == nullptr) {
+    auto *slab = static_cast<struct process *>(
+        malloc(PROCESS_SLAB_SIZE * sizeof(struct process)));
+    process_slabs.push_back(slab);
+    for (int i = PROCESS_SLAB_SIZE - 1; i >= 0; --i) {
+      slab[i].next = free_processes;
+      free_processes = &slab[i];
     }
-    phe = phe->next;
   }
+  struct process *p = free_processes;
+  free_processes = p->next;
+  return p;
 }
 
-static void __unhash_all_processes(struct proc_hash_entry *phe) {
-  if (phe->next != nullptr) { __unhash_all_processes(phe->next); }
-  free(phe->next);
+static void release_process(struct process *p) {
+  p->next = free_processes;
+  free_processes = p;
 }
 
-static void unhash_all_processes() {
-  int i;
+/* An open addressing pid -> process map with linear probing. Deleted slots
+ * become tombstones, so process_cleanup() can delete while walking it. The
+ * table is rebuilt when it gets too full of either. */
+#define PID_TOMBSTONE (reinterpret_cast<struct process *>(1))
+static std::vector<struct process *> pid_table(256, nullptr);
+static size_t pid_table_live = 0;
+static size_t pid_table_tombstones = 0;
+
+static inline size_t pid_slot(pid_t pid) {
+  /* Fibonacci hashing, consecutive pids land far apart */
+  return (static_cast<uint32_t>(pid) * 2654435769u) & (pid_table.size() - 1);
+}
+
+static void rehash_processes(size_t size) {
+  std::vector<struct process *> old(size, nullptr);
+  old.swap(pid_table);
+  pid_table_tombstones = 0;
+  for (struct process *p : old) {
+    if (p == nullptr || p == PID_TOMBSTONE) { continue; }
+    size_t i = pid_slot(p->pid);
+    while (pid_table[i] != nullptr) { i = (i + 1) & (pid_table.size() - 1); }
+    pid_table[i] = p;
+  }
+}
+
+static void hash_process(struct process *p) {
+  /* keep the table at most half full, counting tombstones */
+  if ((pid_table_live + pid_table_tombstones + 1) * 2 > pid_table.size()) {
+    rehash_processes(pid_table_live * 4 > pid_table.size()
+                         ? pid_table.size() * 2
+                         : pid_table.size());
+  }
+
+  size_t i = pid_slot(p->pid);
+  while (pid_table[i] != nullptr && pid_table[i] != PID_TOMBSTONE) {
+    i = (i + 1) & (pid_table.size() - 1);
+  }
+  if (pid_table[i] == PID_TOMBSTONE) { --pid_table_tombstones; }
+  pid_table[i] = p;
+  ++pid_table_live;
+}
 
-  for (i = 0; i < HTABSIZE; i++) {
-    __unhash_all_processes(&proc_hash_table[i]);
-    proc_hash_table[i].next = nullptr;
+static size_t find_process_slot(pid_t pid) {
+  size_t i = pid_slot(pid);
+  while (pid_table[i] != nullptr) {
+    if (pid_table[i] != PID_TOMBSTONE && pid_table[i]->pid == pid) { return i; }
+    i = (i + 1) & (pid_table.size() - 1);
   }
+  return pid_table.size();
+}
+
+static void unhash_slot(size_t i) {
+  pid_table[i] = PID_TOMBSTONE;
+  --pid_table_live;
+  ++pid_table_tombstones;
+}
+
+static void unhash_all_processes() {
+  std::fill(pid_table.begin(), pid_table.end(), nullptr);
+  pid_table_live = pid_table_tombstones = 0;
 }
 
+/* Processes by name and by basename. It points into the names of the
+ * processes, which only change while get_top_info() runs, so it is rebuilt
+ * on the first lookup after each update of the process list. */
+static std::unordered_multimap<std::string_view, struct process *> name_index;
+static unsigned long name_index_time = ULONG_MAX;
+
+/* the names of the users processes ran as, as ${top user} shows them;
+ * getpwuid() may have to ask a directory service, and users hardly change */
+static std::unordered_map<uid_t, std::string> user_names;
+
 struct process *get_first_process() {
   return first_process;
 }
 
 void free_all_processes() {
-  struct process *next = nullptr, *pr = first_process;
+  struct process *pr = first_process;
 
   while (pr != nullptr) {
-    next = pr->next;
     free_and_zero(pr->name);
     free_and_zero(pr->basename);
-    free(pr);
-    pr = next;
+    pr = pr->next;
   }
   first_process = nullptr;
-
-  /* drop the whole hash table */
+  name_index.clear();
+  name_index_time = ULONG_MAX;
+  user_names.clear();
+#ifdef __linux__
+  free_top_views();
+#endif /* __linux__ */
+
+  /* drop the whole hash table and every slab */
   unhash_all_processes();
+  for (struct process *slab : process_slabs) { free(slab); }
+  process_slabs.clear();
+  free_processes = nullptr;
 }
 
-struct process *get_process_by_name(const char *name) {
-  struct process *p = first_process;
-
-  while (p != nullptr) {
-    /* Try matching against the full command line first. If that fails,
-     * fall back to the basename.
-     */
-    if (((p->name != nullptr) && (strcmp(p->name, name) == 0)) ||
-        ((p->basename != nullptr) && (strcmp(p->basename, name) == 0))) {
-      return p;
-    }
-    p = p->next;
+size_t process_table_memory(size_t *count) {
+  /* unordered_map nodes: the next pointer and the cached hash */
+  const size_t node = 2 * sizeof(void *);
+
+  size_t size = process_slabs.size() * PROCESS_SLAB_SIZE *
+                    sizeof(struct process) +
+                pid_table.capacity() * sizeof(struct process *);
+  *count = 0;
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    ++*count;
+    if (p->name != nullptr) { size += strlen(p->name) + 1; }
+    if (p->basename != nullptr) { size += strlen(p->basename) + 1; }
   }
-  return nullptr;
+  size += name_index.bucket_count() * sizeof(void *) +
+          name_index.size() *
+              (node + sizeof(decltype(name_index)::value_type));
+  size += user_names.bucket_count() * sizeof(void *);
+  for (const auto &u : user_names) {
+    size += node + sizeof(u) + conky::priv::heap_size(u.second);
+  }
+  return size;
 }
 
-static struct process *find_process(pid_t pid) {
-  struct proc_hash_entry *phe;
+void process_set_name(struct process *p, const char *name,
+                      const char *basename, size_t max) {
+  /* names hardly ever change, so keep the old copies when we can */
+  if (p->name == nullptr || strncmp(p->name, name, max) != 0) {
+    free_and_zero(p->name);
+    p->name = strndup(name, max);
+  }
+  if (p->basename == nullptr || strncmp(p->basename, basename, max) != 0) {
+    free_and_zero(p->basename);
+    p->basename = strndup(basename, max);
+  }
+}
 
-  phe = &proc_hash_table[pid & (HTABSIZE - 1)];
-  while (phe->next != nullptr) {
-    if (phe->next->proc->pid == pid) { return phe->next->proc; }
-    phe = phe->next;
+static void index_process_names() {
+  name_index.clear();
+  name_index.reserve(pid_table_live * 2);
+  for (struct process *p = first_process; p != nullptr; p = p->next) {
+    if (p->name != nullptr) { name_index.emplace(p->name, p); }
+    if (p->basename != nullptr &&
+        (p->name == nullptr || strcmp(p->name, p->basename) != 0)) {
+      name_index.emplace(p->basename, p);
+    }
   }
-  return nullptr;
+  name_index_time = g_time;
+}
+
+struct process *get_process_by_name(const char *name) {
+  /* match either the full command line or the basename */
+  if (name == nullptr) { return nullptr; }
+  if (name_index_time != g_time) { index_process_names(); }
+  auto it = name_index.find(name);
+  return it != name_index.end() ? it->second : nullptr;
+}
+
+static struct process *find_process(pid_t pid) {
+  size_t i = find_process_slot(pid);
+  return i < pid_table.size() ? pid_table[i] : nullptr;
 }
 
 static struct process *new_process(pid_t pid) {
-  auto *p = static_cast<struct process *>(malloc(sizeof(struct process)));
+  struct process *p = alloc_process();
 
   /* Do stitching necessary for doubly linked list */
   p->previous = nullptr;
@@ -156,6 +239,7 @@ static struct process *new_process(pid_t pid) {
   first_process = p;
 
   p->pid = pid;
+  p->starttime = 0;
   p->name = nullptr;
   p->basename = nullptr;
   p->amount = 0;
@@ -173,6 +257,7 @@ static struct process *new_process(pid_t pid) {
   p->write_bytes = 0;
   p->previous_write_bytes = ULLONG_MAX;
   p->io_perc = 0;
+  p->io_retry_time = 0;
 #endif /* BUILD_IOSTATS */
   p->time_stamp = 0;
   p->counted = 1;
@@ -200,7 +285,7 @@ struct process *get_process(pid_t pid) {
  * Destroy and remove a process           *
  ******************************************/
 
-static void delete_process(struct process *p) {
+static void delete_process(struct process *p, size_t slot) {
 #if defined(PARANOID)
   assert(p->id == 0x0badfeed);
 
@@ -223,8 +308,8 @@ static void delete_process(struct process *p) {
   free_and_zero(p->name);
   free_and_zero(p->basename);
   /* remove the process from the hash table */
-  unhash_process(p);
-  free(p);
+  unhash_slot(slot);
+  release_process(p);
 }
 
 /******************************************
@@ -232,22 +317,22 @@ static void delete_process(struct process *p) {
  ******************************************/
 
 static void process_cleanup() {
-  struct process *p = first_process;
-
-  while (p != nullptr) {
-    struct process *current = p;
+  /* walk the pid table rather than the list, it is one contiguous array */
+  for (size_t i = 0; i < pid_table.size(); ++i) {
+    struct process *p = pid_table[i];
+    if (p == nullptr || p == PID_TOMBSTONE) { continue; }
 
 #if defined(PARANOID)
     assert(p->id == 0x0badfeed);
 #endif /* defined(PARANOID) */
 
-    p = p->next;
-    /* Delete processes that have died */
-    if (current->time_stamp != g_time) {
-      delete_process(current);
-      if (current == first_process) { first_process = nullptr; }
-      current = nullptr;
-    }
+    /* Delete processes that have died, i.e. weren't stamped with the
+     * current g_time by get_top_info() */
+    if (p->time_stamp != g_time) { delete_process(p, i); }
+  }
+
+  if (pid_table_tombstones * 4 > pid_table.size()) {
+    rehash_processes(pid_table.size());
   }
 }
 
@@ -255,45 +340,83 @@ static void process_cleanup() {
  * Find the top processes				  *
  ******************************************/
 
-/* cpu comparison function for prio queue */
-static int compare_cpu(void *va, void *vb) {
-  auto *a = static_cast<struct process *>(va),
-       *b = static_cast<struct process *>(vb);
+enum top_view_type { TOP_VIEW_PROCESSES, TOP_VIEW_THREADS, TOP_VIEW_CGROUPS };
+
+template <>
+conky::lua_traits<top_view_type>::Map conky::lua_traits<top_view_type>::map = {
+    {"processes", TOP_VIEW_PROCESSES},
+    {"threads", TOP_VIEW_THREADS},
+    {"cgroups", TOP_VIEW_CGROUPS}};
+
+static conky::simple_config_setting<top_view_type> top_view(
+    "top_view", TOP_VIEW_PROCESSES, false);
+
+/* how many of the busiest processes have their threads listed */
+static conky::range_config_setting<unsigned int> top_thread_candidates(
+    "top_thread_candidates", 1, MAX_SP, 10, false);
+
+/* Keeps the MAX_SP (at most) greatest processes seen in a min heap kept in a
+ * fixed array, so selecting them costs O(n log k) and no allocations. */
+class top_selector {
+  bool (*const greater)(const struct process *, const struct process *);
+  struct process *heap[MAX_SP];
+  int size;
+  const int capacity;
+
+  void sift_down(int i) {
+    for (;;) {
+      int least = i, l = 2 * i + 1, r = l + 1;
+      if (l < size && greater(heap[least], heap[l])) { least = l; }
+      if (r < size && greater(heap[least], heap[r])) { least = r; }
+      if (least == i) { return; }
+      std::swap(heap[i], heap[least]);
+      i = least;
+    }
+  }
 
-  if (b->amount > a->amount) { return 1; }
-  if (a->amount > b->amount) { return -1; }
-  return 0;
-}
+ public:
+  top_selector(bool (*greater_)(const struct process *,
+                                const struct process *),
+               int capacity_)
+      : greater(greater_), size(0), capacity(std::min(capacity_, MAX_SP)) {}
+
+  void add(struct process *p) {
+    if (size < capacity) {
+      int i = size++;
+      heap[i] = p;
+      while (i > 0 && greater(heap[(i - 1) / 2], heap[i])) {
+        std::swap(heap[i], heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+      }
+    } else if (capacity > 0 && greater(p, heap[0])) {
+      heap[0] = p;
+      sift_down(0);
+    }
+  }
 
-/* mem comparison function for prio queue */
-static int compare_mem(void *va, void *vb) {
-  auto *a = static_cast<struct process *>(va),
-       *b = static_cast<struct process *>(vb);
+  /* stores the selection in decreasing order, padded with nullptr */
+  void store(struct process **out) {
+    std::sort(heap, heap + size, greater);
+    std::copy(heap, heap + size, out);
+    std::fill(out + size, out + MAX_SP, nullptr);
+  }
+};
 
-  if (b->rss > a->rss) { return 1; }
-  if (a->rss > b->rss) { return -1; }
-  return 0;
+static bool greater_cpu(const struct process *a, const struct process *b) {
+  return a->amount > b->amount;
 }
 
-/* CPU time comparison function for prio queue */
-static int compare_time(void *va, void *vb) {
-  auto *a = static_cast<struct process *>(va),
-       *b = static_cast<struct process *>(vb);
+static bool greater_mem(const struct process *a, const struct process *b) {
+  return a->rss > b->rss;
+}
 
-  if (b->total_cpu_time > a->total_cpu_time) { return 1; }
-  if (b->total_cpu_time < a->total_cpu_time) { return -1; }
-  return 0;
+static bool greater_time(const struct process *a, const struct process *b) {
+  return a->total_cpu_time > b->total_cpu_time;
 }
 
 #ifdef BUILD_IOSTATS
-/* I/O comparison function for prio queue */
-static int compare_io(void *va, void *vb) {
-  auto *a = static_cast<struct process *>(va),
-       *b = static_cast<struct process *>(vb);
-
-  if (b->io_perc > a->io_perc) { return 1; }
-  if (a->io_perc > b->io_perc) { return -1; }
-  return 0;
+static bool greater_io(const struct process *a, const struct process *b) {
+  return a->io_perc > b->io_perc;
 }
 #endif /* BUILD_IOSTATS */
 
@@ -309,13 +432,6 @@ static void process_find_top(struct process **cpu, struct process **mem,
                              struct process **io
 #endif /* BUILD_IOSTATS */
 ) {
-  prio_queue_t cpu_queue, mem_queue, time_queue;
-#ifdef BUILD_IOSTATS
-  prio_queue_t io_queue;
-#endif
-  struct process *cur_proc = nullptr;
-  int i;
-
   if ((top_cpu == 0) && (top_mem == 0) && (top_time == 0)
 #ifdef BUILD_IOSTATS
       && (top_io == 0)
@@ -324,22 +440,12 @@ static void process_find_top(struct process **cpu, struct process **mem,
     return;
   }
 
-  cpu_queue = init_prio_queue();
-  pq_set_compare(cpu_queue, &compare_cpu);
-  pq_set_max_size(cpu_queue, MAX_SP);
-
-  mem_queue = init_prio_queue();
-  pq_set_compare(mem_queue, &compare_mem);
-  pq_set_max_size(mem_queue, MAX_SP);
-
-  time_queue = init_prio_queue();
-  pq_set_compare(time_queue, &compare_time);
-  pq_set_max_size(time_queue, MAX_SP);
-
+  /* only select as many as the deepest ${top} asks for */
+  top_selector cpu_top(&greater_cpu, top_cpu != 0 ? top_depth : 0);
+  top_selector mem_top(&greater_mem, top_mem != 0 ? top_depth : 0);
+  top_selector time_top(&greater_time, top_time != 0 ? top_depth : 0);
 #ifdef BUILD_IOSTATS
-  io_queue = init_prio_queue();
-  pq_set_compare(io_queue, &compare_io);
-  pq_set_max_size(io_queue, MAX_SP);
+  top_selector io_top(&greater_io, top_io != 0 ? top_depth : 0);
 #endif
 
   /* g_time is the time_stamp entry for process.  It is updated when the
@@ -353,39 +459,50 @@ static void process_find_top(struct process **cpu, struct process **mem,
 
   process_cleanup(); /* cleanup list from exited processes */
 
-  cur_proc = first_process;
-
-  while (cur_proc != nullptr) {
-    if (top_cpu != 0) { insert_prio_elem(cpu_queue, cur_proc); }
-    if (top_mem != 0) { insert_prio_elem(mem_queue, cur_proc); }
-    if (top_time != 0) { insert_prio_elem(time_queue, cur_proc); }
+  /* one pass over the list feeds every ordering */
+  auto add = [&](struct process *cur_proc) {
+    cpu_top.add(cur_proc);
+    mem_top.add(cur_proc);
+    time_top.add(cur_proc);
 #ifdef BUILD_IOSTATS
-    if (top_io != 0) { insert_prio_elem(io_queue, cur_proc); }
+    io_top.add(cur_proc);
 #endif /* BUILD_IOSTATS */
-    cur_proc = cur_proc->next;
-  }
-
-  for (i = 0; i < MAX_SP; i++) {
-    if (top_cpu != 0) {
-      cpu[i] = static_cast<process *>(pop_prio_elem(cpu_queue));
-    }
-    if (top_mem != 0) {
-      mem[i] = static_cast<process *>(pop_prio_elem(mem_queue));
-    }
-    if (top_time != 0) {
-      ptime[i] = static_cast<process *>(pop_prio_elem(time_queue));
+  };
+
+  bool fed = false;
+#ifdef __linux__
+  const top_view_type view = top_view.get(*state);
+  if (view != TOP_VIEW_PROCESSES) {
+    static std::vector<struct process *> entries;
+
+    if (view == TOP_VIEW_THREADS) {
+      /* only the threads of the busiest processes are worth reading */
+      struct process *candidates[MAX_SP];
+      top_selector busiest(&greater_cpu, top_thread_candidates.get(*state));
+      for (struct process *p = first_process; p != nullptr; p = p->next) {
+        busiest.add(p);
+      }
+      busiest.store(candidates);
+      get_top_threads(candidates, entries);
+    } else {
+      get_top_cgroups(entries);
     }
-#ifdef BUILD_IOSTATS
-    if (top_io != 0) {
-      io[i] = static_cast<process *>(pop_prio_elem(io_queue));
+    std::for_each(entries.begin(), entries.end(), add);
+    fed = true;
+  }
+#endif /* __linux__ */
+  if (!fed) {
+    for (struct process *cur_proc = first_process; cur_proc != nullptr;
+         cur_proc = cur_proc->next) {
+      add(cur_proc);
     }
-#endif /* BUILD_IOSTATS */
   }
-  free_prio_queue(cpu_queue);
-  free_prio_queue(mem_queue);
-  free_prio_queue(time_queue);
+
+  if (top_cpu != 0) { cpu_top.store(cpu); }
+  if (top_mem != 0) { mem_top.store(mem); }
+  if (top_time != 0) { time_top.store(ptime); }
 #ifdef BUILD_IOSTATS
-  free_prio_queue(io_queue);
+  if (top_io != 0) { io_top.store(io); }
 #endif /* BUILD_IOSTATS */
 }
 
@@ -400,8 +517,10 @@ int update_top() {
   return 0;
 }
 
-static char *format_time(unsigned long timeval, const int width) {
-  char buf[10];
+/* Formats timeval, in centiseconds, into buf in at most width characters,
+ * in the most precise unit that fits. */
+static void format_time(char *buf, size_t size, unsigned long timeval,
+                        const int width) {
   unsigned long nt;  // narrow time, for speed on 32-bit
   unsigned cc;       // centiseconds
   unsigned nn;       // multi-purpose whatever
@@ -411,31 +530,19 @@ static char *format_time(unsigned long timeval, const int width) {
   nt /= 100;      // total seconds
   nn = nt % 60;   // seconds past the minute
   nt /= 60;       // total minutes
-  if (width >= snprintf(buf, sizeof buf, "%lu:%02u.%02u", nt, nn, cc)) {
-    return strndup(buf, text_buffer_size.get(*state));
-  }
-  if (width >= snprintf(buf, sizeof buf, "%lu:%02u", nt, nn)) {
-    return strndup(buf, text_buffer_size.get(*state));
-  }
+  if (width >= snprintf(buf, size, "%lu:%02u.%02u", nt, nn, cc)) { return; }
+  if (width >= snprintf(buf, size, "%lu:%02u", nt, nn)) { return; }
   nn = nt % 60;  // minutes past the hour
   nt /= 60;      // total hours
-  if (width >= snprintf(buf, sizeof buf, "%lu,%02u", nt, nn)) {
-    return strndup(buf, text_buffer_size.get(*state));
-  }
+  if (width >= snprintf(buf, size, "%lu,%02u", nt, nn)) { return; }
   nn = nt;  // now also hours
-  if (width >= snprintf(buf, sizeof buf, "%uh", nn)) {
-    return strndup(buf, text_buffer_size.get(*state));
-  }
+  if (width >= snprintf(buf, size, "%uh", nn)) { return; }
   nn /= 24;  // now days
-  if (width >= snprintf(buf, sizeof buf, "%ud", nn)) {
-    return strndup(buf, text_buffer_size.get(*state));
-  }
+  if (width >= snprintf(buf, size, "%ud", nn)) { return; }
   nn /= 7;  // now weeks
-  if (width >= snprintf(buf, sizeof buf, "%uw", nn)) {
-    return strndup(buf, text_buffer_size.get(*state));
-  }
+  if (width >= snprintf(buf, size, "%uw", nn)) { return; }
   // well shoot, this outta' fit...
-  return strndup("<inf>", text_buffer_size.get(*state));
+  snprintf(buf, size, "<inf>");
 }
 
 struct top_data {
@@ -447,12 +554,30 @@ struct top_data {
 
 static conky::range_config_setting<unsigned int> top_name_width(
     "top_name_width", 0, std::numeric_limits<unsigned int>::max(), 15, true);
-static conky::simple_config_setting<bool> top_name_verbose("top_name_verbose",
-                                                           false, true);
+conky::simple_config_setting<bool> top_name_verbose("top_name_verbose", false,
+                                                    true);
+
+/* top_name_width and top_name_verbose, read once per update rather than for
+ * every row */
+static void top_name_settings(unsigned int *width, bool *verbose) {
+  static double read_at = -1;
+  static unsigned int name_width;
+  static bool name_verbose;
+
+  if (read_at != current_update_time) {
+    name_width = top_name_width.get(*state);
+    name_verbose = top_name_verbose.get(*state);
+    read_at = current_update_time;
+  }
+  *width = name_width;
+  *verbose = name_verbose;
+}
 
 static void print_top_name(struct text_object *obj, char *p,
                            unsigned int p_max_size) {
   auto *td = static_cast<struct top_data *>(obj->data.opaque);
+  unsigned int name_width;
+  bool verbose;
   int width;
 
   if ((td == nullptr) || (td->list == nullptr) ||
@@ -460,9 +585,9 @@ static void print_top_name(struct text_object *obj, char *p,
     return;
   }
 
-  width = std::min(p_max_size,
-                   static_cast<unsigned int>(top_name_width.get(*state)) + 1);
-  if (top_name_verbose.get(*state)) {
+  top_name_settings(&name_width, &verbose);
+  width = std::min(p_max_size, name_width + 1);
+  if (verbose) {
     /* print the full command line */
     snprintf(p, width + 1, "%-*s", width, td->list[td->num]->name);
   } else {
@@ -490,7 +615,7 @@ static void print_top_time(struct text_object *obj, char *p,
                            unsigned int p_max_size) {
   auto *td = static_cast<struct top_data *>(obj->data.opaque);
   int width;
-  char *timeval;
+  char timeval[10];
 
   if ((td == nullptr) || (td->list == nullptr) ||
       (td->list[td->num] == nullptr)) {
@@ -498,27 +623,28 @@ static void print_top_time(struct text_object *obj, char *p,
   }
 
   width = std::min(p_max_size, static_cast<unsigned int>(10));
-  timeval = format_time(td->list[td->num]->total_cpu_time, 9);
+  format_time(timeval, sizeof timeval, td->list[td->num]->total_cpu_time, 9);
   snprintf(p, width, "%9s", timeval);
-  free(timeval);
 }
 
 static void print_top_user(struct text_object *obj, char *p,
                            unsigned int p_max_size) {
   auto *td = static_cast<struct top_data *>(obj->data.opaque);
-  struct passwd *pw;
 
   if ((td == nullptr) || (td->list == nullptr) ||
       (td->list[td->num] == nullptr)) {
     return;
   }
 
-  pw = getpwuid(td->list[td->num]->uid);
-  if (pw != nullptr) {
-    snprintf(p, p_max_size, "%.8s", pw->pw_name);
-  } else {
-    snprintf(p, p_max_size, "%d", td->list[td->num]->uid);
+  uid_t uid = td->list[td->num]->uid;
+  auto it = user_names.find(uid);
+  if (it == user_names.end()) {
+    struct passwd *pw = getpwuid(uid);
+    std::string name = pw != nullptr ? std::string(pw->pw_name).substr(0, 8)
+                                     : std::to_string(uid);
+    it = user_names.emplace(uid, std::move(name)).first;
   }
+  snprintf(p, p_max_size, "%s", it->second.c_str());
 }
 
 #define PRINT_TOP_GENERATOR(name, width, fmt, field)                         \
@@ -583,6 +709,7 @@ int parse_top_args(const char *s, const char *arg, struct text_object *obj) {
   } else if (strcmp(&s[3], "_io") == EQUAL) {
     td->list = info.io;
     top_io = 1;
+    top_io_fields = 1;
 #endif /* BUILD_IOSTATS */
   } else {
 #ifdef BUILD_IOSTATS
@@ -618,10 +745,13 @@ int parse_top_args(const char *s, const char *arg, struct text_object *obj) {
 #ifdef BUILD_IOSTATS
     } else if (strcmp(buf, "io_read") == EQUAL) {
       obj->callbacks.print = &print_top_read_bytes;
+      top_io_fields = 1;
     } else if (strcmp(buf, "io_write") == EQUAL) {
       obj->callbacks.print = &print_top_write_bytes;
+      top_io_fields = 1;
     } else if (strcmp(buf, "io_perc") == EQUAL) {
       obj->callbacks.print = &print_top_io_perc;
+      top_io_fields = 1;
 #endif /* BUILD_IOSTATS */
     } else {
       NORM_ERR("invalid type arg for top");
@@ -643,6 +773,7 @@ int parse_top_args(const char *s, const char *arg, struct text_object *obj) {
       return 0;
     }
     td->num = n - 1;
+    top_depth = std::max(top_depth, n);
 
   } else {
     NORM_ERR("invalid argument count for top");
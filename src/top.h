@@ -65,6 +65,8 @@
 #include <pwd.h>
 #include <regex.h>
 
+#include <vector>
+
 /******************************************
  * Defines								  *
  ******************************************/
@@ -73,8 +75,6 @@
  * and it'll take me a while to write a replacement. */
 #define BUFFER_LEN 1024
 
-#define MAX_SP 10  // number of elements to sort
-
 /******************************************
  * Process class						  *
  ******************************************/
@@ -84,6 +84,9 @@ struct process {
   struct process *previous;
 
   pid_t pid;
+  /* when the process started, in clock ticks after boot; with the pid it
+   * tells whether name still belongs to this process */
+  unsigned long long starttime;
   char *name;
   char *basename;
   uid_t uid;
@@ -104,6 +107,9 @@ struct process {
   unsigned long long write_bytes;
   unsigned long long previous_write_bytes;
   float io_perc;
+  /* the g_time before which /proc/<pid>/io isn't tried again after it was
+   * denied */
+  unsigned long io_retry_time;
 #endif
   unsigned int time_stamp;
   unsigned int counted;
@@ -125,9 +131,31 @@ int update_top(void);
 
 void get_top_info(void);
 
+/* the memory held by the process list and its indices, for ${conky_mem};
+ * count is set to the number of processes */
+size_t process_table_memory(size_t *count);
+
 extern struct process *first_process;
 extern unsigned long g_time;
 
+extern conky::simple_config_setting<bool> top_name_verbose;
+
 struct process *get_process(pid_t pid);
 
+/* Sets the names of p, at most max characters long, reusing its current
+ * strings if they didn't change. Doesn't touch settings, so it can be called
+ * from parallel_for(). */
+void process_set_name(struct process *p, const char *name,
+                      const char *basename, size_t max);
+
+#ifdef __linux__
+/* The views of top_view, see linux.cc. Threads lists the threads of the
+ * candidate processes and the other processes whole, cgroups sums up the
+ * processes by cgroup, with pid being the number of them. */
+void get_top_threads(struct process **candidates,
+                     std::vector<struct process *> &entries);
+void get_top_cgroups(std::vector<struct process *> &entries);
+void free_top_views(void);
+#endif /* __linux__ */
+
 #endif /* _top_h_ */
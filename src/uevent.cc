@@ -0,0 +1,99 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uevent.hh"
+
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace conky {
+
+namespace {
+/* the multicast group of the kernel's own messages, udev rebroadcasts them
+ * to group 2 after processing */
+const unsigned int UEVENT_KERNEL_GROUP = 1;
+}  // namespace
+
+bool uevent_monitor::open() {
+  close();
+
+  fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+              NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) { return false; }
+
+  struct sockaddr_nl addr {};
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = UEVENT_KERNEL_GROUP;
+  addr.nl_pid = 0; /* let the kernel pick a unique id */
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof addr) < 0) {
+    int err = errno;
+    close();
+    errno = err;
+    return false;
+  }
+  return true;
+}
+
+void uevent_monitor::close() {
+  if (fd >= 0) { ::close(fd); }
+  fd = -1;
+}
+
+bool uevent_monitor::read_events(
+    const std::function<void(const char *, const char *)> &on_event) {
+  if (fd < 0) { return false; }
+
+  /* "action@devpath", then NUL separated KEY=value pairs */
+  char buf[8192];
+  for (;;) {
+    ssize_t len = recv(fd, buf, sizeof buf - 1, 0);
+    if (len < 0) {
+      if (errno == EINTR) { continue; }
+      /* ENOBUFS: the socket overflowed and events are gone */
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    buf[len] = '\0';
+
+    const char *action = "";
+    const char *subsystem = "";
+    for (const char *p = buf; p < buf + len; p += strlen(p) + 1) {
+      if (strncmp(p, "ACTION=", 7) == 0) {
+        action = p + 7;
+      } else if (strncmp(p, "SUBSYSTEM=", 10) == 0) {
+        subsystem = p + 10;
+      }
+    }
+    on_event(action, subsystem);
+  }
+}
+
+}  // namespace conky
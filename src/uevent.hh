@@ -0,0 +1,69 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef UEVENT_HH
+#define UEVENT_HH
+
+#include <functional>
+
+namespace conky {
+
+/*
+ * Device add and remove notifications broadcast by the kernel over netlink
+ * (the ones udev acts on), so sysfs paths resolved once can be resolved again
+ * when devices come and go. Unlike the proc connector this needs no
+ * privileges.
+ */
+class uevent_monitor {
+  int fd;
+
+  uevent_monitor(const uevent_monitor &) = delete;
+  uevent_monitor &operator=(const uevent_monitor &) = delete;
+
+ public:
+  uevent_monitor() : fd(-1) {}
+  ~uevent_monitor() { close(); }
+
+  /* Starts listening. Returns false (with errno set) if that's not possible.
+   */
+  bool open();
+  void close();
+  bool is_open() const { return fd >= 0; }
+
+  /*
+   * Passes the action ("add", "remove", ...) and subsystem of every event
+   * since the last call to on_event. Returns false if events were lost.
+   */
+  bool read_events(
+      const std::function<void(const char *action, const char *subsystem)>
+          &on_event);
+};
+
+}  // namespace conky
+
+#endif /* UEVENT_HH */
@@ -21,17 +21,79 @@
  */
 
 #include "config.h"
+#include "conky.h"
 #include "logging.h"
+#include "thread-qos.hh"
 
 #include "update-cb.hh"
 
+#include <cxxabi.h>
 #include <unistd.h>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <typeinfo>
+#include <vector>
 
 namespace conky {
 namespace {
-semaphore sem_wait;
+/* the callbacks with wait=true of the current update */
+completion_latch frame_done;
+/* how long run_all_callbacks() spins before it sleeps waiting for them, most
+ * frames' callbacks finish within this once the caller has run out of them */
+const double FRAME_SPIN = 50e-6; /* seconds */
 enum { UNUSED_MAX = 5 };
+
+/* callbacks set_on_demand() keep running for DEMAND_HYSTERESIS update
+ * intervals after they were wanted() last, then on every DEMAND_POLL-th one,
+ * so that their result isn't too old once it is wanted again */
+enum { DEMAND_HYSTERESIS = 5, DEMAND_POLL = 10 };
+
+/* The registered callbacks are kept in a hashed timer wheel: slot i holds
+ * those due in a tick t with t % WHEEL_SLOTS == i. run_all_callbacks() only
+ * looks at the slots of the ticks which passed since it ran last, and in them
+ * only touches the callbacks which are due, the rest are one or more turns of
+ * the wheel away. */
+enum { WHEEL_SLOTS = 512 };
+const double WHEEL_TICK = 1.0 / 16; /* seconds */
+
+priv::callback_base *wheel[WHEEL_SLOTS];
+int64_t wheel_tick = -1; /* the last tick looked at, -1 before the first */
+
+inline int64_t to_tick(double time) {
+  return static_cast<int64_t>(time / WHEEL_TICK);
+}
+
+/* signalled when a callback with a deadline finishes */
+std::mutex bounded_mutex;
+std::condition_variable bounded_cv;
+
+/* 0 means one thread per CPU */
+conky::range_config_setting<unsigned int> callback_threads("callback_threads",
+                                                           0, 1024, 0, false);
+
+conky::simple_config_setting<bool> collect_on_demand("collect_on_demand", true,
+                                                     false);
+
+/* the longest period callbacks whose result stays the same are stretched
+ * to, 0 keeps them to theirs */
+conky::range_config_setting<double> adaptive_period_max(
+    "adaptive_period_max", 0.0, std::numeric_limits<double>::infinity(), 0.0,
+    false);
+
+/* how much longer than its own the period of a callback is made whose result
+ * stayed the same for unchanged runs: doubled after each run from the second
+ * on, up to adaptive_period_max */
+double adaptive_period(double period, uint8_t unchanged, double max) {
+  if (max <= 0 || unchanged < 2) { return period; }
+  double base = std::max(period, active_update_interval());
+  if (base >= max) { return period; }
+  return std::min(std::ldexp(base, std::min<int>(unchanged - 1, 30)), max);
+}
 }  // namespace
 
 namespace priv {
@@ -83,10 +145,39 @@ inline bool callback_base::is_equal(const handle &a, const handle &b) {
 void callback_base::merge(callback_base &&other) {
   if (other.period < period) {
     period = other.period;
-    remaining = 0;
+    expire();
   }
   assert(wait == other.wait);
+  on_demand = on_demand && other.on_demand;
   unused = 0;
+  wanted_update = updates;
+}
+
+/* puts the callback into the slot of the tick it is due in, or of the next
+ * tick run_all_callbacks() looks at if that has passed already */
+void callback_base::schedule() {
+  unschedule();
+  if (wheel_tick < 0) { wheel_tick = to_tick(get_time()) - 1; }
+  int64_t tick = std::max(to_tick(due), wheel_tick + 1);
+  callback_base *&head = wheel[tick % WHEEL_SLOTS];
+  wheel_next = head;
+  if (head != nullptr) { head->wheel_link = &wheel_next; }
+  head = this;
+  wheel_link = &head;
+}
+
+void callback_base::unschedule() {
+  if (wheel_link == nullptr) { return; }
+  *wheel_link = wheel_next;
+  if (wheel_next != nullptr) { wheel_next->wheel_link = wheel_link; }
+  wheel_next = nullptr;
+  wheel_link = nullptr;
+}
+
+void callback_base::expire() {
+  due = 0;
+  unchanged.store(0, std::memory_order_relaxed);
+  if (wheel_link != nullptr) { schedule(); }
 }
 
 /*
@@ -95,15 +186,29 @@ void callback_base::merge(callback_base &&other) {
 callback_base::handle callback_base::do_register_cb(const handle &h) {
   const auto &p = callbacks.insert(h);
 
-  /* insertion failed; callback already exists */
-  if (!p.second) { (*p.first)->merge(std::move(*h)); }
+  if (p.second) {
+    /* readers see what the constructor left in result until work() runs */
+    h->publish();
+    h->self = h;
+    h->wanted_update = updates;
+    h->schedule();
+  } else {
+    /* insertion failed; callback already exists */
+    (*p.first)->merge(std::move(*h));
+  }
 
   return *p.first;
 }
 
 void callback_base::run() {
+  assert(!is_pooled());
+
   if (thread == nullptr) {
-    thread = new std::thread(&callback_base::start_routine, this);
+    thread_qos qos = collector_thread_qos();
+    thread = new std::thread([this, qos] {
+      qos.apply();
+      start_routine();
+    });
   }
 
   sem_start.post();
@@ -120,41 +225,338 @@ void callback_base::start_routine() {
       // do nothing
     }
 
+    timed_work();
+    if (wait) { frame_done.arrive(); }
+  }
+}
+
+std::string callback_base::profile_name() {
+  int status;
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wpotentially-evaluated-expression"
+  const char *mangled = typeid(*this).name();
+#pragma clang diagnostic pop
+  char *demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+  std::string ret = status == 0 ? demangled : mangled;
+  free(demangled);
+  return ret;
+}
+
+void callback_base::timed_work() {
+  if (!timing) { timing.reset(new profile::callback_record(profile_name())); }
+  {
+    profile::scope s(*timing);
     work();
-    if (wait) { sem_wait.post(); }
   }
+  publish();
+  ++generation;
+}
+
+void callback_base::run_pooled() {
+  timed_work();
+  if (deadline > 0) {
+    {
+      std::lock_guard<std::mutex> lock(bounded_mutex);
+      queued = false;
+      late = false;
+    }
+    bounded_cv.notify_all();
+    return;
+  }
+  queued = false;
+  if (wait) { frame_done.arrive(); }
 }
 
 callback_base::Callbacks callback_base::callbacks(1, get_hash, is_equal);
+uint64_t callback_base::updates = 0;
+
+/*
+ * A fixed number of threads running work() of the pooled callbacks. Callbacks
+ * with wait=true go into the frame queue, which the workers always empty
+ * first. run_all_callbacks() also helps emptying it while waiting, so slow
+ * wait=false callbacks occupying all workers cannot stall a frame. Callbacks
+ * with a deadline go into the bounded queue, which is served next but never
+ * by run_all_callbacks(), as that would make it wait for them regardless.
+ * Callbacks with wait=false go into the background queue.
+ */
+class callback_pool {
+  typedef callback_base::handle handle;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<handle> frame_queue;
+  std::deque<handle> bounded_queue;
+  std::deque<handle> background_queue;
+  std::deque<std::function<void()>> tasks; /* see parallel_for() */
+  std::vector<std::thread> workers;
+  thread_qos workers_qos; /* what the workers were started with */
+  bool stopping;
+
+  // must be called with the mutex held and at least one queue non-empty
+  handle pop() {
+    std::deque<handle> &q = !frame_queue.empty()     ? frame_queue
+                            : !bounded_queue.empty() ? bounded_queue
+                                                     : background_queue;
+    handle h = std::move(q.front());
+    q.pop_front();
+    return h;
+  }
+
+  void worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      cv.wait(lock, [this] {
+        return stopping || !tasks.empty() || !frame_queue.empty() ||
+               !bounded_queue.empty() || !background_queue.empty();
+      });
+      if (stopping) { return; }
+
+      // tasks are parts of a callback that is already running, so they go
+      // first
+      if (!tasks.empty()) {
+        std::function<void()> task = std::move(tasks.front());
+        tasks.pop_front();
+        lock.unlock();
+        task();
+      } else {
+        // the pool may hold the last reference, so h must be destroyed
+        // without holding the lock
+        handle h = pop();
+        lock.unlock();
+        h->run_pooled();
+      }
+      lock.lock();
+    }
+  }
+
+  void stop_workers() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    cv.notify_all();
+    for (auto &w : workers) { w.join(); }
+    workers.clear();
+    stopping = false;
+  }
+
+ public:
+  callback_pool() : stopping(false) {}
+
+  ~callback_pool() {
+    stop_workers();
+    frame_queue.clear();
+    bounded_queue.clear();
+    background_queue.clear();
+    tasks.clear();
+  }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return workers.size();
+  }
+
+  void submit_task(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.push_back(std::move(task));
+    }
+    cv.notify_one();
+  }
+
+  void resize(size_t n, const thread_qos &qos) {
+    if (n == workers.size() && qos == workers_qos) { return; }
+
+    // queued callbacks stay queued and are picked up by the new workers
+    stop_workers();
+    workers_qos = qos;
+    workers.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+      workers.emplace_back([this, qos] {
+        qos.apply();
+        worker();
+      });
+    }
+  }
+
+  /*
+   * Queue a callback. Returns false if it is still queued or running since
+   * the last time, in which case it is not queued again.
+   */
+  bool submit(const handle &h) {
+    if (h->queued.exchange(true)) { return false; }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      (!h->wait             ? background_queue
+       : h->deadline > 0 ? bounded_queue
+                         : frame_queue)
+          .push_back(h);
+    }
+    cv.notify_one();
+    return true;
+  }
+
+  // run the callbacks from the frame queue in the calling thread
+  void help() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!frame_queue.empty()) {
+      {
+        handle h = std::move(frame_queue.front());
+        frame_queue.pop_front();
+        lock.unlock();
+        h->run_pooled();
+      }
+      lock.lock();
+    }
+  }
+};
+
+/* declared after the callbacks, so that it is destroyed before them */
+callback_pool pool;
 }  // namespace priv
 
+void parallel_for(size_t n, const std::function<void(size_t)> &fn) {
+  struct shared_state {
+    const std::function<void(size_t)> &fn;
+    const size_t n;
+    std::atomic<size_t> next;
+    size_t finished;
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    shared_state(const std::function<void(size_t)> &fn_, size_t n_)
+        : fn(fn_), n(n_), next(0), finished(0) {}
+
+    void run() {
+      size_t done = 0;
+      for (size_t i; (i = next++) < n; ++done) { fn(i); }
+      if (done == 0) { return; }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if ((finished += done) == n) { cv.notify_all(); }
+    }
+  };
+
+  if (n == 0) { return; }
+  size_t helpers = std::min(priv::pool.size(), n - 1);
+  if (helpers == 0) {
+    for (size_t i = 0; i < n; ++i) { fn(i); }
+    return;
+  }
+
+  // helpers may only get to run after all the work is done, so they must not
+  // outlive the state they share with us
+  auto state = std::make_shared<shared_state>(fn, n);
+  for (size_t i = 0; i < helpers; ++i) {
+    priv::pool.submit_task([state] { state->run(); });
+  }
+  // the caller works too, so this finishes even if every worker is busy
+  state->run();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->cv.wait(lock, [&state] { return state->finished == state->n; });
+}
+
+size_t callbacks_memory(size_t *count) {
+  using priv::callback_base;
+
+  size_t size = 0;
+  for (const auto &h : callback_base::callbacks) {
+    size += sizeof(callback_base) + h->memory();
+  }
+  *count = callback_base::callbacks.size();
+  return size;
+}
+
 void run_all_callbacks() {
   using priv::callback_base;
+  using priv::pool;
+
+  const auto start = std::chrono::steady_clock::now();
+  unsigned int threads = callback_threads.get(*state);
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  pool.resize(threads, collector_thread_qos());
 
-  size_t wait = 0;
-  for (auto i = callback_base::callbacks.begin();
-       i != callback_base::callbacks.end();) {
-    callback_base &cb = **i;
-
-    /* check whether enough update intervals have elapsed (up to period) */
-    if (cb.remaining-- == 0) {
-      /* run the callback as long as someone holds a pointer to it;
-       * if no one owns the callback, run it at most UNUSED_MAX times */
-      if (!i->unique() || ++cb.unused < UNUSED_MAX) {
-        cb.remaining = cb.period - 1;
-        cb.run();
-        if (cb.wait) { ++wait; }
+  const bool demand = collect_on_demand.get(*state);
+  const double adaptive_max = adaptive_period_max.get(*state);
+  const uint64_t update = ++callback_base::updates;
+  const double now = get_time();
+  /* run what falls due before the next update is half way */
+  const double horizon = now + active_update_interval() / 2;
+
+  std::vector<callback_base *> due;
+  int64_t tick = std::max(wheel_tick + 1, to_tick(horizon) - WHEEL_SLOTS + 1);
+  for (; tick <= to_tick(horizon); ++tick) {
+    for (callback_base *cb = wheel[tick % WHEEL_SLOTS]; cb != nullptr;
+         cb = cb->wheel_next) {
+      if (cb->due <= horizon) { due.push_back(cb); }
+    }
+  }
+  wheel_tick = to_tick(horizon);
+
+  std::vector<callback_base::handle> bounded;
+  for (callback_base *p : due) {
+    callback_base::handle h(p->self.lock());
+    callback_base &cb = *p;
+    /* callbacks and h */
+    const bool owned = h.use_count() > 2;
+
+    /* the objects reading the result are hidden (e.g. in an $if which is
+     * false), so leave it due until they are shown again */
+    uint64_t idle = update - cb.wanted_update;
+    if (demand && cb.on_demand && owned && idle > DEMAND_HYSTERESIS &&
+        idle % DEMAND_POLL != 0) {
+      cb.schedule();
+      continue;
+    }
+
+    /* run the callback as long as someone holds a pointer to it;
+     * if no one owns the callback, run it at most UNUSED_MAX times */
+    if (!owned && ++cb.unused >= UNUSED_MAX) {
+      cb.unschedule();
+      callback_base::callbacks.erase(h);
+      continue;
+    }
+    double period = cb.period;
+    if (cb.power_source != nullptr) {
+      double factor = power_period_factor(cb.power_source);
+      if (factor > 1) {
+        period = std::max(period, active_update_interval()) * factor;
       }
     }
-    if (cb.unused == UNUSED_MAX) {
-      auto t = i;
-      ++i;
-      callback_base::callbacks.erase(t);
-    } else {
-      ++i;
+    period = adaptive_period(
+        period, cb.unchanged.load(std::memory_order_relaxed), adaptive_max);
+    /* keep to the period unless the callback fell behind */
+    cb.due = cb.due + period > horizon ? cb.due + period : now + period;
+    cb.schedule();
+    /* counted before it runs, as it may finish right away */
+    const bool waited = cb.wait && !(cb.is_pooled() && cb.deadline > 0);
+    if (waited) { frame_done.add(); }
+    if (!cb.is_pooled()) {
+      cb.run();
+    } else if (pool.submit(h)) {
+      if (cb.wait && cb.deadline > 0) { bounded.push_back(h); }
+    } else if (waited) {
+      /* still queued or running from before, so it won't arrive */
+      frame_done.arrive();
     }
   }
 
-  while (wait-- > 0) { sem_wait.wait(); }
+  pool.help();
+  frame_done.wait(std::thread::hardware_concurrency() > 1 ? FRAME_SPIN : 0);
+
+  std::unique_lock<std::mutex> lock(bounded_mutex);
+  for (const auto &h : bounded) {
+    auto until = start + std::chrono::duration_cast<
+                             std::chrono::steady_clock::duration>(
+                             std::chrono::duration<double>(h->deadline));
+    if (!bounded_cv.wait_until(lock, until, [&h] { return !h->queued; }) &&
+        !h->late.exchange(true)) {
+      NORM_ERR("%s missed its deadline of %gs, using its last result",
+               h->profile_name().c_str(), h->deadline);
+    }
+  }
 }
 }  // namespace conky
@@ -23,17 +23,24 @@
 #ifndef UPDATE_CB_HH
 #define UPDATE_CB_HH
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <thread>
 // the following probably requires a is-gcc-4.7.0 check
+#include <functional>
 #include <mutex>
+#include <string>
 #include <tuple>
+#include <type_traits>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <assert.h>
 
 #include "c++wrap.hh"
+#include "profiling.hh"
 #include "semaphore.hh"
 
 namespace conky {
@@ -41,10 +48,21 @@ namespace conky {
 template <typename Callback>
 class callback_handle;
 void run_all_callbacks();
+
+/* Calls fn(0) ... fn(n - 1) from the callback pool and the calling thread
+ * and returns once all of them returned. For callbacks splitting their work();
+ * fn must be safe to call concurrently with itself. */
+void parallel_for(size_t n, const std::function<void(size_t)> &fn);
 template <typename Callback, typename... Params>
-callback_handle<Callback> register_cb(uint32_t period, Params &&...params);
+callback_handle<Callback> register_cb(double period, Params &&...params);
+
+/* the memory held by the registered callbacks and their results, for
+ * ${conky_mem}; count is set to the number of callbacks */
+size_t callbacks_memory(size_t *count);
 
 namespace priv {
+class callback_pool;
+
 class callback_base {
   typedef callback_handle<callback_base> handle;
   typedef std::unordered_set<handle, size_t (*)(const handle &),
@@ -52,23 +70,46 @@ class callback_base {
       Callbacks;
 
   semaphore sem_start;
-  std::thread *thread;
+  std::thread *thread; /* only used by callbacks which have a pipe */
   const size_t hash; /* used to determined callback uniqueness */
-  uint32_t period;   /* how often to run a callback */
-  uint32_t
-      remaining; /* update intervals remaining until we can run a callback */
+  double period;     /* seconds between two runs, 0 runs it every update */
+  double due;        /* get_time() of the next run, see schedule() */
+  /* the next and the link to this one in its slot of the timer wheel, the
+   * latter is null while the callback isn't in it */
+  callback_base *wheel_next;
+  callback_base **wheel_link;
+  std::weak_ptr<callback_base> self; /* the handle in callbacks */
   std::pair<int, int> pipefd;
   const bool wait; /* whether or not to wait for a callback to finish */
   bool done;       /* if true, callback is being stopped and destroyed */
   uint8_t unused;  /* number of update intervals during which no one owns a
                       callback */
+  std::atomic<bool> queued; /* true while waiting for or running in the pool */
+  double deadline; /* see set_deadline(), 0 if there is none */
+  std::atomic<bool> late; /* missed the deadline, work() is still running */
+  bool on_demand;         /* see set_on_demand() */
+  const char *power_source; /* see set_power_source() */
+  uint64_t wanted_update; /* the value of updates at the last wanted() */
+  /* runs in a row whose result was the same as the one before, see
+   * note_result() */
+  std::atomic<uint8_t> unchanged;
+  std::unique_ptr<profile::callback_record> timing; /* created on first run */
 
   callback_base(const callback_base &) = delete;
   callback_base &operator=(const callback_base &) = delete;
 
   virtual bool operator==(const callback_base &) = 0;
 
+  /* callbacks with a pipe may block indefinitely in work() (e.g. IMAP IDLE)
+   * and are woken up through it, so they keep a thread of their own. The rest
+   * are run by the callback pool. */
+  bool is_pooled() const { return pipefd.first < 0; }
+
+  void schedule();
+  void unschedule();
   void run();
+  void run_pooled();
+  void timed_work();
   void start_routine();
   void stop();
 
@@ -80,6 +121,9 @@ class callback_base {
   // a list of registered callbacks
   static Callbacks callbacks;
 
+  // how many times run_all_callbacks() ran
+  static uint64_t updates;
+
   // used by the callbacks list
   static inline size_t get_hash(const handle &h);
   static inline bool is_equal(const handle &a, const handle &b);
@@ -87,29 +131,59 @@ class callback_base {
   static handle do_register_cb(const handle &h);
 
   template <typename Callback, typename... Params>
-  friend callback_handle<Callback> conky::register_cb(uint32_t period,
+  friend callback_handle<Callback> conky::register_cb(double period,
                                                       Params &&...params);
 
   friend void conky::run_all_callbacks();
+  friend size_t conky::callbacks_memory(size_t *count);
+
+  friend class callback_pool;
 
   template <typename Callback>
   friend class conky::callback_handle;
 
  protected:
-  callback_base(size_t hash_, uint32_t period_, bool wait_, bool use_pipe)
+  callback_base(size_t hash_, double period_, bool wait_, bool use_pipe)
       : thread(nullptr),
         hash(hash_),
         period(period_),
-        remaining(0),
+        due(0),
+        wheel_next(nullptr),
+        wheel_link(nullptr),
         pipefd(use_pipe ? pipe2(O_CLOEXEC) : std::pair<int, int>(-1, -1)),
         wait(wait_),
         done(false),
-        unused(0) {}
+        unused(0),
+        queued(false),
+        deadline(0),
+        late(false),
+        on_demand(false),
+        power_source(nullptr),
+        wanted_update(0),
+        unchanged(0),
+        generation(0) {}
 
   int donefd() { return pipefd.first; }
 
   bool is_done() { return done; }
 
+  /* Wait at most this many seconds for work() in run_all_callbacks(), for
+   * pooled callbacks with wait=true. A callback taking longer is marked
+   * stale, keeps its previous result and finishes in the background, so one
+   * hanging device can't hold up the frame. It is not run again before it
+   * finished. */
+  void set_deadline(double seconds) { deadline = seconds; }
+
+  /* Only run while someone reads the result, i.e. calls wanted() every
+   * update. A callback nobody wanted for a few updates is run only now and
+   * then, until it is wanted again. Callbacks merged with one which isn't
+   * on demand aren't either. */
+  void set_on_demand(bool value) { on_demand = value; }
+
+  /* The kind of source the callback reads, as named in battery_sources.
+   * Their periods are stretched on battery, see power_period_factor(). */
+  void set_power_source(const char *name) { power_source = name; }
+
   // to be implemented by descendant classes
   virtual void work() = 0;
 
@@ -117,9 +191,49 @@ class callback_base {
   // afterwards
   virtual void merge(callback_base &&);
 
+  // how the callback is called in ${conky_profile callbacks}, defaults to the
+  // name of the class
+  virtual std::string profile_name();
+
+  // called on the worker thread after each work(), and once when the callback
+  // is registered
+  virtual void publish() {}
+
+  /* whether the result publish() took differs from the last one; the
+   * period of callbacks whose result stays the same grows while it does, up
+   * to adaptive_period_max; worker thread only */
+  void note_result(bool changed) {
+    uint8_t runs = unchanged.load(std::memory_order_relaxed);
+    if (changed) {
+      unchanged.store(0, std::memory_order_relaxed);
+    } else if (runs < UINT8_MAX) {
+      unchanged.store(runs + 1, std::memory_order_relaxed);
+    }
+  }
+
+  // the memory the callback holds beyond the object itself, mostly in its
+  // result; main thread only
+  virtual size_t memory() { return 0; }
+
  public:
   std::mutex result_mutex;
 
+  /* incremented each time work() returns, so users of the result can tell
+   * whether it may have changed since they last looked */
+  std::atomic<uint64_t> generation;
+
+  /* run at the next update instead of waiting out the period, e.g. because
+   * what the callback reads has changed, and from then on at its own period
+   * again; main thread only */
+  void expire();
+
+  /* the result is going to be read, see set_on_demand(); main thread only */
+  void wanted() { wanted_update = updates; }
+
+  /* whether work() missed its deadline and is still running, so the result
+   * is older than it should be */
+  bool is_stale() const { return late; }
+
   virtual ~callback_base();
 };
 
@@ -138,13 +252,14 @@ class callback_handle : private std::shared_ptr<Callback> {
   using Base::operator*;
 
   friend void conky::run_all_callbacks();
+  friend class priv::callback_base;
   template <typename Callback_, typename... Params>
-  friend callback_handle<Callback_> register_cb(uint32_t period,
+  friend callback_handle<Callback_> register_cb(double period,
                                                 Params &&...params);
 };
 
 template <typename Callback, typename... Params>
-callback_handle<Callback> register_cb(uint32_t period, Params &&...params) {
+callback_handle<Callback> register_cb(double period, Params &&...params) {
   return std::dynamic_pointer_cast<Callback>(
       priv::callback_base::do_register_cb(priv::callback_base::handle(
           new Callback(period, std::forward<Params>(params)...))));
@@ -169,6 +284,103 @@ template <typename... Elements>
 struct hash_tuple<0, Elements...> {
   static inline size_t hash(const std::tuple<Elements...> &) { return 0; }
 };
+
+/*
+ * What a result owns on the heap, as far as can be seen from its type. Types
+ * it can't see into count as nothing; callbacks with such results can add
+ * what they know by overriding memory().
+ */
+template <typename T>
+inline size_t heap_size(const T &);
+template <typename T>
+inline size_t heap_size(const std::vector<T> &v);
+template <typename T>
+inline size_t heap_size(const std::shared_ptr<T> &p);
+
+inline size_t heap_size(const std::string &s) {
+  /* short strings are kept within the object */
+  return s.capacity() < sizeof(std::string) ? 0 : s.capacity() + 1;
+}
+
+template <typename T>
+inline size_t heap_size(const T &) {
+  return 0;
+}
+
+template <typename T>
+inline size_t heap_size(const std::vector<T> &v) {
+  size_t size = v.capacity() * sizeof(T);
+  for (const auto &e : v) { size += heap_size(e); }
+  return size;
+}
+
+template <typename T>
+inline size_t heap_size(const std::shared_ptr<T> &p) {
+  return p ? sizeof(T) + heap_size(*p) : 0;
+}
+
+/*
+ * Describes a callback for profiling by its first key, if that is a string
+ * (e.g. the command of exec callbacks or the url of curl callbacks).
+ */
+inline std::string describe_key(const std::string &key) { return key; }
+
+template <typename Key>
+inline std::string describe_key(const Key &) {
+  return std::string();
+}
+
+/*
+ * Whether a result is the same as the last one, for note_result(). Results
+ * which can't be compared (e.g. legacy callbacks' void *, which stands for
+ * what they write elsewhere) always count as changed.
+ */
+template <typename T, typename = void>
+struct has_equal : std::false_type {};
+
+template <typename T>
+struct has_equal<T, decltype(void(std::declval<const T &>() ==
+                                  std::declval<const T &>()))>
+    : std::integral_constant<bool, !std::is_pointer<T>::value> {};
+
+template <typename T>
+inline typename std::enable_if<has_equal<T>::value, bool>::type same_result(
+    const T &a, const T &b) {
+  return a == b;
+}
+
+template <typename T>
+inline typename std::enable_if<!has_equal<T>::value, bool>::type same_result(
+    const T &, const T &) {
+  return false;
+}
+
+template <typename A, typename B>
+inline bool same_result(const std::pair<A, B> &a, const std::pair<A, B> &b) {
+  return same_result(a.first, b.first) && same_result(a.second, b.second);
+}
+
+/* std::vector has an operator== whatever its elements are */
+template <typename T>
+inline bool same_result(const std::vector<T> &a, const std::vector<T> &b) {
+  if (a.size() != b.size()) { return false; }
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (!same_result(a[i], b[i])) { return false; }
+  }
+  return true;
+}
+
+template <typename Tuple, bool empty = std::tuple_size<Tuple>::value == 0>
+struct describe_tuple {
+  static inline std::string describe(const Tuple &tuple) {
+    return describe_key(std::get<0>(tuple));
+  }
+};
+
+template <typename Tuple>
+struct describe_tuple<Tuple, true> {
+  static inline std::string describe(const Tuple &) { return std::string(); }
+};
 }  // namespace priv
 
 /*
@@ -185,6 +397,13 @@ struct hash_tuple<0, Elements...> {
  * get_result_copy() returns a copy of the result object and it handles the
  * necessary locking. Don't call it if you hold a lock on the result_mutex.
  *
+ * read_result() returns the result as of the last time work() returned
+ * without locking or copying anything, which is what print functions should
+ * use. After every work() the result is copied into a triple buffer: the
+ * worker fills a slot of its own and swaps it in atomically, the reader swaps
+ * it out again when it is newer than the one it holds. This relies on a
+ * single reader, so read_result() must only be called from the main thread.
+ *
  * You should implement the work() function to do the actual updating and store
  * the result in the result variable (lock the mutex while you are doing it,
  * especially if you have wait=false).
@@ -198,7 +417,10 @@ struct hash_tuple<0, Elements...> {
  * Callbacks are registered with the register_cb() function. You pass the class
  * name as the template parameter, and any additional parameters to the
  * constructor as function parameters. The period parameter specifies how often
- * the callback will run. It should be left for the user to decide that.
+ * the callback will run, in seconds, with 0 meaning at every update. It
+ * should be left for the user to decide that. A callback runs at the update
+ * closest to when it is due, so periods shorter than update_interval run it at
+ * every update, and it doesn't shift if update_interval changes.
  * register_cb() returns a pointer to the newly created object. As long as
  * someone holds a pointer to the object, the callback will be run.
  *
@@ -206,6 +428,10 @@ struct hash_tuple<0, Elements...> {
  * periodicity). It should be called from somewhere inside the main loop,
  * according to the update_interval setting. It waits for the callbacks which
  * have wait=true. It leaves the rest to run in background.
+ *
+ * Unless a callback uses a pipe, its work() is run by a fixed pool of
+ * callback_threads worker threads, so work() may be called from a different
+ * thread each time, but never concurrently with itself.
  */
 template <typename Result, typename... Keys>
 class callback : public priv::callback_base {
@@ -227,8 +453,52 @@ class callback : public priv::callback_base {
     return std::get<i>(tuple);
   }
 
+  virtual std::string profile_name() {
+    std::string key = priv::describe_tuple<Tuple>::describe(tuple);
+    std::string name = callback_base::profile_name();
+    return key.empty() ? name : name + " " + key;
+  }
+
+  /* the result and the reader's slot; the other two slots hold copies of
+   * earlier results, which are left out rather than guessed at */
+  virtual size_t memory() {
+    size_t size = priv::heap_size(slots[front]);
+    std::lock_guard<std::mutex> l(result_mutex);
+    return size + priv::heap_size(result);
+  }
+
+  /* hands what is in result to the readers before work() returns, for
+   * piped callbacks whose work() keeps waiting for a server to report
+   * changes; worker thread only, without holding result_mutex */
+  void publish_now() {
+    publish();
+    ++generation;
+  }
+
+ private:
+  /* or'ed into shared until the reader has taken the slot in it */
+  static const uint8_t fresh = 4;
+
+  /* indices of the triple buffer: the slot the reader uses, the one being
+   * handed over and the one the worker fills next */
+  Result slots[3];
+  uint8_t front = 0;
+  std::atomic<uint8_t> shared{1};
+  uint8_t back = 2;
+  /* the slot published last, which only publish() writes to once it got it
+   * back as the one to fill next, so it can read it meanwhile */
+  uint8_t published = 1;
+
+  virtual void publish() {
+    /* work() is done with result, and only ever runs on one thread at once */
+    note_result(!priv::same_result(slots[published], result));
+    slots[back] = result;
+    published = back;
+    back = shared.exchange(back | fresh, std::memory_order_acq_rel) & ~fresh;
+  }
+
  public:
-  callback(uint32_t period_, bool wait_, const Tuple &tuple_,
+  callback(double period_, bool wait_, const Tuple &tuple_,
            bool use_pipe = false)
       : callback_base(priv::hash_tuple<sizeof...(Keys), Keys...>::hash(tuple_),
                       period_, wait_, use_pipe),
@@ -240,6 +510,13 @@ class callback : public priv::callback_base {
     std::lock_guard<std::mutex> l(result_mutex);
     return result;
   }
+
+  const Result &read_result() {
+    if ((shared.load(std::memory_order_relaxed) & fresh) != 0) {
+      front = shared.exchange(front, std::memory_order_acq_rel) & ~fresh;
+    }
+    return slots[front];
+  }
 };
 }  // namespace conky
 
@@ -40,9 +40,9 @@ void print_uid_name(struct text_object *obj, char *p, unsigned int p_max_size) {
   struct passwd *pw;
   uid_t uid;
   char *firstinvalid;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   errno = 0;
   uid = strtol(objbuf.get(), &firstinvalid, 10);
@@ -62,9 +62,9 @@ void print_gid_name(struct text_object *obj, char *p, unsigned int p_max_size) {
   struct group *grp;
   gid_t gid;
   char *firstinvalid;
-  std::unique_ptr<char[]> objbuf(new char[max_user_text.get(*state)]);
+  conky::scratch_text objbuf(max_user_text.get(*state));
 
-  generate_text_internal(objbuf.get(), max_user_text.get(*state), *obj->sub);
+  generate_text_internal(objbuf.get(), objbuf.size(), *obj->sub);
 
   errno = 0;
   gid = strtol(objbuf.get(), &firstinvalid, 10);
@@ -27,160 +27,141 @@
  *
  */
 
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 #include <utmp.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "conky.h"
 
 #define BUFLEN 512
 
-static void user_name(char *ptr) {
-  const struct utmp *usr = 0;
+/* The logged in users, as of the last time utmp changed. It is parsed once
+ * for every ${user_*} and only again when its modification time changes. */
+struct utmp_user {
+  std::string name;
+  std::string line;
+  time_t log_in;
+};
+
+static std::vector<utmp_user> utmp_users;
+/* when each terminal was logged into, for ${user_time}; like getutline(), the
+ * first login or user process on a line counts */
+static std::unordered_map<std::string, time_t> utmp_lines;
+static struct timespec utmp_mtime = {-1, 0};
+static ino_t utmp_ino = 0;
+
+/* Re-reads utmp if it changed since the last time, returns whether it did. */
+static bool read_utmp() {
+  struct stat st;
+
+  if (stat(_PATH_UTMP, &st) == 0) {
+    if (st.st_mtim.tv_sec == utmp_mtime.tv_sec &&
+        st.st_mtim.tv_nsec == utmp_mtime.tv_nsec && st.st_ino == utmp_ino) {
+      return false;
+    }
+    utmp_mtime = st.st_mtim;
+    utmp_ino = st.st_ino;
+  } else {
+    /* can't tell whether it changed, so read it every time */
+    utmp_mtime.tv_sec = -1;
+  }
+
+  utmp_users.clear();
+  utmp_lines.clear();
 
+  const struct utmp *usr;
   setutent();
   while ((usr = getutent()) != nullptr) {
+    if (usr->ut_type != USER_PROCESS && usr->ut_type != LOGIN_PROCESS) {
+      continue;
+    }
+    std::string line(usr->ut_line, strnlen(usr->ut_line, UT_LINESIZE));
+    utmp_lines.emplace(line, usr->ut_time);
     if (usr->ut_type == USER_PROCESS) {
-      if (strlen(ptr) + strnlen(usr->ut_name, UT_NAMESIZE - 1) + 1 <= BUFLEN) {
-        strncat(ptr, usr->ut_name, UT_NAMESIZE);
-      }
+      utmp_users.push_back(
+          {std::string(usr->ut_name, strnlen(usr->ut_name, UT_NAMESIZE - 1)),
+           std::move(line), usr->ut_time});
     }
   }
+  endutent();
+  return true;
 }
-static void user_num(int *ptr) {
-  const struct utmp *usr;
-  int users_num = 0;
 
-  setutent();
-  while ((usr = getutent()) != nullptr) {
-    if (usr->ut_type == USER_PROCESS) { ++users_num; }
+static void user_name(char *ptr) {
+  for (const utmp_user &usr : utmp_users) {
+    if (strlen(ptr) + usr.name.size() + 1 <= BUFLEN) {
+      strncat(ptr, usr.name.c_str(), UT_NAMESIZE);
+    }
   }
-  *ptr = users_num;
 }
 static void user_term(char *ptr) {
-  const struct utmp *usr;
-
-  setutent();
-  while ((usr = getutent()) != nullptr) {
-    if (usr->ut_type == USER_PROCESS) {
-      if (strlen(ptr) + strnlen(usr->ut_line, UT_LINESIZE) + 1 <= BUFLEN) {
-        strncat(ptr, usr->ut_line, UT_LINESIZE);
-      }
+  for (const utmp_user &usr : utmp_users) {
+    if (strlen(ptr) + usr.line.size() + 1 <= BUFLEN) {
+      strncat(ptr, usr.line.c_str(), UT_LINESIZE);
     }
   }
 }
 static void user_time(char *ptr) {
-  const struct utmp *usr;
-  time_t log_in, real, diff;
+  time_t real, diff;
   char buf[BUFLEN] = "";
 
-  setutent();
-  while ((usr = getutent()) != nullptr) {
-    if (usr->ut_type == USER_PROCESS) {
-      log_in = usr->ut_time;
-      time(&real);
-      diff = difftime(real, log_in);
-      format_seconds(buf, BUFLEN, diff);
-      if (strlen(ptr) + strlen(buf) + 1 <= BUFLEN) {
-        strncat(ptr, buf, BUFLEN - strlen(ptr) - 1);
-      }
+  time(&real);
+  for (const utmp_user &usr : utmp_users) {
+    diff = difftime(real, usr.log_in);
+    format_seconds(buf, BUFLEN, diff);
+    if (strlen(ptr) + strlen(buf) + 1 <= BUFLEN) {
+      strncat(ptr, buf, BUFLEN - strlen(ptr) - 1);
     }
   }
 }
-static void tty_user_time(char *ptr, char *tty) {
-  time_t real, diff, log_in;
+static void tty_user_time(char *ptr, const char *tty) {
+  time_t real, diff;
   char buf[BUFLEN] = "";
 
-  struct utmp *usr, line;
-
-  setutent();
-  strncpy(line.ut_line, tty, UT_LINESIZE);
-  usr = getutline(&line);
-  if (usr == nullptr) { return; }
-
-  log_in = usr->ut_time;
+  auto it = utmp_lines.find(std::string(tty, strnlen(tty, UT_LINESIZE)));
+  if (it == utmp_lines.end()) { return; }
 
   time(&real);
-  diff = difftime(real, log_in);
+  diff = difftime(real, it->second);
   format_seconds(buf, BUFLEN, diff);
   strncpy(ptr, buf, BUFLEN - 1);
 }
 
-static void users_alloc(struct information *ptr) {
-  if (ptr->users.names == nullptr) {
-    ptr->users.names = (char *)malloc(text_buffer_size.get(*state));
-  }
-  if (ptr->users.terms == nullptr) {
-    ptr->users.terms = (char *)malloc(text_buffer_size.get(*state));
-  }
-  if (ptr->users.times == nullptr) {
-    ptr->users.times = (char *)malloc(text_buffer_size.get(*state));
+/* Puts value, or "broken" if it is empty, in *ptr. */
+static void set_users_string(char **ptr, const char *value) {
+  if (*ptr == nullptr) {
+    *ptr = static_cast<char *>(malloc(text_buffer_size.get(*state)));
   }
+  strncpy(*ptr, *value != 0 ? value : "broken", text_buffer_size.get(*state));
 }
 
 static void update_user_time(char *tty) {
-  struct information *current_info = &info;
   char temp[BUFLEN] = "";
 
-  if (current_info->users.ctime == nullptr) {
-    current_info->users.ctime = (char *)malloc(text_buffer_size.get(*state));
-  }
-
   tty_user_time(temp, tty);
-
-  if (*temp != 0) {
-    free_and_zero(current_info->users.ctime);
-    current_info->users.ctime = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.ctime, temp, text_buffer_size.get(*state));
-  } else {
-    free_and_zero(current_info->users.ctime);
-    current_info->users.ctime = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.ctime, "broken", text_buffer_size.get(*state));
-  }
+  set_users_string(&info.users.ctime, temp);
 }
 
 int update_users(void) {
   struct information *current_info = &info;
   char temp[BUFLEN] = "";
-  int t;
-  users_alloc(current_info);
-  user_name(temp);
-  if (*temp != 0) {
-    free_and_zero(current_info->users.names);
-    current_info->users.names = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.names, temp, text_buffer_size.get(*state));
-  } else {
-    free_and_zero(current_info->users.names);
-    current_info->users.names = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.names, "broken", text_buffer_size.get(*state));
-  }
-  user_num(&t);
-  if (t != 0) {
-    if (current_info->users.number) { current_info->users.number = 0; }
-    current_info->users.number = t;
-  } else {
-    current_info->users.number = 0;
+
+  if (read_utmp() || current_info->users.names == nullptr ||
+      current_info->users.terms == nullptr) {
+    user_name(temp);
+    set_users_string(&current_info->users.names, temp);
+    current_info->users.number = utmp_users.size();
+    temp[0] = 0;
+    user_term(temp);
+    set_users_string(&current_info->users.terms, temp);
   }
+  /* the times change with every update */
   temp[0] = 0;
-  user_term(temp);
-  if (*temp != 0) {
-    free_and_zero(current_info->users.terms);
-    current_info->users.terms = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.terms, temp, text_buffer_size.get(*state));
-  } else {
-    free_and_zero(current_info->users.terms);
-    current_info->users.terms = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.terms, "broken", text_buffer_size.get(*state));
-  }
   user_time(temp);
-  if (*temp != 0) {
-    free_and_zero(current_info->users.times);
-    current_info->users.times = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.times, temp, text_buffer_size.get(*state));
-  } else {
-    free_and_zero(current_info->users.times);
-    current_info->users.times = (char *)malloc(text_buffer_size.get(*state));
-    strncpy(current_info->users.times, "broken", text_buffer_size.get(*state));
-  }
+  set_users_string(&current_info->users.times, temp);
   return 0;
 }
 
@@ -31,6 +31,10 @@
 #include "config.h"
 #include "conky.h"
 #include "logging.h"
+#include "reactor.hh"
+
+#include <string>
+#include <vector>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wvariadic-macros"
@@ -54,6 +58,9 @@
 #ifdef BUILD_XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif
+#ifdef BUILD_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* BUILD_XRANDR */
 #ifdef BUILD_XSHAPE
 #include <X11/extensions/shape.h>
 #endif /* BUILD_XSHAPE */
@@ -71,6 +78,25 @@ int screen;
 /* workarea from _NET_WORKAREA, this is where window / text is aligned */
 int workarea[4];
 
+/*
+ * The Xinerama heads, asked for once and again only after the screen
+ * changed: for RRScreenChangeNotify (or a resized root window without
+ * XRandR) and when the window manager changes _NET_WORKAREA. They are kept
+ * over a reload, which reconnects, as long as the display and its size
+ * stay the same.
+ */
+struct screen_head {
+  int x, y, width, height;
+};
+static std::vector<screen_head> heads;
+static bool heads_valid = false;
+static std::string heads_display;
+static int heads_width, heads_height;
+
+#ifdef BUILD_XRANDR
+static int randr_event_base = -1;
+#endif /* BUILD_XRANDR */
+
 /* Window stuff */
 struct conky_window window;
 char window_created = 0;
@@ -423,32 +449,51 @@ static void init_X11() {
 
   get_x11_desktop_info(display, 0);
 
+#ifdef BUILD_XRANDR
+  int randr_error_base;
+  if (XRRQueryExtension(display, &randr_event_base, &randr_error_base) != 0) {
+    XRRSelectInput(display, RootWindow(display, screen),
+                   RRScreenChangeNotifyMask);
+  } else {
+    randr_event_base = -1;
+  }
+#endif /* BUILD_XRANDR */
+
+  if (heads_display != DisplayString(display) ||
+      heads_width != display_width || heads_height != display_height) {
+    heads_valid = false;
+  }
   update_workarea();
 
   /* WARNING, this type not in Xlib spec */
   XSetErrorHandler(&x11_error_handler);
   XSetIOErrorHandler(&x11_ioerror_handler);
 
+  /* X events wake the main loop; XPending() picks them up */
+  conky::main_reactor().add(ConnectionNumber(display), [] {});
+
   DBGP("leave init_X11()");
 }
 
 static void deinit_X11() {
   if (display) {
     DBGP("deinit_X11()");
+    conky::main_reactor().remove(ConnectionNumber(display));
+    clear_x11_color_cache();
     XCloseDisplay(display);
     display = nullptr;
   }
 }
 
-static void update_workarea() {
-  /* default work area is display */
-  workarea[0] = 0;
-  workarea[1] = 0;
-  workarea[2] = display_width;
-  workarea[3] = display_height;
+/* asks X for the heads, without Xinerama there are none */
+static void query_heads() {
+  heads_valid = true;
+  heads_display = DisplayString(display);
+  heads_width = display_width;
+  heads_height = display_height;
+  heads.clear();
 
 #ifdef BUILD_XINERAMA
-  /* if xinerama is being used, adjust workarea to the head's area */
   int useless1, useless2;
   if (XineramaQueryExtension(display, &useless1, &useless2) == 0) {
     return; /* doesn't even have xinerama */
@@ -458,33 +503,75 @@ static void update_workarea() {
     return; /* has xinerama but isn't using it */
   }
 
-  int heads = 0;
-  XineramaScreenInfo *si = XineramaQueryScreens(display, &heads);
+  int count = 0;
+  XineramaScreenInfo *si = XineramaQueryScreens(display, &count);
   if (si == nullptr) {
     NORM_ERR(
         "warning: XineramaQueryScreen returned nullptr, ignoring head "
         "settings");
     return; /* queryscreens failed? */
   }
+  for (int i = 0; i < count; ++i) {
+    heads.push_back(
+        screen_head{si[i].x_org, si[i].y_org, si[i].width, si[i].height});
+  }
+  XFree(si);
+#endif /* BUILD_XINERAMA */
+}
+
+/* sets the workarea to the head selected by xinerama_head, from the cached
+ * heads unless the screen changed since they were asked for */
+static void update_workarea() {
+  if (!heads_valid) { query_heads(); }
+
+  /* default work area is display */
+  workarea[0] = 0;
+  workarea[1] = 0;
+  workarea[2] = display_width;
+  workarea[3] = display_height;
+
+  if (heads.empty()) { return; }
 
   int i = head_index.get(*state);
-  if (i < 0 || i >= heads) {
+  if (i < 0 || i >= static_cast<int>(heads.size())) {
     NORM_ERR("warning: invalid head index, ignoring head settings");
     return;
   }
 
-  XineramaScreenInfo *ps = &si[i];
-  workarea[0] = ps->x_org;
-  workarea[1] = ps->y_org;
-  workarea[2] = workarea[0] + ps->width;
-  workarea[3] = workarea[1] + ps->height;
-  XFree(si);
+  const screen_head &h = heads[i];
+  workarea[0] = h.x;
+  workarea[1] = h.y;
+  workarea[2] = h.x + h.width;
+  workarea[3] = h.y + h.height;
 
   DBGP("Fixed xinerama area to: %d %d %d %d", workarea[0], workarea[1],
        workarea[2], workarea[3]);
-#endif
 }
 
+bool x11_screen_changed(const XEvent &ev) {
+#ifdef BUILD_XRANDR
+  if (randr_event_base >= 0 &&
+      ev.type == randr_event_base + RRScreenChangeNotify) {
+    /* keeps DisplayWidth() and DisplayHeight() up to date */
+    XRRUpdateConfiguration(const_cast<XEvent *>(&ev));
+    display_width = DisplayWidth(display, screen);
+    display_height = DisplayHeight(display, screen);
+    heads_valid = false;
+    return true;
+  }
+#endif /* BUILD_XRANDR */
+  if (ev.type == ConfigureNotify &&
+      ev.xconfigure.window == RootWindow(display, screen)) {
+    display_width = ev.xconfigure.width;
+    display_height = ev.xconfigure.height;
+    heads_valid = false;
+    return true;
+  }
+  return false;
+}
+
+void x11_screen_update() { update_workarea(); }
+
 /* Find root window and desktop window.
  * Return desktop window on success,
  * and set root and desktop byref return values.
@@ -561,10 +648,13 @@ static Window find_desktop_window(Window *p_root, Window *p_desktop) {
 
 #ifdef OWN_WINDOW
 namespace {
+unsigned long background_pixel(int argb) {
+  return background_colour.get(*state) | (argb << 24);
+}
+
 /* helper function for set_transparent_background() */
 void do_set_background(Window win, int argb) {
-  unsigned long colour = background_colour.get(*state) | (argb << 24);
-  XSetWindowBackground(display, win, colour);
+  XSetWindowBackground(display, win, background_pixel(argb));
 }
 }  // namespace
 
@@ -989,6 +1079,7 @@ static void init_window(lua::state &l __attribute__((unused)), bool own) {
                ExposureMask | PropertyChangeMask
 #ifdef OWN_WINDOW
                    | (own_window.get(l) ? (StructureNotifyMask |
+                                           VisibilityChangeMask |
                                            ButtonPressMask | ButtonReleaseMask)
                                         : 0)
 #endif
@@ -1037,50 +1128,47 @@ void create_gc() {
                         GCFunction | GCGraphicsExposures, &values);
 }
 
-// Get current desktop number
-static inline void get_x11_desktop_current(Display *current_display,
-                                           Window root, Atom atom) {
+/* Reads a single CARDINAL property of the root window into value. Returns
+ * whether it was there and differs from what value held. */
+static bool get_x11_root_cardinal(Display *current_display, Window root,
+                                  Atom atom, int offset, int &value) {
   Atom actual_type;
   int actual_format;
   unsigned long nitems;
   unsigned long bytes_after;
   unsigned char *prop = nullptr;
-  struct information *current_info = &info;
+  bool changed = false;
 
-  if (atom == None) { return; }
+  if (atom == None) { return false; }
 
   if ((XGetWindowProperty(current_display, root, atom, 0, 1L, False,
                           XA_CARDINAL, &actual_type, &actual_format, &nitems,
                           &bytes_after, &prop) == Success) &&
       (actual_type == XA_CARDINAL) && (nitems == 1L) && (actual_format == 32)) {
-    current_info->x11.desktop.current = prop[0] + 1;
+    int v = *reinterpret_cast<long *>(prop) + offset;
+    changed = v != value;
+    value = v;
   }
   if (prop != nullptr) { XFree(prop); }
+  return changed;
 }
 
-// Get total number of available desktops
-static inline void get_x11_desktop_number(Display *current_display, Window root,
-                                          Atom atom) {
-  Atom actual_type;
-  int actual_format;
-  unsigned long nitems;
-  unsigned long bytes_after;
-  unsigned char *prop = nullptr;
-  struct information *current_info = &info;
-
-  if (atom == None) { return; }
+// Get current desktop number
+static inline bool get_x11_desktop_current(Display *current_display,
+                                           Window root, Atom atom) {
+  return get_x11_root_cardinal(current_display, root, atom, 1,
+                               info.x11.desktop.current);
+}
 
-  if ((XGetWindowProperty(current_display, root, atom, 0, 1L, False,
-                          XA_CARDINAL, &actual_type, &actual_format, &nitems,
-                          &bytes_after, &prop) == Success) &&
-      (actual_type == XA_CARDINAL) && (nitems == 1L) && (actual_format == 32)) {
-    current_info->x11.desktop.number = prop[0];
-  }
-  if (prop != nullptr) { XFree(prop); }
+// Get total number of available desktops
+static inline bool get_x11_desktop_number(Display *current_display,
+                                          Window root, Atom atom) {
+  return get_x11_root_cardinal(current_display, root, atom, 0,
+                               info.x11.desktop.number);
 }
 
 // Get all desktop names
-static inline void get_x11_desktop_names(Display *current_display, Window root,
+static inline bool get_x11_desktop_names(Display *current_display, Window root,
                                          Atom atom) {
   Atom actual_type;
   int actual_format;
@@ -1088,18 +1176,22 @@ static inline void get_x11_desktop_names(Display *current_display, Window root,
   unsigned long bytes_after;
   unsigned char *prop = nullptr;
   struct information *current_info = &info;
+  bool changed = false;
 
-  if (atom == None) { return; }
+  if (atom == None) { return false; }
 
   if ((XGetWindowProperty(current_display, root, atom, 0, (~0L), False,
                           ATOM(UTF8_STRING), &actual_type, &actual_format,
                           &nitems, &bytes_after, &prop) == Success) &&
       (actual_type == ATOM(UTF8_STRING)) && (nitems > 0L) &&
       (actual_format == 8)) {
-    current_info->x11.desktop.all_names.assign(
-        reinterpret_cast<const char *>(prop), nitems);
+    std::string &names = current_info->x11.desktop.all_names;
+    changed = names.compare(0, std::string::npos,
+                            reinterpret_cast<const char *>(prop), nitems) != 0;
+    if (changed) { names.assign(reinterpret_cast<const char *>(prop), nitems); }
   }
   if (prop != nullptr) { XFree(prop); }
+  return changed;
 }
 
 // Get current desktop name
@@ -1119,44 +1211,68 @@ static inline void get_x11_desktop_current_name(const std::string &names) {
   }
 }
 
-void get_x11_desktop_info(Display *current_display, Atom atom) {
+/* The desktop objects only print what is decoded here. It is read once at
+ * startup and again only for PropertyNotify events on the root window that
+ * concern one of the atoms it comes from; returns true if that changed
+ * something, so the text can be updated right away. */
+bool get_x11_desktop_info(Display *current_display, Atom atom) {
+  enum { CURRENT, NUMBER, NAMES, WORKAREA, ATOM_COUNT };
+  static Atom atoms[ATOM_COUNT];
   Window root;
-  static Atom atom_current, atom_number, atom_names;
   struct information *current_info = &info;
   XWindowAttributes window_attributes;
+  bool changed = false;
 
   root = RootWindow(current_display, current_info->x11.monitor.current);
 
   /* Check if we initialise else retrieve changed property */
   if (atom == 0) {
-    atom_current = XInternAtom(current_display, "_NET_CURRENT_DESKTOP", True);
-    atom_number = XInternAtom(current_display, "_NET_NUMBER_OF_DESKTOPS", True);
-    atom_names = XInternAtom(current_display, "_NET_DESKTOP_NAMES", True);
-    get_x11_desktop_current(current_display, root, atom_current);
-    get_x11_desktop_number(current_display, root, atom_number);
-    get_x11_desktop_names(current_display, root, atom_names);
+    static const char *names[ATOM_COUNT] = {
+        "_NET_CURRENT_DESKTOP", "_NET_NUMBER_OF_DESKTOPS",
+        "_NET_DESKTOP_NAMES", "_NET_WORKAREA"};
+
+    /* a single round trip for all of them; missing ones come back None */
+    XInternAtoms(current_display, const_cast<char **>(names), ATOM_COUNT, True,
+                 atoms);
+    get_x11_desktop_current(current_display, root, atoms[CURRENT]);
+    get_x11_desktop_number(current_display, root, atoms[NUMBER]);
+    get_x11_desktop_names(current_display, root, atoms[NAMES]);
     get_x11_desktop_current_name(current_info->x11.desktop.all_names);
 
-    /* Set the PropertyChangeMask on the root window, if not set */
+    /* Set the PropertyChangeMask on the root window, if not set, and the
+     * StructureNotifyMask, for the root window's resizes, see
+     * x11_screen_changed() */
     XGetWindowAttributes(display, root, &window_attributes);
-    if ((window_attributes.your_event_mask & PropertyChangeMask) == 0) {
+    const long mask = PropertyChangeMask | StructureNotifyMask;
+    if ((window_attributes.your_event_mask & mask) != mask) {
       XSetWindowAttributes attributes;
-      attributes.event_mask =
-          window_attributes.your_event_mask | PropertyChangeMask;
+      attributes.event_mask = window_attributes.your_event_mask | mask;
       XChangeWindowAttributes(display, root, CWEventMask, &attributes);
-      XGetWindowAttributes(display, root, &window_attributes);
     }
-  } else {
-    if (atom == atom_current) {
-      get_x11_desktop_current(current_display, root, atom_current);
+    return true;
+  }
+
+  /* most root window properties, e.g. the active window, are none of ours */
+  if (atom == None) { return false; }
+  if (atom == atoms[CURRENT]) {
+    changed = get_x11_desktop_current(current_display, root, atom);
+    if (changed) {
       get_x11_desktop_current_name(current_info->x11.desktop.all_names);
-    } else if (atom == atom_number) {
-      get_x11_desktop_number(current_display, root, atom_number);
-    } else if (atom == atom_names) {
-      get_x11_desktop_names(current_display, root, atom_names);
+    }
+  } else if (atom == atoms[NUMBER]) {
+    changed = get_x11_desktop_number(current_display, root, atom);
+  } else if (atom == atoms[NAMES]) {
+    changed = get_x11_desktop_names(current_display, root, atom);
+    if (changed) {
       get_x11_desktop_current_name(current_info->x11.desktop.all_names);
     }
+  } else if (atom == atoms[WORKAREA]) {
+    /* panels or heads came or went, align to what is left */
+    heads_valid = false;
+    update_workarea();
+    changed = true;
   }
+  return changed;
 }
 
 static const char NOT_IN_X[] = "Not running in X";
@@ -1279,12 +1395,47 @@ void set_struts(int sidenum) {
 #endif /* OWN_WINDOW */
 
 #ifdef BUILD_XDBE
+bool xdbe_copies_back_buffer(unsigned long *pixel) {
+#ifdef OWN_WINDOW
+  if (!use_xdbe.get(*state) || !own_window.get(*state)) { return false; }
+#ifdef BUILD_ARGB
+  if (have_argb_visual) {
+    *pixel = background_pixel(
+        set_transparent.get(*state) ? 0 : own_window_argb_value.get(*state));
+    return true;
+  }
+#endif /* BUILD_ARGB */
+  if (set_transparent.get(*state)) { return false; }
+  *pixel = background_pixel(0);
+  return true;
+#else
+  (void)pixel;
+  return false;
+#endif /* OWN_WINDOW */
+}
+
+void xdbe_clear_back_buffer(Region region) {
+  unsigned long pixel;
+
+  if (!xdbe_copies_back_buffer(&pixel)) { return; }
+  if (region != nullptr) {
+    XSetRegion(display, window.gc, region);
+  } else {
+    XSetClipMask(display, window.gc, None);
+  }
+  XSetForeground(display, window.gc, pixel);
+  XFillRectangle(display, window.back_buffer, window.gc, 0, 0, window.width,
+                 window.height);
+}
+
 void xdbe_swap_buffers() {
   if (use_xdbe.get(*state)) {
     XdbeSwapInfo swap;
+    unsigned long pixel;
 
     swap.swap_window = window.window;
-    swap.swap_action = XdbeBackground;
+    swap.swap_action =
+        xdbe_copies_back_buffer(&pixel) ? XdbeCopied : XdbeBackground;
     XdbeSwapBuffers(display, &swap, 1);
   }
 }
@@ -30,6 +30,7 @@
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wvariadic-macros"
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 #pragma GCC diagnostic pop
 #ifdef BUILD_XFT
 #include <X11/Xft/Xft.h>
@@ -108,7 +109,11 @@ extern char window_created;
 void destroy_window(void);
 void create_gc(void);
 void set_transparent_background(Window win);
-void get_x11_desktop_info(Display *current_display, Atom atom);
+bool get_x11_desktop_info(Display *current_display, Atom atom);
+/* whether ev tells the screen changed, in which case the heads are asked
+ * for again by the next x11_screen_update(), which aligns the workarea */
+bool x11_screen_changed(const XEvent &ev);
+void x11_screen_update();
 void set_struts(int);
 
 void print_monitor(struct text_object *, char *, unsigned int);
@@ -127,6 +132,12 @@ void print_keyboard_layout(struct text_object *, char *, unsigned int);
 void print_mouse_speed(struct text_object *, char *, unsigned int);
 
 #ifdef BUILD_XDBE
+/* True if the window background is a plain colour, returned in pixel. The back
+ * buffer is then kept across swaps (XdbeCopied), so only the parts of it that
+ * are redrawn need clearing, with xdbe_clear_back_buffer(). */
+bool xdbe_copies_back_buffer(unsigned long *pixel);
+/* clear region of the back buffer, or all of it if region is nullptr */
+void xdbe_clear_back_buffer(Region region);
 void xdbe_swap_buffers(void);
 #else
 void xpmdb_swap_buffers(void);
@@ -28,12 +28,19 @@
 
 #include "conky.h"
 
+#include <poll.h>
+
 xmmsc_connection_t *xmms2_conn;
 
 #define CONN_INIT 0
 #define CONN_OK 1
 #define CONN_NO 2
 
+/* The server broadcasts changes of the song, the playback status and the
+ * playlist. The playtime is only asked for when those change, and now and
+ * then while playing to follow seeks; in between it is counted locally. */
+#define XMMS2_RESYNC_INTERVAL 10
+
 static void xmms_alloc(struct information *ptr) {
   if (ptr->xmms2.artist == nullptr) {
     ptr->xmms2.artist = (char *)malloc(text_buffer_size.get(*state));
@@ -76,8 +83,8 @@ static void xmms_alloc(struct information *ptr) {
   ptr->xmms2.bitrate = 0;
   ptr->xmms2.duration = 0;
   ptr->xmms2.elapsed = 0;
+  ptr->xmms2.sampled = get_time();
   ptr->xmms2.size = 0;
-  ptr->xmms2.progress = 0;
   ptr->xmms2.timesplayed = -1;
 }
 
@@ -106,6 +113,27 @@ void connection_lost(void *p) {
   strncpy(ptr->xmms2.status, "Disconnected", text_buffer_size.get(*state) - 1);
   ptr->xmms2.playlist[0] = '\0';
   ptr->xmms2.id = 0;
+  ptr->xmms2.playing = false;
+}
+
+int handle_playtime(xmmsv_t *value, void *p);
+
+/* the elapsed time in ms, moved on by the time passed since the server
+ * reported it when playing */
+static int xmms2_elapsed() {
+  int elapsed = info.xmms2.elapsed;
+  if (info.xmms2.playing) {
+    elapsed += (get_time() - info.xmms2.sampled) * 1000;
+    if (info.xmms2.duration > 0 && elapsed > info.xmms2.duration) {
+      elapsed = info.xmms2.duration;
+    }
+  }
+  return elapsed;
+}
+
+static float xmms2_progress() {
+  if (info.xmms2.duration <= 0) { return 0; }
+  return (float)xmms2_elapsed() / info.xmms2.duration;
 }
 
 int handle_curent_id(xmmsv_t *value, void *p) {
@@ -189,6 +217,10 @@ int handle_curent_id(xmmsv_t *value, void *p) {
 
     xmmsv_unref(infos);
     xmmsc_result_unref(res);
+
+    /* a new song may have started anywhere */
+    XMMS_CALLBACK_SET(xmms2_conn, xmmsc_playback_playtime, handle_playtime,
+                      ptr);
   }
   return TRUE;
 }
@@ -205,11 +237,11 @@ int handle_playtime(xmmsv_t *value, void *p) {
 
   if (xmmsv_get_int(value, &play_time)) {
     ptr->xmms2.elapsed = play_time;
-    ptr->xmms2.progress = (float)play_time / ptr->xmms2.duration;
-    ptr->xmms2.percent = (int)(ptr->xmms2.progress * 100);
+    ptr->xmms2.sampled = get_time();
   }
 
-  return TRUE;
+  /* one answer is enough, see XMMS2_RESYNC_INTERVAL */
+  return FALSE;
 }
 
 int handle_playback_state_change(xmmsv_t *value, void *p) {
@@ -228,6 +260,9 @@ int handle_playback_state_change(xmmsv_t *value, void *p) {
   }
 
   if (xmmsv_get_int(value, &pb_state)) {
+    ptr->xmms2.playing = pb_state == XMMS_PLAYBACK_STATUS_PLAY;
+    XMMS_CALLBACK_SET(xmms2_conn, xmmsc_playback_playtime, handle_playtime,
+                      ptr);
     switch (pb_state) {
       case XMMS_PLAYBACK_STATUS_PLAY:
         strncpy(ptr->xmms2.status, "Playing", text_buffer_size.get(*state) - 1);
@@ -237,7 +272,7 @@ int handle_playback_state_change(xmmsv_t *value, void *p) {
         break;
       case XMMS_PLAYBACK_STATUS_STOP:
         strncpy(ptr->xmms2.status, "Stopped", text_buffer_size.get(*state) - 1);
-        ptr->xmms2.elapsed = ptr->xmms2.progress = ptr->xmms2.percent = 0;
+        ptr->xmms2.elapsed = 0;
         break;
       default:
         strncpy(ptr->xmms2.status, "Unknown", text_buffer_size.get(*state) - 1);
@@ -320,8 +355,6 @@ int update_xmms2(void) {
     xmmsc_disconnect_callback_set(xmms2_conn, connection_lost, current_info);
     XMMS_CALLBACK_SET(xmms2_conn, xmmsc_broadcast_playback_current_id,
                       handle_curent_id, current_info);
-    XMMS_CALLBACK_SET(xmms2_conn, xmmsc_signal_playback_playtime,
-                      handle_playtime, current_info);
     XMMS_CALLBACK_SET(xmms2_conn, xmmsc_broadcast_playback_status,
                       handle_playback_state_change, current_info);
     XMMS_CALLBACK_SET(xmms2_conn, xmmsc_broadcast_playlist_loaded,
@@ -336,14 +369,26 @@ int update_xmms2(void) {
                       handle_playback_state_change, current_info);
     XMMS_CALLBACK_SET(xmms2_conn, xmmsc_playlist_current_active,
                       handle_playlist_loaded, current_info);
+    XMMS_CALLBACK_SET(xmms2_conn, xmmsc_playback_playtime, handle_playtime,
+                      current_info);
 
     /* everything seems to be ok */
     current_info->xmms2.conn_state = CONN_OK;
   }
 
-  /* handle callbacks */
+  /* handle callbacks, if the server sent anything */
   if (current_info->xmms2.conn_state == CONN_OK) {
-    xmmsc_io_in_handle(xmms2_conn);
+    struct pollfd pfd = {xmmsc_io_fd_get(xmms2_conn), POLLIN, 0};
+    if (poll(&pfd, 1, 0) > 0) { xmmsc_io_in_handle(xmms2_conn); }
+  }
+  if (current_info->xmms2.conn_state == CONN_OK) {
+    if (current_info->xmms2.playing &&
+        get_time() - current_info->xmms2.sampled > XMMS2_RESYNC_INTERVAL) {
+      /* the answer comes with a later update */
+      current_info->xmms2.sampled = get_time();
+      XMMS_CALLBACK_SET(xmms2_conn, xmmsc_playback_playtime, handle_playtime,
+                        current_info);
+    }
     if (xmmsc_io_want_out(xmms2_conn)) xmmsc_io_out_handle(xmms2_conn);
   }
   return 0;
@@ -360,8 +405,8 @@ void print_xmms2_tracknr(struct text_object *obj, char *p,
 void print_xmms2_elapsed(struct text_object *obj, char *p,
                          unsigned int p_max_size) {
   (void)obj;
-  snprintf(p, p_max_size, "%02d:%02d", info.xmms2.elapsed / 60000,
-           (info.xmms2.elapsed / 1000) % 60);
+  int elapsed = xmms2_elapsed();
+  snprintf(p, p_max_size, "%02d:%02d", elapsed / 60000, (elapsed / 1000) % 60);
 }
 
 void print_xmms2_duration(struct text_object *obj, char *p,
@@ -374,7 +419,7 @@ void print_xmms2_duration(struct text_object *obj, char *p,
 double xmms2_barval(struct text_object *obj) {
   (void)obj;
 
-  return info.xmms2.progress;
+  return xmms2_progress();
 }
 
 void print_xmms2_smart(struct text_object *obj, char *p,
@@ -411,10 +456,15 @@ XMMS2_PRINT_GENERATOR(id, "%u")
 XMMS2_PRINT_GENERATOR(size, "%2.1f")
 XMMS2_PRINT_GENERATOR(playlist, "%s")
 XMMS2_PRINT_GENERATOR(timesplayed, "%i")
-XMMS2_PRINT_GENERATOR(percent, "%i")
 
 #undef XMMS2_PRINT_GENERATOR
 
+void print_xmms2_percent(struct text_object *obj, char *p,
+                         unsigned int p_max_size) {
+  (void)obj;
+  snprintf(p, p_max_size, "%i", (int)(xmms2_progress() * 100));
+}
+
 int if_xmms2_connected(struct text_object *obj) {
   (void)obj;
 
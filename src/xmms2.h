@@ -44,12 +44,12 @@ struct xmms2_s {
   int bitrate;
   unsigned int id;
   int duration;
-  int elapsed;
+  int elapsed;    /* as last reported by the server */
+  double sampled; /* get_time() when it was */
+  bool playing;
   int timesplayed;
   float size;
 
-  float progress;
-  int percent;
   char *status;
   int conn_state;
 };
@@ -0,0 +1,280 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Micro-benchmarks for the hot paths of a conky update: text generation, the
+ * /proc parsers, setting lookups, the number formatters, the gradient
+ * factories and the top process sort. Results are written to stdout as a JSON
+ * array with one object per benchmark, so they can be compared between builds.
+ *
+ * usage: bench-conky [filter]
+ *
+ * Only benchmarks whose name contains 'filter' are run. The /proc parsers read
+ * the recorded tree in tests/fixtures; set CONKY_BENCH_FIXTURES to use another.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.h"
+#include "conky.h"
+#include "core.h"
+#include "diskio.h"
+#include "gradient.h"
+#include "lua-config.hh"
+#include "net_stat.h"
+#include "setting.hh"
+#include "text_object.h"
+#include "top.h"
+#ifdef __linux__
+#include "linux.h"
+#endif
+
+namespace {
+
+struct result {
+  std::string name;
+  uint64_t iterations;
+  double ns_per_op;
+  double min_ns_per_op;
+};
+
+std::vector<result> results;
+const char *filter = nullptr;
+
+using bench_clock = std::chrono::steady_clock;
+
+double elapsed_ns(bench_clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start)
+      .count();
+}
+
+/*
+ * Runs 'fn' in batches large enough to take about a millisecond each, for
+ * roughly a quarter of a second, and records the mean and the fastest batch.
+ */
+void bench(const char *name, const std::function<void()> &fn) {
+  const int kRounds = 25;
+  const double kBatchNs = 1e6;
+
+  if (filter != nullptr && strstr(name, filter) == nullptr) { return; }
+
+  // warm up caches and any lazily initialised state
+  fn();
+
+  uint64_t batch = 1;
+  for (;;) {
+    auto start = bench_clock::now();
+    for (uint64_t i = 0; i < batch; ++i) { fn(); }
+    if (elapsed_ns(start) >= kBatchNs || batch >= (1ULL << 30)) { break; }
+    batch *= 2;
+  }
+
+  double total = 0;
+  double best = 0;
+  for (int r = 0; r < kRounds; ++r) {
+    auto start = bench_clock::now();
+    for (uint64_t i = 0; i < batch; ++i) { fn(); }
+    double per_op = elapsed_ns(start) / batch;
+    total += per_op;
+    if (r == 0 || per_op < best) { best = per_op; }
+  }
+
+  results.push_back({name, batch * kRounds, total / kRounds, best});
+  fprintf(stderr, "%-32s %12.1f ns/op\n", name, total / kRounds);
+}
+
+void print_json(FILE *out) {
+  fprintf(out, "[\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const result &r = results[i];
+    fprintf(out,
+            "  {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, "
+            "\"min_ns_per_op\": %.1f}%s\n",
+            r.name.c_str(), static_cast<unsigned long long>(r.iterations),
+            r.ns_per_op, r.min_ns_per_op, i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "]\n");
+}
+
+void setup_lua() {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+  state->loadstring(
+      "conky.config = { out_to_console = false,"
+#ifdef BUILD_X11
+      " out_to_x = false,"
+#endif
+      " }");
+  state->call(0, 0);
+  conky::set_config_settings(*state);
+}
+
+void bench_gradients() {
+  const int width = 256;
+  const unsigned long first = 0x996633;
+  const unsigned long last = 0x3366ff;
+
+  bench("gradient/rgb", [&] {
+    conky::rgb_gradient_factory factory(width, first, last);
+    auto colours = factory.create_gradient();
+  });
+  bench("gradient/hsv", [&] {
+    conky::hsv_gradient_factory factory(width, first, last);
+    auto colours = factory.create_gradient();
+  });
+  bench("gradient/hcl", [&] {
+    conky::hcl_gradient_factory factory(width, first, last);
+    auto colours = factory.create_gradient();
+  });
+}
+
+void bench_settings() {
+  bench("setting/get", [] {
+    volatile unsigned int size = text_buffer_size.get(*state);
+    (void)size;
+  });
+}
+
+void bench_formatters() {
+  char buf[64];
+  long long n = 0;
+
+  bench("human_readable", [&] {
+    human_readable(n, buf, sizeof(buf));
+    n = n * 7 + 1234567;
+    if (n > (1LL << 50)) { n = 0; }
+  });
+  bench("spaced_print", [&] {
+    spaced_print(buf, sizeof(buf), "%d%%", 4, static_cast<int>(n++ % 100));
+  });
+  bench("percent_print", [&] {
+    percent_print(buf, sizeof(buf), static_cast<unsigned>(n++ % 101));
+  });
+  bench("format_seconds", [&] {
+    format_seconds(buf, sizeof(buf), static_cast<long>(n++ * 4099 % 1000000));
+  });
+}
+
+void bench_text(const char *name, const std::string &text) {
+  struct text_object root;
+  memset(&root, 0, sizeof(root));
+  extract_variable_text_internal(&root, text.c_str());
+
+  std::vector<char> buf(16 * 1024);
+  bench(name, [&] { generate_text_internal(buf.data(), buf.size(), root); });
+
+  free_text_objects(&root);
+}
+
+void bench_text_generation() {
+  std::string plain;
+  std::string mixed;
+  for (int i = 0; i < 64; ++i) {
+    plain += "static text line with some words in it\n";
+    mixed +=
+        "${color grey}Memory:$color $mem/$memmax ${membar 6}\n"
+        "${if_match 1 == 1}yes${else}no${endif} ${offset 4}"
+        "Uptime: $uptime ${alignr}$loadavg\n";
+  }
+  bench_text("generate_text/plain", plain);
+  bench_text("generate_text/mixed", mixed);
+}
+
+#ifdef __linux__
+void bench_proc_parsers() {
+  const char *root = getenv("CONKY_BENCH_FIXTURES");
+  set_open_file_root(root != nullptr ? root : BENCH_FIXTURE_DIR);
+
+  prepare_diskio_stat("sda");
+  prepare_diskio_stat("nvme0n1");
+  /* only interfaces something refers to are updated */
+  get_net_stat("eth0", nullptr, nullptr);
+  get_net_stat("wlan0", nullptr, nullptr);
+
+  bench("proc/meminfo", [] { update_meminfo(); });
+  bench("proc/stat", [] {
+    last_update_time = current_update_time;
+    current_update_time += 1.0;
+    update_stat();
+  });
+  bench("proc/diskstats", [] { update_diskio(); });
+  bench("proc/net_dev", [] {
+    int reported = 0;
+    FILE *fp = open_file("/proc/net/dev", &reported);
+    if (fp == nullptr) { return; }
+    char buf[256];
+    if (fgets(buf, sizeof(buf), fp) != nullptr &&
+        fgets(buf, sizeof(buf), fp) != nullptr) {
+      update_net_interfaces(fp, false, 1.0);
+    }
+    fclose(fp);
+  });
+
+  set_open_file_root("");
+}
+#endif /* __linux__ */
+
+void bench_top() {
+  // process_find_top() is static, update_top() is its only caller
+  top_cpu = 1;
+  top_mem = 1;
+  bench("process_find_top", [] { update_top(); });
+  top_cpu = 0;
+  top_mem = 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) { filter = argv[1]; }
+
+  // the gradient factories query the X visual unless the lua state is unset,
+  // so they go first (see test-gradient.cc)
+  state = nullptr;
+  bench_gradients();
+
+  setup_lua();
+  bench_settings();
+  bench_formatters();
+  bench_text_generation();
+#ifdef __linux__
+  bench_proc_parsers();
+#endif /* __linux__ */
+  bench_top();
+
+  print_json(stdout);
+  return 0;
+}
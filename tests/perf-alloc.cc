@@ -0,0 +1,134 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Counts the allocations of a process it is preloaded into
+ * (LD_PRELOAD=libperf-alloc.so) and, when the process exits, writes
+ *
+ *   allocations <n>
+ *   syscalls <n>
+ *
+ * to the file named by PERF_ALLOC_OUT, the latter being the read and write
+ * syscalls of all of its threads as /proc/self/io counts them. Used by
+ * perf-conky; glibc only, as it forwards to glibc's own allocator.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+
+std::atomic<unsigned long long> allocations{0};
+pid_t counted_pid;
+
+inline void count() { allocations.fetch_add(1, std::memory_order_relaxed); }
+
+unsigned long long io_field(const char *text, const char *name) {
+  unsigned long long value = 0;
+  char key[32];
+  unsigned long long n;
+  int offset = 0;
+  while (sscanf(text, "%31[^:]: %llu\n%n", key, &n, &offset) == 2 &&
+         offset > 0) {
+    if (strcmp(key, name) == 0) { value = n; }
+    text += offset;
+  }
+  return value;
+}
+
+/* the commands conky runs aren't counted, nor would they know the count */
+__attribute__((constructor)) void start_counting() {
+  counted_pid = getpid();
+  unsetenv("LD_PRELOAD");
+}
+
+__attribute__((destructor)) void write_counts() {
+  const char *out = getenv("PERF_ALLOC_OUT");
+  if (out == nullptr || getpid() != counted_pid) { return; }
+
+  /* read before anything below adds to it */
+  char io[512] = "";
+  FILE *fp = fopen("/proc/self/io", "re");
+  if (fp != nullptr) {
+    size_t n = fread(io, 1, sizeof io - 1, fp);
+    io[n] = '\0';
+    fclose(fp);
+  }
+  unsigned long long counted = allocations.load();
+
+  fp = fopen(out, "we");
+  if (fp == nullptr) { return; }
+  fprintf(fp, "allocations %llu\nsyscalls %llu\n", counted,
+          io_field(io, "syscr") + io_field(io, "syscw"));
+  fclose(fp);
+}
+
+}  // namespace
+
+extern "C" {
+
+void *malloc(size_t size) {
+  count();
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+  count();
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+  count();
+  return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) {
+  count();
+  *ptr = __libc_memalign(alignment, size);
+  return *ptr != nullptr ? 0 : ENOMEM;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+  count();
+  return __libc_memalign(alignment, size);
+}
+
+}  // extern "C"
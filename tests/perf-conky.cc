@@ -0,0 +1,269 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Frame budgets: runs conky on each config in tests/perf against the frames
+ * recorded in tests/fixtures/replay and fails if an update costs more than
+ * tests/perf/budgets allows, in CPU time, allocations or read and write
+ * syscalls.
+ *
+ * usage: perf-conky [--update] CONKY ALLOC_LIB PERF_DIR REPLAY_DIR
+ *
+ * Each config is run twice with --bench, for a short and a long number of
+ * updates, so that what starting and stopping costs drops out of the
+ * difference. CPU time is the best of a few pairs of runs. --update writes
+ * the measured costs, plus some headroom, to the budgets file instead.
+ *
+ * Exits with 77 (skipped) if no config has a budget yet.
+ */
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+
+namespace {
+
+const unsigned long kShortFrames = 20;
+const unsigned long kLongFrames = 220;
+const int kCpuRounds = 3;
+
+/* what the budgets are set to over the measured costs by --update, CPU time
+ * being the noisiest */
+const double kCpuHeadroom = 1.5;
+const double kCountHeadroom = 1.1;
+
+struct cost {
+  double cpu_us = 0;
+  double allocations = 0;
+  double syscalls = 0;
+};
+
+std::string conky_path, alloc_lib, perf_dir, replay_dir;
+/* where the counts of a run are written */
+std::string counts;
+
+/* Runs conky on config for frames updates. Returns false if it didn't exit
+ * cleanly. */
+bool run(const std::string &config, unsigned long frames, cost &total) {
+  unlink(counts.c_str());
+
+  pid_t pid = fork();
+  if (pid < 0) { return false; }
+  if (pid == 0) {
+    /* hooks.lua and the like are loaded relative to the configs */
+    if (chdir(perf_dir.c_str()) != 0) { _exit(127); }
+    setenv("LD_PRELOAD", alloc_lib.c_str(), 1);
+    setenv("PERF_ALLOC_OUT", counts.c_str(), 1);
+    if (freopen("/dev/null", "w", stdout) == nullptr ||
+        freopen("/dev/null", "w", stderr) == nullptr) {
+      _exit(127);
+    }
+    std::string replay = "--replay=" + replay_dir;
+    std::string bench = "--bench=" + std::to_string(frames);
+    execl(conky_path.c_str(), conky_path.c_str(), "-c", config.c_str(),
+          replay.c_str(), bench.c_str(), static_cast<char *>(nullptr));
+    _exit(127);
+  }
+
+  int status;
+  struct rusage usage {};
+  while (wait4(pid, &status, 0, &usage) < 0) {
+    if (errno != EINTR) { return false; }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) { return false; }
+
+  total.cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e6 +
+                 usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+  std::ifstream in(counts);
+  std::string key;
+  double value;
+  while (in >> key >> value) {
+    if (key == "allocations") { total.allocations = value; }
+    if (key == "syscalls") { total.syscalls = value; }
+  }
+  unlink(counts.c_str());
+  return true;
+}
+
+/* the cost of one update of config */
+bool measure(const std::string &config, cost &per_frame) {
+  const double frames = kLongFrames - kShortFrames;
+
+  for (int round = 0; round < kCpuRounds; ++round) {
+    cost short_run, long_run;
+    if (!run(config, kShortFrames, short_run) ||
+        !run(config, kLongFrames, long_run)) {
+      return false;
+    }
+    double cpu_us = std::max(0.0, long_run.cpu_us - short_run.cpu_us) / frames;
+    if (round == 0 || cpu_us < per_frame.cpu_us) { per_frame.cpu_us = cpu_us; }
+    /* the same in every round, give or take the odd thread */
+    per_frame.allocations =
+        std::max(0.0, long_run.allocations - short_run.allocations) / frames;
+    per_frame.syscalls =
+        std::max(0.0, long_run.syscalls - short_run.syscalls) / frames;
+  }
+  return true;
+}
+
+/* config -> budget, from lines of "config cpu_us allocations syscalls" */
+std::map<std::string, cost> read_budgets(const std::string &file) {
+  std::map<std::string, cost> budgets;
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') { continue; }
+    std::istringstream words(line);
+    std::string config;
+    cost c;
+    if (words >> config >> c.cpu_us >> c.allocations >> c.syscalls) {
+      budgets[config] = c;
+    }
+  }
+  return budgets;
+}
+
+bool write_budgets(const std::string &file,
+                   const std::map<std::string, cost> &measured) {
+  FILE *out = fopen(file.c_str(), "we");
+  if (out == nullptr) { return false; }
+  fprintf(out,
+          "# The most one update of each config in this directory may cost,\n"
+          "# as checked by perf-conky: CPU time in microseconds, and the\n"
+          "# allocations and read and write syscalls it makes. Written by\n"
+          "# 'perf-conky --update', lower them by hand to lock in a gain.\n"
+          "#\n"
+          "# config cpu_us allocations syscalls\n");
+  for (const auto &m : measured) {
+    /* one more of each for what a callback thread does now and then */
+    fprintf(out, "%s %.0f %.0f %.0f\n", m.first.c_str(),
+            std::ceil(m.second.cpu_us * kCpuHeadroom),
+            std::ceil(m.second.allocations * kCountHeadroom) + 1,
+            std::ceil(m.second.syscalls * kCountHeadroom) + 1);
+  }
+  return fclose(out) == 0;
+}
+
+std::vector<std::string> configs() {
+  std::vector<std::string> names;
+  DIR *dir = opendir(perf_dir.c_str());
+  if (dir == nullptr) { return names; }
+  while (struct dirent *e = readdir(dir)) {
+    std::string name(e->d_name);
+    if (name.size() > 5 && name.compare(name.size() - 5, 5, ".conf") == 0) {
+      names.push_back(name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+bool within(const char *config, const char *what, double measured,
+            double budget) {
+  if (measured <= budget) { return true; }
+  fprintf(stderr, "%s: %.1f %s per update, over the budget of %.0f\n", config,
+          measured, what, budget);
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  bool update = argc > 1 && strcmp(argv[1], "--update") == 0;
+  if (update) {
+    --argc;
+    ++argv;
+  }
+  if (argc != 5) {
+    fprintf(stderr,
+            "usage: perf-conky [--update] CONKY ALLOC_LIB PERF_DIR "
+            "REPLAY_DIR\n");
+    return 2;
+  }
+  conky_path = argv[1];
+  alloc_lib = argv[2];
+  perf_dir = argv[3];
+  replay_dir = argv[4];
+  char cwd[4096];
+  if (getcwd(cwd, sizeof cwd) == nullptr) { return 2; }
+  counts = std::string(cwd) + "/perf-counts";
+
+  std::string budgets_file = perf_dir + "/budgets";
+  std::map<std::string, cost> budgets = read_budgets(budgets_file);
+  std::map<std::string, cost> measured;
+  bool failed = false;
+  bool checked = false;
+
+  for (const std::string &config : configs()) {
+    cost c;
+    if (!measure(config, c)) {
+      fprintf(stderr, "%s: conky didn't run to the end\n", config.c_str());
+      failed = true;
+      continue;
+    }
+    measured[config] = c;
+    fprintf(stderr, "%-24s %10.1f us %10.1f allocations %8.1f syscalls\n",
+            config.c_str(), c.cpu_us, c.allocations, c.syscalls);
+
+    auto it = budgets.find(config);
+    if (update || it == budgets.end()) { continue; }
+    checked = true;
+    const cost &b = it->second;
+    failed |= !within(config.c_str(), "us", c.cpu_us, b.cpu_us);
+    failed |= !within(config.c_str(), "allocations", c.allocations,
+                      b.allocations);
+    failed |= !within(config.c_str(), "syscalls", c.syscalls, b.syscalls);
+  }
+
+  if (update) {
+    if (failed || !write_budgets(budgets_file, measured)) { return 1; }
+    return 0;
+  }
+  if (failed) { return 1; }
+  if (!checked) {
+    fprintf(stderr, "no budgets in %s, run perf-conky --update\n",
+            budgets_file.c_str());
+    return 77;
+  }
+  return 0;
+}
@@ -0,0 +1,18 @@
+-- the Lua side of lua.conf, loaded from the directory of the configs
+function conky_perf_value(n)
+    return string.format('%d', tonumber(n) * 2)
+end
+
+function conky_perf_parse(n)
+    return '${cpu cpu' .. (tonumber(n) % 8) .. '}%'
+end
+
+function conky_perf_draw()
+    local total = 0
+    for i = 0, conky_info.cpu_count do
+        total = total + (conky_info.cpu[i] or 0)
+    end
+    local mem = conky_info.mem.mem
+    local text = conky_parse('${downspeed eth0} ${upspeed eth0}')
+    return total, mem, text
+end
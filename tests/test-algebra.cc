@@ -0,0 +1,73 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <cstring>
+
+#include <algebra.h>
+#include <text_object.h>
+
+static bool if_match(const char *arg) {
+  struct text_object obj;
+  memset(&obj, 0, sizeof(obj));
+  parse_if_match(&obj, arg);
+  REQUIRE(obj.data.opaque != nullptr);
+  bool result = check_if_match(&obj) != 0;
+  free_if_match(&obj);
+  return result;
+}
+
+TEST_CASE("if_match expressions are compiled") {
+  SECTION("numbers") {
+    REQUIRE(if_match("1 < 2"));
+    REQUIRE_FALSE(if_match("3 <= 2"));
+    REQUIRE(if_match("-4 != 4"));
+    REQUIRE(if_match("2 == 2.0"));
+    REQUIRE(if_match("2.5 > 2"));
+  }
+
+  SECTION("strings") {
+    REQUIRE(if_match("\"abc\" == \"abc\""));
+    REQUIRE(if_match("\"abc\" < \"abd\""));
+    REQUIRE(if_match("\"a > b\" != \"a\""));
+  }
+
+  SECTION("&& binds tighter than ||") {
+    REQUIRE(if_match("1 == 1 && 2 == 2"));
+    REQUIRE_FALSE(if_match("1 == 1 && 2 == 3"));
+    REQUIRE(if_match("1 == 2 || 2 == 2"));
+    REQUIRE(if_match("1 == 2 && 2 == 2 || 3 == 3"));
+    REQUIRE_FALSE(if_match("1 == 2 || 2 == 2 && 3 == 4"));
+  }
+}
+
+TEST_CASE("if_match treats failed comparisons as true") {
+  REQUIRE(if_match("\"abc\" == 1"));
+  REQUIRE_FALSE(if_match("\"abc\" == 1 && 1 == 2"));
+}
@@ -43,3 +43,44 @@ TEST_CASE("Expressions can be evaluated", "[evaluate]") {
     REQUIRE(strncmp(input, result, kMaxSize) == 0);
   }
 }
+
+TEST_CASE("wrap_text breaks lines and folds case in one pass", "[wrap]") {
+  char out[64];
+
+  SECTION("lines are broken after width characters") {
+    REQUIRE(wrap_text("abcdefg\nhi", out, sizeof(out), 3, TEXT_CASE_KEEP));
+    REQUIRE(strcmp(out, "abc\ndef\ng\nhi") == 0);
+  }
+
+  SECTION("UTF-8 sequences count as one character") {
+    REQUIRE(wrap_text("\xc3\xa4\xc3\xb6\xc3\xbc", out, sizeof(out), 2,
+                      TEXT_CASE_KEEP));
+    REQUIRE(strcmp(out, "\xc3\xa4\xc3\xb6\n\xc3\xbc") == 0);
+  }
+
+  SECTION("the case is folded on the way") {
+    REQUIRE(wrap_text("abCD", out, sizeof(out), 2, TEXT_CASE_UPPER));
+    REQUIRE(strcmp(out, "AB\nCD") == 0);
+  }
+
+  SECTION("text that doesn't fit is reported") {
+    REQUIRE_FALSE(wrap_text("abcdef", out, 6, 3, TEXT_CASE_KEEP));
+    REQUIRE(strcmp(out, "abc\nd") == 0);
+  }
+}
+
+TEST_CASE("fold_text_case folds ASCII like toupper and tolower", "[wrap]") {
+  std::string all;
+  for (int c = 1; c < 128; ++c) { all += static_cast<char>(c); }
+  std::string upper = all, lower = all;
+  for (char &c : upper) { c = static_cast<char>(toupper(c)); }
+  for (char &c : lower) { c = static_cast<char>(tolower(c)); }
+
+  std::string text = all + "\xc3\xa4" + all;
+  fold_text_case(&text[0], TEXT_CASE_UPPER);
+  REQUIRE(text == upper + "\xc3\xa4" + upper);
+
+  text = all + all;
+  fold_text_case(&text[0], TEXT_CASE_LOWER);
+  REQUIRE(text == lower + lower);
+}
@@ -29,6 +29,7 @@
 #include "catch2/catch.hpp"
 
 #include <core.h>
+#include <text_object.h>
 
 TEST_CASE("remove_comments returns correct value") {
   SECTION("for no comments") {
@@ -66,3 +67,126 @@ TEST_CASE("remove_comments returns correct value") {
     REQUIRE(removed_chars == 6);
   }
 }
+
+static int false_iftest(struct text_object *) { return 0; }
+
+static int print_len_x(struct text_object *, char *p, unsigned int p_max_size) {
+  return snprintf(p, p_max_size, "x");
+}
+
+static struct text_object *new_object(struct text_object *root) {
+  if (root->arena == nullptr) { root->arena = new conky::text_arena; }
+  auto *obj = static_cast<struct text_object *>(
+      root->arena->allocate(sizeof(struct text_object)));
+  append_object(root, obj);
+  return obj;
+}
+
+TEST_CASE("text_arena hands out zeroed, aligned memory") {
+  conky::text_arena arena;
+  const size_t align = alignof(std::max_align_t);
+
+  auto *a = static_cast<char *>(arena.allocate(3));
+  auto *b = static_cast<char *>(arena.allocate(sizeof(struct text_object)));
+  REQUIRE(reinterpret_cast<uintptr_t>(b) % align == 0);
+  REQUIRE(b >= a + 3);
+  REQUIRE(b[0] == 0);
+  size_t capacity = arena.capacity();
+  REQUIRE(capacity > 0);
+
+  // blocks larger than usual are given their own
+  auto *big = static_cast<char *>(arena.allocate(capacity * 2));
+  REQUIRE(big[capacity * 2 - 1] == 0);
+  REQUIRE(arena.capacity() >= capacity * 3);
+
+  char *copy = arena.copy("plain text");
+  REQUIRE(strcmp(copy, "plain text") == 0);
+}
+
+TEST_CASE("compile_text_objects resolves ifblock jumps and cached segments") {
+  struct text_object root {};
+  void *ifblock = nullptr;
+
+  obj_be_plain_text(new_object(&root), "a");
+  struct text_object *if_obj = new_object(&root);
+  if_obj->callbacks.iftest = &false_iftest;
+  obj_be_ifblock_if(&ifblock, if_obj);
+  obj_be_plain_text(new_object(&root), "b");
+  struct text_object *else_obj = new_object(&root);
+  else_obj->callbacks.iftest = &gen_false_iftest;
+  obj_be_ifblock_else(&ifblock, else_obj);
+  obj_be_plain_text(new_object(&root), "c");
+  struct text_object *endif_obj = new_object(&root);
+  endif_obj->callbacks.print = &gen_print_nothing;
+  obj_be_ifblock_endif(&ifblock, endif_obj);
+  obj_be_plain_text(new_object(&root), "d");
+
+  compile_text_objects(&root);
+
+  // the endif prints nothing and gets no op
+  REQUIRE(root.op_count == 6);
+  REQUIRE(root.ops[1].type == TEXT_OP_IFTEST);
+  REQUIRE(root.ops[1].jump == 4);
+  REQUIRE(root.ops[3].type == TEXT_OP_IFTEST);
+  REQUIRE(root.ops[3].jump == 5);
+  REQUIRE(root.ops[5].type == TEXT_OP_PRINT);
+  REQUIRE(strcmp(root.ops[5].obj->data.s, "d") == 0);
+
+  // plain text never changes, so its output is cached
+  REQUIRE(root.segment_count == 4);
+  REQUIRE(root.ops[0].segment != nullptr);
+  REQUIRE(root.ops[1].segment == nullptr);
+
+  free_text_objects(&root);
+  REQUIRE(root.ops == nullptr);
+  REQUIRE(root.segments == nullptr);
+  REQUIRE(root.arena == nullptr);
+}
+
+TEST_CASE("compile_text_objects keeps print_len callbacks apart") {
+  struct text_object root {};
+  static const std::atomic<uint64_t> generation(1);
+
+  struct text_object *obj = new_object(&root);
+  obj->callbacks.print_len = &print_len_x;
+  obj->generation = &generation;
+
+  compile_text_objects(&root);
+
+  REQUIRE(root.op_count == 1);
+  REQUIRE(root.ops[0].type == TEXT_OP_PRINT_LEN);
+  REQUIRE(root.ops[0].cb.print_len == &print_len_x);
+  // their output is cached like that of print callbacks
+  REQUIRE(root.ops[0].segment != nullptr);
+
+  free_text_objects(&root);
+}
+
+TEST_CASE("take_interval_arg strips a trailing interval") {
+  std::string rest;
+  double interval;
+
+  SECTION("after other arguments") {
+    const char *arg = take_interval_arg("/home  interval=30", rest, interval);
+    REQUIRE(strcmp(arg, "/home") == 0);
+    REQUIRE(interval == 30);
+  }
+
+  SECTION("as the only argument") {
+    REQUIRE(take_interval_arg("interval=0.5", rest, interval) == nullptr);
+    REQUIRE(interval == 0.5);
+  }
+
+  SECTION("leaving other arguments alone") {
+    const char *arg = "cpu1";
+    REQUIRE(take_interval_arg(arg, rest, interval) == arg);
+    REQUIRE(interval == -1);
+    REQUIRE(take_interval_arg(nullptr, rest, interval) == nullptr);
+  }
+
+  SECTION("ignoring invalid values") {
+    const char *arg = take_interval_arg("/ interval=x", rest, interval);
+    REQUIRE(strcmp(arg, "/") == 0);
+    REQUIRE(interval == -1);
+  }
+}
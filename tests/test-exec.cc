@@ -0,0 +1,64 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "catch2/catch.hpp"
+
+#include <string>
+
+#include <exec.h>
+
+static exec_values parse(const std::string &output) {
+  exec_values values;
+  parse_exec_values(output.data(), output.size(), values);
+  return values;
+}
+
+TEST_CASE("parse_exec_values reads what execmulti commands print") {
+  SECTION("key=value lines") {
+    exec_values values = parse("temp = 41\nfan=900 rpm\r\n# a=comment\nx\n");
+    REQUIRE(values == exec_values{{"fan", "900 rpm"}, {"temp", "41"}});
+  }
+
+  SECTION("the last of repeated keys counts") {
+    REQUIRE(parse("a=1\nb=2\na=3") == exec_values{{"a", "3"}, {"b", "2"}});
+  }
+
+  SECTION("JSON with nested keys") {
+    exec_values values = parse(
+        " {\"cpu\": {\"temp\": 40.5, \"name\": \"x\\\"86\\u00e9\"},"
+        " \"fans\": [900, null], \"ok\": true, \"e\": {}}\n");
+    REQUIRE(values == exec_values{{"cpu.name", "x\"86\xc3\xa9"},
+                                  {"cpu.temp", "40.5"},
+                                  {"fans.0", "900"},
+                                  {"fans.1", ""},
+                                  {"ok", "true"}});
+  }
+
+  SECTION("invalid JSON keeps what came before the error") {
+    REQUIRE(parse("{\"a\": 1, \"b\": }") == exec_values{{"a", "1"}});
+  }
+}
@@ -0,0 +1,134 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <conky.h>
+#include <file-watch.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+void write_file(const std::string &path, const char *text) {
+  FILE *fp = fopen(path.c_str(), "w");
+  REQUIRE(fp != nullptr);
+  fputs(text, fp);
+  fclose(fp);
+}
+}  // namespace
+
+TEST_CASE("watched_file keeps what it derived until the file changes") {
+  char dir[] = "/tmp/conky-watch-XXXXXX";
+  REQUIRE(mkdtemp(dir) != nullptr);
+  const std::string path = std::string(dir) + "/flag";
+
+  current_update_time = 1;
+  auto file = conky::watched_file::get(path);
+  REQUIRE(conky::watched_file::get(path) == file);
+
+  file->refresh();
+  REQUIRE_FALSE(file->exists());
+  REQUIRE_FALSE(file->readable());
+
+  write_file(path, "one two\nthree\n");
+  current_update_time = 2;
+  file->refresh();
+  REQUIRE(file->exists());
+  REQUIRE(file->lines() == 2);
+  REQUIRE(file->words() == 3);
+  REQUIRE(file->contains("thr"));
+  REQUIRE_FALSE(file->contains("four"));
+  REQUIRE(file->head(3) == "one");
+  REQUIRE(file->head(100) == "one two\nthree\n");
+  uint64_t hash = file->hash();
+
+  SECTION("a change is seen on the next update") {
+    write_file(path, "four\n");
+    current_update_time = 3;
+    file->refresh();
+    REQUIRE(file->lines() == 1);
+    REQUIRE(file->words() == 1);
+    REQUIRE(file->contains("four"));
+    REQUIRE_FALSE(file->contains("thr"));
+    REQUIRE(file->hash() != hash);
+  }
+
+  SECTION("removing the file is seen") {
+    unlink(path.c_str());
+    current_update_time = 3;
+    file->refresh();
+    REQUIRE_FALSE(file->exists());
+    REQUIRE(file->lines() == 0);
+  }
+
+  unlink(path.c_str());
+  rmdir(dir);
+}
+
+TEST_CASE("watched_file follows links") {
+  char dir[] = "/tmp/conky-watch-XXXXXX";
+  REQUIRE(mkdtemp(dir) != nullptr);
+  const std::string link = std::string(dir) + "/resolv.conf";
+  const std::string first = std::string(dir) + "/first";
+  const std::string second = std::string(dir) + "/second";
+
+  write_file(first, "nameserver 10.0.0.1\n");
+  write_file(second, "nameserver 10.0.0.2\n");
+  REQUIRE(symlink(first.c_str(), link.c_str()) == 0);
+
+  current_update_time = 1;
+  auto file = conky::watched_file::get(link);
+  file->refresh();
+  REQUIRE(file->contains("10.0.0.1"));
+
+  write_file(first, "nameserver 10.0.0.3\n");
+  current_update_time = 2;
+  file->refresh();
+  REQUIRE(file->contains("10.0.0.3"));
+
+  const std::string tmp = link + ".tmp";
+  REQUIRE(symlink(second.c_str(), tmp.c_str()) == 0);
+  REQUIRE(rename(tmp.c_str(), link.c_str()) == 0);
+  current_update_time = 3;
+  file->refresh();
+  REQUIRE(file->contains("10.0.0.2"));
+
+  write_file(second, "nameserver 10.0.0.4\n");
+  current_update_time = 4;
+  file->refresh();
+  REQUIRE(file->contains("10.0.0.4"));
+
+  unlink(link.c_str());
+  unlink(first.c_str());
+  unlink(second.c_str());
+  rmdir(dir);
+}
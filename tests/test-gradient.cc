@@ -142,3 +142,32 @@ TEST_CASE(
   }
 #endif
 }
+
+TEST_CASE("gradient_cache hands out the same gradient until it is evicted") {
+  conky::gradient_cache cache(2);
+  int made = 0;
+  auto make = [&] {
+    ++made;
+    return conky::gradient_factory::colour_array(new unsigned long[width]);
+  };
+
+  const unsigned long *first = cache.get(0, width, 1, 2, make);
+  REQUIRE(cache.get(0, width, 1, 2, make) == first);
+  REQUIRE(made == 1);
+
+  SECTION("any part of the key tells gradients apart") {
+    cache.get(1, width, 1, 2, make);
+    cache.get(0, width + 1, 1, 2, make);
+    REQUIRE(made == 3);
+  }
+
+  SECTION("the least recently used one goes first") {
+    cache.get(0, width, 3, 4, make);
+    REQUIRE(cache.get(0, width, 1, 2, make) == first);
+    cache.get(0, width, 5, 6, make); /* evicts 3, 4 */
+    REQUIRE(cache.get(0, width, 1, 2, make) == first);
+    REQUIRE(made == 3);
+    cache.get(0, width, 3, 4, make);
+    REQUIRE(made == 4);
+  }
+}
@@ -0,0 +1,100 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <graph-history.hh>
+
+#include <unistd.h>
+
+#include <cstdlib>
+#include <string>
+
+TEST_CASE("graph_history keeps samples across reopening") {
+  char tmpl[] = "/tmp/conky-graph-history-XXXXXX";
+  int fd = mkstemp(tmpl);
+  REQUIRE(fd != -1);
+  close(fd);
+  const std::string path = tmpl;
+  double out[4];
+
+  {
+    conky::graph_history history;
+    REQUIRE(history.open(path, 4));
+    for (int i = 1; i <= 5; ++i) { history.push(i, 100 + i); }
+  }
+
+  SECTION("samples come back newest first") {
+    conky::graph_history history;
+    REQUIRE(history.open(path, 4));
+    REQUIRE(history.width() == 4);
+    history.load(out, 4);
+    REQUIRE(out[0] == Approx(5));
+    REQUIRE(out[1] == Approx(4));
+    REQUIRE(out[3] == Approx(2));
+  }
+
+  SECTION("a new width keeps the newest samples") {
+    conky::graph_history history;
+    REQUIRE(history.open(path, 2));
+    history.load(out, 4);
+    REQUIRE(out[0] == Approx(5));
+    REQUIRE(out[1] == Approx(4));
+    REQUIRE(out[2] == Approx(0));
+
+    REQUIRE(history.open(path, 3));
+    history.push(6, 106);
+    history.load(out, 3);
+    REQUIRE(out[0] == Approx(6));
+    REQUIRE(out[1] == Approx(5));
+    REQUIRE(out[2] == Approx(4));
+  }
+
+  SECTION("time spent not running shows as zeros") {
+    conky::graph_history history;
+    REQUIRE(history.open(path, 4));
+    /* last sample at 105, now 108 with an interval of 1: 106 and 107 */
+    history.catch_up(108, 1);
+    history.push(8, 108);
+    history.load(out, 4);
+    REQUIRE(out[0] == Approx(8));
+    REQUIRE(out[1] == Approx(0));
+    REQUIRE(out[2] == Approx(0));
+    REQUIRE(out[3] == Approx(5));
+  }
+
+  SECTION("a damaged file starts over") {
+    REQUIRE(truncate(path.c_str(), 7) == 0);
+    conky::graph_history history;
+    REQUIRE(history.open(path, 4));
+    history.load(out, 4);
+    REQUIRE(out[0] == Approx(0));
+  }
+
+  unlink(path.c_str());
+}
@@ -0,0 +1,87 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <graph-ring.hh>
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+
+TEST_CASE("graph_ring keeps the newest samples first") {
+  conky::graph_ring ring;
+  ring.resize(3);
+  for (double v : {1.0, 2.0, 3.0, 4.0}) { ring.push(v); }
+
+  REQUIRE(ring[0] == 4.0);
+  REQUIRE(ring[1] == 3.0);
+  REQUIRE(ring[2] == 2.0);
+
+  SECTION("resizing keeps the newest ones") {
+    ring.resize(5);
+    REQUIRE(ring[0] == 4.0);
+    REQUIRE(ring[2] == 2.0);
+    REQUIRE(ring[3] == 0.0);
+    ring.resize(2);
+    REQUIRE(ring[0] == 4.0);
+    REQUIRE(ring[1] == 3.0);
+    REQUIRE(ring.max() == 4.0);
+  }
+}
+
+TEST_CASE("graph_ring max is the largest sample in the graph") {
+  conky::graph_ring ring;
+  std::deque<double> shown(50, 0.0);
+  ring.resize(shown.size());
+
+  srand(1);
+  for (int i = 0; i < 2000; ++i) {
+    /* runs of falling values make the deque grow */
+    double v = i % 100 < 50 ? 1000 - i % 100 : rand() % 100;
+    ring.push(v);
+    shown.push_front(v);
+    shown.pop_back();
+    REQUIRE(ring.max() == *std::max_element(shown.begin(), shown.end()));
+  }
+}
+
+TEST_CASE("graph_ring assign replaces all samples") {
+  conky::graph_ring ring;
+  const double values[] = {5, 9, 1};
+  ring.resize(3);
+  ring.push(20);
+  ring.assign(values);
+
+  REQUIRE(ring[0] == 5);
+  REQUIRE(ring[2] == 1);
+  REQUIRE(ring.max() == 9);
+  ring.push(0);
+  ring.push(0);
+  REQUIRE(ring.max() == 5);
+}
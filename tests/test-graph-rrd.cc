@@ -0,0 +1,72 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <graph-rrd.hh>
+
+TEST_CASE("graph_rrd consolidates samples per column") {
+  conky::graph_rrd rrd;
+  double out[6];
+
+  SECTION("short spans use one second buckets") {
+    for (int t = 0; t < 6; ++t) { rrd.push(t, 1000 + t); }
+    rrd.fill(out, 6, 6, 1005.5);
+    REQUIRE(out[0] == Approx(5));
+    REQUIRE(out[5] == Approx(0));
+  }
+
+  SECTION("a column consolidates every sample within it") {
+    for (int t = 0; t < 60; ++t) { rrd.push(t % 2 == 0 ? 1 : 3, 1000 + t); }
+    rrd.fill(out, 6, 60, 1060);
+    REQUIRE(out[0] == Approx(2));
+    rrd.fill(out, 6, 60, 1060, conky::graph_rrd::MINIMUM);
+    REQUIRE(out[0] == Approx(1));
+    rrd.fill(out, 6, 60, 1060, conky::graph_rrd::MAXIMUM);
+    REQUIRE(out[0] == Approx(3));
+  }
+
+  SECTION("long spans come from coarser levels") {
+    /* one sample a minute for six hours */
+    for (int m = 0; m < 360; ++m) { rrd.push(m < 300 ? 0 : 10, 60.0 * m); }
+    rrd.fill(out, 6, 6 * 3600, 360 * 60);
+    REQUIRE(out[0] == Approx(10));
+    REQUIRE(out[1] == Approx(0));
+    REQUIRE(out[5] == Approx(0));
+  }
+
+  SECTION("columns without samples repeat the one before") {
+    rrd.push(4, 1000);
+    rrd.push(8, 1005);
+    rrd.fill(out, 6, 6, 1006);
+    REQUIRE(out[0] == Approx(8));
+    REQUIRE(out[1] == Approx(4));
+    REQUIRE(out[4] == Approx(4));
+    REQUIRE(out[5] == Approx(4));
+  }
+}
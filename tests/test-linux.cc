@@ -28,9 +28,77 @@
 
 #include "catch2/catch.hpp"
 
+#include <key-table.hh>
 #include <linux.h>
 
+#include <string>
+#include <vector>
+
 TEST_CASE("get_entropy_avail returns 0", "[get_entropy_avail]") {
   unsigned int unused = 0;
   REQUIRE(get_entropy_avail(&unused) == 0);
 }
+
+TEST_CASE("scan_decimal parses numbers of any length", "[scan_decimal]") {
+  unsigned long long value;
+
+  SECTION("short numbers") {
+    const char text[] = " 42 7";
+    const char *end = text + sizeof(text) - 1;
+    const char *p = scan_decimal(text, end, &value);
+    REQUIRE(value == 42);
+    p = scan_decimal(p, end, &value);
+    REQUIRE(value == 7);
+    REQUIRE(p == end);
+  }
+
+  SECTION("eight digits and more") {
+    const char text[] = "cpu0 12345678 1234567890123456789 98765432x";
+    const char *end = text + sizeof(text) - 1;
+    const char *p = scan_decimal(text + 3, end, &value);
+    REQUIRE(value == 0);
+    p = scan_decimal(p, end, &value);
+    REQUIRE(value == 12345678);
+    p = scan_decimal(p, end, &value);
+    REQUIRE(value == 1234567890123456789ULL);
+    p = scan_decimal(p, end, &value);
+    REQUIRE(value == 98765432);
+    REQUIRE(*p == 'x');
+  }
+
+  SECTION("stopping at end") {
+    const char text[] = "123456789";
+    const char *p = scan_decimal(text, text + 4, &value);
+    REQUIRE(value == 1234);
+    REQUIRE(p == text + 4);
+  }
+}
+
+TEST_CASE("key_table finds its keys", "[key_table]") {
+  static constexpr auto keys =
+      conky::make_key_table("MemTotal", "MemFree", "Cached", "some", "full");
+  static_assert(keys.find("Cached") == 2, "found at compile time");
+
+  REQUIRE(keys.find("MemTotal") == 0);
+  REQUIRE(keys.find("full") == 4);
+  REQUIRE(keys.find("SwapCached") == keys.npos);
+  REQUIRE(keys.find("") == keys.npos);
+
+  SECTION("for_each_key_value reads every line format") {
+    const char text[] =
+        "MemTotal:       16318412 kB\n"
+        "SwapCached:            0 kB\n"
+        "Cached 42\n"
+        "some avg10=0.50 total=7\n"
+        "full=3";
+    std::vector<std::string> seen;
+    conky::for_each_key_value(
+        text, text + sizeof(text) - 1, keys,
+        [&](size_t key, const char *value, const char *eol) {
+          seen.push_back(std::to_string(key) + ":" +
+                         std::string(value, eol - value));
+        });
+    REQUIRE(seen == std::vector<std::string>{"0:16318412 kB", "2:42",
+                                             "3:avg10=0.50 total=7", "4:3"});
+  }
+}
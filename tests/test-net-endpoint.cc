@@ -0,0 +1,88 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <net-endpoint.hh>
+
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include <string>
+
+/* a listening socket on a free port of the loopback address */
+static int listen_loopback(std::string &port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in addr {};
+  socklen_t len = sizeof(addr);
+
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(fd, reinterpret_cast<struct sockaddr *>(&addr), len);
+  listen(fd, 4);
+  getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len);
+  port = std::to_string(ntohs(addr.sin_port));
+  return fd;
+}
+
+TEST_CASE("net_endpoint connects and backs off") {
+  std::string port;
+  int server = listen_loopback(port);
+
+  SECTION("users of the same endpoint share it") {
+    auto a = conky::net_endpoint::get("127.0.0.1", port, AF_INET);
+    auto b = conky::net_endpoint::get("127.0.0.1", port, AF_INET);
+    REQUIRE(a == b);
+    REQUIRE(a != conky::net_endpoint::get("127.0.0.1", port, AF_INET6));
+  }
+
+  SECTION("a listening server is connected to") {
+    auto endpoint = conky::net_endpoint::get("127.0.0.1", port, AF_INET);
+    REQUIRE(endpoint->ready());
+    int fd = endpoint->connect(1);
+    REQUIRE(fd != -1);
+    close(fd);
+    REQUIRE(endpoint->ready());
+  }
+
+  SECTION("failures hold off the next attempts until a success") {
+    auto endpoint = conky::net_endpoint::get("127.0.0.1", port, AF_INET);
+    endpoint->failed();
+    REQUIRE_FALSE(endpoint->ready());
+    endpoint->succeeded();
+    REQUIRE(endpoint->ready());
+  }
+
+  close(server);
+
+  SECTION("a refused connection counts as a failure") {
+    auto endpoint = conky::net_endpoint::get("127.0.0.1", port, AF_INET);
+    REQUIRE(endpoint->connect(1) == -1);
+    REQUIRE_FALSE(endpoint->ready());
+  }
+}
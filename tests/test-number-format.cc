@@ -0,0 +1,77 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <string>
+
+#include <number-format.hh>
+
+TEST_CASE("text_writer prints like snprintf") {
+  char buf[32];
+  char expected[32];
+
+  SECTION("integers") {
+    const long long values[] = {0, 7, -7, 1000, LLONG_MAX, LLONG_MIN};
+    for (long long value : values) {
+      conky::text_writer out(buf, sizeof(buf));
+      int len = out.append(value).finish();
+      REQUIRE(len == snprintf(expected, sizeof(expected), "%lld", value));
+      REQUIRE(std::string(buf) == expected);
+    }
+  }
+
+  SECTION("fixed point numbers round the same way") {
+    const double values[] = {0, 0.005, 1.125, 9.995, 99.95, 123.456, -2.5};
+    for (double value : values) {
+      for (int precision = 0; precision <= 3; ++precision) {
+        conky::text_writer out(buf, sizeof(buf));
+        int len = out.append_fixed(value, precision).finish();
+        REQUIRE(len ==
+                snprintf(expected, sizeof(expected), "%.*f", precision, value));
+        REQUIRE(std::string(buf) == expected);
+      }
+    }
+  }
+
+  SECTION("text that doesn't fit is cut off and counted") {
+    conky::text_writer out(buf, 8);
+    int len = out.append(12345).append("h ").fill(' ', 3).append(678).finish();
+    REQUIRE(len == 13);
+    REQUIRE(std::string(buf) == "12345h ");
+  }
+
+  SECTION("an empty buffer is left alone") {
+    buf[0] = 'x';
+    conky::text_writer out(buf, 0);
+    REQUIRE(out.append("abc").finish() == 3);
+    REQUIRE(buf[0] == 'x');
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <string>
+#include <thread>
+
+#include <profiling.hh>
+
+namespace {
+size_t count(const std::string &haystack, const std::string &needle) {
+  size_t n = 0;
+  for (size_t i = haystack.find(needle); i != std::string::npos;
+       i = haystack.find(needle, i + 1)) {
+    ++n;
+  }
+  return n;
+}
+}  // namespace
+
+TEST_CASE("traces are exported in the Chrome trace event format") {
+  using namespace conky::profile;
+
+  enable_tracing("");
+  REQUIRE(tracing());
+
+  { span s("test \"quoted\" span"); }
+  std::thread([] {
+    for (int i = 0; i < 3000; ++i) { span s("test wrapped span"); }
+  }).join();
+
+  std::string json = trace_json();
+  REQUIRE(json.compare(0, 15, "{\"displayTimeUn") == 0);
+  REQUIRE(json.substr(json.size() - 3) == "]}\n");
+  REQUIRE(count(json, "\"name\":\"main\"") == 1);
+  REQUIRE(count(json, "\"name\":\"test \\\"quoted\\\" span\"") == 1);
+  /* only the last events of a thread are kept */
+  REQUIRE(count(json, "\"name\":\"test wrapped span\"") == 2048);
+}
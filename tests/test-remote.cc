@@ -0,0 +1,74 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <remote.h>
+
+#include <string>
+
+TEST_CASE("apply_remote_frame decodes out_to_socket frames") {
+  remote_frames frames;
+  /* 2 values at 10 ms: 3 and -4, zigzag encoded */
+  const std::string key("K\x02\x14\x06\x07", 5);
+  /* 5 ms later: -1 and +6 */
+  const std::string delta("D\x02\x0a\x01\x0c", 5);
+
+  SECTION("a key frame sets the values") {
+    REQUIRE(apply_remote_frame(key.data(), key.size(), frames));
+    REQUIRE(frames.synced);
+    REQUIRE(frames.time == 10);
+    REQUIRE(frames.values == std::vector<int64_t>{3, -4});
+  }
+
+  SECTION("a delta frame adds to the previous one") {
+    REQUIRE(apply_remote_frame(key.data(), key.size(), frames));
+    REQUIRE(apply_remote_frame(delta.data(), delta.size(), frames));
+    REQUIRE(frames.time == 15);
+    REQUIRE(frames.values == std::vector<int64_t>{2, 2});
+  }
+
+  SECTION("a delta frame needs a key frame first") {
+    REQUIRE_FALSE(apply_remote_frame(delta.data(), delta.size(), frames));
+    REQUIRE_FALSE(frames.synced);
+  }
+
+  SECTION("broken frames are rejected and leave the values alone") {
+    REQUIRE(apply_remote_frame(key.data(), key.size(), frames));
+    const std::string shorter = key.substr(0, key.size() - 1);
+    const std::string longer = key + '\x00';
+    const std::string other = "X" + key.substr(1);
+    const std::string fewer("D\x01\x0a\x01", 4);
+    REQUIRE_FALSE(apply_remote_frame(shorter.data(), shorter.size(), frames));
+    REQUIRE_FALSE(apply_remote_frame(longer.data(), longer.size(), frames));
+    REQUIRE_FALSE(apply_remote_frame(other.data(), other.size(), frames));
+    REQUIRE_FALSE(apply_remote_frame(fewer.data(), fewer.size(), frames));
+    REQUIRE(frames.time == 10);
+    REQUIRE(frames.values == std::vector<int64_t>{3, -4});
+  }
+}
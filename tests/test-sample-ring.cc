@@ -0,0 +1,108 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <sample-ring.hh>
+
+TEST_CASE("sample_ring averages the last samples") {
+  conky::sample_ring<double> ring(4);
+
+  SECTION("samples not pushed yet count as 0") {
+    ring.push(8);
+    REQUIRE(ring.sum() == Approx(8));
+    REQUIRE(ring.average() == Approx(2));
+  }
+
+  SECTION("old samples drop out") {
+    for (int i = 1; i <= 6; ++i) { ring.push(i); }
+    REQUIRE(ring.sum() == Approx(3 + 4 + 5 + 6));
+    REQUIRE(ring.average() == Approx(4.5));
+  }
+
+  SECTION("resizing keeps the newest samples") {
+    for (int i = 1; i <= 5; ++i) { ring.push(i); }
+    ring.set_window(2);
+    REQUIRE(ring.window() == 2);
+    REQUIRE(ring.sum() == Approx(4 + 5));
+    ring.push(6);
+    REQUIRE(ring.sum() == Approx(5 + 6));
+
+    ring.set_window(3);
+    REQUIRE(ring.sum() == Approx(5 + 6));
+    ring.push(7);
+    REQUIRE(ring.sum() == Approx(5 + 6 + 7));
+    ring.push(8);
+    REQUIRE(ring.sum() == Approx(6 + 7 + 8));
+  }
+
+  SECTION("clear forgets everything") {
+    ring.push(3);
+    ring.clear();
+    REQUIRE(ring.sum() == 0);
+    ring.push(4);
+    REQUIRE(ring.average() == Approx(1));
+  }
+}
+
+TEST_CASE("sample_block averages the last samples of each series") {
+  conky::sample_block<double> block(2, 3);
+
+  SECTION("series are averaged apart") {
+    for (int i = 1; i <= 4; ++i) {
+      double values[] = {static_cast<double>(i), 10.0 * i};
+      block.push(values);
+    }
+    float averages[2];
+    block.averages(averages);
+    REQUIRE(block.sums()[0] == Approx(2 + 3 + 4));
+    REQUIRE(averages[0] == Approx(3));
+    REQUIRE(averages[1] == Approx(30));
+  }
+
+  SECTION("resizing keeps the newest samples") {
+    for (int i = 1; i <= 5; ++i) {
+      double values[] = {static_cast<double>(i), 0};
+      block.push(values);
+    }
+    block.resize(2, 2);
+    REQUIRE(block.window() == 2);
+    REQUIRE(block.sums()[0] == Approx(4 + 5));
+    double values[] = {6, 0};
+    block.push(values);
+    REQUIRE(block.sums()[0] == Approx(5 + 6));
+  }
+
+  SECTION("another number of series starts over") {
+    double values[] = {1, 2};
+    block.push(values);
+    block.resize(3, 3);
+    REQUIRE(block.count() == 3);
+    REQUIRE(block.sums()[1] == 0);
+  }
+}
@@ -0,0 +1,62 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <semaphore.hh>
+
+TEST_CASE("completion_latch waits for every arrival") {
+  completion_latch latch;
+
+  SECTION("without any work") { latch.wait(); }
+
+  SECTION("with work finishing on other threads") {
+    const int n = 8;
+    std::atomic<int> finished(0);
+    std::vector<std::thread> threads;
+
+    for (int round = 0; round < 100; ++round) {
+      finished = 0;
+      latch.add(n);
+      for (int i = 0; i < n; ++i) {
+        threads.emplace_back([&] {
+          ++finished;
+          latch.arrive();
+        });
+      }
+      latch.wait(round % 2 == 0 ? 1e-5 : 0);
+      REQUIRE(finished == n);
+      for (auto &t : threads) { t.join(); }
+      threads.clear();
+    }
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include "conky.h"
+#include "lua-config.hh"
+#include "setting.hh"
+
+namespace {
+conky::simple_config_setting<std::string> test_string("test_string", "default",
+                                                      true);
+
+void run(const char *code) {
+  state->loadstring(code);
+  state->call(0, 0);
+}
+}  // namespace
+
+TEST_CASE("settings follow changes made to conky.config", "[setting]") {
+  state = std::make_unique<lua::state>();
+  conky::export_symbols(*state);
+
+  run("conky.config = { out_to_console = false,"
+#ifdef BUILD_X11
+      " out_to_x = false,"
+#endif
+      " update_interval = 3, test_string = 'first' }");
+  conky::invalidate_config_settings();
+  REQUIRE(update_interval.get(*state) == 3);
+  REQUIRE(test_string.get(*state) == "first");
+
+  conky::set_config_settings(*state);
+  REQUIRE(update_interval.get(*state) == 3);
+  REQUIRE(test_string.get(*state) == "first");
+
+  SECTION("assignments from lua are seen by the next get()") {
+    run("conky.config.update_interval = 5 conky.config.test_string = 'second'");
+    REQUIRE(update_interval.get(*state) == 5);
+    REQUIRE(test_string.get(*state) == "second");
+  }
+
+  SECTION("values set from C++ are seen by the next get()") {
+    state->pushnumber(7);
+    update_interval.lua_set(*state);
+    REQUIRE(update_interval.get(*state) == 7);
+  }
+
+  SECTION("rejected values leave the cached value alone") {
+    run("conky.config.update_interval = -1");
+    REQUIRE(update_interval.get(*state) == 3);
+  }
+
+  conky::cleanup_config_settings(*state);
+  state.reset();
+}
@@ -0,0 +1,99 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include "catch2/catch.hpp"
+
+#include <map>
+#include <string>
+
+#include <template.h>
+
+namespace {
+std::map<std::string, std::string> bodies;
+int lookups = 0;
+
+bool lookup(const std::string &name, std::string &body) {
+  ++lookups;
+  auto it = bodies.find(name);
+  if (it == bodies.end()) { return false; }
+  body = it->second;
+  return true;
+}
+}  // namespace
+
+TEST_CASE("template_expander substitutes arguments") {
+  bodies = {{"template0", "$\\1\\2"},
+            {"template1", "\\1: ${fs_used \\2} / ${fs_size \\2}"},
+            {"template2", "\\1\\ \\2"},
+            {"disk", "<\\1>"}};
+  conky::template_expander expander(&lookup);
+
+  SECTION("numbered and plain text") {
+    REQUIRE(expander.expand("a ${template0 node name} b") == "a $nodename b");
+    REQUIRE(expander.expand("${template1 root /}") ==
+            "root: ${fs_used /} / ${fs_size /}");
+    REQUIRE(expander.expand("$template0") == "$12");
+    REQUIRE(expander.expand("$alignr ${cpu}") == "$alignr ${cpu}");
+  }
+
+  SECTION("escapes in arguments") {
+    REQUIRE(expander.expand("${template2 a\\ b c}") == "a b c");
+    REQUIRE(expander.expand("${template1 x\\\\y /}") ==
+            "x\\y: ${fs_used /} / ${fs_size /}");
+  }
+
+  SECTION("named templates") {
+    REQUIRE(expander.expand("${template disk sda}") == "<sda>");
+  }
+
+  SECTION("nested templates expand in one pass") {
+    bodies["outer"] = "[${template disk \\1}]";
+    REQUIRE(expander.expand("${template outer sdb}") == "[<sdb>]");
+  }
+
+  SECTION("unknown templates expand to nothing") {
+    REQUIRE(expander.expand("a${template nope x}b") == "ab");
+  }
+
+  SECTION("recursion stops") {
+    bodies["loop"] = "x${template loop}";
+    std::string out = expander.expand("${template loop}");
+    REQUIRE(out == std::string(conky::template_expander::MAX_DEPTH, 'x'));
+    REQUIRE(expander.expand("${template loop}") == out);
+  }
+
+  SECTION("expansions are remembered until forgotten") {
+    expander.expand("${template disk sda}");
+    lookups = 0;
+    REQUIRE(expander.expand("${template disk sda} ${template disk sda}") ==
+            "<sda> <sda>");
+    REQUIRE(lookups == 0);
+    bodies["disk"] = "(\\1)";
+    expander.forget();
+    REQUIRE(expander.expand("${template disk sda}") == "(sda)");
+  }
+}
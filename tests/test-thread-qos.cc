@@ -0,0 +1,54 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <thread-qos.hh>
+
+TEST_CASE("parse_cpu_list reads lists the way the kernel prints them") {
+  std::vector<int> cpus;
+
+  REQUIRE(conky::parse_cpu_list("0-3,8", cpus));
+  REQUIRE(cpus == std::vector<int>{0, 1, 2, 3, 8});
+
+  REQUIRE(conky::parse_cpu_list("16-19\n", cpus));
+  REQUIRE(cpus == std::vector<int>{16, 17, 18, 19});
+
+  SECTION("an empty list keeps every CPU") {
+    REQUIRE(conky::parse_cpu_list("", cpus));
+    REQUIRE(cpus.empty());
+  }
+
+  SECTION("malformed lists are rejected") {
+    REQUIRE_FALSE(conky::parse_cpu_list("3-1", cpus));
+    REQUIRE_FALSE(conky::parse_cpu_list("0,,1", cpus));
+    REQUIRE_FALSE(conky::parse_cpu_list("a", cpus));
+    REQUIRE_FALSE(conky::parse_cpu_list("0-", cpus));
+    REQUIRE_FALSE(conky::parse_cpu_list("-1", cpus));
+  }
+}
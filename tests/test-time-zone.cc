@@ -0,0 +1,138 @@
+/*
+ *
+ * Conky, a system monitor, based on torsmo
+ *
+ * Any original torsmo code is licensed under the BSD license
+ *
+ * All code written since the fork of torsmo is licensed under the GPL
+ *
+ * Please see COPYING for details
+ *
+ * Copyright (c) 2005-2021 Brenden Matthews, Philip Kovacs, et. al.
+ *	(see AUTHORS)
+ * All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "catch2/catch.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+#include <unistd.h>
+
+#include <time-zone.hh>
+
+namespace {
+
+/* what the C library makes of the time with TZ set to name */
+struct tm libc_localtime(const char *name, time_t t) {
+  struct tm tm;
+  const char *old = getenv("TZ");
+  std::string saved = old != nullptr ? old : "";
+
+  setenv("TZ", name, 1);
+  tzset();
+  localtime_r(&t, &tm);
+  if (old != nullptr) {
+    setenv("TZ", saved.c_str(), 1);
+  } else {
+    unsetenv("TZ");
+  }
+  tzset();
+  return tm;
+}
+
+void check_like_libc(const char *name, time_t t) {
+  struct tm expected = libc_localtime(name, t);
+  struct tm tm;
+  conky::time_zone::get(name).localtime(t, &tm);
+
+  INFO(name << " at " << t);
+  REQUIRE(tm.tm_year == expected.tm_year);
+  REQUIRE(tm.tm_yday == expected.tm_yday);
+  REQUIRE(tm.tm_hour == expected.tm_hour);
+  REQUIRE(tm.tm_min == expected.tm_min);
+  REQUIRE(tm.tm_isdst == expected.tm_isdst);
+  REQUIRE(tm.tm_gmtoff == expected.tm_gmtoff);
+  REQUIRE(std::string(tm.tm_zone) == expected.tm_zone);
+}
+
+}  // namespace
+
+TEST_CASE("time_zone parses POSIX TZ strings") {
+  conky::time_zone::rule r;
+
+  REQUIRE(conky::time_zone::parse_rule("CET-1CEST,M3.5.0,M10.5.0/3", r));
+  REQUIRE(r.std_abbr == "CET");
+  REQUIRE(r.dst_abbr == "CEST");
+  REQUIRE(r.std_offset == 3600);
+  REQUIRE(r.dst_offset == 7200);
+  REQUIRE(r.start.kind == 'M');
+  REQUIRE(r.start.month == 3);
+  REQUIRE(r.start.week == 5);
+  REQUIRE(r.start.time == 7200);
+  REQUIRE(r.end.time == 3 * 3600);
+
+  REQUIRE(conky::time_zone::parse_rule("<+0330>-3:30", r));
+  REQUIRE(r.std_abbr == "+0330");
+  REQUIRE(r.std_offset == 3 * 3600 + 30 * 60);
+  REQUIRE_FALSE(r.has_dst);
+
+  REQUIRE_FALSE(conky::time_zone::parse_rule("", r));
+  REQUIRE_FALSE(conky::time_zone::parse_rule("Europe/Berlin", r));
+  REQUIRE_FALSE(conky::time_zone::parse_rule("EST5EDT,M3.2.0", r));
+  REQUIRE_FALSE(conky::time_zone::parse_rule("EST5EDT,M13.2.0,M11.1.0", r));
+}
+
+TEST_CASE("time_zone converts like the C library") {
+  /* 2021-03-28 00:59:59 UTC, one second before Europe switches */
+  const time_t switch_eu = 1616893199;
+  const time_t times[] = {0,          switch_eu,  switch_eu + 1,
+                          1635641999, 1635642000, 1700000000,
+                          1720000000, 2200000000, 4000000000};
+
+  SECTION("with POSIX TZ strings") {
+    for (const char *name :
+         {"UTC0", "CET-1CEST,M3.5.0,M10.5.0/3", "EST5EDT,M3.2.0,M11.1.0",
+          "AEST-10AEDT,M10.1.0,M4.1.0/3", "<-03>3",
+          "IST-1GMT0,M10.5.0,M3.5.0/1", "NZST-12NZDT,M9.5.0,M4.1.0/3"}) {
+      for (time_t t : times) { check_like_libc(name, t); }
+    }
+  }
+
+  SECTION("with zoneinfo files") {
+    for (const char *name : {"Europe/Berlin", "America/New_York",
+                             "Australia/Sydney", "Asia/Kolkata", "UTC"}) {
+      std::string path = std::string("/usr/share/zoneinfo/") + name;
+      if (getenv("TZDIR") != nullptr || access(path.c_str(), R_OK) != 0) {
+        continue;
+      }
+      for (time_t t : times) { check_like_libc(name, t); }
+    }
+  }
+}
+
+TEST_CASE("time_zone falls back to UTC") {
+  struct tm tm;
+  conky::time_zone::get("No/Such_Zone").localtime(86400 + 3600, &tm);
+
+  REQUIRE(tm.tm_mday == 2);
+  REQUIRE(tm.tm_hour == 1);
+  REQUIRE(tm.tm_gmtoff == 0);
+  REQUIRE(std::string(tm.tm_zone) == "UTC");
+}